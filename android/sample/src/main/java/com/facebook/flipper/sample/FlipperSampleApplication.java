@@ -14,6 +14,7 @@ import com.facebook.sonar.plugins.litho.LithoSonarDescriptors;
 import com.facebook.sonar.plugins.network.NetworkSonarPlugin;
 import com.facebook.sonar.plugins.network.SonarOkhttpInterceptor;
 import com.facebook.sonar.plugins.sharedpreferences.SharedPreferencesSonarPlugin;
+import java.io.File;
 import java.util.concurrent.TimeUnit;
 import okhttp3.OkHttpClient;
 
@@ -21,11 +22,26 @@ public class FlipperSampleApplication extends Application {
 
   public static OkHttpClient okhttpClient;
 
+  /**
+   * False when files/sonar-disabled exists, so that {@link PerfScenarioActivity} can measure the
+   * app without Sonar at all.
+   */
+  public static boolean sonarStarted;
+
   @Override
   public void onCreate() {
     super.onCreate();
     SoLoader.init(this, false);
 
+    if (new File(getFilesDir(), "sonar-disabled").exists()) {
+      okhttpClient = new OkHttpClient.Builder()
+      .connectTimeout(60, TimeUnit.SECONDS)
+      .readTimeout(60, TimeUnit.SECONDS)
+      .writeTimeout(10, TimeUnit.MINUTES)
+      .build();
+      return;
+    }
+
     final SonarClient client = AndroidSonarClient.getInstance(this);
     final DescriptorMapping descriptorMapping = DescriptorMapping.withDefaults();
 
@@ -45,6 +61,7 @@ public class FlipperSampleApplication extends Application {
     client.addPlugin(new SharedPreferencesSonarPlugin(this, "sample"));
     client.addPlugin(new LeakCanarySonarPlugin());
     client.start();
+    sonarStarted = true;
 
     getSharedPreferences("sample", Context.MODE_PRIVATE).edit().putString("Hello", "world").apply();
   }
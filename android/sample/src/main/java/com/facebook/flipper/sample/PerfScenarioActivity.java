@@ -0,0 +1,501 @@
+// Copyright 2004-present Facebook. All Rights Reserved.
+
+package com.facebook.flipper.sample;
+
+import android.app.Activity;
+import android.content.Context;
+import android.content.SharedPreferences;
+import android.os.Build;
+import android.os.Bundle;
+import android.os.Debug;
+import android.os.Handler;
+import android.os.Process;
+import android.os.SystemClock;
+import android.support.v7.widget.LinearLayoutManager;
+import android.support.v7.widget.RecyclerView;
+import android.util.Log;
+import android.view.Choreographer;
+import android.view.ViewGroup;
+import android.widget.LinearLayout;
+import android.widget.TextView;
+import com.facebook.sonar.android.AndroidSonarClient;
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.util.Arrays;
+import java.util.concurrent.atomic.AtomicInteger;
+import okhttp3.Call;
+import okhttp3.Callback;
+import okhttp3.Request;
+import okhttp3.Response;
+import org.json.JSONArray;
+import org.json.JSONException;
+import org.json.JSONObject;
+
+/**
+ * Runs scripted scenarios that stress what Sonar's plugins watch, and measures frame times, CPU
+ * and memory while they run, to tell how much overhead Sonar adds. Started with
+ *
+ * <pre>
+ * adb shell am start -n com.facebook.flipper.sample/.PerfScenarioActivity --es mode idle
+ * </pre>
+ *
+ * where mode is disabled, idle, which runs with Sonar started but no desktop, or desktop, which
+ * waits for a desktop to open the Inspector. For disabled, the app is started without Sonar after
+ * adb shell run-as com.facebook.flipper.sample touch files/sonar-disabled, which is removed the
+ * same way afterwards. Otherwise disabled only stops the client, which is reported as
+ * sonarStarted. Each scenario runs
+ * for phaseMs, 10 seconds unless given with --ei. The report is logged under the SonarPerf tag as
+ * a single line of JSON, and written to sonar-perf-[mode].json in the app's external files
+ * directory, for adb pull.
+ */
+public class PerfScenarioActivity extends Activity {
+
+  private static final String TAG = "SonarPerf";
+  private static final long DEFAULT_PHASE_MS = 10000;
+  private static final long SETTLE_MS = 2000;
+  private static final long DESKTOP_TIMEOUT_MS = 30000;
+  private static final long FRAME_NANOS = 16666667;
+
+  private final Handler mHandler = new Handler();
+  private final JSONArray mPhases = new JSONArray();
+  private String mMode;
+  private long mPhaseMs;
+  private boolean mDesktopConnected;
+  private PerfScenarioServer mServer;
+
+  @Override
+  protected void onCreate(Bundle savedInstanceState) {
+    super.onCreate(savedInstanceState);
+    mMode = getIntent().getStringExtra("mode");
+    if (mMode == null) {
+      mMode = "idle";
+    }
+    mPhaseMs = getIntent().getIntExtra("phaseMs", (int) DEFAULT_PHASE_MS);
+    setContentView(status("Starting " + mMode));
+
+    if (mMode.equals("disabled") && FlipperSampleApplication.sonarStarted) {
+      Log.w(TAG, "Sonar was started, so its plugins are only disconnected");
+      AndroidSonarClient.getInstance(this).stop();
+    }
+    try {
+      mServer = new PerfScenarioServer();
+      mServer.start();
+    } catch (IOException e) {
+      Log.e(TAG, "Couldn't start the local server", e);
+      finish();
+      return;
+    }
+    waitForDesktop(SystemClock.uptimeMillis() + DESKTOP_TIMEOUT_MS);
+  }
+
+  @Override
+  protected void onDestroy() {
+    super.onDestroy();
+    mHandler.removeCallbacksAndMessages(null);
+    if (mServer != null) {
+      mServer.stop();
+    }
+  }
+
+  private void waitForDesktop(final long deadline) {
+    mDesktopConnected =
+        FlipperSampleApplication.sonarStarted
+            && AndroidSonarClient.getInstance(this).isPluginActive("Inspector");
+    if (mMode.equals("desktop") && !mDesktopConnected && SystemClock.uptimeMillis() < deadline) {
+      setContentView(status("Waiting for a desktop to open the Inspector"));
+      mHandler.postDelayed(
+          new Runnable() {
+            @Override
+            public void run() {
+              waitForDesktop(deadline);
+            }
+          },
+          500);
+      return;
+    }
+    final Phase[] phases = {
+      new Phase("baseline"),
+      new HierarchyPhase(),
+      new ScrollPhase(),
+      new NetworkPhase(),
+      new PreferencesPhase(),
+    };
+    mHandler.postDelayed(
+        new Runnable() {
+          @Override
+          public void run() {
+            runPhase(phases, 0);
+          }
+        },
+        SETTLE_MS);
+  }
+
+  private void runPhase(final Phase[] phases, final int index) {
+    if (index == phases.length) {
+      report();
+      finish();
+      return;
+    }
+    final Phase phase = phases[index];
+    phase.start();
+    final FrameRecorder recorder = new FrameRecorder(phase);
+    final long cpuStart = Process.getElapsedCpuTime();
+    final long wallStart = SystemClock.elapsedRealtime();
+    Choreographer.getInstance().postFrameCallback(recorder);
+
+    mHandler.postDelayed(
+        new Runnable() {
+          @Override
+          public void run() {
+            recorder.stop();
+            final long cpuMs = Process.getElapsedCpuTime() - cpuStart;
+            final long wallMs = SystemClock.elapsedRealtime() - wallStart;
+            try {
+              final JSONObject result =
+                  new JSONObject()
+                      .put("name", phase.mName)
+                      .put("wallMs", wallMs)
+                      .put("cpuMs", cpuMs)
+                      .put("cpuPercent", wallMs > 0 ? 100.0 * cpuMs / wallMs : 0)
+                      .put("frames", recorder.stats())
+                      .put("memory", memory());
+              phase.stop(result);
+              mPhases.put(result);
+            } catch (JSONException e) {
+              Log.e(TAG, "Couldn't record " + phase.mName, e);
+            }
+            // Lets the work a phase queued, such as network callbacks, drain before the next.
+            mHandler.postDelayed(
+                new Runnable() {
+                  @Override
+                  public void run() {
+                    runPhase(phases, index + 1);
+                  }
+                },
+                SETTLE_MS);
+          }
+        },
+        mPhaseMs);
+  }
+
+  private void report() {
+    try {
+      final JSONObject report =
+          new JSONObject()
+              .put("platform", "android")
+              .put("mode", mMode)
+              .put("sonarStarted", FlipperSampleApplication.sonarStarted)
+              .put("desktopConnected", mDesktopConnected)
+              .put("device", Build.MANUFACTURER + " " + Build.MODEL)
+              .put("sdk", Build.VERSION.SDK_INT)
+              .put("phaseMs", mPhaseMs)
+              .put("phases", mPhases);
+      if (FlipperSampleApplication.sonarStarted) {
+        report.put("sonar", new JSONObject(AndroidSonarClient.getInstance(this).getMetrics()));
+      }
+      final String json = report.toString();
+      Log.i(TAG, json);
+      final File file = new File(getExternalFilesDir(null), "sonar-perf-" + mMode + ".json");
+      final FileOutputStream out = new FileOutputStream(file);
+      try {
+        out.write(json.getBytes("UTF-8"));
+      } finally {
+        out.close();
+      }
+      Log.i(TAG, "Report written to " + file);
+    } catch (JSONException e) {
+      Log.e(TAG, "Couldn't write the report", e);
+    } catch (IOException e) {
+      Log.e(TAG, "Couldn't write the report", e);
+    }
+  }
+
+  private static JSONObject memory() throws JSONException {
+    final Runtime runtime = Runtime.getRuntime();
+    return new JSONObject()
+        .put("javaHeapKb", (runtime.totalMemory() - runtime.freeMemory()) / 1024)
+        .put("nativeHeapKb", Debug.getNativeHeapAllocatedSize() / 1024)
+        .put("pssKb", Debug.getPss());
+  }
+
+  private TextView status(String text) {
+    final TextView view = new TextView(this);
+    view.setText(text);
+    view.setTextSize(20);
+    return view;
+  }
+
+  /** Collects the interval between frames while a phase runs, and drives the phase's work. */
+  private static final class FrameRecorder implements Choreographer.FrameCallback {
+    private final Phase mPhase;
+    private long[] mIntervals = new long[1024];
+    private int mCount;
+    private long mLastFrameNanos;
+    private boolean mStopped;
+
+    FrameRecorder(Phase phase) {
+      mPhase = phase;
+    }
+
+    @Override
+    public void doFrame(long frameTimeNanos) {
+      if (mStopped) {
+        return;
+      }
+      if (mLastFrameNanos != 0) {
+        if (mCount == mIntervals.length) {
+          mIntervals = Arrays.copyOf(mIntervals, mCount * 2);
+        }
+        mIntervals[mCount++] = frameTimeNanos - mLastFrameNanos;
+      }
+      mLastFrameNanos = frameTimeNanos;
+      mPhase.frame();
+      Choreographer.getInstance().postFrameCallback(this);
+    }
+
+    void stop() {
+      mStopped = true;
+    }
+
+    JSONObject stats() throws JSONException {
+      final long[] sorted = Arrays.copyOf(mIntervals, mCount);
+      Arrays.sort(sorted);
+      int janky = 0;
+      for (long interval : sorted) {
+        // A frame that took longer than one and a half vsyncs missed one.
+        if (interval > FRAME_NANOS * 3 / 2) {
+          janky++;
+        }
+      }
+      return new JSONObject()
+          .put("count", mCount)
+          .put("janky", janky)
+          .put("p50Ms", percentileMs(sorted, 0.5))
+          .put("p90Ms", percentileMs(sorted, 0.9))
+          .put("p99Ms", percentileMs(sorted, 0.99))
+          .put("maxMs", percentileMs(sorted, 1));
+    }
+
+    private static double percentileMs(long[] sorted, double percentile) {
+      if (sorted.length == 0) {
+        return 0;
+      }
+      final int index = (int) Math.ceil(percentile * sorted.length) - 1;
+      return sorted[Math.max(0, Math.min(sorted.length - 1, index))] / 1e6;
+    }
+  }
+
+  /** A scenario. The baseline does nothing, to measure the app at rest. */
+  private class Phase {
+    final String mName;
+
+    Phase(String name) {
+      mName = name;
+    }
+
+    void start() {
+      setContentView(status(mName));
+    }
+
+    /** Called at the start of every frame while the phase runs. */
+    void frame() {}
+
+    /** Adds what the phase got done to its result. */
+    void stop(JSONObject result) throws JSONException {}
+  }
+
+  /** A deep and wide hierarchy with a label changing every frame, which lays it out again. */
+  private final class HierarchyPhase extends Phase {
+    private static final int DEPTH = 6;
+    private static final int BREADTH = 4;
+    private TextView[] mLeaves;
+    private int mViews;
+    private int mFrame;
+
+    HierarchyPhase() {
+      super("hierarchy");
+    }
+
+    @Override
+    void start() {
+      mLeaves = new TextView[(int) Math.pow(BREADTH, DEPTH)];
+      mViews = 0;
+      final LinearLayout root = new LinearLayout(PerfScenarioActivity.this);
+      build(root, 1, new int[1]);
+      setContentView(root);
+    }
+
+    private void build(ViewGroup parent, int depth, int[] leafIndex) {
+      for (int i = 0; i < BREADTH; i++) {
+        mViews++;
+        if (depth == DEPTH) {
+          final TextView leaf = new TextView(PerfScenarioActivity.this);
+          leaf.setText("0");
+          leaf.setTextSize(4);
+          parent.addView(leaf);
+          mLeaves[leafIndex[0]++] = leaf;
+          continue;
+        }
+        final LinearLayout group = new LinearLayout(PerfScenarioActivity.this);
+        group.setOrientation(depth % 2 == 0 ? LinearLayout.HORIZONTAL : LinearLayout.VERTICAL);
+        parent.addView(group);
+        build(group, depth + 1, leafIndex);
+      }
+    }
+
+    @Override
+    void frame() {
+      mFrame++;
+      mLeaves[(mFrame * 31) % mLeaves.length].setText(Integer.toString(mFrame));
+    }
+
+    @Override
+    void stop(JSONObject result) throws JSONException {
+      result.put("views", mViews);
+    }
+  }
+
+  /** Scrolls a long list back and forth, binding new rows every few frames. */
+  private final class ScrollPhase extends Phase {
+    private static final int ITEMS = 10000;
+    private RecyclerView mList;
+    private int mDirection = 1;
+    private int mBinds;
+
+    ScrollPhase() {
+      super("scroll");
+    }
+
+    @Override
+    void start() {
+      mList = new RecyclerView(PerfScenarioActivity.this);
+      mList.setLayoutManager(new LinearLayoutManager(PerfScenarioActivity.this));
+      mList.setAdapter(
+          new RecyclerView.Adapter<RecyclerView.ViewHolder>() {
+            @Override
+            public RecyclerView.ViewHolder onCreateViewHolder(ViewGroup parent, int viewType) {
+              final TextView row = new TextView(parent.getContext());
+              row.setTextSize(18);
+              row.setPadding(24, 24, 24, 24);
+              return new RecyclerView.ViewHolder(row) {};
+            }
+
+            @Override
+            public void onBindViewHolder(RecyclerView.ViewHolder holder, int position) {
+              mBinds++;
+              ((TextView) holder.itemView).setText("Row " + position);
+            }
+
+            @Override
+            public int getItemCount() {
+              return ITEMS;
+            }
+          });
+      setContentView(mList);
+    }
+
+    @Override
+    void frame() {
+      if (!mList.canScrollVertically(mDirection)) {
+        mDirection = -mDirection;
+      }
+      mList.scrollBy(0, 40 * mDirection);
+    }
+
+    @Override
+    void stop(JSONObject result) throws JSONException {
+      result.put("binds", mBinds);
+    }
+  }
+
+  /** Keeps a burst of requests to the local server in flight through the Sonar interceptor. */
+  private final class NetworkPhase extends Phase {
+    private static final int IN_FLIGHT = 8;
+    private final AtomicInteger mCompleted = new AtomicInteger();
+    private final AtomicInteger mFailed = new AtomicInteger();
+    private volatile boolean mRunning;
+
+    NetworkPhase() {
+      super("network");
+    }
+
+    @Override
+    void start() {
+      super.start();
+      mRunning = true;
+      for (int i = 0; i < IN_FLIGHT; i++) {
+        request(i);
+      }
+    }
+
+    private void request(final int sequence) {
+      final Request request =
+          new Request.Builder().url(mServer.url("/items/" + sequence + "?perf=1")).get().build();
+      FlipperSampleApplication.okhttpClient
+          .newCall(request)
+          .enqueue(
+              new Callback() {
+                @Override
+                public void onFailure(Call call, IOException e) {
+                  mFailed.incrementAndGet();
+                  next();
+                }
+
+                @Override
+                public void onResponse(Call call, Response response) throws IOException {
+                  response.body().string();
+                  mCompleted.incrementAndGet();
+                  next();
+                }
+
+                private void next() {
+                  if (mRunning) {
+                    request(sequence + IN_FLIGHT);
+                  }
+                }
+              });
+    }
+
+    @Override
+    void stop(JSONObject result) throws JSONException {
+      mRunning = false;
+      result.put("requests", mCompleted.get()).put("failures", mFailed.get());
+    }
+  }
+
+  /** Writes to the preferences the Preferences plugin watches, many times a frame. */
+  private final class PreferencesPhase extends Phase {
+    private static final int WRITES_PER_FRAME = 20;
+    private SharedPreferences mPreferences;
+    private int mWrites;
+
+    PreferencesPhase() {
+      super("preferences");
+    }
+
+    @Override
+    void start() {
+      super.start();
+      mPreferences = getSharedPreferences("sample", Context.MODE_PRIVATE);
+    }
+
+    @Override
+    void frame() {
+      for (int i = 0; i < WRITES_PER_FRAME; i++) {
+        mPreferences.edit().putInt("perf-" + (mWrites % 100), mWrites).apply();
+        mWrites++;
+      }
+    }
+
+    @Override
+    void stop(JSONObject result) throws JSONException {
+      result.put("writes", mWrites);
+      final SharedPreferences.Editor editor = mPreferences.edit();
+      for (int i = 0; i < 100; i++) {
+        editor.remove("perf-" + i);
+      }
+      editor.apply();
+    }
+  }
+}
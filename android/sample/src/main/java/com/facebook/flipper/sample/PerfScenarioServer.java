@@ -0,0 +1,114 @@
+// Copyright 2004-present Facebook. All Rights Reserved.
+
+package com.facebook.flipper.sample;
+
+import android.util.Log;
+import java.io.BufferedReader;
+import java.io.IOException;
+import java.io.InputStreamReader;
+import java.io.OutputStream;
+import java.net.InetAddress;
+import java.net.ServerSocket;
+import java.net.Socket;
+import java.nio.charset.Charset;
+import java.util.Arrays;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+
+/**
+ * Answers every request on 127.0.0.1 with the same JSON body, so that the network scenario
+ * measures what reporting requests costs rather than the network.
+ */
+final class PerfScenarioServer {
+
+  private static final int BODY_BYTES = 4 * 1024;
+
+  private final ServerSocket mSocket;
+  private final ExecutorService mConnections = Executors.newCachedThreadPool();
+  private final byte[] mResponse;
+
+  PerfScenarioServer() throws IOException {
+    mSocket = new ServerSocket(0, 50, InetAddress.getByName("127.0.0.1"));
+    final char[] body = new char[BODY_BYTES];
+    Arrays.fill(body, 'a');
+    body[0] = '"';
+    body[BODY_BYTES - 1] = '"';
+    final String response =
+        "HTTP/1.1 200 OK\r\n"
+            + "Content-Type: application/json\r\n"
+            + "Content-Length: "
+            + BODY_BYTES
+            + "\r\n\r\n"
+            + new String(body);
+    mResponse = response.getBytes(Charset.forName("US-ASCII"));
+  }
+
+  String url(String path) {
+    return "http://127.0.0.1:" + mSocket.getLocalPort() + path;
+  }
+
+  void start() {
+    mConnections.execute(
+        new Runnable() {
+          @Override
+          public void run() {
+            while (!mSocket.isClosed()) {
+              try {
+                serve(mSocket.accept());
+              } catch (IOException e) {
+                if (!mSocket.isClosed()) {
+                  Log.w("SonarPerf", "Accepting a connection failed", e);
+                }
+              }
+            }
+          }
+        });
+  }
+
+  void stop() {
+    try {
+      mSocket.close();
+    } catch (IOException ignored) {
+    }
+    mConnections.shutdownNow();
+  }
+
+  private void serve(final Socket socket) {
+    mConnections.execute(
+        new Runnable() {
+          @Override
+          public void run() {
+            try {
+              final BufferedReader reader =
+                  new BufferedReader(new InputStreamReader(socket.getInputStream(), "US-ASCII"));
+              final OutputStream out = socket.getOutputStream();
+              // Keep-alive, so that bursts reuse connections the way apps' traffic does.
+              while (readRequest(reader)) {
+                out.write(mResponse);
+                out.flush();
+              }
+            } catch (IOException ignored) {
+            } finally {
+              try {
+                socket.close();
+              } catch (IOException ignored) {
+              }
+            }
+          }
+        });
+  }
+
+  /** Reads the headers of the next request, which the scenario sends without a body. */
+  private static boolean readRequest(BufferedReader reader) throws IOException {
+    final String requestLine = reader.readLine();
+    if (requestLine == null) {
+      return false;
+    }
+    for (String line = reader.readLine(); line != null; line = reader.readLine()) {
+      if (line.isEmpty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+}
@@ -45,6 +45,11 @@ public class RootComponentSpec {
                 .key("3")
                 .textSizeSp(20)
                 .clickHandler(RootComponent.openDiagnostics(c)))
+            .child(Text.create(c)
+                .text("Run perf scenarios")
+                .key("4")
+                .textSizeSp(20)
+                .clickHandler(RootComponent.openPerfScenarios(c)))
             .build();
   }
 
@@ -112,4 +117,10 @@ public class RootComponentSpec {
         Intent intent = new Intent(c, SonarDiagnosticActivity.class);
         c.startActivity(intent);
     }
+
+    @OnEvent(ClickEvent.class)
+    static void openPerfScenarios(final ComponentContext c) {
+        Intent intent = new Intent(c, PerfScenarioActivity.class);
+        c.startActivity(intent);
+    }
 }
@@ -6,197 +6,1338 @@
  *
  */
 
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <sched.h>
+#include <strings.h>
+#include <unordered_map>
+#include <vector>
 
 #ifdef SONAR_OSS
 #include <fbjni/fbjni.h>
 #else
 #include <fb/fbjni.h>
+#include <fbjni/ByteBuffer.h>
+#include <fbjni/JThreadPool.h>
 #endif
 
+#include <folly/Conv.h>
+#include <folly/Executor.h>
 #include <folly/json.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/io/async/EventBaseManager.h>
+#include <folly/io/IOBuf.h>
 
 #include <Sonar/SonarClient.h>
 #include <Sonar/SonarWebSocket.h>
 #include <Sonar/SonarConnection.h>
+#include <Sonar/SonarEventRing.h>
+#include <Sonar/SonarFramesPlugin.h>
+#include <Sonar/SonarInspector.h>
+#include <Sonar/SonarMemoryBudget.h>
+#include <Sonar/SonarMemoryPlugin.h>
+#include <Sonar/SonarMetricsPlugin.h>
+#include <Sonar/SonarNetworkCapture.h>
 #include <Sonar/SonarResponder.h>
 #include <Sonar/SonarStateUpdateListener.h>
 #include <Sonar/SonarState.h>
+#include <Sonar/SonarTracePlugin.h>
 
 using namespace facebook;
 using namespace facebook::sonar;
 
 namespace {
 
+// Sonar's own EventBase threads are started from Java and stay inside
+// loopForever, so they already have an attached, cached JNIEnv. Upcalls can
+// also come from threads Java doesn't know about, such as the folly thread
+// that fires timeouts. Those are attached the first time they need Java and
+// stay attached, with their JNIEnv cached, until they exit, rather than
+// attaching and detaching around every call.
+struct AttachedThread {
+  jni::ThreadScope scope;
+  jni::detail::JniEnvCacher cacher{jni::Environment::current()};
+};
+
+void ensureAttached() {
+  static thread_local AttachedThread thread;
+  (void)thread;
+}
+
+// Wraps a call into Java from C++. Besides attaching the thread, it gives the
+// call its own local reference frame. The EventBase threads never return
+// from loopForever, and natively attached threads never detach, so without a
+// frame any local reference that isn't released explicitly would stay alive
+// for the lifetime of the thread. capacity is how many local references the
+// upcall is expected to need; JNI grows the frame if it needs more.
+class JniUpcallScope {
+ public:
+  static constexpr jint kDefaultCapacity = 16;
+
+  explicit JniUpcallScope(jint capacity = kDefaultCapacity)
+      : frame_((ensureAttached(), jni::Environment::current()), capacity) {}
+
+ private:
+  jni::JniLocalScope frame_;
+};
+
+// Runs the receivers of plugins added with addBackgroundPlugin, on workers
+// that are attached to Java once rather than around every call.
+class JThreadPoolExecutor : public folly::Executor {
+ public:
+  static constexpr size_t kThreadCount = 2;
+
+  static std::shared_ptr<folly::Executor> shared() {
+    // Leaked, so that the workers aren't joined at exit.
+    static auto executor = new std::shared_ptr<folly::Executor>(
+        std::make_shared<JThreadPoolExecutor>());
+    return *executor;
+  }
+
+  JThreadPoolExecutor() : pool_(kThreadCount) {}
+
+  void add(folly::Func func) override {
+    // folly::Func is move only, and the pool takes std::function.
+    auto task = std::make_shared<folly::Func>(std::move(func));
+    pool_.add([task] { (*task)(); });
+  }
+
+ private:
+  jni::JThreadPool pool_;
+};
+
+// Field names are converted into a per-thread buffer, so reading or writing
+// a field doesn't allocate a string just to look it up.
+const std::string& fieldName(jni::alias_ref<jstring> name) {
+  static thread_local std::string buffer;
+  name->toStdString(buffer);
+  return buffer;
+}
+
 class JEventBase : public jni::HybridClass<JEventBase> {
  public:
-  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/EventBase;";
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/EventBase;";
+
+  static void registerNatives() {
+    registerHybrid({
+        makeNativeMethod("initHybrid", JEventBase::initHybrid),
+        makeNativeMethod("loopForever", JEventBase::loopForever),
+        makeNativeMethod("setCurrentThreadAffinity", JEventBase::setCurrentThreadAffinity),
+    });
+  }
+
+  folly::EventBase* eventBase() {
+    return &eventBase_;
+  }
+
+ private:
+  friend HybridBase;
+
+  JEventBase() {}
+
+  void loopForever() {
+    folly::EventBaseManager::get()->setEventBase(&eventBase_, false);
+    eventBase_.loopForever();
+  }
+
+  static void initHybrid(jni::alias_ref<jhybridobject> o) {
+    return setCxxInstance(o);
+  }
+
+  static jboolean setCurrentThreadAffinity(jni::alias_ref<jclass>, jni::alias_ref<jni::JArrayInt> cpus) {
+    const auto count = cpus->size();
+    const auto region = cpus->getRegion(0, count);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < count; i++) {
+      // CPU_SET doesn't check its argument.
+      if (region[i] < 0 || region[i] >= CPU_SETSIZE) {
+        return false;
+      }
+      CPU_SET(region[i], &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+  }
+
+  folly::EventBase eventBase_;
+};
+
+class JSonarObject : public jni::JavaClass<JSonarObject> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/core/SonarObject;";
+
+  static void OnLoad() {
+    toJsonStringMethod();
+  }
+
+  static jni::local_ref<JSonarObject> create(const folly::dynamic& json) {
+    return newInstance(folly::toJson(json));
+  }
+
+  std::string toJsonString() {
+    return toJsonStringMethod()(self())->toStdString();
+  }
+
+ private:
+  static const jni::JMethod<std::string()>& toJsonStringMethod() {
+    static const auto method = javaClassStatic()->getMethod<std::string()>("toJsonString");
+    return method;
+  }
+};
+
+class JSonarArray : public jni::JavaClass<JSonarArray> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/core/SonarArray;";
+
+  static void OnLoad() {
+    toJsonStringMethod();
+  }
+
+  static jni::local_ref<JSonarArray> create(const folly::dynamic& json) {
+    return newInstance(folly::toJson(json));
+  }
+
+  std::string toJsonString() {
+    return toJsonStringMethod()(self())->toStdString();
+  }
+
+ private:
+  static const jni::JMethod<std::string()>& toJsonStringMethod() {
+    static const auto method = javaClassStatic()->getMethod<std::string()>("toJsonString");
+    return method;
+  }
+};
+
+// Lets Java read incoming params field by field without converting them to
+// JSON first. Nested objects share the root, so they stay valid for as long
+// as any of them is reachable from Java.
+class JSonarObjectImpl : public jni::HybridClass<JSonarObjectImpl, JSonarObject> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/SonarObjectImpl;";
+
+  static void registerNatives() {
+    registerHybrid({
+      makeNativeMethod("getString", JSonarObjectImpl::getString),
+      makeNativeMethod("getInt", JSonarObjectImpl::getInt),
+      makeNativeMethod("getLong", JSonarObjectImpl::getLong),
+      makeNativeMethod("getDouble", JSonarObjectImpl::getDouble),
+      makeNativeMethod("getBoolean", JSonarObjectImpl::getBoolean),
+      makeNativeMethod("getObject", JSonarObjectImpl::getObject),
+      makeNativeMethod("getArray", JSonarObjectImpl::getArray),
+      makeNativeMethod("contains", JSonarObjectImpl::contains),
+      makeNativeMethod("toJsonString", JSonarObjectImpl::toJsonString),
+    });
+  }
+
+  static jni::local_ref<JSonarObject> create(folly::dynamic json) {
+    if (!json.isObject()) {
+      return JSonarObject::create(json);
+    }
+    auto root = std::make_shared<const folly::dynamic>(std::move(json));
+    const auto value = root.get();
+    return newObjectCxxArgs(std::move(root), value);
+  }
+
+  // The accessors follow the lenient conversions of the org.json opt*
+  // methods the Java implementation uses.
+
+  jni::local_ref<jstring> getString(jni::alias_ref<jstring> name) {
+    const auto field = get(name);
+    if (!field || field->isNull()) {
+      return nullptr;
+    }
+    return jni::make_jstring(field->isString() ? field->getString() : folly::toJson(*field));
+  }
+
+  jint getInt(jni::alias_ref<jstring> name) {
+    return static_cast<jint>(getLong(name));
+  }
+
+  jlong getLong(jni::alias_ref<jstring> name) {
+    const auto field = get(name);
+    if (!field) {
+      return 0;
+    }
+    if (field->isInt()) {
+      return field->getInt();
+    }
+    if (field->isDouble()) {
+      return static_cast<jlong>(field->getDouble());
+    }
+    if (field->isString()) {
+      auto parsed = folly::tryTo<double>(field->getString());
+      return parsed.hasValue() ? static_cast<jlong>(parsed.value()) : 0;
+    }
+    return 0;
+  }
+
+  jdouble getDouble(jni::alias_ref<jstring> name) {
+    const auto field = get(name);
+    if (field && field->isNumber()) {
+      return field->asDouble();
+    }
+    if (field && field->isString()) {
+      auto parsed = folly::tryTo<double>(field->getString());
+      if (parsed.hasValue()) {
+        return parsed.value();
+      }
+    }
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+
+  jboolean getBoolean(jni::alias_ref<jstring> name) {
+    const auto field = get(name);
+    if (field && field->isBool()) {
+      return field->getBool();
+    }
+    return field && field->isString() && strcasecmp(field->c_str(), "true") == 0;
+  }
+
+  jni::local_ref<JSonarObject> getObject(jni::alias_ref<jstring> name) {
+    static const folly::dynamic empty = folly::dynamic::object();
+    const auto field = get(name);
+    return newObjectCxxArgs(root_, field && field->isObject() ? field : &empty);
+  }
+
+  jni::local_ref<JSonarArray> getArray(jni::alias_ref<jstring> name) {
+    const auto field = get(name);
+    return JSonarArray::create(field && field->isArray() ? *field : folly::dynamic::array());
+  }
+
+  jboolean contains(jni::alias_ref<jstring> name) {
+    return value_->count(fieldName(name)) > 0;
+  }
+
+  // The params behind object if it is backed by native memory, so they can
+  // be sent without going through JSON.
+  static const folly::dynamic* nativeValue(jni::alias_ref<JSonarObject> object) {
+    if (!object || !object->isInstanceOf(javaClassStatic())) {
+      return nullptr;
+    }
+    return jni::static_ref_cast<jhybridobject>(object)->cthis()->value_;
+  }
+
+  std::string toJsonString() {
+    return folly::toJson(*value_);
+  }
+
+ private:
+  friend HybridBase;
+  std::shared_ptr<const folly::dynamic> root_;
+  const folly::dynamic* value_;
+
+  JSonarObjectImpl(std::shared_ptr<const folly::dynamic> root, const folly::dynamic* value)
+      : root_(std::move(root)), value_(value) {}
+
+  const folly::dynamic* get(jni::alias_ref<jstring> name) const {
+    return value_->get_ptr(fieldName(name));
+  }
+};
+
+class JSonarObjectWriterImpl : public jni::HybridClass<JSonarObjectWriterImpl> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/SonarObjectWriterImpl;";
+
+  static void registerNatives() {
+    registerHybrid({
+      makeNativeMethod("initHybrid", JSonarObjectWriterImpl::initHybrid),
+      makeNativeMethod("writeString", JSonarObjectWriterImpl::writeString),
+      makeNativeMethod("writeLong", JSonarObjectWriterImpl::writeLong),
+      makeNativeMethod("writeDouble", JSonarObjectWriterImpl::writeDouble),
+      makeNativeMethod("writeBoolean", JSonarObjectWriterImpl::writeBoolean),
+      makeNativeMethod("writeObject", JSonarObjectWriterImpl::writeObject),
+      makeNativeMethod("writeArray", JSonarObjectWriterImpl::writeArray),
+      makeNativeMethod("begin", JSonarObjectWriterImpl::begin),
+      makeNativeMethod("endNative", JSonarObjectWriterImpl::end),
+      makeNativeMethod("build", JSonarObjectWriterImpl::build),
+    });
+  }
+
+  static jni::local_ref<jhybriddata> initHybrid(jni::alias_ref<jclass>) {
+    return makeCxxInstance();
+  }
+
+  void writeString(jni::alias_ref<jstring> name, jni::alias_ref<jstring> value) {
+    write(name, value ? folly::dynamic(value->toStdString()) : folly::dynamic(nullptr));
+  }
+
+  void writeLong(jni::alias_ref<jstring> name, jlong value) {
+    write(name, static_cast<int64_t>(value));
+  }
+
+  void writeDouble(jni::alias_ref<jstring> name, jdouble value) {
+    write(name, std::isnan(value) ? folly::dynamic(nullptr) : folly::dynamic(value));
+  }
+
+  void writeBoolean(jni::alias_ref<jstring> name, jboolean value) {
+    write(name, static_cast<bool>(value));
+  }
+
+  void writeObject(jni::alias_ref<jstring> name, jni::alias_ref<JSonarObject> value) {
+    if (auto native = JSonarObjectImpl::nativeValue(value)) {
+      write(name, *native);
+    } else {
+      write(name, value ? folly::parseJson(value->toJsonString()) : folly::dynamic(nullptr));
+    }
+  }
+
+  void writeArray(jni::alias_ref<jstring> name, jni::alias_ref<JSonarArray> value) {
+    write(name, value ? folly::parseJson(value->toJsonString()) : folly::dynamic(nullptr));
+  }
+
+  void begin(jni::alias_ref<jstring> name, jboolean array) {
+    auto& container = write(name, array ? folly::dynamic::array() : folly::dynamic::object());
+    stack_.push_back(&container);
+  }
+
+  void end() {
+    if (stack_.size() == 1) {
+      jni::throwNewJavaException("java/lang/IllegalStateException", "end() without begin");
+    }
+    stack_.pop_back();
+  }
+
+  jni::local_ref<JSonarObject> build() {
+    if (stack_.size() != 1) {
+      jni::throwNewJavaException("java/lang/IllegalStateException", "build() with unclosed objects or arrays");
+    }
+    auto root = std::move(root_);
+    root_ = folly::dynamic::object();
+    return JSonarObjectImpl::create(std::move(root));
+  }
+
+ private:
+  friend HybridBase;
+
+  // Values are only ever added to the innermost container, and none of its
+  // children are on the stack, so the pointers stay valid.
+  folly::dynamic root_ = folly::dynamic::object();
+  std::vector<folly::dynamic*> stack_{&root_};
+
+  JSonarObjectWriterImpl() {}
+
+  folly::dynamic& write(jni::alias_ref<jstring> name, folly::dynamic value) {
+    auto& top = *stack_.back();
+    if (name) {
+      // Like SonarObject.Builder, null values leave the field out.
+      if (value.isNull()) {
+        top.erase(fieldName(name));
+        return top;
+      }
+      auto& slot = top[fieldName(name)];
+      slot = std::move(value);
+      return slot;
+    }
+    top.push_back(std::move(value));
+    return top[top.size() - 1];
+  }
+};
+
+class JSonarResponder : public jni::JavaClass<JSonarResponder> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/core/SonarResponder;";
+};
+
+class JSonarResponderImpl : public jni::HybridClass<JSonarResponderImpl, JSonarResponder> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/SonarResponderImpl;";
+
+  static void registerNatives() {
+    registerHybrid({
+      makeNativeMethod("successObject", JSonarResponderImpl::successObject),
+      makeNativeMethod("successArray", JSonarResponderImpl::successArray),
+      makeNativeMethod("error", JSonarResponderImpl::error),
+    });
+  }
+
+  // The JSON Java produced goes out as is, rather than being parsed here
+  // only to be serialized again by the socket.
+  void successObject(jni::alias_ref<JSonarObject> json) {
+    if (auto native = JSonarObjectImpl::nativeValue(json)) {
+      _responder->success(*native);
+      return;
+    }
+    _responder->successJson(json ? json->toJsonString() : "{}");
+  }
+
+  void successArray(jni::alias_ref<JSonarArray> json) {
+    _responder->successJson(json ? json->toJsonString() : "{}");
+  }
+
+  void error(jni::alias_ref<JSonarObject> json) {
+    _responder->error(json ? folly::parseJson(json->toJsonString()) : folly::dynamic::object());
+  }
+
+  void successJson(std::string json) {
+    _responder->successJson(std::move(json));
+  }
+
+ private:
+  friend HybridBase;
+  std::shared_ptr<SonarResponder> _responder;
+
+  JSonarResponderImpl(std::shared_ptr<SonarResponder> responder): _responder(std::move(responder)) {}
+};
+
+class JSonarConnection : public jni::JavaClass<JSonarConnection> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/core/SonarConnection;";
+};
+
+class JSonarConnectionImpl : public jni::HybridClass<JSonarConnectionImpl, JSonarConnection> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/SonarConnectionImpl;";
+
+  static void OnLoad() {
+    dispatchMethod();
+  }
+
+  static void registerNatives() {
+    registerHybrid({
+      makeNativeMethod("sendObject", JSonarConnectionImpl::sendObject),
+      makeNativeMethod("sendArray", JSonarConnectionImpl::sendArray),
+      makeNativeMethod("sendBytes", JSonarConnectionImpl::sendBytes),
+      makeNativeMethod("reportError", JSonarConnectionImpl::reportError),
+      makeNativeMethod("cacheResponses", JSonarConnectionImpl::cacheResponses),
+      makeNativeMethod("invalidateResponses", JSonarConnectionImpl::invalidateResponses),
+      makeNativeMethod("receiveNative", JSonarConnectionImpl::receive),
+    });
+  }
+
+  void sendObject(const std::string& method, jni::alias_ref<JSonarObject> json) {
+    if (auto native = JSonarObjectImpl::nativeValue(json)) {
+      _connection->send(method, *native);
+      return;
+    }
+    _connection->sendJson(method, json ? json->toJsonString() : "{}");
+  }
+
+  void sendArray(const std::string& method, jni::alias_ref<JSonarArray> json) {
+    _connection->sendJson(method, json ? json->toJsonString() : "{}");
+  }
+
+  jboolean sendBytes(const std::string& method, jni::alias_ref<JSonarObject> metadata, jni::alias_ref<jni::JByteBuffer> data) {
+    if (!_connection->supportsBinary()) {
+      return false;
+    }
+    const auto start = data->position();
+    const auto size = data->limit() - start;
+    std::unique_ptr<folly::IOBuf> iobuf;
+    if (data->isDirect()) {
+      // Send the buffer's memory as is. The global ref keeps the buffer alive
+      // until the frame has been written, and is released from whichever
+      // thread drops the IOBuf.
+      auto buffer = new jni::global_ref<jni::JByteBuffer>(jni::make_global(data));
+      iobuf = folly::IOBuf::takeOwnership(
+          data->getDirectBytes() + start,
+          size,
+          [](void*, void* userData) {
+            ensureAttached();
+            delete static_cast<jni::global_ref<jni::JByteBuffer>*>(userData);
+          },
+          buffer);
+    } else {
+      iobuf = folly::IOBuf::create(size);
+      data->getBytes(start, size, iobuf->writableData());
+      iobuf->append(size);
+    }
+    return _connection->sendBinary(
+        method,
+        metadata ? folly::parseJson(metadata->toJsonString()) : folly::dynamic::object(),
+        std::move(iobuf));
+  }
+
+  const std::shared_ptr<SonarConnection>& sharedConnection() {
+    return _connection;
+  }
+
+  SonarConnection& connection() {
+    return *_connection;
+  }
+
+  void reportError(jni::alias_ref<jni::JThrowable> throwable) {
+    _connection->error(throwable->toString(), throwable->getStackTrace()->toString());
+  }
+
+  void cacheResponses(const std::string& method, const std::string& version) {
+    _connection->cacheResponses(method, version);
+  }
+
+  void invalidateResponses(const std::string& version) {
+    _connection->invalidateResponses(version);
+  }
+
+  // Receivers live in a table on the Java side, and all of a connection's
+  // handlers share one global reference to it. The handlers own the Java
+  // object, which owns the connection, until the connection drops them when
+  // the plugin is disconnected.
+  static void receive(jni::alias_ref<jhybridobject> self, const std::string& method, jint index) {
+    auto dispatcher = self->cthis()->dispatcher(self);
+    self->cthis()->_connection->receive(method, [dispatcher, index] (const folly::dynamic& params, std::unique_ptr<SonarResponder> responder) {
+      JniUpcallScope scope;
+      dispatchMethod()(*dispatcher, index, JSonarObjectImpl::create(params), JSonarResponderImpl::newObjectCxxArgs(std::move(responder)));
+    });
+  }
+
+ private:
+  using Dispatch = void(jint, jni::alias_ref<JSonarObject::javaobject>, jni::alias_ref<JSonarResponder::javaobject>);
+  using Dispatcher = jni::global_ref<jhybridobject>;
+
+  static const jni::JMethod<Dispatch>& dispatchMethod() {
+    static const auto method = javaClassStatic()->getMethod<Dispatch>("dispatch");
+    return method;
+  }
+
+  std::shared_ptr<Dispatcher> dispatcher(jni::alias_ref<jhybridobject> self) {
+    std::lock_guard<std::mutex> lock(_dispatcherMutex);
+    auto dispatcher = _dispatcher.lock();
+    if (!dispatcher) {
+      dispatcher = std::make_shared<Dispatcher>(jni::make_global(self));
+      _dispatcher = dispatcher;
+    }
+    return dispatcher;
+  }
+
+
+  friend HybridBase;
+  std::shared_ptr<SonarConnection> _connection;
+  // Only the handlers own the dispatcher, as the connection owning it would
+  // keep its own Java object alive forever.
+  std::weak_ptr<Dispatcher> _dispatcher;
+  std::mutex _dispatcherMutex;
+
+  JSonarConnectionImpl(std::shared_ptr<SonarConnection> connection): _connection(std::move(connection)) {}
+};
+
+class JEventRing : public jni::HybridClass<JEventRing> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/EventRing;";
+
+  static void registerNatives() {
+    registerHybrid({
+      makeNativeMethod("initHybrid", JEventRing::initHybrid),
+      makeNativeMethod("isEmpty", JEventRing::isEmpty),
+      makeNativeMethod("push", JEventRing::push),
+      makeNativeMethod("sendToNative", JEventRing::sendTo),
+      makeNativeMethod("frontMethod", JEventRing::frontMethod),
+      makeNativeMethod("frontParams", JEventRing::frontParams),
+      makeNativeMethod("pop", JEventRing::pop),
+    });
+  }
+
+  static jni::local_ref<jhybriddata> initHybrid(jni::alias_ref<jclass>, jint maxEvents, jint capacityBytes, jni::alias_ref<jstring> persistentPath) {
+    std::unique_ptr<SonarEventRing> ring;
+    if (persistentPath) {
+      ring = SonarEventRing::mapped(persistentPath->toStdString(), maxEvents, capacityBytes);
+    }
+    if (!ring) {
+      ring = std::make_unique<SonarEventRing>(maxEvents, capacityBytes);
+    }
+    return makeCxxInstance(std::move(ring));
+  }
+
+  jboolean isEmpty() {
+    return _ring->empty();
+  }
+
+  void push(const std::string& method, const std::string params) {
+    _ring->push(method, params);
+  }
+
+  void sendTo(jni::alias_ref<JSonarConnectionImpl::javaobject> connection) {
+    auto& native = connection->cthis()->connection();
+    _ring->drain([&native](folly::StringPiece method, folly::StringPiece params) {
+      native.sendJson(method, params.str());
+    });
+  }
+
+  std::string frontMethod() {
+    folly::StringPiece method, params;
+    _ring->front(method, params);
+    return method.str();
+  }
+
+  std::string frontParams() {
+    folly::StringPiece method, params;
+    _ring->front(method, params);
+    return params.str();
+  }
+
+  void pop() {
+    _ring->pop();
+  }
+
+ private:
+  friend HybridBase;
+  std::unique_ptr<SonarEventRing> _ring;
+
+  JEventRing(std::unique_ptr<SonarEventRing> ring): _ring(std::move(ring)) {}
+};
+
+// Metric and trace handles for Java, which refers to them by slot. A slot is filled
+// once, before its index is handed out, and never changed after, so
+// recording reads it without a lock.
+template <typename Handle, size_t kSlots>
+class HandleSlots {
+ public:
+  template <typename Lookup>
+  jint find(const std::string& name, Lookup&& lookup) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = indices_.find(name);
+    if (it != indices_.end()) {
+      return it->second;
+    }
+    if (indices_.size() == kSlots) {
+      return -1;
+    }
+    const jint index = indices_.size();
+    slots_[index] = lookup(name);
+    indices_.emplace(name, index);
+    return index;
+  }
+
+  const Handle& operator[](jint index) const {
+    return slots_[index];
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<std::string, jint> indices_;
+  std::array<Handle, kSlots> slots_;
+};
+
+class JSonarFramesPlugin : public jni::HybridClass<JSonarFramesPlugin> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/SonarFramesPlugin;";
+
+  static void registerNatives() {
+    registerHybrid({
+      makeNativeMethod("initHybrid", JSonarFramesPlugin::initHybrid),
+      makeNativeMethod("frameNative", JSonarFramesPlugin::frame),
+      makeNativeMethod("setRefreshPeriodNative", JSonarFramesPlugin::setRefreshPeriod),
+      makeNativeMethod("connectNative", JSonarFramesPlugin::connect),
+      makeNativeMethod("disconnectNative", JSonarFramesPlugin::disconnect),
+    });
+  }
+
+  static jni::local_ref<jhybriddata> initHybrid(jni::alias_ref<jclass>, jint summaryIntervalMs) {
+    return makeCxxInstance(std::chrono::milliseconds(summaryIntervalMs));
+  }
+
+  void frame(jlong frameTimeNanos) {
+    _plugin.onFrame(frameTimeNanos);
+  }
+
+  void setRefreshPeriod(jlong nanos) {
+    _plugin.setRefreshPeriod(std::chrono::nanoseconds(nanos));
+  }
+
+  void connect(jni::alias_ref<JSonarConnectionImpl::javaobject> connection) {
+    _plugin.didConnect(connection->cthis()->sharedConnection());
+  }
+
+  void disconnect() {
+    _plugin.didDisconnect();
+  }
+
+ private:
+  friend HybridBase;
+  SonarFramesPlugin _plugin;
+
+  JSonarFramesPlugin(std::chrono::milliseconds summaryInterval): _plugin(summaryInterval) {}
+};
+
+class JRuntime : public jni::JavaClass<JRuntime> {
+ public:
+  constexpr static auto kJavaDescriptor = "Ljava/lang/Runtime;";
+
+  // What the Java heap holds, in kilobytes.
+  static int64_t usedMemoryKb() {
+    static const auto getRuntime = javaClassStatic()->getStaticMethod<JRuntime::javaobject()>("getRuntime");
+    static const auto totalMemory = javaClassStatic()->getMethod<jlong()>("totalMemory");
+    static const auto freeMemory = javaClassStatic()->getMethod<jlong()>("freeMemory");
+    JniUpcallScope scope;
+    const auto runtime = getRuntime(javaClassStatic());
+    return (totalMemory(runtime) - freeMemory(runtime)) / 1024;
+  }
+};
+
+class JSonarMemoryPlugin : public jni::HybridClass<JSonarMemoryPlugin> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/SonarMemoryPlugin;";
+
+  static void registerNatives() {
+    registerHybrid({
+      makeNativeMethod("initHybrid", JSonarMemoryPlugin::initHybrid),
+      makeNativeMethod("connectNative", JSonarMemoryPlugin::connect),
+      makeNativeMethod("disconnectNative", JSonarMemoryPlugin::disconnect),
+    });
+  }
+
+  static jni::local_ref<jhybriddata> initHybrid(jni::alias_ref<jclass>) {
+    return makeCxxInstance();
+  }
+
+  void connect(jni::alias_ref<JSonarConnectionImpl::javaobject> connection) {
+    _plugin->didConnect(connection->cthis()->sharedConnection());
+  }
+
+  void disconnect() {
+    _plugin->didDisconnect();
+  }
+
+ private:
+  friend HybridBase;
+  // Samples are scheduled with a weak reference to it.
+  std::shared_ptr<SonarMemoryPlugin> _plugin;
+
+  JSonarMemoryPlugin()
+      : _plugin(std::make_shared<SonarMemoryPlugin>(std::vector<SonarMemorySource>{
+            {"javaHeap", &JRuntime::usedMemoryKb},
+        })) {}
+};
+
+class JSonarMetricsPlugin : public jni::HybridClass<JSonarMetricsPlugin> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/SonarMetricsPlugin;";
 
   static void registerNatives() {
     registerHybrid({
-        makeNativeMethod("initHybrid", JEventBase::initHybrid),
-        makeNativeMethod("loopForever", JEventBase::loopForever),
+      makeNativeMethod("initHybrid", JSonarMetricsPlugin::initHybrid),
+      makeNativeMethod("counterIndex", JSonarMetricsPlugin::counterIndex),
+      makeNativeMethod("gaugeIndex", JSonarMetricsPlugin::gaugeIndex),
+      makeNativeMethod("histogramIndex", JSonarMetricsPlugin::histogramIndex),
+      makeNativeMethod("addNative", JSonarMetricsPlugin::add),
+      makeNativeMethod("setNative", JSonarMetricsPlugin::set),
+      makeNativeMethod("recordNative", JSonarMetricsPlugin::record),
+      makeNativeMethod("connectNative", JSonarMetricsPlugin::connect),
+      makeNativeMethod("disconnectNative", JSonarMetricsPlugin::disconnect),
     });
   }
 
-  folly::EventBase* eventBase() {
-    return &eventBase_;
+  static jni::local_ref<jhybriddata> initHybrid(jni::alias_ref<jclass>, jint flushIntervalMs) {
+    return makeCxxInstance(std::chrono::milliseconds(flushIntervalMs));
   }
 
- private:
-  friend HybridBase;
+  jint counterIndex(const std::string& name) {
+    return _counters.find(name, [this](const std::string& name) { return _plugin.counter(name); });
+  }
 
-  JEventBase() {}
+  jint gaugeIndex(const std::string& name) {
+    return _gauges.find(name, [this](const std::string& name) { return _plugin.gauge(name); });
+  }
 
-  void loopForever() {
-    folly::EventBaseManager::get()->setEventBase(&eventBase_, false);
-    eventBase_.loopForever();
+  jint histogramIndex(const std::string& name) {
+    return _histograms.find(name, [this](const std::string& name) { return _plugin.histogram(name); });
   }
 
-  static void initHybrid(jni::alias_ref<jhybridobject> o) {
-    return setCxxInstance(o);
+  void add(jint index, jlong amount) {
+    _counters[index].add(amount);
   }
 
-  folly::EventBase eventBase_;
-};
+  void set(jint index, jdouble value) {
+    _gauges[index].set(value);
+  }
 
-class JSonarObject : public jni::JavaClass<JSonarObject> {
- public:
-  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/core/SonarObject;";
+  void record(jint index, jlong value) {
+    _histograms[index].record(value);
+  }
 
-  static jni::local_ref<JSonarObject> create(const folly::dynamic& json) {
-    return newInstance(folly::toJson(json));
+  void connect(jni::alias_ref<JSonarConnectionImpl::javaobject> connection) {
+    _plugin.didConnect(connection->cthis()->sharedConnection());
   }
 
-  std::string toJsonString() {
-    static const auto method = javaClassStatic()->getMethod<std::string()>("toJsonString");
-    return method(self())->toStdString();
+  void disconnect() {
+    _plugin.didDisconnect();
   }
+
+ private:
+  friend HybridBase;
+  SonarMetricsPlugin _plugin;
+  HandleSlots<SonarCounter, detail::kSonarMaxCounters> _counters;
+  HandleSlots<SonarGauge, detail::kSonarMaxGauges> _gauges;
+  HandleSlots<SonarHistogram, detail::kSonarMaxHistograms> _histograms;
+
+  JSonarMetricsPlugin(std::chrono::milliseconds flushInterval): _plugin(flushInterval) {}
 };
 
-class JSonarArray : public jni::JavaClass<JSonarArray> {
+class JSonarTracePlugin : public jni::HybridClass<JSonarTracePlugin> {
  public:
-  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/core/SonarArray;";
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/SonarTracePlugin;";
 
-  static jni::local_ref<JSonarArray> create(const folly::dynamic& json) {
-    return newInstance(folly::toJson(json));
+  // Fewer than the native limit, to keep the slots small.
+  static constexpr size_t kNames = 4096;
+
+  static void registerNatives() {
+    registerHybrid({
+      makeNativeMethod("initHybrid", JSonarTracePlugin::initHybrid),
+      makeNativeMethod("nameIndex", JSonarTracePlugin::nameIndex),
+      makeNativeMethod("recordNative", JSonarTracePlugin::record),
+      makeNativeMethod("dumpNative", JSonarTracePlugin::dump),
+      makeNativeMethod("connectNative", JSonarTracePlugin::connect),
+      makeNativeMethod("disconnectNative", JSonarTracePlugin::disconnect),
+    });
   }
 
-  std::string toJsonString() {
-    static const auto method = javaClassStatic()->getMethod<std::string()>("toJsonString");
-    return method(self())->toStdString();
+  static jni::local_ref<jhybriddata> initHybrid(jni::alias_ref<jclass>, jint eventsPerThread, jint flushIntervalMs) {
+    return makeCxxInstance(eventsPerThread, std::chrono::milliseconds(flushIntervalMs));
   }
-};
 
-class JSonarResponder : public jni::JavaClass<JSonarResponder> {
- public:
-  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/core/SonarResponder;";
+  jint nameIndex(const std::string& name) {
+    return _names.find(name, [this](const std::string& name) { return _plugin.name(name); });
+  }
+
+  void record(jint index, jchar phase) {
+    _names[index].record(static_cast<SonarTracePhase>(phase));
+  }
+
+  void dump() {
+    _plugin.dump();
+  }
+
+  void connect(jni::alias_ref<JSonarConnectionImpl::javaobject> connection) {
+    _plugin.didConnect(connection->cthis()->sharedConnection());
+  }
+
+  void disconnect() {
+    _plugin.didDisconnect();
+  }
+
+ private:
+  friend HybridBase;
+  SonarTracePlugin _plugin;
+  HandleSlots<SonarTraceName, kNames> _names;
+
+  JSonarTracePlugin(jint eventsPerThread, std::chrono::milliseconds flushInterval): _plugin(eventsPerThread, flushInterval) {}
 };
 
-class JSonarResponderImpl : public jni::HybridClass<JSonarResponderImpl, JSonarResponder> {
+class JNetworkCapture : public jni::HybridClass<JNetworkCapture> {
  public:
-  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/SonarResponderImpl;";
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/NetworkCapture;";
 
   static void registerNatives() {
     registerHybrid({
-      makeNativeMethod("successObject", JSonarResponderImpl::successObject),
-      makeNativeMethod("successArray", JSonarResponderImpl::successArray),
-      makeNativeMethod("error", JSonarResponderImpl::error),
+      makeNativeMethod("initHybrid", JNetworkCapture::initHybrid),
+      makeNativeMethod("setFilterNative", JNetworkCapture::setFilter),
+      makeNativeMethod("reportRequestNative", JNetworkCapture::reportRequest),
+      makeNativeMethod("reportResponseNative", JNetworkCapture::reportResponse),
+      makeNativeMethod("reportDroppedNative", JNetworkCapture::reportDropped),
+      makeNativeMethod("connectNative", JNetworkCapture::connect),
+      makeNativeMethod("disconnectNative", JNetworkCapture::disconnect),
     });
   }
 
-  void successObject(jni::alias_ref<JSonarObject> json) {
-    _responder->success(json ? folly::parseJson(json->toJsonString()) : folly::dynamic::object());
+  static jni::local_ref<jhybriddata> initHybrid(jni::alias_ref<jclass>, jni::alias_ref<jstring> bufferPath, jni::alias_ref<jstring> bodySpillDirectory) {
+    SonarNetworkCaptureConfig config;
+    if (bufferPath) {
+      config.bufferFile = bufferPath->toStdString();
+    }
+    if (bodySpillDirectory) {
+      config.bodySpillDirectory = bodySpillDirectory->toStdString();
+    }
+    return makeCxxInstance(std::move(config));
   }
 
-  void successArray(jni::alias_ref<JSonarArray> json) {
-    _responder->success(json ? folly::parseJson(json->toJsonString()) : folly::dynamic::object());
+  void setFilter(const std::string& params) {
+    _capture.setFilter(folly::parseJson(params));
   }
 
-  void error(jni::alias_ref<JSonarObject> json) {
-    _responder->error(json ? folly::parseJson(json->toJsonString()) : folly::dynamic::object());
+  void reportRequest(
+      const std::string& id,
+      jlong timestamp,
+      const std::string& method,
+      const std::string& url,
+      jni::alias_ref<jni::JArrayClass<jstring>> headers,
+      jni::alias_ref<jni::JArrayByte> body) {
+    SonarNetworkRequest request;
+    request.id = id;
+    request.timestamp = timestamp;
+    request.method = method;
+    request.url = url;
+    request.headers = toHeaders(headers);
+    request.body = toBody(body, nullptr);
+    _capture.reportRequest(request);
+  }
+
+  void reportResponse(
+      const std::string& id,
+      jlong timestamp,
+      jint status,
+      jni::alias_ref<jstring> reason,
+      jni::alias_ref<jni::JArrayClass<jstring>> headers,
+      jboolean formattable,
+      jni::alias_ref<jni::JArrayByte> body,
+      jni::alias_ref<jni::JByteBuffer> bodyBuffer) {
+    SonarNetworkResponse response;
+    response.id = id;
+    response.timestamp = timestamp;
+    response.status = status;
+    if (reason) {
+      response.reason = reason->toStdString();
+    }
+    response.headers = toHeaders(headers);
+    response.formattable = formattable;
+    response.body = toBody(body, bodyBuffer);
+    _capture.reportResponse(std::move(response));
+  }
+
+  void reportDropped(const std::string& id) {
+    _capture.reportDropped(id);
+  }
+
+  void connect(jni::alias_ref<JSonarConnectionImpl::javaobject> connection) {
+    _capture.didConnect(connection->cthis()->sharedConnection());
+  }
+
+  void disconnect() {
+    _capture.didDisconnect();
   }
 
  private:
   friend HybridBase;
-  std::shared_ptr<SonarResponder> _responder;
+  SonarNetworkCapture _capture;
 
-  JSonarResponderImpl(std::shared_ptr<SonarResponder> responder): _responder(std::move(responder)) {}
+  JNetworkCapture(SonarNetworkCaptureConfig config): _capture(std::move(config)) {}
+
+  // Java passes headers as name, value, name, value...
+  static std::vector<SonarNetworkHeader> toHeaders(jni::alias_ref<jni::JArrayClass<jstring>> headers) {
+    std::vector<SonarNetworkHeader> result;
+    if (!headers) {
+      return result;
+    }
+    const size_t count = headers->size() / 2;
+    result.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      const auto value = headers->getElement(2 * i + 1);
+      result.push_back({headers->getElement(2 * i)->toStdString(), value ? value->toStdString() : ""});
+    }
+    return result;
+  }
+
+  // Either of the two, the buffer between its position and limit.
+  static std::string toBody(jni::alias_ref<jni::JArrayByte> bytes, jni::alias_ref<jni::JByteBuffer> buffer) {
+    std::string body;
+    if (buffer) {
+      const auto start = buffer->position();
+      const auto size = buffer->limit() - start;
+      if (buffer->isDirect()) {
+        body.assign(reinterpret_cast<const char*>(buffer->getDirectBytes()) + start, size);
+      } else {
+        body.resize(size);
+        buffer->getBytes(start, size, reinterpret_cast<uint8_t*>(&body[0]));
+      }
+    } else if (bytes) {
+      body.resize(bytes->size());
+      bytes->getRegion(0, body.size(), reinterpret_cast<jbyte*>(&body[0]));
+    }
+    return body;
+  }
 };
 
-class JSonarReceiver : public jni::JavaClass<JSonarReceiver> {
+// Nodes are handles into a table on the Java side, where 0 is none.
+class JInspectorEngineAdapter : public jni::JavaClass<JInspectorEngineAdapter> {
  public:
-  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/core/SonarReceiver;";
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/InspectorEngine$Adapter;";
+
+  jint root() const {
+    static const auto method = javaClassStatic()->getMethod<jint()>("root");
+    return method(self());
+  }
+
+  std::string identifier(jint node) const {
+    static const auto method = javaClassStatic()->getMethod<jstring(jint)>("identifier");
+    return method(self(), node)->toStdString();
+  }
+
+  std::string name(jint node) const {
+    static const auto method = javaClassStatic()->getMethod<jstring(jint)>("name");
+    return method(self(), node)->toStdString();
+  }
+
+  std::string decoration(jint node) const {
+    static const auto method = javaClassStatic()->getMethod<jstring(jint)>("decoration");
+    const auto decoration = method(self(), node);
+    return decoration ? decoration->toStdString() : "";
+  }
+
+  jni::local_ref<jni::JArrayInt::javaobject> children(jint node) const {
+    static const auto method = javaClassStatic()->getMethod<jni::JArrayInt::javaobject(jint)>("children");
+    return method(self(), node);
+  }
+
+  // Names and values, one after the other.
+  jni::local_ref<jni::JArrayClass<jstring>::javaobject> attributes(jint node) const {
+    static const auto method = javaClassStatic()->getMethod<jni::JArrayClass<jstring>::javaobject(jint)>("attributes");
+    return method(self(), node);
+  }
+
+  // Names and JSON values, one after the other.
+  jni::local_ref<jni::JArrayClass<jstring>::javaobject> data(jint node) const {
+    static const auto method = javaClassStatic()->getMethod<jni::JArrayClass<jstring>::javaobject(jint)>("data");
+    return method(self(), node);
+  }
+
+  jni::local_ref<jni::JArrayClass<jstring>::javaobject> extra(jint node) const {
+    static const auto method = javaClassStatic()->getMethod<jni::JArrayClass<jstring>::javaobject(jint)>("extra");
+    return method(self(), node);
+  }
+
+  jint find(const std::string& id) const {
+    static const auto method = javaClassStatic()->getMethod<jint(jstring)>("find");
+    return method(self(), jni::make_jstring(id).get());
+  }
+
+  void retain(jint node) const {
+    static const auto method = javaClassStatic()->getMethod<void(jint)>("retain");
+    method(self(), node);
+  }
 
-  void receive(const folly::dynamic params, std::shared_ptr<SonarResponder> responder) const {
-    static const auto method = javaClassStatic()->getMethod<void(jni::alias_ref<JSonarObject::javaobject>, jni::alias_ref<JSonarResponder::javaobject>)>("onReceive");
-    method(self(), JSonarObject::create(std::move(params)), JSonarResponderImpl::newObjectCxxArgs(responder));
+  void release(jint node) const {
+    static const auto method = javaClassStatic()->getMethod<void(jint)>("release");
+    method(self(), node);
   }
 };
 
-class JSonarConnection : public jni::JavaClass<JSonarConnection> {
+// Reaches the Java adapter passed to the engine call in progress. Outside of
+// one, such as when the engine is destroyed, there is nothing to call and the
+// Java side drops its handles itself.
+class JInspectorAdapter : public SonarInspectorAdapter {
  public:
-  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/core/SonarConnection;";
+  jni::alias_ref<JInspectorEngineAdapter::javaobject> current;
+
+  SonarInspectorNode root() override {
+    return current ? toNode(current->root()) : nullptr;
+  }
+
+  std::string identifier(SonarInspectorNode node) override {
+    return current->identifier(toHandle(node));
+  }
+
+  std::string name(SonarInspectorNode node) override {
+    return current->name(toHandle(node));
+  }
+
+  std::string decoration(SonarInspectorNode node) override {
+    return current->decoration(toHandle(node));
+  }
+
+  void children(SonarInspectorNode node, std::vector<SonarInspectorNode>& children) override {
+    const auto handles = current->children(toHandle(node));
+    if (!handles) {
+      return;
+    }
+    const auto count = handles->size();
+    const auto region = handles->getRegion(0, count);
+    for (size_t i = 0; i < count; i++) {
+      children.push_back(toNode(region[i]));
+    }
+  }
+
+  void attributes(SonarInspectorNode node, SonarInspectorAttributes& attributes) override {
+    const auto pairs = current->attributes(toHandle(node));
+    for (size_t i = 0, count = pairs ? pairs->size() / 2 : 0; i < count; i++) {
+      const auto value = pairs->getElement(2 * i + 1);
+      attributes.add(pairs->getElement(2 * i)->toStdString(), value ? value->toStdString() : "");
+    }
+  }
+
+  void data(SonarInspectorNode node, SonarMessageWriter& writer) override {
+    putRaw(current->data(toHandle(node)), writer);
+  }
+
+  void extra(SonarInspectorNode node, SonarMessageWriter& writer) override {
+    putRaw(current->extra(toHandle(node)), writer);
+  }
+
+  // Touches are hit tested by the descriptors on Android, so nodeAt isn't
+  // used and views don't need to report where they are.
+  SonarInspectorBounds bounds(SonarInspectorNode node) override {
+    return SonarInspectorBounds();
+  }
+
+  SonarInspectorNode find(const std::string& id) override {
+    return toNode(current->find(id));
+  }
+
+  void retain(SonarInspectorNode node) override {
+    if (current) {
+      current->retain(toHandle(node));
+    }
+  }
+
+  void release(SonarInspectorNode node) override {
+    if (current) {
+      current->release(toHandle(node));
+    }
+  }
+
+ private:
+  static SonarInspectorNode toNode(jint handle) {
+    return reinterpret_cast<SonarInspectorNode>(static_cast<intptr_t>(handle));
+  }
+
+  static jint toHandle(SonarInspectorNode node) {
+    return static_cast<jint>(reinterpret_cast<intptr_t>(node));
+  }
+
+  static void putRaw(jni::alias_ref<jni::JArrayClass<jstring>::javaobject> pairs, SonarMessageWriter& writer) {
+    for (size_t i = 0, count = pairs ? pairs->size() / 2 : 0; i < count; i++) {
+      const auto value = pairs->getElement(2 * i + 1);
+      writer.putRaw(pairs->getElement(2 * i)->toStdString(), value ? value->toStdString() : "null");
+    }
+  }
 };
 
-class JSonarConnectionImpl : public jni::HybridClass<JSonarConnectionImpl, JSonarConnection> {
+class JInspectorEngine : public jni::HybridClass<JInspectorEngine> {
  public:
-  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/SonarConnectionImpl;";
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/android/InspectorEngine;";
 
   static void registerNatives() {
     registerHybrid({
-      makeNativeMethod("sendObject", JSonarConnectionImpl::sendObject),
-      makeNativeMethod("sendArray", JSonarConnectionImpl::sendArray),
-      makeNativeMethod("reportError", JSonarConnectionImpl::reportError),
-      makeNativeMethod("receive", JSonarConnectionImpl::receive),
+      makeNativeMethod("initHybrid", JInspectorEngine::initHybrid),
+      makeNativeMethod("getRootNative", JInspectorEngine::getRoot),
+      makeNativeMethod("startGetNodesNative", JInspectorEngine::startGetNodes),
+      makeNativeMethod("runGetNodesNative", JInspectorEngine::runGetNodes),
+      makeNativeMethod("respondNative", JInspectorEngine::respond),
+      makeNativeMethod("takeResponseNative", JInspectorEngine::takeResponse),
+      makeNativeMethod("resetNative", JInspectorEngine::reset),
     });
   }
 
-  void sendObject(const std::string method, jni::alias_ref<JSonarObject> json) {
-    _connection->send(std::move(method), json ? folly::parseJson(json->toJsonString()) : folly::dynamic::object());
+  static jni::local_ref<jhybriddata> initHybrid(jni::alias_ref<jclass>) {
+    return makeCxxInstance();
   }
 
-  void sendArray(const std::string method, jni::alias_ref<JSonarArray> json) {
-    _connection->send(std::move(method), json ? folly::parseJson(json->toJsonString()) : folly::dynamic::object());
+  std::string getRoot(jni::alias_ref<JInspectorEngineAdapter::javaobject> adapter) {
+    Call call(*this, adapter);
+    return _inspector.getRoot();
   }
 
-  void reportError(jni::alias_ref<jni::JThrowable> throwable) {
-    _connection->error(throwable->toString(), throwable->getStackTrace()->toString());
+  jint startGetNodes(const std::string& params) {
+    const auto id = ++_lastCall;
+    _calls[id] = _inspector.getNodes(folly::parseJson(params));
+    return id;
   }
 
-  void receive(const std::string method, jni::alias_ref<JSonarReceiver> receiver) {
-    auto global = make_global(receiver);
-    _connection->receive(std::move(method), [global] (const folly::dynamic& params, std::unique_ptr<SonarResponder> responder) {
-      global->receive(params, std::move(responder));
-    });
+  jboolean runGetNodes(jni::alias_ref<JInspectorEngineAdapter::javaobject> adapter, jint id, jlong budgetNanos) {
+    const auto getNodes = _calls.find(id);
+    if (getNodes == _calls.end()) {
+      return true;
+    }
+    Call call(*this, adapter);
+    return getNodes->second->run(std::chrono::nanoseconds(budgetNanos));
+  }
+
+  // Sends the response of a finished call without it passing through Java.
+  void respond(jint id, jni::alias_ref<JSonarResponderImpl::javaobject> responder) {
+    responder->cthis()->successJson(takeResponse(id));
+  }
+
+  std::string takeResponse(jint id) {
+    const auto getNodes = _calls.find(id);
+    if (getNodes == _calls.end()) {
+      return "{}";
+    }
+    auto response = getNodes->second->takeResponse();
+    _calls.erase(getNodes);
+    return response;
+  }
+
+  void reset(jni::alias_ref<JInspectorEngineAdapter::javaobject> adapter) {
+    Call call(*this, adapter);
+    _calls.clear();
+    _inspector.reset();
   }
 
  private:
   friend HybridBase;
-  std::shared_ptr<SonarConnection> _connection;
 
-  JSonarConnectionImpl(std::shared_ptr<SonarConnection> connection): _connection(std::move(connection)) {}
+  class Call {
+   public:
+    Call(JInspectorEngine& engine, jni::alias_ref<JInspectorEngineAdapter::javaobject> adapter)
+        : _adapter(engine._adapter) {
+      _adapter.current = adapter;
+    }
+
+    ~Call() {
+      _adapter.current = nullptr;
+    }
+
+   private:
+    JInspectorAdapter& _adapter;
+  };
+
+  // Owned by the inspector, and only called from the main thread.
+  JInspectorAdapter& _adapter;
+  SonarInspector _inspector;
+  std::unordered_map<jint, std::unique_ptr<SonarInspectorGetNodes>> _calls;
+  jint _lastCall = 0;
+
+  JInspectorEngine(): JInspectorEngine(new JInspectorAdapter()) {}
+
+  explicit JInspectorEngine(JInspectorAdapter* adapter)
+      : _adapter(*adapter), _inspector(std::unique_ptr<SonarInspectorAdapter>(adapter)) {}
 };
 
 class JSonarPlugin : public jni::JavaClass<JSonarPlugin> {
  public:
   constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/core/SonarPlugin;";
 
+  static void OnLoad() {
+    getIdMethod();
+    onConnectMethod();
+    onDisconnectMethod();
+  }
+
   std::string identifier() const {
-    static const auto method = javaClassStatic()->getMethod<std::string()>("getId");
-    return method(self())->toStdString();
+    return getIdMethod()(self())->toStdString();
   }
 
   void didConnect(std::shared_ptr<SonarConnection> conn) {
-    static const auto method = javaClassStatic()->getMethod<void(jni::alias_ref<JSonarConnection::javaobject>)>("onConnect");
-    method(self(), JSonarConnectionImpl::newObjectCxxArgs(conn));
+    onConnectMethod()(self(), JSonarConnectionImpl::newObjectCxxArgs(conn));
   }
 
   void didDisconnect() {
+    onDisconnectMethod()(self());
+  }
+
+ private:
+  static const jni::JMethod<std::string()>& getIdMethod() {
+    static const auto method = javaClassStatic()->getMethod<std::string()>("getId");
+    return method;
+  }
+
+  static const jni::JMethod<void(jni::alias_ref<JSonarConnection::javaobject>)>& onConnectMethod() {
+    static const auto method = javaClassStatic()->getMethod<void(jni::alias_ref<JSonarConnection::javaobject>)>("onConnect");
+    return method;
+  }
+
+  static const jni::JMethod<void()>& onDisconnectMethod() {
     static const auto method = javaClassStatic()->getMethod<void()>("onDisconnect");
-    method(self());
+    return method;
+  }
+};
+
+class JSonarPluginFactory : public jni::JavaClass<JSonarPluginFactory> {
+ public:
+  constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/core/SonarPluginFactory;";
+
+  static void OnLoad() {
+    createMethod();
+  }
+
+  jni::local_ref<JSonarPlugin> create() const {
+    return createMethod()(self());
+  }
+
+ private:
+  static const jni::JMethod<JSonarPlugin()>& createMethod() {
+    static const auto method = javaClassStatic()->getMethod<JSonarPlugin()>("create");
+    return method;
   }
 };
 
@@ -204,21 +1345,45 @@ class JSonarStateUpdateListener : public jni::JavaClass<JSonarStateUpdateListene
  public:
   constexpr static auto  kJavaDescriptor = "Lcom/facebook/sonar/core/SonarStateUpdateListener;";
 
+  static void OnLoad() {
+    onUpdateMethod();
+    onStepStartedMethod();
+    onStepSuccessMethod();
+    onStepFailedMethod();
+  }
+
   void onUpdate() {
-    static const auto method = javaClassStatic()->getMethod<void()>("onUpdate");
-    method(self());
+    onUpdateMethod()(self());
   }
   void onStepStarted(std::string step) {
-    static const auto method = javaClassStatic()->getMethod<void(std::string)>("onStepStarted");
-    method(self(), step);
+    onStepStartedMethod()(self(), step);
   }
   void onStepSuccess(std::string step) {
-    static const auto method = javaClassStatic()->getMethod<void(std::string)>("onStepSuccess");
-    method(self(), step);
+    onStepSuccessMethod()(self(), step);
   }
   void onStepFailed(std::string step, std::string errorMessage) {
+    onStepFailedMethod()(self(), step, errorMessage);
+  }
+
+ private:
+  static const jni::JMethod<void()>& onUpdateMethod() {
+    static const auto method = javaClassStatic()->getMethod<void()>("onUpdate");
+    return method;
+  }
+
+  static const jni::JMethod<void(std::string)>& onStepStartedMethod() {
+    static const auto method = javaClassStatic()->getMethod<void(std::string)>("onStepStarted");
+    return method;
+  }
+
+  static const jni::JMethod<void(std::string)>& onStepSuccessMethod() {
+    static const auto method = javaClassStatic()->getMethod<void(std::string)>("onStepSuccess");
+    return method;
+  }
+
+  static const jni::JMethod<void(std::string, std::string)>& onStepFailedMethod() {
     static const auto method = javaClassStatic()->getMethod<void(std::string, std::string)>("onStepFailed");
-    method(self(), step, errorMessage);
+    return method;
   }
 };
 
@@ -236,33 +1401,95 @@ class JSonarPluginWrapper : public SonarPlugin {
   jni::global_ref<JSonarPlugin> jplugin;
 
   virtual std::string identifier() const override {
-    return jplugin->identifier();
+    return identifier_;
   }
 
   virtual void didConnect(std::shared_ptr<SonarConnection> conn) override {
+    JniUpcallScope scope;
     jplugin->didConnect(conn);
   }
 
   virtual void didDisconnect() override {
+    JniUpcallScope scope;
     jplugin->didDisconnect();
   }
 
-  JSonarPluginWrapper(jni::global_ref<JSonarPlugin> plugin): jplugin(plugin) {}
+  // getId is called once here, on the thread registering the plugin, since
+  // SonarClient looks plugins up by identifier all the time.
+  JSonarPluginWrapper(jni::global_ref<JSonarPlugin> plugin): jplugin(plugin), identifier_(plugin->identifier()) {}
+
+ private:
+  const std::string identifier_;
 };
 
 struct JStateSummary : public jni::JavaClass<JStateSummary> {
 public:
   constexpr static auto kJavaDescriptor = "Lcom/facebook/sonar/core/StateSummary;";
 
+  static void OnLoad() {
+    addEntriesMethod();
+  }
+
   static jni::local_ref<JStateSummary> create() {
     return newInstance();
   }
 
-  void addEntry(std::string name, std::string state) {
-    static const auto method = javaClassStatic()->getMethod<void(std::string, std::string)>("addEntry");
-    return method(self(), name, state);
+  // What addEntries hands over, kept by the caller to hand over again while
+  // the elements are unchanged.
+  struct Entries {
+    jni::global_ref<jni::JArrayByte::javaobject> names;
+    jni::global_ref<jni::JArrayInt::javaobject> entries;
+    jni::global_ref<jni::JArrayLong::javaobject> durations;
+  };
+
+  // Packs every element into three arrays, which addEntries hands over in a
+  // single upcall; see StateSummary.addEntries for the layout.
+  static Entries pack(const std::vector<StateElement>& elements) {
+    std::string names;
+    std::vector<jint> entries;
+    std::vector<jlong> durations;
+    entries.reserve(elements.size() * (3 + StepTimings::kBucketCount));
+    durations.reserve(elements.size() * 2);
+    for (const auto& element : elements) {
+      names.append(element.name_);
+      entries.push_back(element.name_.size());
+      entries.push_back(stateOrdinal(element.state_));
+      entries.push_back(element.timings_.buckets.size());
+      entries.insert(entries.end(), element.timings_.buckets.begin(), element.timings_.buckets.end());
+      durations.push_back(element.timings_.lastMs);
+      durations.push_back(element.timings_.maxMs);
+    }
+
+    auto jnames = jni::JArrayByte::newArray(names.size());
+    jnames->setRegion(0, names.size(), reinterpret_cast<const jbyte*>(names.data()));
+    auto jentries = jni::JArrayInt::newArray(entries.size());
+    jentries->setRegion(0, entries.size(), entries.data());
+    auto jdurations = jni::JArrayLong::newArray(durations.size());
+    jdurations->setRegion(0, durations.size(), durations.data());
+    return Entries{jni::make_global(jnames), jni::make_global(jentries), jni::make_global(jdurations)};
+  }
+
+  void addEntries(const Entries& packed) {
+    addEntriesMethod()(self(), packed.names, packed.entries, packed.durations);
+  }
+
+ private:
+  using AddEntries = void(jni::alias_ref<jni::JArrayByte>, jni::alias_ref<jni::JArrayInt>, jni::alias_ref<jni::JArrayLong>);
+
+  static const jni::JMethod<AddEntries>& addEntriesMethod() {
+    static const auto method = javaClassStatic()->getMethod<AddEntries>("addEntries");
+    return method;
   }
 
+  // Ordinals of StateSummary.State.
+  static jint stateOrdinal(State state) {
+    switch (state) {
+      case State::in_progress: return 0;
+      case State::success: return 1;
+      case State::failed: return 2;
+    }
+    return 3;
+  }
 };
 
 class JSonarClient : public jni::HybridClass<JSonarClient> {
@@ -275,16 +1502,29 @@ class JSonarClient : public jni::HybridClass<JSonarClient> {
       makeNativeMethod("getInstance", JSonarClient::getInstance),
       makeNativeMethod("start", JSonarClient::start),
       makeNativeMethod("stop", JSonarClient::stop),
+      makeNativeMethod("suspend", JSonarClient::suspend),
+      makeNativeMethod("resume", JSonarClient::resume),
       makeNativeMethod("addPlugin", JSonarClient::addPlugin),
+      makeNativeMethod("addBackgroundPlugin", JSonarClient::addBackgroundPlugin),
+      makeNativeMethod("addPluginFactory", JSonarClient::addPluginFactory),
       makeNativeMethod("removePlugin", JSonarClient::removePlugin),
+      makeNativeMethod("isPluginActive", JSonarClient::isPluginActive),
       makeNativeMethod("subscribeForUpdates", JSonarClient::subscribeForUpdates),
       makeNativeMethod("unsubscribe", JSonarClient::unsubscribe),
       makeNativeMethod("getPlugin", JSonarClient::getPlugin),
       makeNativeMethod("getState", JSonarClient::getState),
       makeNativeMethod("getStateSummary", JSonarClient::getStateSummary),
+      makeNativeMethod("getMetrics", JSonarClient::getMetrics),
+      makeNativeMethod("onMemoryPressure", JSonarClient::onMemoryPressure),
     });
   }
 
+  static void onMemoryPressure(jni::alias_ref<jclass>, jboolean critical) {
+    SonarMemoryBudget::shared().onMemoryPressure(
+        critical ? SonarMemoryPressure::Critical
+                 : SonarMemoryPressure::Moderate);
+  }
+
   static jni::alias_ref<JSonarClient::javaobject> getInstance(jni::alias_ref<jclass>) {
     static auto client = make_global(newObjectCxxArgs());
   	return client;
@@ -298,16 +1538,47 @@ class JSonarClient : public jni::HybridClass<JSonarClient> {
   	SonarClient::instance()->stop();
   }
 
+  void suspend() {
+    SonarClient::instance()->suspend();
+  }
+
+  void resume() {
+    SonarClient::instance()->resume();
+  }
+
   void addPlugin(jni::alias_ref<JSonarPlugin> plugin) {
     auto wrapper = std::make_shared<JSonarPluginWrapper>(make_global(plugin));
     SonarClient::instance()->addPlugin(wrapper);
   }
 
+  void addBackgroundPlugin(jni::alias_ref<JSonarPlugin> plugin) {
+    auto wrapper = std::make_shared<JSonarPluginWrapper>(make_global(plugin));
+    SonarClient::instance()->addPlugin(wrapper, JThreadPoolExecutor::shared());
+  }
+
+  // The factory is called by SonarClient, on whichever thread the desktop's
+  // init arrives on.
+  void addPluginFactory(const std::string& identifier, jni::alias_ref<JSonarPluginFactory> factory) {
+    auto globalFactory = make_global(factory);
+    SonarClient::instance()->addPluginFactory(identifier, [globalFactory]() -> std::shared_ptr<SonarPlugin> {
+      JniUpcallScope scope;
+      auto plugin = globalFactory->create();
+      if (!plugin) {
+        return nullptr;
+      }
+      return std::make_shared<JSonarPluginWrapper>(make_global(plugin));
+    });
+  }
+
   void removePlugin(jni::alias_ref<JSonarPlugin> plugin) {
     auto client = SonarClient::instance();
     client->removePlugin(client->getPlugin(plugin->identifier()));
   }
 
+  jboolean isPluginActive(const std::string& identifier) {
+    return SonarClient::instance()->isPluginActive(identifier);
+  }
+
   void subscribeForUpdates(jni::alias_ref<JSonarStateUpdateListener> stateListener) {
     auto client = SonarClient::instance();
     mStateListener = std::make_shared<AndroidSonarStateUpdateListener>(stateListener);
@@ -320,25 +1591,37 @@ class JSonarClient : public jni::HybridClass<JSonarClient> {
     client->setStateListener(nullptr);
   }
 
-  std::string getState() {
-    return SonarClient::instance()->getState();
+  // Polls of an unchanged state get the same snapshot, and hand out the same
+  // Java string rather than converting it again.
+  jni::local_ref<jstring> getState() {
+    const auto state = SonarClient::instance()->getState();
+    std::lock_guard<std::mutex> lock(mStateMutex);
+    if (state != mState) {
+      mStateString = jni::make_global(jni::make_jstring(*state));
+      mState = state;
+    }
+    return jni::make_local(mStateString);
   }
 
-  jni::global_ref<JStateSummary::javaobject> getStateSummary() {
-    auto summary = jni::make_global(JStateSummary::create());
-    auto elements = SonarClient::instance()->getStateElements();
-    for (auto&& element : elements) {
-      std::string status;
-      switch (element.state_) {
-        case State::in_progress: status = "IN_PROGRESS"; break;
-        case State::failed: status = "FAILED"; break;
-        case State::success: status = "SUCCESS"; break;
-      }
-      summary->addEntry(element.name_, status);
+  std::string getMetrics() {
+    return folly::toJson(SonarClient::instance()->getMetrics());
+  }
+
+  // Java may change the summary it gets, so only the packed entries are
+  // kept for unchanged polls.
+  jni::local_ref<JStateSummary> getStateSummary() {
+    const auto elements = SonarClient::instance()->getStateElements();
+    std::lock_guard<std::mutex> lock(mStateMutex);
+    if (elements != mStateElements) {
+      mStateEntries = JStateSummary::pack(*elements);
+      mStateElements = elements;
     }
+    auto summary = JStateSummary::create();
+    summary->addEntries(mStateEntries);
     return summary;
   }
 
+
   jni::alias_ref<JSonarPlugin> getPlugin(const std::string& identifier) {
     auto plugin = SonarClient::instance()->getPlugin(identifier);
     if (plugin) {
@@ -359,9 +1642,12 @@ class JSonarClient : public jni::HybridClass<JSonarClient> {
       const std::string deviceId,
       const std::string app,
       const std::string appId,
-      const std::string privateAppDirectory) {
+      const std::string privateAppDirectory,
+      jni::alias_ref<jni::JArrayClass<jstring>> fallbackHosts,
+      const std::string brokerSocketName,
+      jboolean brokerOwner) {
 
-    SonarClient::init({
+    SonarInitConfig config{
       {
         std::move(host),
         std::move(os),
@@ -373,12 +1659,26 @@ class JSonarClient : public jni::HybridClass<JSonarClient> {
       },
       callbackWorker->eventBase(),
       connectionWorker->eventBase()
-    });
+    };
+    if (fallbackHosts) {
+      for (size_t i = 0; i < fallbackHosts->size(); i++) {
+        config.fallbackHosts.push_back(
+            fallbackHosts->getElement(i)->toStdString());
+      }
+    }
+    config.brokerSocketName = std::move(brokerSocketName);
+    config.brokerOwner = brokerOwner;
+    SonarClient::init(std::move(config));
   }
 
  private:
   friend HybridBase;
   std::shared_ptr<SonarStateUpdateListener> mStateListener = nullptr;
+  std::mutex mStateMutex;
+  std::shared_ptr<const std::string> mState;
+  jni::global_ref<jstring> mStateString;
+  std::shared_ptr<const std::vector<StateElement>> mStateElements;
+  JStateSummary::Entries mStateEntries;
   JSonarClient() {}
 };
 
@@ -386,10 +1686,37 @@ class JSonarClient : public jni::HybridClass<JSonarClient> {
 
 jint JNI_OnLoad(JavaVM* vm, void*) {
   return jni::initialize(vm, [] {
+#ifdef NDEBUG
+    // Errors reported to Java are mostly expected ones, such as calls to
+    // plugins that aren't registered, so don't pay for native stack traces.
+    jni::setCppStackTracesInJavaExceptions(false);
+#endif
+    // Resolve the classes and methods used for upcalls with the application
+    // class loader, since threads attached from native code only see the
+    // system class loader. This runs in the background so that neither
+    // library load nor the first message after connecting waits for it.
+    jni::preloadInBackground([] {
+      JSonarObject::OnLoad();
+      JSonarArray::OnLoad();
+      JSonarPlugin::OnLoad();
+      JSonarPluginFactory::OnLoad();
+      JSonarStateUpdateListener::OnLoad();
+      JStateSummary::OnLoad();
+      JSonarConnectionImpl::OnLoad();
+    });
     JSonarClient::registerNatives();
     JSonarConnectionImpl::registerNatives();
     JSonarResponderImpl::registerNatives();
+    JSonarObjectWriterImpl::registerNatives();
+    JSonarObjectImpl::registerNatives();
     JEventBase::registerNatives();
+    JEventRing::registerNatives();
+    JSonarFramesPlugin::registerNatives();
+    JSonarMemoryPlugin::registerNatives();
+    JSonarMetricsPlugin::registerNatives();
+    JSonarTracePlugin::registerNatives();
+    JNetworkCapture::registerNatives();
+    JInspectorEngine::registerNatives();
   });
 }
 
@@ -398,5 +1725,6 @@ AndroidSonarStateUpdateListener::AndroidSonarStateUpdateListener(jni::alias_ref<
 }
 
 void AndroidSonarStateUpdateListener::onUpdate() {
+  JniUpcallScope scope;
   jStateListener->onUpdate();
 }
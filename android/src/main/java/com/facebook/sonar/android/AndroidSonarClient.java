@@ -7,28 +7,36 @@
  */
 package com.facebook.sonar.android;
 
+import android.app.ActivityManager;
+import android.content.ComponentCallbacks2;
 import android.content.Context;
 import android.content.pm.PackageManager;
+import android.content.res.Configuration;
 import android.net.wifi.WifiInfo;
 import android.net.wifi.WifiManager;
 import android.os.Build;
+import android.os.Process;
 import android.support.v4.content.ContextCompat;
 import android.util.Log;
 import com.facebook.sonar.core.SonarClient;
+import com.facebook.sonar.core.SonarObjectWriter;
 
 public final class AndroidSonarClient {
   private static boolean sIsInitialized = false;
   private static SonarThread sSonarThread;
   private static SonarThread sConnectionThread;
+  private static int sThreadPriority = Process.THREAD_PRIORITY_BACKGROUND;
+  private static int[] sThreadCpus = new int[0];
+  private static boolean sShareConnection = false;
   private static final String[] REQUIRED_PERMISSIONS =
       new String[] {"android.permission.INTERNET", "android.permission.ACCESS_WIFI_STATE"};
 
   public static synchronized SonarClient getInstance(Context context) {
     if (!sIsInitialized) {
       checkRequiredPermissions(context);
-      sSonarThread = new SonarThread("SonarEventBaseThread");
+      sSonarThread = new SonarThread("SonarEventBaseThread", sThreadPriority, sThreadCpus);
       sSonarThread.start();
-      sConnectionThread = new SonarThread("SonarConnectionThread");
+      sConnectionThread = new SonarThread("SonarConnectionThread", sThreadPriority, sThreadCpus);
       sConnectionThread.start();
 
       final Context app =
@@ -42,12 +50,51 @@ public final class AndroidSonarClient {
           getId(),
           getRunningAppName(app),
           getPackageName(app),
-          context.getFilesDir().getAbsolutePath());
+          context.getFilesDir().getAbsolutePath(),
+          getFallbackServerHosts(),
+          sShareConnection ? "sonar-broker-" + getPackageName(app) : "",
+          getPackageName(app).equals(getProcessName(app)));
+      SonarObjectWriter.setFactory(SonarObjectWriterImpl.FACTORY);
+      app.registerComponentCallbacks(new MemoryPressureCallbacks());
       sIsInitialized = true;
     }
     return SonarClientImpl.getInstance();
   }
 
+  /**
+   * Sets the priority (a nice value, see {@link Process#setThreadPriority(int)}) and the CPUs of
+   * Sonar's callback and connection threads, for example to keep them on the little cores while
+   * measuring frame timings. Passing no CPUs leaves their affinity alone. Has to be called before
+   * the first call to getInstance.
+   *
+   * @throws IllegalArgumentException if a CPU id is negative.
+   */
+  public static synchronized void setThreadOptions(int priority, int... cpus) {
+    if (sIsInitialized) {
+      throw new IllegalStateException("Sonar threads have already been started");
+    }
+    for (int cpu : cpus) {
+      if (cpu < 0) {
+        throw new IllegalArgumentException("Invalid CPU id: " + cpu);
+      }
+    }
+    sThreadPriority = priority;
+    sThreadCpus = cpus.clone();
+  }
+
+  /**
+   * Has the processes of a multi-process app share one connection to the desktop, which then shows
+   * them as a single app. The main process, the one named after the package, connects to the
+   * desktop and relays the plugins of the other processes, which connect to it instead. Has to be
+   * called in every process before the first call to getInstance.
+   */
+  public static synchronized void setShareConnectionAcrossProcesses(boolean share) {
+    if (sIsInitialized) {
+      throw new IllegalStateException("Sonar has already been initialized");
+    }
+    sShareConnection = share;
+  }
+
   public static synchronized SonarClient getInstanceIfInitialized() {
     if (!sIsInitialized) {
       return null;
@@ -101,6 +148,43 @@ public final class AndroidSonarClient {
     }
   }
 
+  /**
+   * Hosts raced with {@link #getServerHost}, for emulators that reach the desktop through `adb
+   * reverse` rather than their host loopback address.
+   */
+  static String[] getFallbackServerHosts() {
+    if (isRunningOnStockEmulator() || isRunningOnGenymotion()) {
+      return new String[] {"localhost"};
+    } else {
+      return new String[0];
+    }
+  }
+
+  /** Sheds Sonar's buffers when the system runs low on memory, rather than get the app killed. */
+  static final class MemoryPressureCallbacks implements ComponentCallbacks2 {
+    @Override
+    public void onTrimMemory(int level) {
+      if (level == TRIM_MEMORY_RUNNING_CRITICAL || level >= TRIM_MEMORY_MODERATE) {
+        // Either the app is about to be killed to free memory, or next in line once in the
+        // background.
+        SonarClientImpl.onMemoryPressure(true);
+      } else if (level == TRIM_MEMORY_RUNNING_MODERATE
+          || level == TRIM_MEMORY_RUNNING_LOW
+          || level == TRIM_MEMORY_BACKGROUND) {
+        SonarClientImpl.onMemoryPressure(false);
+      }
+      // TRIM_MEMORY_UI_HIDDEN isn't pressure, only the UI going away.
+    }
+
+    @Override
+    public void onLowMemory() {
+      SonarClientImpl.onMemoryPressure(true);
+    }
+
+    @Override
+    public void onConfigurationChanged(Configuration newConfig) {}
+  }
+
   static String getRunningAppName(Context context) {
     return context.getApplicationInfo().loadLabel(context.getPackageManager()).toString();
   }
@@ -108,4 +192,19 @@ public final class AndroidSonarClient {
   static String getPackageName(Context context) {
     return context.getPackageName();
   }
+
+  static String getProcessName(Context context) {
+    final int pid = Process.myPid();
+    final ActivityManager manager =
+        (ActivityManager) context.getSystemService(Context.ACTIVITY_SERVICE);
+    if (manager == null || manager.getRunningAppProcesses() == null) {
+      return null;
+    }
+    for (ActivityManager.RunningAppProcessInfo info : manager.getRunningAppProcesses()) {
+      if (info.pid == pid) {
+        return info.processName;
+      }
+    }
+    return null;
+  }
 }
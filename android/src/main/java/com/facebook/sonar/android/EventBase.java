@@ -27,6 +27,10 @@ class EventBase extends HybridClassBase {
   @DoNotStrip
   native void loopForever();
 
+  /** Restricts the calling thread to the given CPUs. Returns false if that failed. */
+  @DoNotStrip
+  static native boolean setCurrentThreadAffinity(int[] cpus);
+
   @DoNotStrip
   private native void initHybrid();
 }
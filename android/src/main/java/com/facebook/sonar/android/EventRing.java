@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.android;
+
+import com.facebook.jni.HybridData;
+import com.facebook.proguard.annotations.DoNotStrip;
+import com.facebook.soloader.SoLoader;
+import com.facebook.sonar.BuildConfig;
+import com.facebook.sonar.core.SonarConnection;
+import com.facebook.sonar.core.SonarObject;
+import java.io.File;
+import javax.annotation.Nullable;
+
+/**
+ * Ring of serialized events, oldest first, in a native arena of a fixed size, shared with the
+ * iOS buffering plugin. Buffered events cost their serialized size and nothing else, and pushing
+ * and evicting never allocate. Not thread safe.
+ */
+@DoNotStrip
+public final class EventRing {
+  static {
+    if (BuildConfig.IS_INTERNAL_BUILD) {
+      SoLoader.loadLibrary("sonar");
+    }
+  }
+
+  private final HybridData mHybridData;
+
+  /**
+   * With a persistentFile, the ring is kept in that file, mapped into memory, so that events
+   * buffered by one run of the app are still there for the next. Falls back to memory if the file
+   * can't be mapped.
+   */
+  public EventRing(int maxEvents, int capacityBytes, @Nullable File persistentFile) {
+    mHybridData =
+        initHybrid(
+            maxEvents,
+            capacityBytes,
+            persistentFile != null ? persistentFile.getAbsolutePath() : null);
+  }
+
+  public native boolean isEmpty();
+
+  /** Adds an event, dropping the oldest ones if there's no room for it. */
+  public native void push(String method, String params);
+
+  /**
+   * Sends every buffered event to connection, oldest first, and empties the ring. Events go
+   * straight from the arena to Sonar's own connections, without a trip through Java each.
+   */
+  public void sendTo(SonarConnection connection) {
+    if (connection instanceof SonarConnectionImpl) {
+      sendToNative((SonarConnectionImpl) connection);
+      return;
+    }
+    while (!isEmpty()) {
+      final String method = frontMethod();
+      final String params = frontParams();
+      pop();
+      connection.send(method, new SonarObject(params));
+    }
+  }
+
+  private native void sendToNative(SonarConnectionImpl connection);
+
+  private native String frontMethod();
+
+  private native String frontParams();
+
+  private native void pop();
+
+  private static native HybridData initHybrid(
+      int maxEvents, int capacityBytes, @Nullable String persistentPath);
+}
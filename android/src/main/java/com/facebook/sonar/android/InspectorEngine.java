@@ -0,0 +1,146 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.android;
+
+import com.facebook.jni.HybridData;
+import com.facebook.proguard.annotations.DoNotStrip;
+import com.facebook.soloader.SoLoader;
+import com.facebook.sonar.BuildConfig;
+import com.facebook.sonar.core.SonarConnection;
+import com.facebook.sonar.core.SonarObject;
+import com.facebook.sonar.core.SonarResponder;
+import javax.annotation.Nullable;
+
+/**
+ * The native SonarInspector, which tracks the nodes the desktop knows by id and serializes them,
+ * leaving out the sections the desktop already has, for the Inspector plugin. It reaches the
+ * hierarchy through an {@link Adapter}, and must only be used from the main thread. Only available
+ * in internal builds, which load Sonar's native library.
+ */
+@DoNotStrip
+public final class InspectorEngine {
+  static {
+    if (BuildConfig.IS_INTERNAL_BUILD) {
+      SoLoader.loadLibrary("sonar");
+    }
+  }
+
+  /**
+   * The hierarchy, as seen by the engine. Nodes are handles the adapter hands out, 0 being none,
+   * which stay valid while the engine retains them. Handles the engine didn't retain may be
+   * dropped once the call into the engine that the adapter was passed to returns.
+   */
+  @DoNotStrip
+  public interface Adapter {
+    @DoNotStrip
+    int root();
+
+    @DoNotStrip
+    String identifier(int node);
+
+    @DoNotStrip
+    String name(int node);
+
+    @DoNotStrip
+    @Nullable
+    String decoration(int node);
+
+    @DoNotStrip
+    int[] children(int node);
+
+    /** Names and values, one after the other. */
+    @DoNotStrip
+    String[] attributes(int node);
+
+    /** Names of the node's sidebar sections and their values as JSON, one after the other. */
+    @DoNotStrip
+    String[] data(int node);
+
+    /** Names and JSON values of further keys of the node, which aren't hashed. */
+    @DoNotStrip
+    String[] extra(int node);
+
+    /** The node with an id handed out other than through the engine, or 0. */
+    @DoNotStrip
+    int find(String id);
+
+    @DoNotStrip
+    void retain(int node);
+
+    @DoNotStrip
+    void release(int node);
+  }
+
+  /**
+   * Only connections with a native side are served by the engine. A class of its own, since
+   * calling into InspectorEngine loads the native library.
+   */
+  public static final class Connections {
+    private Connections() {}
+
+    public static boolean canServe(SonarConnection connection) {
+      return connection instanceof SonarConnectionImpl;
+    }
+  }
+
+  /** A getNodes call, captured a slice at a time. */
+  public final class GetNodes {
+    private final int mCall;
+
+    private GetNodes(int call) {
+      mCall = call;
+    }
+
+    /** Captures nodes for about budgetNanos, at least one. Returns true once every node is. */
+    public boolean run(Adapter adapter, long budgetNanos) {
+      return runGetNodesNative(adapter, mCall, budgetNanos);
+    }
+
+    /** Sends the response, once run returned true. */
+    public void respond(SonarResponder responder) {
+      if (responder instanceof SonarResponderImpl) {
+        respondNative(mCall, (SonarResponderImpl) responder);
+      } else {
+        responder.success(new SonarObject(takeResponseNative(mCall)));
+      }
+    }
+  }
+
+  private final HybridData mHybridData;
+
+  public InspectorEngine() {
+    mHybridData = initHybrid();
+  }
+
+  public SonarObject getRoot(Adapter adapter) {
+    return new SonarObject(getRootNative(adapter));
+  }
+
+  public GetNodes getNodes(SonarObject params) {
+    return new GetNodes(startGetNodesNative(params.toJsonString()));
+  }
+
+  /** Forgets every node, releasing them through adapter. */
+  public void reset(Adapter adapter) {
+    resetNative(adapter);
+  }
+
+  private native String getRootNative(Adapter adapter);
+
+  private native int startGetNodesNative(String params);
+
+  private native boolean runGetNodesNative(Adapter adapter, int call, long budgetNanos);
+
+  private native void respondNative(int call, SonarResponderImpl responder);
+
+  private native String takeResponseNative(int call);
+
+  private native void resetNative(Adapter adapter);
+
+  private static native HybridData initHybrid();
+}
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.android;
+
+import com.facebook.jni.HybridData;
+import com.facebook.proguard.annotations.DoNotStrip;
+import com.facebook.soloader.SoLoader;
+import com.facebook.sonar.BuildConfig;
+import com.facebook.sonar.core.SonarConnection;
+import com.facebook.sonar.core.SonarObject;
+import java.io.File;
+import java.nio.ByteBuffer;
+import javax.annotation.Nullable;
+
+/**
+ * The native SonarNetworkCapture, which does the Network plugin's filtering, buffering while
+ * disconnected, keeping of bodies for getResponseBody, encoding and aggregation. Only available in
+ * internal builds, which load Sonar's native library.
+ */
+@DoNotStrip
+public final class NetworkCapture {
+  static {
+    if (BuildConfig.IS_INTERNAL_BUILD) {
+      SoLoader.loadLibrary("sonar");
+    }
+  }
+
+  private final HybridData mHybridData;
+
+  /**
+   * With a bufferFile, events are buffered in it while disconnected as BufferingSonarPlugin does.
+   * Response bodies that don't fit in memory spill into bodySpillDirectory, or are dropped without
+   * one.
+   */
+  public NetworkCapture(@Nullable File bufferFile, @Nullable File bodySpillDirectory) {
+    mHybridData =
+        initHybrid(
+            bufferFile != null ? bufferFile.getPath() : null,
+            bodySpillDirectory != null ? bodySpillDirectory.getPath() : null);
+  }
+
+  public void setFilter(SonarObject params) {
+    setFilterNative(params.toJsonString());
+  }
+
+  /** headers are names and values, one after the other. */
+  public void reportRequest(
+      String id,
+      long timestamp,
+      String method,
+      String url,
+      String[] headers,
+      @Nullable byte[] body) {
+    reportRequestNative(id, timestamp, method, url, headers, body);
+  }
+
+  /** Only one of body and bodyBuffer is set, the latter between its position and limit. */
+  public void reportResponse(
+      String id,
+      long timestamp,
+      int status,
+      @Nullable String reason,
+      String[] headers,
+      boolean formattable,
+      @Nullable byte[] body,
+      @Nullable ByteBuffer bodyBuffer) {
+    reportResponseNative(id, timestamp, status, reason, headers, formattable, body, bodyBuffer);
+  }
+
+  /** For a response that was checked against the filter and left out before it was reported. */
+  public void reportDropped(String id) {
+    reportDroppedNative(id);
+  }
+
+  /** Returns false for connections without a native side, which the capture can't send to. */
+  public boolean connect(SonarConnection connection) {
+    if (!(connection instanceof SonarConnectionImpl)) {
+      return false;
+    }
+    connectNative((SonarConnectionImpl) connection);
+    return true;
+  }
+
+  public void disconnect() {
+    disconnectNative();
+  }
+
+  private native void setFilterNative(String params);
+
+  private native void reportRequestNative(
+      String id, long timestamp, String method, String url, String[] headers, byte[] body);
+
+  private native void reportResponseNative(
+      String id,
+      long timestamp,
+      int status,
+      String reason,
+      String[] headers,
+      boolean formattable,
+      byte[] body,
+      ByteBuffer bodyBuffer);
+
+  private native void reportDroppedNative(String id);
+
+  private native void connectNative(SonarConnectionImpl connection);
+
+  private native void disconnectNative();
+
+  private static native HybridData initHybrid(String bufferPath, String bodySpillDirectory);
+}
@@ -13,6 +13,7 @@ import com.facebook.soloader.SoLoader;
 import com.facebook.sonar.BuildConfig;
 import com.facebook.sonar.core.SonarClient;
 import com.facebook.sonar.core.SonarPlugin;
+import com.facebook.sonar.core.SonarPluginFactory;
 import com.facebook.sonar.core.SonarStateUpdateListener;
 import com.facebook.sonar.core.StateSummary;
 
@@ -39,25 +40,49 @@ class SonarClientImpl implements SonarClient {
       String deviceId,
       String app,
       String appId,
-      String privateAppDirectory);
+      String privateAppDirectory,
+      String[] fallbackHosts,
+      String brokerSocketName,
+      boolean brokerOwner);
 
   public static native SonarClientImpl getInstance();
 
+  /**
+   * Has Sonar's buffers drop half of what they hold, or all of it when critical. See {@link
+   * AndroidSonarClient} for how trim levels map to it.
+   */
+  public static native void onMemoryPressure(boolean critical);
+
   @Override
   public native void addPlugin(SonarPlugin plugin);
 
+  @Override
+  public native void addBackgroundPlugin(SonarPlugin plugin);
+
+  @Override
+  public native void addPluginFactory(String id, SonarPluginFactory factory);
+
   @Override
   public native <T extends SonarPlugin> T getPlugin(String id);
 
   @Override
   public native void removePlugin(SonarPlugin plugin);
 
+  @Override
+  public native boolean isPluginActive(String id);
+
   @Override
   public native void start();
 
   @Override
   public native void stop();
 
+  @Override
+  public native void suspend();
+
+  @Override
+  public native void resume();
+
   @Override
   public native void subscribeForUpdates(SonarStateUpdateListener stateListener);
 
@@ -69,4 +94,7 @@ class SonarClientImpl implements SonarClient {
 
   @Override
   public native StateSummary getStateSummary();
+
+  @Override
+  public native String getMetrics();
 }
@@ -15,6 +15,10 @@ import com.facebook.sonar.core.SonarArray;
 import com.facebook.sonar.core.SonarConnection;
 import com.facebook.sonar.core.SonarObject;
 import com.facebook.sonar.core.SonarReceiver;
+import com.facebook.sonar.core.SonarResponder;
+import java.nio.ByteBuffer;
+import java.util.List;
+import java.util.concurrent.CopyOnWriteArrayList;
 
 @DoNotStrip
 class SonarConnectionImpl implements SonarConnection {
@@ -25,6 +29,9 @@ class SonarConnectionImpl implements SonarConnection {
   }
 
   private final HybridData mHybridData;
+  // Copied on registration, which is rare, so that dispatching a call doesn't
+  // lock. Only appended to, so an index stays valid.
+  private final List<SonarReceiver> mReceivers = new CopyOnWriteArrayList<>();
 
   private SonarConnectionImpl(HybridData hd) {
     mHybridData = hd;
@@ -44,9 +51,33 @@ class SonarConnectionImpl implements SonarConnection {
 
   public native void sendArray(String method, SonarArray params);
 
+  @Override
+  public native boolean sendBytes(String method, SonarObject metadata, ByteBuffer data);
+
   @Override
   public native void reportError(Throwable throwable);
 
   @Override
-  public native void receive(String method, SonarReceiver receiver);
+  public native void cacheResponses(String method, String version);
+
+  @Override
+  public native void invalidateResponses(String version);
+
+  @Override
+  public void receive(String method, SonarReceiver receiver) {
+    final int index;
+    synchronized (mReceivers) {
+      index = mReceivers.size();
+      mReceivers.add(receiver);
+    }
+    receiveNative(method, index);
+  }
+
+  private native void receiveNative(String method, int index);
+
+  @DoNotStrip
+  private void dispatch(int index, SonarObject params, SonarResponder responder)
+      throws Exception {
+    mReceivers.get(index).onReceive(params, responder);
+  }
 }
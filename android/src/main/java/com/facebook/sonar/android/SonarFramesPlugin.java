@@ -0,0 +1,127 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.android;
+
+import android.annotation.TargetApi;
+import android.content.Context;
+import android.os.Build;
+import android.os.Handler;
+import android.os.Looper;
+import android.view.Choreographer;
+import android.view.WindowManager;
+import com.facebook.jni.HybridData;
+import com.facebook.proguard.annotations.DoNotStrip;
+import com.facebook.soloader.SoLoader;
+import com.facebook.sonar.BuildConfig;
+import com.facebook.sonar.core.SonarConnection;
+import com.facebook.sonar.core.SonarPlugin;
+
+/**
+ * Sends frame duration histograms, missed refreshes and the CPU time of Sonar's own threads to the
+ * desktop's Frames plugin once per summary interval, see the native SonarFramesPlugin. Frames are
+ * timed with a {@link Choreographer.FrameCallback} while a desktop is connected, and need API 16.
+ */
+@DoNotStrip
+public final class SonarFramesPlugin implements SonarPlugin {
+  static {
+    if (BuildConfig.IS_INTERNAL_BUILD) {
+      SoLoader.loadLibrary("sonar");
+    }
+  }
+
+  public static final String ID = "Frames";
+
+  private final HybridData mHybridData;
+  private final Handler mMainHandler = new Handler(Looper.getMainLooper());
+  private final Context mContext;
+  // Only touched on the main thread.
+  private Object mFrameCallback;
+
+  /** context is used for the display's refresh rate, frames are counted against 60Hz otherwise. */
+  public SonarFramesPlugin(Context context) {
+    this(context, 1000);
+  }
+
+  public SonarFramesPlugin(Context context, int summaryIntervalMs) {
+    mContext = context == null ? null : context.getApplicationContext();
+    mHybridData = initHybrid(summaryIntervalMs);
+  }
+
+  @Override
+  public String getId() {
+    return ID;
+  }
+
+  @Override
+  public void onConnect(SonarConnection connection) {
+    // Only Sonar's own connections have a native side to send to.
+    if (!(connection instanceof SonarConnectionImpl)
+        || Build.VERSION.SDK_INT < Build.VERSION_CODES.JELLY_BEAN) {
+      return;
+    }
+    connectNative((SonarConnectionImpl) connection);
+    mMainHandler.post(
+        new Runnable() {
+          @Override
+          @TargetApi(Build.VERSION_CODES.JELLY_BEAN)
+          public void run() {
+            if (mFrameCallback == null) {
+              setRefreshPeriodNative(refreshPeriodNanos());
+              final FrameCallback callback = new FrameCallback();
+              mFrameCallback = callback;
+              Choreographer.getInstance().postFrameCallback(callback);
+            }
+          }
+        });
+  }
+
+  @Override
+  public void onDisconnect() {
+    mMainHandler.post(
+        new Runnable() {
+          @Override
+          public void run() {
+            // The callback stops posting itself once it is no longer the current one.
+            mFrameCallback = null;
+          }
+        });
+    disconnectNative();
+  }
+
+  private long refreshPeriodNanos() {
+    if (mContext == null) {
+      return 0;
+    }
+    final WindowManager windowManager =
+        (WindowManager) mContext.getSystemService(Context.WINDOW_SERVICE);
+    final float refreshRate = windowManager.getDefaultDisplay().getRefreshRate();
+    return refreshRate > 0 ? (long) (1e9 / refreshRate) : 0;
+  }
+
+  @TargetApi(Build.VERSION_CODES.JELLY_BEAN)
+  private final class FrameCallback implements Choreographer.FrameCallback {
+    @Override
+    public void doFrame(long frameTimeNanos) {
+      if (mFrameCallback != this) {
+        return;
+      }
+      frameNative(frameTimeNanos);
+      Choreographer.getInstance().postFrameCallback(this);
+    }
+  }
+
+  private native void frameNative(long frameTimeNanos);
+
+  private native void setRefreshPeriodNative(long nanos);
+
+  private native void connectNative(SonarConnectionImpl connection);
+
+  private native void disconnectNative();
+
+  private static native HybridData initHybrid(int summaryIntervalMs);
+}
@@ -0,0 +1,61 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.android;
+
+import com.facebook.jni.HybridData;
+import com.facebook.proguard.annotations.DoNotStrip;
+import com.facebook.soloader.SoLoader;
+import com.facebook.sonar.BuildConfig;
+import com.facebook.sonar.core.SonarConnection;
+import com.facebook.sonar.core.SonarPlugin;
+
+/**
+ * Samples the app's RSS, PSS, native heap and Java heap for the desktop's Memory plugin, see the
+ * native SonarMemoryPlugin. Sampling runs on Sonar's own thread while a desktop is connected, at
+ * the rate the desktop picks.
+ */
+@DoNotStrip
+public final class SonarMemoryPlugin implements SonarPlugin {
+  static {
+    if (BuildConfig.IS_INTERNAL_BUILD) {
+      SoLoader.loadLibrary("sonar");
+    }
+  }
+
+  public static final String ID = "Memory";
+
+  private final HybridData mHybridData;
+
+  public SonarMemoryPlugin() {
+    mHybridData = initHybrid();
+  }
+
+  @Override
+  public String getId() {
+    return ID;
+  }
+
+  @Override
+  public void onConnect(SonarConnection connection) {
+    // Only Sonar's own connections have a native side to send to.
+    if (connection instanceof SonarConnectionImpl) {
+      connectNative((SonarConnectionImpl) connection);
+    }
+  }
+
+  @Override
+  public void onDisconnect() {
+    disconnectNative();
+  }
+
+  private native void connectNative(SonarConnectionImpl connection);
+
+  private native void disconnectNative();
+
+  private static native HybridData initHybrid();
+}
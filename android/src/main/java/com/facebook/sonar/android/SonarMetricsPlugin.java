@@ -0,0 +1,146 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.android;
+
+import com.facebook.jni.HybridData;
+import com.facebook.proguard.annotations.DoNotStrip;
+import com.facebook.soloader.SoLoader;
+import com.facebook.sonar.BuildConfig;
+import com.facebook.sonar.core.SonarConnection;
+import com.facebook.sonar.core.SonarPlugin;
+
+/**
+ * Streams app defined counters, gauges and histograms to the desktop's Metrics plugin, see the
+ * native SonarMetricsPlugin. Values are recorded into per-thread native shards, without building
+ * a message each, and sent together once per flush interval.
+ *
+ * <p>Metrics are looked up by name once, and the handle kept:
+ *
+ * <pre>
+ *   private static final SonarMetricsPlugin.Counter sHits = metrics.counter("cache.hits");
+ *   sHits.add();
+ * </pre>
+ */
+@DoNotStrip
+public final class SonarMetricsPlugin implements SonarPlugin {
+  static {
+    if (BuildConfig.IS_INTERNAL_BUILD) {
+      SoLoader.loadLibrary("sonar");
+    }
+  }
+
+  public static final String ID = "Metrics";
+
+  private final HybridData mHybridData;
+
+  public SonarMetricsPlugin() {
+    this(1000);
+  }
+
+  public SonarMetricsPlugin(int flushIntervalMs) {
+    mHybridData = initHybrid(flushIntervalMs);
+  }
+
+  /** Counts events, such as cache hits. */
+  public final class Counter {
+    private final int mIndex;
+
+    private Counter(int index) {
+      mIndex = index;
+    }
+
+    public void add() {
+      add(1);
+    }
+
+    public void add(long amount) {
+      if (mIndex >= 0) {
+        addNative(mIndex, amount);
+      }
+    }
+  }
+
+  /** A value that is set rather than added to, such as a queue depth. */
+  public final class Gauge {
+    private final int mIndex;
+
+    private Gauge(int index) {
+      mIndex = index;
+    }
+
+    public void set(double value) {
+      if (mIndex >= 0) {
+        setNative(mIndex, value);
+      }
+    }
+  }
+
+  /** A distribution of values, such as durations in microseconds. */
+  public final class Histogram {
+    private final int mIndex;
+
+    private Histogram(int index) {
+      mIndex = index;
+    }
+
+    public void record(long value) {
+      if (mIndex >= 0) {
+        recordNative(mIndex, value);
+      }
+    }
+  }
+
+  /** Past the native limit on names, the handle does nothing. */
+  public Counter counter(String name) {
+    return new Counter(counterIndex(name));
+  }
+
+  public Gauge gauge(String name) {
+    return new Gauge(gaugeIndex(name));
+  }
+
+  public Histogram histogram(String name) {
+    return new Histogram(histogramIndex(name));
+  }
+
+  @Override
+  public String getId() {
+    return ID;
+  }
+
+  @Override
+  public void onConnect(SonarConnection connection) {
+    // Only Sonar's own connections have a native side to flush to.
+    if (connection instanceof SonarConnectionImpl) {
+      connectNative((SonarConnectionImpl) connection);
+    }
+  }
+
+  @Override
+  public void onDisconnect() {
+    disconnectNative();
+  }
+
+  private native int counterIndex(String name);
+
+  private native int gaugeIndex(String name);
+
+  private native int histogramIndex(String name);
+
+  private native void addNative(int index, long amount);
+
+  private native void setNative(int index, double value);
+
+  private native void recordNative(int index, long value);
+
+  private native void connectNative(SonarConnectionImpl connection);
+
+  private native void disconnectNative();
+
+  private static native HybridData initHybrid(int flushIntervalMs);
+}
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.android;
+
+import com.facebook.jni.HybridData;
+import com.facebook.proguard.annotations.DoNotStrip;
+import com.facebook.soloader.SoLoader;
+import com.facebook.sonar.BuildConfig;
+import com.facebook.sonar.core.SonarArray;
+import com.facebook.sonar.core.SonarObject;
+import org.json.JSONException;
+import org.json.JSONObject;
+
+/**
+ * A SonarObject that reads its fields straight from the params the desktop sent, so receivers don't
+ * pay for converting the whole message to JSON and back when they only look at a few fields.
+ */
+@DoNotStrip
+class SonarObjectImpl extends SonarObject {
+  static {
+    if (BuildConfig.IS_INTERNAL_BUILD) {
+      SoLoader.loadLibrary("sonar");
+    }
+  }
+
+  private final HybridData mHybridData;
+
+  private SonarObjectImpl(HybridData hd) {
+    mHybridData = hd;
+  }
+
+  @Override
+  protected JSONObject materialize() {
+    try {
+      return new JSONObject(toJsonString());
+    } catch (JSONException e) {
+      throw new RuntimeException(e);
+    }
+  }
+
+  @Override
+  public native String getString(String name);
+
+  @Override
+  public native int getInt(String name);
+
+  @Override
+  public native long getLong(String name);
+
+  @Override
+  public float getFloat(String name) {
+    return (float) getDouble(name);
+  }
+
+  @Override
+  public native double getDouble(String name);
+
+  @Override
+  public native boolean getBoolean(String name);
+
+  @Override
+  public native SonarObject getObject(String name);
+
+  @Override
+  public native SonarArray getArray(String name);
+
+  @Override
+  public native boolean contains(String name);
+
+  @Override
+  public native String toJsonString();
+
+  @Override
+  public String toString() {
+    return toJsonString();
+  }
+}
@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.android;
+
+import com.facebook.jni.HybridData;
+import com.facebook.proguard.annotations.DoNotStrip;
+import com.facebook.soloader.SoLoader;
+import com.facebook.sonar.BuildConfig;
+import com.facebook.sonar.core.SonarArray;
+import com.facebook.sonar.core.SonarObject;
+import com.facebook.sonar.core.SonarObjectWriter;
+import javax.annotation.Nullable;
+
+/** Writes into a native folly::dynamic. build() returns a {@link SonarObjectImpl}. */
+@DoNotStrip
+class SonarObjectWriterImpl extends SonarObjectWriter {
+  static {
+    if (BuildConfig.IS_INTERNAL_BUILD) {
+      SoLoader.loadLibrary("sonar");
+    }
+  }
+
+  static final Factory FACTORY =
+      new Factory() {
+        @Override
+        public SonarObjectWriter create() {
+          return new SonarObjectWriterImpl();
+        }
+      };
+
+  private final HybridData mHybridData;
+
+  private SonarObjectWriterImpl() {
+    mHybridData = initHybrid();
+  }
+
+  private static native HybridData initHybrid();
+
+  @Override
+  protected native void writeString(@Nullable String name, @Nullable String value);
+
+  @Override
+  protected native void writeLong(@Nullable String name, long value);
+
+  @Override
+  protected native void writeDouble(@Nullable String name, double value);
+
+  @Override
+  protected native void writeBoolean(@Nullable String name, boolean value);
+
+  @Override
+  protected native void writeObject(@Nullable String name, @Nullable SonarObject value);
+
+  @Override
+  protected native void writeArray(@Nullable String name, @Nullable SonarArray value);
+
+  @Override
+  protected native void begin(@Nullable String name, boolean array);
+
+  @Override
+  public SonarObjectWriter end() {
+    endNative();
+    return this;
+  }
+
+  private native void endNative();
+
+  @Override
+  public native SonarObject build();
+}
@@ -8,18 +8,28 @@
 package com.facebook.sonar.android;
 
 import android.os.Process;
+import android.util.Log;
+import java.util.Arrays;
 import javax.annotation.Nullable;
 
 class SonarThread extends Thread {
   private @Nullable EventBase mEventBase;
+  private final int mPriority;
+  private final int[] mCpus;
 
   SonarThread(final String name) {
+    this(name, Process.THREAD_PRIORITY_BACKGROUND, new int[0]);
+  }
+
+  SonarThread(final String name, int priority, int[] cpus) {
     super(name);
+    mPriority = priority;
+    mCpus = cpus;
   }
 
   @Override
   public void run() {
-    Process.setThreadPriority(Process.THREAD_PRIORITY_BACKGROUND);
+    Process.setThreadPriority(mPriority);
     synchronized (this) {
       try {
         mEventBase = new EventBase();
@@ -28,6 +38,10 @@ class SonarThread extends Thread {
       }
     }
 
+    if (mCpus.length > 0 && !EventBase.setCurrentThreadAffinity(mCpus)) {
+      Log.w("Sonar", "Unable to restrict " + getName() + " to CPUs " + Arrays.toString(mCpus));
+    }
+
     mEventBase.loopForever();
   }
 
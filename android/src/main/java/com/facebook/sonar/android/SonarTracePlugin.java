@@ -0,0 +1,121 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.android;
+
+import com.facebook.jni.HybridData;
+import com.facebook.proguard.annotations.DoNotStrip;
+import com.facebook.soloader.SoLoader;
+import com.facebook.sonar.BuildConfig;
+import com.facebook.sonar.core.SonarConnection;
+import com.facebook.sonar.core.SonarPlugin;
+
+/**
+ * Records begin, end and instant events for the desktop's Trace plugin, see the native
+ * SonarTracePlugin. Each thread writes into a fixed-size native ring of its own, without locking
+ * or allocating, and the desktop either streams what was recorded or asks for a dump of the rings.
+ *
+ * <p>Names are looked up once, and the handle kept:
+ *
+ * <pre>
+ *   private static final SonarTracePlugin.Name sDecode = trace.name("decode");
+ *   sDecode.begin();
+ *   try {
+ *     ...
+ *   } finally {
+ *     sDecode.end();
+ *   }
+ * </pre>
+ */
+@DoNotStrip
+public final class SonarTracePlugin implements SonarPlugin {
+  static {
+    if (BuildConfig.IS_INTERNAL_BUILD) {
+      SoLoader.loadLibrary("sonar");
+    }
+  }
+
+  public static final String ID = "Trace";
+
+  private final HybridData mHybridData;
+
+  public SonarTracePlugin() {
+    this(4096, 250);
+  }
+
+  /** eventsPerThread is rounded up to a power of two. */
+  public SonarTracePlugin(int eventsPerThread, int flushIntervalMs) {
+    mHybridData = initHybrid(eventsPerThread, flushIntervalMs);
+  }
+
+  /** Ends are matched with the latest begin on the same thread, whatever their name. */
+  public final class Name {
+    private final int mIndex;
+
+    private Name(int index) {
+      mIndex = index;
+    }
+
+    public void begin() {
+      record('B');
+    }
+
+    public void end() {
+      record('E');
+    }
+
+    public void instant() {
+      record('i');
+    }
+
+    private void record(char phase) {
+      if (mIndex >= 0) {
+        recordNative(mIndex, phase);
+      }
+    }
+  }
+
+  /** Past the native limit on names, the handle does nothing. */
+  public Name name(String name) {
+    return new Name(nameIndex(name));
+  }
+
+  /** Sends everything the rings hold to the desktop, if it is connected. */
+  public void dump() {
+    dumpNative();
+  }
+
+  @Override
+  public String getId() {
+    return ID;
+  }
+
+  @Override
+  public void onConnect(SonarConnection connection) {
+    // Only Sonar's own connections have a native side to send to.
+    if (connection instanceof SonarConnectionImpl) {
+      connectNative((SonarConnectionImpl) connection);
+    }
+  }
+
+  @Override
+  public void onDisconnect() {
+    disconnectNative();
+  }
+
+  private native int nameIndex(String name);
+
+  private native void recordNative(int index, char phase);
+
+  private native void dumpNative();
+
+  private native void connectNative(SonarConnectionImpl connection);
+
+  private native void disconnectNative();
+
+  private static native HybridData initHybrid(int eventsPerThread, int flushIntervalMs);
+}
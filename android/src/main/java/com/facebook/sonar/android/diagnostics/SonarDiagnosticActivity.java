@@ -13,6 +13,8 @@ import android.widget.LinearLayout;
 import android.view.View;
 import android.widget.TextView;
 import android.widget.ScrollView;
+import org.json.JSONException;
+import org.json.JSONObject;
 
 public class SonarDiagnosticActivity extends Activity implements SonarStateUpdateListener {
 
@@ -80,9 +82,31 @@ public class SonarDiagnosticActivity extends Activity implements SonarStateUpdat
       }
       stateText.append(status).append(e.getName()).append("\n");
     }
+    stateText.append(getTransportSummary());
     return stateText.toString();
   }
 
+  private String getTransportSummary() {
+    try {
+      final JSONObject transport =
+          new JSONObject(AndroidSonarClient.getInstance(this).getMetrics())
+              .getJSONObject("transport");
+      final long rtt = transport.getLong("keepaliveRttMicros");
+      return "Frames in/out: "
+          + transport.getLong("framesReceived")
+          + "/"
+          + transport.getLong("framesSent")
+          + ", bytes in/out: "
+          + transport.getLong("bytesReceived")
+          + "/"
+          + transport.getLong("bytesSent")
+          + ", keepalive RTT: "
+          + (rtt < 0 ? "-" : (rtt / 1000) + " ms");
+    } catch (JSONException e) {
+      return "";
+    }
+  }
+
   protected void onStop() {
     super.onStop();
     final SonarClient client = AndroidSonarClient.getInstance(this);
@@ -149,7 +149,7 @@ public class SonarArray {
     }
 
     public Builder put(SonarObject o) {
-      mJson.put(o == null ? null : o.mJson);
+      mJson.put(o == null ? null : o.json());
       return this;
     }
 
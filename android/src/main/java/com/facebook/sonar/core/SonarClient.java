@@ -10,14 +10,43 @@ package com.facebook.sonar.core;
 public interface SonarClient {
   void addPlugin(SonarPlugin plugin);
 
+  /**
+   * Same as {@link #addPlugin}, but the plugin's receivers are called on a small pool of
+   * background threads shared by such plugins, rather than on Sonar's own thread, so that a slow
+   * receiver doesn't hold up other plugins' messages. Receivers must be thread safe.
+   */
+  void addBackgroundPlugin(SonarPlugin plugin);
+
+  /**
+   * Same as {@link #addPlugin}, for a plugin that is only created once a desktop opens it, or once
+   * {@link #getPlugin} asks for it. Its id is listed to desktops in the meantime, so that plugins
+   * that are expensive to set up cost nothing until they're used.
+   */
+  void addPluginFactory(String id, SonarPluginFactory factory);
+
   <T extends SonarPlugin> T getPlugin(String id);
 
   void removePlugin(SonarPlugin plugin);
 
+  /**
+   * Whether a desktop is connected and has initialized the plugin with the given id. Cheap enough
+   * to check before doing work that is only useful to the desktop.
+   */
+  boolean isPluginActive(String id);
+
   void start();
 
   void stop();
 
+  /**
+   * For when the app goes to the background, instead of {@link #stop()}, which disconnects every
+   * plugin. Plugin messages are held and reconnecting is put off until {@link #resume()}, while the
+   * connection and the plugins connected over it are kept.
+   */
+  void suspend();
+
+  void resume();
+
   void subscribeForUpdates(SonarStateUpdateListener stateListener);
 
   void unsubscribe();
@@ -25,4 +54,10 @@ public interface SonarClient {
   String getState();
 
   StateSummary getStateSummary();
+
+  /**
+   * Per plugin traffic and transport counters as a JSON object, in the same
+   * format the desktop gets from the "__metrics" method.
+   */
+  String getMetrics();
 }
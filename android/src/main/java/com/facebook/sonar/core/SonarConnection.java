@@ -7,6 +7,8 @@
  */
 package com.facebook.sonar.core;
 
+import java.nio.ByteBuffer;
+
 /**
  * A connection between a SonarPlugin and the desktop Sonar application. Register request handlers
  * to respond to calls made by the desktop application or directly send messages to the desktop
@@ -26,6 +28,26 @@ public interface SonarConnection {
    */
   void send(String method, SonarArray params);
 
+  /**
+   * Call a remote method on the Sonar desktop application with binary data, such as an image,
+   * along with optional metadata. The data goes from the buffer's position to its limit. Direct
+   * buffers are sent from their memory without copying, so they must not be modified afterwards;
+   * other buffers are copied once.
+   * Returns false without sending anything if the desktop can't receive binary data, in which case
+   * callers should fall back to send.
+   */
+  boolean sendBytes(String method, SonarObject metadata, ByteBuffer data);
+
+  /**
+   * Serve repeat calls of method with identical params from the last response, for as long as the
+   * counter named version isn't bumped with invalidateResponses. Only for methods whose response
+   * depends on nothing but their params and the state that counter covers.
+   */
+  void cacheResponses(String method, String version);
+
+  /** Drop the cached responses that depend on the counter named version. */
+  void invalidateResponses(String version);
+
   /** Report client error */
   void reportError(Throwable throwable);
 
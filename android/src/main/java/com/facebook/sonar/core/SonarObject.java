@@ -13,12 +13,20 @@ import org.json.JSONException;
 import org.json.JSONObject;
 
 public class SonarObject {
-  final JSONObject mJson;
+  private JSONObject mJson;
 
   public SonarObject(JSONObject json) {
     mJson = (json != null ? json : new JSONObject());
   }
 
+  /**
+   * For subclasses that hold their fields elsewhere and only build the JSONObject once {@link
+   * #materialize()} is needed.
+   */
+  protected SonarObject() {
+    mJson = null;
+  }
+
   public SonarObject(String json) {
     try {
       mJson = new JSONObject(json);
@@ -27,49 +35,61 @@ public class SonarObject {
     }
   }
 
+  /** Builds the JSONObject backing a lazily created object. Called at most once. */
+  protected JSONObject materialize() {
+    return new JSONObject();
+  }
+
+  final JSONObject json() {
+    if (mJson == null) {
+      mJson = materialize();
+    }
+    return mJson;
+  }
+
   public SonarDynamic getDynamic(String name) {
-    return new SonarDynamic(mJson.opt(name));
+    return new SonarDynamic(json().opt(name));
   }
 
   public String getString(String name) {
-    if (mJson.isNull(name)) {
+    if (json().isNull(name)) {
       return null;
     }
-    return mJson.optString(name);
+    return json().optString(name);
   }
 
   public int getInt(String name) {
-    return mJson.optInt(name);
+    return json().optInt(name);
   }
 
   public long getLong(String name) {
-    return mJson.optLong(name);
+    return json().optLong(name);
   }
 
   public float getFloat(String name) {
-    return (float) mJson.optDouble(name);
+    return (float) json().optDouble(name);
   }
 
   public double getDouble(String name) {
-    return mJson.optDouble(name);
+    return json().optDouble(name);
   }
 
   public boolean getBoolean(String name) {
-    return mJson.optBoolean(name);
+    return json().optBoolean(name);
   }
 
   public SonarObject getObject(String name) {
-    final Object o = mJson.opt(name);
+    final Object o = json().opt(name);
     return new SonarObject((JSONObject) o);
   }
 
   public SonarArray getArray(String name) {
-    final Object o = mJson.opt(name);
+    final Object o = json().opt(name);
     return new SonarArray((JSONArray) o);
   }
 
   public boolean contains(String name) {
-    return mJson.has(name);
+    return json().has(name);
   }
 
   public String toJsonString() {
@@ -78,17 +98,17 @@ public class SonarObject {
 
   @Override
   public String toString() {
-    return mJson.toString();
+    return json().toString();
   }
 
   @Override
   public boolean equals(Object o) {
-    return mJson.toString().equals(o.toString());
+    return toString().equals(o.toString());
   }
 
   @Override
   public int hashCode() {
-    return mJson.hashCode();
+    return json().hashCode();
   }
 
   public static class Builder {
@@ -203,7 +223,7 @@ public class SonarObject {
 
     public Builder put(String name, SonarObject o) {
       try {
-        mJson.put(name, o == null ? null : o.mJson);
+        mJson.put(name, o == null ? null : o.json());
       } catch (JSONException e) {
         throw new RuntimeException(e);
       }
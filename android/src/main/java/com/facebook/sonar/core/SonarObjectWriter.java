@@ -0,0 +1,243 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.core;
+
+import java.util.ArrayList;
+import java.util.List;
+import javax.annotation.Nullable;
+import org.json.JSONArray;
+import org.json.JSONException;
+import org.json.JSONObject;
+
+/**
+ * Writes a SonarObject field by field, without building an intermediate object per nested value
+ * the way {@link SonarObject.Builder} does. Objects and arrays are opened with beginObject and
+ * beginArray and closed with end. Within an object values are written with put, within an array
+ * with add.
+ *
+ * <p>Once native Sonar is loaded, writers write straight into the native message, so large results
+ * such as inspector trees never go through org.json. Otherwise, for example in unit tests, they
+ * fall back to org.json.
+ */
+public abstract class SonarObjectWriter {
+
+  public interface Factory {
+    SonarObjectWriter create();
+  }
+
+  /** A value that can write its fields itself, so that writing it doesn't build a SonarObject. */
+  public interface Writable extends SonarValue {
+    /** Writes the value's fields into the object being written. */
+    void writeTo(SonarObjectWriter writer);
+  }
+
+  private static volatile Factory sFactory =
+      new Factory() {
+        @Override
+        public SonarObjectWriter create() {
+          return new JsonWriter();
+        }
+      };
+
+  public static SonarObjectWriter create() {
+    return sFactory.create();
+  }
+
+  public static void setFactory(Factory factory) {
+    sFactory = factory;
+  }
+
+  /**
+   * A null name appends the value to the array being written. Like {@link SonarObject.Builder},
+   * putting a null value leaves the field out.
+   */
+  protected abstract void writeString(@Nullable String name, @Nullable String value);
+
+  protected abstract void writeLong(@Nullable String name, long value);
+
+  protected abstract void writeDouble(@Nullable String name, double value);
+
+  protected abstract void writeBoolean(@Nullable String name, boolean value);
+
+  protected abstract void writeObject(@Nullable String name, @Nullable SonarObject value);
+
+  protected abstract void writeArray(@Nullable String name, @Nullable SonarArray value);
+
+  protected abstract void begin(@Nullable String name, boolean array);
+
+  /** Closes the innermost object or array. */
+  public abstract SonarObjectWriter end();
+
+  /** Returns the written object. All objects and arrays must have been closed. */
+  public abstract SonarObject build();
+
+  public SonarObjectWriter put(String name, @Nullable String value) {
+    writeString(name, value);
+    return this;
+  }
+
+  public SonarObjectWriter put(String name, long value) {
+    writeLong(name, value);
+    return this;
+  }
+
+  public SonarObjectWriter put(String name, double value) {
+    writeDouble(name, value);
+    return this;
+  }
+
+  public SonarObjectWriter put(String name, boolean value) {
+    writeBoolean(name, value);
+    return this;
+  }
+
+  public SonarObjectWriter put(String name, @Nullable SonarObject value) {
+    writeObject(name, value);
+    return this;
+  }
+
+  public SonarObjectWriter put(String name, @Nullable SonarArray value) {
+    writeArray(name, value);
+    return this;
+  }
+
+  public SonarObjectWriter put(String name, @Nullable SonarValue value) {
+    if (value instanceof Writable) {
+      begin(name, false);
+      ((Writable) value).writeTo(this);
+      return end();
+    }
+    writeObject(name, value == null ? null : value.toSonarObject());
+    return this;
+  }
+
+  public SonarObjectWriter beginObject(String name) {
+    begin(name, false);
+    return this;
+  }
+
+  public SonarObjectWriter beginArray(String name) {
+    begin(name, true);
+    return this;
+  }
+
+  public SonarObjectWriter add(@Nullable String value) {
+    writeString(null, value);
+    return this;
+  }
+
+  public SonarObjectWriter add(long value) {
+    writeLong(null, value);
+    return this;
+  }
+
+  public SonarObjectWriter add(double value) {
+    writeDouble(null, value);
+    return this;
+  }
+
+  public SonarObjectWriter add(boolean value) {
+    writeBoolean(null, value);
+    return this;
+  }
+
+  public SonarObjectWriter add(@Nullable SonarObject value) {
+    writeObject(null, value);
+    return this;
+  }
+
+  public SonarObjectWriter add(@Nullable SonarValue value) {
+    if (value instanceof Writable) {
+      begin(null, false);
+      ((Writable) value).writeTo(this);
+      return end();
+    }
+    writeObject(null, value == null ? null : value.toSonarObject());
+    return this;
+  }
+
+  public SonarObjectWriter beginObject() {
+    begin(null, false);
+    return this;
+  }
+
+  public SonarObjectWriter beginArray() {
+    begin(null, true);
+    return this;
+  }
+
+  private static class JsonWriter extends SonarObjectWriter {
+    private final JSONObject mRoot = new JSONObject();
+    private final List<Object> mStack = new ArrayList<>();
+
+    JsonWriter() {
+      mStack.add(mRoot);
+    }
+
+    private void write(@Nullable String name, @Nullable Object value) {
+      final Object top = mStack.get(mStack.size() - 1);
+      try {
+        if (name == null) {
+          ((JSONArray) top).put(value);
+        } else {
+          ((JSONObject) top).put(name, value);
+        }
+      } catch (JSONException e) {
+        throw new RuntimeException(e);
+      }
+    }
+
+    @Override
+    protected void writeString(@Nullable String name, @Nullable String value) {
+      write(name, value);
+    }
+
+    @Override
+    protected void writeLong(@Nullable String name, long value) {
+      write(name, value);
+    }
+
+    @Override
+    protected void writeDouble(@Nullable String name, double value) {
+      write(name, Double.isNaN(value) ? null : value);
+    }
+
+    @Override
+    protected void writeBoolean(@Nullable String name, boolean value) {
+      write(name, value);
+    }
+
+    @Override
+    protected void writeObject(@Nullable String name, @Nullable SonarObject value) {
+      write(name, value == null ? null : value.json());
+    }
+
+    @Override
+    protected void writeArray(@Nullable String name, @Nullable SonarArray value) {
+      write(name, value == null ? null : value.mJson);
+    }
+
+    @Override
+    protected void begin(@Nullable String name, boolean array) {
+      final Object value = array ? new JSONArray() : new JSONObject();
+      write(name, value);
+      mStack.add(value);
+    }
+
+    @Override
+    public SonarObjectWriter end() {
+      mStack.remove(mStack.size() - 1);
+      return this;
+    }
+
+    @Override
+    public SonarObject build() {
+      return new SonarObject(mRoot);
+    }
+  }
+}
@@ -0,0 +1,17 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.core;
+
+/** Creates a plugin on demand, see {@link SonarClient#addPluginFactory}. */
+public interface SonarPluginFactory {
+  /**
+   * Called at most once, on Sonar's callback thread. The plugin's id must be the one the factory
+   * was added with.
+   */
+  SonarPlugin create();
+}
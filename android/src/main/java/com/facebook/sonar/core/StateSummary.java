@@ -1,5 +1,6 @@
 package com.facebook.sonar.core;
 
+import java.nio.charset.Charset;
 import java.util.List;
 import java.util.ArrayList;
 
@@ -12,27 +13,101 @@ public class StateSummary {
   public static class StateElement {
     private final String mName;
     private final State mState;
+    private final long mLastDurationMs;
+    private final long mMaxDurationMs;
+    private final int[] mDurationHistogram;
+
     public StateElement(String name, State state) {
+      this(name, state, 0, 0, new int[0]);
+    }
+
+    public StateElement(
+        String name,
+        State state,
+        long lastDurationMs,
+        long maxDurationMs,
+        int[] durationHistogram) {
       mName = name;
       mState = state;
+      mLastDurationMs = lastDurationMs;
+      mMaxDurationMs = maxDurationMs;
+      mDurationHistogram = durationHistogram;
     }
+
     public String getName() {
       return mName;
     }
+
     public State getState() {
       return mState;
     }
+
+    public long getLastDurationMs() {
+      return mLastDurationMs;
+    }
+
+    public long getMaxDurationMs() {
+      return mMaxDurationMs;
+    }
+
+    /**
+     * Number of runs of this step per duration bucket. The buckets end at 10, 50, 100, 500, 1000,
+     * 5000 and 10000 ms, with a final bucket for slower runs.
+     */
+    public int[] getDurationHistogram() {
+      return mDurationHistogram;
+    }
   }
 
   public final List<StateElement> mList = new ArrayList<>();
 
   public void addEntry(String name, String state) {
+    addEntry(name, state, 0, 0, new int[0]);
+  }
+
+  public void addEntry(
+      String name,
+      String state,
+      long lastDurationMs,
+      long maxDurationMs,
+      int[] durationHistogram) {
     State s;
     try {
       s = State.valueOf(state);
     } catch (RuntimeException e) {
       s = State.UNKNOWN;
     }
-    mList.add(new StateElement(name, s));
+    mList.add(new StateElement(name, s, lastDurationMs, maxDurationMs, durationHistogram));
+  }
+
+  private static final Charset UTF_8 = Charset.forName("UTF-8");
+
+  /**
+   * Adds every entry of a summary in one call, so native code can hand over the whole summary
+   * without crossing into Java per entry. names holds the UTF-8 encoded names back to back. For
+   * each entry, entries holds the name's length in bytes, the ordinal of its State, the number of
+   * histogram buckets and then the buckets, and durations holds its last and max durations. The
+   * arrays are only read, so native code hands the same ones over again while nothing changed.
+   */
+  public void addEntries(byte[] names, int[] entries, long[] durations) {
+    final State[] states = State.values();
+    int nameOffset = 0;
+    int i = 0;
+    int d = 0;
+    while (i < entries.length) {
+      final int nameLength = entries[i++];
+      final int state = entries[i++];
+      final int[] histogram = new int[entries[i++]];
+      System.arraycopy(entries, i, histogram, 0, histogram.length);
+      i += histogram.length;
+      mList.add(
+          new StateElement(
+              new String(names, nameOffset, nameLength, UTF_8),
+              state >= 0 && state < states.length ? states[state] : State.UNKNOWN,
+              durations[d++],
+              durations[d++],
+              histogram));
+      nameOffset += nameLength;
+    }
   }
 }
@@ -7,9 +7,15 @@
  */
 package com.facebook.sonar.plugins.common;
 
+import android.content.Context;
+import android.util.Base64;
+import com.facebook.sonar.BuildConfig;
+import com.facebook.sonar.android.EventRing;
 import com.facebook.sonar.core.SonarConnection;
 import com.facebook.sonar.core.SonarObject;
 import com.facebook.sonar.core.SonarPlugin;
+import java.io.File;
+import java.nio.ByteBuffer;
 import javax.annotation.Nullable;
 
 /**
@@ -21,10 +27,32 @@ import javax.annotation.Nullable;
 public abstract class BufferingSonarPlugin implements SonarPlugin {
 
   private static final int BUFFER_SIZE = 500;
+  private static final int BUFFER_BYTES = 16 * 1024 * 1024;
 
+  private final @Nullable File mPersistentFile;
+  // Events are kept serialized in Sonar's native ring, which is only loaded in internal builds.
+  private @Nullable EventRing mEventRing;
   private @Nullable RingBuffer<CachedSonarEvent> mEventQueue;
   private @Nullable SonarConnection mConnection;
 
+  public BufferingSonarPlugin() {
+    this(null);
+  }
+
+  /**
+   * With a persistentFile, events are buffered in that file, mapped into memory, so that events
+   * sent before the desktop connects, such as the ones from app startup, survive the app being
+   * restarted. Falls back to an in-memory buffer if the file can't be mapped.
+   */
+  public BufferingSonarPlugin(@Nullable File persistentFile) {
+    mPersistentFile = persistentFile;
+  }
+
+  /** Where a plugin's persistent buffer is kept, in Sonar's private directory. */
+  public static File getPersistentFile(Context context, String identifier) {
+    return new File(context.getFilesDir(), "sonar-" + identifier + ".buffer");
+  }
+
   @Override
   public synchronized void onConnect(SonarConnection connection) {
     mConnection = connection;
@@ -46,19 +74,60 @@ public abstract class BufferingSonarPlugin implements SonarPlugin {
   }
 
   public synchronized void send(String method, SonarObject sonarObject) {
-    if (mEventQueue == null) {
-      mEventQueue = new RingBuffer<>(BUFFER_SIZE);
-    }
+    createBuffer();
     if (mConnection != null) {
       mConnection.send(method, sonarObject);
+    } else if (mEventRing != null) {
+      mEventRing.push(method, sonarObject.toJsonString());
     } else {
       mEventQueue.enqueue(new CachedSonarEvent(method, sonarObject));
     }
   }
 
+  /**
+   * Sends data as the message's binary payload when the connection can carry one, which spares
+   * encoding it as base64. The desktop then receives params as the message. Otherwise, and while
+   * buffered, data goes into params under dataKey as a base64 string.
+   */
+  public synchronized void send(
+      String method, SonarObject.Builder params, @Nullable ByteBuffer data, String dataKey) {
+    if (mConnection != null && data != null && mConnection.sendBytes(method, params.build(), data)) {
+      return;
+    }
+    send(method, params.put(dataKey, toBase64(data)).build());
+  }
+
+  private static @Nullable String toBase64(@Nullable ByteBuffer data) {
+    if (data == null) {
+      return null;
+    }
+    final byte[] bytes = new byte[data.remaining()];
+    data.duplicate().get(bytes);
+    return Base64.encodeToString(bytes, Base64.DEFAULT);
+  }
+
+  private void createBuffer() {
+    if (mEventQueue != null || mEventRing != null) {
+      return;
+    }
+    if (BuildConfig.IS_INTERNAL_BUILD) {
+      mEventRing = new EventRing(BUFFER_SIZE, BUFFER_BYTES, mPersistentFile);
+    } else {
+      mEventQueue = new RingBuffer<>(BUFFER_SIZE);
+    }
+  }
+
   private synchronized void sendBufferedEvents() {
-    if (mEventQueue != null && mConnection != null) {
-      for (CachedSonarEvent cachedSonarEvent : mEventQueue.asList()) {
+    if (mConnection == null) {
+      return;
+    }
+    // A persistent buffer may still hold events from a previous run.
+    createBuffer();
+    if (mEventRing != null) {
+      mEventRing.sendTo(mConnection);
+    }
+    if (mEventQueue != null) {
+      for (CachedSonarEvent cachedSonarEvent : mEventQueue.asIterable()) {
         mConnection.send(cachedSonarEvent.method, cachedSonarEvent.sonarObject);
       }
       mEventQueue.clear();
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.plugins.common;
+
+import android.util.Log;
+import android.view.Choreographer;
+import com.facebook.sonar.core.SonarObject;
+import com.facebook.sonar.core.SonarResponder;
+
+/**
+ * Runs long main thread work, such as describing a big view hierarchy, in slices of at most
+ * {@link #SLICE_NANOS} per frame so that the app keeps drawing while it's inspected. The work is
+ * split into steps, which keep whatever state they need to pick up where they left off once a
+ * slice is used up.
+ */
+public final class MainThreadBudget {
+
+  /** Leaves most of a 60fps frame to the app. */
+  public static final long SLICE_NANOS = 4 * 1000 * 1000;
+
+  public interface Task {
+    /** Does the next bit of work. Returns false once there is none left. */
+    boolean step() throws Exception;
+  }
+
+  private MainThreadBudget() {}
+
+  /**
+   * Runs the first slice right away, and the rest at the start of the following frames. A step
+   * that throws ends the task, with the exception reported to responder. Must be called on the
+   * main thread.
+   */
+  public static void run(SonarResponder responder, Task task) {
+    new Slices(responder, task).doFrame(0);
+  }
+
+  private static final class Slices implements Choreographer.FrameCallback {
+    private final SonarResponder mResponder;
+    private final Task mTask;
+
+    Slices(SonarResponder responder, Task task) {
+      mResponder = responder;
+      mTask = task;
+    }
+
+    @Override
+    public void doFrame(long frameTimeNanos) {
+      final long deadline = System.nanoTime() + SLICE_NANOS;
+      try {
+        while (mTask.step()) {
+          if (System.nanoTime() >= deadline) {
+            Choreographer.getInstance().postFrameCallback(this);
+            return;
+          }
+        }
+      } catch (Exception e) {
+        mResponder.error(
+            new SonarObject.Builder()
+                .put("message", String.valueOf(e.getMessage()))
+                .put("stacktrace", Log.getStackTraceString(e))
+                .build());
+      }
+    }
+  }
+}
@@ -7,20 +7,21 @@
  */
 package com.facebook.sonar.plugins.common;
 
-import java.util.LinkedList;
-import java.util.List;
+import java.util.ArrayDeque;
+import java.util.Deque;
 
 final class RingBuffer<T> {
   final int mBufferSize;
-  final List<T> mBuffer = new LinkedList<>();
+  final Deque<T> mBuffer;
 
   RingBuffer(int bufferSize) {
     mBufferSize = bufferSize;
+    mBuffer = new ArrayDeque<>(bufferSize);
   }
 
   void enqueue(T item) {
     if (mBuffer.size() >= mBufferSize) {
-      mBuffer.remove(0);
+      mBuffer.removeFirst();
     }
     mBuffer.add(item);
   }
@@ -29,7 +30,7 @@ final class RingBuffer<T> {
     mBuffer.clear();
   }
 
-  List<T> asList() {
+  Iterable<T> asIterable() {
     return mBuffer;
   }
 }
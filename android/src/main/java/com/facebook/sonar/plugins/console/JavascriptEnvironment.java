@@ -10,14 +10,36 @@ package com.facebook.sonar.plugins.console;
 import com.facebook.sonar.plugins.console.iface.ScriptingEnvironment;
 import java.util.HashMap;
 import java.util.Map;
+import java.util.concurrent.Executor;
+import java.util.concurrent.Executors;
+import java.util.concurrent.ThreadFactory;
+import javax.annotation.Nullable;
 import org.mozilla.javascript.Context;
 import org.mozilla.javascript.ContextFactory;
 
 public class JavascriptEnvironment implements ScriptingEnvironment {
 
+  private static final Executor sWarmUpExecutor =
+      Executors.newSingleThreadExecutor(
+          new ThreadFactory() {
+            @Override
+            public Thread newThread(Runnable runnable) {
+              final Thread thread = new Thread(runnable, "SonarConsoleWarmUp");
+              thread.setDaemon(true);
+              return thread;
+            }
+          });
+
   private final Map<String, Object> mBoundVariables;
   private final ContextFactory mContextFactory;
 
+  // Setting up the standard objects of a session takes long enough to hold up the first command,
+  // so the next session is set up ahead of time on a background thread. Guarded by this.
+  private @Nullable JavascriptSession mWarmSession;
+  private boolean mWarmingUp;
+  // Bumped when a global is registered, which sessions set up before then don't have.
+  private int mGlobalsVersion;
+
   public JavascriptEnvironment() {
     mBoundVariables = new HashMap<>();
     mContextFactory =
@@ -27,11 +49,59 @@ public class JavascriptEnvironment implements ScriptingEnvironment {
             return featureIndex == Context.FEATURE_ENHANCED_JAVA_ACCESS;
           }
         };
+    warmUp();
   }
 
   @Override
   public JavascriptSession startSession() {
-    return new JavascriptSession(mContextFactory, mBoundVariables);
+    JavascriptSession session;
+    final Map<String, Object> globals;
+    synchronized (this) {
+      session = mWarmSession;
+      mWarmSession = null;
+      globals = new HashMap<>(mBoundVariables);
+    }
+    if (session == null) {
+      session = new JavascriptSession(mContextFactory, globals);
+    }
+    warmUp();
+    return session;
+  }
+
+  private void warmUp() {
+    final int globalsVersion;
+    final Map<String, Object> globals;
+    synchronized (this) {
+      if (mWarmSession != null || mWarmingUp) {
+        return;
+      }
+      mWarmingUp = true;
+      globalsVersion = mGlobalsVersion;
+      globals = new HashMap<>(mBoundVariables);
+    }
+
+    sWarmUpExecutor.execute(
+        new Runnable() {
+          @Override
+          public void run() {
+            JavascriptSession session = null;
+            try {
+              session = new JavascriptSession(mContextFactory, globals);
+            } finally {
+              final boolean stale;
+              synchronized (JavascriptEnvironment.this) {
+                mWarmingUp = false;
+                stale = globalsVersion != mGlobalsVersion;
+                if (!stale) {
+                  mWarmSession = session;
+                }
+              }
+              if (stale) {
+                warmUp();
+              }
+            }
+          }
+        });
   }
 
   /**
@@ -42,13 +112,17 @@ public class JavascriptEnvironment implements ScriptingEnvironment {
    * @param object The reference to bind.
    */
   @Override
-  public void registerGlobalObject(String name, Object object) {
+  public synchronized void registerGlobalObject(String name, Object object) {
     if (mBoundVariables.containsKey(name)) {
       throw new IllegalStateException(
           String.format(
               "Variable %s is already reserved for %s", name, mBoundVariables.get(name)));
     }
     mBoundVariables.put(name, object);
+    mGlobalsVersion++;
+    // Set up again with the new global, once whatever is being set up now is done.
+    mWarmSession = null;
+    warmUp();
   }
 
   @Override
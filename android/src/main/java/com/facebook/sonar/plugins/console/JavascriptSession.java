@@ -9,6 +9,7 @@ package com.facebook.sonar.plugins.console;
 
 import com.facebook.sonar.plugins.console.iface.ScriptingSession;
 import java.io.Closeable;
+import java.util.LinkedHashMap;
 import java.util.Map;
 import java.util.concurrent.atomic.AtomicInteger;
 import org.json.JSONException;
@@ -20,6 +21,7 @@ import org.mozilla.javascript.Function;
 import org.mozilla.javascript.NativeJSON;
 import org.mozilla.javascript.NativeJavaMethod;
 import org.mozilla.javascript.NativeJavaObject;
+import org.mozilla.javascript.Script;
 import org.mozilla.javascript.Scriptable;
 import org.mozilla.javascript.ScriptableObject;
 import org.mozilla.javascript.Undefined;
@@ -34,27 +36,43 @@ public class JavascriptSession implements Closeable, ScriptingSession {
   private final Scriptable mScope;
   private final AtomicInteger lineNumber = new AtomicInteger(0);
 
+  private static final int MAX_CACHED_SCRIPTS = 64;
+  // Scripts driving the console tend to send the same commands over and over, so their compiled
+  // form is kept. Scripts don't hold on to a scope, so they can run with any context object.
+  private final Map<String, Script> mScripts =
+      new LinkedHashMap<String, Script>(16, 0.75f, true) {
+        @Override
+        protected boolean removeEldestEntry(Map.Entry<String, Script> eldest) {
+          return size() > MAX_CACHED_SCRIPTS;
+        }
+      };
+
   JavascriptSession(ContextFactory contextFactory, Map<String, Object> globals) {
     mContextFactory = contextFactory;
     mContext = contextFactory.enterContext();
-
-    // Interpreted mode, or it will produce Dalvik incompatible bytecode.
-    mContext.setOptimizationLevel(-1);
-    mScope = mContext.initStandardObjects();
-
-    for (Map.Entry<String, Object> entry : globals.entrySet()) {
-      final Object value = entry.getValue();
-
-      if (value instanceof Number || value instanceof String) {
-        ScriptableObject.putConstProperty(mScope, entry.getKey(), entry.getValue());
-      } else {
-        // Calling java methods in the VM produces objects wrapped in NativeJava*.
-        // So passing in wrapped objects keeps them consistent.
-        ScriptableObject.putConstProperty(
-            mScope,
-            entry.getKey(),
-            new NativeJavaObject(mScope, entry.getValue(), entry.getValue().getClass()));
+    try {
+      // Interpreted mode, or it will produce Dalvik incompatible bytecode.
+      mContext.setOptimizationLevel(-1);
+      mScope = mContext.initStandardObjects();
+
+      for (Map.Entry<String, Object> entry : globals.entrySet()) {
+        final Object value = entry.getValue();
+
+        if (value instanceof Number || value instanceof String) {
+          ScriptableObject.putConstProperty(mScope, entry.getKey(), entry.getValue());
+        } else {
+          // Calling java methods in the VM produces objects wrapped in NativeJava*.
+          // So passing in wrapped objects keeps them consistent.
+          ScriptableObject.putConstProperty(
+              mScope,
+              entry.getKey(),
+              new NativeJavaObject(mScope, entry.getValue(), entry.getValue().getClass()));
+        }
       }
+    } finally {
+      // Leave the context so that it can be entered on whichever thread evaluates commands, which
+      // lets sessions be set up ahead of time on another thread.
+      Context.exit();
     }
   }
 
@@ -69,19 +87,28 @@ public class JavascriptSession implements Closeable, ScriptingSession {
     return evaluateCommand(userScript, scope);
   }
 
-  private JSONObject evaluateCommand(String command, Scriptable scope) throws JSONException {
+  // A context can only be entered on one thread at a time.
+  private synchronized JSONObject evaluateCommand(String command, Scriptable scope)
+      throws JSONException {
     try {
       // This may be called by any thread, and contexts have to be entered in the current thread
       // before being used, so enter/exit every time.
-      mContextFactory.enterContext();
-      return toJson(
-          mContext.evaluateString(
-              scope, command, "sonar-console", lineNumber.incrementAndGet(), null));
+      mContextFactory.enterContext(mContext);
+      return toJson(compile(command).exec(mContext, scope));
     } finally {
       Context.exit();
     }
   }
 
+  private Script compile(String command) {
+    Script script = mScripts.get(command);
+    if (script == null) {
+      script = mContext.compileString(command, "sonar-console", lineNumber.incrementAndGet(), null);
+      mScripts.put(command, script);
+    }
+    return script;
+  }
+
   private JSONObject toJson(Object result) throws JSONException {
 
     if (result instanceof String) {
@@ -157,7 +184,7 @@ public class JavascriptSession implements Closeable, ScriptingSession {
 
   @Override
   public void close() {
-    Context.exit();
+    mScripts.clear();
   }
 
   private static Object safeUnwrap(Object o) {
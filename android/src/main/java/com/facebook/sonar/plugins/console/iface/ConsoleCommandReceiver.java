@@ -8,6 +8,7 @@
 package com.facebook.sonar.plugins.console.iface;
 
 import android.support.annotation.Nullable;
+import com.facebook.sonar.core.SonarArray;
 import com.facebook.sonar.core.SonarConnection;
 import com.facebook.sonar.core.SonarObject;
 import com.facebook.sonar.core.SonarReceiver;
@@ -57,6 +58,34 @@ public class ConsoleCommandReceiver {
             }
           }
         };
+    // Runs a list of commands in one go and responds with all of their results, so that scripts
+    // driving the console don't wait for a round trip and a main thread hop per command.
+    final SonarReceiver executeCommandsReceiver =
+        new MainThreadSonarReceiver(connection) {
+          @Override
+          public void onReceiveOnMainThread(SonarObject params, SonarResponder responder)
+              throws Exception {
+            final SonarArray commands = params.getArray("commands");
+            final SonarArray.Builder results = new SonarArray.Builder();
+            for (int i = 0; i < commands.length(); i++) {
+              final SonarObject command = commands.getObject(i);
+              final Object contextObject =
+                  contextProvider.getObjectForId(command.getString("context"));
+              try {
+                JSONObject o =
+                    contextObject == null
+                        ? session.evaluateCommand(command.getString("command"))
+                        : session.evaluateCommand(command.getString("command"), contextObject);
+                results.put(new SonarObject.Builder().put("success", new SonarObject(o)));
+              } catch (Exception e) {
+                results.put(
+                    new SonarObject.Builder()
+                        .put("error", new SonarObject.Builder().put("message", e.getMessage())));
+              }
+            }
+            responder.success(new SonarObject.Builder().put("results", results).build());
+          }
+        };
     final SonarReceiver isEnabledReceiver =
         new SonarReceiver() {
           @Override
@@ -69,6 +98,7 @@ public class ConsoleCommandReceiver {
         };
 
     connection.receive("executeCommand", executeCommandReceiver);
+    connection.receive("executeCommands", executeCommandsReceiver);
     connection.receive("isConsoleEnabled", isEnabledReceiver);
   }
 
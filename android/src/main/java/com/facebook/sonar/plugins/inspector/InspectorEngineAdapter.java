@@ -0,0 +1,225 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.plugins.inspector;
+
+import android.util.SparseArray;
+import android.util.SparseIntArray;
+import com.facebook.sonar.android.InspectorEngine;
+import com.facebook.sonar.core.ErrorReportingRunnable;
+import com.facebook.sonar.core.SonarConnection;
+import com.facebook.sonar.core.SonarObject;
+import java.lang.ref.WeakReference;
+import java.util.ArrayList;
+import java.util.List;
+import javax.annotation.Nullable;
+
+/**
+ * Lets the native engine reach the nodes through their descriptors. Nodes are handed out as
+ * handles, a new one each time, which only keep their node alive until the engine call returns
+ * and {@link #sweep()} runs. After that the engine's retained handles refer to their nodes weakly,
+ * like {@link ObjectTracker}, and one whose node has been collected reads as an empty node.
+ *
+ * <p>Ids go through the plugin's tracking, so the receivers still served from Java find the nodes
+ * the engine described.
+ */
+final class InspectorEngineAdapter implements InspectorEngine.Adapter {
+  private static final String[] NONE = new String[0];
+
+  private final InspectorSonarPlugin mPlugin;
+  private final Object mRoot;
+  private final ObjectTracker mObjectTracker;
+  private final SonarConnection mConnection;
+  private final SparseArray<WeakReference<Object>> mNodes = new SparseArray<>();
+  private final SparseIntArray mRetains = new SparseIntArray();
+  // Handed out during the current engine call, and kept alive until it returns.
+  private final List<Object> mFreshNodes = new ArrayList<>();
+  private final List<Integer> mFreshHandles = new ArrayList<>();
+  private int mLastHandle;
+
+  InspectorEngineAdapter(
+      InspectorSonarPlugin plugin,
+      Object root,
+      ObjectTracker objectTracker,
+      SonarConnection connection) {
+    mPlugin = plugin;
+    mRoot = root;
+    mObjectTracker = objectTracker;
+    mConnection = connection;
+  }
+
+  /** Drops the handles handed out during the engine call that just returned, unless retained. */
+  void sweep() {
+    for (int handle : mFreshHandles) {
+      if (mRetains.get(handle) == 0) {
+        mNodes.remove(handle);
+      }
+    }
+    mFreshHandles.clear();
+    mFreshNodes.clear();
+  }
+
+  @Override
+  public int root() {
+    return handle(mRoot);
+  }
+
+  @Override
+  public String identifier(int node) {
+    final Object obj = get(node);
+    if (obj == null) {
+      return "";
+    }
+    try {
+      return mPlugin.trackObject(obj);
+    } catch (Exception e) {
+      mConnection.reportError(e);
+      return "";
+    }
+  }
+
+  @Override
+  public String name(int node) {
+    final Object obj = get(node);
+    if (obj == null) {
+      return "";
+    }
+    try {
+      return mPlugin.descriptorForObject(obj).getName(obj);
+    } catch (Exception e) {
+      mConnection.reportError(e);
+      return "";
+    }
+  }
+
+  @Override
+  public @Nullable String decoration(int node) {
+    final Object obj = get(node);
+    if (obj == null) {
+      return null;
+    }
+    try {
+      return mPlugin.descriptorForObject(obj).getDecoration(obj);
+    } catch (Exception e) {
+      mConnection.reportError(e);
+      return null;
+    }
+  }
+
+  @Override
+  public int[] children(int node) {
+    final Object obj = get(node);
+    if (obj == null) {
+      return new int[0];
+    }
+    final List<Object> children = new ArrayList<>();
+    new ErrorReportingRunnable(mConnection) {
+      @Override
+      protected void runOrThrow() throws Exception {
+        final NodeDescriptor<Object> descriptor = mPlugin.descriptorForObject(obj);
+        for (int i = 0, count = descriptor.getChildCount(obj); i < count; i++) {
+          final Object child = descriptor.getChildAt(obj, i);
+          if (child == null) {
+            throw new AssertionError("Unexpected null value");
+          }
+          children.add(child);
+        }
+      }
+    }.run();
+    final int[] handles = new int[children.size()];
+    for (int i = 0; i < handles.length; i++) {
+      handles[i] = handle(children.get(i));
+    }
+    return handles;
+  }
+
+  @Override
+  public String[] attributes(int node) {
+    final Object obj = get(node);
+    if (obj == null) {
+      return NONE;
+    }
+    final List<String> pairs = new ArrayList<>();
+    new ErrorReportingRunnable(mConnection) {
+      @Override
+      protected void runOrThrow() throws Exception {
+        for (Named<String> attribute : mPlugin.descriptorForObject(obj).getAttributes(obj)) {
+          pairs.add(attribute.getName());
+          pairs.add(attribute.getValue());
+        }
+      }
+    }.run();
+    return pairs.toArray(NONE);
+  }
+
+  @Override
+  public String[] data(int node) {
+    final Object obj = get(node);
+    if (obj == null) {
+      return NONE;
+    }
+    final List<String> pairs = new ArrayList<>();
+    new ErrorReportingRunnable(mConnection) {
+      @Override
+      protected void runOrThrow() throws Exception {
+        for (Named<SonarObject> section : mPlugin.descriptorForObject(obj).getData(obj)) {
+          pairs.add(section.getName());
+          pairs.add(section.getValue().toJsonString());
+        }
+      }
+    }.run();
+    return pairs.toArray(NONE);
+  }
+
+  @Override
+  public String[] extra(int node) {
+    final Object obj = get(node);
+    if (obj == null) {
+      return NONE;
+    }
+    return new String[] {
+      "extraInfo", mPlugin.descriptorForObject(obj).getExtraInfo(obj).toJsonString()
+    };
+  }
+
+  @Override
+  public int find(String id) {
+    final Object obj = mObjectTracker.get(id);
+    return obj != null && mPlugin.descriptorForObject(obj) != null ? handle(obj) : 0;
+  }
+
+  @Override
+  public void retain(int node) {
+    mRetains.put(node, mRetains.get(node) + 1);
+  }
+
+  @Override
+  public void release(int node) {
+    final int retains = mRetains.get(node) - 1;
+    if (retains > 0) {
+      mRetains.put(node, retains);
+    } else {
+      mRetains.delete(node);
+      mNodes.remove(node);
+    }
+  }
+
+  private int handle(Object obj) {
+    if (++mLastHandle == 0) {
+      mLastHandle++;
+    }
+    mNodes.put(mLastHandle, new WeakReference<>(obj));
+    mFreshNodes.add(obj);
+    mFreshHandles.add(mLastHandle);
+    return mLastHandle;
+  }
+
+  private @Nullable Object get(int node) {
+    final WeakReference<Object> ref = mNodes.get(node);
+    return ref != null ? ref.get() : null;
+  }
+}
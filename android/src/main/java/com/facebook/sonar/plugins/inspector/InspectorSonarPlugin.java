@@ -10,32 +10,51 @@ package com.facebook.sonar.plugins.inspector;
 
 import android.app.Application;
 import android.content.Context;
+import android.graphics.Bitmap;
+import android.os.Handler;
+import android.os.Looper;
 import android.support.v4.view.ViewCompat;
+import android.util.Base64;
+import android.view.Choreographer;
 import android.view.accessibility.AccessibilityEvent;
 import android.view.MotionEvent;
 import android.view.View;
 import android.view.ViewGroup;
+import com.facebook.sonar.android.InspectorEngine;
 import com.facebook.sonar.core.ErrorReportingRunnable;
 import com.facebook.sonar.core.SonarArray;
 import com.facebook.sonar.core.SonarConnection;
 import com.facebook.sonar.core.SonarDynamic;
 import com.facebook.sonar.core.SonarObject;
+import com.facebook.sonar.core.SonarObjectWriter;
 import com.facebook.sonar.core.SonarPlugin;
 import com.facebook.sonar.core.SonarReceiver;
 import com.facebook.sonar.core.SonarResponder;
+import com.facebook.sonar.plugins.common.MainThreadBudget;
 import com.facebook.sonar.plugins.common.MainThreadSonarReceiver;
 import com.facebook.sonar.plugins.console.iface.ConsoleCommandReceiver;
 import com.facebook.sonar.plugins.console.iface.NullScriptingEnvironment;
 import com.facebook.sonar.plugins.console.iface.ScriptingEnvironment;
 import com.facebook.sonar.plugins.inspector.descriptors.ApplicationDescriptor;
+import com.facebook.sonar.plugins.inspector.descriptors.utils.AccessibilityEvaluationCache;
 import com.facebook.sonar.plugins.inspector.descriptors.utils.AccessibilityUtil;
 
+import java.nio.ByteBuffer;
 import java.util.ArrayList;
+import java.util.HashSet;
+import java.util.LinkedHashSet;
 import java.util.List;
+import java.util.Set;
 import javax.annotation.Nullable;
 
 public class InspectorSonarPlugin implements SonarPlugin {
 
+  /** Main thread time a getNodes call may spend prefetching, in total. */
+  private static final long PREFETCH_NANOS = 2 * MainThreadBudget.SLICE_NANOS;
+
+  /** The longest side of a node image, unless getSnapshots asks for another. */
+  private static final int DEFAULT_SNAPSHOT_SIZE = 256;
+
   private ApplicationWrapper mApplication;
   private DescriptorMapping mDescriptorMapping;
   private ObjectTracker mObjectTracker;
@@ -44,6 +63,12 @@ public class InspectorSonarPlugin implements SonarPlugin {
   private TouchOverlayView mTouchOverlay;
   private SonarConnection mConnection;
   private @Nullable List<ExtensionCommand> mExtensionCommands;
+  private int mPrefetchLevels = 0;
+  private int mPrefetchMaxNodes = 500;
+  private final NodeSnapshots mSnapshots;
+  // Serves getRoot and getNodes for native connections, unless prefetching.
+  private @Nullable InspectorEngine mEngine;
+  private @Nullable InspectorEngineAdapter mEngineAdapter;
 
   /** An interface for extensions to the Inspector Sonar plugin */
   public interface ExtensionCommand {
@@ -110,6 +135,17 @@ public class InspectorSonarPlugin implements SonarPlugin {
     mApplication = wrapper;
     mScriptingEnvironment = scriptingEnvironment;
     mExtensionCommands = extensions;
+    mSnapshots = new NodeSnapshots(wrapper, descriptorMapping);
+  }
+
+  /**
+   * Has getNodes also describe the next levels below the nodes it was asked for, at most maxNodes
+   * of them, and send them in a prefetchedNodes message after the reply, so that expanding them
+   * on the desktop doesn't take another round trip. 0 levels, the default, prefetches nothing.
+   */
+  public void setPrefetchPolicy(int levels, int maxNodes) {
+    mPrefetchLevels = levels;
+    mPrefetchMaxNodes = maxNodes;
   }
 
   @Override
@@ -121,6 +157,11 @@ public class InspectorSonarPlugin implements SonarPlugin {
   public void onConnect(SonarConnection connection) throws Exception {
     mConnection = connection;
     mDescriptorMapping.onConnect(connection);
+    NodeDescriptor.sSnapshots = mSnapshots;
+    if (InspectorEngine.Connections.canServe(connection)) {
+      mEngine = new InspectorEngine();
+      mEngineAdapter = new InspectorEngineAdapter(this, mApplication, mObjectTracker, connection);
+    }
 
     ConsoleCommandReceiver.listenForCommands(
         connection,
@@ -134,7 +175,9 @@ public class InspectorSonarPlugin implements SonarPlugin {
         });
     connection.receive("getRoot", mGetRoot);
     connection.receive("getNodes", mGetNodes);
+    connection.receive("getSnapshots", mGetSnapshots);
     connection.receive("setData", mSetData);
+    connection.receive("setDataMany", mSetDataMany);
     connection.receive("setHighlighted", mSetHighlighted);
     connection.receive("setSearchActive", mSetSearchActive);
     connection.receive("isSearchActive", mIsSearchActive);
@@ -153,6 +196,9 @@ public class InspectorSonarPlugin implements SonarPlugin {
 
   @Override
   public void onDisconnect() throws Exception {
+    synchronized (mPendingHighlightLock) {
+      mPendingHighlightId = null;
+    }
     if (mHighlightedId != null) {
       setHighlighted(mHighlightedId, false, false);
       mHighlightedId = null;
@@ -161,7 +207,25 @@ public class InspectorSonarPlugin implements SonarPlugin {
     // remove any added accessibility delegates, leave isSearchActive untouched
     ApplicationDescriptor.clearEditedDelegates();
 
+    if (mEngine != null) {
+      // The engine is only used from the main thread, where calls to it may still be running.
+      final InspectorEngine engine = mEngine;
+      final InspectorEngineAdapter adapter = mEngineAdapter;
+      mMainHandler.post(
+          new Runnable() {
+            @Override
+            public void run() {
+              engine.reset(adapter);
+              adapter.sweep();
+            }
+          });
+      mEngine = null;
+      mEngineAdapter = null;
+    }
+
     mObjectTracker.clear();
+    NodeDescriptor.sSnapshots = null;
+    mSnapshots.clear();
     mDescriptorMapping.onDisconnect();
     mConnection = null;
   }
@@ -171,6 +235,14 @@ public class InspectorSonarPlugin implements SonarPlugin {
         @Override
         public void onReceiveOnMainThread(SonarObject params, SonarResponder responder)
             throws Exception {
+          if (mEngine != null) {
+            try {
+              responder.success(mEngine.getRoot(mEngineAdapter));
+            } finally {
+              mEngineAdapter.sweep();
+            }
+            return;
+          }
           responder.success(getNode(trackObject(mApplication)));
         }
       };
@@ -181,7 +253,12 @@ public class InspectorSonarPlugin implements SonarPlugin {
         public void onReceiveOnMainThread(SonarObject params, SonarResponder responder)
             throws Exception {
           // applicationWrapper is not used by accessibility, but is a common ancestor for multiple view roots
-          responder.success(getAXNode(trackObject(mApplication)));
+          AccessibilityEvaluationCache.begin();
+          try {
+            responder.success(getAXNode(trackObject(mApplication)));
+          } finally {
+            AccessibilityEvaluationCache.end();
+          }
         }
       };
 
@@ -190,28 +267,216 @@ public class InspectorSonarPlugin implements SonarPlugin {
         @Override
         public void onReceiveOnMainThread(final SonarObject params, final SonarResponder responder)
             throws Exception {
+          if (mEngine != null && mPrefetchLevels == 0) {
+            getNodesFromEngine(params, responder);
+            return;
+          }
           final SonarArray ids = params.getArray("ids");
-          final SonarArray.Builder result = new SonarArray.Builder();
+          final SonarObjectWriter result = SonarObjectWriter.create().beginArray("elements");
+
+          // Only this window of each node's children is tracked and sent, so that lists with
+          // thousands of items can be paged through.
+          int offset = 0;
+          int limit = Integer.MAX_VALUE;
+          if (params.contains("childrenRange")) {
+            final SonarObject range = params.getObject("childrenRange");
+            offset = Math.max(0, range.getInt("offset"));
+            if (range.contains("limit")) {
+              limit = Math.max(0, range.getInt("limit"));
+            }
+          }
+          final int childrenOffset = offset;
+          final int childrenLimit = limit;
+          final List<String> childIds = mPrefetchLevels > 0 ? new ArrayList<String>() : null;
+
+          // A node per step, so that big batches are spread over several frames.
+          MainThreadBudget.run(
+              responder,
+              new MainThreadBudget.Task() {
+                int mIndex = 0;
+                @Nullable Prefetch mPrefetch;
+
+                @Override
+                public boolean step() throws Exception {
+                  if (mPrefetch != null) {
+                    return mPrefetch.step();
+                  }
+                  if (mIndex == ids.length()) {
+                    responder.success(result.end().build());
+                    if (childIds == null || childIds.isEmpty()) {
+                      return false;
+                    }
+                    mPrefetch = new Prefetch(ids, childIds, childrenOffset, childrenLimit);
+                    return true;
+                  }
+                  final String id = ids.getString(mIndex++);
+                  result.beginObject();
+                  if (!writeNode(result, id, childrenOffset, childrenLimit, childIds)) {
+                    responder.error(
+                        new SonarObject.Builder()
+                            .put("message", "No node with given id")
+                            .put("id", id)
+                            .build());
+                    return false;
+                  }
+                  result.end();
+                  return true;
+                }
+              });
+        }
+      };
 
-          for (int i = 0, count = ids.length(); i < count; i++) {
-            final String id = ids.getString(i);
-            final SonarObject node = getNode(id);
-            if (node != null) {
-              result.put(node);
-            } else {
-              responder.error(
-                  new SonarObject.Builder()
-                      .put("message", "No node with given id")
-                      .put("id", id)
-                      .build());
-              return;
+  /**
+   * Has the engine capture the nodes a slice at a time, and send them without the response going
+   * through Java. Unlike the Java path, it leaves out the sections the desktop already has, and
+   * ids of nodes that are gone rather than failing the call.
+   */
+  private void getNodesFromEngine(SonarObject params, final SonarResponder responder) {
+    final InspectorEngineAdapter adapter = mEngineAdapter;
+    final InspectorEngine.GetNodes getNodes = mEngine.getNodes(params);
+    MainThreadBudget.run(
+        responder,
+        new MainThreadBudget.Task() {
+          @Override
+          public boolean step() {
+            final boolean done;
+            try {
+              // The engine keeps to the slice itself, and runs once per frame.
+              done = getNodes.run(adapter, MainThreadBudget.SLICE_NANOS);
+            } finally {
+              adapter.sweep();
+            }
+            if (done) {
+              getNodes.respond(responder);
             }
+            return !done;
           }
+        });
+  }
 
-          responder.success(new SonarObject.Builder().put("elements", result).build());
+  /**
+   * Sends an image of each of the nodes in ids that is a view, no larger than maxSize on either
+   * side, as a snapshot message with the image as its binary payload. Nodes whose hash in hashes
+   * is still current only get listed as unchanged in the reply, which comes once every image has
+   * been sent. Each main thread slice starts as many captures as fit in it.
+   */
+  final SonarReceiver mGetSnapshots =
+      new MainThreadSonarReceiver(mConnection) {
+        @Override
+        public void onReceiveOnMainThread(final SonarObject params, final SonarResponder responder)
+            throws Exception {
+          final SonarArray ids = params.getArray("ids");
+          final int maxSize =
+              params.contains("maxSize") ? params.getInt("maxSize") : DEFAULT_SNAPSHOT_SIZE;
+          final Bitmap.CompressFormat format =
+              "webp".equals(params.getString("format"))
+                  ? Bitmap.CompressFormat.WEBP
+                  : Bitmap.CompressFormat.JPEG;
+          final SnapshotReply reply =
+              new SnapshotReply(
+                  mConnection,
+                  ids.length(),
+                  params.contains("hashes") ? params.getObject("hashes") : null,
+                  format,
+                  responder);
+
+          MainThreadBudget.run(
+              responder,
+              new MainThreadBudget.Task() {
+                int mIndex = 0;
+
+                @Override
+                public boolean step() throws Exception {
+                  if (mIndex == ids.length()) {
+                    return false;
+                  }
+                  final String id = ids.getString(mIndex++);
+                  final Object obj = mObjectTracker.get(id);
+                  if (obj instanceof View) {
+                    mSnapshots.capture(id, (View) obj, Math.max(1, maxSize), format, reply);
+                  } else {
+                    reply.onSnapshot(id, null);
+                  }
+                  return true;
+                }
+              });
         }
       };
 
+  /** Sends the images of a getSnapshots call as they're encoded, then replies. */
+  private static final class SnapshotReply implements NodeSnapshots.Callback {
+    private final SonarConnection mConnection;
+    private final @Nullable SonarObject mKnownHashes;
+    private final String mFormat;
+    private final SonarResponder mResponder;
+    private final SonarArray.Builder mSnapshots = new SonarArray.Builder();
+    private final SonarArray.Builder mMissing = new SonarArray.Builder();
+    private int mRemaining;
+
+    SnapshotReply(
+        SonarConnection connection,
+        int count,
+        @Nullable SonarObject knownHashes,
+        Bitmap.CompressFormat format,
+        SonarResponder responder) {
+      mConnection = connection;
+      mRemaining = count;
+      mKnownHashes = knownHashes;
+      mFormat = format == Bitmap.CompressFormat.WEBP ? "webp" : "jpeg";
+      mResponder = responder;
+      if (count == 0) {
+        finish();
+      }
+    }
+
+    // Called on the main thread for nodes that aren't views, and on the snapshot thread otherwise.
+    @Override
+    public synchronized void onSnapshot(String id, @Nullable NodeSnapshots.Snapshot snapshot) {
+      if (snapshot == null) {
+        mMissing.put(id);
+      } else {
+        final boolean unchanged =
+            mKnownHashes != null && snapshot.hash.equals(mKnownHashes.getString(id));
+        mSnapshots.put(
+            new SonarObject.Builder()
+                .put("id", id)
+                .put("hash", snapshot.hash)
+                .put("unchanged", unchanged)
+                .build());
+        if (!unchanged) {
+          send(id, snapshot);
+        }
+      }
+      if (--mRemaining == 0) {
+        finish();
+      }
+    }
+
+    private void send(String id, NodeSnapshots.Snapshot snapshot) {
+      final SonarObject.Builder metadata =
+          new SonarObject.Builder()
+              .put("id", id)
+              .put("hash", snapshot.hash)
+              .put("width", snapshot.width)
+              .put("height", snapshot.height)
+              .put("format", mFormat);
+      if (mConnection.sendBytes("snapshot", metadata.build(), ByteBuffer.wrap(snapshot.data))) {
+        return;
+      }
+      mConnection.send(
+          "snapshot",
+          metadata.put("data", Base64.encodeToString(snapshot.data, Base64.NO_WRAP)).build());
+    }
+
+    private void finish() {
+      mResponder.success(
+          new SonarObject.Builder()
+              .put("snapshots", mSnapshots.build())
+              .put("missing", mMissing.build())
+              .build());
+    }
+  }
+
   final SonarReceiver mGetAXNodes =
       new MainThreadSonarReceiver(mConnection) {
         @Override
@@ -224,40 +489,66 @@ public class InspectorSonarPlugin implements SonarPlugin {
           final boolean forAccessibilityEvent = params.getBoolean("forAccessibilityEvent");
           final String selected = params.getString("selected");
 
-          for (int i = 0, count = ids.length(); i < count; i++) {
-            final String id = ids.getString(i);
-            final SonarObject node = getAXNode(id);
-
-            // sent request for non-existent node, potentially in error
-            if (node == null) {
-
-              // some nodes may be null since we are searching through all current and previous known nodes
-              if (forAccessibilityEvent) {
-                continue;
-              }
-
-              responder.error(
-                      new SonarObject.Builder()
-                              .put("message", "No accessibility node with given id")
-                              .put("id", id)
-                              .build());
-              return;
-            } else {
-
-              // always add currently selected node for live updates to the sidebar
-              // also add focused node for updates
-              if (forAccessibilityEvent) {
-                if (id.equals(selected) || node.getObject("extraInfo").getBoolean("focused")) {
-                  result.put(node);
+          // What is worked out about each view's accessibility is kept until the last node is
+          // described, and invalidations meanwhile drop the parts of the tree they touch.
+          AccessibilityEvaluationCache.begin();
+          MainThreadBudget.run(
+              responder,
+              new MainThreadBudget.Task() {
+                int mIndex = 0;
+
+                @Override
+                public boolean step() throws Exception {
+                  try {
+                    if (describeNext()) {
+                      return true;
+                    }
+                  } catch (Exception e) {
+                    AccessibilityEvaluationCache.end();
+                    throw e;
+                  }
+                  AccessibilityEvaluationCache.end();
+                  return false;
                 }
 
-              // normal getNodes call, put any nodes in result
-              } else {
-                result.put(node);
-              }
-            }
-          }
-          responder.success(new SonarObject.Builder().put("elements", result).build());
+                private boolean describeNext() throws Exception {
+                  if (mIndex == ids.length()) {
+                    responder.success(new SonarObject.Builder().put("elements", result).build());
+                    return false;
+                  }
+                  final String id = ids.getString(mIndex++);
+                  final SonarObject node = getAXNode(id);
+
+                  // sent request for non-existent node, potentially in error
+                  if (node == null) {
+
+                    // some nodes may be null since we are searching through all current and previous known nodes
+                    if (forAccessibilityEvent) {
+                      return true;
+                    }
+
+                    responder.error(
+                            new SonarObject.Builder()
+                                    .put("message", "No accessibility node with given id")
+                                    .put("id", id)
+                                    .build());
+                    return false;
+                  }
+
+                  // always add currently selected node for live updates to the sidebar
+                  // also add focused node for updates
+                  if (forAccessibilityEvent) {
+                    if (id.equals(selected) || node.getObject("extraInfo").getBoolean("focused")) {
+                      result.put(node);
+                    }
+
+                  // normal getNodes call, put any nodes in result
+                  } else {
+                    result.put(node);
+                  }
+                  return true;
+                }
+              });
         }
       };
 
@@ -308,22 +599,122 @@ public class InspectorSonarPlugin implements SonarPlugin {
         }
       };
 
-  final SonarReceiver mSetHighlighted =
+  // Applies the edits in order, in one pass on the main thread, and responds with the nodes they
+  // changed, including the ones descriptors invalidate meanwhile, rather than having the desktop
+  // fetch them again after an invalidate per edit. Used while a value is dragged in the sidebar.
+  final SonarReceiver mSetDataMany =
       new MainThreadSonarReceiver(mConnection) {
         @Override
         public void onReceiveOnMainThread(final SonarObject params, SonarResponder responder)
             throws Exception {
-          final String nodeId = params.getString("id");
-          final boolean isAlignmentMode = params.getBoolean("isAlignmentMode");
+          final boolean ax = params.getBoolean("ax");
+          final SonarArray edits = params.getArray("edits");
+          final Set<String> changed = new LinkedHashSet<>();
+
+          NodeDescriptor.sBatchedInvalidations = changed;
+          NodeDescriptor.sBatchingAX = ax;
+          try {
+            for (int i = 0, count = edits.length(); i < count; i++) {
+              final SonarObject edit = edits.getObject(i);
+              final String nodeId = edit.getString("id");
+              final Object obj = mObjectTracker.get(nodeId);
+              if (obj == null) {
+                continue;
+              }
+              final NodeDescriptor<Object> descriptor = descriptorForObject(obj);
+              if (descriptor == null) {
+                continue;
+              }
 
-          if (mHighlightedId != null) {
-            setHighlighted(mHighlightedId, false, isAlignmentMode);
+              final SonarArray keyPath = edit.getArray("path");
+              final String[] path = new String[keyPath.length()];
+              for (int j = 0; j < path.length; j++) {
+                path[j] = keyPath.getString(j);
+              }
+              descriptor.setValue(obj, path, edit.getDynamic("value"));
+              changed.add(nodeId);
+            }
+          } finally {
+            NodeDescriptor.sBatchedInvalidations = null;
           }
 
-          if (nodeId != null) {
-            setHighlighted(nodeId, true, isAlignmentMode);
+          final SonarArray.Builder elements = new SonarArray.Builder();
+          for (String id : changed) {
+            final SonarObject node = ax ? getAXNode(id) : getNode(id);
+            if (node != null) {
+              elements.put(node);
+            }
           }
-          mHighlightedId = nodeId;
+          responder.success(new SonarObject.Builder().put("elements", elements).build());
+        }
+      };
+
+  // The desktop calls setHighlighted for every node the mouse moves over, so calls only record the
+  // latest node, and it is highlighted at the next frame. Guarded by mPendingHighlightLock.
+  private final Object mPendingHighlightLock = new Object();
+  private @Nullable String mPendingHighlightId;
+  private boolean mPendingAlignmentMode;
+  private boolean mHighlightPosted;
+  // Only touched on the main thread.
+  private boolean mHighlightedAlignmentMode;
+  private final Handler mMainHandler = new Handler(Looper.getMainLooper());
+
+  final SonarReceiver mSetHighlighted =
+      new SonarReceiver() {
+        @Override
+        public void onReceive(final SonarObject params, SonarResponder responder) {
+          synchronized (mPendingHighlightLock) {
+            mPendingHighlightId = params.getString("id");
+            mPendingAlignmentMode = params.getBoolean("isAlignmentMode");
+            if (mHighlightPosted) {
+              return;
+            }
+            mHighlightPosted = true;
+          }
+          mMainHandler.post(mPostHighlight);
+        }
+      };
+
+  // Choreographer has to be used from the main thread.
+  private final Runnable mPostHighlight =
+      new Runnable() {
+        @Override
+        public void run() {
+          Choreographer.getInstance().postFrameCallback(mApplyHighlight);
+        }
+      };
+
+  private final Choreographer.FrameCallback mApplyHighlight =
+      new Choreographer.FrameCallback() {
+        @Override
+        public void doFrame(long frameTimeNanos) {
+          final String nodeId;
+          final boolean isAlignmentMode;
+          synchronized (mPendingHighlightLock) {
+            nodeId = mPendingHighlightId;
+            isAlignmentMode = mPendingAlignmentMode;
+            mHighlightPosted = false;
+          }
+
+          if (isAlignmentMode == mHighlightedAlignmentMode
+              && (nodeId == null ? mHighlightedId == null : nodeId.equals(mHighlightedId))) {
+            return;
+          }
+
+          new ErrorReportingRunnable(mConnection) {
+            @Override
+            protected void runOrThrow() throws Exception {
+              if (mHighlightedId != null) {
+                setHighlighted(mHighlightedId, false, isAlignmentMode);
+              }
+
+              if (nodeId != null) {
+                setHighlighted(nodeId, true, isAlignmentMode);
+              }
+              mHighlightedId = nodeId;
+              mHighlightedAlignmentMode = isAlignmentMode;
+            }
+          }.run();
         }
       };
 
@@ -442,7 +833,12 @@ public class InspectorSonarPlugin implements SonarPlugin {
       int x = touchX;
       int y = touchY;
       Object node = mApplication;
-
+      NodeDescriptor<Object> descriptor = descriptorForObject(mApplication);
+      // Descriptors continue into a child from within hitTest, which would recurse once per level.
+      // Instead that call only moves the touch to the child, and the outermost one hit tests each
+      // node in turn.
+      boolean descending;
+      boolean hasNextNode;
 
       @Override
       public void finish() {
@@ -461,18 +857,31 @@ public class InspectorSonarPlugin implements SonarPlugin {
             y -= offsetY;
 
             if (ax) {
-              node = assertNotNull(descriptorForObject(node).getAXChildAt(node, childIndex));
+              node = assertNotNull(descriptor.getAXChildAt(node, childIndex));
             } else {
-              node = assertNotNull(descriptorForObject(node).getChildAt(node, childIndex));
+              node = assertNotNull(descriptor.getChildAt(node, childIndex));
             }
 
             path.put(trackObject(node));
-            final NodeDescriptor<Object> descriptor = descriptorForObject(node);
+            descriptor = descriptorForObject(node);
 
-            if (ax) {
-              descriptor.axHitTest(node, touch);
-            } else {
-              descriptor.hitTest(node, touch);
+            if (descending) {
+              hasNextNode = true;
+              return;
+            }
+
+            descending = true;
+            try {
+              do {
+                hasNextNode = false;
+                if (ax) {
+                  descriptor.axHitTest(node, touch);
+                } else {
+                  descriptor.hitTest(node, touch);
+                }
+              } while (hasNextNode);
+            } finally {
+              descending = false;
             }
           }
         }.run();
@@ -535,60 +944,146 @@ public class InspectorSonarPlugin implements SonarPlugin {
   }
 
   private @Nullable SonarObject getNode(String id) throws Exception {
+    final SonarObjectWriter node = SonarObjectWriter.create();
+    return writeNode(node, id) ? node.build() : null;
+  }
+
+  private boolean writeNode(final SonarObjectWriter node, String id) throws Exception {
+    return writeNode(node, id, 0, Integer.MAX_VALUE, null);
+  }
+
+  /**
+   * Writes the node's fields into the object being written, with the children from childrenOffset
+   * on, at most childrenLimit of them, and the total childCount. The ids of the children written
+   * are added to childIds, if given. Returns false if there's no node.
+   */
+  private boolean writeNode(
+      final SonarObjectWriter node,
+      String id,
+      final int childrenOffset,
+      final int childrenLimit,
+      final @Nullable List<String> childIds)
+      throws Exception {
     final Object obj = mObjectTracker.get(id);
     if (obj == null) {
-      return null;
+      return false;
     }
 
     final NodeDescriptor<Object> descriptor = descriptorForObject(obj);
     if (descriptor == null) {
-      return null;
+      return false;
     }
 
-    final SonarArray.Builder children = new SonarArray.Builder();
+    node.put("id", descriptor.getId(obj)).put("name", descriptor.getName(obj));
+
+    node.beginObject("data");
     new ErrorReportingRunnable(mConnection) {
       @Override
       protected void runOrThrow() throws Exception {
-        for (int i = 0, count = descriptor.getChildCount(obj); i < count; i++) {
-          final Object child = assertNotNull(descriptor.getChildAt(obj, i));
-          children.put(trackObject(child));
-        }
+        descriptor.writeData(obj, node);
       }
     }.run();
+    node.end();
 
-    final SonarObject.Builder data = new SonarObject.Builder();
+    final int[] childCount = new int[1];
+    node.beginArray("children");
     new ErrorReportingRunnable(mConnection) {
       @Override
       protected void runOrThrow() throws Exception {
-        for (Named<SonarObject> props : descriptor.getData(obj)) {
-          data.put(props.getName(), props.getValue());
+        childCount[0] = descriptor.getChildCount(obj);
+        final long end = Math.min(childCount[0], (long) childrenOffset + childrenLimit);
+        for (int i = childrenOffset; i < end; i++) {
+          final Object child = assertNotNull(descriptor.getChildAt(obj, i));
+          final String childId = trackObject(child);
+          node.add(childId);
+          if (childIds != null) {
+            childIds.add(childId);
+          }
         }
       }
     }.run();
+    node.end();
+    node.put("childCount", childCount[0]);
 
-    final SonarArray.Builder attributes = new SonarArray.Builder();
+    node.beginArray("attributes");
     new ErrorReportingRunnable(mConnection) {
       @Override
       protected void runOrThrow() throws Exception {
         for (Named<String> attribute : descriptor.getAttributes(obj)) {
-          attributes.put(
-              new SonarObject.Builder()
-                  .put("name", attribute.getName())
-                  .put("value", attribute.getValue())
-                  .build());
+          final String name = attribute.getName();
+          final String value = attribute.getValue();
+          node.beginObject().put("name", name).put("value", value).end();
         }
       }
     }.run();
+    node.end();
 
-    return new SonarObject.Builder()
-        .put("id", descriptor.getId(obj))
-        .put("name", descriptor.getName(obj))
-        .put("data", data)
-        .put("children", children)
-        .put("attributes", attributes)
-        .put("decoration", descriptor.getDecoration(obj))
-        .put("extraInfo", descriptor.getExtraInfo(obj))
-        .build();
+    node.put("decoration", descriptor.getDecoration(obj))
+        .put("extraInfo", descriptor.getExtraInfo(obj));
+    return true;
+  }
+
+  /**
+   * Describes the descendants of the nodes a getNodes call asked for, a level at a time, until
+   * the prefetch policy's levels, nodes or {@link #PREFETCH_NANOS} run out. They go out as one
+   * prefetchedNodes message, which unlike the reply waits behind the responses to the desktop's
+   * other calls.
+   */
+  private final class Prefetch implements MainThreadBudget.Task {
+    private final Set<String> mSeen = new HashSet<>();
+    private final int mChildrenOffset;
+    private final int mChildrenLimit;
+    private final SonarObjectWriter mElements = SonarObjectWriter.create().beginArray("elements");
+    private List<String> mLevel;
+    private List<String> mNextLevel = new ArrayList<>();
+    private int mIndex = 0;
+    private int mDepth = 1;
+    private int mCount = 0;
+    private long mSpentNanos = 0;
+
+    Prefetch(SonarArray requested, List<String> children, int childrenOffset, int childrenLimit) {
+      for (int i = 0; i < requested.length(); i++) {
+        mSeen.add(requested.getString(i));
+      }
+      mLevel = children;
+      mChildrenOffset = childrenOffset;
+      mChildrenLimit = childrenLimit;
+    }
+
+    @Override
+    public boolean step() throws Exception {
+      if (mIndex == mLevel.size()) {
+        if (mDepth == mPrefetchLevels || mNextLevel.isEmpty()) {
+          return finish();
+        }
+        mLevel = mNextLevel;
+        mNextLevel = new ArrayList<>();
+        mIndex = 0;
+        mDepth++;
+      }
+      if (mCount >= mPrefetchMaxNodes || mSpentNanos >= PREFETCH_NANOS) {
+        return finish();
+      }
+      final long start = System.nanoTime();
+      final String id = mLevel.get(mIndex++);
+      final Object obj = mObjectTracker.get(id);
+      // Gone since, or already sent.
+      if (obj != null && descriptorForObject(obj) != null && mSeen.add(id)) {
+        mElements.beginObject();
+        writeNode(mElements, id, mChildrenOffset, mChildrenLimit, mNextLevel);
+        mElements.end();
+        mCount++;
+      }
+      mSpentNanos += System.nanoTime() - start;
+      return true;
+    }
+
+    private boolean finish() {
+      if (mCount > 0) {
+        mConnection.send("prefetchedNodes", mElements.end().build());
+      }
+      return false;
+    }
   }
 
   private @Nullable SonarObject getAXNode(String id) throws Exception {
@@ -652,7 +1147,7 @@ public class InspectorSonarPlugin implements SonarPlugin {
         .build();
   }
 
-  private String trackObject(Object obj) throws Exception {
+  String trackObject(Object obj) throws Exception {
     final NodeDescriptor<Object> descriptor = descriptorForObject(obj);
     final String id = descriptor.getId(obj);
     final Object curr = mObjectTracker.get(id);
@@ -663,7 +1158,7 @@ public class InspectorSonarPlugin implements SonarPlugin {
     return id;
   }
 
-  private NodeDescriptor<Object> descriptorForObject(Object obj) {
+  NodeDescriptor<Object> descriptorForObject(Object obj) {
     final Class c = assertNotNull(obj).getClass();
     return (NodeDescriptor<Object>) mDescriptorMapping.descriptorForClass(c);
   }
@@ -8,10 +8,13 @@
 
 package com.facebook.sonar.plugins.inspector;
 
+import com.facebook.sonar.core.SonarArray;
 import com.facebook.sonar.core.SonarObject;
+import com.facebook.sonar.core.SonarObjectWriter;
 import com.facebook.sonar.core.SonarValue;
+import java.util.Arrays;
 
-public class InspectorValue<T> implements SonarValue {
+public class InspectorValue<T> implements SonarObjectWriter.Writable {
 
   /**
    * Descrive the type of data this value contains. This will influence how values are parsed and
@@ -76,4 +79,33 @@ public class InspectorValue<T> implements SonarValue {
         .put("value", mValue)
         .build();
   }
+
+  /** Writes the same fields as {@link #toSonarObject()}. */
+  @Override
+  public void writeTo(SonarObjectWriter writer) {
+    writer.put("__type__", mType.toString()).put("__mutable__", mMutable);
+
+    final Object value = mValue;
+    if (value == null) {
+      return;
+    } else if (value instanceof Integer || value instanceof Long) {
+      writer.put("value", ((Number) value).longValue());
+    } else if (value instanceof Float || value instanceof Double) {
+      writer.put("value", ((Number) value).doubleValue());
+    } else if (value instanceof Boolean) {
+      writer.put("value", (boolean) (Boolean) value);
+    } else if (value instanceof String) {
+      writer.put("value", (String) value);
+    } else if (value instanceof SonarObject) {
+      writer.put("value", (SonarObject) value);
+    } else if (value instanceof SonarArray) {
+      writer.put("value", (SonarArray) value);
+    } else if (value instanceof SonarValue) {
+      writer.put("value", (SonarValue) value);
+    } else if (value instanceof Object[]) {
+      writer.put("value", Arrays.deepToString((Object[]) value));
+    } else {
+      writer.put("value", value.toString());
+    }
+  }
 }
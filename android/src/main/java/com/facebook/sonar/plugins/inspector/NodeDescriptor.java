@@ -8,12 +8,17 @@
 
 package com.facebook.sonar.plugins.inspector;
 
+import android.os.Looper;
+import android.view.View;
 import com.facebook.sonar.core.SonarArray;
 import com.facebook.sonar.core.SonarConnection;
 import com.facebook.sonar.core.SonarDynamic;
 import com.facebook.sonar.core.SonarObject;
+import com.facebook.sonar.core.SonarObjectWriter;
+import com.facebook.sonar.plugins.inspector.descriptors.utils.AccessibilityEvaluationCache;
 import java.util.Collections;
 import java.util.List;
+import java.util.Set;
 import javax.annotation.Nullable;
 
 /**
@@ -25,6 +30,13 @@ public abstract class NodeDescriptor<T> {
   protected SonarConnection mConnection;
   private DescriptorMapping mDescriptorMapping;
 
+  // Set on the main thread while the inspector applies a batch of edits, which sends the nodes
+  // they invalidate back with its response, rather than as an invalidate message each.
+  static @Nullable Set<String> sBatchedInvalidations;
+  static boolean sBatchingAX;
+  // The inspector's node images while it's connected, which invalidating a node drops.
+  static @Nullable NodeSnapshots sSnapshots;
+
   void setConnection(SonarConnection connection) {
     mConnection = connection;
   }
@@ -52,6 +64,16 @@ public abstract class NodeDescriptor<T> {
       new ErrorReportingRunnable() {
         @Override
         protected void runOrThrow() throws Exception {
+          if (sSnapshots != null) {
+            sSnapshots.invalidate(getId(node), node);
+          }
+          if (node instanceof View) {
+            AccessibilityEvaluationCache.invalidate((View) node);
+          }
+          if (batchesInvalidations(false)) {
+            sBatchedInvalidations.add(getId(node));
+            return;
+          }
           SonarArray array =
               new SonarArray.Builder()
                   .put(new SonarObject.Builder().put("id", getId(node)).build())
@@ -72,6 +94,13 @@ public abstract class NodeDescriptor<T> {
       new ErrorReportingRunnable() {
         @Override
         protected void runOrThrow() throws Exception {
+          if (node instanceof View) {
+            AccessibilityEvaluationCache.invalidate((View) node);
+          }
+          if (batchesInvalidations(true)) {
+            sBatchedInvalidations.add(getId(node));
+            return;
+          }
           SonarArray array =
                   new SonarArray.Builder()
                           .put(new SonarObject.Builder().put("id", getId(node)).build())
@@ -83,6 +112,12 @@ public abstract class NodeDescriptor<T> {
     }
   }
 
+  private static boolean batchesInvalidations(boolean ax) {
+    return sBatchedInvalidations != null
+        && sBatchingAX == ax
+        && Looper.myLooper() == Looper.getMainLooper();
+  }
+
   protected final boolean connected() {
     return mConnection != null;
   }
@@ -139,6 +174,17 @@ public abstract class NodeDescriptor<T> {
    */
   public abstract List<Named<SonarObject>> getData(T node) throws Exception;
 
+  /**
+   * Writes the same data as {@link this#getData(Object)} into the node being sent, one object per
+   * header. Descriptors for big trees can override this to write their data field by field rather
+   * than building SonarObjects first.
+   */
+  public void writeData(T node, SonarObjectWriter data) throws Exception {
+    for (Named<SonarObject> props : getData(node)) {
+      data.put(props.getName(), props.getValue());
+    }
+  }
+
   /** Gets data for AX tree */
   public List<Named<SonarObject>> getAXData(T node) throws Exception {
     return Collections.EMPTY_LIST;
@@ -0,0 +1,230 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+package com.facebook.sonar.plugins.inspector;
+
+import android.annotation.TargetApi;
+import android.app.Activity;
+import android.graphics.Bitmap;
+import android.graphics.Canvas;
+import android.graphics.Rect;
+import android.os.Build;
+import android.os.Handler;
+import android.os.HandlerThread;
+import android.support.v4.util.LruCache;
+import android.view.PixelCopy;
+import android.view.View;
+import android.view.ViewParent;
+import android.view.Window;
+import java.io.ByteArrayOutputStream;
+import java.util.zip.CRC32;
+import javax.annotation.Nullable;
+
+/**
+ * Captures downscaled images of views for the desktop's previews. The main thread only starts the
+ * copy: with {@link PixelCopy} where the view is shown in an activity's window, which leaves
+ * reading and scaling the pixels to the render thread, and otherwise by drawing the view into a
+ * bitmap no larger than the image. Encoding and hashing happen on a thread of their own. Images
+ * are kept per node until the node or one of its descendants is invalidated.
+ */
+final class NodeSnapshots {
+
+  interface Callback {
+    /** Called on the snapshot thread, with null if the node couldn't be captured. */
+    void onSnapshot(String id, @Nullable Snapshot snapshot);
+  }
+
+  static final class Snapshot {
+    final byte[] data;
+    /** A CRC32 of data, for the desktop to tell whether its copy is still current. */
+    final String hash;
+    final int width;
+    final int height;
+    final int maxSize;
+    final Bitmap.CompressFormat format;
+
+    Snapshot(byte[] data, int width, int height, int maxSize, Bitmap.CompressFormat format) {
+      final CRC32 crc = new CRC32();
+      crc.update(data);
+      this.data = data;
+      this.hash = Long.toHexString(crc.getValue());
+      this.width = width;
+      this.height = height;
+      this.maxSize = maxSize;
+      this.format = format;
+    }
+  }
+
+  private static final int QUALITY = 80;
+  private static final int MAX_CACHE_BYTES = 4 * 1024 * 1024;
+
+  private final ApplicationWrapper mApplication;
+  private final DescriptorMapping mDescriptorMapping;
+  private final LruCache<String, Snapshot> mCache =
+      new LruCache<String, Snapshot>(MAX_CACHE_BYTES) {
+        @Override
+        protected int sizeOf(String id, Snapshot snapshot) {
+          return snapshot.data.length;
+        }
+      };
+  private @Nullable Handler mHandler;
+
+  NodeSnapshots(ApplicationWrapper application, DescriptorMapping descriptorMapping) {
+    mApplication = application;
+    mDescriptorMapping = descriptorMapping;
+  }
+
+  /**
+   * Captures view, no larger than maxSize on either side, unless there's a current image of it
+   * already. Must be called on the main thread.
+   */
+  void capture(
+      final String id,
+      final View view,
+      final int maxSize,
+      final Bitmap.CompressFormat format,
+      final Callback callback) {
+    final Snapshot cached = mCache.get(id);
+    if (cached != null && cached.maxSize == maxSize && cached.format == format) {
+      respond(id, cached, callback);
+      return;
+    }
+
+    final int width = view.getWidth();
+    final int height = view.getHeight();
+    if (width == 0 || height == 0 || !view.isShown()) {
+      respond(id, null, callback);
+      return;
+    }
+    final float scale = Math.min(1f, (float) maxSize / Math.max(width, height));
+    final Bitmap bitmap =
+        Bitmap.createBitmap(
+            Math.max(1, Math.round(width * scale)),
+            Math.max(1, Math.round(height * scale)),
+            Bitmap.Config.ARGB_8888);
+    final Runnable encode =
+        new Runnable() {
+          @Override
+          public void run() {
+            encode(id, bitmap, maxSize, format, callback);
+          }
+        };
+    if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.O && copyPixels(view, bitmap, encode)) {
+      return;
+    }
+
+    // Views outside of activity windows, such as dialogs and toasts, and older releases.
+    final Canvas canvas = new Canvas(bitmap);
+    canvas.scale(scale, scale);
+    view.draw(canvas);
+    handler().post(encode);
+  }
+
+  /** Drops the images of node and of the views that contain it. */
+  void invalidate(String id, Object node) {
+    mCache.remove(id);
+    if (!(node instanceof View)) {
+      return;
+    }
+    for (ViewParent parent = ((View) node).getParent();
+        parent instanceof View;
+        parent = parent.getParent()) {
+      final NodeDescriptor<Object> descriptor =
+          (NodeDescriptor<Object>) mDescriptorMapping.descriptorForClass(parent.getClass());
+      if (descriptor != null) {
+        mCache.remove(descriptor.getId(parent));
+      }
+    }
+  }
+
+  void clear() {
+    mCache.evictAll();
+  }
+
+  @TargetApi(Build.VERSION_CODES.O)
+  private boolean copyPixels(View view, final Bitmap bitmap, final Runnable encode) {
+    final Window window = windowForView(view);
+    if (window == null || !view.isHardwareAccelerated()) {
+      return false;
+    }
+    final int[] location = new int[2];
+    view.getLocationInWindow(location);
+    final Rect source =
+        new Rect(
+            location[0],
+            location[1],
+            location[0] + view.getWidth(),
+            location[1] + view.getHeight());
+    final View decorView = window.getDecorView();
+    if (!source.intersect(0, 0, decorView.getWidth(), decorView.getHeight())) {
+      return false;
+    }
+    PixelCopy.request(
+        window,
+        source,
+        bitmap,
+        new PixelCopy.OnPixelCopyFinishedListener() {
+          @Override
+          public void onPixelCopyFinished(int result) {
+            // A recycled bitmap is reported as a node that couldn't be captured.
+            if (result != PixelCopy.SUCCESS) {
+              bitmap.recycle();
+            }
+            encode.run();
+          }
+        },
+        handler());
+    return true;
+  }
+
+  private @Nullable Window windowForView(View view) {
+    final View root = view.getRootView();
+    for (Activity activity : mApplication.getActivityStack()) {
+      final Window window = activity.getWindow();
+      if (window != null && window.peekDecorView() == root) {
+        return window;
+      }
+    }
+    return null;
+  }
+
+  private void encode(
+      String id, Bitmap bitmap, int maxSize, Bitmap.CompressFormat format, Callback callback) {
+    if (bitmap.isRecycled()) {
+      callback.onSnapshot(id, null);
+      return;
+    }
+    final ByteArrayOutputStream out = new ByteArrayOutputStream();
+    bitmap.compress(format, QUALITY, out);
+    final Snapshot snapshot =
+        new Snapshot(out.toByteArray(), bitmap.getWidth(), bitmap.getHeight(), maxSize, format);
+    bitmap.recycle();
+    mCache.put(id, snapshot);
+    callback.onSnapshot(id, snapshot);
+  }
+
+  private void respond(
+      final String id, final @Nullable Snapshot snapshot, final Callback callback) {
+    handler().post(
+        new Runnable() {
+          @Override
+          public void run() {
+            callback.onSnapshot(id, snapshot);
+          }
+        });
+  }
+
+  private synchronized Handler handler() {
+    if (mHandler == null) {
+      final HandlerThread thread = new HandlerThread("SonarSnapshots");
+      thread.start();
+      mHandler = new Handler(thread.getLooper());
+    }
+    return mHandler;
+  }
+}
@@ -8,28 +8,49 @@
 
 package com.facebook.sonar.plugins.inspector;
 
+import java.lang.ref.ReferenceQueue;
 import java.lang.ref.WeakReference;
 import java.util.HashMap;
 import java.util.Map;
 import javax.annotation.Nullable;
 
+/**
+ * Weakly maps node ids to the objects they were handed out for. Entries of collected objects are
+ * swept as new objects are tracked, so that the table stays the size of the live tree rather than
+ * of every object that has been shown in a session.
+ */
 public class ObjectTracker {
   ObjectTracker() {}
 
-  private final Map<String, WeakReference<Object>> mObjects = new HashMap<>();
+  private static final class TrackedReference extends WeakReference<Object> {
+    final String id;
+    final int generation;
+
+    TrackedReference(String id, Object obj, int generation, ReferenceQueue<Object> queue) {
+      super(obj, queue);
+      this.id = id;
+      this.generation = generation;
+    }
+  }
+
+  private Map<String, TrackedReference> mObjects = new HashMap<>();
+  private final ReferenceQueue<Object> mCollected = new ReferenceQueue<>();
+  // Bumped by clear(), so that references queued from before it are skipped by the sweep.
+  private int mGeneration;
 
   void put(String id, Object obj) {
-    mObjects.put(id, new WeakReference<>(obj));
+    sweep();
+    mObjects.put(id, new TrackedReference(id, obj, mGeneration, mCollected));
   }
 
   @Nullable
   public Object get(String id) {
-    final WeakReference<Object> weakObj = mObjects.get(id);
-    if (weakObj == null) {
+    final TrackedReference ref = mObjects.get(id);
+    if (ref == null) {
       return null;
     }
 
-    final Object obj = weakObj.get();
+    final Object obj = ref.get();
     if (obj == null) {
       mObjects.remove(id);
     }
@@ -38,10 +59,22 @@ public class ObjectTracker {
   }
 
   void clear() {
-    mObjects.clear();
+    // A new table rather than HashMap.clear(), which keeps the table at the largest it has been.
+    mObjects = new HashMap<>();
+    mGeneration++;
   }
 
   boolean contains(String id) {
     return mObjects.containsKey(id);
   }
+
+  private void sweep() {
+    TrackedReference ref;
+    while ((ref = (TrackedReference) mCollected.poll()) != null) {
+      // The id may have been tracked again for a newer object since.
+      if (ref.generation == mGeneration && mObjects.get(ref.id) == ref) {
+        mObjects.remove(ref.id);
+      }
+    }
+  }
 }
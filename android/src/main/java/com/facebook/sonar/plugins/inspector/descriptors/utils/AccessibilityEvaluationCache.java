@@ -0,0 +1,110 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.plugins.inspector.descriptors.utils;
+
+import android.os.Looper;
+import android.view.View;
+import android.view.ViewParent;
+import com.facebook.sonar.plugins.inspector.descriptors.utils.AccessibilityRoleUtil.AccessibilityRole;
+import java.util.IdentityHashMap;
+import java.util.Iterator;
+import java.util.List;
+import java.util.Map;
+import javax.annotation.Nullable;
+
+/**
+ * Remembers what {@link AccessibilityEvaluationUtil}, {@link AccessibilityUtil} and {@link
+ * AccessibilityRoleUtil} worked out about each view for the length of one traversal of the
+ * accessibility tree, such as a getAXNodes call. Whether a view is focusable or speaks depends on
+ * its ancestors and descendants, so without it every node of a traversal walks most of the tree
+ * again. Invalidating a view drops what was remembered about it, its ancestors and its
+ * descendants. Outside of a traversal, and off the main thread, nothing is remembered.
+ */
+public final class AccessibilityEvaluationCache {
+
+  static final class Entry {
+    @Nullable Boolean talkbackFocusable;
+    @Nullable Boolean accessibilityFocusable;
+    @Nullable Boolean speaking;
+    @Nullable Boolean focusableAncestor;
+    @Nullable AccessibilityRole role;
+    boolean hasTalkbackDescription;
+    @Nullable CharSequence talkbackDescription;
+  }
+
+  private static @Nullable AccessibilityEvaluationCache sCurrent;
+
+  private final Map<View, Entry> mEntries = new IdentityHashMap<>();
+  private boolean mHasRoots;
+  private @Nullable List<AndroidRootResolver.Root> mRoots;
+
+  private AccessibilityEvaluationCache() {}
+
+  /** Starts a traversal, forgetting anything a previous one left behind. */
+  public static void begin() {
+    sCurrent = new AccessibilityEvaluationCache();
+  }
+
+  public static void end() {
+    sCurrent = null;
+  }
+
+  /** Drops what the running traversal knows about view, its ancestors and its descendants. */
+  public static void invalidate(View view) {
+    final AccessibilityEvaluationCache cache = sCurrent;
+    if (cache == null || Looper.myLooper() != Looper.getMainLooper()) {
+      return;
+    }
+    // Windows may have come and gone too.
+    cache.mHasRoots = false;
+    cache.mRoots = null;
+    final Iterator<View> views = cache.mEntries.keySet().iterator();
+    while (views.hasNext()) {
+      final View cached = views.next();
+      if (cached == view || isAncestor(cached, view) || isAncestor(view, cached)) {
+        views.remove();
+      }
+    }
+  }
+
+  /** The view's entry, or null outside of a traversal. */
+  static @Nullable Entry entry(@Nullable View view) {
+    final AccessibilityEvaluationCache cache = sCurrent;
+    if (cache == null || view == null || Looper.myLooper() != Looper.getMainLooper()) {
+      return null;
+    }
+    Entry entry = cache.mEntries.get(view);
+    if (entry == null) {
+      entry = new Entry();
+      cache.mEntries.put(view, entry);
+    }
+    return entry;
+  }
+
+  /** The window roots, which are looked up with reflection, once per traversal. */
+  static @Nullable List<AndroidRootResolver.Root> activeRoots() {
+    final AccessibilityEvaluationCache cache = sCurrent;
+    if (cache == null || Looper.myLooper() != Looper.getMainLooper()) {
+      return new AndroidRootResolver().listActiveRoots();
+    }
+    if (!cache.mHasRoots) {
+      cache.mRoots = new AndroidRootResolver().listActiveRoots();
+      cache.mHasRoots = true;
+    }
+    return cache.mRoots;
+  }
+
+  private static boolean isAncestor(View ancestor, View view) {
+    for (ViewParent parent = view.getParent(); parent != null; parent = parent.getParent()) {
+      if (parent == ancestor) {
+        return true;
+      }
+    }
+    return false;
+  }
+}
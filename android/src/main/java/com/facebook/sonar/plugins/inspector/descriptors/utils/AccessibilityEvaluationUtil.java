@@ -50,6 +50,19 @@ public class AccessibilityEvaluationUtil {
    */
   public static boolean isSpeakingNode(
       @Nullable AccessibilityNodeInfoCompat node, @Nullable View view) {
+    final AccessibilityEvaluationCache.Entry cached = AccessibilityEvaluationCache.entry(view);
+    if (cached != null && cached.speaking != null) {
+      return cached.speaking;
+    }
+    final boolean result = evaluateSpeakingNode(node, view);
+    if (cached != null) {
+      cached.speaking = result;
+    }
+    return result;
+  }
+
+  private static boolean evaluateSpeakingNode(
+      @Nullable AccessibilityNodeInfoCompat node, @Nullable View view) {
     if (node == null || view == null) {
       return false;
     }
@@ -129,6 +142,19 @@ public class AccessibilityEvaluationUtil {
    */
   public static boolean isAccessibilityFocusable(
       @Nullable AccessibilityNodeInfoCompat node, @Nullable View view) {
+    final AccessibilityEvaluationCache.Entry cached = AccessibilityEvaluationCache.entry(view);
+    if (cached != null && cached.accessibilityFocusable != null) {
+      return cached.accessibilityFocusable;
+    }
+    final boolean result = evaluateAccessibilityFocusable(node, view);
+    if (cached != null) {
+      cached.accessibilityFocusable = result;
+    }
+    return result;
+  }
+
+  private static boolean evaluateAccessibilityFocusable(
+      @Nullable AccessibilityNodeInfoCompat node, @Nullable View view) {
     if (node == null || view == null) {
       return false;
     }
@@ -224,6 +250,19 @@ public class AccessibilityEvaluationUtil {
    */
   public static boolean hasFocusableAncestor(
       @Nullable AccessibilityNodeInfoCompat node, @Nullable View view) {
+    final AccessibilityEvaluationCache.Entry cached = AccessibilityEvaluationCache.entry(view);
+    if (cached != null && cached.focusableAncestor != null) {
+      return cached.focusableAncestor;
+    }
+    final boolean result = evaluateFocusableAncestor(node, view);
+    if (cached != null) {
+      cached.focusableAncestor = result;
+    }
+    return result;
+  }
+
+  private static boolean evaluateFocusableAncestor(
+      @Nullable AccessibilityNodeInfoCompat node, @Nullable View view) {
     if (node == null || view == null) {
       return false;
     }
@@ -284,8 +323,7 @@ public class AccessibilityEvaluationUtil {
    * @return {@code true} if view has equal bounds
    */
   public static boolean hasEqualBoundsToViewRoot(AccessibilityNodeInfoCompat node, View view) {
-    AndroidRootResolver rootResolver = new AndroidRootResolver();
-    List<AndroidRootResolver.Root> roots = rootResolver.listActiveRoots();
+    List<AndroidRootResolver.Root> roots = AccessibilityEvaluationCache.activeRoots();
     if (roots != null) {
       for (AndroidRootResolver.Root root : roots) {
         if (view == root.view) {
@@ -317,6 +355,18 @@ public class AccessibilityEvaluationUtil {
    * @return {@code boolean} if the view will be ignored by TalkBack.
    */
   public static boolean isTalkbackFocusable(View view) {
+    final AccessibilityEvaluationCache.Entry cached = AccessibilityEvaluationCache.entry(view);
+    if (cached != null && cached.talkbackFocusable != null) {
+      return cached.talkbackFocusable;
+    }
+    final boolean result = evaluateTalkbackFocusable(view);
+    if (cached != null) {
+      cached.talkbackFocusable = result;
+    }
+    return result;
+  }
+
+  private static boolean evaluateTalkbackFocusable(@Nullable View view) {
     if (view == null) {
       return false;
     }
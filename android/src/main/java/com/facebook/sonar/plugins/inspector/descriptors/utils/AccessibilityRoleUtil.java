@@ -98,10 +98,17 @@ public class AccessibilityRoleUtil {
     if (view == null) {
       return AccessibilityRole.NONE;
     }
+    final AccessibilityEvaluationCache.Entry cached = AccessibilityEvaluationCache.entry(view);
+    if (cached != null && cached.role != null) {
+      return cached.role;
+    }
     AccessibilityNodeInfoCompat nodeInfo = AccessibilityNodeInfoCompat.obtain();
     ViewCompat.onInitializeAccessibilityNodeInfo(view, nodeInfo);
     AccessibilityRole role = getRole(nodeInfo);
     nodeInfo.recycle();
+    if (cached != null) {
+      cached.role = role;
+    }
     return role;
   }
 
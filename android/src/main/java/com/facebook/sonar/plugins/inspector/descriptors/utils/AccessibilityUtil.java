@@ -432,6 +432,19 @@ public final class AccessibilityUtil {
    */
   @Nullable
   public static CharSequence getTalkbackDescription(View view) {
+    final AccessibilityEvaluationCache.Entry cached = AccessibilityEvaluationCache.entry(view);
+    if (cached != null && cached.hasTalkbackDescription) {
+      return cached.talkbackDescription;
+    }
+    final CharSequence description = evaluateTalkbackDescription(view);
+    if (cached != null) {
+      cached.hasTalkbackDescription = true;
+      cached.talkbackDescription = description;
+    }
+    return description;
+  }
+
+  private static @Nullable CharSequence evaluateTalkbackDescription(View view) {
     final AccessibilityNodeInfoCompat node = ViewAccessibilityHelper.createNodeInfoFromView(view);
     if (node == null) {
       return null;
@@ -0,0 +1,112 @@
+// Copyright 2004-present Facebook. All Rights Reserved.
+
+package com.facebook.sonar.plugins.litho;
+
+import com.facebook.litho.annotations.Prop;
+import com.facebook.litho.annotations.ResType;
+import com.facebook.litho.annotations.State;
+import java.lang.reflect.Field;
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import javax.annotation.Nullable;
+
+/**
+ * The @Prop fields of a component class, or the @State fields of a state container class, looked
+ * up once per class rather than once per component and node. Fields are made accessible up front.
+ * Overrides are applied on layout threads, so lookups are synchronized.
+ */
+final class AnnotatedFields {
+
+  static final class Accessor {
+    final Field field;
+    final String name;
+    // Only set for props.
+    final @Nullable ResType resType;
+    // Whether the desktop can edit the value, see applyReflectiveOverride.
+    final boolean mutable;
+
+    Accessor(Field field, @Nullable ResType resType) {
+      this.field = field;
+      this.name = field.getName();
+      this.resType = resType;
+      this.mutable = isTypeMutable(field.getType());
+    }
+  }
+
+  private static final Accessor[] NONE = new Accessor[0];
+  private static final Map<Class<?>, Accessor[]> sProps = new HashMap<>();
+  private static final Map<Class<?>, Accessor[]> sState = new HashMap<>();
+
+  private AnnotatedFields() {}
+
+  static Accessor[] props(Class<?> componentClass) {
+    synchronized (sProps) {
+      Accessor[] accessors = sProps.get(componentClass);
+      if (accessors == null) {
+        accessors = lookUp(componentClass, true);
+        sProps.put(componentClass, accessors);
+      }
+      return accessors;
+    }
+  }
+
+  static Accessor[] state(Class<?> stateContainerClass) {
+    synchronized (sState) {
+      Accessor[] accessors = sState.get(stateContainerClass);
+      if (accessors == null) {
+        accessors = lookUp(stateContainerClass, false);
+        sState.put(stateContainerClass, accessors);
+      }
+      return accessors;
+    }
+  }
+
+  /** The prop or state field with the given name, null if there is none. */
+  static @Nullable Accessor find(Accessor[] accessors, String name) {
+    for (Accessor accessor : accessors) {
+      if (accessor.name.equals(name)) {
+        return accessor;
+      }
+    }
+    return null;
+  }
+
+  private static Accessor[] lookUp(Class<?> type, boolean props) {
+    final List<Accessor> accessors = new ArrayList<>();
+    for (Field f : type.getDeclaredFields()) {
+      try {
+        if (props) {
+          final Prop annotation = f.getAnnotation(Prop.class);
+          if (annotation != null) {
+            f.setAccessible(true);
+            accessors.add(new Accessor(f, annotation.resType()));
+          }
+        } else if (f.getAnnotation(State.class) != null) {
+          f.setAccessible(true);
+          accessors.add(new Accessor(f, null));
+        }
+      } catch (Exception ignored) {
+      }
+    }
+    return accessors.isEmpty() ? NONE : accessors.toArray(new Accessor[accessors.size()]);
+  }
+
+  private static boolean isTypeMutable(Class<?> type) {
+    if (type == int.class || type == Integer.class) {
+      return true;
+    } else if (type == long.class || type == Long.class) {
+      return true;
+    } else if (type == float.class || type == Float.class) {
+      return true;
+    } else if (type == double.class || type == Double.class) {
+      return true;
+    } else if (type == boolean.class || type == Boolean.class) {
+      return true;
+    } else if (type.isAssignableFrom(String.class)) {
+      return true;
+    }
+    return false;
+  }
+}
@@ -17,11 +17,10 @@ import com.facebook.litho.DebugComponent;
 import com.facebook.litho.DebugLayoutNode;
 import com.facebook.litho.LithoView;
 import com.facebook.litho.StateContainer;
-import com.facebook.litho.annotations.Prop;
-import com.facebook.litho.annotations.State;
 import com.facebook.litho.reference.Reference;
 import com.facebook.sonar.core.SonarDynamic;
 import com.facebook.sonar.core.SonarObject;
+import com.facebook.sonar.core.SonarObjectWriter;
 import com.facebook.sonar.plugins.inspector.HighlightedOverlay;
 import com.facebook.sonar.plugins.inspector.InspectorValue;
 import com.facebook.sonar.plugins.inspector.Named;
@@ -57,7 +56,11 @@ public class DebugComponentDescriptor extends NodeDescriptor<DebugComponent> {
 
           for (Pair<String[], SonarDynamic> override : overrides) {
             if (override.first[0].equals("Props")) {
-              applyReflectiveOverride(component, override.first[1], override.second);
+              applyReflectiveOverride(
+                  component,
+                  AnnotatedFields.props(component.getClass()),
+                  override.first[1],
+                  override.second);
             }
           }
         }
@@ -72,7 +75,11 @@ public class DebugComponentDescriptor extends NodeDescriptor<DebugComponent> {
 
           for (Pair<String[], SonarDynamic> override : overrides) {
             if (override.first[0].equals("State")) {
-              applyReflectiveOverride(stateContainer, override.first[1], override.second);
+              applyReflectiveOverride(
+                  stateContainer,
+                  AnnotatedFields.state(stateContainer.getClass()),
+                  override.first[1],
+                  override.second);
             }
           }
         }
@@ -149,32 +156,76 @@ public class DebugComponentDescriptor extends NodeDescriptor<DebugComponent> {
 
     final List<Named<SonarObject>> data = new ArrayList<>();
 
-    final SonarObject layoutData = getLayoutData(node);
-    if (layoutData != null) {
-      data.add(new Named<>("Layout", layoutData));
+    if (node.getLayoutNode() != null) {
+      final SonarObjectWriter layoutData = SonarObjectWriter.create();
+      writeLayoutData(node, node.getLayoutNode(), layoutData);
+      data.add(new Named<>("Layout", layoutData.build()));
     }
 
-    final SonarObject propData = getPropData(node);
-    if (propData != null) {
-      data.add(new Named<>("Props", propData));
+    final AnnotatedFields.Accessor[] props = getProps(node);
+    if (props.length > 0) {
+      final SonarObjectWriter propData = SonarObjectWriter.create();
+      writePropData(node.getComponent(), props, propData);
+      data.add(new Named<>("Props", propData.build()));
     }
 
-    final SonarObject stateData = getStateData(node);
-    if (stateData != null) {
-      data.add(new Named<>("State", stateData));
+    final AnnotatedFields.Accessor[] state = getState(node);
+    if (state.length > 0) {
+      final SonarObjectWriter stateData = SonarObjectWriter.create();
+      writeStateData(node.getStateContainer(), state, stateData);
+      data.add(new Named<>("State", stateData.build()));
     }
 
     return data;
   }
 
-  @Nullable
-  private static SonarObject getLayoutData(DebugComponent node) {
+  /**
+   * Writes the same data as {@link #getData(DebugComponent)}, but straight into the node being
+   * sent, which with native Sonar loaded means straight into the native message.
+   */
+  @Override
+  public void writeData(DebugComponent node, SonarObjectWriter data) throws Exception {
+    NodeDescriptor componentDescriptor = descriptorForClass(node.getComponent().getClass());
+    if (componentDescriptor.getClass() != ObjectDescriptor.class) {
+      componentDescriptor.writeData(node.getComponent(), data);
+      return;
+    }
+
+    // Every begin is matched with an end, even if something throws, so that the caller can still
+    // finish the node.
     final DebugLayoutNode layout = node.getLayoutNode();
-    if (layout == null) {
-      return null;
+    if (layout != null) {
+      data.beginObject("Layout");
+      try {
+        writeLayoutData(node, layout, data);
+      } finally {
+        data.end();
+      }
+    }
+
+    final AnnotatedFields.Accessor[] props = getProps(node);
+    if (props.length > 0) {
+      data.beginObject("Props");
+      try {
+        writePropData(node.getComponent(), props, data);
+      } finally {
+        data.end();
+      }
     }
 
-    final SonarObject.Builder data = new SonarObject.Builder();
+    final AnnotatedFields.Accessor[] state = getState(node);
+    if (state.length > 0) {
+      data.beginObject("State");
+      try {
+        writeStateData(node.getStateContainer(), state, data);
+      } finally {
+        data.end();
+      }
+    }
+  }
+
+  private static void writeLayoutData(
+      DebugComponent node, DebugLayoutNode layout, SonarObjectWriter data) {
     data.put("background", fromReference(node.getContext(), layout.getBackground()));
     data.put("foreground", fromDrawable(layout.getForeground()));
 
@@ -201,169 +252,127 @@ public class DebugComponentDescriptor extends NodeDescriptor<DebugComponent> {
 
     data.put("aspect-ratio", fromFloat(layout.getAspectRatio()));
 
-    data.put(
-        "margin",
-        new SonarObject.Builder()
-            .put("left", fromYogaValue(layout.getMargin(YogaEdge.LEFT)))
-            .put("top", fromYogaValue(layout.getMargin(YogaEdge.TOP)))
-            .put("right", fromYogaValue(layout.getMargin(YogaEdge.RIGHT)))
-            .put("bottom", fromYogaValue(layout.getMargin(YogaEdge.BOTTOM)))
-            .put("start", fromYogaValue(layout.getMargin(YogaEdge.START)))
-            .put("end", fromYogaValue(layout.getMargin(YogaEdge.END)))
-            .put("horizontal", fromYogaValue(layout.getMargin(YogaEdge.HORIZONTAL)))
-            .put("vertical", fromYogaValue(layout.getMargin(YogaEdge.VERTICAL)))
-            .put("all", fromYogaValue(layout.getMargin(YogaEdge.ALL))));
-
-    data.put(
-        "padding",
-        new SonarObject.Builder()
-            .put("left", fromYogaValue(layout.getPadding(YogaEdge.LEFT)))
-            .put("top", fromYogaValue(layout.getPadding(YogaEdge.TOP)))
-            .put("right", fromYogaValue(layout.getPadding(YogaEdge.RIGHT)))
-            .put("bottom", fromYogaValue(layout.getPadding(YogaEdge.BOTTOM)))
-            .put("start", fromYogaValue(layout.getPadding(YogaEdge.START)))
-            .put("end", fromYogaValue(layout.getPadding(YogaEdge.END)))
-            .put("horizontal", fromYogaValue(layout.getPadding(YogaEdge.HORIZONTAL)))
-            .put("vertical", fromYogaValue(layout.getPadding(YogaEdge.VERTICAL)))
-            .put("all", fromYogaValue(layout.getPadding(YogaEdge.ALL))));
-
-    data.put(
-        "border",
-        new SonarObject.Builder()
-            .put("left", fromFloat(layout.getBorderWidth(YogaEdge.LEFT)))
-            .put("top", fromFloat(layout.getBorderWidth(YogaEdge.TOP)))
-            .put("right", fromFloat(layout.getBorderWidth(YogaEdge.RIGHT)))
-            .put("bottom", fromFloat(layout.getBorderWidth(YogaEdge.BOTTOM)))
-            .put("start", fromFloat(layout.getBorderWidth(YogaEdge.START)))
-            .put("end", fromFloat(layout.getBorderWidth(YogaEdge.END)))
-            .put("horizontal", fromFloat(layout.getBorderWidth(YogaEdge.HORIZONTAL)))
-            .put("vertical", fromFloat(layout.getBorderWidth(YogaEdge.VERTICAL)))
-            .put("all", fromFloat(layout.getBorderWidth(YogaEdge.ALL))));
+    data.beginObject("margin")
+        .put("left", fromYogaValue(layout.getMargin(YogaEdge.LEFT)))
+        .put("top", fromYogaValue(layout.getMargin(YogaEdge.TOP)))
+        .put("right", fromYogaValue(layout.getMargin(YogaEdge.RIGHT)))
+        .put("bottom", fromYogaValue(layout.getMargin(YogaEdge.BOTTOM)))
+        .put("start", fromYogaValue(layout.getMargin(YogaEdge.START)))
+        .put("end", fromYogaValue(layout.getMargin(YogaEdge.END)))
+        .put("horizontal", fromYogaValue(layout.getMargin(YogaEdge.HORIZONTAL)))
+        .put("vertical", fromYogaValue(layout.getMargin(YogaEdge.VERTICAL)))
+        .put("all", fromYogaValue(layout.getMargin(YogaEdge.ALL)))
+        .end();
+
+    data.beginObject("padding")
+        .put("left", fromYogaValue(layout.getPadding(YogaEdge.LEFT)))
+        .put("top", fromYogaValue(layout.getPadding(YogaEdge.TOP)))
+        .put("right", fromYogaValue(layout.getPadding(YogaEdge.RIGHT)))
+        .put("bottom", fromYogaValue(layout.getPadding(YogaEdge.BOTTOM)))
+        .put("start", fromYogaValue(layout.getPadding(YogaEdge.START)))
+        .put("end", fromYogaValue(layout.getPadding(YogaEdge.END)))
+        .put("horizontal", fromYogaValue(layout.getPadding(YogaEdge.HORIZONTAL)))
+        .put("vertical", fromYogaValue(layout.getPadding(YogaEdge.VERTICAL)))
+        .put("all", fromYogaValue(layout.getPadding(YogaEdge.ALL)))
+        .end();
+
+    data.beginObject("border")
+        .put("left", fromFloat(layout.getBorderWidth(YogaEdge.LEFT)))
+        .put("top", fromFloat(layout.getBorderWidth(YogaEdge.TOP)))
+        .put("right", fromFloat(layout.getBorderWidth(YogaEdge.RIGHT)))
+        .put("bottom", fromFloat(layout.getBorderWidth(YogaEdge.BOTTOM)))
+        .put("start", fromFloat(layout.getBorderWidth(YogaEdge.START)))
+        .put("end", fromFloat(layout.getBorderWidth(YogaEdge.END)))
+        .put("horizontal", fromFloat(layout.getBorderWidth(YogaEdge.HORIZONTAL)))
+        .put("vertical", fromFloat(layout.getBorderWidth(YogaEdge.VERTICAL)))
+        .put("all", fromFloat(layout.getBorderWidth(YogaEdge.ALL)))
+        .end();
+
+    data.beginObject("position")
+        .put("left", fromYogaValue(layout.getPosition(YogaEdge.LEFT)))
+        .put("top", fromYogaValue(layout.getPosition(YogaEdge.TOP)))
+        .put("right", fromYogaValue(layout.getPosition(YogaEdge.RIGHT)))
+        .put("bottom", fromYogaValue(layout.getPosition(YogaEdge.BOTTOM)))
+        .put("start", fromYogaValue(layout.getPosition(YogaEdge.START)))
+        .put("end", fromYogaValue(layout.getPosition(YogaEdge.END)))
+        .put("horizontal", fromYogaValue(layout.getPosition(YogaEdge.HORIZONTAL)))
+        .put("vertical", fromYogaValue(layout.getPosition(YogaEdge.VERTICAL)))
+        .put("all", fromYogaValue(layout.getPosition(YogaEdge.ALL)))
+        .end();
+  }
 
-    data.put(
-        "position",
-        new SonarObject.Builder()
-            .put("left", fromYogaValue(layout.getPosition(YogaEdge.LEFT)))
-            .put("top", fromYogaValue(layout.getPosition(YogaEdge.TOP)))
-            .put("right", fromYogaValue(layout.getPosition(YogaEdge.RIGHT)))
-            .put("bottom", fromYogaValue(layout.getPosition(YogaEdge.BOTTOM)))
-            .put("start", fromYogaValue(layout.getPosition(YogaEdge.START)))
-            .put("end", fromYogaValue(layout.getPosition(YogaEdge.END)))
-            .put("horizontal", fromYogaValue(layout.getPosition(YogaEdge.HORIZONTAL)))
-            .put("vertical", fromYogaValue(layout.getPosition(YogaEdge.VERTICAL)))
-            .put("all", fromYogaValue(layout.getPosition(YogaEdge.ALL))));
-
-    return data.build();
+  private static AnnotatedFields.Accessor[] getProps(DebugComponent node) {
+    if (node.canResolve()) {
+      return NO_FIELDS;
+    }
+    return AnnotatedFields.props(node.getComponent().getClass());
   }
 
-  @Nullable
-  private static SonarObject getPropData(DebugComponent node) {
+  private static AnnotatedFields.Accessor[] getState(DebugComponent node) {
     if (node.canResolve()) {
-      return null;
+      return NO_FIELDS;
+    }
+    final StateContainer stateContainer = node.getStateContainer();
+    if (stateContainer == null) {
+      return NO_FIELDS;
     }
+    return AnnotatedFields.state(stateContainer.getClass());
+  }
 
-    final Component component = node.getComponent();
-    final SonarObject.Builder props = new SonarObject.Builder();
+  private static final AnnotatedFields.Accessor[] NO_FIELDS = new AnnotatedFields.Accessor[0];
 
-    boolean hasProps = false;
-    for (Field f : component.getClass().getDeclaredFields()) {
+  private static void writePropData(
+      Component component, AnnotatedFields.Accessor[] props, SonarObjectWriter data) {
+    for (AnnotatedFields.Accessor prop : props) {
       try {
-        f.setAccessible(true);
-
-        final Prop annotation = f.getAnnotation(Prop.class);
-        if (annotation != null) {
-          switch (annotation.resType()) {
-            case COLOR:
-              props.put(f.getName(), fromColor((Integer) f.get(component)));
-              break;
-            case DRAWABLE:
-              props.put(f.getName(), fromDrawable((Drawable) f.get(component)));
-              break;
-            default:
-              if (f.get(component) != null
-                  && PropWithDescription.class.isAssignableFrom(f.get(component).getClass())) {
-                final Object description =
-                    ((PropWithDescription) f.get(component))
-                        .getSonarLayoutInspectorPropDescription();
-                // Treat the description as immutable for now, because it's a "translation" of the
-                // actual prop,
-                // mutating them is not going to change the original prop.
-                if (description instanceof Map<?, ?>) {
-                  final Map<?, ?> descriptionMap = (Map<?, ?>) description;
-                  for (Map.Entry<?, ?> entry : descriptionMap.entrySet()) {
-                    props.put(
-                        entry.getKey().toString(), InspectorValue.immutable(entry.getValue()));
-                  }
-                } else {
-                  props.put(f.getName(), InspectorValue.immutable(description));
+        final Object value = prop.field.get(component);
+        switch (prop.resType) {
+          case COLOR:
+            data.put(prop.name, fromColor((Integer) value));
+            break;
+          case DRAWABLE:
+            data.put(prop.name, fromDrawable((Drawable) value));
+            break;
+          default:
+            if (value instanceof PropWithDescription) {
+              final Object description =
+                  ((PropWithDescription) value).getSonarLayoutInspectorPropDescription();
+              // Treat the description as immutable for now, because it's a "translation" of the
+              // actual prop,
+              // mutating them is not going to change the original prop.
+              if (description instanceof Map<?, ?>) {
+                final Map<?, ?> descriptionMap = (Map<?, ?>) description;
+                for (Map.Entry<?, ?> entry : descriptionMap.entrySet()) {
+                  data.put(entry.getKey().toString(), InspectorValue.immutable(entry.getValue()));
                 }
               } else {
-                if (isTypeMutable(f.getType())) {
-                  props.put(f.getName(), InspectorValue.mutable(f.get(component)));
-                } else {
-                  props.put(f.getName(), InspectorValue.immutable(f.get(component)));
-                }
+                data.put(prop.name, InspectorValue.immutable(description));
               }
-              break;
-          }
-          hasProps = true;
+            } else if (prop.mutable) {
+              data.put(prop.name, InspectorValue.mutable(value));
+            } else {
+              data.put(prop.name, InspectorValue.immutable(value));
+            }
+            break;
         }
       } catch (Exception ignored) {
       }
     }
-
-    return hasProps ? props.build() : null;
   }
 
-  @Nullable
-  private static SonarObject getStateData(DebugComponent node) {
-    if (node.canResolve()) {
-      return null;
-    }
-
-    final StateContainer stateContainer = node.getStateContainer();
-    if (stateContainer == null) {
-      return null;
-    }
-
-    final SonarObject.Builder state = new SonarObject.Builder();
-
-    boolean hasState = false;
-    for (Field f : stateContainer.getClass().getDeclaredFields()) {
+  private static void writeStateData(
+      StateContainer stateContainer, AnnotatedFields.Accessor[] state, SonarObjectWriter data) {
+    for (AnnotatedFields.Accessor field : state) {
       try {
-        f.setAccessible(true);
-
-        final State annotation = f.getAnnotation(State.class);
-        if (annotation != null) {
-          if (isTypeMutable(f.getType())) {
-            state.put(f.getName(), InspectorValue.mutable(f.get(stateContainer)));
-          } else {
-            state.put(f.getName(), InspectorValue.immutable(f.get(stateContainer)));
-          }
-          hasState = true;
+        final Object value = field.field.get(stateContainer);
+        if (field.mutable) {
+          data.put(field.name, InspectorValue.mutable(value));
+        } else {
+          data.put(field.name, InspectorValue.immutable(value));
         }
       } catch (Exception ignored) {
       }
     }
-
-    return hasState ? state.build() : null;
-  }
-
-  private static boolean isTypeMutable(Class<?> type) {
-    if (type == int.class || type == Integer.class) {
-      return true;
-    } else if (type == long.class || type == Long.class) {
-      return true;
-    } else if (type == float.class || type == Float.class) {
-      return true;
-    } else if (type == double.class || type == Double.class) {
-      return true;
-    } else if (type == boolean.class || type == Boolean.class) {
-      return true;
-    } else if (type.isAssignableFrom(String.class)) {
-      return true;
-    }
-    return false;
   }
 
   @Override
@@ -575,10 +584,14 @@ public class DebugComponentDescriptor extends NodeDescriptor<DebugComponent> {
     return YogaEdge.valueOf(s.toUpperCase());
   }
 
-  private static void applyReflectiveOverride(Object o, String key, SonarDynamic dynamic) {
+  private static void applyReflectiveOverride(
+      Object o, AnnotatedFields.Accessor[] fields, String key, SonarDynamic dynamic) {
     try {
-      final Field field = o.getClass().getDeclaredField(key);
-      field.setAccessible(true);
+      final AnnotatedFields.Accessor accessor = AnnotatedFields.find(fields, key);
+      if (accessor == null) {
+        return;
+      }
+      final Field field = accessor.field;
 
       final Class type = field.getType();
 
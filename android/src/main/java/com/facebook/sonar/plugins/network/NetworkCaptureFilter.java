@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+package com.facebook.sonar.plugins.network;
+
+import android.net.Uri;
+import com.facebook.sonar.core.SonarArray;
+import com.facebook.sonar.core.SonarObject;
+import java.util.Locale;
+import javax.annotation.Nullable;
+
+/**
+ * Which requests the desktop wants to see, as pushed with setFilter. Checked before a request or
+ * response is converted, so that the ones nobody looks at cost next to nothing. Every field is
+ * optional, and an empty filter captures everything.
+ */
+public final class NetworkCaptureFilter {
+  public static final NetworkCaptureFilter ALL = new NetworkCaptureFilter();
+
+  // Matches the host itself and its subdomains.
+  private @Nullable String mHost;
+  private @Nullable String mPathPrefix;
+  // Upper case.
+  private @Nullable String[] mMethods;
+  private int mMinStatus = 0;
+  private int mMaxStatus = Integer.MAX_VALUE;
+  // Lower case, matched against the start of the content type.
+  private @Nullable String mContentType;
+  private long mMaxBodyBytes = Long.MAX_VALUE;
+
+  private NetworkCaptureFilter() {}
+
+  public static NetworkCaptureFilter fromSonarObject(SonarObject params) {
+    final NetworkCaptureFilter filter = new NetworkCaptureFilter();
+    filter.mHost = lowerCase(params.getString("host"));
+    filter.mPathPrefix = emptyToNull(params.getString("pathPrefix"));
+    if (params.contains("methods")) {
+      final SonarArray methods = params.getArray("methods");
+      filter.mMethods = new String[methods.length()];
+      for (int i = 0; i < methods.length(); i++) {
+        filter.mMethods[i] = methods.getString(i).toUpperCase(Locale.US);
+      }
+    }
+    if (params.contains("minStatus")) {
+      filter.mMinStatus = params.getInt("minStatus");
+    }
+    if (params.contains("maxStatus")) {
+      filter.mMaxStatus = params.getInt("maxStatus");
+    }
+    filter.mContentType = lowerCase(params.getString("contentType"));
+    if (params.contains("maxBodyBytes")) {
+      filter.mMaxBodyBytes = params.getLong("maxBodyBytes");
+    }
+    return filter;
+  }
+
+  public boolean acceptsRequest(String method, @Nullable String host, @Nullable String path) {
+    if (mMethods != null && !containsMethod(method)) {
+      return false;
+    }
+    return acceptsHost(host) && acceptsPath(path);
+  }
+
+  /** Only parses the url when the filter has a host or path. */
+  public boolean acceptsRequest(String method, String url) {
+    if (mHost == null && mPathPrefix == null) {
+      return acceptsRequest(method, null, null);
+    }
+    final Uri uri = Uri.parse(url);
+    return acceptsRequest(method, uri.getHost(), uri.getPath());
+  }
+
+  /** Only needs what is known before the body is read. */
+  public boolean acceptsResponse(int status, @Nullable String contentType) {
+    if (status < mMinStatus || status > mMaxStatus) {
+      return false;
+    }
+    return mContentType == null
+        || (contentType != null && contentType.toLowerCase(Locale.US).startsWith(mContentType));
+  }
+
+  /** Bodies larger than this are reported without their data. */
+  public long getMaxBodyBytes() {
+    return mMaxBodyBytes;
+  }
+
+  private boolean containsMethod(String method) {
+    for (String accepted : mMethods) {
+      if (accepted.equalsIgnoreCase(method)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  private boolean acceptsHost(@Nullable String host) {
+    if (mHost == null) {
+      return true;
+    }
+    if (host == null) {
+      return false;
+    }
+    host = host.toLowerCase(Locale.US);
+    return host.equals(mHost)
+        || (host.endsWith(mHost) && host.charAt(host.length() - mHost.length() - 1) == '.');
+  }
+
+  private boolean acceptsPath(@Nullable String path) {
+    return mPathPrefix == null || (path != null && path.startsWith(mPathPrefix));
+  }
+
+  private static @Nullable String emptyToNull(@Nullable String value) {
+    return value == null || value.isEmpty() ? null : value;
+  }
+
+  private static @Nullable String lowerCase(@Nullable String value) {
+    value = emptyToNull(value);
+    return value == null ? null : value.toLowerCase(Locale.US);
+  }
+}
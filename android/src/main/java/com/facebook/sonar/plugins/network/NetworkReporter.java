@@ -8,8 +8,10 @@
 
 package com.facebook.sonar.plugins.network;
 
+import java.nio.ByteBuffer;
 import java.util.ArrayList;
 import java.util.List;
+import javax.annotation.Nullable;
 
 public interface NetworkReporter {
   void reportRequest(RequestInfo requestInfo);
@@ -56,6 +58,12 @@ public interface NetworkReporter {
     public String statusReason;
     public List<Header> headers = new ArrayList<>();
     public byte[] body;
+    /**
+     * The body in a direct buffer, between its position and limit, as an alternative to body that
+     * can be sent to the desktop without being copied or base64 encoded. Only one of the two is
+     * set.
+     */
+    public @Nullable ByteBuffer bodyBuffer;
 
     public Header getFirstHeader(final String name) {
       for (Header header : headers) {
@@ -8,24 +8,84 @@
 
 package com.facebook.sonar.plugins.network;
 
+import android.content.Context;
 import android.util.Base64;
+import com.facebook.sonar.BuildConfig;
+import com.facebook.sonar.android.NetworkCapture;
 import com.facebook.sonar.core.ErrorReportingRunnable;
 import com.facebook.sonar.core.SonarArray;
+import com.facebook.sonar.core.SonarConnection;
 import com.facebook.sonar.core.SonarObject;
+import com.facebook.sonar.core.SonarReceiver;
+import com.facebook.sonar.core.SonarResponder;
 import com.facebook.sonar.plugins.common.BufferingSonarPlugin;
+import java.io.File;
+import java.util.LinkedHashMap;
 import java.util.List;
+import java.util.Map;
+import javax.annotation.Nullable;
 
+/**
+ * Reports the requests and responses of a {@link NetworkReporter}, such as {@link
+ * SonarOkhttpInterceptor}, to the desktop's Network plugin. In internal builds they are handed to
+ * the native {@link NetworkCapture}, which filters, buffers and encodes them as on iOS, and also
+ * keeps full bodies for getResponseBody and can aggregate requests into summaries. Otherwise they
+ * are sent from Java.
+ */
 public class NetworkSonarPlugin extends BufferingSonarPlugin implements NetworkReporter {
   public static final String ID = "Network";
 
-  private final List<NetworkResponseFormatter> mFormatters;
+  // Requests left out by the filter whose responses haven't come yet, which are left out too.
+  private static final int MAX_SKIPPED_REQUESTS = 256;
+
+  private final ResponseFormatterPipeline mFormatters;
+  private final @Nullable NetworkCapture mCapture;
+  private volatile NetworkCaptureFilter mFilter = NetworkCaptureFilter.ALL;
+  private final Map<String, Boolean> mSkippedRequests =
+      new LinkedHashMap<String, Boolean>() {
+        @Override
+        protected boolean removeEldestEntry(Map.Entry<String, Boolean> eldest) {
+          return size() > MAX_SKIPPED_REQUESTS;
+        }
+      };
 
   public NetworkSonarPlugin() {
     this(null);
   }
 
   public NetworkSonarPlugin(List<NetworkResponseFormatter> formatters) {
-    this.mFormatters = formatters;
+    this.mFormatters = new ResponseFormatterPipeline(formatters);
+    this.mCapture = createCapture(null, null);
+  }
+
+  /**
+   * Keeps requests made before the desktop connects, in particular the ones from app startup,
+   * across restarts of the app until they're sent.
+   */
+  public NetworkSonarPlugin(Context context, List<NetworkResponseFormatter> formatters) {
+    // The native capture buffers in the file itself, instead of the Java buffer.
+    super(BuildConfig.IS_INTERNAL_BUILD ? null : getPersistentFile(context, ID));
+    this.mFormatters = new ResponseFormatterPipeline(formatters);
+    // Bodies that don't fit in memory are dropped if the directory can't be made.
+    final File bodies = new File(context.getCacheDir(), "sonar-network-bodies");
+    final boolean spill = bodies.isDirectory() || bodies.mkdirs();
+    this.mCapture = createCapture(getPersistentFile(context, ID), spill ? bodies : null);
+  }
+
+  private static @Nullable NetworkCapture createCapture(
+      @Nullable File bufferFile, @Nullable File bodySpillDirectory) {
+    if (!BuildConfig.IS_INTERNAL_BUILD) {
+      return null;
+    }
+    return new NetworkCapture(bufferFile, bodySpillDirectory);
+  }
+
+  /**
+   * Adds a formatter that is only asked about responses whose content type starts with
+   * contentType, ahead of the ones passed to the constructor.
+   */
+  public void addFormatter(String contentType, NetworkResponseFormatter formatter) {
+    mFormatters.addFormatter(contentType, formatter);
   }
 
   @Override
@@ -33,8 +93,103 @@ public class NetworkSonarPlugin extends BufferingSonarPlugin implements NetworkR
     return ID;
   }
 
+  /**
+   * What the desktop wants to see. Reporters can check it before collecting a request or
+   * response, as SonarOkhttpInterceptor does, rather than have the plugin discard it.
+   */
+  public NetworkCaptureFilter getCaptureFilter() {
+    return mFilter;
+  }
+
+  @Override
+  public void onConnect(SonarConnection connection) {
+    // Registers getResponseBody, setFilter, setAggregation and getSummary, and sends what it
+    // buffered. The setFilter below replaces the native one, and passes the filter on to it.
+    if (mCapture != null) {
+      mCapture.connect(connection);
+    }
+    // Responses are formatted once the desktop opens them, rather than for every response.
+    connection.receive(
+        "formatResponse",
+        new SonarReceiver() {
+          @Override
+          public void onReceive(SonarObject params, final SonarResponder responder) {
+            mFormatters.format(
+                params.getString("id"),
+                new ResponseFormatterPipeline.Callback() {
+                  @Override
+                  public void onFormatted(String json) {
+                    responder.success(
+                        new SonarObject.Builder().put("data", toBase64(json.getBytes())).build());
+                  }
+
+                  @Override
+                  public void onFailed(String reason) {
+                    responder.error(new SonarObject.Builder().put("message", reason).build());
+                  }
+                });
+          }
+        });
+    connection.receive(
+        "setFilter",
+        new SonarReceiver() {
+          @Override
+          public void onReceive(SonarObject params, SonarResponder responder) {
+            mFilter = NetworkCaptureFilter.fromSonarObject(params);
+            if (mCapture != null) {
+              mCapture.setFilter(params);
+            }
+            responder.success();
+          }
+        });
+    super.onConnect(connection);
+  }
+
+  /** Everything is captured again while no desktop is around to say otherwise. */
+  @Override
+  public void onDisconnect() {
+    mFilter = NetworkCaptureFilter.ALL;
+    if (mCapture != null) {
+      mCapture.disconnect();
+    }
+    super.onDisconnect();
+  }
+
+  /**
+   * For a request that was reported but whose response the filter leaves out, so that the desktop
+   * drops the request too.
+   */
+  public void reportDropped(String requestId) {
+    if (mCapture != null) {
+      mCapture.reportDropped(requestId);
+      return;
+    }
+    send("dropRequest", new SonarObject.Builder().put("id", requestId).build());
+  }
+
   @Override
   public void reportRequest(RequestInfo requestInfo) {
+    if (mCapture != null) {
+      mCapture.reportRequest(
+          requestInfo.requestId,
+          requestInfo.timeStamp,
+          requestInfo.method,
+          requestInfo.uri,
+          toArray(requestInfo.headers),
+          requestInfo.body);
+      return;
+    }
+    final NetworkCaptureFilter filter = mFilter;
+    if (!filter.acceptsRequest(requestInfo.method, requestInfo.uri)) {
+      synchronized (mSkippedRequests) {
+        mSkippedRequests.put(requestInfo.requestId, Boolean.TRUE);
+      }
+      return;
+    }
+    if (requestInfo.body != null && requestInfo.body.length > filter.getMaxBodyBytes()) {
+      requestInfo.body = null;
+    }
+
     final SonarObject request =
         new SonarObject.Builder()
             .put("id", requestInfo.requestId)
@@ -50,46 +205,83 @@ public class NetworkSonarPlugin extends BufferingSonarPlugin implements NetworkR
 
   @Override
   public void reportResponse(final ResponseInfo responseInfo) {
+    if (mCapture != null) {
+      reportNativeResponse(responseInfo);
+      return;
+    }
+    synchronized (mSkippedRequests) {
+      if (mSkippedRequests.remove(responseInfo.requestId) != null) {
+        return;
+      }
+    }
+    final NetworkCaptureFilter filter = mFilter;
+    final Header contentType = responseInfo.getFirstHeader("content-type");
+    if (!filter.acceptsResponse(
+        responseInfo.statusCode, contentType != null ? contentType.value : null)) {
+      reportDropped(responseInfo.requestId);
+      return;
+    }
+
     final Runnable job =
         new ErrorReportingRunnable(getConnection()) {
           @Override
           protected void runOrThrow() throws Exception {
-            if (shouldStripResponseBody(responseInfo)) {
+            if (shouldStripResponseBody(responseInfo)
+                || bodyLength(responseInfo) > filter.getMaxBodyBytes()) {
               responseInfo.body = null;
+              responseInfo.bodyBuffer = null;
             }
 
-            final SonarObject response =
+            final SonarObject.Builder response =
                 new SonarObject.Builder()
                     .put("id", responseInfo.requestId)
                     .put("timestamp", responseInfo.timeStamp)
                     .put("status", responseInfo.statusCode)
                     .put("reason", responseInfo.statusReason)
                     .put("headers", toSonarObject(responseInfo.headers))
-                    .put("data", toBase64(responseInfo.body))
-                    .build();
+                    .put("formattable", mFormatters.offer(responseInfo));
 
-            send("newResponse", response);
+            if (responseInfo.bodyBuffer != null) {
+              send("newResponse", response, responseInfo.bodyBuffer, "data");
+            } else {
+              send("newResponse", response.put("data", toBase64(responseInfo.body)).build());
+            }
           }
         };
 
-    if (mFormatters != null) {
-      for (NetworkResponseFormatter formatter : mFormatters) {
-        if (formatter.shouldFormat(responseInfo)) {
-          formatter.format(
-              responseInfo,
-              new NetworkResponseFormatter.OnCompletionListener() {
-                @Override
-                public void onCompletion(final String json) {
-                  responseInfo.body = json.getBytes();
-                  job.run();
-                }
-              });
-          return;
-        }
-      }
+    job.run();
+  }
+
+  /** The native capture applies the filter itself. */
+  private void reportNativeResponse(ResponseInfo responseInfo) {
+    final Header contentType = responseInfo.getFirstHeader("content-type");
+    if (shouldStripResponseBody(responseInfo)) {
+      responseInfo.body = null;
+      responseInfo.bodyBuffer = null;
     }
+    // Only offered if the response is kept, so that it doesn't push out the ones that are.
+    final boolean formattable =
+        mFilter.acceptsResponse(
+                responseInfo.statusCode, contentType != null ? contentType.value : null)
+            && mFormatters.offer(responseInfo);
+    mCapture.reportResponse(
+        responseInfo.requestId,
+        responseInfo.timeStamp,
+        responseInfo.statusCode,
+        responseInfo.statusReason,
+        toArray(responseInfo.headers),
+        formattable,
+        responseInfo.bodyBuffer != null ? null : responseInfo.body,
+        responseInfo.bodyBuffer);
+  }
 
-    job.run();
+  private static String[] toArray(List<Header> headers) {
+    final String[] array = new String[2 * headers.size()];
+    for (int i = 0; i < headers.size(); i++) {
+      array[2 * i] = headers.get(i).name;
+      array[2 * i + 1] = headers.get(i).value;
+    }
+    return array;
   }
 
   private String toBase64(byte[] bytes) {
@@ -109,6 +301,13 @@ public class NetworkSonarPlugin extends BufferingSonarPlugin implements NetworkR
     return list.build();
   }
 
+  private static long bodyLength(ResponseInfo responseInfo) {
+    if (responseInfo.bodyBuffer != null) {
+      return responseInfo.bodyBuffer.remaining();
+    }
+    return responseInfo.body != null ? responseInfo.body.length : 0;
+  }
+
   private static boolean shouldStripResponseBody(ResponseInfo responseInfo) {
     final Header contentType = responseInfo.getFirstHeader("content-type");
     if (contentType == null) {
@@ -0,0 +1,194 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.plugins.network;
+
+import com.facebook.sonar.plugins.network.NetworkReporter.Header;
+import com.facebook.sonar.plugins.network.NetworkReporter.ResponseInfo;
+import java.util.ArrayList;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.Executor;
+import java.util.concurrent.RejectedExecutionException;
+import java.util.concurrent.ThreadPoolExecutor;
+import java.util.concurrent.TimeUnit;
+import javax.annotation.Nullable;
+
+/**
+ * Runs {@link NetworkResponseFormatter}s on a small pool of background threads, and only for
+ * the responses the desktop asks for. Responses that a formatter wants are kept, up to a total
+ * size, until the desktop asks for them to be formatted or they are evicted by newer ones.
+ */
+final class ResponseFormatterPipeline {
+
+  interface Callback {
+    void onFormatted(String json);
+
+    void onFailed(String reason);
+  }
+
+  private static final int MAX_PENDING_BYTES = 8 * 1024 * 1024;
+  private static final int MAX_QUEUED_JOBS = 16;
+
+  private final List<NetworkResponseFormatter> mFormatters = new ArrayList<>();
+  // Formatters by the content type prefix they're registered for, asked before mFormatters.
+  private final Map<String, List<NetworkResponseFormatter>> mContentTypeFormatters =
+      new LinkedHashMap<>();
+  // Oldest first, so that eviction drops the responses least likely to be opened.
+  private final LinkedHashMap<String, Pending> mPending = new LinkedHashMap<>();
+  private int mPendingBytes;
+  private final Executor mExecutor;
+
+  private static final class Pending {
+    final ResponseInfo response;
+    final NetworkResponseFormatter formatter;
+    final int size;
+
+    Pending(ResponseInfo response, NetworkResponseFormatter formatter, int size) {
+      this.response = response;
+      this.formatter = formatter;
+      this.size = size;
+    }
+  }
+
+  ResponseFormatterPipeline(@Nullable List<NetworkResponseFormatter> formatters) {
+    if (formatters != null) {
+      mFormatters.addAll(formatters);
+    }
+    final ThreadPoolExecutor executor =
+        new ThreadPoolExecutor(
+            2,
+            2,
+            30,
+            TimeUnit.SECONDS,
+            new ArrayBlockingQueue<Runnable>(MAX_QUEUED_JOBS),
+            new ThreadPoolExecutor.AbortPolicy());
+    executor.allowCoreThreadTimeOut(true);
+    mExecutor = executor;
+  }
+
+  synchronized void addFormatter(String contentType, NetworkResponseFormatter formatter) {
+    List<NetworkResponseFormatter> formatters = mContentTypeFormatters.get(contentType);
+    if (formatters == null) {
+      formatters = new ArrayList<>();
+      mContentTypeFormatters.put(contentType, formatters);
+    }
+    formatters.add(formatter);
+  }
+
+  synchronized boolean isEmpty() {
+    return mFormatters.isEmpty() && mContentTypeFormatters.isEmpty();
+  }
+
+  /**
+   * Keeps response for formatting later if a formatter wants it, in which case it returns true.
+   * Only asks formatters whether they want it, which is expected to be cheap.
+   */
+  synchronized boolean offer(ResponseInfo response) {
+    final NetworkResponseFormatter formatter = route(response);
+    if (formatter == null) {
+      return false;
+    }
+    final int size =
+        response.bodyBuffer != null
+            ? response.bodyBuffer.remaining()
+            : response.body != null ? response.body.length : 0;
+    if (size > MAX_PENDING_BYTES) {
+      return false;
+    }
+    final Pending previous = mPending.remove(response.requestId);
+    if (previous != null) {
+      mPendingBytes -= previous.size;
+    }
+    mPending.put(response.requestId, new Pending(response, formatter, size));
+    mPendingBytes += size;
+    final Iterator<Pending> oldest = mPending.values().iterator();
+    while (mPendingBytes > MAX_PENDING_BYTES && oldest.hasNext()) {
+      mPendingBytes -= oldest.next().size;
+      oldest.remove();
+    }
+    return true;
+  }
+
+  /** Formats the kept response with the given id on the pool, and forgets it. */
+  void format(String requestId, final Callback callback) {
+    final Pending pending;
+    synchronized (this) {
+      pending = mPending.remove(requestId);
+      if (pending != null) {
+        mPendingBytes -= pending.size;
+      }
+    }
+    if (pending == null) {
+      callback.onFailed("Response is no longer available for formatting");
+      return;
+    }
+    try {
+      mExecutor.execute(
+          new Runnable() {
+            @Override
+            public void run() {
+              final ResponseInfo response = pending.response;
+              // Formatters work on the body's bytes.
+              if (response.bodyBuffer != null) {
+                response.body = new byte[response.bodyBuffer.remaining()];
+                response.bodyBuffer.duplicate().get(response.body);
+                response.bodyBuffer = null;
+              }
+              try {
+                pending.formatter.format(
+                    response,
+                    new NetworkResponseFormatter.OnCompletionListener() {
+                      @Override
+                      public void onCompletion(String json) {
+                        callback.onFormatted(json);
+                      }
+                    });
+              } catch (RuntimeException e) {
+                callback.onFailed(e.toString());
+              }
+            }
+          });
+    } catch (RejectedExecutionException e) {
+      // Kept so that the desktop can ask again.
+      synchronized (this) {
+        mPending.put(requestId, pending);
+        mPendingBytes += pending.size;
+      }
+      callback.onFailed("Too many responses are being formatted");
+    }
+  }
+
+  private @Nullable NetworkResponseFormatter route(ResponseInfo response) {
+    final Header contentType = response.getFirstHeader("content-type");
+    if (contentType != null) {
+      for (Map.Entry<String, List<NetworkResponseFormatter>> entry :
+          mContentTypeFormatters.entrySet()) {
+        if (contentType.value.startsWith(entry.getKey())) {
+          final NetworkResponseFormatter formatter = firstWanting(entry.getValue(), response);
+          if (formatter != null) {
+            return formatter;
+          }
+        }
+      }
+    }
+    return firstWanting(mFormatters, response);
+  }
+
+  private static @Nullable NetworkResponseFormatter firstWanting(
+      List<NetworkResponseFormatter> formatters, ResponseInfo response) {
+    for (NetworkResponseFormatter formatter : formatters) {
+      if (formatter.shouldFormat(response)) {
+        return formatter;
+      }
+    }
+    return null;
+  }
+}
@@ -7,53 +7,222 @@
  */
 package com.facebook.sonar.plugins.network;
 
-import android.util.Log;
 import com.facebook.sonar.plugins.network.NetworkReporter.RequestInfo;
 import com.facebook.sonar.plugins.network.NetworkReporter.ResponseInfo;
 import java.io.IOException;
+import java.io.OutputStream;
+import java.nio.ByteBuffer;
 import java.util.ArrayList;
 import java.util.List;
-import java.util.Random;
 import java.util.Set;
 import java.util.UUID;
+import java.util.concurrent.Executor;
+import java.util.concurrent.Executors;
+import java.util.concurrent.atomic.AtomicBoolean;
 import javax.annotation.Nullable;
 import okhttp3.Headers;
+import okhttp3.HttpUrl;
 import okhttp3.Interceptor;
+import okhttp3.MediaType;
 import okhttp3.Request;
 import okhttp3.Response;
 import okhttp3.ResponseBody;
 import okio.Buffer;
+import okio.BufferedSource;
+import okio.ForwardingSource;
+import okio.Okio;
+import okio.Source;
 
 public class SonarOkhttpInterceptor implements Interceptor {
 
+  /** Bodies larger than this are reported without their data. */
+  public static final int DEFAULT_MAX_BODY_BYTES = 1024 * 1024;
+
+  private static final int INITIAL_BODY_BYTES = 16 * 1024;
+
+  // Reporting builds and serializes the response, which is kept off the threads that read bodies.
+  private static final Executor sReportExecutor = Executors.newSingleThreadExecutor();
+
   public @Nullable NetworkSonarPlugin plugin;
+  private final int mMaxBodyBytes;
 
   public SonarOkhttpInterceptor() {
     this.plugin = null;
+    this.mMaxBodyBytes = DEFAULT_MAX_BODY_BYTES;
   }
 
   public SonarOkhttpInterceptor(NetworkSonarPlugin plugin) {
+    this(plugin, DEFAULT_MAX_BODY_BYTES);
+  }
+
+  public SonarOkhttpInterceptor(NetworkSonarPlugin plugin, int maxBodyBytes) {
     this.plugin = plugin;
+    this.mMaxBodyBytes = maxBodyBytes;
   }
 
   @Override
   public Response intercept(Interceptor.Chain chain) throws IOException {
     Request request = chain.request();
+    // Requests the desktop filters out are passed on untouched, without converting or copying.
+    final NetworkCaptureFilter filter = plugin.getCaptureFilter();
+    final HttpUrl url = request.url();
+    if (!filter.acceptsRequest(request.method(), url.host(), url.encodedPath())) {
+      return chain.proceed(request);
+    }
+    final int maxBodyBytes = (int) Math.min(mMaxBodyBytes, filter.getMaxBodyBytes());
     String identifier = UUID.randomUUID().toString();
-    plugin.reportRequest(convertRequest(request, identifier));
+    plugin.reportRequest(convertRequest(request, identifier, maxBodyBytes));
     Response response = chain.proceed(request);
+    if (!filter.acceptsResponse(response.code(), response.header("Content-Type"))) {
+      plugin.reportDropped(identifier);
+      return response;
+    }
     ResponseBody body = response.body();
-    ResponseInfo responseInfo = convertResponse(response, body, identifier);
-    plugin.reportResponse(responseInfo);
-    // Creating new response as can't used response.body() more than once
-    if (responseInfo.body != null) {
-      return response
-          .newBuilder()
-          .body(ResponseBody.create(body.contentType(), responseInfo.body))
-          .build();
-    } else {
+    ResponseInfo responseInfo = convertResponse(response, identifier);
+    if (body == null) {
+      report(responseInfo);
       return response;
     }
+    // The app gets the body as it arrives, instead of after all of it was read for Sonar. Sonar
+    // gets a copy of what the app read, once the app is done with it.
+    return response
+        .newBuilder()
+        .body(new TeeResponseBody(body, responseInfo, maxBodyBytes))
+        .build();
+  }
+
+  private void report(final ResponseInfo responseInfo) {
+    final NetworkSonarPlugin plugin = this.plugin;
+    sReportExecutor.execute(
+        new Runnable() {
+          @Override
+          public void run() {
+            plugin.reportResponse(responseInfo);
+          }
+        });
+  }
+
+  /** Passes the body through, keeping a copy of up to mMaxBodyBytes of it in a direct buffer. */
+  private final class TeeResponseBody extends ResponseBody {
+    private final ResponseBody mBody;
+    private final ResponseInfo mResponseInfo;
+    private final AtomicBoolean mReported = new AtomicBoolean();
+    private final BufferedSource mSource;
+    private final int mMaxBodyBytes;
+    private @Nullable ByteBuffer mCopy;
+    private boolean mOverflowed;
+    // Lets okio copy its segments straight into mCopy.
+    private final OutputStream mCopyStream =
+        new OutputStream() {
+          @Override
+          public void write(int b) {
+            mCopy.put((byte) b);
+          }
+
+          @Override
+          public void write(byte[] b, int off, int len) {
+            mCopy.put(b, off, len);
+          }
+        };
+
+    TeeResponseBody(ResponseBody body, ResponseInfo responseInfo, int maxBodyBytes) {
+      mBody = body;
+      mResponseInfo = responseInfo;
+      mMaxBodyBytes = maxBodyBytes;
+      final long length = body.contentLength();
+      if (length > mMaxBodyBytes) {
+        mOverflowed = true;
+      } else {
+        mCopy = ByteBuffer.allocateDirect(length >= 0 ? (int) length : INITIAL_BODY_BYTES);
+      }
+      mSource = Okio.buffer(new TeeSource(body.source()));
+    }
+
+    @Override
+    public @Nullable MediaType contentType() {
+      return mBody.contentType();
+    }
+
+    @Override
+    public long contentLength() {
+      return mBody.contentLength();
+    }
+
+    @Override
+    public BufferedSource source() {
+      return mSource;
+    }
+
+    private final class TeeSource extends ForwardingSource {
+      TeeSource(Source delegate) {
+        super(delegate);
+      }
+
+      @Override
+      public long read(Buffer sink, long byteCount) throws IOException {
+        final long read;
+        try {
+          read = super.read(sink, byteCount);
+        } catch (IOException e) {
+          mOverflowed = true;
+          finish();
+          throw e;
+        }
+        if (read < 0) {
+          finish();
+        } else if (read > 0) {
+          copy(sink, sink.size() - read, read);
+        }
+        return read;
+      }
+
+      @Override
+      public void close() throws IOException {
+        super.close();
+        // Not reading the body to the end leaves Sonar with part of it.
+        finish();
+      }
+    }
+
+    private void copy(Buffer sink, long offset, long byteCount) throws IOException {
+      if (mOverflowed) {
+        return;
+      }
+      if (mCopy.remaining() < byteCount) {
+        final long needed = mCopy.position() + byteCount;
+        if (needed > mMaxBodyBytes) {
+          mOverflowed = true;
+          mCopy = null;
+          return;
+        }
+        final long capacity = Math.min(mMaxBodyBytes, Math.max(needed, 2L * mCopy.capacity()));
+        final ByteBuffer grown = ByteBuffer.allocateDirect((int) capacity);
+        mCopy.flip();
+        grown.put(mCopy);
+        mCopy = grown;
+      }
+      sink.copyTo(mCopyStream, offset, byteCount);
+    }
+
+    private void finish() {
+      if (!mReported.compareAndSet(false, true)) {
+        return;
+      }
+      if (!mOverflowed && mCopy != null) {
+        mCopy.flip();
+        mResponseInfo.bodyBuffer = mCopy;
+      }
+      mCopy = null;
+      report(mResponseInfo);
+    }
+  }
+
+  private static long contentLength(final Request request) {
+    try {
+      return request.body().contentLength();
+    } catch (final IOException e) {
+      return -1;
+    }
   }
 
   private static byte[] bodyToByteArray(final Request request) {
@@ -68,7 +237,7 @@ public class SonarOkhttpInterceptor implements Interceptor {
     }
   }
 
-  private RequestInfo convertRequest(Request request, String identifier) {
+  private RequestInfo convertRequest(Request request, String identifier, int maxBodyBytes) {
     List<NetworkReporter.Header> headers = convertHeader(request.headers());
     RequestInfo info = new RequestInfo();
     info.requestId = identifier;
@@ -76,14 +245,14 @@ public class SonarOkhttpInterceptor implements Interceptor {
     info.headers = headers;
     info.method = request.method();
     info.uri = request.url().toString();
-    if (request.body() != null) {
+    if (request.body() != null && contentLength(request) <= maxBodyBytes) {
       info.body = bodyToByteArray(request);
     }
 
     return info;
   }
 
-  private ResponseInfo convertResponse(Response response, ResponseBody body, String identifier) {
+  private ResponseInfo convertResponse(Response response, String identifier) {
 
     List<NetworkReporter.Header> headers = convertHeader(response.headers());
     ResponseInfo info = new ResponseInfo();
@@ -91,11 +260,6 @@ public class SonarOkhttpInterceptor implements Interceptor {
     info.timeStamp = response.receivedResponseAtMillis();
     info.statusCode = response.code();
     info.headers = headers;
-    try {
-      info.body = body.bytes();
-    } catch (IOException e) {
-      Log.e("Sonar", e.toString());
-    }
     return info;
   }
 
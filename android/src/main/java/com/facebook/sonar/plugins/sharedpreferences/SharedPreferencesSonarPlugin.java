@@ -12,33 +12,70 @@ import static android.content.Context.MODE_PRIVATE;
 
 import android.content.Context;
 import android.content.SharedPreferences;
+import android.view.Choreographer;
+import com.facebook.sonar.core.SonarArray;
 import com.facebook.sonar.core.SonarConnection;
 import com.facebook.sonar.core.SonarObject;
 import com.facebook.sonar.core.SonarPlugin;
 import com.facebook.sonar.core.SonarReceiver;
 import com.facebook.sonar.core.SonarResponder;
+import java.util.HashMap;
+import java.util.LinkedHashMap;
 import java.util.Map;
+import java.util.Set;
 
+/**
+ * Keeps its own copy of the preferences, which is read in full once and then kept up to date one
+ * key at a time, rather than copying the whole file with {@link SharedPreferences#getAll()} on
+ * every change. Changes made within a frame are sent as one batch, and every batch bumps a
+ * version the desktop can pass back to only be sent what changed since. Responses to
+ * getSharedPreferences are cached by the connection until the snapshot next changes.
+ */
 public class SharedPreferencesSonarPlugin implements SonarPlugin {
 
+  private static final String CACHE_VERSION = "preferences";
+
   private SonarConnection mConnection;
   private final SharedPreferences mSharedPreferences;
+
+  // Guards everything below. Changes come in on the main thread, requests on the connection's.
+  private final Object mLock = new Object();
+  // Null until the first time it is needed.
+  private Map<String, Object> mSnapshot;
+  private long mVersion;
+  // The version each key, including deleted ones, last changed in.
+  private final Map<String, Long> mChangedIn = new HashMap<>();
+  // Keys changed since the last batch, with when they first changed.
+  private final Map<String, Long> mPending = new LinkedHashMap<>();
+  private boolean mFlushPosted;
+
+  private final Choreographer.FrameCallback mFlush =
+      new Choreographer.FrameCallback() {
+        @Override
+        public void doFrame(long frameTimeNanos) {
+          flush();
+        }
+      };
+
   private final SharedPreferences.OnSharedPreferenceChangeListener
       onSharedPreferenceChangeListener =
           new SharedPreferences.OnSharedPreferenceChangeListener() {
             @Override
             public void onSharedPreferenceChanged(SharedPreferences sharedPreferences, String key) {
-              if (mConnection == null) {
-                return;
+              synchronized (mLock) {
+                // Nobody has seen the preferences yet, so there is nothing to keep up to date.
+                if (mSnapshot == null && mConnection == null) {
+                  return;
+                }
+                if (!mPending.containsKey(key)) {
+                  mPending.put(key, System.currentTimeMillis());
+                }
+                if (mFlushPosted) {
+                  return;
+                }
+                mFlushPosted = true;
               }
-              mConnection.send(
-                  "sharedPreferencesChange",
-                  new SonarObject.Builder()
-                      .put("name", key)
-                      .put("deleted", !mSharedPreferences.contains(key))
-                      .put("time", System.currentTimeMillis())
-                      .put("value", mSharedPreferences.getAll().get(key))
-                      .build());
+              Choreographer.getInstance().postFrameCallback(mFlush);
             }
           };
 
@@ -80,28 +117,156 @@ public class SharedPreferencesSonarPlugin implements SonarPlugin {
     return "Preferences";
   }
 
-  private SonarObject getSharedPreferencesObject() {
-    final SonarObject.Builder builder = new SonarObject.Builder();
-    final Map<String, ?> map = mSharedPreferences.getAll();
+  private Map<String, Object> snapshot() {
+    if (mSnapshot == null) {
+      mSnapshot = new HashMap<>(mSharedPreferences.getAll());
+    }
+    return mSnapshot;
+  }
 
-    for (Map.Entry<String, ?> entry : map.entrySet()) {
-      final Object val = entry.getValue();
-      builder.put(entry.getKey(), val);
+  /**
+   * SharedPreferences can only look a single key up through a typed getter, so this tries the
+   * type the key had last first, and the others once that one doesn't match.
+   */
+  private Object readValue(String key, Object previous) {
+    if (previous != null) {
+      try {
+        return readAs(previous.getClass(), key);
+      } catch (ClassCastException e) {
+        // The key was written with another type, try them all.
+      }
+    }
+    for (Class<?> type : VALUE_TYPES) {
+      try {
+        return readAs(type, key);
+      } catch (ClassCastException e) {
+        // Not this one.
+      }
     }
+    return mSharedPreferences.getAll().get(key);
+  }
+
+  private static final Class<?>[] VALUE_TYPES = {
+    String.class, Boolean.class, Integer.class, Long.class, Float.class, Set.class
+  };
 
-    return builder.build();
+  private Object readAs(Class<?> type, String key) {
+    if (type == Boolean.class) {
+      return mSharedPreferences.getBoolean(key, false);
+    } else if (type == Integer.class) {
+      return mSharedPreferences.getInt(key, 0);
+    } else if (type == Long.class) {
+      return mSharedPreferences.getLong(key, 0);
+    } else if (type == Float.class) {
+      return mSharedPreferences.getFloat(key, 0);
+    } else if (type == String.class) {
+      return mSharedPreferences.getString(key, null);
+    } else if (Set.class.isAssignableFrom(type)) {
+      return mSharedPreferences.getStringSet(key, null);
+    }
+    throw new ClassCastException(type.getName());
+  }
+
+  /** Applies the pending changes to the snapshot, and sends them as one batch. */
+  private void flush() {
+    final SonarConnection connection;
+    final SonarArray.Builder changes = new SonarArray.Builder();
+    final long version;
+    synchronized (mLock) {
+      mFlushPosted = false;
+      if (mPending.isEmpty()) {
+        return;
+      }
+      final Map<String, Object> snapshot = snapshot();
+      version = ++mVersion;
+      for (Map.Entry<String, Long> change : mPending.entrySet()) {
+        final String key = change.getKey();
+        final boolean deleted = !mSharedPreferences.contains(key);
+        final Object value = deleted ? null : readValue(key, snapshot.get(key));
+        if (deleted) {
+          snapshot.remove(key);
+        } else {
+          snapshot.put(key, value);
+        }
+        mChangedIn.put(key, version);
+        changes.put(
+            new SonarObject.Builder()
+                .put("name", key)
+                .put("deleted", deleted)
+                .put("time", change.getValue())
+                .put("value", value));
+      }
+      mPending.clear();
+      connection = mConnection;
+    }
+    if (connection != null) {
+      connection.invalidateResponses(CACHE_VERSION);
+      connection.send(
+          "sharedPreferencesChanges",
+          new SonarObject.Builder().put("version", version).put("changes", changes).build());
+    }
+  }
+
+  /**
+   * Without since, the whole file as a flat object, as older desktops expect it. With since, only
+   * the entries changed after that version, along with the keys deleted since and the current
+   * version. A version this plugin doesn't know, from before the app restarted for instance, gets
+   * every entry with full set so that the desktop starts over.
+   */
+  private SonarObject getSharedPreferencesObject(SonarObject params) {
+    synchronized (mLock) {
+      final Map<String, Object> snapshot = snapshot();
+      if (params == null || !params.contains("since")) {
+        final SonarObject.Builder builder = new SonarObject.Builder();
+        for (Map.Entry<String, Object> entry : snapshot.entrySet()) {
+          builder.put(entry.getKey(), entry.getValue());
+        }
+        return builder.build();
+      }
+
+      final long since = params.getLong("since");
+      final boolean full = since <= 0 || since > mVersion;
+      final SonarObject.Builder entries = new SonarObject.Builder();
+      final SonarArray.Builder deleted = new SonarArray.Builder();
+      if (full) {
+        for (Map.Entry<String, Object> entry : snapshot.entrySet()) {
+          entries.put(entry.getKey(), entry.getValue());
+        }
+      } else {
+        for (Map.Entry<String, Long> change : mChangedIn.entrySet()) {
+          if (change.getValue() <= since) {
+            continue;
+          }
+          final String key = change.getKey();
+          if (snapshot.containsKey(key)) {
+            entries.put(key, snapshot.get(key));
+          } else {
+            deleted.put(key);
+          }
+        }
+      }
+      return new SonarObject.Builder()
+          .put("version", mVersion)
+          .put("full", full)
+          .put("entries", entries)
+          .put("deleted", deleted)
+          .build();
+    }
   }
 
   @Override
-  public void onConnect(SonarConnection connection) {
-    mConnection = connection;
+  public void onConnect(final SonarConnection connection) {
+    synchronized (mLock) {
+      mConnection = connection;
+    }
 
+    connection.cacheResponses("getSharedPreferences", CACHE_VERSION);
     connection.receive(
         "getSharedPreferences",
         new SonarReceiver() {
           @Override
           public void onReceive(SonarObject params, SonarResponder responder) {
-            responder.success(getSharedPreferencesObject());
+            responder.success(getSharedPreferencesObject(params));
           }
         });
 
@@ -113,7 +278,10 @@ public class SharedPreferencesSonarPlugin implements SonarPlugin {
               throws IllegalArgumentException {
 
             String preferenceName = params.getString("preferenceName");
-            Object originalValue = mSharedPreferences.getAll().get(preferenceName);
+            final Object originalValue;
+            synchronized (mLock) {
+              originalValue = snapshot().get(preferenceName);
+            }
             SharedPreferences.Editor editor = mSharedPreferences.edit();
 
             if (originalValue instanceof Boolean) {
@@ -130,15 +298,23 @@ public class SharedPreferencesSonarPlugin implements SonarPlugin {
               throw new IllegalArgumentException("Type not supported: " + preferenceName);
             }
 
-            editor.apply();
+            // commit rather than apply, so that the change is in the snapshot by the time the
+            // response is built.
+            editor.commit();
+            synchronized (mLock) {
+              snapshot().put(preferenceName, readValue(preferenceName, originalValue));
+            }
+            connection.invalidateResponses(CACHE_VERSION);
 
-            responder.success(getSharedPreferencesObject());
+            responder.success(getSharedPreferencesObject(params));
           }
         });
   }
 
   @Override
   public void onDisconnect() {
-    mConnection = null;
+    synchronized (mLock) {
+      mConnection = null;
+    }
   }
 }
@@ -11,6 +11,7 @@ import com.facebook.sonar.core.SonarArray;
 import com.facebook.sonar.core.SonarConnection;
 import com.facebook.sonar.core.SonarObject;
 import com.facebook.sonar.core.SonarReceiver;
+import java.nio.ByteBuffer;
 import java.util.ArrayList;
 import java.util.HashMap;
 import java.util.List;
@@ -46,9 +47,29 @@ public class SonarConnectionMock implements SonarConnection {
     paramList.add(params);
   }
 
+  @Override
+  public boolean sendBytes(String method, SonarObject metadata, ByteBuffer data) {
+    final List<Object> paramList;
+    if (sent.containsKey(method)) {
+      paramList = sent.get(method);
+    } else {
+      paramList = new ArrayList<>();
+      sent.put(method, paramList);
+    }
+
+    paramList.add(data);
+    return true;
+  }
+
   @Override
   public void reportError(Throwable throwable) {}
 
+  @Override
+  public void cacheResponses(String method, String version) {}
+
+  @Override
+  public void invalidateResponses(String version) {}
+
   @Override
   public void receive(String method, SonarReceiver receiver) {
     receivers.put(method, receiver);
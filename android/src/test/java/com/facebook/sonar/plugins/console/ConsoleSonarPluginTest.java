@@ -9,7 +9,10 @@ package com.facebook.sonar.plugins.console;
 
 import static org.hamcrest.CoreMatchers.hasItem;
 import static org.hamcrest.MatcherAssert.assertThat;
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertNotNull;
 
+import com.facebook.sonar.core.SonarArray;
 import com.facebook.sonar.core.SonarObject;
 import com.facebook.sonar.testing.SonarConnectionMock;
 import com.facebook.sonar.testing.SonarResponderMock;
@@ -42,6 +45,27 @@ public class ConsoleSonarPluginTest {
         hasItem(new SonarObject.Builder().put("value", 4).put("type", "json").build()));
   }
 
+  @Test
+  public void commandsShouldEvaluateInOneResponse() throws Exception {
+    SonarObject params =
+        new SonarObject.Builder()
+            .put(
+                "commands",
+                new SonarArray.Builder()
+                    .put(new SonarObject.Builder().put("command", "var x = 2; x"))
+                    .put(new SonarObject.Builder().put("command", "x + 2"))
+                    .put(new SonarObject.Builder().put("command", "y.z")))
+            .build();
+    connection.receivers.get("executeCommands").onReceive(params, responder);
+
+    SonarArray results = ((SonarObject) responder.successes.get(0)).getArray("results");
+    assertEquals(3, results.length());
+    assertEquals(
+        new SonarObject.Builder().put("value", 4).put("type", "json").build(),
+        results.getObject(1).getObject("success"));
+    assertNotNull(results.getObject(2).getObject("error"));
+  }
+
   private void receiveScript(String a) throws Exception {
     SonarObject getValue = new SonarObject.Builder().put("command", a).build();
     connection.receivers.get("executeCommand").onReceive(getValue, responder);
@@ -40,6 +40,16 @@ public class JavascriptSessionTest {
     assertEquals(10, json.getInt("value"));
   }
 
+  @Test
+  public void testRepeatedCommandsSeeCurrentState() throws Exception {
+    JavascriptSession session =
+        new JavascriptSession(mContextFactory, Collections.<String, Object>emptyMap());
+    session.evaluateCommand("var x = 0;");
+    session.evaluateCommand("x += 1");
+    JSONObject json = session.evaluateCommand("x += 1");
+    assertEquals(2, json.getInt("value"));
+  }
+
   @Test
   public void testVariablesGetBoundCorrectly() throws Exception {
     JavascriptSession session =
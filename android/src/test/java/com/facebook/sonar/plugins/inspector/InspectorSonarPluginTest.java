@@ -9,6 +9,7 @@ package com.facebook.sonar.plugins.inspector;
 
 import static org.hamcrest.CoreMatchers.equalTo;
 import static org.hamcrest.CoreMatchers.hasItem;
+import static org.hamcrest.CoreMatchers.nullValue;
 import static org.hamcrest.MatcherAssert.assertThat;
 
 import android.app.Application;
@@ -101,6 +102,7 @@ public class InspectorSonarPluginTest {
                 .put("name", "com.facebook.sonar")
                 .put("data", new SonarObject.Builder())
                 .put("children", new SonarArray.Builder().put("test"))
+                .put("childCount", 1)
                 .put("attributes", new SonarArray.Builder())
                 .put("decoration", (String) null)
                 .put("extraInfo", new SonarObject.Builder())
@@ -138,12 +140,120 @@ public class InspectorSonarPluginTest {
                                 .put("name", "test")
                                 .put("data", new SonarObject.Builder())
                                 .put("children", new SonarArray.Builder())
+                                .put("childCount", 0)
                                 .put("attributes", new SonarArray.Builder())
                                 .put("decoration", (String) null)
                                 .put("extraInfo", new SonarObject.Builder())))
                 .build()));
   }
 
+  @Test
+  public void testGetNodesPrefetchesTheNextLevel() throws Exception {
+    final InspectorSonarPlugin plugin =
+        new InspectorSonarPlugin(mApp, mDescriptorMapping, mScriptingEnvironment, null);
+    plugin.setPrefetchPolicy(1, 10);
+    final SonarResponderMock responder = new SonarResponderMock();
+    final SonarConnectionMock connection = new SonarConnectionMock();
+    plugin.onConnect(connection);
+
+    final TestNode root = new TestNode();
+    root.id = "test";
+    root.name = "test";
+    final TestNode child = new TestNode();
+    child.id = "child";
+    child.name = "child";
+    final TestNode grandchild = new TestNode();
+    grandchild.id = "grandchild";
+    grandchild.name = "grandchild";
+    child.children.add(grandchild);
+    root.children.add(child);
+    mApplicationDescriptor.root = root;
+
+    plugin.mGetRoot.onReceive(null, responder);
+    plugin.mGetNodes.onReceive(
+        new SonarObject.Builder().put("ids", new SonarArray.Builder().put("test")).build(),
+        responder);
+
+    // Only one level down, so the grandchild is only tracked, as the child's child.
+    assertThat(
+        connection.sent.get("prefetchedNodes"),
+        hasItem(
+            new SonarObject.Builder()
+                .put(
+                    "elements",
+                    new SonarArray.Builder()
+                        .put(
+                            new SonarObject.Builder()
+                                .put("id", "child")
+                                .put("name", "child")
+                                .put("data", new SonarObject.Builder())
+                                .put("children", new SonarArray.Builder().put("grandchild"))
+                                .put("childCount", 1)
+                                .put("attributes", new SonarArray.Builder())
+                                .put("decoration", (String) null)
+                                .put("extraInfo", new SonarObject.Builder())))
+                .build()));
+  }
+
+  @Test
+  public void testGetNodesWithChildrenRange() throws Exception {
+    final InspectorSonarPlugin plugin =
+        new InspectorSonarPlugin(mApp, mDescriptorMapping, mScriptingEnvironment, null);
+    final SonarResponderMock responder = new SonarResponderMock();
+    final SonarConnectionMock connection = new SonarConnectionMock();
+    plugin.onConnect(connection);
+
+    final TestNode root = new TestNode();
+    root.id = "test";
+    root.name = "test";
+    for (int i = 0; i < 4; i++) {
+      final TestNode child = new TestNode();
+      child.id = "child" + i;
+      child.name = "child";
+      root.children.add(child);
+    }
+    mApplicationDescriptor.root = root;
+
+    plugin.mGetRoot.onReceive(null, responder);
+    plugin.mGetNodes.onReceive(
+        new SonarObject.Builder()
+            .put("ids", new SonarArray.Builder().put("test"))
+            .put("childrenRange", new SonarObject.Builder().put("offset", 1).put("limit", 2))
+            .build(),
+        responder);
+
+    assertThat(
+        responder.successes,
+        hasItem(
+            new SonarObject.Builder()
+                .put(
+                    "elements",
+                    new SonarArray.Builder()
+                        .put(
+                            new SonarObject.Builder()
+                                .put("id", "test")
+                                .put("name", "test")
+                                .put("data", new SonarObject.Builder())
+                                .put("children", new SonarArray.Builder().put("child1").put("child2"))
+                                .put("childCount", 4)
+                                .put("attributes", new SonarArray.Builder())
+                                .put("decoration", (String) null)
+                                .put("extraInfo", new SonarObject.Builder())))
+                .build()));
+
+    // Children outside of the range aren't tracked.
+    plugin.mGetNodes.onReceive(
+        new SonarObject.Builder().put("ids", new SonarArray.Builder().put("child0")).build(),
+        responder);
+    assertThat(
+        responder.errors,
+        hasItem(
+            new SonarObject.Builder()
+                .put("message", "No node with given id")
+                .put("id", "child0")
+                .build()));
+  }
+
   @Test
   public void testGetNodesThatDontExist() throws Exception {
     final InspectorSonarPlugin plugin =
@@ -170,6 +280,35 @@ public class InspectorSonarPluginTest {
                 .build()));
   }
 
+  @Test
+  public void testGetSnapshotsListsNodesThatArentViews() throws Exception {
+    final InspectorSonarPlugin plugin =
+        new InspectorSonarPlugin(mApp, mDescriptorMapping, mScriptingEnvironment, null);
+    final SonarResponderMock responder = new SonarResponderMock();
+    final SonarConnectionMock connection = new SonarConnectionMock();
+    plugin.onConnect(connection);
+
+    final TestNode root = new TestNode();
+    root.id = "test";
+    mApplicationDescriptor.root = root;
+
+    plugin.mGetRoot.onReceive(null, responder);
+    plugin.mGetSnapshots.onReceive(
+        new SonarObject.Builder()
+            .put("ids", new SonarArray.Builder().put("test").put("notest"))
+            .build(),
+        responder);
+
+    assertThat(
+        responder.successes,
+        hasItem(
+            new SonarObject.Builder()
+                .put("snapshots", new SonarArray.Builder())
+                .put("missing", new SonarArray.Builder().put("test").put("notest"))
+                .build()));
+    assertThat(connection.sent.get("snapshot"), nullValue());
+  }
+
   @Test
   public void testSetData() throws Exception {
     final InspectorSonarPlugin plugin =
@@ -206,6 +345,47 @@ public class InspectorSonarPluginTest {
                 .build()));
   }
 
+  @Test
+  public void testSetDataMany() throws Exception {
+    final InspectorSonarPlugin plugin =
+        new InspectorSonarPlugin(mApp, mDescriptorMapping, mScriptingEnvironment, null);
+    final SonarConnectionMock connection = new SonarConnectionMock();
+    final SonarResponderMock responder = new SonarResponderMock();
+    plugin.onConnect(connection);
+
+    final TestNode root = new TestNode();
+    root.id = "test";
+    root.data = new SonarObject.Builder().put("prop", "value").build();
+
+    mApplicationDescriptor.root = root;
+
+    plugin.mGetRoot.onReceive(null, responder);
+    plugin.mSetDataMany.onReceive(
+        new SonarObject.Builder()
+            .put(
+                "edits",
+                new SonarArray.Builder()
+                    .put(
+                        new SonarObject.Builder()
+                            .put("id", "test")
+                            .put("path", new SonarArray.Builder().put("data"))
+                            .put("value", new SonarObject.Builder().put("prop", "first")))
+                    .put(
+                        new SonarObject.Builder()
+                            .put("id", "test")
+                            .put("path", new SonarArray.Builder().put("data"))
+                            .put("value", new SonarObject.Builder().put("prop", "second"))))
+            .build(),
+        responder);
+
+    assertThat(root.data.getString("prop"), equalTo("second"));
+    // The node comes back with the response, once, rather than as invalidate messages.
+    assertThat(connection.sent.get("invalidate"), nullValue());
+    final SonarArray elements = ((SonarObject) responder.successes.get(1)).getArray("elements");
+    assertThat(elements.length(), equalTo(1));
+    assertThat(elements.getObject(0).getString("id"), equalTo("test"));
+  }
+
   @Test
   public void testSetHighlighted() throws Exception {
     final InspectorSonarPlugin plugin =
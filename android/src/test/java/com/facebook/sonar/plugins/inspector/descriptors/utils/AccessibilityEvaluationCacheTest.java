@@ -0,0 +1,54 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.plugins.inspector.descriptors.utils;
+
+import static org.hamcrest.CoreMatchers.equalTo;
+import static org.hamcrest.CoreMatchers.nullValue;
+import static org.hamcrest.MatcherAssert.assertThat;
+
+import android.view.View;
+import android.view.ViewGroup;
+import android.widget.FrameLayout;
+import com.facebook.testing.robolectric.v3.WithTestDefaultsRunner;
+import org.junit.After;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+import org.robolectric.RuntimeEnvironment;
+
+@RunWith(WithTestDefaultsRunner.class)
+public class AccessibilityEvaluationCacheTest {
+
+  @After
+  public void tearDown() {
+    AccessibilityEvaluationCache.end();
+  }
+
+  @Test
+  public void testInvalidationDropsAncestorsAndDescendants() {
+    final ViewGroup root = new FrameLayout(RuntimeEnvironment.application);
+    final ViewGroup parent = new FrameLayout(RuntimeEnvironment.application);
+    final View child = new View(RuntimeEnvironment.application);
+    final View sibling = new View(RuntimeEnvironment.application);
+    root.addView(parent);
+    root.addView(sibling);
+    parent.addView(child);
+
+    assertThat(AccessibilityEvaluationCache.entry(child), nullValue());
+
+    AccessibilityEvaluationCache.begin();
+    for (View view : new View[] {root, parent, child, sibling}) {
+      AccessibilityEvaluationCache.entry(view).speaking = true;
+    }
+    AccessibilityEvaluationCache.invalidate(parent);
+
+    assertThat(AccessibilityEvaluationCache.entry(root).speaking, nullValue());
+    assertThat(AccessibilityEvaluationCache.entry(parent).speaking, nullValue());
+    assertThat(AccessibilityEvaluationCache.entry(child).speaking, nullValue());
+    assertThat(AccessibilityEvaluationCache.entry(sibling).speaking, equalTo(true));
+  }
+}
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+package com.facebook.sonar.plugins.network;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertTrue;
+
+import com.facebook.sonar.core.SonarArray;
+import com.facebook.sonar.core.SonarObject;
+import com.facebook.testing.robolectric.v3.WithTestDefaultsRunner;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+@RunWith(WithTestDefaultsRunner.class)
+public class NetworkCaptureFilterTest {
+
+  @Test
+  public void emptyFilterCapturesEverything() throws Exception {
+    final NetworkCaptureFilter filter =
+        NetworkCaptureFilter.fromSonarObject(new SonarObject.Builder().build());
+    assertTrue(filter.acceptsRequest("DELETE", "https://example.com/anything"));
+    assertTrue(filter.acceptsResponse(500, null));
+    assertEquals(Long.MAX_VALUE, filter.getMaxBodyBytes());
+  }
+
+  @Test
+  public void requestsAreMatchedOnHostPathAndMethod() throws Exception {
+    final NetworkCaptureFilter filter =
+        NetworkCaptureFilter.fromSonarObject(
+            new SonarObject.Builder()
+                .put("host", "Example.com")
+                .put("pathPrefix", "/api")
+                .put("methods", new SonarArray.Builder().put("get").put("POST"))
+                .build());
+    assertTrue(filter.acceptsRequest("GET", "https://example.com/api/feed"));
+    assertTrue(filter.acceptsRequest("post", "https://graph.example.com/api"));
+    assertFalse(filter.acceptsRequest("PUT", "https://example.com/api/feed"));
+    assertFalse(filter.acceptsRequest("GET", "https://notexample.com/api/feed"));
+    assertFalse(filter.acceptsRequest("GET", "https://example.com/static/api"));
+  }
+
+  @Test
+  public void responsesAreMatchedOnStatusAndContentType() throws Exception {
+    final NetworkCaptureFilter filter =
+        NetworkCaptureFilter.fromSonarObject(
+            new SonarObject.Builder()
+                .put("minStatus", 400)
+                .put("maxStatus", 499)
+                .put("contentType", "application/json")
+                .put("maxBodyBytes", 1024)
+                .build());
+    assertTrue(filter.acceptsResponse(404, "application/json; charset=utf-8"));
+    assertFalse(filter.acceptsResponse(200, "application/json"));
+    assertFalse(filter.acceptsResponse(404, "text/html"));
+    assertFalse(filter.acceptsResponse(404, null));
+    assertEquals(1024, filter.getMaxBodyBytes());
+  }
+}
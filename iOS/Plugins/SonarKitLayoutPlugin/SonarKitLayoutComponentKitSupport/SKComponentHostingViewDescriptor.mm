@@ -23,7 +23,7 @@
 @implementation SKComponentHostingViewDescriptor
 
 - (NSString *)identifierForNode:(CKComponentHostingView *)node {
-  return [NSString stringWithFormat: @"%p", node];
+  return SKObjectIdentifier(node);
 }
 
 - (NSUInteger)childCountForNode:(CKComponentHostingView *)node {
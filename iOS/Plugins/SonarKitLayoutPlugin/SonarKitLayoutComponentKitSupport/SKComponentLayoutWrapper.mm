@@ -14,6 +14,7 @@
 #import <ComponentKit/CKComponentDataSourceAttachController.h>
 #import <ComponentKit/CKComponentDataSourceAttachControllerInternal.h>
 #import <ComponentKit/CKInspectableView.h>
+#import <SonarKitLayoutPlugin/SKNodeDescriptor.h>
 
 static char const kLayoutWrapperKey = ' ';
 
@@ -38,24 +39,60 @@ static CKFlexboxComponentChild findFlexboxLayoutParams(CKComponent *parent, CKCo
 }
 
 @implementation SKComponentLayoutWrapper
+{
+  // What the wrapper was built from, to tell whether it can be reused.
+  std::shared_ptr<const std::vector<CKComponentLayoutChild>> _layoutChildren;
+  NSString *_parentKey;
+  int _index;
+}
 
 + (instancetype)newFromRoot:(id<CKInspectableView>)root {
   const CKComponentLayout layout = [root mountedLayout];
-  SKComponentLayoutWrapper *const wrapper =
-  [[SKComponentLayoutWrapper alloc] initWithLayout:layout
-                                          position:CGPointMake(0, 0)
-                                         parentKey:[NSString stringWithFormat: @"%p.", layout.component]];
+  return [self wrapperForLayout:layout
+                       position:CGPointMake(0, 0)
+                      parentKey:[SKObjectIdentifier(layout.component) stringByAppendingString:@"."]
+                          index:-1];
+}
+
+// Wrappers are cached on their component. Layouts are immutable, so a
+// component laid out with the same children vector as when it was last
+// wrapped has the same subtree, and its wrapper can be reused as it is when
+// relayout only touched other parts of the hierarchy.
++ (instancetype)wrapperForLayout:(const CKComponentLayout &)layout position:(CGPoint)position parentKey:(NSString *)parentKey index:(int)index {
+  SKComponentLayoutWrapper *cached = layout.component ? objc_getAssociatedObject(layout.component, &kLayoutWrapperKey) : nil;
+  if (cached != nil &&
+      cached->_layoutChildren == layout.children &&
+      CGSizeEqualToSize(cached->_size, layout.size) &&
+      CGPointEqualToPoint(cached->_position, position) &&
+      cached->_index == index &&
+      [cached->_parentKey isEqualToString:parentKey]) {
+    return cached;
+  }
+
+  SKComponentLayoutWrapper *const wrapper = [[SKComponentLayoutWrapper alloc] initWithLayout:layout
+                                                                                    position:position
+                                                                                   parentKey:parentKey
+                                                                                       index:index];
   if (layout.component)
     objc_setAssociatedObject(layout.component, &kLayoutWrapperKey, wrapper, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
   return wrapper;
 }
 
-- (instancetype)initWithLayout:(const CKComponentLayout &)layout position:(CGPoint)position parentKey:(NSString *)parentKey {
+// A child's identifier is its parent's, its index and its class, e.g.
+// "0x7f9e1c0.CKFlexboxComponent[0].CKLabelComponent". It's built with a single
+// allocation per layout, as there is one for every component in the tree.
+- (instancetype)initWithLayout:(const CKComponentLayout &)layout position:(CGPoint)position parentKey:(NSString *)parentKey index:(int)index {
   if (self = [super init]) {
     _component = layout.component;
     _size = layout.size;
     _position = position;
-    _identifier = [parentKey stringByAppendingString:layout.component ? NSStringFromClass([layout.component class]) : @"(null)"];
+    _layoutChildren = layout.children;
+    _parentKey = parentKey;
+    _index = index;
+    const char *className = layout.component ? class_getName([layout.component class]) : "(null)";
+    _identifier = index < 0
+      ? [[NSString alloc] initWithFormat:@"%@%s", parentKey, className]
+      : [[NSString alloc] initWithFormat:@"%@[%d].%s", parentKey, index, className];
 
     if (layout.children != nullptr) {
       int index = 0;
@@ -63,9 +100,10 @@ static CKFlexboxComponentChild findFlexboxLayoutParams(CKComponent *parent, CKCo
         if (child.layout.component == nil) {
           continue; // nil children are allowed, ignore them
         }
-        SKComponentLayoutWrapper *childWrapper = [[SKComponentLayoutWrapper alloc] initWithLayout:child.layout
-                                                                                         position:child.position
-                                                                                        parentKey:[_identifier stringByAppendingFormat:@"[%d].", index++]];
+        SKComponentLayoutWrapper *childWrapper = [SKComponentLayoutWrapper wrapperForLayout:child.layout
+                                                                                   position:child.position
+                                                                                  parentKey:_identifier
+                                                                                      index:index++];
         childWrapper->_isFlexboxChild = [_component isKindOfClass:[CKFlexboxComponent class]];
         childWrapper->_flexboxChild = findFlexboxLayoutParams(_component, child.layout.component);
         _children.push_back(childWrapper);
@@ -23,7 +23,7 @@
 @implementation SKComponentRootViewDescriptor
 
 - (NSString *)identifierForNode:(CKComponentRootView *)node {
-  return [NSString stringWithFormat: @"%p", node];
+  return SKObjectIdentifier(node);
 }
 
 - (NSUInteger)childCountForNode:(CKComponentRootView *)node {
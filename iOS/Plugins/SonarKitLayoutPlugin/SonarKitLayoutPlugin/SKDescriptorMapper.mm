@@ -9,6 +9,8 @@
 
 #import "SKDescriptorMapper.h"
 
+#import <unordered_map>
+
 #import "SKApplicationDescriptor.h"
 #import "SKButtonDescriptor.h"
 #import "SKScrollViewDescriptor.h"
@@ -18,6 +20,10 @@
 @implementation SKDescriptorMapper
 {
   NSMutableDictionary<NSString *, SKNodeDescriptor *> *_descriptors;
+  // What descriptorForClass: resolved each class to, misses included, so
+  // that repeated lookups don't walk the class hierarchy again. Cleared
+  // whenever a descriptor is registered.
+  std::unordered_map<Class, SKNodeDescriptor *> _resolvedDescriptors;
 }
 
 - (instancetype)initWithDefaults {
@@ -40,19 +46,24 @@
 }
 
 - (SKNodeDescriptor *)descriptorForClass:(Class)cls {
-  SKNodeDescriptor *classDescriptor = nil;
+  const auto resolved = _resolvedDescriptors.find(cls);
+  if (resolved != _resolvedDescriptors.end()) {
+    return resolved->second;
+  }
 
-  while (classDescriptor == nil && cls != nil) {
-    classDescriptor = [_descriptors objectForKey: NSStringFromClass(cls)];
-    cls = [cls superclass];
+  SKNodeDescriptor *classDescriptor = nil;
+  for (Class current = cls; classDescriptor == nil && current != nil; current = [current superclass]) {
+    classDescriptor = [_descriptors objectForKey: NSStringFromClass(current)];
   }
 
+  _resolvedDescriptors[cls] = classDescriptor;
   return classDescriptor;
 }
 
 - (void)registerDescriptor:(SKNodeDescriptor *)descriptor forClass:(Class)cls {
   NSString *className = NSStringFromClass(cls);
   _descriptors[className] = descriptor;
+  _resolvedDescriptors.clear();
 }
 
 - (NSArray<SKNodeDescriptor *> *)allDescriptors {
@@ -37,7 +37,10 @@
   [CATransaction setValue:(id)kCFBooleanTrue
                    forKey:kCATransactionDisableActions];
   _overlayLayer.frame = frame;
-  [view.layer addSublayer: _overlayLayer];
+  // The one layer moves between views, it is only added when it has to.
+  if (_overlayLayer.superlayer != view.layer) {
+    [view.layer addSublayer: _overlayLayer];
+  }
   [CATransaction commit];
 }
 
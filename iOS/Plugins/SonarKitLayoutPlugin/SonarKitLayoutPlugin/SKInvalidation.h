@@ -15,12 +15,33 @@
 
 @end
 
+/**
+ Whether the swizzled methods report invalidations. Checked by every call to a
+ swizzled method, so it is a plain flag rather than a property.
+ */
+FOUNDATION_EXTERN BOOL _SKInvalidationsEnabled;
+
+static inline BOOL SKInvalidationsEnabled(void) {
+  return __atomic_load_n(&_SKInvalidationsEnabled, __ATOMIC_RELAXED);
+}
+
 @interface SKInvalidation : NSObject
 
 + (instancetype)sharedInstance;
 
+/**
+ Installs the swizzles the first time, and has them report invalidations to
+ the delegate until disableInvalidations.
+ */
 + (void)enableInvalidations;
 
+/**
+ Has the swizzles call straight through to the original methods. Swizzles
+ can't be safely removed once installed, so they stay, at the cost of a
+ message send and a load of the flag per call.
+ */
++ (void)disableInvalidations;
+
 @property (nonatomic, weak) id<SKInvalidationDelegate> delegate;
 
 @end
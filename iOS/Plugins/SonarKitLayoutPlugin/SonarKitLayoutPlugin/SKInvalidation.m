@@ -13,6 +13,8 @@
 #import "UIView+SKInvalidation.h"
 #import "UICollectionView+SKInvalidation.h"
 
+BOOL _SKInvalidationsEnabled = NO;
+
 @implementation SKInvalidation
 
 + (instancetype)sharedInstance {
@@ -42,13 +44,24 @@
             name:UIWindowDidBecomeHiddenNotification
           object:nil];
   });
+  __atomic_store_n(&_SKInvalidationsEnabled, YES, __ATOMIC_RELAXED);
+}
+
++ (void)disableInvalidations {
+  __atomic_store_n(&_SKInvalidationsEnabled, NO, __ATOMIC_RELAXED);
 }
 
 + (void)windowDidBecomeVisible:(NSNotification*)notification {
+  if (!SKInvalidationsEnabled()) {
+    return;
+  }
   [[SKInvalidation sharedInstance].delegate invalidateNode:[notification.object nextResponder]];
 }
 
 + (void)windowDidBecomeHidden:(NSNotification*)notification {
+  if (!SKInvalidationsEnabled()) {
+    return;
+  }
   [[SKInvalidation sharedInstance].delegate invalidateNode:[notification.object nextResponder]];
 }
 
@@ -12,6 +12,15 @@
 #import "SKTouch.h"
 
 typedef void (^SKNodeUpdateData)(id value);
+typedef void (^SKNodeMutation)(id node, id value);
+
+/**
+ The object's address, formatted the way [NSString stringWithFormat:@"%p"]
+ would, but without parsing a format string. Identifiers are created for
+ every node the plugin sends, so descriptors which identify nodes by address
+ should use this.
+ */
+FOUNDATION_EXTERN NSString *SKObjectIdentifier(id object);
 
 /**
  A SKNodeDescriptor is an object which know how to expose an Object of type T
@@ -60,6 +69,13 @@ typedef void (^SKNodeUpdateData)(id value);
  */
 - (id)childForNode:(T)node atIndex:(NSUInteger)index;
 
+/**
+  All the children of a node, in order. The default asks childForNode:atIndex:
+  for each of them; descriptors that work out all children at once should
+  override this so that walking a node's children doesn't redo that per child.
+ */
+- (NSArray *)childrenForNode:(T)node;
+
 /**
  Get the data to show for this node in the sidebar of the Sonar application. The objects
  will be shown in order by SKNamed.name as their header.
@@ -74,12 +90,26 @@ typedef void (^SKNodeUpdateData)(id value);
 
 /**
  A mapping of the path for a specific value, and a block responsible for updating
- its corresponding value for a specific node.
+ its corresponding value for the node it is passed. Asked for once per descriptor,
+ so that editing a value doesn't build blocks for all the others; descriptors should
+ implement this rather than dataMutationsForNode:.
 
  The paths (string) is dependent on what `dataForNode` returns (e.g "SKNodeDescriptor.name").
  */
++ (NSDictionary<NSString *, SKNodeMutation> *)dataMutations;
+
+/**
+ Same as dataMutations, with blocks bound to a specific node. Only asked for paths
+ dataMutations doesn't have.
+ */
 - (NSDictionary<NSString *, SKNodeUpdateData> *)dataMutationsForNode:(T)node;
 
+/**
+ Updates the value at path for node, through dataMutations or dataMutationsForNode:.
+ Returns NO if there is no mutation for that path.
+ */
+- (BOOL)setData:(id)value forPath:(NSString *)path ofNode:(T)node;
+
 /**
  This is used in order to highlight any specific node which is currently
  selected in the Sonar application. The plugin automatically takes care of de-selecting
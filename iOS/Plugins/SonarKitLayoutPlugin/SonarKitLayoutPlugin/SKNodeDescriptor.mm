@@ -9,9 +9,25 @@
 
 #import "SKNodeDescriptor.h"
 
+NSString *SKObjectIdentifier(id object) {
+  char buffer[2 + sizeof(uintptr_t) * 2];
+  uintptr_t address = (uintptr_t)(__bridge void *)object;
+  size_t start = sizeof(buffer);
+  do {
+    buffer[--start] = "0123456789abcdef"[address & 0xf];
+    address >>= 4;
+  } while (address != 0);
+  buffer[--start] = 'x';
+  buffer[--start] = '0';
+  return [[NSString alloc] initWithBytes: buffer + start
+                                  length: sizeof(buffer) - start
+                                encoding: NSASCIIStringEncoding];
+}
+
 @implementation SKNodeDescriptor
 {
   SKDescriptorMapper *_mapper;
+  NSDictionary<NSString *, SKNodeMutation> *_dataMutations;
 }
 
 - (void)setUp {
@@ -44,10 +60,43 @@
   @throw [NSString stringWithFormat:@"need to implement %@", NSStringFromSelector(_cmd)];
 }
 
+- (NSArray *)childrenForNode:(id)node {
+  const NSUInteger count = [self childCountForNode: node];
+  NSMutableArray *children = [NSMutableArray arrayWithCapacity: count];
+  for (NSUInteger i = 0; i < count; i++) {
+    id child = [self childForNode: node atIndex: i];
+    if (child) {
+      [children addObject: child];
+    }
+  }
+  return children;
+}
+
++ (NSDictionary<NSString *, SKNodeMutation> *)dataMutations {
+  return @{};
+}
+
 - (NSDictionary<NSString *, SKNodeUpdateData> *)dataMutationsForNode:(id)node {
   return @{};
 }
 
+- (BOOL)setData:(id)value forPath:(NSString *)path ofNode:(id)node {
+  if (!_dataMutations) {
+    _dataMutations = [[self class] dataMutations];
+  }
+  SKNodeMutation mutation = _dataMutations[path];
+  if (mutation != nil) {
+    mutation(node, value);
+    return YES;
+  }
+  SKNodeUpdateData updateData = [self dataMutationsForNode: node][path];
+  if (updateData != nil) {
+    updateData(value);
+    return YES;
+  }
+  return NO;
+}
+
 - (NSArray<SKNamed<NSDictionary *> *> *)dataForNode:(id)node {
   return @[];
 }
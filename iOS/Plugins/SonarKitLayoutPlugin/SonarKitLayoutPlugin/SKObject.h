@@ -15,13 +15,30 @@
 
 @end
 
+/**
+ While one of these is alive, rects, sizes, points and insets are encoded
+ packed, as {__type__: "rect", __mutable__, value: [x, y, width, height]} and
+ so on, with each number in fixed-point hundredths of a point, instead of as
+ nested dictionaries of floats. That's what desktops that ask for
+ compactValues get. Only used on the main thread, where nodes are described.
+ */
+class SKCompactValuesScope {
+public:
+  SKCompactValuesScope(BOOL enabled);
+  ~SKCompactValuesScope();
+private:
+  BOOL _previous;
+};
+
 class SKObject {
 public:
-  SKObject(CGRect rect);
-  SKObject(CGSize size);
-  SKObject(CGPoint point);
-  SKObject(UIEdgeInsets insets);
+  SKObject(CGRect rect) : SKObject(rect, NO) { };
+  SKObject(CGSize size) : SKObject(size, NO) { };
+  SKObject(CGPoint point) : SKObject(point, NO) { };
+  SKObject(UIEdgeInsets insets) : SKObject(insets, NO) { };
   SKObject(CGAffineTransform transform);
+  // Encoded like UIColor, as a 32 bit ARGB color, without creating one.
+  SKObject(CGColorRef color) : SKObject(color, NO) { };
   SKObject(id<SKSonarValueCoder> value);
   SKObject(id value);
 
@@ -29,15 +46,25 @@ public:
     return _actual ?: [NSNull null];
   }
 protected:
+  SKObject(CGRect rect, BOOL isMutable);
+  SKObject(CGSize size, BOOL isMutable);
+  SKObject(CGPoint point, BOOL isMutable);
+  SKObject(UIEdgeInsets insets, BOOL isMutable);
+  SKObject(CGColorRef color, BOOL isMutable);
+
   id<NSObject> _actual;
+  // Typed values are built with their mutability already, so they don't
+  // need converting.
+  BOOL _typed = NO;
 };
 
 class SKMutableObject : public SKObject {
 public:
-  SKMutableObject(CGRect rect) : SKObject(rect) { }
-  SKMutableObject(CGSize size) : SKObject(size) { };
-  SKMutableObject(CGPoint point) : SKObject(point) { };
-  SKMutableObject(UIEdgeInsets insets) : SKObject(insets) { };
+  SKMutableObject(CGRect rect) : SKObject(rect, YES) { _convertedToMutable = _typed; };
+  SKMutableObject(CGSize size) : SKObject(size, YES) { _convertedToMutable = _typed; };
+  SKMutableObject(CGPoint point) : SKObject(point, YES) { _convertedToMutable = _typed; };
+  SKMutableObject(UIEdgeInsets insets) : SKObject(insets, YES) { _convertedToMutable = _typed; };
+  SKMutableObject(CGColorRef color) : SKObject(color, YES) { _convertedToMutable = _typed; };
   SKMutableObject(CGAffineTransform transform) : SKObject(transform) { };
   SKMutableObject(id<SKSonarValueCoder> value) : SKObject(value) { };
   SKMutableObject(id value) : SKObject(value) { };
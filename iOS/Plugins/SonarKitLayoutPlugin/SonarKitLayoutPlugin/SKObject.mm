@@ -9,34 +9,105 @@
 
 #import "SKObject.h"
 
-SKObject::SKObject(CGRect rect) {
-  _actual = @{
-              @"origin": SKObject(rect.origin),
-              @"size": SKObject(rect.size)
-              };
+#import <initializer_list>
+
+#import "UIColor+SKSonarValueCoder.h"
+
+// What a packed number is a multiple of, in points.
+static const double kFixedPointScale = 100;
+
+static BOOL _compactValues = NO;
+
+SKCompactValuesScope::SKCompactValuesScope(BOOL enabled) : _previous(_compactValues) {
+  _compactValues = enabled;
 }
 
-SKObject::SKObject(CGSize size) {
-  _actual = @{
-              @"height": @(size.height),
-              @"width": @(size.width)
-              };
+SKCompactValuesScope::~SKCompactValuesScope() {
+  _compactValues = _previous;
 }
 
-SKObject::SKObject(CGPoint point) {
-  _actual = @{
-              @"x": @(point.x),
-              @"y": @(point.y)
-              };
+// Numbers this small are tagged pointers, so unlike the fractional floats
+// they replace, packing them doesn't allocate. Returns nil outside of a
+// SKCompactValuesScope, or if a number doesn't fit, like CGFLOAT_MAX, in which
+// case the value is encoded as it always was.
+static NSDictionary *_SKPacked(NSString *type, std::initializer_list<CGFloat> numbers, BOOL isMutable) {
+  if (!_compactValues) {
+    return nil;
+  }
+  NSNumber *packed[4];
+  NSUInteger count = 0;
+  for (CGFloat number : numbers) {
+    const double scaled = round(number * kFixedPointScale);
+    // Also false for NaN.
+    if (!(fabs(scaled) <= INT32_MAX) || count == 4) {
+      return nil;
+    }
+    packed[count++] = @((int32_t)scaled);
+  }
+  return @{
+           @"__type__": type,
+           @"__mutable__": @(isMutable),
+           @"value": [NSArray arrayWithObjects: packed count: count],
+           };
+}
+
+SKObject::SKObject(CGRect rect, BOOL isMutable) {
+  _actual = _SKPacked(@"rect", {rect.origin.x, rect.origin.y, rect.size.width, rect.size.height}, isMutable);
+  _typed = _actual != nil;
+  if (!_typed) {
+    _actual = @{
+                @"origin": SKObject(rect.origin),
+                @"size": SKObject(rect.size)
+                };
+  }
 }
 
-SKObject::SKObject(UIEdgeInsets insets) {
+SKObject::SKObject(CGSize size, BOOL isMutable) {
+  _actual = _SKPacked(@"size", {size.width, size.height}, isMutable);
+  _typed = _actual != nil;
+  if (!_typed) {
+    _actual = @{
+                @"height": @(size.height),
+                @"width": @(size.width)
+                };
+  }
+}
+
+SKObject::SKObject(CGPoint point, BOOL isMutable) {
+  _actual = _SKPacked(@"point", {point.x, point.y}, isMutable);
+  _typed = _actual != nil;
+  if (!_typed) {
+    _actual = @{
+                @"x": @(point.x),
+                @"y": @(point.y)
+                };
+  }
+}
+
+SKObject::SKObject(UIEdgeInsets insets, BOOL isMutable) {
+  _actual = _SKPacked(@"insets", {insets.top, insets.left, insets.bottom, insets.right}, isMutable);
+  _typed = _actual != nil;
+  if (!_typed) {
+    _actual = @{
+                @"top": @(insets.top),
+                @"bottom": @(insets.bottom),
+                @"left": @(insets.left),
+                @"right": @(insets.right),
+                };
+  }
+}
+
+SKObject::SKObject(CGColorRef color, BOOL isMutable) {
+  // Without a color, encoded like a nil UIColor.
+  if (color == NULL) {
+    return;
+  }
   _actual = @{
-              @"top": @(insets.top),
-              @"bottom": @(insets.bottom),
-              @"left": @(insets.left),
-              @"right": @(insets.right),
+              @"__type__": @"color",
+              @"__mutable__": @(isMutable),
+              @"value": @(SKColorARGB(color)),
               };
+  _typed = YES;
 }
 
 SKObject::SKObject(CGAffineTransform transform) {
@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#import <Foundation/Foundation.h>
+
+#import "SKDescriptorMapper.h"
+
+/**
+ An immutable copy of a SKSearchIndex, which can be searched on any thread.
+ */
+@interface SKSearchIndexSnapshot : NSObject
+
+@property (nonatomic, copy, readonly) NSString *rootId;
+
+/**
+ Ids of the nodes whose name or identifier contains the query, ignoring case,
+ in tree order. Skips the first offset matches and returns at most limit of
+ them. total is set to the number of matches in the whole tree.
+ */
+- (NSArray<NSString *> *)nodesMatchingQuery:(NSString *)query
+                                     offset:(NSUInteger)offset
+                                      limit:(NSUInteger)limit
+                                      total:(NSUInteger *)total;
+
+- (NSString *)parentOfNode:(NSString *)nodeId;
+
+- (NSArray<NSString *> *)childrenOfNode:(NSString *)nodeId;
+
+@end
+
+/**
+ Names and structure of the layout hierarchy, so that searching it doesn't
+ walk every node on the main thread. It's built on first use and after that
+ only re-indexes the subtrees of nodes that have been invalidated.
+ */
+@interface SKSearchIndex : NSObject
+
+- (instancetype)initWithDescriptorMapper:(SKDescriptorMapper *)mapper
+                             trackObject:(NSString *(^)(id object))trackObject
+                              lookUpNode:(id (^)(NSString *nodeId))lookUpNode;
+
+/**
+ Marks a node's subtree as out of date. Can be called from any thread.
+ */
+- (void)invalidateNodeWithId:(NSString *)nodeId;
+
+/**
+ Brings the index up to date with the hierarchy under rootNode and returns a
+ snapshot of it. Must be called on the main thread.
+ */
+- (SKSearchIndexSnapshot *)snapshotFromRootNode:(id)rootNode;
+
+@end
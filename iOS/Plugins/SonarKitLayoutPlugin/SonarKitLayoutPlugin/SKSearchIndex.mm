@@ -0,0 +1,206 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#if FB_SONARKIT_ENABLED
+
+#import "SKSearchIndex.h"
+
+#import <mutex>
+
+#import "SKNodeDescriptor.h"
+
+// Not every change to the hierarchy is invalidated, so the index is rebuilt
+// from scratch once it gets this old rather than drifting forever.
+static const NSTimeInterval kSearchIndexMaxAge = 10;
+
+@interface SKSearchIndexEntry : NSObject
+{
+@public
+  NSString *_name;
+  NSString *_parentId;
+  NSArray<NSString *> *_children;
+}
+@end
+
+@implementation SKSearchIndexEntry
+@end
+
+@implementation SKSearchIndexSnapshot
+{
+  NSDictionary<NSString *, SKSearchIndexEntry *> *_entries;
+}
+
+- (instancetype)initWithEntries:(NSDictionary<NSString *, SKSearchIndexEntry *> *)entries rootId:(NSString *)rootId {
+  if (self = [super init]) {
+    _entries = entries;
+    _rootId = [rootId copy];
+  }
+  return self;
+}
+
+- (NSArray<NSString *> *)nodesMatchingQuery:(NSString *)query
+                                     offset:(NSUInteger)offset
+                                      limit:(NSUInteger)limit
+                                      total:(NSUInteger *)total {
+  NSMutableArray<NSString *> *matches = [NSMutableArray new];
+  NSUInteger count = 0;
+
+  NSMutableArray<NSString *> *stack = [NSMutableArray new];
+  if (_rootId) {
+    [stack addObject: _rootId];
+  }
+  while (stack.count > 0) {
+    NSString *nodeId = stack.lastObject;
+    [stack removeLastObject];
+    SKSearchIndexEntry *entry = _entries[nodeId];
+    if (entry == nil) {
+      continue;
+    }
+
+    if ((entry->_name && [entry->_name rangeOfString: query options: NSCaseInsensitiveSearch].location != NSNotFound) ||
+        [nodeId rangeOfString: query options: NSCaseInsensitiveSearch].location != NSNotFound) {
+      if (count >= offset && matches.count < limit) {
+        [matches addObject: nodeId];
+      }
+      count++;
+    }
+
+    for (NSString *child in [entry->_children reverseObjectEnumerator]) {
+      [stack addObject: child];
+    }
+  }
+
+  if (total) {
+    *total = count;
+  }
+  return matches;
+}
+
+- (NSString *)parentOfNode:(NSString *)nodeId {
+  SKSearchIndexEntry *entry = _entries[nodeId];
+  return entry ? entry->_parentId : nil;
+}
+
+- (NSArray<NSString *> *)childrenOfNode:(NSString *)nodeId {
+  SKSearchIndexEntry *entry = _entries[nodeId];
+  return entry ? entry->_children : nil;
+}
+
+@end
+
+@implementation SKSearchIndex
+{
+  SKDescriptorMapper *_mapper;
+  NSString *(^_trackObject)(id object);
+  id (^_lookUpNode)(NSString *nodeId);
+
+  NSMutableDictionary<NSString *, SKSearchIndexEntry *> *_entries;
+  NSString *_rootId;
+  NSDate *_builtAt;
+  SKSearchIndexSnapshot *_snapshot;
+
+  std::mutex _invalidatedMutex;
+  NSMutableSet<NSString *> *_invalidated;
+}
+
+- (instancetype)initWithDescriptorMapper:(SKDescriptorMapper *)mapper
+                             trackObject:(NSString *(^)(id object))trackObject
+                              lookUpNode:(id (^)(NSString *nodeId))lookUpNode {
+  if (self = [super init]) {
+    _mapper = mapper;
+    _trackObject = [trackObject copy];
+    _lookUpNode = [lookUpNode copy];
+    _entries = [NSMutableDictionary new];
+    _invalidated = [NSMutableSet new];
+  }
+  return self;
+}
+
+- (void)invalidateNodeWithId:(NSString *)nodeId {
+  std::lock_guard<std::mutex> lock(_invalidatedMutex);
+  [_invalidated addObject: nodeId];
+}
+
+- (SKSearchIndexSnapshot *)snapshotFromRootNode:(id)rootNode {
+  NSSet<NSString *> *invalidated;
+  {
+    std::lock_guard<std::mutex> lock(_invalidatedMutex);
+    invalidated = _invalidated;
+    _invalidated = [NSMutableSet new];
+  }
+
+  NSString *rootId = _trackObject(rootNode);
+  if (_rootId == nil || ![_rootId isEqual: rootId] || -[_builtAt timeIntervalSinceNow] > kSearchIndexMaxAge) {
+    [_entries removeAllObjects];
+    [self indexNode: rootNode withParent: nil];
+    _rootId = rootId;
+    _builtAt = [NSDate date];
+    _snapshot = nil;
+  } else {
+    for (NSString *nodeId in invalidated) {
+      // Nodes which aren't indexed are either new, in which case their parent
+      // was invalidated too, or have already gone with an invalidated ancestor.
+      SKSearchIndexEntry *entry = _entries[nodeId];
+      if (entry == nil) {
+        continue;
+      }
+      NSString *parentId = entry->_parentId;
+      [self removeSubtree: nodeId];
+      id node = _lookUpNode(nodeId);
+      if (node != nil) {
+        [self indexNode: node withParent: parentId];
+      }
+      _snapshot = nil;
+    }
+  }
+
+  if (_snapshot == nil) {
+    _snapshot = [[SKSearchIndexSnapshot alloc] initWithEntries: [_entries copy] rootId: _rootId];
+  }
+  return _snapshot;
+}
+
+- (NSString *)indexNode:(id)node withParent:(NSString *)parentId {
+  SKNodeDescriptor *descriptor = [_mapper descriptorForClass: [node class]];
+  if (node == nil || descriptor == nil) {
+    return nil;
+  }
+  NSString *nodeId = _trackObject(node);
+  if (nodeId == nil) {
+    return nil;
+  }
+
+  NSMutableArray<NSString *> *children = [NSMutableArray new];
+  for (id child in [descriptor childrenForNode: node]) {
+    NSString *childId = [self indexNode: child withParent: nodeId];
+    if (childId) {
+      [children addObject: childId];
+    }
+  }
+
+  SKSearchIndexEntry *entry = [SKSearchIndexEntry new];
+  entry->_name = [descriptor nameForNode: node];
+  entry->_parentId = parentId;
+  entry->_children = children;
+  _entries[nodeId] = entry;
+  return nodeId;
+}
+
+- (void)removeSubtree:(NSString *)nodeId {
+  SKSearchIndexEntry *entry = _entries[nodeId];
+  if (entry == nil) {
+    return;
+  }
+  [_entries removeObjectForKey: nodeId];
+  for (NSString *child in entry->_children) {
+    [self removeSubtree: child];
+  }
+}
+
+@end
+
+#endif
@@ -19,6 +19,12 @@
   id<NSObject> _currentNode;
 
   SKDescriptorMapper *_descriptorMapper;
+
+  // Descriptors continue into a child from within hitTest:forNode:, which
+  // would recurse once per level. Instead that call only moves the touch to
+  // the child, and the outermost one hit tests each node in turn.
+  BOOL _descending;
+  BOOL _hasNextNode;
 }
 
 - (instancetype)initWithTouchPoint:(CGPoint)touchPoint
@@ -46,7 +52,18 @@
   descriptor = [_descriptorMapper descriptorForClass: [_currentNode class]];
   [_path addObject: [descriptor identifierForNode: _currentNode]];
 
-  [descriptor hitTest: self forNode: _currentNode];
+  if (_descending) {
+    _hasNextNode = YES;
+    return;
+  }
+
+  _descending = YES;
+  do {
+    _hasNextNode = NO;
+    [descriptor hitTest: self forNode: _currentNode];
+    descriptor = [_descriptorMapper descriptorForClass: [_currentNode class]];
+  } while (_hasNextNode);
+  _descending = NO;
 }
 
 - (void)finish {
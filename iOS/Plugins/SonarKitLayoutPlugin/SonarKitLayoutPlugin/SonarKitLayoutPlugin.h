@@ -26,6 +26,18 @@
 
 @property (nonatomic, readonly, strong) SKDescriptorMapper *descriptorMapper;
 
+/**
+How many levels below the nodes of a getNodes call to capture along with them, in the same pass on the main thread, and send
+in a prefetchedNodes message after the reply, so that expanding them on the desktop doesn't take another round trip. 0, the
+default, prefetches nothing.
+*/
+@property (nonatomic, assign) NSUInteger prefetchLevels;
+
+/**
+The most nodes a getNodes call prefetches, 500 unless set.
+*/
+@property (nonatomic, assign) NSUInteger prefetchMaxNodes;
+
 @end
 
 #endif
@@ -13,22 +13,126 @@
 #import <SonarKit/SonarConnection.h>
 #import <SonarKit/SonarResponder.h>
 #import <SonarKit/SKMacros.h>
+#import <QuartzCore/QuartzCore.h>
 #import "SKDescriptorMapper.h"
 #import "SKNodeDescriptor.h"
+#import "SKObject.h"
 #import "SKTapListener.h"
 #import "SKTapListenerImpl.h"
+#import "SKSearchIndex.h"
 #import "SKSearchResultNode.h"
-#import <mutex>
+#import "utils/SKContentHash.h"
+#import "utils/SKSnapshot.h"
+
+static const NSUInteger kDefaultSearchResultsLimit = 100;
+
+// How long getNodes may keep the main thread busy before letting the app
+// render a frame, so that inspecting a large hierarchy doesn't drop frames.
+static const CFTimeInterval kMainThreadBudget = 0.004;
+
+// Invalidations are reported at most once a frame, and no more often than
+// this, so that scrolling doesn't keep the desktop refetching.
+static const CFTimeInterval kMinInvalidateInterval = 0.25;
+
+// The longest side of a node image, in pixels, unless getSnapshots asks for
+// another, and how many bytes of encoded images are kept.
+static const CGFloat kDefaultSnapshotSize = 256;
+static const NSUInteger kSnapshotCacheBytes = 4 * 1024 * 1024;
+
+// The counter the connection's cached getRoot responses depend on.
+static NSString *const kTreeCacheVersion = @"tree";
+
+static NSString *const kHashedSections[] = {@"attributes", @"data", @"children"};
+
+// The window of children getNodes sends for each node, from its optional
+// childrenRange param of the form {offset, limit}. Without one all children
+// are sent, which for a list with thousands of cells means tracking and
+// serializing every one of them.
+static NSRange SKChildrenRange(id params) {
+  if (![params isKindOfClass: [NSDictionary class]]) {
+    return NSMakeRange(0, NSUIntegerMax);
+  }
+  const NSUInteger offset = [params[@"offset"] unsignedIntegerValue];
+  const NSUInteger limit = params[@"limit"] ? [params[@"limit"] unsignedIntegerValue] : NSUIntegerMax - offset;
+  return NSMakeRange(offset, MIN(limit, NSUIntegerMax - offset));
+}
+
+// Every node is sent with a hash of its attributes, data and children. The
+// desktop sends the hashes of the copy it already has when refetching a node,
+// and sections whose hash hasn't changed are left out of the reply. Only
+// touches the captured node, so it can run on any thread.
+static NSDictionary *SKDiffNode(NSDictionary *node, NSDictionary<NSString *, NSString *> *knownHashes) {
+  if (![knownHashes isKindOfClass: [NSDictionary class]]) {
+    knownHashes = nil;
+  }
+  NSMutableDictionary *diffed = [node mutableCopy];
+  NSMutableDictionary<NSString *, NSString *> *hashes = [NSMutableDictionary new];
+  for (NSString *section : kHashedSections) {
+    id value = node[section];
+    if (value == nil) {
+      continue;
+    }
+    NSString *hash = SKContentHashString(SKContentHash(value));
+    hashes[section] = hash;
+    if ([hash isEqual: knownHashes[section]]) {
+      [diffed removeObjectForKey: section];
+    }
+  }
+  diffed[@"hashes"] = hashes;
+  return diffed;
+}
+
+// CADisplayLink retains its target, so the plugin is only referenced through a
+// block that holds it weakly.
+@interface SKDisplayLinkTarget : NSObject
+- (instancetype)initWithBlock:(void (^)(void))block;
+- (void)displayLinkDidFire:(CADisplayLink *)displayLink;
+@end
+
+@implementation SKDisplayLinkTarget
+{
+  void (^_block)(void);
+}
+
+- (instancetype)initWithBlock:(void (^)(void))block {
+  if (self = [super init]) {
+    _block = [block copy];
+  }
+  return self;
+}
+
+- (void)displayLinkDidFire:(CADisplayLink *)displayLink {
+  _block();
+}
+
+@end
+
+// An encoded image of a node, kept until the node or one of its descendants is
+// invalidated.
+@interface SKNodeSnapshot : NSObject
+@property (nonatomic, strong) NSData *data;
+@property (nonatomic, copy) NSString *contentHash;
+@property (nonatomic, assign) CGSize size;
+@property (nonatomic, assign) CGFloat maxSize;
+@end
+
+@implementation SKNodeSnapshot
+@end
 
 @implementation SonarKitLayoutPlugin
 {
 
   NSMapTable<NSString *, id> *_trackedObjects;
   NSString *_lastHighlightedNode;
-  NSMutableSet *_invalidObjects;
-  Boolean _invalidateMessageQueued;
-  NSDate *_lastInvalidateMessage;
-  std::mutex invalidObjectsMutex;
+  // The desktop calls setHighlighted for every node the mouse moves over, so
+  // calls only record the latest node, which is highlighted at the next frame.
+  // Only touched on the main thread.
+  id _pendingHighlightedNode;
+  CADisplayLink *_highlightLink;
+  // Only touched on the main thread.
+  NSHashTable *_invalidatedNodes;
+  CADisplayLink *_invalidationLink;
+  CFTimeInterval _lastInvalidateMessage;
 
   id<NSObject> _rootNode;
   id<SKTapListener> _tapListener;
@@ -36,6 +140,22 @@
   id<SonarConnection> _connection;
 
   NSMutableSet *_registeredDelegates;
+
+  SKSearchIndex *_searchIndex;
+  dispatch_queue_t _backgroundQueue;
+
+  NSCache<NSString *, SKNodeSnapshot *> *_snapshots;
+  // Separate from _backgroundQueue, so that encoding images doesn't hold up
+  // replies to getNodes.
+  dispatch_queue_t _snapshotQueue;
+
+  // Set once the desktop asks for node data with packed geometry, which it
+  // then does for as long as it's connected.
+  BOOL _compactValues;
+
+  // Whether the connection may hold a response to getRoot, which any change
+  // to the hierarchy then has to drop. Only touched on the main thread.
+  BOOL _rootResponseCached;
 }
 
 - (instancetype)initWithRootNode:(id<NSObject>)rootNode
@@ -50,15 +170,30 @@
             withDescriptorMapper:(SKDescriptorMapper *)mapper {
   if (self = [super init]) {
     _descriptorMapper = mapper;
+    _prefetchMaxNodes = 500;
     _trackedObjects = [NSMapTable strongToWeakObjectsMapTable];
     _lastHighlightedNode = nil;
-    _invalidObjects = [NSMutableSet new];
-    _invalidateMessageQueued = false;
-    _lastInvalidateMessage = [NSDate date];
+    _invalidatedNodes = [NSHashTable weakObjectsHashTable];
+    _lastInvalidateMessage = 0;
     _rootNode = rootNode;
     _tapListener = tapListener;
 
     _registeredDelegates = [NSMutableSet new];
+
+    __weak SonarKitLayoutPlugin *weakSelf = self;
+    _searchIndex = [[SKSearchIndex alloc] initWithDescriptorMapper: mapper
+                                                       trackObject: ^NSString *(id object) {
+                                                         return [weakSelf trackObject: object];
+                                                       }
+                                                        lookUpNode: ^id(NSString *nodeId) {
+                                                          SonarKitLayoutPlugin *strongSelf = weakSelf;
+                                                          return strongSelf ? [strongSelf->_trackedObjects objectForKey: nodeId] : nil;
+                                                        }];
+    _backgroundQueue = dispatch_queue_create("com.facebook.sonarkit.layout", DISPATCH_QUEUE_SERIAL);
+    _snapshots = [NSCache new];
+    _snapshots.totalCostLimit = kSnapshotCacheBytes;
+    _snapshotQueue = dispatch_queue_create("com.facebook.sonarkit.layout.snapshots", DISPATCH_QUEUE_SERIAL);
+
     [SKInvalidation sharedInstance].delegate = self;
   }
 
@@ -83,12 +218,43 @@
   // In order to avoid a retain cycle (Connection -> Block -> SonarKitLayoutPlugin -> Connection ...)
   __weak SonarKitLayoutPlugin *weakSelf = self;
 
+  // Repeat calls of getRoot are answered by the connection from the last
+  // response, until the tree counter is bumped by a change to the hierarchy.
+  if ([connection respondsToSelector: @selector(cacheResponsesOf:version:)]) {
+    [connection cacheResponsesOf: @"getRoot" version: kTreeCacheVersion];
+  }
   [connection receive:@"getRoot" withBlock:^(NSDictionary *params, id<SonarResponder> responder) {
-    SonarPerformBlockOnMainThread(^{ [weakSelf onCallGetRoot: responder]; });
+    SonarPerformBlockOnMainThread(^{
+      [weakSelf acceptCompactValues: params];
+      [weakSelf onCallGetRoot: responder];
+    });
   }];
 
   [connection receive:@"getNodes" withBlock:^(NSDictionary *params, id<SonarResponder> responder) {
-    SonarPerformBlockOnMainThread(^{ [weakSelf onCallGetNodes: params[@"ids"] withResponder: responder]; });
+    SonarPerformBlockOnMainThread(^{
+      [weakSelf acceptCompactValues: params];
+      [weakSelf onCallGetNodes: params[@"ids"]
+               withKnownHashes: params[@"hashes"]
+                 structureOnly: [params[@"structureOnly"] boolValue]
+                 childrenRange: SKChildrenRange(params[@"childrenRange"])
+                 withResponder: responder];
+    });
+  }];
+
+  [connection receive:@"getSnapshots" withBlock:^(NSDictionary *params, id<SonarResponder> responder) {
+    SonarPerformBlockOnMainThread(^{
+      [weakSelf onCallGetSnapshots: params[@"ids"]
+                           maxSize: params[@"maxSize"] ? [params[@"maxSize"] doubleValue] : kDefaultSnapshotSize
+                   withKnownHashes: params[@"hashes"]
+                     withResponder: responder];
+    });
+  }];
+
+  [connection receive:@"getNodeData" withBlock:^(NSDictionary *params, id<SonarResponder> responder) {
+    SonarPerformBlockOnMainThread(^{
+      [weakSelf acceptCompactValues: params];
+      [weakSelf onCallGetNodeData: params[@"id"] withResponder: responder];
+    });
   }];
 
   [connection receive:@"setData" withBlock:^(NSDictionary *params, id<SonarResponder> responder) {
@@ -100,8 +266,12 @@
     });
   }];
 
+  [connection receive:@"setDataMany" withBlock:^(NSDictionary *params, id<SonarResponder> responder) {
+    SonarPerformBlockOnMainThread(^{ [weakSelf onCallSetDataMany: params[@"edits"] withResponder: responder]; });
+  }];
+
   [connection receive:@"setHighlighted" withBlock:^(NSDictionary *params, id<SonarResponder> responder) {
-    SonarPerformBlockOnMainThread(^{ [weakSelf onCallSetHighlighted: params[@"id"] withResponder: responder]; });
+    SonarPerformBlockOnMainThread(^{ [weakSelf highlightNodeAtNextFrame: params[@"id"]]; });
   }];
 
   [connection receive:@"setSearchActive" withBlock:^(NSDictionary *params, id<SonarResponder> responder) {
@@ -113,35 +283,316 @@
   }];
 
   [connection receive:@"getSearchResults" withBlock:^(NSDictionary *params, id<SonarResponder> responder) {
-    SonarPerformBlockOnMainThread(^{ [weakSelf onCallGetSearchResults: params[@"query"] withResponder: responder]; });
+    SonarPerformBlockOnMainThread(^{
+      [weakSelf onCallGetSearchResults: params[@"query"]
+                            withOffset: [params[@"offset"] unsignedIntegerValue]
+                             withLimit: params[@"limit"] ? [params[@"limit"] unsignedIntegerValue] : kDefaultSearchResultsLimit
+                         withResponder: responder];
+    });
   }];
 }
 
 - (void)didDisconnect {
+  // Otherwise every view mutation in the app keeps paying for them.
+  [SKInvalidation disableInvalidations];
+
+  [_invalidationLink invalidate];
+  _invalidationLink = nil;
+  [_invalidatedNodes removeAllObjects];
+
+  [_highlightLink invalidate];
+  _highlightLink = nil;
+  _pendingHighlightedNode = nil;
+
+  [_snapshots removeAllObjects];
+  _compactValues = NO;
+  _rootResponseCached = NO;
+
   // Clear the last highlight if there is any
   [self onCallSetHighlighted: nil withResponder: nil];
   // Disable search if it is active
   [self onCallSetSearchActive: NO withConnection: nil];
 }
 
+- (void)acceptCompactValues:(NSDictionary *)params {
+  if ([params[@"compactValues"] boolValue]) {
+    _compactValues = YES;
+  }
+}
+
 - (void)onCallGetRoot:(id<SonarResponder>)responder {
-  const auto rootNode= [self getNode: [self trackObject: _rootNode]];
+  if ([_connection respondsToSelector: @selector(invalidateResponses:)]) {
+    _rootResponseCached = YES;
+  }
+  NSDictionary *rootNode = [self captureNode: [self trackObject: _rootNode] structureOnly: NO];
 
-  [responder success: rootNode];
+  dispatch_async(_backgroundQueue, ^{
+    [responder success: rootNode ? SKDiffNode(rootNode, nil) : nil];
+  });
 }
 
-- (void)onCallGetNodes:(NSArray<NSDictionary *> *)nodeIds withResponder:(id<SonarResponder>)responder {
-  NSMutableArray<NSDictionary *> *elements = [NSMutableArray new];
+- (void)onCallGetNodes:(NSArray<NSDictionary *> *)nodeIds
+       withKnownHashes:(NSDictionary<NSString *, NSDictionary *> *)knownHashes
+         structureOnly:(BOOL)structureOnly
+         childrenRange:(NSRange)childrenRange
+         withResponder:(id<SonarResponder>)responder {
+  if (![knownHashes isKindOfClass: [NSDictionary class]]) {
+    knownHashes = nil;
+  }
+
+  [self appendNodes: nodeIds
+          fromIndex: 0
+    withKnownHashes: knownHashes
+      structureOnly: structureOnly
+      childrenRange: childrenRange
+         toElements: [NSMutableArray new]
+      withResponder: responder];
+}
 
-  for (id nodeId in nodeIds) {
-    const auto node = [self getNode: nodeId];
-    if (node == nil) {
+// Captures nodes until the main thread budget runs out, then continues on the
+// next turn of the main queue. Diffing and serializing the reply happen on the
+// background queue.
+- (void)appendNodes:(NSArray *)nodeIds
+          fromIndex:(NSUInteger)index
+    withKnownHashes:(NSDictionary<NSString *, NSDictionary *> *)knownHashes
+      structureOnly:(BOOL)structureOnly
+      childrenRange:(NSRange)childrenRange
+         toElements:(NSMutableArray<NSDictionary *> *)elements
+      withResponder:(id<SonarResponder>)responder {
+  const CFTimeInterval deadline = CACurrentMediaTime() + kMainThreadBudget;
+  while (index < nodeIds.count) {
+    id nodeId = nodeIds[index++];
+    const auto node = [self captureNode: nodeId structureOnly: structureOnly childrenRange: childrenRange];
+    if (node != nil) {
+      [elements addObject: node];
+    }
+    if (CACurrentMediaTime() >= deadline) {
+      break;
+    }
+  }
+
+  if (index < nodeIds.count) {
+    __weak SonarKitLayoutPlugin *weakSelf = self;
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [weakSelf appendNodes: nodeIds
+                  fromIndex: index
+            withKnownHashes: knownHashes
+              structureOnly: structureOnly
+              childrenRange: childrenRange
+                 toElements: elements
+              withResponder: responder];
+    });
+    return;
+  }
+
+  NSArray<NSDictionary *> *prefetched = [self prefetchBelow: elements
+                                               structureOnly: structureOnly
+                                               childrenRange: childrenRange];
+  id<SonarConnection> connection = _connection;
+  dispatch_async(_backgroundQueue, ^{
+    NSMutableArray<NSDictionary *> *diffed = [NSMutableArray arrayWithCapacity: elements.count];
+    for (NSDictionary *element in elements) {
+      [diffed addObject: SKDiffNode(element, knownHashes[element[@"id"]])];
+    }
+    [responder success: @{ @"elements": diffed }];
+
+    if (prefetched.count == 0) {
+      return;
+    }
+    NSMutableArray<NSDictionary *> *prefetchedDiffed = [NSMutableArray arrayWithCapacity: prefetched.count];
+    for (NSDictionary *element in prefetched) {
+      [prefetchedDiffed addObject: SKDiffNode(element, nil)];
+    }
+    // A plugin message rather than part of the reply, so that it waits behind
+    // the responses to the desktop's other calls.
+    [connection send: @"prefetchedNodes" withParams: @{ @"elements": prefetchedDiffed }];
+  });
+}
+
+// Captures the descendants of elements a level at a time, until prefetchLevels,
+// prefetchMaxNodes or the main thread budget run out. Nodes in elements aren't
+// captured again.
+- (NSArray<NSDictionary *> *)prefetchBelow:(NSArray<NSDictionary *> *)elements
+                             structureOnly:(BOOL)structureOnly
+                             childrenRange:(NSRange)childrenRange {
+  NSMutableArray<NSDictionary *> *prefetched = [NSMutableArray new];
+  if (_prefetchLevels == 0 || _prefetchMaxNodes == 0) {
+    return prefetched;
+  }
+  const CFTimeInterval deadline = CACurrentMediaTime() + kMainThreadBudget;
+  NSMutableSet<NSString *> *seen = [NSMutableSet new];
+  for (NSDictionary *element in elements) {
+    [seen addObject: element[@"id"]];
+  }
+  NSArray<NSDictionary *> *level = elements;
+  for (NSUInteger depth = 0; depth < _prefetchLevels && level.count > 0; depth++) {
+    NSMutableArray<NSDictionary *> *nextLevel = [NSMutableArray new];
+    for (NSDictionary *parent in level) {
+      for (NSString *childId in parent[@"children"]) {
+        if ([seen containsObject: childId]) {
+          continue;
+        }
+        [seen addObject: childId];
+        NSDictionary *child = [self captureNode: childId structureOnly: structureOnly childrenRange: childrenRange];
+        if (child != nil) {
+          [nextLevel addObject: child];
+        }
+        if (prefetched.count + nextLevel.count >= _prefetchMaxNodes || CACurrentMediaTime() >= deadline) {
+          [prefetched addObjectsFromArray: nextLevel];
+          return prefetched;
+        }
+      }
+    }
+    [prefetched addObjectsFromArray: nextLevel];
+    level = nextLevel;
+  }
+  return prefetched;
+}
+
+- (void)onCallGetSnapshots:(NSArray<NSString *> *)nodeIds
+                   maxSize:(CGFloat)maxSize
+           withKnownHashes:(NSDictionary<NSString *, NSString *> *)knownHashes
+             withResponder:(id<SonarResponder>)responder {
+  if (![nodeIds isKindOfClass: [NSArray class]]) {
+    [responder error: @{ @"error": @"ids must be an array" }];
+    return;
+  }
+  if (![knownHashes isKindOfClass: [NSDictionary class]]) {
+    knownHashes = nil;
+  }
+
+  [self captureSnapshots: nodeIds
+               fromIndex: 0
+                 maxSize: MAX(1, maxSize)
+         withKnownHashes: knownHashes
+                toImages: [NSMutableDictionary new]
+           withResponder: responder];
+}
+
+// Like appendNodes, copies the screen contents of views until the main thread
+// budget runs out, then continues on the next turn of the main queue. Views are
+// copied at up to twice the size of the image, for the background queue to
+// scale down smoothly and encode, and views with a current image aren't copied
+// at all. Each image is sent as a snapshot message, with the encoded image as
+// its binary payload, unless the hash the desktop has for it is still current.
+// The reply comes after every image has been sent.
+- (void)captureSnapshots:(NSArray<NSString *> *)nodeIds
+               fromIndex:(NSUInteger)index
+                 maxSize:(CGFloat)maxSize
+         withKnownHashes:(NSDictionary<NSString *, NSString *> *)knownHashes
+                toImages:(NSMutableDictionary<NSString *, id> *)images
+           withResponder:(id<SonarResponder>)responder {
+  const CFTimeInterval deadline = CACurrentMediaTime() + kMainThreadBudget;
+  while (index < nodeIds.count) {
+    NSString *nodeId = nodeIds[index++];
+    SKNodeSnapshot *cached = [_snapshots objectForKey: nodeId];
+    if (cached != nil && cached.maxSize == maxSize) {
+      images[nodeId] = cached;
       continue;
     }
-    [elements addObject: node];
+    id node = [_trackedObjects objectForKey: nodeId];
+    if ([node isKindOfClass: [UIView class]]) {
+      UIImage *image = SKSnapshotCapture(node, 2 * maxSize);
+      if (image != nil) {
+        images[nodeId] = image;
+      }
+    }
+    if (CACurrentMediaTime() >= deadline) {
+      break;
+    }
+  }
+
+  if (index < nodeIds.count) {
+    __weak SonarKitLayoutPlugin *weakSelf = self;
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [weakSelf captureSnapshots: nodeIds
+                       fromIndex: index
+                         maxSize: maxSize
+                 withKnownHashes: knownHashes
+                        toImages: images
+                   withResponder: responder];
+    });
+    return;
   }
 
-  [responder success: @{ @"elements": elements }];
+  id<SonarConnection> connection = _connection;
+  NSCache<NSString *, SKNodeSnapshot *> *cache = _snapshots;
+  dispatch_async(_snapshotQueue, ^{
+    NSMutableArray<NSDictionary *> *snapshots = [NSMutableArray new];
+    NSMutableArray<NSString *> *missing = [NSMutableArray new];
+    for (NSString *nodeId in nodeIds) {
+      id image = images[nodeId];
+      SKNodeSnapshot *snapshot = [image isKindOfClass: [SKNodeSnapshot class]] ? image : nil;
+      if (image != nil && snapshot == nil) {
+        CGSize size = CGSizeZero;
+        NSData *data = SKSnapshotEncode(image, maxSize, &size);
+        if (data != nil) {
+          snapshot = [SKNodeSnapshot new];
+          snapshot.data = data;
+          snapshot.contentHash = SKContentHashString(SKContentHashData(data));
+          snapshot.size = size;
+          snapshot.maxSize = maxSize;
+          [cache setObject: snapshot forKey: nodeId cost: data.length];
+        }
+      }
+      if (snapshot == nil) {
+        [missing addObject: nodeId];
+        continue;
+      }
+
+      const BOOL unchanged = [snapshot.contentHash isEqual: knownHashes[nodeId]];
+      [snapshots addObject: @{ @"id": nodeId, @"hash": snapshot.contentHash, @"unchanged": @(unchanged) }];
+      if (unchanged) {
+        continue;
+      }
+      NSDictionary *metadata = @{
+                                 @"id": nodeId,
+                                 @"hash": snapshot.contentHash,
+                                 @"width": @(snapshot.size.width),
+                                 @"height": @(snapshot.size.height),
+                                 @"format": @"jpeg",
+                                 };
+      if ([connection respondsToSelector: @selector(send:withMetadata:data:)] &&
+          [connection send: @"snapshot" withMetadata: metadata data: snapshot.data]) {
+        continue;
+      }
+      NSMutableDictionary *params = [metadata mutableCopy];
+      params[@"data"] = [snapshot.data base64EncodedStringWithOptions: 0];
+      [connection send: @"snapshot" withParams: params];
+    }
+    [responder success: @{ @"snapshots": snapshots, @"missing": missing }];
+  });
+}
+
+// Images show a view's subviews too, so those of its superviews go with it.
+- (void)dropSnapshotsOfNode:(id)node withId:(NSString *)nodeId {
+  [_snapshots removeObjectForKey: nodeId];
+  if (![node isKindOfClass: [UIView class]]) {
+    return;
+  }
+  for (UIView *ancestor = [node superview]; ancestor != nil; ancestor = ancestor.superview) {
+    NSString *ancestorId = [[_descriptorMapper descriptorForClass: [ancestor class]] identifierForNode: ancestor];
+    if (ancestorId != nil) {
+      [_snapshots removeObjectForKey: ancestorId];
+    }
+  }
+}
+
+- (void)onCallGetNodeData:(NSString *)nodeId withResponder:(id<SonarResponder>)responder {
+  id<NSObject> node = [_trackedObjects objectForKey: nodeId];
+  SKNodeDescriptor *nodeDescriptor = [_descriptorMapper descriptorForClass: [node class]];
+  if (node == nil || nodeDescriptor == nil) {
+    [responder error: @{ @"error": @"no tracked node found" }];
+    return;
+  }
+
+  NSDictionary *data = [self dataForNode: node withDescriptor: nodeDescriptor];
+  dispatch_async(_backgroundQueue, ^{
+    [responder success: @{
+                          @"id": nodeId,
+                          @"data": data,
+                          }];
+  });
 }
 
 - (void)onCallSetData:(NSString *)objectId
@@ -167,22 +618,118 @@
   SKNodeDescriptor *descriptor = [_descriptorMapper descriptorForClass: [node class]];
 
   NSString *dotJoinedPath = [path componentsJoinedByString: @"."];
-  SKNodeUpdateData updateDataForPath = [[descriptor dataMutationsForNode: node] objectForKey: dotJoinedPath];
-  if (updateDataForPath != nil) {
-    updateDataForPath(value);
+  if ([descriptor setData: value forPath: dotJoinedPath ofNode: node]) {
+    [self dropSnapshotsOfNode: node withId: objectId];
+    [self invalidateRootResponse];
     [connection send: @"invalidate" withParams: @{ @"id": [descriptor identifierForNode: node] }];
   }
 }
 
-- (void)onCallGetSearchResults:(NSString *)query withResponder:(id<SonarResponder>)responder {
-  const auto alreadyAddedElements = [NSMutableSet<NSString *> new];
-  SKSearchResultNode *matchTree = [self searchForQuery:(NSString *)[query lowercaseString] fromNode:(id)_rootNode withElementsAlreadyAdded: alreadyAddedElements];
+// Applies the edits in order, in one pass on the main thread, and responds
+// with the nodes they changed, rather than having the desktop fetch them again
+// after an invalidate per edit. Used while a value is dragged in the sidebar.
+- (void)onCallSetDataMany:(NSArray<NSDictionary *> *)edits withResponder:(id<SonarResponder>)responder {
+  if (![edits isKindOfClass: [NSArray class]]) {
+    [responder error: @{ @"error": @"edits must be an array" }];
+    return;
+  }
 
-  [responder success: @{
-                        @"results": [matchTree toNSDictionary] ?: [NSNull null],
-                        @"query": query
-                        }];
-  return;
+  NSMutableOrderedSet<NSString *> *changedNodes = [NSMutableOrderedSet new];
+  for (NSDictionary *edit in edits) {
+    NSString *objectId = edit[@"id"];
+    id value = edit[@"value"];
+    id node = objectId ? [_trackedObjects objectForKey: objectId] : nil;
+    // Same as setData for empty text fields.
+    if (node == nil || value == nil || [value isKindOfClass: [NSNull class]]) {
+      continue;
+    }
+    SKNodeDescriptor *descriptor = [_descriptorMapper descriptorForClass: [node class]];
+    NSString *dotJoinedPath = [edit[@"path"] componentsJoinedByString: @"."];
+    if ([descriptor setData: value forPath: dotJoinedPath ofNode: node]) {
+      [self dropSnapshotsOfNode: node withId: objectId];
+      [self invalidateRootResponse];
+      [changedNodes addObject: objectId];
+    }
+  }
+
+  NSMutableArray<NSDictionary *> *elements = [NSMutableArray arrayWithCapacity: changedNodes.count];
+  for (NSString *nodeId in changedNodes) {
+    NSDictionary *element = [self captureNode: nodeId structureOnly: NO];
+    if (element != nil) {
+      [elements addObject: element];
+    }
+  }
+
+  dispatch_async(_backgroundQueue, ^{
+    NSMutableArray<NSDictionary *> *diffed = [NSMutableArray arrayWithCapacity: elements.count];
+    for (NSDictionary *element in elements) {
+      [diffed addObject: SKDiffNode(element, nil)];
+    }
+    [responder success: @{ @"elements": diffed }];
+  });
+}
+
+// Searching runs against a snapshot of the search index on a background
+// queue, so only the matches that are sent, and their ancestors, are visited
+// on the main thread.
+- (void)onCallGetSearchResults:(NSString *)query
+                    withOffset:(NSUInteger)offset
+                     withLimit:(NSUInteger)limit
+                 withResponder:(id<SonarResponder>)responder {
+  SKSearchIndexSnapshot *snapshot = [_searchIndex snapshotFromRootNode: _rootNode];
+  __weak SonarKitLayoutPlugin *weakSelf = self;
+
+  dispatch_async(_backgroundQueue, ^{
+    NSUInteger total = 0;
+    NSArray<NSString *> *matches = [snapshot nodesMatchingQuery: query offset: offset limit: limit total: &total];
+
+    NSMutableSet<NSString *> *includedNodes = [NSMutableSet new];
+    for (NSString *match in matches) {
+      for (NSString *nodeId = match; nodeId != nil && ![includedNodes containsObject: nodeId]; nodeId = [snapshot parentOfNode: nodeId]) {
+        [includedNodes addObject: nodeId];
+      }
+    }
+    NSSet<NSString *> *matchingNodes = [NSSet setWithArray: matches];
+
+    SonarPerformBlockOnMainThread(^{
+      SKSearchResultNode *matchTree = [weakSelf searchResultTreeForNode: snapshot.rootId
+                                                           fromSnapshot: snapshot
+                                                      withIncludedNodes: includedNodes
+                                                       andMatchingNodes: matchingNodes];
+      [responder success: @{
+                            @"results": [matchTree toNSDictionary] ?: [NSNull null],
+                            @"query": query,
+                            @"offset": @(offset),
+                            @"total": @(total),
+                            }];
+    });
+  });
+}
+
+- (void)highlightNodeAtNextFrame:(id)objectId {
+  _pendingHighlightedNode = objectId;
+  if (_highlightLink == nil) {
+    __weak SonarKitLayoutPlugin *weakSelf = self;
+    SKDisplayLinkTarget *target = [[SKDisplayLinkTarget alloc] initWithBlock:^{
+      [weakSelf flushPendingHighlight];
+    }];
+    _highlightLink = [CADisplayLink displayLinkWithTarget: target selector: @selector(displayLinkDidFire:)];
+    [_highlightLink addToRunLoop: [NSRunLoop mainRunLoop] forMode: NSRunLoopCommonModes];
+  }
+  _highlightLink.paused = NO;
+}
+
+- (void)flushPendingHighlight {
+  _highlightLink.paused = YES;
+  id objectId = _pendingHighlightedNode;
+  _pendingHighlightedNode = nil;
+  if ([objectId isKindOfClass:[NSNull class]]) {
+    objectId = nil;
+  }
+  if (objectId == _lastHighlightedNode || [objectId isEqual: _lastHighlightedNode]) {
+    return;
+  }
+  [self onCallSetHighlighted: objectId withResponder: nil];
 }
 
 - (void)onCallSetHighlighted:(NSString *)objectId withResponder:(id<SonarResponder>)responder {
@@ -238,44 +785,94 @@
   }
 }
 
+// Called for every change to the hierarchy, for example for every cell a
+// collection view dequeues, so this only records the node. Everything else
+// happens once a frame in flushInvalidatedNodes.
 - (void)invalidateNode:(id<NSObject>)node {
-  SKNodeDescriptor *descriptor = [_descriptorMapper descriptorForClass: [node class]];
-  if (descriptor == nil) {
+  if (node == nil) {
+    return;
+  }
+  if (![NSThread isMainThread]) {
+    SonarPerformBlockOnMainThread(^{ [self invalidateNode: node]; });
     return;
   }
 
-  NSString *nodeId = [descriptor identifierForNode: node];
-  if (![_trackedObjects objectForKey: nodeId]) {
+  [self invalidateRootResponse];
+  [_invalidatedNodes addObject: node];
+  if (_invalidationLink == nil) {
+    __weak SonarKitLayoutPlugin *weakSelf = self;
+    SKDisplayLinkTarget *target = [[SKDisplayLinkTarget alloc] initWithBlock:^{
+      [weakSelf flushInvalidatedNodes];
+    }];
+    _invalidationLink = [CADisplayLink displayLinkWithTarget: target selector: @selector(displayLinkDidFire:)];
+    [_invalidationLink addToRunLoop: [NSRunLoop mainRunLoop] forMode: NSRunLoopCommonModes];
+  }
+  _invalidationLink.paused = NO;
+}
+
+// Right away rather than with the next flush, so that a getRoot coming in
+// before then isn't answered with the hierarchy from before the change.
+- (void)invalidateRootResponse {
+  if (!_rootResponseCached) {
     return;
   }
-  [descriptor invalidateNode: node];
+  _rootResponseCached = NO;
+  [_connection invalidateResponses: kTreeCacheVersion];
+}
 
-  // Collect invalidate messages before sending in a batch
-  std::lock_guard<std::mutex> lock(invalidObjectsMutex);
-  [_invalidObjects addObject:nodeId];
-  if (_invalidateMessageQueued) {
+- (void)flushInvalidatedNodes {
+  if (CACurrentMediaTime() - _lastInvalidateMessage < kMinInvalidateInterval) {
+    return;
+  }
+  _invalidationLink.paused = YES;
+
+  NSArray *nodes = _invalidatedNodes.allObjects;
+  [_invalidatedNodes removeAllObjects];
+  for (id node in nodes) {
+    NSString *nodeId = [[_descriptorMapper descriptorForClass: [node class]] identifierForNode: node];
+    if (nodeId != nil) {
+      [self dropSnapshotsOfNode: node withId: nodeId];
+    }
+  }
+  if (_connection == nil || ![[SonarClient sharedClient] isPluginActive:[self identifier]]) {
     return;
   }
-  _invalidateMessageQueued = true;
 
-  if (_lastInvalidateMessage.timeIntervalSinceNow < -1) {
-    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 500 * NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
-      [self reportInvalidatedObjects];
-    });
+  NSMapTable<id, NSString *> *trackedNodes = [NSMapTable strongToStrongObjectsMapTable];
+  for (id node in nodes) {
+    SKNodeDescriptor *descriptor = [_descriptorMapper descriptorForClass: [node class]];
+    NSString *nodeId = [descriptor identifierForNode: node];
+    if (nodeId == nil || ![_trackedObjects objectForKey: nodeId]) {
+      continue;
+    }
+    [descriptor invalidateNode: node];
+    [trackedNodes setObject: nodeId forKey: node];
   }
-}
 
-- (void)reportInvalidatedObjects {
-  std::lock_guard<std::mutex> lock(invalidObjectsMutex);
-  NSMutableArray *nodes = [NSMutableArray new];
-  for (NSString *nodeId in self->_invalidObjects) {
-   [nodes addObject: [NSDictionary dictionaryWithObject: nodeId forKey: @"id"]];
+  // The desktop refetches the subtree of every node it is told about, so nodes
+  // under another invalidated view don't need reporting.
+  NSMutableArray<NSDictionary *> *reported = [NSMutableArray new];
+  for (id node in trackedNodes) {
+    BOOL hasInvalidatedAncestor = NO;
+    if ([node isKindOfClass: [UIView class]]) {
+      for (UIView *ancestor = [node superview]; ancestor != nil; ancestor = ancestor.superview) {
+        if ([trackedNodes objectForKey: ancestor]) {
+          hasInvalidatedAncestor = YES;
+          break;
+        }
+      }
+    }
+    if (!hasInvalidatedAncestor) {
+      NSString *nodeId = [trackedNodes objectForKey: node];
+      [_searchIndex invalidateNodeWithId: nodeId];
+      [reported addObject: @{ @"id": nodeId }];
+    }
+  }
+
+  if (reported.count > 0) {
+    [_connection send: @"invalidate" withParams: @{ @"nodes": reported }];
+    _lastInvalidateMessage = CACurrentMediaTime();
   }
-  [self->_connection send: @"invalidate" withParams: [NSDictionary dictionaryWithObject: nodes forKey: @"nodes"]];
-  self->_lastInvalidateMessage = [NSDate date];
-  self->_invalidObjects = [NSMutableSet new];
-  self->_invalidateMessageQueued = false;
-  return;
 }
 
 - (void)updateNodeReference:(id<NSObject>)node {
@@ -286,58 +883,69 @@
 
   NSString *nodeId = [descriptor identifierForNode: node];
   [_trackedObjects setObject:node forKey:nodeId];
+  [_searchIndex invalidateNodeWithId: nodeId];
 }
 
-- (SKSearchResultNode *)searchForQuery:(NSString *)query fromNode:(id)node withElementsAlreadyAdded:(NSMutableSet<NSString *> *)alreadyAdded {
-  SKNodeDescriptor *descriptor = [_descriptorMapper descriptorForClass: [node class]];
-  if (node == nil || descriptor == nil) {
+- (SKSearchResultNode *)searchResultTreeForNode:(NSString *)nodeId
+                                   fromSnapshot:(SKSearchIndexSnapshot *)snapshot
+                              withIncludedNodes:(NSSet<NSString *> *)includedNodes
+                               andMatchingNodes:(NSSet<NSString *> *)matchingNodes {
+  if (nodeId == nil || ![includedNodes containsObject: nodeId]) {
+    return nil;
+  }
+  // The node may have gone since the snapshot was taken.
+  NSDictionary *element = [self getNode: nodeId withKnownHashes: nil structureOnly: YES];
+  if (element == nil) {
     return nil;
   }
 
   NSMutableArray<SKSearchResultNode *> *childTrees = nil;
-  BOOL isMatch = [descriptor matchesQuery: query forNode: node];
-
-  NSString *nodeId = [self trackObject: node];
-
-  for (auto i = 0; i < [descriptor childCountForNode: node]; i++) {
-    id child = [descriptor childForNode: node atIndex: i];
-    if (child) {
-      SKSearchResultNode *childTree = [self searchForQuery: query fromNode: child withElementsAlreadyAdded:alreadyAdded];
-      if (childTree != nil) {
-        if (childTrees == nil) {
-          childTrees = [NSMutableArray new];
-        }
-        [childTrees addObject: childTree];
+  for (NSString *child in [snapshot childrenOfNode: nodeId]) {
+    SKSearchResultNode *childTree = [self searchResultTreeForNode: child
+                                                     fromSnapshot: snapshot
+                                                withIncludedNodes: includedNodes
+                                                 andMatchingNodes: matchingNodes];
+    if (childTree != nil) {
+      if (childTrees == nil) {
+        childTrees = [NSMutableArray new];
       }
+      [childTrees addObject: childTree];
     }
   }
 
-  if (isMatch || childTrees != nil) {
-
-    NSDictionary *element = [self getNode: nodeId];
-    if (nodeId == nil || element == nil) {
-      return nil;
-    }
-    NSMutableArray<NSString *> *descriptorChildElements = [element objectForKey: @"children"];
-    NSMutableDictionary *newElement = [element mutableCopy];
-
-    NSMutableArray<NSString *> *childElementsToReturn = [NSMutableArray new];
-    for (NSString *child in descriptorChildElements) {
-      if (![alreadyAdded containsObject: child]) {
-        [alreadyAdded addObject: child]; //todo add all at end
-        [childElementsToReturn addObject: child];
-      }
-    }
-    [newElement setObject: childElementsToReturn forKey: @"children"];
-    return [[SKSearchResultNode alloc] initWithNode: nodeId
-                                            asMatch: isMatch
-                                        withElement: newElement
-                                        andChildren: childTrees];
-  }
-  return nil;
+  return [[SKSearchResultNode alloc] initWithNode: nodeId
+                                          asMatch: [matchingNodes containsObject: nodeId]
+                                      withElement: element
+                                      andChildren: childTrees];
 }
 
 - (NSDictionary *)getNode:(NSString *)nodeId {
+  return [self getNode: nodeId withKnownHashes: nil structureOnly: NO];
+}
+
+- (NSDictionary *)getNode:(NSString *)nodeId
+          withKnownHashes:(NSDictionary<NSString *, NSString *> *)knownHashes
+            structureOnly:(BOOL)structureOnly {
+  NSDictionary *node = [self captureNode: nodeId structureOnly: structureOnly];
+  return node ? SKDiffNode(node, knownHashes) : nil;
+}
+
+// Reads everything that is sent about a node. This is the only part that needs
+// the main thread: the result only holds plain values, so hashing and
+// serializing it can happen elsewhere.
+//
+// Data is the expensive part of a node and is only shown for the selected one,
+// so when only the structure is asked for it is left out, to be fetched with
+// getNodeData.
+- (NSDictionary *)captureNode:(NSString *)nodeId structureOnly:(BOOL)structureOnly {
+  return [self captureNode: nodeId structureOnly: structureOnly childrenRange: NSMakeRange(0, NSUIntegerMax)];
+}
+
+// Only the children in childrenRange are tracked and sent, along with how
+// many there are in total, so the desktop can page through the rest.
+- (NSDictionary *)captureNode:(NSString *)nodeId
+                structureOnly:(BOOL)structureOnly
+                childrenRange:(NSRange)childrenRange {
   id<NSObject> node = [_trackedObjects objectForKey: nodeId];
   if (node == nil) {
     SKLog(@"node is nil, no tracked node found for nodeId: %@", nodeId);
@@ -351,7 +959,6 @@
   }
 
   NSMutableArray *attributes = [NSMutableArray new];
-  NSMutableDictionary *data = [NSMutableDictionary new];
 
   const auto *nodeAttributes = [nodeDescriptor attributesForNode: node];
   for (const SKNamed<NSString *> *namedPair in nodeAttributes) {
@@ -365,35 +972,49 @@
     }
   }
 
-  const auto *nodeData = [nodeDescriptor dataForNode: node];
-  for (const SKNamed<NSDictionary *> *namedPair in nodeData) {
-    data[namedPair.name] = namedPair.value;
+  NSArray *allChildren = [nodeDescriptor childrenForNode: node];
+  const NSUInteger childCount = allChildren.count;
+  const NSUInteger start = MIN(childrenRange.location, childCount);
+  NSArray *window = allChildren;
+  if (start > 0 || childrenRange.length < childCount - start) {
+    window = [allChildren subarrayWithRange: NSMakeRange(start, MIN(childrenRange.length, childCount - start))];
   }
 
-  NSMutableArray *children = [NSMutableArray new];
-  for (NSUInteger i = 0; i < [nodeDescriptor childCountForNode: node]; i++) {
-    id childNode = [nodeDescriptor childForNode: node atIndex: i];
-
+  NSMutableArray *children = [NSMutableArray arrayWithCapacity: window.count];
+  for (id childNode in window) {
     NSString *childIdentifier = [self trackObject: childNode];
     if (childIdentifier) {
       [children addObject: childIdentifier];
     }
   }
 
-  NSDictionary *nodeDic =
+  NSMutableDictionary *nodeDic = [NSMutableDictionary dictionaryWithDictionary:
   @{
     // We shouldn't get nil for id/name/decoration, but let's not crash if we do.
     @"id": [nodeDescriptor identifierForNode: node] ?: @"(unknown)",
     @"name": [nodeDescriptor nameForNode: node] ?: @"(unknown)",
     @"children": children,
+    @"childCount": @(childCount),
     @"attributes": attributes,
-    @"data": data,
     @"decoration": [nodeDescriptor decorationForNode: node] ?: @"(unknown)",
-    };
+    }];
+  if (!structureOnly) {
+    nodeDic[@"data"] = [self dataForNode: node withDescriptor: nodeDescriptor];
+  }
 
   return nodeDic;
 }
 
+- (NSDictionary *)dataForNode:(id<NSObject>)node withDescriptor:(SKNodeDescriptor *)nodeDescriptor {
+  SKCompactValuesScope compactValues(_compactValues);
+  NSMutableDictionary *data = [NSMutableDictionary new];
+  const auto *nodeData = [nodeDescriptor dataForNode: node];
+  for (const SKNamed<NSDictionary *> *namedPair in nodeData) {
+    data[namedPair.name] = namedPair.value;
+  }
+  return data;
+}
+
 - (NSString *)trackObject:(id)object {
   const SKNodeDescriptor *descriptor = [_descriptorMapper descriptorForClass: [object class]];
   NSString *objectIdentifier = [descriptor identifierForNode: object];
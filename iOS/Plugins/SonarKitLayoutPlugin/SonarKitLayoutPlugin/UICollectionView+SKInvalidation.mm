@@ -23,9 +23,11 @@ FB_LINKABLE(UICollectionView_SKInvalidation)
 }
 
 - (UICollectionViewCell *)swizzle_cellForItemAtIndexPath:(NSIndexPath *)indexPath {
-  dispatch_async(dispatch_get_main_queue(), ^{
+  // Invalidations are coalesced and handled once a frame, after the cell has
+  // been added, so there is no need to defer this.
+  if (SKInvalidationsEnabled()) {
     [[SKInvalidation sharedInstance].delegate invalidateNode: self];
-  });
+  }
 
   return [self swizzle_cellForItemAtIndexPath: indexPath];
 }
@@ -11,6 +11,9 @@
 
 #import "SKObject.h"
 
+// The color's components as 0xAARRGGBB, which is how colors are sent.
+uint32_t SKColorARGB(CGColorRef color);
+
 FB_LINK_REQUIRE(UIColor_SonarValueCoder)
 @interface UIColor (SonarValueCoder) <SKSonarValueCoder>
 
@@ -9,6 +9,31 @@
 
 #import "UIColor+SKSonarValueCoder.h"
 
+static uint32_t SKColorChannel(CGFloat component) {
+  return (uint32_t)(MAX(0, MIN(1, component)) * 255);
+}
+
+uint32_t SKColorARGB(CGColorRef color) {
+  const CGColorSpaceModel colorSpaceModel = CGColorSpaceGetModel(CGColorGetColorSpace(color));
+  const size_t count = CGColorGetNumberOfComponents(color);
+  const CGFloat *components = CGColorGetComponents(color);
+
+  uint32_t red, green, blue, alpha;
+  if (colorSpaceModel == kCGColorSpaceModelRGB && count == 4) {
+    red = SKColorChannel(components[0]);
+    green = SKColorChannel(components[1]);
+    blue = SKColorChannel(components[2]);
+    alpha = SKColorChannel(components[3]);
+  } else if (colorSpaceModel == kCGColorSpaceModelMonochrome && count == 2) {
+    red = green = blue = SKColorChannel(components[0]);
+    alpha = SKColorChannel(components[1]);
+  } else {
+    red = green = blue = alpha = 0;
+  }
+
+  return (alpha << 24) | (red << 16) | (green << 8) | blue;
+}
+
 FB_LINKABLE(UIColor_SonarValueCoder)
 @implementation UIColor (SonarValueCoder)
 
@@ -26,40 +51,10 @@ FB_LINKABLE(UIColor_SonarValueCoder)
 }
 
 - (NSDictionary<NSString *, id<NSObject>> *)sonarValue {
-  CGColorSpaceRef colorSpace = CGColorGetColorSpace([self CGColor]);
-  CGColorSpaceModel colorSpaceModel = CGColorSpaceGetModel(colorSpace);
-
-  NSUInteger red, green, blue, alpha;
-
-  switch (colorSpaceModel) {
-    case kCGColorSpaceModelUnknown:
-    case kCGColorSpaceModelRGB: {
-      CGFloat r, g, b, a;
-      [self getRed: &r green: &g blue: &b alpha: &a];
-
-      red = (NSUInteger)(r * 255) & 0xFF;
-      green = (NSUInteger)(g * 255) & 0xFF;
-      blue = (NSUInteger)(b * 255) & 0xFF;
-      alpha = (NSUInteger)(a * 255) & 0xFF;
-    } break;
-
-    case kCGColorSpaceModelMonochrome: {
-      CGFloat a, w;
-      [self getWhite: &w alpha: &a];
-
-      red = green = blue = (NSUInteger)(w * 255) & 0xFF;
-      alpha = (NSUInteger)(a * 255) & 0xFF;
-    } break;
-
-    default:
-      red = green = blue = alpha = 0;
-  }
-
-  NSUInteger intColor = (alpha << 24) | (red << 16) | (green << 8) | blue;
   return @{
            @"__type__": @"color",
            @"__mutable__": @NO,
-           @"value": @(intColor)
+           @"value": @(SKColorARGB([self CGColor]))
            };
 }
 
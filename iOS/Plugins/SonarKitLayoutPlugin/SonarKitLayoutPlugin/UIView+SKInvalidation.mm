@@ -28,6 +28,9 @@ FB_LINKABLE(UIView_SKInvalidation)
 
 - (void)swizzle_setHidden:(BOOL)hidden {
   [self swizzle_setHidden: hidden];
+  if (!SKInvalidationsEnabled()) {
+    return;
+  }
 
   id<SKInvalidationDelegate> delegate = [SKInvalidation sharedInstance].delegate;
   if (delegate != nil) {
@@ -37,6 +40,9 @@ FB_LINKABLE(UIView_SKInvalidation)
 
 - (void)swizzle_addSubview:(UIView *)view {
   [self swizzle_addSubview: view];
+  if (!SKInvalidationsEnabled()) {
+    return;
+  }
 
   id<SKInvalidationDelegate> delegate = [SKInvalidation sharedInstance].delegate;
   if (delegate != nil) {
@@ -45,6 +51,11 @@ FB_LINKABLE(UIView_SKInvalidation)
 }
 
 - (void)swizzle_removeFromSuperview {
+  if (!SKInvalidationsEnabled()) {
+    [self swizzle_removeFromSuperview];
+    return;
+  }
+
   id<SKInvalidationDelegate> delegate = [SKInvalidation sharedInstance].delegate;
   if (delegate != nil && self.superview != nil) {
     [delegate invalidateNode: self.superview];
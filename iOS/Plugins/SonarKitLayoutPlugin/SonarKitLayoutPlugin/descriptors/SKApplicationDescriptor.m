@@ -16,7 +16,7 @@
 @implementation SKApplicationDescriptor
 
 - (NSString *)identifierForNode:(UIApplication *)node {
-  return [NSString stringWithFormat: @"%p", node];
+  return SKObjectIdentifier(node);
 }
 
 - (NSUInteger)childCountForNode:(UIApplication *)node {
@@ -27,14 +27,19 @@
   return [self visibleChildrenForNode: node][index];
 }
 
+- (NSArray *)childrenForNode:(UIApplication *)node {
+  return [self visibleChildrenForNode: node];
+}
+
 - (void)setHighlighted:(BOOL)highlighted forNode:(UIApplication *)node {
   SKNodeDescriptor *windowDescriptor = [self descriptorForClass: [UIWindow class]];
   [windowDescriptor setHighlighted: highlighted forNode: [node keyWindow]];
 }
 
 - (void)hitTest:(SKTouch *)touch forNode:(UIApplication *)node {
-  for (NSInteger index = [self childCountForNode: node] - 1; index >= 0; index--) {
-    UIWindow *child = [self childForNode: node atIndex: index];
+  NSArray<UIWindow *> *children = [self visibleChildrenForNode: node];
+  for (NSInteger index = children.count - 1; index >= 0; index--) {
+    UIWindow *child = children[index];
     if (child.isHidden || child.alpha <= 0) {
       continue;
     }
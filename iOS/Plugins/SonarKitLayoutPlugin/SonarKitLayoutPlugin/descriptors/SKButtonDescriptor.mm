@@ -16,7 +16,7 @@
 @implementation SKButtonDescriptor
 
 - (NSString *)identifierForNode:(UIButton *)node {
-  return [NSString stringWithFormat: @"%p", node];
+  return SKObjectIdentifier(node);
 }
 
 - (NSUInteger)childCountForNode:(UIButton *)node {
@@ -48,30 +48,29 @@
   return data;
 }
 
-- (NSDictionary<NSString *, SKNodeUpdateData> *)dataMutationsForNode:(UIButton *)node {
-  NSDictionary *buttonMutations = @{
-                                    @"UIButton.titleLabel": ^(NSString *newValue) {
-                                      [node setTitle: newValue forState: node.state];
-                                    },
-                                    @"UIButton.currentTitleColor": ^(NSNumber *newValue) {
-                                      [node setTitleColor: [UIColor fromSonarValue: newValue] forState: node.state];
-                                    },
-                                    @"UIButton.highlighted": ^(NSNumber *highlighted) {
-                                      [node setHighlighted: [highlighted boolValue]];
-                                    },
-                                    @"UIButton.enabled": ^(NSNumber *enabled) {
-                                      [node setEnabled: [enabled boolValue]];
-                                    }
-                                    };
++ (NSDictionary<NSString *, SKNodeMutation> *)dataMutations {
+  return @{
+           @"UIButton.titleLabel": ^(UIButton *node, NSString *newValue) {
+             [node setTitle: newValue forState: node.state];
+           },
+           @"UIButton.currentTitleColor": ^(UIButton *node, NSNumber *newValue) {
+             [node setTitleColor: [UIColor fromSonarValue: newValue] forState: node.state];
+           },
+           @"UIButton.highlighted": ^(UIButton *node, NSNumber *highlighted) {
+             [node setHighlighted: [highlighted boolValue]];
+           },
+           @"UIButton.enabled": ^(UIButton *node, NSNumber *enabled) {
+             [node setEnabled: [enabled boolValue]];
+           }
+           };
+}
 
+- (BOOL)setData:(id)value forPath:(NSString *)path ofNode:(UIButton *)node {
+  if ([super setData: value forPath: path ofNode: node]) {
+    return YES;
+  }
   SKNodeDescriptor *viewDescriptor = [self descriptorForClass: [UIView class]];
-  NSDictionary *viewMutations = [viewDescriptor dataMutationsForNode: node];
-
-  NSMutableDictionary *mutations = [NSMutableDictionary new];
-  [mutations addEntriesFromDictionary: buttonMutations];
-  [mutations addEntriesFromDictionary: viewMutations];
-
-  return mutations;
+  return [viewDescriptor setData: value forPath: path ofNode: node];
 }
 
 - (NSArray<SKNamed<NSString *> *> *)attributesForNode:(UIScrollView *)node {
@@ -28,14 +28,19 @@
   return [descriptor childForNode: node atIndex: index];
 }
 
+- (NSArray *)childrenForNode:(UIScrollView *)node {
+  SKNodeDescriptor *descriptor = [self descriptorForClass: [UIView class]];
+  return [descriptor childrenForNode: node];
+}
+
 - (id)dataForNode:(UIScrollView *)node {
   SKNodeDescriptor *descriptor = [self descriptorForClass: [UIView class]];
   return [descriptor dataForNode:node];
 }
 
-- (id)dataMutationsForNode:(UIScrollView *)node {
+- (BOOL)setData:(id)value forPath:(NSString *)path ofNode:(UIScrollView *)node {
   SKNodeDescriptor *descriptor = [self descriptorForClass: [UIView class]];
-  return [descriptor dataMutationsForNode:node];
+  return [descriptor setData: value forPath: path ofNode: node];
 }
 
 - (NSArray<SKNamed<NSString *> *> *)attributesForNode:(UIScrollView *)node {
@@ -49,8 +54,9 @@
 }
 
 - (void)hitTest:(SKTouch *)touch forNode:(UIScrollView *)node {
-  for (NSInteger index = [self childCountForNode: node] - 1; index >= 0; index--) {
-    id<NSObject> childNode = [self childForNode: node atIndex: index];
+  NSArray *children = [self childrenForNode: node];
+  for (NSInteger index = children.count - 1; index >= 0; index--) {
+    id<NSObject> childNode = children[index];
     CGRect frame;
 
     if ([childNode isKindOfClass: [UIViewController class]]) {
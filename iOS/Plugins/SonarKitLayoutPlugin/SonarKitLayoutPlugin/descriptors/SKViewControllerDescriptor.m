@@ -14,7 +14,7 @@
 @implementation SKViewControllerDescriptor
 
 - (NSString *)identifierForNode:(UIViewController *)node {
-  return [NSString stringWithFormat: @"%p", node];
+  return SKObjectIdentifier(node);
 }
 
 - (NSUInteger)childCountForNode:(UIViewController *)node {
@@ -31,7 +31,7 @@
 - (NSArray<SKNamed<NSString *> *> *)attributesForNode:(UIViewController *)node {
   return @[
            [SKNamed newWithName: @"addr"
-                      withValue: [NSString stringWithFormat: @"%p", node]]
+                      withValue: SKObjectIdentifier(node)]
            ];
 }
 
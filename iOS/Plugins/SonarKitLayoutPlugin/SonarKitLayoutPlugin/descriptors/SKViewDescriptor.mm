@@ -38,7 +38,7 @@ static NSDictionary *YGUnitEnumMap = nil;
 }
 
 - (NSString *)identifierForNode:(UIView *)node {
-  return [NSString stringWithFormat: @"%p", node];
+  return SKObjectIdentifier(node);
 }
 
 - (NSUInteger)childCountForNode:(UIView *)node {
@@ -49,6 +49,10 @@ static NSDictionary *YGUnitEnumMap = nil;
   return [[self validChildrenForNode:node] objectAtIndex: index];
 }
 
+- (NSArray *)childrenForNode:(UIView *)node {
+  return [self validChildrenForNode: node];
+}
+
 - (NSArray *)validChildrenForNode:(UIView *)node {
   NSMutableArray *validChildren = [NSMutableArray new];
 
@@ -84,12 +88,12 @@ static NSDictionary *YGUnitEnumMap = nil;
                                   }],
           [SKNamed newWithName: @"CALayer"
                      withValue: @{
-                                  @"shadowColor": SKMutableObject([UIColor colorWithCGColor:node.layer.shadowColor]),
+                                  @"shadowColor": SKMutableObject(node.layer.shadowColor),
                                   @"shadowOpacity": SKMutableObject(@(node.layer.shadowOpacity)),
                                   @"shadowRadius": SKMutableObject(@(node.layer.shadowRadius)),
                                   @"shadowOffset": SKMutableObject(node.layer.shadowOffset),
-                                  @"backgroundColor": SKMutableObject([UIColor colorWithCGColor:node.layer.backgroundColor]),
-                                  @"borderColor": SKMutableObject([UIColor colorWithCGColor:node.layer.borderColor]),
+                                  @"backgroundColor": SKMutableObject(node.layer.backgroundColor),
+                                  @"borderColor": SKMutableObject(node.layer.borderColor),
                                   @"borderWidth": SKMutableObject(@(node.layer.borderWidth)),
                                   @"cornerRadius": SKMutableObject(@(node.layer.cornerRadius)),
                                   @"masksToBounds": SKMutableObject(@(node.layer.masksToBounds)),
@@ -177,68 +181,68 @@ static NSDictionary *YGUnitEnumMap = nil;
           nil];
 }
 
-- (NSDictionary<NSString *, SKNodeUpdateData> *)dataMutationsForNode:(UIView *)node {
++ (NSDictionary<NSString *, SKNodeMutation> *)dataMutations {
   return @{
     // UIView
-    @"UIView.alpha": ^(NSNumber *value) {
+    @"UIView.alpha": ^(UIView *node, NSNumber *value) {
       node.alpha = [value floatValue];
     },
-    @"UIView.backgroundColor": ^(NSNumber *value) {
+    @"UIView.backgroundColor": ^(UIView *node, NSNumber *value) {
       node.backgroundColor = [UIColor fromSonarValue: value];
     },
-    @"UIView.frame.origin.y": ^(NSNumber *value) {
+    @"UIView.frame.origin.y": ^(UIView *node, NSNumber *value) {
       CGRect frame = node.frame;
       frame.origin.y = [value floatValue];
       node.frame = frame;
     },
-    @"UIView.frame.origin.x": ^(NSNumber *value) {
+    @"UIView.frame.origin.x": ^(UIView *node, NSNumber *value) {
       CGRect frame = node.frame;
       frame.origin.x = [value floatValue];
       node.frame = frame;
     },
-    @"UIView.frame.size.width": ^(NSNumber *value) {
+    @"UIView.frame.size.width": ^(UIView *node, NSNumber *value) {
       CGRect frame = node.frame;
       frame.size.width = [value floatValue];
       node.frame = frame;
     },
-    @"UIView.frame.size.height": ^(NSNumber *value) {
+    @"UIView.frame.size.height": ^(UIView *node, NSNumber *value) {
       CGRect frame = node.frame;
       frame.size.width = [value floatValue];
       node.frame = frame;
     },
     // CALayer
-    @"CALayer.shadowColor": ^(NSNumber *value) {
+    @"CALayer.shadowColor": ^(UIView *node, NSNumber *value) {
       node.layer.shadowColor = [UIColor fromSonarValue:value].CGColor;
     },
-    @"CALayer.shadowOpacity": ^(NSNumber *value) {
+    @"CALayer.shadowOpacity": ^(UIView *node, NSNumber *value) {
       node.layer.shadowOpacity = [value floatValue];
     },
-    @"CALayer.shadowRadius": ^(NSNumber *value) {
+    @"CALayer.shadowRadius": ^(UIView *node, NSNumber *value) {
       node.layer.shadowRadius = [value floatValue];
     },
-    @"CALayer.shadowOffset.width": ^(NSNumber *value) {
+    @"CALayer.shadowOffset.width": ^(UIView *node, NSNumber *value) {
       CGSize offset = node.layer.shadowOffset;
       offset.width = [value floatValue];
       node.layer.shadowOffset = offset;
     },
-    @"CALayer.shadowOffset.height": ^(NSNumber *value) {
+    @"CALayer.shadowOffset.height": ^(UIView *node, NSNumber *value) {
       CGSize offset = node.layer.shadowOffset;
       offset.height = [value floatValue];
       node.layer.shadowOffset = offset;
     },
-    @"CALayer.backgroundColor": ^(NSNumber *value) {
+    @"CALayer.backgroundColor": ^(UIView *node, NSNumber *value) {
       node.layer.backgroundColor = [UIColor fromSonarValue:value].CGColor;
     },
-    @"CALayer.borderColor": ^(NSNumber *value) {
+    @"CALayer.borderColor": ^(UIView *node, NSNumber *value) {
       node.layer.borderColor = [UIColor fromSonarValue:value].CGColor;
     },
-    @"CALayer.borderWidth": ^(NSNumber *value) {
+    @"CALayer.borderWidth": ^(UIView *node, NSNumber *value) {
       node.layer.borderWidth = [value floatValue];
     },
-    @"CALayer.cornerRadius": ^(NSNumber *value) {
+    @"CALayer.cornerRadius": ^(UIView *node, NSNumber *value) {
       node.layer.cornerRadius = [value floatValue];
     },
-    @"CALayer.masksToBounds": ^(NSNumber *value) {
+    @"CALayer.masksToBounds": ^(UIView *node, NSNumber *value) {
       node.layer.masksToBounds = [value boolValue];
     },
     // YGLayout
@@ -264,10 +268,10 @@ static NSDictionary *YGUnitEnumMap = nil;
     @"YGLayout.display": APPLY_ENUM_TO_YOGA_PROPERTY(display, YGDisplay),
     @"YGLayout.flex.flexDirection": APPLY_ENUM_TO_YOGA_PROPERTY(flexDirection, YGFlexDirection),
     @"YGLayout.flex.flexWrap": APPLY_ENUM_TO_YOGA_PROPERTY(flexWrap, YGWrap),
-    @"YGLayout.flex.flexGrow": ^(NSNumber *value) {
+    @"YGLayout.flex.flexGrow": ^(UIView *node, NSNumber *value) {
       node.yoga.flexGrow = [value floatValue];
     },
-    @"YGLayout.flex.flexShrink": ^(NSNumber *value) {
+    @"YGLayout.flex.flexShrink": ^(UIView *node, NSNumber *value) {
       node.yoga.flexShrink = [value floatValue];
     },
     @"YGLayout.flex.flexBasis.value": APPLY_VALUE_TO_YGVALUE(flexBasis),
@@ -308,25 +312,25 @@ static NSDictionary *YGUnitEnumMap = nil;
     @"YGLayout.padding.vertical.unit": APPLY_UNIT_TO_YGVALUE(paddingVertical, YGUnit),
     @"YGLayout.padding.all.value": APPLY_VALUE_TO_YGVALUE(padding),
     @"YGLayout.padding.all.unit": APPLY_UNIT_TO_YGVALUE(padding, YGUnit),
-    @"YGLayout.border.leftWidth": ^(NSNumber *value) {
+    @"YGLayout.border.leftWidth": ^(UIView *node, NSNumber *value) {
       node.yoga.borderLeftWidth = [value floatValue];
     },
-    @"YGLayout.border.topWidth": ^(NSNumber *value) {
+    @"YGLayout.border.topWidth": ^(UIView *node, NSNumber *value) {
       node.yoga.borderTopWidth = [value floatValue];
     },
-    @"YGLayout.border.rightWidth": ^(NSNumber *value) {
+    @"YGLayout.border.rightWidth": ^(UIView *node, NSNumber *value) {
       node.yoga.borderRightWidth = [value floatValue];
     },
-    @"YGLayout.border.bottomWidth": ^(NSNumber *value) {
+    @"YGLayout.border.bottomWidth": ^(UIView *node, NSNumber *value) {
       node.yoga.borderBottomWidth = [value floatValue];
     },
-    @"YGLayout.border.startWidth": ^(NSNumber *value) {
+    @"YGLayout.border.startWidth": ^(UIView *node, NSNumber *value) {
       node.yoga.borderStartWidth = [value floatValue];
     },
-    @"YGLayout.border.endWidth": ^(NSNumber *value) {
+    @"YGLayout.border.endWidth": ^(UIView *node, NSNumber *value) {
       node.yoga.borderEndWidth = [value floatValue];
     },
-    @"YGLayout.border.all": ^(NSNumber *value) {
+    @"YGLayout.border.all": ^(UIView *node, NSNumber *value) {
       node.yoga.borderWidth = [value floatValue];
     },
     @"YGLayout.dimensions.width.value": APPLY_VALUE_TO_YGVALUE(width),
@@ -341,77 +345,77 @@ static NSDictionary *YGUnitEnumMap = nil;
     @"YGLayout.dimensions.maxWidth.unit": APPLY_UNIT_TO_YGVALUE(maxWidth, YGUnit),
     @"YGLayout.dimensions.maxHeight.value": APPLY_VALUE_TO_YGVALUE(maxHeight),
     @"YGLayout.dimensions.maxHeight.unit": APPLY_UNIT_TO_YGVALUE(maxHeight, YGUnit),
-    @"YGLayout.aspectRatio": ^(NSNumber *value) {
+    @"YGLayout.aspectRatio": ^(UIView *node, NSNumber *value) {
       node.yoga.aspectRatio = [value floatValue];
     },
     // Accessibility
-    @"Accessibility.isAccessibilityElement": ^(NSNumber *value) {
+    @"Accessibility.isAccessibilityElement": ^(UIView *node, NSNumber *value) {
       node.isAccessibilityElement = [value boolValue];
     },
-    @"Accessibility.accessibilityLabel": ^(NSString *value) {
+    @"Accessibility.accessibilityLabel": ^(UIView *node, NSString *value) {
       node.accessibilityLabel = value;
     },
-    @"Accessibility.accessibilityValue": ^(NSString *value) {
+    @"Accessibility.accessibilityValue": ^(UIView *node, NSString *value) {
       node.accessibilityValue = value;
     },
-    @"Accessibility.accessibilityHint": ^(NSString *value) {
+    @"Accessibility.accessibilityHint": ^(UIView *node, NSString *value) {
       node.accessibilityHint = value;
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitButton": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitButton": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitButton, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitLink": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitLink": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitLink, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitHeader": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitHeader": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitHeader, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitSearchField": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitSearchField": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitSearchField, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitImage": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitImage": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitImage, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitSelected": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitSelected": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitSelected, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitPlaysSound": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitPlaysSound": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitPlaysSound, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitKeyboardKey": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitKeyboardKey": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitKeyboardKey, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitStaticText": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitStaticText": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitStaticText, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitSummaryElement": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitSummaryElement": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitSummaryElement, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitNotEnabled": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitNotEnabled": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitNotEnabled, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitUpdatesFrequently": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitUpdatesFrequently": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitUpdatesFrequently, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitStartsMediaSession": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitStartsMediaSession": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitStartsMediaSession, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitAdjustable": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitAdjustable": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitAdjustable, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitAllowsDirectInteraction": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitAllowsDirectInteraction": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitAllowsDirectInteraction, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitCausesPageTurn": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitCausesPageTurn": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitCausesPageTurn, [value boolValue]);
     },
-    @"Accessibility.accessibilityTraits.UIAccessibilityTraitTabBar": ^(NSNumber *value) {
+    @"Accessibility.accessibilityTraits.UIAccessibilityTraitTabBar": ^(UIView *node, NSNumber *value) {
       node.accessibilityTraits = AccessibilityTraitsToggle(node.accessibilityTraits, UIAccessibilityTraitTabBar, [value boolValue]);
     },
-    @"Accessibility.accessibilityViewIsModal": ^(NSNumber *value) {
+    @"Accessibility.accessibilityViewIsModal": ^(UIView *node, NSNumber *value) {
       node.accessibilityViewIsModal = [value boolValue];
     },
-    @"Accessibility.shouldGroupAccessibilityChildren": ^(NSNumber *value) {
+    @"Accessibility.shouldGroupAccessibilityChildren": ^(UIView *node, NSNumber *value) {
       node.shouldGroupAccessibilityChildren = [value boolValue];
     },
   };
@@ -420,7 +424,7 @@ static NSDictionary *YGUnitEnumMap = nil;
 - (NSArray<SKNamed<NSString *> *> *)attributesForNode:(UIView *)node {
   return @[
            [SKNamed newWithName: @"addr"
-                      withValue: [NSString stringWithFormat: @"%p", node]]
+                      withValue: SKObjectIdentifier(node)]
            ];
 }
 
@@ -434,8 +438,9 @@ static NSDictionary *YGUnitEnumMap = nil;
 }
 
 - (void)hitTest:(SKTouch *)touch forNode:(UIView *)node {
-  for (NSInteger index = [self childCountForNode: node] - 1; index >= 0; index--) {
-    id<NSObject> childNode = [self childForNode: node atIndex: index];
+  NSArray *children = [self validChildrenForNode: node];
+  for (NSInteger index = children.count - 1; index >= 0; index--) {
+    id<NSObject> childNode = children[index];
     UIView *viewForNode = nil;
 
     if ([childNode isKindOfClass: [UIViewController class]]) {
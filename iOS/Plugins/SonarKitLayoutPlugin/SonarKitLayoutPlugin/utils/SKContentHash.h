@@ -0,0 +1,27 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#import <Foundation/Foundation.h>
+
+/*
+ 64 bit FNV-1a hash of a tree of Foundation values, as sent to Sonar:
+ strings, numbers, arrays, dictionaries and NSNull. Equal trees hash the same
+ regardless of dictionary ordering, so it can be used to tell whether a node
+ has changed since the desktop last fetched it. Any other object is hashed
+ with -hash.
+ */
+uint64_t SKContentHash(id object);
+
+/*
+ 64 bit FNV-1a hash of the bytes of data, such as an encoded image.
+ */
+uint64_t SKContentHashData(NSData *data);
+
+/*
+ The hash as a string, as JavaScript numbers can't hold 64 bit integers.
+ */
+NSString *SKContentHashString(uint64_t hash);
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#if FB_SONARKIT_ENABLED
+
+#import "SKContentHash.h"
+
+static const uint64_t kFNVOffsetBasis = 14695981039346656037ULL;
+static const uint64_t kFNVPrime = 1099511628211ULL;
+
+static uint64_t hashBytes(uint64_t hash, const void *bytes, size_t length) {
+  const uint8_t *p = (const uint8_t *)bytes;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= p[i];
+    hash *= kFNVPrime;
+  }
+  return hash;
+}
+
+template <typename T>
+static uint64_t hashValue(uint64_t hash, T value) {
+  return hashBytes(hash, &value, sizeof(value));
+}
+
+static uint64_t hashString(uint64_t hash, NSString *string) {
+  const CFIndex length = CFStringGetLength((__bridge CFStringRef)string);
+  hash = hashValue(hash, length);
+  const UniChar *characters = CFStringGetCharactersPtr((__bridge CFStringRef)string);
+  if (characters) {
+    return hashBytes(hash, characters, length * sizeof(UniChar));
+  }
+  UniChar buffer[64];
+  for (CFIndex start = 0; start < length; start += 64) {
+    const CFIndex count = MIN(64, length - start);
+    CFStringGetCharacters((__bridge CFStringRef)string, CFRangeMake(start, count), buffer);
+    hash = hashBytes(hash, buffer, count * sizeof(UniChar));
+  }
+  return hash;
+}
+
+static uint64_t hashObject(uint64_t hash, id object) {
+  if ([object isKindOfClass:[NSString class]]) {
+    return hashString(hashValue(hash, 's'), object);
+  }
+  if ([object isKindOfClass:[NSNumber class]]) {
+    NSNumber *number = object;
+    if (CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID()) {
+      return hashValue(hashValue(hash, 'b'), (uint8_t)[number boolValue]);
+    }
+    if (CFNumberIsFloatType((__bridge CFNumberRef)number)) {
+      return hashValue(hashValue(hash, 'd'), [number doubleValue]);
+    }
+    return hashValue(hashValue(hash, 'i'), [number longLongValue]);
+  }
+  if ([object isKindOfClass:[NSArray class]]) {
+    hash = hashValue(hashValue(hash, 'a'), (uint64_t)[object count]);
+    for (id element in object) {
+      hash = hashObject(hash, element);
+    }
+    return hash;
+  }
+  if ([object isKindOfClass:[NSDictionary class]]) {
+    // Entries are combined with a sum so that the order they are enumerated in
+    // doesn't matter.
+    __block uint64_t entries = 0;
+    [object enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+      entries += hashObject(hashObject(kFNVOffsetBasis, key), value);
+    }];
+    return hashValue(hashValue(hashValue(hash, 'o'), (uint64_t)[object count]), entries);
+  }
+  if (object == nil || object == [NSNull null]) {
+    return hashValue(hash, 'n');
+  }
+  return hashValue(hashValue(hash, '?'), (uint64_t)[object hash]);
+}
+
+uint64_t SKContentHash(id object) {
+  return hashObject(kFNVOffsetBasis, object);
+}
+
+uint64_t SKContentHashData(NSData *data) {
+  return hashBytes(kFNVOffsetBasis, data.bytes, data.length);
+}
+
+NSString *SKContentHashString(uint64_t hash) {
+  return [NSString stringWithFormat:@"%016llx", hash];
+}
+
+#endif
@@ -0,0 +1,22 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#import <UIKit/UIKit.h>
+
+/*
+ Copies what the screen last showed of view into an image no larger than
+ maxPixels on either side, without committing pending changes or rendering the
+ layer tree again, which keeps it to a fraction of a frame. Must be called on
+ the main thread. Returns nil for views that aren't in a window.
+ */
+UIImage *SKSnapshotCapture(UIView *view, CGFloat maxPixels);
+
+/*
+ Scales image down to fit maxPixels and encodes it as JPEG, setting size to the
+ size of the encoded image. Can be called on any thread.
+ */
+NSData *SKSnapshotEncode(UIImage *image, CGFloat maxPixels, CGSize *size);
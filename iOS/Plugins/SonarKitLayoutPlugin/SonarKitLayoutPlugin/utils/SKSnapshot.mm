@@ -0,0 +1,60 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#if FB_SONARKIT_ENABLED
+
+#import "SKSnapshot.h"
+
+static const CGFloat kJPEGQuality = 0.8;
+
+UIImage *SKSnapshotCapture(UIView *view, CGFloat maxPixels) {
+  const CGSize size = view.bounds.size;
+  if (view.window == nil || size.width <= 0 || size.height <= 0) {
+    return nil;
+  }
+  const CGFloat scale = MIN(view.window.screen.scale, maxPixels / MAX(size.width, size.height));
+  UIGraphicsBeginImageContextWithOptions(size, NO, scale);
+  const BOOL drawn = [view drawViewHierarchyInRect: view.bounds afterScreenUpdates: NO];
+  UIImage *image = drawn ? UIGraphicsGetImageFromCurrentImageContext() : nil;
+  UIGraphicsEndImageContext();
+  return image;
+}
+
+NSData *SKSnapshotEncode(UIImage *image, CGFloat maxPixels, CGSize *size) {
+  CGImageRef source = image.CGImage;
+  const size_t sourceWidth = CGImageGetWidth(source);
+  const size_t sourceHeight = CGImageGetHeight(source);
+  if (sourceWidth == 0 || sourceHeight == 0) {
+    return nil;
+  }
+  const CGFloat scale = MIN(1, maxPixels / MAX(sourceWidth, sourceHeight));
+  const size_t width = MAX(1, (size_t)round(sourceWidth * scale));
+  const size_t height = MAX(1, (size_t)round(sourceHeight * scale));
+
+  CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+  CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, kCGImageAlphaNoneSkipLast);
+  CGColorSpaceRelease(colorSpace);
+  if (context == NULL) {
+    return nil;
+  }
+  // JPEG has no alpha, so transparent areas are shown against white.
+  CGContextSetRGBFillColor(context, 1, 1, 1, 1);
+  CGContextFillRect(context, CGRectMake(0, 0, width, height));
+  CGContextSetInterpolationQuality(context, kCGInterpolationHigh);
+  CGContextDrawImage(context, CGRectMake(0, 0, width, height), source);
+  CGImageRef scaled = CGBitmapContextCreateImage(context);
+  CGContextRelease(context);
+
+  NSData *data = UIImageJPEGRepresentation([UIImage imageWithCGImage: scaled], kJPEGQuality);
+  CGImageRelease(scaled);
+  if (size != NULL) {
+    *size = CGSizeMake(width, height);
+  }
+  return data;
+}
+
+#endif
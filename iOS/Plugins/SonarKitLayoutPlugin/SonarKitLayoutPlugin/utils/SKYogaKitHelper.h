@@ -8,21 +8,21 @@
 #import <Foundation/Foundation.h>
 
 #define APPLY_ENUM_TO_YOGA_PROPERTY(varName, enumName) \
-^(NSString *newValue) { \
+^(UIView *node, NSString *newValue) { \
 NSNumber *varName = [[enumName##EnumMap allKeysForObject:newValue] lastObject]; \
 if (varName == nil) { return; } \
 node.yoga.varName = (enumName)[varName unsignedIntegerValue]; \
 }
 
 #define APPLY_VALUE_TO_YGVALUE(varName) \
-^(NSNumber *value) { \
+^(UIView *node, NSNumber *value) { \
 YGValue newValue = node.yoga.varName; \
 newValue.value = [value floatValue]; \
 node.yoga.varName = newValue; \
 }
 
 #define APPLY_UNIT_TO_YGVALUE(varName, enumName) \
-^(NSString *value) { \
+^(UIView *node, NSString *value) { \
 NSNumber *varName = [[enumName##EnumMap allKeysForObject:value] lastObject]; \
 if (varName == nil) { return; } \
 YGValue newValue = node.yoga.varName; \
@@ -10,6 +10,7 @@
 #if FB_SONARKIT_ENABLED
 
 #import <SonarKitLayoutPlugin/SKDescriptorMapper.h>
+#import <SonarKitLayoutPlugin/SKInvalidation.h>
 #import <SonarKitLayoutPlugin/SKNodeDescriptor.h>
 #import <SonarKitLayoutPlugin/SonarKitLayoutPlugin.h>
 #import <SonarKitTestUtils/SonarConnectionMock.h>
@@ -19,6 +20,21 @@
 #import "TestNode.h"
 #import "TestNodeDescriptor.h"
 
+@interface SKInvalidationRecorder : NSObject<SKInvalidationDelegate>
+@property (nonatomic, assign) NSUInteger invalidations;
+@end
+
+@implementation SKInvalidationRecorder
+
+- (void)invalidateNode:(id<NSObject>)node {
+  _invalidations++;
+}
+
+- (void)updateNodeReference:(id<NSObject>)node {
+}
+
+@end
+
 @interface SonarKitLayoutPluginTests : XCTestCase
 @end
 
@@ -245,6 +261,140 @@
   XCTAssertTrue([testNode3.nodeName isEqualToString: @"changedNameForTestNode3"]);
 }
 
+- (void)testSetDataMany {
+  TestNode *rootNode = [[TestNode alloc] initWithName: @"rootNode"
+                                            withFrame: CGRectMake(0, 0, 20, 60)];
+
+  TestNode *testNode1 = [[TestNode alloc] initWithName: @"testNode1"
+                                             withFrame: CGRectMake(20, 20, 20, 20)];
+  TestNode *testNode2 = [[TestNode alloc] initWithName: @"testNode2"
+                                             withFrame: CGRectMake(20, 40, 20, 20)];
+
+  rootNode.children = @[ testNode1, testNode2 ];
+
+  SKTapListenerMock *tapListener = [SKTapListenerMock new];
+  SonarKitLayoutPlugin *plugin = [[SonarKitLayoutPlugin alloc] initWithRootNode: rootNode
+                                                                withTapListener: tapListener
+                                                           withDescriptorMapper: _descriptorMapper];
+
+  SonarConnectionMock *connection = [SonarConnectionMock new];
+  SonarResponderMock *responder = [SonarResponderMock new];
+  [plugin didConnect:connection];
+
+  connection.receivers[@"getRoot"](@{}, responder);
+
+  // Edits are applied in order, and untracked nodes are skipped.
+  connection.receivers[@"setDataMany"](@{
+                                         @"edits": @[
+                                           @{ @"id": @"testNode1", @"path": @[ @"TestNode", @"name" ], @"value": @"first" },
+                                           @{ @"id": @"testNode2", @"path": @[ @"TestNode", @"name" ], @"value": @"second" },
+                                           @{ @"id": @"testNode1", @"path": @[ @"TestNode", @"name" ], @"value": @"third" },
+                                           @{ @"id": @"unknown", @"path": @[ @"TestNode", @"name" ], @"value": @"fourth" },
+                                           ],
+                                         }, responder);
+
+  XCTAssertTrue([testNode1.nodeName isEqualToString: @"third"]);
+  XCTAssertTrue([testNode2.nodeName isEqualToString: @"second"]);
+}
+
+- (void)testGetNodesTracksOnlyChildrenInRange {
+  TestNode *rootNode = [[TestNode alloc] initWithName: @"rootNode"];
+  SonarKitLayoutPlugin *plugin = [[SonarKitLayoutPlugin alloc] initWithRootNode: rootNode
+                                                                withTapListener: nil
+                                                           withDescriptorMapper: _descriptorMapper];
+
+  SonarConnectionMock *connection = [SonarConnectionMock new];
+  SonarResponderMock *responder = [SonarResponderMock new];
+  [plugin didConnect:connection];
+
+  // Tracks the root while it has no children yet.
+  connection.receivers[@"getRoot"](@{}, responder);
+
+  NSMutableArray<TestNode *> *children = [NSMutableArray new];
+  for (NSUInteger i = 0; i < 4; i++) {
+    [children addObject: [[TestNode alloc] initWithName: [NSString stringWithFormat: @"testNode%lu", (unsigned long)i]]];
+  }
+  rootNode.children = children;
+
+  connection.receivers[@"getNodes"](@{
+                                      @"ids": @[ @"rootNode" ],
+                                      @"childrenRange": @{ @"offset": @1, @"limit": @2 },
+                                      }, responder);
+
+  // Edits to nodes that aren't tracked are skipped.
+  NSMutableArray *edits = [NSMutableArray new];
+  for (TestNode *child in children) {
+    [edits addObject: @{ @"id": child.nodeName, @"path": @[ @"TestNode", @"name" ], @"value": @"edited" }];
+  }
+  connection.receivers[@"setDataMany"](@{ @"edits": edits }, responder);
+
+  XCTAssertEqualObjects(children[0].nodeName, @"testNode0");
+  XCTAssertEqualObjects(children[1].nodeName, @"edited");
+  XCTAssertEqualObjects(children[2].nodeName, @"edited");
+  XCTAssertEqualObjects(children[3].nodeName, @"testNode3");
+}
+
+- (void)testGetNodesPrefetchesTheNextLevel {
+  TestNode *rootNode = [[TestNode alloc] initWithName: @"rootNode"];
+  SonarKitLayoutPlugin *plugin = [[SonarKitLayoutPlugin alloc] initWithRootNode: rootNode
+                                                                withTapListener: nil
+                                                           withDescriptorMapper: _descriptorMapper];
+  plugin.prefetchLevels = 1;
+
+  SonarConnectionMock *connection = [SonarConnectionMock new];
+  SonarResponderMock *responder = [SonarResponderMock new];
+  [plugin didConnect:connection];
+  connection.receivers[@"getRoot"](@{}, responder);
+
+  TestNode *child = [[TestNode alloc] initWithName: @"child"];
+  TestNode *grandchild = [[TestNode alloc] initWithName: @"grandchild"];
+  TestNode *greatGrandchild = [[TestNode alloc] initWithName: @"greatGrandchild"];
+  grandchild.children = @[ greatGrandchild ];
+  child.children = @[ grandchild ];
+  rootNode.children = @[ child ];
+
+  connection.receivers[@"getNodes"](@{ @"ids": @[ @"rootNode" ] }, responder);
+
+  // Capturing the prefetched child tracked its children, but only one level
+  // was prefetched.
+  connection.receivers[@"setDataMany"](@{ @"edits": @[
+    @{ @"id": @"grandchild", @"path": @[ @"TestNode", @"name" ], @"value": @"edited" },
+    @{ @"id": @"greatGrandchild", @"path": @[ @"TestNode", @"name" ], @"value": @"edited" },
+  ] }, responder);
+
+  XCTAssertEqualObjects(grandchild.nodeName, @"edited");
+  XCTAssertEqualObjects(greatGrandchild.nodeName, @"greatGrandchild");
+}
+
+- (void)testDisabledInvalidations {
+  SKInvalidationRecorder *recorder = [SKInvalidationRecorder new];
+  id<SKInvalidationDelegate> previousDelegate = [SKInvalidation sharedInstance].delegate;
+  [SKInvalidation sharedInstance].delegate = recorder;
+
+  UIView *parent = [UIView new];
+  UIView *child = [UIView new];
+
+  [SKInvalidation enableInvalidations];
+  [parent addSubview: child];
+  XCTAssertEqual(recorder.invalidations, 1u);
+
+  [SKInvalidation disableInvalidations];
+  [child removeFromSuperview];
+  [parent addSubview: child];
+  child.hidden = YES;
+  XCTAssertEqual(recorder.invalidations, 1u);
+
+  // What every view mutation in the app pays while disconnected.
+  [self measureBlock:^{
+    for (int i = 0; i < 100000; i++) {
+      child.hidden = (i & 1);
+    }
+  }];
+  XCTAssertEqual(recorder.invalidations, 1u);
+
+  [SKInvalidation sharedInstance].delegate = previousDelegate;
+}
+
 @end
 
 #endif
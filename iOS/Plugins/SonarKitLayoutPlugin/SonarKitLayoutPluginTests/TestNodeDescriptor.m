@@ -39,9 +39,9 @@
   [touch finish];
 }
 
-- (NSDictionary<NSString *, SKNodeUpdateData> *)dataMutationsForNode:(TestNode *)node {
++ (NSDictionary<NSString *, SKNodeMutation> *)dataMutations {
   return @{
-           @"TestNode.name": ^(NSString *newName) {
+           @"TestNode.name": ^(TestNode *node, NSString *newName) {
              node.nodeName = newName;
            }
            };
@@ -0,0 +1,29 @@
+//
+//  FLEXNetworkBodyAccumulator.h
+//  Copyright 2004-present Facebook. All Rights Reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/// Collects a response body as it arrives, without holding all of it in memory. The first headLimit bytes are kept,
+/// then either the last tailLimit bytes, or, when spilling to disk, everything after the head, streamed to a
+/// temporary file. Not thread safe.
+@interface FLEXNetworkBodyAccumulator : NSObject
+
+- (instancetype)initWithExpectedLength:(int64_t)expectedLength
+                             headLimit:(NSUInteger)headLimit
+                             tailLimit:(NSUInteger)tailLimit
+                          spillsToDisk:(BOOL)spillsToDisk;
+
+- (void)appendData:(NSData *)data;
+
+/// How many bytes were appended, including the ones that weren't kept.
+@property (nonatomic, readonly) int64_t length;
+
+/// Whether the body leaves bytes out, between its head and its tail.
+@property (nonatomic, readonly, getter=isTruncated) BOOL truncated;
+
+/// The head followed by the tail, or the whole body mapped from its spill file. Ends the accumulation.
+- (NSData *)body;
+
+@end
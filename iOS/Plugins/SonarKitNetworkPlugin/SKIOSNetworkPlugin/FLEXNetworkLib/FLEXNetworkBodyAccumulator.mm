@@ -0,0 +1,168 @@
+//
+//  FLEXNetworkBodyAccumulator.mm
+//  Copyright 2004-present Facebook. All Rights Reserved.
+//
+
+#import "FLEXNetworkBodyAccumulator.h"
+
+@implementation FLEXNetworkBodyAccumulator
+{
+    NSUInteger _headLimit;
+    NSUInteger _tailLimit;
+    BOOL _spillsToDisk;
+    NSMutableData *_head;
+    // Up to twice tailLimit, trimmed when it gets there, so that bytes aren't moved on every append.
+    NSMutableData *_tail;
+    NSString *_spillPath;
+    NSFileHandle *_spillFile;
+    NSData *_body;
+}
+
+- (instancetype)initWithExpectedLength:(int64_t)expectedLength
+                             headLimit:(NSUInteger)headLimit
+                             tailLimit:(NSUInteger)tailLimit
+                          spillsToDisk:(BOOL)spillsToDisk
+{
+    self = [super init];
+    if (self) {
+        _headLimit = headLimit;
+        _tailLimit = tailLimit;
+        _spillsToDisk = spillsToDisk;
+        NSUInteger capacity = expectedLength > 0 ? (NSUInteger)MIN((uint64_t)expectedLength, (uint64_t)headLimit) : 0;
+        _head = [[NSMutableData alloc] initWithCapacity:capacity];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self closeSpillFile];
+}
+
+- (void)appendData:(NSData *)data
+{
+    if (_body || data.length == 0) {
+        return;
+    }
+    _length += data.length;
+
+    if (_spillFile) {
+        [self writeToSpillFile:data];
+        return;
+    }
+
+    NSUInteger headBytes = MIN(_headLimit - _head.length, data.length);
+    if (headBytes > 0) {
+        [_head appendBytes:data.bytes length:headBytes];
+    }
+    if (headBytes == data.length) {
+        return;
+    }
+    NSData *rest = [data subdataWithRange:NSMakeRange(headBytes, data.length - headBytes)];
+
+    if (_spillsToDisk && [self openSpillFile]) {
+        [self writeToSpillFile:rest];
+        return;
+    }
+
+    if (_tailLimit == 0) {
+        _truncated = YES;
+        return;
+    }
+    if (!_tail) {
+        _tail = [[NSMutableData alloc] initWithCapacity:2 * _tailLimit];
+    }
+    [_tail appendData:rest];
+    if (_tail.length > 2 * _tailLimit) {
+        [self trimTail];
+    }
+}
+
+- (void)trimTail
+{
+    if (_tail.length > _tailLimit) {
+        _truncated = YES;
+        [_tail replaceBytesInRange:NSMakeRange(0, _tail.length - _tailLimit) withBytes:NULL length:0];
+    }
+}
+
+- (NSData *)body
+{
+    if (_body) {
+        return _body;
+    }
+
+    if (_spillPath) {
+        [_spillFile closeFile];
+        _spillFile = nil;
+        // Mapped, so that the body doesn't count against the app's memory. The mapping outlives the file.
+        NSData *mapped = [NSData dataWithContentsOfFile:_spillPath options:NSDataReadingMappedAlways error:NULL];
+        [[NSFileManager defaultManager] removeItemAtPath:_spillPath error:NULL];
+        _spillPath = nil;
+        if (mapped) {
+            _body = mapped;
+            _head = nil;
+            return _body;
+        }
+        // The head is still in memory, but the rest is gone.
+        _truncated = YES;
+    }
+
+    if (_tail.length > 0) {
+        [self trimTail];
+        [_head appendData:_tail];
+        _tail = nil;
+    }
+    _body = [_head copy];
+    _head = nil;
+    return _body;
+}
+
+#pragma mark - Spilling
+
+- (BOOL)openSpillFile
+{
+    NSString *directory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"FLEXNetworkBodies"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    NSString *path = [directory stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    if (![[NSFileManager defaultManager] createFileAtPath:path contents:_head attributes:nil]) {
+        _spillsToDisk = NO;
+        return NO;
+    }
+    NSFileHandle *file = [NSFileHandle fileHandleForWritingAtPath:path];
+    if (!file) {
+        [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+        _spillsToDisk = NO;
+        return NO;
+    }
+    [file seekToEndOfFile];
+    _spillPath = path;
+    _spillFile = file;
+    return YES;
+}
+
+- (void)writeToSpillFile:(NSData *)data
+{
+    @try {
+        [_spillFile writeData:data];
+    } @catch (NSException *exception) {
+        // Out of space, most likely. What was written is kept, and the rest dropped.
+        [_spillFile closeFile];
+        _spillFile = nil;
+        _spillsToDisk = NO;
+        _truncated = YES;
+        _tailLimit = 0;
+    }
+}
+
+- (void)closeSpillFile
+{
+    [_spillFile closeFile];
+    _spillFile = nil;
+    if (_spillPath) {
+        [[NSFileManager defaultManager] removeItemAtPath:_spillPath error:NULL];
+        _spillPath = nil;
+    }
+}
+
+@end
@@ -0,0 +1,39 @@
+//
+//  FLEXNetworkBodyStore.h
+//  Copyright 2004-present Facebook. All Rights Reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/// Keeps response bodies on disk, in the app's caches directory, so that they stay available long after they'd
+/// have been evicted from memory. Bodies are appended to segment files and read back mapped from them. Once the
+/// bodies stored add up to more than byteLimit, the least recently used ones are dropped, and a segment is deleted
+/// once none of its bodies are left. The store starts out empty, as request IDs don't outlive a launch.
+/// Thread safe.
+@interface FLEXNetworkBodyStore : NSObject
+
+- (instancetype)initWithDirectory:(NSString *)directory byteLimit:(NSUInteger)byteLimit;
+
+/// A store in the app's caches directory.
+- (instancetype)initWithByteLimit:(NSUInteger)byteLimit;
+
+/// The most bytes the stored bodies take up on disk, before compression is taken into account.
+@property (atomic, assign) NSUInteger byteLimit;
+
+/// If YES, bodies stored from then on are compressed with zlib, trading CPU time on store and read for disk space.
+@property (atomic, assign) BOOL compressesBodies;
+
+/// Stores body for requestID, replacing the one stored before, if any.
+- (void)storeBody:(NSData *)body forRequestID:(NSString *)requestID;
+
+/// The body stored for requestID, mapped unless it was compressed, or nil if there is none.
+- (NSData *)bodyForRequestID:(NSString *)requestID;
+
+- (void)removeBodyForRequestID:(NSString *)requestID;
+
+- (void)removeAllBodies;
+
+/// How many bytes the bodies stored take up on disk.
+@property (nonatomic, readonly) NSUInteger storedBytes;
+
+@end
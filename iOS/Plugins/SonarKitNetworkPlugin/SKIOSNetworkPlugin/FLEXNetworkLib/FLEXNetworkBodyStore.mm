@@ -0,0 +1,314 @@
+//
+//  FLEXNetworkBodyStore.mm
+//  Copyright 2004-present Facebook. All Rights Reserved.
+//
+
+#import "FLEXNetworkBodyStore.h"
+
+#import <compression.h>
+
+#import <list>
+#import <string>
+#import <unordered_map>
+
+namespace {
+
+// Bodies are appended to the current segment until it reaches this size. A larger body gets a segment of its own.
+const NSUInteger kSegmentBytes = 8 * 1024 * 1024;
+
+struct FLEXBodyEntry {
+    NSUInteger segment;
+    NSUInteger offset;
+    // On disk, and before compression.
+    NSUInteger length;
+    NSUInteger originalLength;
+    bool compressed;
+    // Where the entry is in the LRU list.
+    std::list<std::string>::iterator lruPosition;
+};
+
+struct FLEXSegment {
+    NSUInteger length = 0;
+    NSUInteger liveEntries = 0;
+    // The segment mapped as of length, remapped when an entry past it is read.
+    NSData *mapped = nil;
+};
+
+NSData *compressedData(NSData *data)
+{
+    NSMutableData *compressed = [NSMutableData dataWithLength:data.length];
+    size_t size = compression_encode_buffer(
+        (uint8_t *)compressed.mutableBytes, compressed.length,
+        (const uint8_t *)data.bytes, data.length,
+        nullptr, COMPRESSION_ZLIB);
+    if (size == 0) {
+        // Didn't fit in the original size, so isn't worth it.
+        return nil;
+    }
+    compressed.length = size;
+    return compressed;
+}
+
+NSData *decompressedData(NSData *data, NSUInteger originalLength)
+{
+    NSMutableData *decompressed = [NSMutableData dataWithLength:originalLength];
+    size_t size = compression_decode_buffer(
+        (uint8_t *)decompressed.mutableBytes, decompressed.length,
+        (const uint8_t *)data.bytes, data.length,
+        nullptr, COMPRESSION_ZLIB);
+    return size == originalLength ? decompressed : nil;
+}
+
+}
+
+@implementation FLEXNetworkBodyStore
+{
+    NSString *_directory;
+    dispatch_queue_t _queue;
+    std::unordered_map<std::string, FLEXBodyEntry> _entries;
+    // Least recently used first.
+    std::list<std::string> _lru;
+    std::unordered_map<NSUInteger, FLEXSegment> _segments;
+    NSUInteger _currentSegment;
+    NSFileHandle *_currentSegmentFile;
+    NSUInteger _byteLimit;
+    NSUInteger _storedBytes;
+}
+
+- (instancetype)initWithDirectory:(NSString *)directory byteLimit:(NSUInteger)byteLimit
+{
+    self = [super init];
+    if (self) {
+        _directory = [directory copy];
+        _byteLimit = byteLimit;
+        _queue = dispatch_queue_create("com.flex.FLEXNetworkBodyStore", DISPATCH_QUEUE_SERIAL);
+        [[NSFileManager defaultManager] removeItemAtPath:_directory error:NULL];
+        [[NSFileManager defaultManager] createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    }
+    return self;
+}
+
+- (instancetype)initWithByteLimit:(NSUInteger)byteLimit
+{
+    NSString *caches = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES).firstObject;
+    return [self initWithDirectory:[caches stringByAppendingPathComponent:@"com.flex.FLEXNetworkBodyStore"] byteLimit:byteLimit];
+}
+
+- (NSUInteger)storedBytes
+{
+    __block NSUInteger storedBytes = 0;
+    dispatch_sync(_queue, ^{
+        storedBytes = self->_storedBytes;
+    });
+    return storedBytes;
+}
+
+- (NSUInteger)byteLimit
+{
+    __block NSUInteger byteLimit = 0;
+    dispatch_sync(_queue, ^{
+        byteLimit = self->_byteLimit;
+    });
+    return byteLimit;
+}
+
+- (void)setByteLimit:(NSUInteger)byteLimit
+{
+    dispatch_sync(_queue, ^{
+        self->_byteLimit = byteLimit;
+        [self evictToLimitKeeping:nullptr];
+    });
+}
+
+- (void)storeBody:(NSData *)body forRequestID:(NSString *)requestID
+{
+    if (body.length == 0 || !requestID) {
+        return;
+    }
+    NSData *stored = body;
+    BOOL compressed = NO;
+    if (self.compressesBodies) {
+        if (NSData *smaller = compressedData(body)) {
+            stored = smaller;
+            compressed = YES;
+        }
+    }
+
+    dispatch_sync(_queue, ^{
+        const std::string key = requestID.UTF8String;
+        [self removeEntryForKey:key];
+        if (stored.length > self->_byteLimit) {
+            return;
+        }
+
+        FLEXSegment *segment = [self segmentWithRoomFor:stored.length];
+        if (!segment) {
+            return;
+        }
+        @try {
+            [self->_currentSegmentFile writeData:stored];
+        } @catch (NSException *exception) {
+            // Out of space, most likely. What's stored already stays available.
+            [self closeCurrentSegment];
+            return;
+        }
+
+        self->_lru.push_back(key);
+        self->_entries[key] = FLEXBodyEntry{
+            self->_currentSegment,
+            segment->length,
+            stored.length,
+            body.length,
+            compressed == YES,
+            std::prev(self->_lru.end()),
+        };
+        segment->length += stored.length;
+        segment->liveEntries++;
+        self->_storedBytes += stored.length;
+        [self evictToLimitKeeping:&key];
+    });
+}
+
+- (NSData *)bodyForRequestID:(NSString *)requestID
+{
+    if (!requestID) {
+        return nil;
+    }
+    __block NSData *body = nil;
+    dispatch_sync(_queue, ^{
+        auto entry = self->_entries.find(requestID.UTF8String);
+        if (entry == self->_entries.end()) {
+            return;
+        }
+        FLEXBodyEntry &bodyEntry = entry->second;
+        self->_lru.splice(self->_lru.end(), self->_lru, bodyEntry.lruPosition);
+
+        FLEXSegment &segment = self->_segments[bodyEntry.segment];
+        if (segment.mapped.length < bodyEntry.offset + bodyEntry.length) {
+            if (bodyEntry.segment == self->_currentSegment) {
+                [self->_currentSegmentFile synchronizeFile];
+            }
+            segment.mapped = [NSData dataWithContentsOfFile:[self pathForSegment:bodyEntry.segment] options:NSDataReadingMappedAlways error:NULL];
+            if (segment.mapped.length < bodyEntry.offset + bodyEntry.length) {
+                segment.mapped = nil;
+                return;
+            }
+        }
+        // Keeps the mapping alive for as long as the body is, without copying it.
+        NSData *mapped = segment.mapped;
+        body = [[NSData alloc] initWithBytesNoCopy:(void *)((const uint8_t *)mapped.bytes + bodyEntry.offset)
+                                            length:bodyEntry.length
+                                       deallocator:^(void *bytes, NSUInteger length) {
+                                           (void)mapped;
+                                       }];
+        if (bodyEntry.compressed) {
+            body = decompressedData(body, bodyEntry.originalLength);
+        }
+    });
+    return body;
+}
+
+- (void)removeBodyForRequestID:(NSString *)requestID
+{
+    if (!requestID) {
+        return;
+    }
+    dispatch_sync(_queue, ^{
+        [self removeEntryForKey:requestID.UTF8String];
+    });
+}
+
+- (void)removeAllBodies
+{
+    dispatch_sync(_queue, ^{
+        [self closeCurrentSegment];
+        for (const auto &segment : self->_segments) {
+            [[NSFileManager defaultManager] removeItemAtPath:[self pathForSegment:segment.first] error:NULL];
+        }
+        self->_segments.clear();
+        self->_entries.clear();
+        self->_lru.clear();
+        self->_storedBytes = 0;
+    });
+}
+
+#pragma mark - Private, on the store's queue
+
+- (NSString *)pathForSegment:(NSUInteger)segment
+{
+    return [_directory stringByAppendingPathComponent:[NSString stringWithFormat:@"%lu", (unsigned long)segment]];
+}
+
+- (FLEXSegment *)segmentWithRoomFor:(NSUInteger)length
+{
+    if (_currentSegmentFile) {
+        FLEXSegment &current = _segments[_currentSegment];
+        if (current.length == 0 || current.length + length <= kSegmentBytes) {
+            return &current;
+        }
+        [self closeCurrentSegment];
+    }
+
+    _currentSegment++;
+    NSString *path = [self pathForSegment:_currentSegment];
+    if (![[NSFileManager defaultManager] createFileAtPath:path contents:nil attributes:nil]) {
+        return nullptr;
+    }
+    _currentSegmentFile = [NSFileHandle fileHandleForWritingAtPath:path];
+    if (!_currentSegmentFile) {
+        [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+        return nullptr;
+    }
+    return &_segments[_currentSegment];
+}
+
+- (void)closeCurrentSegment
+{
+    [_currentSegmentFile closeFile];
+    _currentSegmentFile = nil;
+    auto current = _segments.find(_currentSegment);
+    if (current != _segments.end() && current->second.liveEntries == 0) {
+        [self deleteSegment:_currentSegment];
+    }
+}
+
+- (void)deleteSegment:(NSUInteger)segment
+{
+    if (segment == _currentSegment && _currentSegmentFile) {
+        [_currentSegmentFile closeFile];
+        _currentSegmentFile = nil;
+    }
+    // Bodies read from it before stay readable, as the mapping outlives the file.
+    [[NSFileManager defaultManager] removeItemAtPath:[self pathForSegment:segment] error:NULL];
+    _segments.erase(segment);
+}
+
+- (void)removeEntryForKey:(const std::string &)key
+{
+    auto entry = _entries.find(key);
+    if (entry == _entries.end()) {
+        return;
+    }
+    const NSUInteger segmentIndex = entry->second.segment;
+    _storedBytes -= entry->second.length;
+    _lru.erase(entry->second.lruPosition);
+    _entries.erase(entry);
+
+    FLEXSegment &segment = _segments[segmentIndex];
+    if (--segment.liveEntries == 0) {
+        [self deleteSegment:segmentIndex];
+    }
+}
+
+- (void)evictToLimitKeeping:(const std::string *)kept
+{
+    while (_storedBytes > _byteLimit && !_lru.empty()) {
+        const std::string key = _lru.front();
+        if (kept && key == *kept) {
+            break;
+        }
+        [self removeEntryForKey:key];
+    }
+}
+
+@end
@@ -22,6 +22,13 @@ FOUNDATION_EXTERN NSString *const kFLEXNetworkObserverEnabledStateChangedNotific
 /// High level network events are sent to the default FLEXNetworkRecorder instance which maintains the request history and caches response bodies.
 @interface FLEXNetworkObserver : NSObject
 
+/// Injects into every class that implements a delegate method, found by scanning all classes in the process.
+/// Catches sessions and connections created before it's called, at a cost proportional to the number of classes.
 + (void)start;
 
+/// Injects into a delegate's classes the first time a session or connection is created with it, so that the cost
+/// is proportional to the delegate classes actually in use. Sessions and connections created before it's called
+/// aren't observed.
++ (void)startLazily;
+
 @end
@@ -21,6 +21,7 @@
 
 #import <dispatch/queue.h>
 
+#import "FLEXNetworkBodyAccumulator.h"
 #import "FLEXNetworkRecorder.h"
 #import "FLEXUtility.h"
 
@@ -32,7 +33,7 @@ typedef void (^NSURLSessionAsyncCompletion)(id fileURLOrData, NSURLResponse *res
 @interface FLEXInternalRequestState : NSObject
 
 @property (nonatomic, copy) NSURLRequest *request;
-@property (nonatomic, strong) NSMutableData *dataAccumulator;
+@property (nonatomic, strong) FLEXNetworkBodyAccumulator *dataAccumulator;
 
 @end
 
@@ -83,7 +84,10 @@ didBecomeDownloadTask:(NSURLSessionDownloadTask *)downloadTask delegate:(id<NSUR
 
 + (void)start {
   [self injectIntoAllNSURLConnectionDelegateClasses];
+}
 
++ (void)startLazily {
+  [self injectIntoDelegateClassesLazily];
 }
 
 #pragma mark - Statics
@@ -133,29 +137,73 @@ didBecomeDownloadTask:(NSURLSessionDownloadTask *)downloadTask delegate:(id<NSUR
 
 #pragma mark - Delegate Injection
 
+/// The delegate methods that get a class injected when it implements any of them.
+static const SEL *delegateSelectors(int *count)
+{
+    static const SEL selectors[] = {
+        @selector(connectionDidFinishLoading:),
+        @selector(connection:willSendRequest:redirectResponse:),
+        @selector(connection:didReceiveResponse:),
+        @selector(connection:didReceiveData:),
+        @selector(connection:didFailWithError:),
+        @selector(URLSession:task:willPerformHTTPRedirection:newRequest:completionHandler:),
+        @selector(URLSession:dataTask:didReceiveData:),
+        @selector(URLSession:dataTask:didReceiveResponse:completionHandler:),
+        @selector(URLSession:task:didCompleteWithError:),
+        @selector(URLSession:dataTask:didBecomeDownloadTask:),
+        @selector(URLSession:downloadTask:didWriteData:totalBytesWritten:totalBytesExpectedToWrite:),
+        @selector(URLSession:downloadTask:didFinishDownloadingToURL:)
+    };
+    *count = sizeof(selectors) / sizeof(SEL);
+    return selectors;
+}
+
++ (BOOL)classImplementsDelegateSelector:(Class)cls
+{
+    int numSelectors = 0;
+    const SEL *selectors = delegateSelectors(&numSelectors);
+
+    // Use the runtime API rather than the methods on NSObject to avoid sending messages to
+    // classes we're not interested in swizzling. Otherwise we hit +initialize on all classes.
+    // NOTE: calling class_getInstanceMethod() DOES send +initialize to the class. That's why we iterate through the method list.
+    unsigned int methodCount = 0;
+    Method *methods = class_copyMethodList(cls, &methodCount);
+    BOOL matchingSelectorFound = NO;
+    for (unsigned int methodIndex = 0; methodIndex < methodCount && !matchingSelectorFound; methodIndex++) {
+        for (int selectorIndex = 0; selectorIndex < numSelectors; ++selectorIndex) {
+            if (method_getName(methods[methodIndex]) == selectors[selectorIndex]) {
+                matchingSelectorFound = YES;
+                break;
+            }
+        }
+    }
+    free(methods);
+    return matchingSelectorFound;
+}
+
+/// Injects into cls unless that was done already, whichever mode found it. Injecting twice would swap the
+/// swizzled implementations back.
++ (void)injectIntoDelegateClassOnce:(Class)cls
+{
+    static NSMutableSet<Class> *injectedClasses = nil;
+    @synchronized(self) {
+        if (!injectedClasses) {
+            injectedClasses = [NSMutableSet set];
+        }
+        if ([injectedClasses containsObject:cls]) {
+            return;
+        }
+        [injectedClasses addObject:cls];
+        [self injectIntoDelegateClass:cls];
+    }
+}
+
 + (void)injectIntoAllNSURLConnectionDelegateClasses
 {
     // Only allow swizzling once.
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
-        // Swizzle any classes that implement one of these selectors.
-        const SEL selectors[] = {
-            @selector(connectionDidFinishLoading:),
-            @selector(connection:willSendRequest:redirectResponse:),
-            @selector(connection:didReceiveResponse:),
-            @selector(connection:didReceiveData:),
-            @selector(connection:didFailWithError:),
-            @selector(URLSession:task:willPerformHTTPRedirection:newRequest:completionHandler:),
-            @selector(URLSession:dataTask:didReceiveData:),
-            @selector(URLSession:dataTask:didReceiveResponse:completionHandler:),
-            @selector(URLSession:task:didCompleteWithError:),
-            @selector(URLSession:dataTask:didBecomeDownloadTask:),
-            @selector(URLSession:downloadTask:didWriteData:totalBytesWritten:totalBytesExpectedToWrite:),
-            @selector(URLSession:downloadTask:didFinishDownloadingToURL:)
-        };
-
-        const int numSelectors = sizeof(selectors) / sizeof(SEL);
-
+        // Swizzle any classes that implement one of the delegate selectors.
         Class *classes = NULL;
         int numClasses = objc_getClassList(NULL, 0);
 
@@ -169,38 +217,105 @@ didBecomeDownloadTask:(NSURLSessionDownloadTask *)downloadTask delegate:(id<NSUR
                     continue;
                 }
 
-                // Use the runtime API rather than the methods on NSObject to avoid sending messages to
-                // classes we're not interested in swizzling. Otherwise we hit +initialize on all classes.
-                // NOTE: calling class_getInstanceMethod() DOES send +initialize to the class. That's why we iterate through the method list.
-                unsigned int methodCount = 0;
-                Method *methods = class_copyMethodList(className, &methodCount);
-                BOOL matchingSelectorFound = NO;
-                for (unsigned int methodIndex = 0; methodIndex < methodCount; methodIndex++) {
-                    for (int selectorIndex = 0; selectorIndex < numSelectors; ++selectorIndex) {
-                        if (method_getName(methods[methodIndex]) == selectors[selectorIndex]) {
-                            [self injectIntoDelegateClass:className];
-                            matchingSelectorFound = YES;
-                            break;
-                        }
-                    }
-                    if (matchingSelectorFound) {
-                        break;
-                    }
+                if ([self classImplementsDelegateSelector:className]) {
+                    [self injectIntoDelegateClassOnce:className];
                 }
-                free(methods);
             }
 
             free(classes);
         }
 
-        [self injectIntoNSURLConnectionCancel];
-        [self injectIntoNSURLSessionTaskResume];
+        [self injectIntoLoadingSystem];
+    });
+}
 
-        [self injectIntoNSURLConnectionAsynchronousClassMethod];
-        [self injectIntoNSURLConnectionSynchronousClassMethod];
++ (void)injectIntoDelegateClassesLazily
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        [self injectIntoNSURLSessionCreation];
+        [self injectIntoNSURLConnectionCreation];
 
-        [self injectIntoNSURLSessionAsyncDataAndDownloadTaskMethods];
-        [self injectIntoNSURLSessionAsyncUploadTaskMethods];
+        [self injectIntoLoadingSystem];
+    });
+}
+
++ (void)injectIntoLoadingSystem
+{
+    [self injectIntoNSURLConnectionCancel];
+    [self injectIntoNSURLSessionTaskResume];
+
+    [self injectIntoNSURLConnectionAsynchronousClassMethod];
+    [self injectIntoNSURLConnectionSynchronousClassMethod];
+
+    [self injectIntoNSURLSessionAsyncDataAndDownloadTaskMethods];
+    [self injectIntoNSURLSessionAsyncUploadTaskMethods];
+}
+
+/// Injects into the classes of delegate's hierarchy that implement delegate methods, the first time one of them
+/// is seen.
++ (void)injectIntoClassHierarchyOfDelegate:(id)delegate
+{
+    if (!delegate) {
+        return;
+    }
+    static NSMutableSet<Class> *checkedClasses = nil;
+    Class leafClass = object_getClass(delegate);
+    @synchronized(self) {
+        if (!checkedClasses) {
+            checkedClasses = [NSMutableSet set];
+        }
+        if ([checkedClasses containsObject:leafClass]) {
+            return;
+        }
+        [checkedClasses addObject:leafClass];
+    }
+    for (Class cls = leafClass; cls && cls != [NSObject class]; cls = class_getSuperclass(cls)) {
+        if ([self classImplementsDelegateSelector:cls]) {
+            [self injectIntoDelegateClassOnce:cls];
+        }
+    }
+}
+
++ (void)injectIntoNSURLSessionCreation
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        Class className = objc_getMetaClass(class_getName([NSURLSession class]));
+        SEL selector = @selector(sessionWithConfiguration:delegate:delegateQueue:);
+        SEL swizzledSelector = [FLEXUtility swizzledSelectorForSelector:selector];
+
+        NSURLSession *(^swizzleBlock)(Class, NSURLSessionConfiguration *, id<NSURLSessionDelegate>, NSOperationQueue *) = ^NSURLSession *(Class slf, NSURLSessionConfiguration *configuration, id<NSURLSessionDelegate> delegate, NSOperationQueue *queue) {
+            [self injectIntoClassHierarchyOfDelegate:delegate];
+            return ((id(*)(id, SEL, id, id, id))objc_msgSend)(slf, swizzledSelector, configuration, delegate, queue);
+        };
+
+        [FLEXUtility replaceImplementationOfKnownSelector:selector onClass:className withBlock:swizzleBlock swizzledSelector:swizzledSelector];
+    });
+}
+
++ (void)injectIntoNSURLConnectionCreation
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        // initWithRequest:delegate: and the class methods end up in one of these.
+        Class className = [NSURLConnection class];
+
+        SEL selector = @selector(initWithRequest:delegate:startImmediately:);
+        SEL swizzledSelector = [FLEXUtility swizzledSelectorForSelector:selector];
+        id (^swizzleBlock)(NSURLConnection *, NSURLRequest *, id, BOOL) = ^id(NSURLConnection *slf, NSURLRequest *request, id delegate, BOOL startImmediately) {
+            [self injectIntoClassHierarchyOfDelegate:delegate];
+            return ((id(*)(id, SEL, id, id, BOOL))objc_msgSend)(slf, swizzledSelector, request, delegate, startImmediately);
+        };
+        [FLEXUtility replaceImplementationOfKnownSelector:selector onClass:className withBlock:swizzleBlock swizzledSelector:swizzledSelector];
+
+        SEL shortSelector = @selector(initWithRequest:delegate:);
+        SEL swizzledShortSelector = [FLEXUtility swizzledSelectorForSelector:shortSelector];
+        id (^shortSwizzleBlock)(NSURLConnection *, NSURLRequest *, id) = ^id(NSURLConnection *slf, NSURLRequest *request, id delegate) {
+            [self injectIntoClassHierarchyOfDelegate:delegate];
+            return ((id(*)(id, SEL, id, id))objc_msgSend)(slf, swizzledShortSelector, request, delegate);
+        };
+        [FLEXUtility replaceImplementationOfKnownSelector:shortSelector onClass:className withBlock:shortSwizzleBlock swizzledSelector:swizzledShortSelector];
     });
 }
 
@@ -792,7 +907,8 @@ didBecomeDownloadTask:(NSURLSessionDownloadTask *)downloadTask delegate:(id<NSUR
     typedef void (^NSURLSessionDownloadTaskDidFinishDownloadingBlock)(id<NSURLSessionTaskDelegate> slf, NSURLSession *session, NSURLSessionDownloadTask *task, NSURL *location);
 
     NSURLSessionDownloadTaskDidFinishDownloadingBlock undefinedBlock = ^(id<NSURLSessionTaskDelegate> slf, NSURLSession *session, NSURLSessionDownloadTask *task, NSURL *location) {
-        NSData *data = [NSData dataWithContentsOfFile:location.relativePath];
+        // Mapped, as only the part of it that the accumulator keeps is read.
+        NSData *data = [NSData dataWithContentsOfFile:location.relativePath options:NSDataReadingMappedIfSafe error:NULL];
         [[FLEXNetworkObserver sharedObserver] URLSession:session task:task didFinishDownloadingToURL:location data:data delegate:slf];
     };
 
@@ -869,6 +985,15 @@ static char const *const kFLEXRequestIDKey = "kFLEXRequestIDKey";
   dispatch_async(_queue, block);
 }
 
+- (FLEXNetworkBodyAccumulator *)bodyAccumulatorWithExpectedLength:(int64_t)expectedLength
+{
+    FLEXNetworkRecorder *recorder = [FLEXNetworkRecorder defaultRecorder];
+    return [[FLEXNetworkBodyAccumulator alloc] initWithExpectedLength:expectedLength
+                                                            headLimit:recorder.responseBodyHeadByteLimit
+                                                            tailLimit:recorder.responseBodyTailByteLimit
+                                                         spillsToDisk:recorder.spillsResponseBodiesToDisk];
+}
+
 - (FLEXInternalRequestState *)requestStateForRequestID:(NSString *)requestID
 {
     FLEXInternalRequestState *requestState = self.requestStatesForRequestIDs[requestID];
@@ -907,13 +1032,7 @@ static char const *const kFLEXRequestIDKey = "kFLEXRequestIDKey";
         NSString *requestID = [[self class] requestIDForConnectionOrTask:connection];
         FLEXInternalRequestState *requestState = [self requestStateForRequestID:requestID];
 
-        NSMutableData *dataAccumulator = nil;
-        if (response.expectedContentLength < 0) {
-            dataAccumulator = [NSMutableData new];
-        } else {
-            dataAccumulator = [[NSMutableData alloc] initWithCapacity:(NSUInteger)response.expectedContentLength];
-        }
-        requestState.dataAccumulator = dataAccumulator;
+        requestState.dataAccumulator = [self bodyAccumulatorWithExpectedLength:response.expectedContentLength];
 
         [[FLEXNetworkRecorder defaultRecorder] recordResponseReceivedWithRequestID:requestID response:response];
     }];
@@ -936,7 +1055,7 @@ static char const *const kFLEXRequestIDKey = "kFLEXRequestIDKey";
     [self performBlock:^{
         NSString *requestID = [[self class] requestIDForConnectionOrTask:connection];
         FLEXInternalRequestState *requestState = [self requestStateForRequestID:requestID];
-        [[FLEXNetworkRecorder defaultRecorder] recordLoadingFinishedWithRequestID:requestID responseBody:requestState.dataAccumulator];
+        [[FLEXNetworkRecorder defaultRecorder] recordLoadingFinishedWithRequestID:requestID responseBody:[requestState.dataAccumulator body]];
         [self removeRequestStateForRequestID:requestID];
     }];
 }
@@ -986,13 +1105,7 @@ static char const *const kFLEXRequestIDKey = "kFLEXRequestIDKey";
         NSString *requestID = [[self class] requestIDForConnectionOrTask:dataTask];
         FLEXInternalRequestState *requestState = [self requestStateForRequestID:requestID];
 
-        NSMutableData *dataAccumulator = nil;
-        if (response.expectedContentLength < 0) {
-            dataAccumulator = [NSMutableData new];
-        } else {
-            dataAccumulator = [[NSMutableData alloc] initWithCapacity:(NSUInteger)response.expectedContentLength];
-        }
-        requestState.dataAccumulator = dataAccumulator;
+        requestState.dataAccumulator = [self bodyAccumulatorWithExpectedLength:response.expectedContentLength];
 
         NSString *requestMechanism = [NSString stringWithFormat:@"NSURLSessionDataTask (delegate: %@)", [delegate class]];
         [[FLEXNetworkRecorder defaultRecorder] recordMechanism:requestMechanism forRequestID:requestID];
@@ -1034,7 +1147,7 @@ static char const *const kFLEXRequestIDKey = "kFLEXRequestIDKey";
         if (error) {
             [[FLEXNetworkRecorder defaultRecorder] recordLoadingFailedWithRequestID:requestID error:error];
         } else {
-            [[FLEXNetworkRecorder defaultRecorder] recordLoadingFinishedWithRequestID:requestID responseBody:requestState.dataAccumulator];
+            [[FLEXNetworkRecorder defaultRecorder] recordLoadingFinishedWithRequestID:requestID responseBody:[requestState.dataAccumulator body]];
         }
 
         [self removeRequestStateForRequestID:requestID];
@@ -1048,8 +1161,7 @@ static char const *const kFLEXRequestIDKey = "kFLEXRequestIDKey";
         FLEXInternalRequestState *requestState = [self requestStateForRequestID:requestID];
 
         if (!requestState.dataAccumulator) {
-            NSUInteger unsignedBytesExpectedToWrite = totalBytesExpectedToWrite > 0 ? (NSUInteger)totalBytesExpectedToWrite : 0;
-            requestState.dataAccumulator = [[NSMutableData alloc] initWithCapacity:unsignedBytesExpectedToWrite];
+            requestState.dataAccumulator = [self bodyAccumulatorWithExpectedLength:totalBytesExpectedToWrite];
             [[FLEXNetworkRecorder defaultRecorder] recordResponseReceivedWithRequestID:requestID response:downloadTask.response];
 
             NSString *requestMechanism = [NSString stringWithFormat:@"NSURLSessionDownloadTask (delegate: %@)", [delegate class]];
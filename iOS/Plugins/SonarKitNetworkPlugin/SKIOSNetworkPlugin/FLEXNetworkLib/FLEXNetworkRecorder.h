@@ -25,7 +25,8 @@ extern NSString *const kFLEXNetworkRecorderTransactionsClearedNotification;
 
 @property (nonatomic, weak) id<SKNetworkReporterDelegate> delegate;
 
-/// Defaults to 25 MB if never set. Values set here are presisted across launches of the app.
+/// How many bytes of response bodies are kept on disk, the least recently used dropped first.
+/// Defaults to 100 MB if never set. Values set here are presisted across launches of the app.
 @property (nonatomic, assign) NSUInteger responseCacheByteLimit;
 
 /// If NO, the recorder not cache will not cache response for content types with an "image", "video", or "audio" prefix.
@@ -33,15 +34,34 @@ extern NSString *const kFLEXNetworkRecorderTransactionsClearedNotification;
 
 @property (nonatomic, copy) NSArray<NSString *> *hostBlacklist;
 
+/// How much of the start of a response body is captured. Defaults to 2 MB.
+@property (atomic, assign) NSUInteger responseBodyHeadByteLimit;
+
+/// How much of the end of a response body is captured, after the head, when not spilling to disk. Defaults to 256 kB.
+@property (atomic, assign) NSUInteger responseBodyTailByteLimit;
+
+/// If YES, what comes after the head of a response body is streamed to a temporary file, and the whole body is
+/// captured, mapped from that file. Defaults to NO.
+@property (atomic, assign) BOOL spillsResponseBodiesToDisk;
+
+/// Requests it leaves out aren't reported to the delegate, and bodies of responses it leaves out aren't cached.
+@property (atomic, strong) SKNetworkCaptureFilter *captureFilter;
+
 
 // Accessing recorded network activity
 
 /// Array of FLEXNetworkTransaction objects ordered by start time with the newest first.
 - (NSArray<FLEXNetworkTransaction *> *)networkTransactions;
 
-/// The full response data IFF it hasn't been purged due to memory pressure.
+/// The full response data IFF it hasn't been dropped to stay within responseCacheByteLimit.
 - (NSData *)cachedResponseBodyForTransaction:(FLEXNetworkTransaction *)transaction;
 
+/// Same as cachedResponseBodyForTransaction:, looked up by the identifier reported to the delegate.
+- (NSData *)cachedResponseBodyForIdentifier:(int64_t)identifier;
+
+/// If YES, response bodies are compressed on disk. Defaults to NO.
+@property (nonatomic, assign) BOOL compressesResponseBodies;
+
 /// Dumps all network transactions and cached response bodies.
 - (void)clearRecordedActivity;
 
@@ -8,6 +8,9 @@
 
 #import "FLEXNetworkRecorder.h"
 
+#import <atomic>
+
+#import "FLEXNetworkBodyStore.h"
 #import "FLEXNetworkTransaction.h"
 #import "FLEXUtility.h"
 
@@ -18,35 +21,64 @@ NSString *const kFLEXNetworkRecorderTransactionsClearedNotification = @"kFLEXNet
 
 NSString *const kFLEXNetworkRecorderResponseCacheLimitDefaultsKey = @"com.flex.responseCacheLimit";
 
+namespace {
+
+enum class FLEXNetworkEventType {
+    RequestWillBeSent,
+    ResponseReceived,
+    DataReceived,
+    LoadingFinished,
+    LoadingFailed,
+    Mechanism,
+};
+
+// What a record... call was told, as it was told. Applied to the transactions
+// later, on the recorder's queue.
+struct FLEXNetworkEvent {
+    FLEXNetworkEventType type;
+    CFAbsoluteTime time;
+    uint64_t timestamp;
+    int64_t dataLength;
+    NSString *requestID;
+    // The request, response, body, error or mechanism, depending on type.
+    id object;
+    FLEXNetworkEvent *next;
+};
+
+}
+
 @interface FLEXNetworkRecorder ()
 
-@property (nonatomic, strong) NSCache *responseCache;
+@property (nonatomic, strong) FLEXNetworkBodyStore *responseBodyStore;
 @property (nonatomic, strong) NSMutableArray<FLEXNetworkTransaction *> *orderedTransactions;
 @property (nonatomic, strong) NSMutableDictionary<NSString *, FLEXNetworkTransaction *> *networkTransactionsForRequestIdentifiers;
 @property (nonatomic, strong) dispatch_queue_t queue;
 @property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *identifierDict;
+@property (nonatomic, strong) NSMutableDictionary<NSNumber *, NSString *> *requestIDsForIdentifiers;
 @end
 
 @implementation FLEXNetworkRecorder
+{
+    // Events that haven't been applied yet, newest first.
+    std::atomic<FLEXNetworkEvent *> _pendingEvents;
+}
 
 - (instancetype)init
 {
     self = [super init];
     if (self) {
-        _responseCache = [NSCache new];
         NSUInteger responseCacheLimit = [[[NSUserDefaults standardUserDefaults] objectForKey:kFLEXNetworkRecorderResponseCacheLimitDefaultsKey] unsignedIntegerValue];
-        if (responseCacheLimit) {
-            [_responseCache setTotalCostLimit:responseCacheLimit];
-        } else {
-            // Default to 25 MB max. The cache will purge earlier if there is memory pressure.
-            [_responseCache setTotalCostLimit:25 * 1024 * 1024];
-        }
+        // Default to 100 MB max. Bodies are on disk, and only paged in when read.
+        _responseBodyStore = [[FLEXNetworkBodyStore alloc] initWithByteLimit:responseCacheLimit ?: 100 * 1024 * 1024];
+        _responseBodyHeadByteLimit = 2 * 1024 * 1024;
+        _responseBodyTailByteLimit = 256 * 1024;
         _orderedTransactions = [NSMutableArray array];
         _networkTransactionsForRequestIdentifiers = [NSMutableDictionary dictionary];
 
         // Serial queue used because we use mutable objects that are not thread safe
         _queue = dispatch_queue_create("com.flex.FLEXNetworkRecorder", DISPATCH_QUEUE_SERIAL);
         _identifierDict = [NSMutableDictionary dictionary];
+        _requestIDsForIdentifiers = [NSMutableDictionary dictionary];
     }
     return self;
 }
@@ -69,19 +101,30 @@ NSString *const kFLEXNetworkRecorderResponseCacheLimitDefaultsKey = @"com.flex.r
 
 - (NSUInteger)responseCacheByteLimit
 {
-    return [self.responseCache totalCostLimit];
+    return self.responseBodyStore.byteLimit;
 }
 
 - (void)setResponseCacheByteLimit:(NSUInteger)responseCacheByteLimit
 {
-    [self.responseCache setTotalCostLimit:responseCacheByteLimit];
+    self.responseBodyStore.byteLimit = responseCacheByteLimit;
     [[NSUserDefaults standardUserDefaults] setObject:@(responseCacheByteLimit) forKey:kFLEXNetworkRecorderResponseCacheLimitDefaultsKey];
 }
 
+- (BOOL)compressesResponseBodies
+{
+    return self.responseBodyStore.compressesBodies;
+}
+
+- (void)setCompressesResponseBodies:(BOOL)compressesResponseBodies
+{
+    self.responseBodyStore.compressesBodies = compressesResponseBodies;
+}
+
 - (NSArray<FLEXNetworkTransaction *> *)networkTransactions
 {
     __block NSArray<FLEXNetworkTransaction *> *transactions = nil;
     dispatch_sync(self.queue, ^{
+        [self applyPendingEvents];
         transactions = [self.orderedTransactions copy];
     });
     return transactions;
@@ -89,13 +132,24 @@ NSString *const kFLEXNetworkRecorderResponseCacheLimitDefaultsKey = @"com.flex.r
 
 - (NSData *)cachedResponseBodyForTransaction:(FLEXNetworkTransaction *)transaction
 {
-    return [self.responseCache objectForKey:transaction.requestID];
+    return [self.responseBodyStore bodyForRequestID:transaction.requestID];
+}
+
+- (NSData *)cachedResponseBodyForIdentifier:(int64_t)identifier
+{
+    __block NSString *requestID = nil;
+    dispatch_sync(self.queue, ^{
+        [self applyPendingEvents];
+        requestID = self.requestIDsForIdentifiers[@(identifier)];
+    });
+    return [self.responseBodyStore bodyForRequestID:requestID];
 }
 
 - (void)clearRecordedActivity
 {
     dispatch_async(self.queue, ^{
-        [self.responseCache removeAllObjects];
+        [self.responseBodyStore removeAllBodies];
+        [self.requestIDsForIdentifiers removeAllObjects];
         [self.orderedTransactions removeAllObjects];
         [self.networkTransactionsForRequestIdentifiers removeAllObjects];
     });
@@ -103,117 +157,192 @@ NSString *const kFLEXNetworkRecorderResponseCacheLimitDefaultsKey = @"com.flex.r
 
 #pragma mark - Network Events
 
-- (void)recordRequestWillBeSentWithRequestID:(NSString *)requestID request:(NSURLRequest *)request redirectResponse:(NSURLResponse *)redirectResponse
+// These are called from the networking code's own threads, down to once per
+// chunk of data received, so they only log the event. The log is a lock-free
+// list: a record... call is one allocation and one compare-and-swap, and a
+// dispatch to the recorder's queue only for the first event since the log was
+// last applied. Unlike per-thread logs, a single list keeps the events for a
+// request in order when its callbacks come from different threads.
+
+- (void)recordEventOfType:(FLEXNetworkEventType)type requestID:(NSString *)requestID object:(id)object dataLength:(int64_t)dataLength
 {
-  if (![self.identifierDict objectForKey:requestID]) {
-    self.identifierDict[requestID] = [NSNumber random];
-  }
-    NSDate *startDate = [NSDate date];
+    FLEXNetworkEvent *event = new FLEXNetworkEvent{
+        type,
+        CFAbsoluteTimeGetCurrent(),
+        [NSDate timestamp],
+        dataLength,
+        requestID,
+        object,
+        nullptr,
+    };
+    FLEXNetworkEvent *head = _pendingEvents.load(std::memory_order_relaxed);
+    do {
+        event->next = head;
+    } while (!_pendingEvents.compare_exchange_weak(head, event, std::memory_order_release, std::memory_order_relaxed));
+
+    if (!head) {
+        dispatch_async(self.queue, ^{
+            [self applyPendingEvents];
+        });
+    }
+}
 
-    if (redirectResponse) {
-        [self recordResponseReceivedWithRequestID:requestID response:redirectResponse];
-        [self recordLoadingFinishedWithRequestID:requestID responseBody:nil];
+/// Must be called on the recorder's queue.
+- (void)applyPendingEvents
+{
+    FLEXNetworkEvent *event = _pendingEvents.exchange(nullptr, std::memory_order_acquire);
+    FLEXNetworkEvent *oldest = nullptr;
+    while (event) {
+        FLEXNetworkEvent *next = event->next;
+        event->next = oldest;
+        oldest = event;
+        event = next;
+    }
+    while (oldest) {
+        FLEXNetworkEvent *next = oldest->next;
+        [self applyEvent:*oldest];
+        delete oldest;
+        oldest = next;
     }
+}
 
-    dispatch_async(self.queue, ^{
-        SKRequestInfo *info = [[SKRequestInfo alloc] initWithIdentifier:self.identifierDict[requestID].longLongValue timestamp:[NSDate timestamp] request:request data:request.HTTPBody];
-        [self.delegate didObserveRequest:info];
+- (void)applyEvent:(const FLEXNetworkEvent &)event
+{
+    NSString *requestID = event.requestID;
+    NSDate *date = [NSDate dateWithTimeIntervalSinceReferenceDate:event.time];
+
+    if (event.type == FLEXNetworkEventType::RequestWillBeSent) {
+        if (![self.identifierDict objectForKey:requestID]) {
+            self.identifierDict[requestID] = [NSNumber random];
+        }
+        NSURLRequest *request = event.object;
+        SKNetworkCaptureFilter *filter = self.captureFilter;
+        if (filter && ![filter acceptsRequest:request]) {
+            // Without an identifier, nothing more is reported for the request.
+            self.identifierDict[requestID] = nil;
+        } else {
+            SKRequestInfo *info = [[SKRequestInfo alloc] initWithIdentifier:self.identifierDict[requestID].longLongValue timestamp:event.timestamp request:request data:request.HTTPBody];
+            [self.delegate didObserveRequest:info];
+        }
 
         FLEXNetworkTransaction *transaction = [FLEXNetworkTransaction new];
         transaction.requestID = requestID;
         transaction.request = request;
-        transaction.startTime = startDate;
+        transaction.startTime = date;
 
         [self.orderedTransactions insertObject:transaction atIndex:0];
         [self.networkTransactionsForRequestIdentifiers setObject:transaction forKey:requestID];
         transaction.transactionState = FLEXNetworkTransactionStateAwaitingResponse;
-    });
+        return;
+    }
+
+    FLEXNetworkTransaction *transaction = self.networkTransactionsForRequestIdentifiers[requestID];
+    if (!transaction) {
+        return;
+    }
+
+    switch (event.type) {
+        case FLEXNetworkEventType::RequestWillBeSent:
+            break;
+
+        case FLEXNetworkEventType::ResponseReceived:
+            transaction.response = event.object;
+            transaction.transactionState = FLEXNetworkTransactionStateReceivingData;
+            transaction.latency = -[transaction.startTime timeIntervalSinceDate:date];
+            break;
+
+        case FLEXNetworkEventType::DataReceived:
+            transaction.receivedDataLength += event.dataLength;
+            break;
+
+        case FLEXNetworkEventType::LoadingFinished: {
+            NSData *responseBody = event.object;
+            transaction.transactionState = FLEXNetworkTransactionStateFinished;
+            transaction.duration = -[transaction.startTime timeIntervalSinceDate:date];
+            NSNumber *identifier = self.identifierDict[requestID];
+            if (!identifier) {
+                break;
+            }
+            SKNetworkCaptureFilter *filter = self.captureFilter;
+            if (filter && ![filter acceptsResponse:transaction.response]) {
+                // Still reported, so that the delegate can take back the request.
+                responseBody = nil;
+            }
+            SKResponseInfo *responseInfo = [[SKResponseInfo alloc] initWithIndentifier:identifier.longLongValue timestamp:event.timestamp response:transaction.response data:responseBody];
+            self.identifierDict[requestID] = nil; //Clear the entry
+
+            BOOL shouldCache = [responseBody length] > 0;
+            if (!self.shouldCacheMediaResponses) {
+                NSArray<NSString *> *ignoredMIMETypePrefixes = @[ @"audio", @"image", @"video" ];
+                for (NSString *ignoredPrefix in ignoredMIMETypePrefixes) {
+                    shouldCache = shouldCache && ![transaction.response.MIMEType hasPrefix:ignoredPrefix];
+                }
+            }
+
+            if (shouldCache) {
+                [self.responseBodyStore storeBody:responseBody forRequestID:requestID];
+                if (identifier) {
+                    self.requestIDsForIdentifiers[identifier] = requestID;
+                }
+            }
+            // Reported once the body is cached, so that it can be fetched as soon as the delegate hears of it.
+            [self.delegate didObserveResponse:responseInfo];
+            break;
+        }
+
+        case FLEXNetworkEventType::LoadingFailed: {
+            if (self.identifierDict[requestID]) {
+                SKResponseInfo *responseInfo = [[SKResponseInfo alloc] initWithIndentifier:self.identifierDict[requestID].longLongValue timestamp:event.timestamp response:transaction.response data: nil];
+                self.identifierDict[requestID] = nil; //Clear the entry
+                [self.delegate didObserveResponse:responseInfo];
+            }
+            transaction.transactionState = FLEXNetworkTransactionStateFailed;
+            transaction.duration = -[transaction.startTime timeIntervalSinceDate:date];
+            transaction.error = event.object;
+            break;
+        }
+
+        case FLEXNetworkEventType::Mechanism:
+            transaction.requestMechanism = event.object;
+            break;
+    }
+}
+
+- (void)recordRequestWillBeSentWithRequestID:(NSString *)requestID request:(NSURLRequest *)request redirectResponse:(NSURLResponse *)redirectResponse
+{
+    if (redirectResponse) {
+        [self recordResponseReceivedWithRequestID:requestID response:redirectResponse];
+        [self recordLoadingFinishedWithRequestID:requestID responseBody:nil];
+    }
+    [self recordEventOfType:FLEXNetworkEventType::RequestWillBeSent requestID:requestID object:request dataLength:0];
 }
 
 /// Call when HTTP response is available.
 - (void)recordResponseReceivedWithRequestID:(NSString *)requestID response:(NSURLResponse *)response
 {
-    NSDate *responseDate = [NSDate date];
-
-    dispatch_async(self.queue, ^{
-        FLEXNetworkTransaction *transaction = self.networkTransactionsForRequestIdentifiers[requestID];
-        if (!transaction) {
-            return;
-        }
-        transaction.response = response;
-        transaction.transactionState = FLEXNetworkTransactionStateReceivingData;
-        transaction.latency = -[transaction.startTime timeIntervalSinceDate:responseDate];
-    });
+    [self recordEventOfType:FLEXNetworkEventType::ResponseReceived requestID:requestID object:response dataLength:0];
 }
 
 /// Call when data chunk is received over the network.
 - (void)recordDataReceivedWithRequestID:(NSString *)requestID dataLength:(int64_t)dataLength
 {
-    dispatch_async(self.queue, ^{
-        FLEXNetworkTransaction *transaction = self.networkTransactionsForRequestIdentifiers[requestID];
-        if (!transaction) {
-            return;
-        }
-        transaction.receivedDataLength += dataLength;
-    });
+    [self recordEventOfType:FLEXNetworkEventType::DataReceived requestID:requestID object:nil dataLength:dataLength];
 }
 
 /// Call when HTTP request has finished loading.
 - (void)recordLoadingFinishedWithRequestID:(NSString *)requestID responseBody:(NSData *)responseBody
 {
-    NSDate *finishedDate = [NSDate date];
-    dispatch_async(self.queue, ^{
-
-        FLEXNetworkTransaction *transaction = self.networkTransactionsForRequestIdentifiers[requestID];
-        if (!transaction) {
-            return;
-        }
-        transaction.transactionState = FLEXNetworkTransactionStateFinished;
-        transaction.duration = -[transaction.startTime timeIntervalSinceDate:finishedDate];
-        SKResponseInfo *responseInfo = [[SKResponseInfo alloc] initWithIndentifier:self.identifierDict[requestID].longLongValue timestamp:[NSDate timestamp] response:transaction.response data:responseBody];
-        self.identifierDict[requestID] = nil; //Clear the entry
-        [self.delegate didObserveResponse:responseInfo];
-
-        BOOL shouldCache = [responseBody length] > 0;
-        if (!self.shouldCacheMediaResponses) {
-            NSArray<NSString *> *ignoredMIMETypePrefixes = @[ @"audio", @"image", @"video" ];
-            for (NSString *ignoredPrefix in ignoredMIMETypePrefixes) {
-                shouldCache = shouldCache && ![transaction.response.MIMEType hasPrefix:ignoredPrefix];
-            }
-        }
-
-        if (shouldCache) {
-            [self.responseCache setObject:responseBody forKey:requestID cost:[responseBody length]];
-        }
-    });
+    [self recordEventOfType:FLEXNetworkEventType::LoadingFinished requestID:requestID object:responseBody dataLength:0];
 }
 
 - (void)recordLoadingFailedWithRequestID:(NSString *)requestID error:(NSError *)error
 {
-    dispatch_async(self.queue, ^{
-        FLEXNetworkTransaction *transaction = self.networkTransactionsForRequestIdentifiers[requestID];
-        if (!transaction) {
-            return;
-        }
-
-      SKResponseInfo *responseInfo = [[SKResponseInfo alloc] initWithIndentifier:self.identifierDict[requestID].longLongValue timestamp:[NSDate timestamp] response:transaction.response data: nil];
-      self.identifierDict[requestID] = nil; //Clear the entry
-      [self.delegate didObserveResponse:responseInfo];
-        transaction.transactionState = FLEXNetworkTransactionStateFailed;
-        transaction.duration = -[transaction.startTime timeIntervalSinceNow];
-        transaction.error = error;
-    });
+    [self recordEventOfType:FLEXNetworkEventType::LoadingFailed requestID:requestID object:error dataLength:0];
 }
 
 - (void)recordMechanism:(NSString *)mechanism forRequestID:(NSString *)requestID
 {
-    dispatch_async(self.queue, ^{
-        FLEXNetworkTransaction *transaction = self.networkTransactionsForRequestIdentifiers[requestID];
-        if (!transaction) {
-            return;
-        }
-        transaction.requestMechanism = mechanism;
-    });
+    [self recordEventOfType:FLEXNetworkEventType::Mechanism requestID:requestID object:mechanism dataLength:0];
 }
 
 @end
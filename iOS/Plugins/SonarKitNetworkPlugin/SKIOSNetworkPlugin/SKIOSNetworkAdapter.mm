@@ -22,10 +22,19 @@
 
 - (void)setDelegate:(id<SKNetworkReporterDelegate>)delegate {
   _delegate = delegate;
-  [FLEXNetworkObserver start];
+  // The network plugin is set up at launch, ahead of the app's own sessions.
+  [FLEXNetworkObserver startLazily];
   [FLEXNetworkRecorder defaultRecorder].delegate = _delegate;
 }
 
+- (void)setCaptureFilter:(SKNetworkCaptureFilter *)captureFilter {
+  [FLEXNetworkRecorder defaultRecorder].captureFilter = captureFilter;
+}
+
+- (NSData *)responseBodyForIdentifier:(int64_t)identifier {
+  return [[FLEXNetworkRecorder defaultRecorder] cachedResponseBodyForIdentifier:identifier];
+}
+
 @end
 
 #endif
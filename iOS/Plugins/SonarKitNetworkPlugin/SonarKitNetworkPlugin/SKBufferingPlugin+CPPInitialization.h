@@ -13,15 +13,13 @@
 #import <iostream>
 #import <memory>
 
-struct CachedEvent {
-  NSString *method;
-  NSDictionary<NSString *, id> *sonarObject;
-};
-
-
 @interface SKBufferingPlugin(CPPInitialization)
 
 - (instancetype)initWithVectorEventSize:(NSUInteger)size connectionAccessQueue:(std::shared_ptr<facebook::sonar::DispatchQueue>)connectionAccessQueue;
+- (instancetype)initWithVectorEventSize:(NSUInteger)size
+                            bufferBytes:(NSUInteger)bufferBytes
+                             dropPolicy:(SKBufferDropPolicy)dropPolicy
+                  connectionAccessQueue:(std::shared_ptr<facebook::sonar::DispatchQueue>)connectionAccessQueue;
 - (instancetype)initWithDispatchQueue:(std::shared_ptr<facebook::sonar::DispatchQueue>)queue;
 
 @end
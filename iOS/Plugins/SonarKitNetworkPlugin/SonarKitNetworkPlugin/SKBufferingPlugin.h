@@ -11,12 +11,85 @@
 
 #import <SonarKit/SonarPlugin.h>
 
+/**
+ What happens to events sent while disconnected once the buffer is full.
+ */
+typedef NS_ENUM(NSUInteger, SKBufferDropPolicy) {
+  /** New events replace the oldest ones. */
+  SKBufferDropPolicyDropOldest,
+  /** New events are dropped. */
+  SKBufferDropPolicyDropNewest,
+  /**
+   New events are kept less and less often, replacing the oldest ones: the
+   n-th event past a full buffer of size events is kept with probability
+   size / (size + n). Events from the whole disconnected period stay
+   represented.
+   */
+  SKBufferDropPolicySample,
+};
+
 @interface SKBufferingPlugin : NSObject<SonarPlugin>
 
+/**
+ Buffers up to 500 events or 16MB while disconnected, dropping the oldest
+ events first.
+ */
 - (instancetype)initWithQueue:(dispatch_queue_t)queue NS_DESIGNATED_INITIALIZER;
 
+/**
+ bufferSize limits the number of buffered events, bufferBytes their total
+ size once serialized.
+ */
+- (instancetype)initWithQueue:(dispatch_queue_t)queue
+                   bufferSize:(NSUInteger)bufferSize
+                  bufferBytes:(NSUInteger)bufferBytes
+                   dropPolicy:(SKBufferDropPolicy)dropPolicy;
+
+/**
+ With a persistentPath, the buffer is kept in that file, mapped into memory,
+ so that events sent before the desktop connects survive the app being
+ relaunched, such as the ones from app startup. Falls back to an in-memory
+ buffer if the file can't be mapped.
+ */
+- (instancetype)initWithQueue:(dispatch_queue_t)queue
+                   bufferSize:(NSUInteger)bufferSize
+                  bufferBytes:(NSUInteger)bufferBytes
+                   dropPolicy:(SKBufferDropPolicy)dropPolicy
+               persistentPath:(NSString *)persistentPath NS_DESIGNATED_INITIALIZER;
+
+/**
+ The default buffer, kept in the file at persistentPath.
+ */
+- (instancetype)initWithQueue:(dispatch_queue_t)queue persistentPath:(NSString *)persistentPath;
+
+/**
+ Where a plugin's persistent buffer is kept, in Sonar's private directory.
+ */
++ (NSString *)persistentPathForIdentifier:(NSString *)identifier;
+
 - (void)send:(NSString *)method sonarObject:(NSDictionary<NSString *, id> *)sonarObject;
 
+/**
+ Sends data along with sonarObject as a binary frame when the connection can
+ carry one, which avoids base64 encoding it. Otherwise, and when buffered,
+ data goes into sonarObject under dataKey as a base64 string.
+ */
+- (void)send:(NSString *)method
+ sonarObject:(NSDictionary<NSString *, id> *)sonarObject
+        data:(NSData *)data
+      forKey:(NSString *)dataKey;
+
+/**
+ For subclasses: rewrites an event right before it's sent live, for encodings
+ that depend on what the connection has already been sent. Buffered events
+ are kept as they were passed to send and aren't rewritten when replayed, so
+ they must make sense to any connection. Called on the plugin's queue.
+ Returns sonarObject unchanged by default.
+ */
+- (NSDictionary<NSString *, id> *)encodeForConnection:(id<SonarConnection>)connection
+                                               method:(NSString *)method
+                                          sonarObject:(NSDictionary<NSString *, id> *)sonarObject;
+
 @end
 
 #endif
@@ -7,39 +7,122 @@
  */
 #if FB_SONARKIT_ENABLED
 
-#import <vector>
+#import <string>
 
 #import "SKBufferingPlugin.h"
+#import <FBCxxUtils/FBCxxFollyDynamicConvert.h>
+#import <Sonar/SonarEventRing.h>
+#import <Sonar/SonarMemoryBudget.h>
 #import <SonarKit/SonarConnection.h>
 #import "SKDispatchQueue.h"
 #import "SKBufferingPlugin+CPPInitialization.h"
 
 static const NSUInteger bufferSize = 500;
+static const NSUInteger bufferBytes = 16 * 1024 * 1024;
+// Buffered events are replayed this many at a time, so that a large buffer
+// doesn't hold up the queue when the desktop connects.
+static const NSUInteger replayChunkSize = 50;
+
+using EventRing = facebook::sonar::SonarEventRing;
+
+static EventRing::DropPolicy ringDropPolicy(SKBufferDropPolicy dropPolicy)
+{
+  switch (dropPolicy) {
+    case SKBufferDropPolicyDropNewest:
+      return EventRing::DropPolicy::DropNewest;
+    case SKBufferDropPolicySample:
+      return EventRing::DropPolicy::Sample;
+    case SKBufferDropPolicyDropOldest:
+      return EventRing::DropPolicy::DropOldest;
+  }
+  return EventRing::DropPolicy::DropOldest;
+}
 
-@interface SKBufferingPlugin()
-
-@property(assign, nonatomic) std::vector<CachedEvent> ringBuffer;
-@property(assign, nonatomic) std::shared_ptr<facebook::sonar::DispatchQueue> connectionAccessQueue;
-@property(strong, nonatomic) id<SonarConnection> connection;
-
-@end
+static NSDictionary<NSString *, id> *withBase64Data(NSDictionary<NSString *, id> *sonarObject, NSData *data, NSString *dataKey)
+{
+  NSMutableDictionary<NSString *, id> *object = [sonarObject mutableCopy];
+  object[dataKey] = data ? [data base64EncodedStringWithOptions:0] : [NSNull null];
+  return object;
+}
 
 @implementation SKBufferingPlugin
-// {
-//   std::vector<CachedEvent> _ringBuffer;
-//   std::shared_ptr<facebook::sonar::DispatchQueue> _connectionAccessQueue;
-//
-//   id<SonarConnection> _connection;
-// }
+{
+  std::unique_ptr<EventRing> _ringBuffer;
+  std::shared_ptr<facebook::sonar::DispatchQueue> _connectionAccessQueue;
+  std::shared_ptr<facebook::sonar::SonarMemoryBudget::Account> _budgetAccount;
+
+  id<SonarConnection> _connection;
+  BOOL _replaying;
+}
 
 - (instancetype)initWithQueue:(dispatch_queue_t)queue {
   if (self = [super init]) {
-    _ringBuffer.reserve(bufferSize);
+    _ringBuffer = std::make_unique<EventRing>(bufferSize, bufferBytes);
     _connectionAccessQueue = std::make_shared<facebook::sonar::GCDQueue>(queue);
+    [self openBudgetAccount];
   }
   return self;
 }
 
+- (instancetype)initWithQueue:(dispatch_queue_t)queue
+                   bufferSize:(NSUInteger)size
+                  bufferBytes:(NSUInteger)bytes
+                   dropPolicy:(SKBufferDropPolicy)dropPolicy {
+  return [self initWithQueue:queue bufferSize:size bufferBytes:bytes dropPolicy:dropPolicy persistentPath:nil];
+}
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue
+                   bufferSize:(NSUInteger)size
+                  bufferBytes:(NSUInteger)bytes
+                   dropPolicy:(SKBufferDropPolicy)dropPolicy
+               persistentPath:(NSString *)persistentPath {
+  if (self = [super init]) {
+    if (persistentPath) {
+      _ringBuffer = EventRing::mapped([persistentPath fileSystemRepresentation], size, bytes, ringDropPolicy(dropPolicy));
+    }
+    if (!_ringBuffer) {
+      _ringBuffer = std::make_unique<EventRing>(size, bytes, ringDropPolicy(dropPolicy));
+    }
+    _connectionAccessQueue = std::make_shared<facebook::sonar::GCDQueue>(queue);
+    [self openBudgetAccount];
+  }
+  return self;
+}
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue persistentPath:(NSString *)persistentPath {
+  return [self initWithQueue:queue
+                  bufferSize:bufferSize
+                 bufferBytes:bufferBytes
+                  dropPolicy:SKBufferDropPolicyDropOldest
+              persistentPath:persistentPath];
+}
+
+// Over Sonar's memory budget, the oldest buffered events are dropped on the
+// plugin's queue.
+- (void)openBudgetAccount {
+  __weak SKBufferingPlugin *weakSelf = self;
+  auto queue = _connectionAccessQueue;
+  _budgetAccount = facebook::sonar::SonarMemoryBudget::shared().open(
+    [[NSString stringWithFormat:@"%@ buffer", [self identifier]] UTF8String],
+    [weakSelf, queue](size_t bytes) {
+      queue->async(^{
+        SKBufferingPlugin *strongSelf = weakSelf;
+        if (strongSelf) {
+          strongSelf->_ringBuffer->evict(bytes);
+          strongSelf->_budgetAccount->setBytes(strongSelf->_ringBuffer->usedBytes());
+        }
+      });
+    });
+  _budgetAccount->setBytes(_ringBuffer->usedBytes());
+}
+
++ (NSString *)persistentPathForIdentifier:(NSString *)identifier {
+  // Same directory SonarClient hands to the C++ client as its private one.
+  NSString *privateAppDirectory = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES)[0];
+  [[NSFileManager defaultManager] createDirectoryAtPath:privateAppDirectory withIntermediateDirectories:YES attributes:nil error:nil];
+  return [privateAppDirectory stringByAppendingPathComponent:[NSString stringWithFormat:@"sonar-%@.buffer", identifier]];
+}
+
 - (NSString *)identifier {
   // Note: This must match with the javascript pulgin identifier!!
   return @"Network";
@@ -61,26 +144,75 @@ static const NSUInteger bufferSize = 500;
 - (void)send:(NSString *)method
  sonarObject:(NSDictionary<NSString *, id> *)sonarObject {
   _connectionAccessQueue->async(^{
-    if (self->_connection) {
-      [self->_connection send:method withParams:sonarObject];
-    } else {
-      if (self->_ringBuffer.size() == bufferSize) {
-        return;
-      }
-      self->_ringBuffer.push_back({
-        .method = method,
-        .sonarObject = sonarObject
-      });
+    [self sendOrBuffer:method sonarObject:sonarObject];
+  });
+}
+
+- (void)send:(NSString *)method
+ sonarObject:(NSDictionary<NSString *, id> *)sonarObject
+        data:(NSData *)data
+      forKey:(NSString *)dataKey {
+  _connectionAccessQueue->async(^{
+    id<SonarConnection> connection = self->_connection;
+    if (!connection || self->_replaying) {
+      [self sendOrBuffer:method sonarObject:withBase64Data(sonarObject, data, dataKey)];
+      return;
+    }
+    NSDictionary<NSString *, id> *encoded = [self encodeForConnection:connection method:method sonarObject:sonarObject];
+    if (data &&
+        [connection respondsToSelector:@selector(send:withMetadata:data:)] &&
+        [connection send:method withMetadata:encoded data:data]) {
+      return;
     }
+    [connection send:method withParams:withBase64Data(encoded, data, dataKey)];
   });
 }
 
+- (void)sendOrBuffer:(NSString *)method
+         sonarObject:(NSDictionary<NSString *, id> *)sonarObject {
+  // While buffered events are being replayed, new ones queue up behind
+  // them so that the desktop still sees events in order.
+  if (_connection && !_replaying) {
+    [_connection send:method withParams:[self encodeForConnection:_connection method:method sonarObject:sonarObject]];
+  } else {
+    // Buffered events are kept serialized, which is far more compact than
+    // holding on to the objects, and is what gets sent on replay anyway.
+    _ringBuffer->push(
+      [method UTF8String],
+      facebook::cxxutils::convertIdToJson(sonarObject, true));
+    _budgetAccount->setBytes(_ringBuffer->usedBytes());
+  }
+}
+
+- (NSDictionary<NSString *, id> *)encodeForConnection:(id<SonarConnection>)connection
+                                               method:(NSString *)method
+                                          sonarObject:(NSDictionary<NSString *, id> *)sonarObject {
+  return sonarObject;
+}
+
 - (void)sendBufferedEvents {
   NSAssert(_connection, @"connection object cannot be nil");
-  for (const auto &event : _ringBuffer) {
-    [_connection send:event.method withParams:event.sonarObject];
+  const BOOL sendsJSON = [_connection respondsToSelector:@selector(send:withJSONParams:)];
+  _ringBuffer->drain([&](folly::StringPiece method, folly::StringPiece params) {
+    NSString *methodString = [[NSString alloc] initWithBytes:method.data() length:method.size() encoding:NSUTF8StringEncoding];
+    NSData *json = [NSData dataWithBytes:params.data() length:params.size()];
+    if (sendsJSON) {
+      [self->_connection send:methodString withJSONParams:json];
+    } else {
+      [self->_connection send:methodString withParams:[NSJSONSerialization JSONObjectWithData:json options:0 error:nil]];
+    }
+  }, replayChunkSize);
+  _budgetAccount->setBytes(_ringBuffer->usedBytes());
+  _replaying = !_ringBuffer->empty();
+  if (_replaying) {
+    _connectionAccessQueue->async(^{
+      if (self->_connection) {
+        [self sendBufferedEvents];
+      } else {
+        self->_replaying = NO;
+      }
+    });
   }
-  _ringBuffer.clear();
 }
 
 @end
@@ -88,12 +220,24 @@ static const NSUInteger bufferSize = 500;
 @implementation SKBufferingPlugin(CPPInitialization)
 
 - (instancetype)initWithVectorEventSize:(NSUInteger)size connectionAccessQueue:(std::shared_ptr<facebook::sonar::DispatchQueue>)connectionAccessQueue {
+    return [self initWithVectorEventSize:size
+                             bufferBytes:bufferBytes
+                              dropPolicy:SKBufferDropPolicyDropOldest
+                   connectionAccessQueue:connectionAccessQueue];
+}
+
+- (instancetype)initWithVectorEventSize:(NSUInteger)size
+                            bufferBytes:(NSUInteger)bytes
+                             dropPolicy:(SKBufferDropPolicy)dropPolicy
+                  connectionAccessQueue:(std::shared_ptr<facebook::sonar::DispatchQueue>)connectionAccessQueue {
     if (self = [super init]) {
-      _ringBuffer.reserve(size);
+      _ringBuffer = std::make_unique<EventRing>(size, bytes, ringDropPolicy(dropPolicy));
       _connectionAccessQueue = connectionAccessQueue;
+      [self openBudgetAccount];
     }
     return self;
 }
+
 - (instancetype)initWithDispatchQueue:(std::shared_ptr<facebook::sonar::DispatchQueue>)queue {
     return [self initWithVectorEventSize:bufferSize
                       connectionAccessQueue:queue];
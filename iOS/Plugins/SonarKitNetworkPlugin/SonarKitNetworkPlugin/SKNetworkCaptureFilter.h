@@ -0,0 +1,33 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ Which requests the desktop wants to see, as pushed with setFilter. Checked
+ before a request or response is turned into a message, so that the ones
+ nobody looks at cost next to nothing. Every key is optional, and an empty
+ filter captures everything.
+ */
+@interface SKNetworkCaptureFilter : NSObject
+
+/**
+ Takes host (which also matches its subdomains), pathPrefix, methods,
+ minStatus, maxStatus, contentType (a prefix) and maxBodyBytes.
+ */
+- (instancetype)initWithDictionary:(NSDictionary<NSString *, id> *)dictionary;
+
+- (BOOL)acceptsRequest:(NSURLRequest *)request;
+
+/** Only needs what is known before the body arrives. */
+- (BOOL)acceptsResponse:(NSURLResponse *)response;
+
+/** Bodies longer than this are reported without their data. */
+@property (assign, nonatomic, readonly) NSUInteger maxBodyLength;
+
+@end
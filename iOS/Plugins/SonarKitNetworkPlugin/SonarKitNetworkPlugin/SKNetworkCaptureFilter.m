@@ -0,0 +1,83 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#import "SKNetworkCaptureFilter.h"
+
+static NSString *nonEmptyString(id value)
+{
+  return [value isKindOfClass:[NSString class]] && [value length] > 0 ? value : nil;
+}
+
+@implementation SKNetworkCaptureFilter
+{
+  NSString *_host;
+  // "." and the host, which subdomains end in.
+  NSString *_hostSuffix;
+  NSString *_pathPrefix;
+  NSArray<NSString *> *_methods;
+  NSInteger _minStatus;
+  NSInteger _maxStatus;
+  NSString *_contentType;
+}
+
+- (instancetype)initWithDictionary:(NSDictionary<NSString *, id> *)dictionary
+{
+  if (self = [super init]) {
+    _host = [nonEmptyString(dictionary[@"host"]) lowercaseString];
+    _hostSuffix = _host ? [@"." stringByAppendingString:_host] : nil;
+    _pathPrefix = nonEmptyString(dictionary[@"pathPrefix"]);
+    if ([dictionary[@"methods"] isKindOfClass:[NSArray class]]) {
+      _methods = dictionary[@"methods"];
+    }
+    _minStatus = [dictionary[@"minStatus"] isKindOfClass:[NSNumber class]] ? [dictionary[@"minStatus"] integerValue] : 0;
+    _maxStatus = [dictionary[@"maxStatus"] isKindOfClass:[NSNumber class]] ? [dictionary[@"maxStatus"] integerValue] : NSIntegerMax;
+    _contentType = [nonEmptyString(dictionary[@"contentType"]) lowercaseString];
+    _maxBodyLength = [dictionary[@"maxBodyBytes"] isKindOfClass:[NSNumber class]] ? [dictionary[@"maxBodyBytes"] unsignedIntegerValue] : NSUIntegerMax;
+  }
+  return self;
+}
+
+- (BOOL)acceptsRequest:(NSURLRequest *)request
+{
+  if (_methods) {
+    NSString *method = request.HTTPMethod ?: @"GET";
+    BOOL found = NO;
+    for (NSString *accepted in _methods) {
+      if ([accepted isKindOfClass:[NSString class]] && [accepted caseInsensitiveCompare:method] == NSOrderedSame) {
+        found = YES;
+        break;
+      }
+    }
+    if (!found) {
+      return NO;
+    }
+  }
+  if (_host) {
+    NSString *host = [request.URL.host lowercaseString];
+    if (!host || !([host isEqualToString:_host] || [host hasSuffix:_hostSuffix])) {
+      return NO;
+    }
+  }
+  return !_pathPrefix || [request.URL.path hasPrefix:_pathPrefix];
+}
+
+- (BOOL)acceptsResponse:(NSURLResponse *)response
+{
+  if (_minStatus > 0 || _maxStatus < NSIntegerMax) {
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+      return NO;
+    }
+    const NSInteger status = ((NSHTTPURLResponse *)response).statusCode;
+    if (status < _minStatus || status > _maxStatus) {
+      return NO;
+    }
+  }
+  return !_contentType || [[response.MIMEType lowercaseString] hasPrefix:_contentType];
+}
+
+@end
@@ -8,6 +8,7 @@
 #import <Foundation/Foundation.h>
 #import "SKRequestInfo.h"
 #import "SKResponseInfo.h"
+#import "SKNetworkCaptureFilter.h"
 
 @protocol SKNetworkReporterDelegate
 
@@ -20,4 +21,18 @@
 
 @property (weak, nonatomic) id<SKNetworkReporterDelegate> delegate;
 
+@optional
+
+/**
+ The full body of a response that was reported to the delegate, if the adapter still has it.
+ */
+- (NSData *)responseBodyForIdentifier:(int64_t)identifier;
+
+/**
+ The filter the desktop set, nil to capture everything. Adapters that check it
+ before building request and response infos save that work for the ones the
+ delegate would only discard.
+ */
+- (void)setCaptureFilter:(SKNetworkCaptureFilter *)captureFilter;
+
 @end
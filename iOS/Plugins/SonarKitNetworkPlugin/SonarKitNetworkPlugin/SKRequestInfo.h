@@ -12,7 +12,9 @@
 @property(assign, readwrite) int64_t identifier;
 @property(assign, readwrite) uint64_t timestamp;
 @property(strong, nonatomic) NSURLRequest* request;
+/** The body, base64 encoded. Only encoded when first needed. */
 @property(strong, nonatomic) NSString* body;
+@property(strong, nonatomic) NSData* bodyData;
 
 - (instancetype)initWithIdentifier:(int64_t)identifier timestamp:(uint64_t)timestamp request:(NSURLRequest*)request data:(NSData *)data;
 - (void)setBodyFromData:(NSData * _Nullable)data;
@@ -13,7 +13,9 @@
 @property(assign, readwrite) int64_t identifier;
 @property(assign, readwrite) uint64_t timestamp;
 @property(strong, nonatomic) NSURLResponse* response;
+/** The body, unless stripped, base64 encoded. Only encoded when first needed. */
 @property(strong, nonatomic) NSString* body;
+@property(strong, nonatomic) NSData* bodyData;
 
 - (instancetype)initWithIndentifier:(int64_t)identifier timestamp:(uint64_t)timestamp response:(NSURLResponse *)response data:(NSData *)data;
 - (void)setBodyFromData:(NSData * _Nullable)data;
@@ -13,17 +13,25 @@
 @synthesize timestamp = _timestamp;
 @synthesize response = _response;
 @synthesize body = _body;
+@synthesize bodyData = _bodyData;
 
 - (instancetype)initWithIndentifier:(int64_t)identifier timestamp:(uint64_t)timestamp response:(NSURLResponse *)response data:(NSData *)data {
   if(self = [super init]) {
     _identifier = identifier;
     _timestamp = timestamp;
     _response = response;
-    _body = [SKResponseInfo shouldStripReponseBodyWithResponse:response] ? nil : [data base64EncodedStringWithOptions: 0];
+    _bodyData = [SKResponseInfo shouldStripReponseBodyWithResponse:response] ? nil : data;
   }
   return self;
 }
 
+- (NSString *)body {
+  if (!_body) {
+    _body = [_bodyData base64EncodedStringWithOptions: 0];
+  }
+  return _body;
+}
+
 + (BOOL) shouldStripReponseBodyWithResponse:(NSURLResponse *)response {
   NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse*)response;
   NSString *contentType = httpResponse.allHeaderFields[@"content-type"];
@@ -37,7 +45,8 @@
 }
 
 - (void)setBodyFromData:(NSData *_Nullable)data {
-    self.body = [SKResponseInfo shouldStripReponseBodyWithResponse:self.response] ? nil : [data base64EncodedStringWithOptions: 0];
+    self.bodyData = [SKResponseInfo shouldStripReponseBodyWithResponse:self.response] ? nil : data;
+    self.body = nil;
 }
 
 @end
@@ -16,10 +16,23 @@
 @interface SonarKitNetworkPlugin : SKBufferingPlugin <SKNetworkReporterDelegate>
 
 - (instancetype)initWithNetworkAdapter:(id<SKNetworkAdapterDelegate>)adapter NS_DESIGNATED_INITIALIZER;
+/**
+ With persistBuffer, requests made before the desktop connects, in particular
+ the ones from app startup, are kept across launches until they're sent.
+ */
+- (instancetype)initWithNetworkAdapter:(id<SKNetworkAdapterDelegate>)adapter persistBuffer:(BOOL)persistBuffer NS_DESIGNATED_INITIALIZER;
 - (instancetype)initWithNetworkAdapter:(id<SKNetworkAdapterDelegate>)adapter queue:(dispatch_queue_t)queue; //For test purposes
 
 @property (strong, nonatomic) id<SKNetworkAdapterDelegate> adapter;
 
+/**
+ Bodies longer than this many bytes are cut down to it in newRequest and
+ newResponse, which then also carry dataTruncated and the full dataLength.
+ The desktop can fetch full response bodies with getResponseBody for as long
+ as the adapter keeps them. Defaults to 64KB.
+ */
+@property (assign, nonatomic) NSUInteger inlineBodyLimit;
+
 @end
 
 #endif
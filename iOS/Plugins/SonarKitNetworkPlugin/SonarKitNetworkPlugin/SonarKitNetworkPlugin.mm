@@ -14,12 +14,51 @@
 #import "SonarKitNetworkPlugin+CPPInitialization.h"
 #import "SKBufferingPlugin+CPPInitialization.h"
 #import "SKDispatchQueue.h"
+#import <SonarKit/SonarConnection.h>
+#import <SonarKit/SonarResponder.h>
+
+static const NSUInteger defaultInlineBodyLimit = 64 * 1024;
+
+// Header names the desktop is told the index of at most, so that requests
+// with made up header names can't grow the table forever.
+static const NSUInteger maxInternedHeaderNames = 1024;
+
+// Headers as a flat [name, value, name, value, ...] list, which costs one
+// allocation per message rather than two per header.
+static NSArray *compactHeaders(NSDictionary *fields)
+{
+  NSMutableArray *headers = [NSMutableArray arrayWithCapacity:fields.count * 2];
+  [fields enumerateKeysAndObjectsUsingBlock:^(id name, id value, BOOL *stop) {
+    [headers addObject:name];
+    [headers addObject:value];
+  }];
+  return headers;
+}
+
+static NSData *truncateBody(NSMutableDictionary<NSString *, id> *message, NSData *body, NSUInteger limit)
+{
+  if (body.length <= limit) {
+    return body;
+  }
+  message[@"dataTruncated"] = @YES;
+  message[@"dataLength"] = @(body.length);
+  return [body subdataWithRange:NSMakeRange(0, limit)];
+}
 
 @interface SonarKitNetworkPlugin ()
 
 @end
 
 @implementation SonarKitNetworkPlugin
+{
+  // Only used on the plugin's queue.
+  __weak id<SonarConnection> _headerNamesConnection;
+  NSMutableDictionary<NSString *, NSNumber *> *_headerNames;
+  // Set from the connection's thread, read from the adapter's.
+  SKNetworkCaptureFilter *_captureFilter;
+  // Requests left out by the filter, whose responses are left out too.
+  NSMutableSet<NSNumber *> *_skippedRequests;
+}
 
 - (void)setAdapter:(id<SKNetworkAdapterDelegate>)adapter {
   _adapter = adapter;
@@ -28,6 +67,7 @@
 
 - (instancetype)init {
   if (self = [super initWithQueue:dispatch_queue_create("com.sonarkit.network.buffer", DISPATCH_QUEUE_SERIAL)]) {
+    _inlineBodyLimit = defaultInlineBodyLimit;
   }
   return self;
 }
@@ -36,6 +76,17 @@
   if (self = [super initWithQueue:dispatch_queue_create("com.sonarkit.network.buffer", DISPATCH_QUEUE_SERIAL)]) {
     adapter.delegate = self;
     _adapter = adapter;
+    _inlineBodyLimit = defaultInlineBodyLimit;
+  }
+  return self;
+}
+
+- (instancetype)initWithNetworkAdapter:(id<SKNetworkAdapterDelegate>)adapter persistBuffer:(BOOL)persistBuffer {
+  NSString *persistentPath = persistBuffer ? [SKBufferingPlugin persistentPathForIdentifier:@"Network"] : nil;
+  if (self = [super initWithQueue:dispatch_queue_create("com.sonarkit.network.buffer", DISPATCH_QUEUE_SERIAL) persistentPath:persistentPath]) {
+    adapter.delegate = self;
+    _adapter = adapter;
+    _inlineBodyLimit = defaultInlineBodyLimit;
   }
   return self;
 }
@@ -44,61 +95,164 @@
   if (self = [super initWithQueue:queue]) {
     adapter.delegate = self;
     _adapter = adapter;
+    _inlineBodyLimit = defaultInlineBodyLimit;
   }
   return self;
 }
 
+- (void)didConnect:(id<SonarConnection>)connection {
+  [super didConnect:connection];
+
+  // In order to avoid a retain cycle (Connection -> Block -> SonarKitNetworkPlugin -> Connection ...)
+  __weak SonarKitNetworkPlugin *weakSelf = self;
+  [connection receive:@"getResponseBody" withBlock:^(NSDictionary *params, id<SonarResponder> responder) {
+    [weakSelf onCallGetResponseBody:params[@"id"] withResponder:responder];
+  }];
+  [connection receive:@"setFilter" withBlock:^(NSDictionary *params, id<SonarResponder> responder) {
+    [weakSelf setCaptureFilter:[[SKNetworkCaptureFilter alloc] initWithDictionary:params]];
+    [responder success:@{}];
+  }];
+}
+
+- (void)didDisconnect {
+  // Everything is captured again while no desktop is around to say otherwise.
+  [self setCaptureFilter:nil];
+  [super didDisconnect];
+}
+
+- (void)setCaptureFilter:(SKNetworkCaptureFilter *)captureFilter {
+  @synchronized(self) {
+    _captureFilter = captureFilter;
+  }
+  id<SKNetworkAdapterDelegate> adapter = _adapter;
+  if ([(NSObject *)adapter respondsToSelector:@selector(setCaptureFilter:)]) {
+    [adapter setCaptureFilter:captureFilter];
+  }
+}
+
+- (SKNetworkCaptureFilter *)captureFilter {
+  @synchronized(self) {
+    return _captureFilter;
+  }
+}
+
+- (void)onCallGetResponseBody:(NSNumber *)identifier withResponder:(id<SonarResponder>)responder {
+  id<SKNetworkAdapterDelegate> adapter = _adapter;
+  NSData *body = nil;
+  if ([identifier isKindOfClass:[NSNumber class]] && [(NSObject *)adapter respondsToSelector:@selector(responseBodyForIdentifier:)]) {
+    body = [adapter responseBodyForIdentifier:identifier.longLongValue];
+  }
+  if (!body) {
+    [responder error:@{ @"error": @"response body is not available" }];
+    return;
+  }
+  [responder success:@{
+                       @"id": identifier,
+                       @"data": [body base64EncodedStringWithOptions:0],
+                       }];
+}
+
+/**
+ Header names sent before on the same connection are replaced by their index
+ in a table the desktop keeps for the connection. Names new to the table are
+ sent along, in newHeaderNames, starting at index newHeaderNamesOffset.
+ */
+- (NSDictionary<NSString *, id> *)encodeForConnection:(id<SonarConnection>)connection
+                                               method:(NSString *)method
+                                          sonarObject:(NSDictionary<NSString *, id> *)sonarObject {
+  NSArray *headers = sonarObject[@"compactHeaders"];
+  if (headers.count == 0) {
+    return sonarObject;
+  }
+  if (connection != _headerNamesConnection || !_headerNames) {
+    _headerNamesConnection = connection;
+    _headerNames = [NSMutableDictionary new];
+  }
+
+  const NSUInteger offset = _headerNames.count;
+  NSMutableArray *encoded = [headers mutableCopy];
+  NSMutableArray<NSString *> *newNames = nil;
+  for (NSUInteger i = 0; i < encoded.count; i += 2) {
+    NSString *name = encoded[i];
+    NSNumber *index = _headerNames[name];
+    if (!index) {
+      if (_headerNames.count >= maxInternedHeaderNames) {
+        continue;
+      }
+      index = @(_headerNames.count);
+      _headerNames[name] = index;
+      if (!newNames) {
+        newNames = [NSMutableArray new];
+      }
+      [newNames addObject:name];
+    }
+    encoded[i] = index;
+  }
+
+  NSMutableDictionary<NSString *, id> *object = [sonarObject mutableCopy];
+  object[@"compactHeaders"] = encoded;
+  if (newNames) {
+    object[@"newHeaderNames"] = newNames;
+    object[@"newHeaderNamesOffset"] = @(offset);
+  }
+  return object;
+}
+
 #pragma mark - SKNetworkReporterDelegate
 
 
 - (void)didObserveRequest:(SKRequestInfo *)request;
 {
-  NSMutableArray<NSDictionary<NSString *, id> *> *headers = [NSMutableArray new];
-  for (NSString *key in [request.request.allHTTPHeaderFields allKeys]) {
-    NSDictionary<NSString *, id> *header = @{
-                                             @"key": key,
-                                             @"value": request.request.allHTTPHeaderFields[key]
-                                            };
-    [headers addObject: header];
+  SKNetworkCaptureFilter *filter = [self captureFilter];
+  if (filter && ![filter acceptsRequest:request.request]) {
+    @synchronized(self) {
+      if (!_skippedRequests) {
+        _skippedRequests = [NSMutableSet new];
+      }
+      [_skippedRequests addObject:@(request.identifier)];
+    }
+    return;
   }
+  NSMutableDictionary<NSString *, id> *message = [@{
+                                                   @"id": @(request.identifier),
+                                                   @"timestamp": @(request.timestamp),
+                                                   @"method": request.request.HTTPMethod ?: [NSNull null],
+                                                   @"url": [request.request.URL absoluteString] ?: [NSNull null],
+                                                   @"compactHeaders": compactHeaders(request.request.allHTTPHeaderFields),
+                                                   } mutableCopy];
+  NSData *body = filter && request.bodyData.length > filter.maxBodyLength ? nil : truncateBody(message, request.bodyData, _inlineBodyLimit);
 
-  NSString *body = request.body;
-
-  [self send:@"newRequest"
- sonarObject:@{
-               @"id": @(request.identifier),
-               @"timestamp": @(request.timestamp),
-               @"method": request.request.HTTPMethod ?: [NSNull null],
-               @"url": [request.request.URL absoluteString] ?: [NSNull null],
-               @"headers": headers,
-               @"data": body ? body : [NSNull null]
-               }];
+  [self send:@"newRequest" sonarObject:message data:body forKey:@"data"];
 }
 
 - (void)didObserveResponse:(SKResponseInfo *)response
 {
-  NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse*)response.response;
-
-  NSMutableArray<NSDictionary<NSString *, id> *> *headers = [NSMutableArray new];
-  for (NSString *key in [httpResponse.allHeaderFields allKeys]) {
-    NSDictionary<NSString *, id> *header = @{
-                                             @"key": key,
-                                             @"value": httpResponse.allHeaderFields[key]
-                                            };
-    [headers addObject: header];
+  SKNetworkCaptureFilter *filter = [self captureFilter];
+  @synchronized(self) {
+    NSNumber *identifier = @(response.identifier);
+    if ([_skippedRequests containsObject:identifier]) {
+      [_skippedRequests removeObject:identifier];
+      return;
+    }
   }
+  if (filter && ![filter acceptsResponse:response.response]) {
+    // The request was sent already, the desktop drops it.
+    [self send:@"dropRequest" sonarObject:@{ @"id": @(response.identifier) }];
+    return;
+  }
+
+  NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse*)response.response;
 
-  NSString *body = response.body;
+  NSMutableDictionary<NSString *, id> *message = [@{
+                                                   @"id": @(response.identifier),
+                                                   @"timestamp": @(response.timestamp),
+                                                   @"status": @(httpResponse.statusCode),
+                                                   @"reason": [NSHTTPURLResponse localizedStringForStatusCode: httpResponse.statusCode] ?: [NSNull null],
+                                                   @"compactHeaders": compactHeaders(httpResponse.allHeaderFields),
+                                                   } mutableCopy];
+  NSData *body = filter && response.bodyData.length > filter.maxBodyLength ? nil : truncateBody(message, response.bodyData, _inlineBodyLimit);
 
-  [self send:@"newResponse"
- sonarObject:@{
-               @"id": @(response.identifier),
-               @"timestamp": @(response.timestamp),
-               @"status": @(httpResponse.statusCode),
-               @"reason": [NSHTTPURLResponse localizedStringForStatusCode: httpResponse.statusCode] ?: [NSNull null],
-               @"headers": headers,
-               @"data": body ? body : [NSNull null]
-               }];
+  [self send:@"newResponse" sonarObject:message data:body forKey:@"data"];
 
 }
 
@@ -110,6 +264,7 @@
     if (self = [super initWithDispatchQueue:queue]) {
       adapter.delegate = self;
       _adapter = adapter;
+      _inlineBodyLimit = defaultInlineBodyLimit;
     }
     return self;
 }
@@ -14,6 +14,7 @@
 #import <SKIOSNetworkPlugin/SKIOSNetworkAdapter.h>
 
 #import "MainViewController.h"
+#import "PerfScenarioViewController.h"
 #import "RootViewController.h"
 
 #if !FB_SONARKIT_ENABLED
@@ -28,15 +29,26 @@
 {
   _window = [[UIWindow alloc] initWithFrame:[[UIScreen mainScreen] bounds]];
 
+  // Launching with -SonarPerfMode disabled|idle|desktop runs the perf scenarios instead.
+  NSString *perfMode = [[NSUserDefaults standardUserDefaults] stringForKey: @"SonarPerfMode"];
+  const BOOL startSonar = ![perfMode isEqualToString: @"disabled"];
+
   SonarClient *client = [SonarClient sharedClient];
+  if (startSonar) {
+    SKDescriptorMapper *layoutDescriptorMapper = [[SKDescriptorMapper alloc] initWithDefaults];
+    [SonarKitLayoutComponentKitSupport setUpWithDescriptorMapper: layoutDescriptorMapper];
+    [client addPlugin: [[SonarKitLayoutPlugin alloc] initWithRootNode: application
+                                                 withDescriptorMapper: layoutDescriptorMapper]];
 
-  SKDescriptorMapper *layoutDescriptorMapper = [[SKDescriptorMapper alloc] initWithDefaults];
-  [SonarKitLayoutComponentKitSupport setUpWithDescriptorMapper: layoutDescriptorMapper];
-  [client addPlugin: [[SonarKitLayoutPlugin alloc] initWithRootNode: application
-                                               withDescriptorMapper: layoutDescriptorMapper]];
+    [[SonarClient sharedClient] addPlugin: [[SonarKitNetworkPlugin alloc] initWithNetworkAdapter:[SKIOSNetworkAdapter new]]];
+    [client start];
+  }
 
-  [[SonarClient sharedClient] addPlugin: [[SonarKitNetworkPlugin alloc] initWithNetworkAdapter:[SKIOSNetworkAdapter new]]];
-  [client start];
+  if (perfMode) {
+    [_window setRootViewController: [[PerfScenarioViewController alloc] initWithMode: perfMode sonarStarted: startSonar]];
+    [_window makeKeyAndVisible];
+    return YES;
+  }
 
   UIStoryboard *storyboard = [UIStoryboard storyboardWithName:@"MainStoryBoard" bundle:nil];
   MainViewController *mainViewController = [storyboard instantiateViewControllerWithIdentifier:@"MainViewController"];
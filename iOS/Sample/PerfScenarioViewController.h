@@ -0,0 +1,23 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#import <UIKit/UIKit.h>
+
+/**
+Runs scripted scenarios that stress what Sonar's plugins watch, and measures frame times, CPU and memory
+while they run, to tell how much overhead Sonar adds. The app starts with it instead of the main screen
+when launched with -SonarPerfMode disabled, idle or desktop, for example with
+xcrun simctl launch booted com.facebook.flipper.sample -SonarPerfMode idle. disabled doesn't start Sonar,
+idle starts it without a desktop, and desktop waits for a desktop to open the Inspector first. Each
+scenario runs for -SonarPerfPhaseMs, 10 seconds unless given. The report is logged as a single line of
+JSON after "SonarPerf ", and written to sonar-perf-[mode].json in the app's Documents directory.
+*/
+@interface PerfScenarioViewController : UIViewController
+
+- (instancetype)initWithMode:(NSString *)mode sonarStarted:(BOOL)sonarStarted;
+
+@end
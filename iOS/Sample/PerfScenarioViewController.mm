@@ -0,0 +1,443 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#import "PerfScenarioViewController.h"
+
+#import <SonarKit/SonarClient.h>
+#import <QuartzCore/QuartzCore.h>
+#import <mach/mach.h>
+#import <sys/resource.h>
+
+#import <algorithm>
+#import <vector>
+
+static const NSTimeInterval kDefaultPhaseDuration = 10;
+static const NSTimeInterval kSettleDuration = 2;
+static const NSTimeInterval kDesktopTimeout = 30;
+static NSString *const kPerfHost = @"sonar-perf.invalid";
+
+// Answers requests to kPerfHost with the same JSON body, without touching the network, so that the
+// network scenario measures what reporting requests costs. Tasks still go through NSURLSession, which
+// is what the network plugin watches.
+@interface SKPerfURLProtocol : NSURLProtocol
+@end
+
+@implementation SKPerfURLProtocol
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request {
+  return [request.URL.host isEqualToString: kPerfHost];
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request {
+  return request;
+}
+
+- (void)startLoading {
+  static NSData *body;
+  static dispatch_once_t once;
+  dispatch_once(&once, ^{
+    NSMutableData *data = [NSMutableData dataWithLength: 4 * 1024];
+    memset(data.mutableBytes, 'a', data.length);
+    body = data;
+  });
+  NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL: self.request.URL
+                                                            statusCode: 200
+                                                           HTTPVersion: @"HTTP/1.1"
+                                                          headerFields: @{ @"Content-Type": @"application/json",
+                                                                           @"Content-Length": [@(body.length) stringValue] }];
+  [self.client URLProtocol: self didReceiveResponse: response cacheStoragePolicy: NSURLCacheStorageNotAllowed];
+  [self.client URLProtocol: self didLoadData: body];
+  [self.client URLProtocolDidFinishLoading: self];
+}
+
+- (void)stopLoading {
+}
+
+@end
+
+// A scenario. The baseline does nothing, to measure the app at rest.
+@interface SKPerfPhase : NSObject
+@property (nonatomic, copy) NSString *name;
+// Sets up the phase's view, which is shown while it runs.
+@property (nonatomic, copy) UIView *(^start)(CGRect bounds);
+// Called at every frame while the phase runs.
+@property (nonatomic, copy) void (^frame)(void);
+// What the phase got done, added to its result.
+@property (nonatomic, copy) NSDictionary *(^stop)(void);
+@end
+
+@implementation SKPerfPhase
+@end
+
+@interface PerfScenarioViewController () <UICollectionViewDataSource>
+@end
+
+@implementation PerfScenarioViewController
+{
+  NSString *_mode;
+  BOOL _sonarStarted;
+  BOOL _desktopConnected;
+  NSTimeInterval _phaseDuration;
+  NSArray<SKPerfPhase *> *_phases;
+  NSMutableArray<NSDictionary *> *_results;
+
+  CADisplayLink *_displayLink;
+  std::vector<CFTimeInterval> _frameIntervals;
+  CFTimeInterval _lastFrame;
+  SKPerfPhase *_runningPhase;
+  UIView *_phaseView;
+
+  NSUInteger _cellBinds;
+}
+
+- (instancetype)initWithMode:(NSString *)mode sonarStarted:(BOOL)sonarStarted {
+  if (self = [super init]) {
+    _mode = [mode copy];
+    _sonarStarted = sonarStarted;
+    const double phaseMs = [[NSUserDefaults standardUserDefaults] doubleForKey: @"SonarPerfPhaseMs"];
+    _phaseDuration = phaseMs > 0 ? phaseMs / 1000 : kDefaultPhaseDuration;
+    _results = [NSMutableArray new];
+  }
+  return self;
+}
+
+- (void)viewDidLoad {
+  [super viewDidLoad];
+  self.view.backgroundColor = [UIColor whiteColor];
+  _phases = @[
+              [self baselinePhase],
+              [self hierarchyPhase],
+              [self scrollPhase],
+              [self networkPhase],
+              [self preferencesPhase],
+              ];
+}
+
+- (void)viewDidAppear:(BOOL)animated {
+  [super viewDidAppear: animated];
+  [self waitForDesktopUntil: CACurrentMediaTime() + kDesktopTimeout];
+}
+
+- (void)waitForDesktopUntil:(CFTimeInterval)deadline {
+  _desktopConnected = _sonarStarted && [[SonarClient sharedClient] isPluginActive: @"Inspector"];
+  if ([_mode isEqualToString: @"desktop"] && !_desktopConnected && CACurrentMediaTime() < deadline) {
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.5 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+      [self waitForDesktopUntil: deadline];
+    });
+    return;
+  }
+  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kSettleDuration * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+    [self runPhaseAtIndex: 0];
+  });
+}
+
+- (void)runPhaseAtIndex:(NSUInteger)index {
+  if (index == _phases.count) {
+    [self report];
+    return;
+  }
+  SKPerfPhase *phase = _phases[index];
+  [_phaseView removeFromSuperview];
+  _phaseView = phase.start ? phase.start(self.view.bounds) : nil;
+  if (_phaseView) {
+    [self.view addSubview: _phaseView];
+  }
+
+  _runningPhase = phase;
+  _frameIntervals.clear();
+  _lastFrame = 0;
+  _displayLink = [CADisplayLink displayLinkWithTarget: self selector: @selector(displayLinkDidFire:)];
+  [_displayLink addToRunLoop: [NSRunLoop mainRunLoop] forMode: NSRunLoopCommonModes];
+  const double cpuStart = [self cpuSeconds];
+  const CFTimeInterval wallStart = CACurrentMediaTime();
+
+  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_phaseDuration * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+    // The display link retains its target, which keeps the controller alive until here.
+    [self->_displayLink invalidate];
+    self->_displayLink = nil;
+    self->_runningPhase = nil;
+    const double cpu = [self cpuSeconds] - cpuStart;
+    const double wall = CACurrentMediaTime() - wallStart;
+    NSMutableDictionary *result = [@{
+                                     @"name": phase.name,
+                                     @"wallMs": @(wall * 1000),
+                                     @"cpuMs": @(cpu * 1000),
+                                     @"cpuPercent": @(wall > 0 ? 100 * cpu / wall : 0),
+                                     @"frames": [self frameStats],
+                                     @"memory": [self memory],
+                                     } mutableCopy];
+    if (phase.stop) {
+      [result addEntriesFromDictionary: phase.stop()];
+    }
+    [self->_results addObject: result];
+    // Lets the work a phase queued, such as network callbacks, drain before the next.
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kSettleDuration * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+      [self runPhaseAtIndex: index + 1];
+    });
+  });
+}
+
+- (void)displayLinkDidFire:(CADisplayLink *)displayLink {
+  if (_lastFrame != 0) {
+    _frameIntervals.push_back(displayLink.timestamp - _lastFrame);
+  }
+  _lastFrame = displayLink.timestamp;
+  if (_runningPhase.frame) {
+    _runningPhase.frame();
+  }
+}
+
+- (NSDictionary *)frameStats {
+  std::vector<CFTimeInterval> sorted = _frameIntervals;
+  std::sort(sorted.begin(), sorted.end());
+  const CFTimeInterval frameDuration = 1.0 / MAX(60, [UIScreen mainScreen].maximumFramesPerSecond);
+  NSUInteger janky = 0;
+  for (CFTimeInterval interval : sorted) {
+    // A frame that took longer than one and a half vsyncs missed one.
+    if (interval > 1.5 * frameDuration) {
+      janky++;
+    }
+  }
+  auto percentileMs = [&](double percentile) -> double {
+    if (sorted.empty()) {
+      return 0;
+    }
+    const long index = (long)ceil(percentile * sorted.size()) - 1;
+    return sorted[std::max(0L, std::min((long)sorted.size() - 1, index))] * 1000;
+  };
+  return @{
+           @"count": @(sorted.size()),
+           @"janky": @(janky),
+           @"p50Ms": @(percentileMs(0.5)),
+           @"p90Ms": @(percentileMs(0.9)),
+           @"p99Ms": @(percentileMs(0.99)),
+           @"maxMs": @(percentileMs(1)),
+           };
+}
+
+- (double)cpuSeconds {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+- (NSDictionary *)memory {
+  task_vm_info_data_t info;
+  mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+  if (task_info(mach_task_self(), TASK_VM_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+    return @{};
+  }
+  return @{
+           @"physFootprintKb": @(info.phys_footprint / 1024),
+           @"residentKb": @(info.resident_size / 1024),
+           };
+}
+
+- (void)report {
+  NSDictionary *report = @{
+                           @"platform": @"ios",
+                           @"mode": _mode,
+                           @"sonarStarted": @(_sonarStarted),
+                           @"desktopConnected": @(_desktopConnected),
+                           @"device": [UIDevice currentDevice].model,
+                           @"system": [UIDevice currentDevice].systemVersion,
+                           @"phaseMs": @(_phaseDuration * 1000),
+                           @"phases": _results,
+                           };
+  NSData *json = [NSJSONSerialization dataWithJSONObject: report options: 0 error: nil];
+  NSLog(@"SonarPerf %@", [[NSString alloc] initWithData: json encoding: NSUTF8StringEncoding]);
+  NSURL *documents = [[NSFileManager defaultManager] URLsForDirectory: NSDocumentDirectory inDomains: NSUserDomainMask].firstObject;
+  NSURL *file = [documents URLByAppendingPathComponent: [NSString stringWithFormat: @"sonar-perf-%@.json", _mode]];
+  [json writeToURL: file atomically: YES];
+  NSLog(@"SonarPerf report written to %@", file.path);
+
+  [_phaseView removeFromSuperview];
+  UILabel *done = [[UILabel alloc] initWithFrame: self.view.bounds];
+  done.text = @"Done";
+  done.textAlignment = NSTextAlignmentCenter;
+  [self.view addSubview: done];
+}
+
+#pragma mark - Phases
+
+- (SKPerfPhase *)baselinePhase {
+  SKPerfPhase *phase = [SKPerfPhase new];
+  phase.name = @"baseline";
+  return phase;
+}
+
+// A deep and wide hierarchy with a label changing every frame, which lays it out again.
+- (SKPerfPhase *)hierarchyPhase {
+  SKPerfPhase *phase = [SKPerfPhase new];
+  phase.name = @"hierarchy";
+  NSMutableArray<UILabel *> *leaves = [NSMutableArray new];
+  __block NSUInteger views = 0;
+  __block NSUInteger frame = 0;
+  phase.start = ^UIView *(CGRect bounds) {
+    [leaves removeAllObjects];
+    views = 0;
+    UIView *root = [[UIView alloc] initWithFrame: bounds];
+    __block __weak void (^weakBuild)(UIView *, NSUInteger);
+    void (^build)(UIView *, NSUInteger) = ^(UIView *parent, NSUInteger depth) {
+      static const NSUInteger kBreadth = 4;
+      static const NSUInteger kDepth = 6;
+      const CGSize size = parent.bounds.size;
+      for (NSUInteger i = 0; i < kBreadth; i++) {
+        views++;
+        // Alternates columns and rows, like nested stack views.
+        const CGRect rect = depth % 2 == 0
+          ? CGRectMake(i * size.width / kBreadth, 0, size.width / kBreadth, size.height)
+          : CGRectMake(0, i * size.height / kBreadth, size.width, size.height / kBreadth);
+        if (depth == kDepth) {
+          UILabel *leaf = [[UILabel alloc] initWithFrame: rect];
+          leaf.font = [UIFont systemFontOfSize: 4];
+          leaf.text = @"0";
+          [parent addSubview: leaf];
+          [leaves addObject: leaf];
+          continue;
+        }
+        UIView *group = [[UIView alloc] initWithFrame: rect];
+        [parent addSubview: group];
+        weakBuild(group, depth + 1);
+      }
+    };
+    weakBuild = build;
+    build(root, 1);
+    return root;
+  };
+  phase.frame = ^{
+    frame++;
+    UILabel *leaf = leaves[(frame * 31) % leaves.count];
+    leaf.text = [@(frame) stringValue];
+    [leaf sizeToFit];
+  };
+  phase.stop = ^NSDictionary *{
+    return @{ @"views": @(views) };
+  };
+  return phase;
+}
+
+// Scrolls a long collection view back and forth, dequeuing new cells every few frames.
+- (SKPerfPhase *)scrollPhase {
+  SKPerfPhase *phase = [SKPerfPhase new];
+  phase.name = @"scroll";
+  __weak PerfScenarioViewController *weakSelf = self;
+  __block UICollectionView *collectionView;
+  __block CGFloat direction = 1;
+  phase.start = ^UIView *(CGRect bounds) {
+    UICollectionViewFlowLayout *layout = [UICollectionViewFlowLayout new];
+    layout.itemSize = CGSizeMake(bounds.size.width, 44);
+    layout.minimumLineSpacing = 0;
+    collectionView = [[UICollectionView alloc] initWithFrame: bounds collectionViewLayout: layout];
+    collectionView.backgroundColor = [UIColor whiteColor];
+    [collectionView registerClass: [UICollectionViewCell class] forCellWithReuseIdentifier: @"row"];
+    collectionView.dataSource = weakSelf;
+    return collectionView;
+  };
+  phase.frame = ^{
+    CGPoint offset = collectionView.contentOffset;
+    const CGFloat maxOffset = collectionView.contentSize.height - collectionView.bounds.size.height;
+    if ((direction > 0 && offset.y >= maxOffset) || (direction < 0 && offset.y <= 0)) {
+      direction = -direction;
+    }
+    offset.y = MAX(0, MIN(maxOffset, offset.y + 20 * direction));
+    collectionView.contentOffset = offset;
+  };
+  phase.stop = ^NSDictionary *{
+    collectionView = nil;
+    PerfScenarioViewController *strongSelf = weakSelf;
+    return @{ @"binds": @(strongSelf ? strongSelf->_cellBinds : 0) };
+  };
+  return phase;
+}
+
+- (NSInteger)collectionView:(UICollectionView *)collectionView numberOfItemsInSection:(NSInteger)section {
+  return 10000;
+}
+
+- (UICollectionViewCell *)collectionView:(UICollectionView *)collectionView cellForItemAtIndexPath:(NSIndexPath *)indexPath {
+  UICollectionViewCell *cell = [collectionView dequeueReusableCellWithReuseIdentifier: @"row" forIndexPath: indexPath];
+  UILabel *label = (UILabel *)[cell.contentView viewWithTag: 1];
+  if (label == nil) {
+    label = [[UILabel alloc] initWithFrame: CGRectInset(cell.contentView.bounds, 16, 0)];
+    label.tag = 1;
+    [cell.contentView addSubview: label];
+  }
+  label.text = [NSString stringWithFormat: @"Row %ld", (long)indexPath.item];
+  _cellBinds++;
+  return cell;
+}
+
+// Keeps a burst of requests in flight through NSURLSession, answered by SKPerfURLProtocol.
+- (SKPerfPhase *)networkPhase {
+  static const NSUInteger kInFlight = 8;
+  SKPerfPhase *phase = [SKPerfPhase new];
+  phase.name = @"network";
+  __block BOOL running = NO;
+  __block NSUInteger completed = 0;
+  __block NSUInteger failed = 0;
+  __block NSURLSession *session;
+  __block __weak void (^weakRequest)(NSUInteger);
+  void (^request)(NSUInteger) = ^(NSUInteger sequence) {
+    NSURL *url = [NSURL URLWithString: [NSString stringWithFormat: @"https://%@/items/%lu?perf=1", kPerfHost, (unsigned long)sequence]];
+    void (^next)(NSUInteger) = weakRequest;
+    [[session dataTaskWithURL: url completionHandler: ^(NSData *data, NSURLResponse *response, NSError *error) {
+      dispatch_async(dispatch_get_main_queue(), ^{
+        if (error) {
+          failed++;
+        } else {
+          completed++;
+        }
+        if (running && next) {
+          next(sequence + kInFlight);
+        }
+      });
+    }] resume];
+  };
+  weakRequest = request;
+  phase.start = ^UIView *(CGRect bounds) {
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
+    configuration.protocolClasses = @[ [SKPerfURLProtocol class] ];
+    session = [NSURLSession sessionWithConfiguration: configuration];
+    running = YES;
+    for (NSUInteger i = 0; i < kInFlight; i++) {
+      request(i);
+    }
+    return nil;
+  };
+  phase.stop = ^NSDictionary *{
+    running = NO;
+    [session finishTasksAndInvalidate];
+    // Holds on to the request block, which the tasks only reference weakly, until the phase ends.
+    (void)request;
+    return @{ @"requests": @(completed), @"failures": @(failed) };
+  };
+  return phase;
+}
+
+// Writes to NSUserDefaults many times a frame. There's no iOS plugin for them yet, so this measures
+// what Sonar's swizzling and invalidation cost alongside the writes.
+- (SKPerfPhase *)preferencesPhase {
+  static const NSUInteger kWritesPerFrame = 20;
+  SKPerfPhase *phase = [SKPerfPhase new];
+  phase.name = @"preferences";
+  __block NSUInteger writes = 0;
+  NSUserDefaults *defaults = [[NSUserDefaults alloc] initWithSuiteName: @"sonar-perf"];
+  phase.frame = ^{
+    for (NSUInteger i = 0; i < kWritesPerFrame; i++) {
+      [defaults setInteger: writes forKey: [NSString stringWithFormat: @"perf-%lu", (unsigned long)(writes % 100)]];
+      writes++;
+    }
+  };
+  phase.stop = ^NSDictionary *{
+    [defaults removePersistentDomainForName: @"sonar-perf"];
+    return @{ @"writes": @(writes) };
+  };
+  return phase;
+}
+
+@end
@@ -15,4 +15,6 @@ pure Objective-C plugins to send messages to the underlying connection.
 */
 @interface SonarCppBridgingConnection : NSObject <SonarConnection>
 - (instancetype)initWithCppConnection:(std::shared_ptr<facebook::sonar::SonarConnection>)conn;
+/** For plugins written in C++ underneath, such as SKMetricsPlugin. */
+@property (nonatomic, readonly) std::shared_ptr<facebook::sonar::SonarConnection> cppConnection;
 @end
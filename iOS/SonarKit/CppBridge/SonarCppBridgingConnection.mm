@@ -8,7 +8,9 @@
 #import "SonarCppBridgingConnection.h"
 
 #import <FBCxxUtils/FBCxxFollyDynamicConvert.h>
+#import <folly/io/IOBuf.h>
 
+#import "SonarCppBridgingQueue.h"
 #import "SonarCppBridgingResponder.h"
 
 @implementation SonarCppBridgingConnection
@@ -24,11 +26,75 @@
   return self;
 }
 
+- (std::shared_ptr<facebook::sonar::SonarConnection>)cppConnection
+{
+  return conn_;
+}
+
 #pragma mark - SonarConnection
 
+// All sends go through the bridging queue, converting there, so that they
+// stay in order with each other and with responses.
+
 - (void)send:(NSString *)method withParams:(NSDictionary *)params
 {
-  conn_->send([method UTF8String], facebook::cxxutils::convertIdToFollyDynamic(params, true));
+  auto conn = conn_;
+  NSString *const snapshotMethod = [method copy];
+  NSDictionary *const snapshot = [params copy];
+  dispatch_async(SonarCppBridgingQueue(), ^{
+    @autoreleasepool {
+      conn->sendJson([snapshotMethod UTF8String], facebook::cxxutils::convertIdToJson(snapshot, true));
+    }
+  });
+}
+
+- (void)send:(NSString *)method withJSONParams:(NSData *)json
+{
+  auto conn = conn_;
+  NSString *const snapshotMethod = [method copy];
+  NSData *const snapshot = [json copy];
+  dispatch_async(SonarCppBridgingQueue(), ^{
+    conn->sendJson([snapshotMethod UTF8String], std::string(reinterpret_cast<const char *>(snapshot.bytes), snapshot.length));
+  });
+}
+
+- (BOOL)send:(NSString *)method withMetadata:(NSDictionary *)metadata data:(NSData *)data
+{
+  if (!conn_->supportsBinary()) {
+    return NO;
+  }
+  auto conn = conn_;
+  NSString *const snapshotMethod = [method copy];
+  NSDictionary *const snapshotMetadata = [metadata copy];
+  NSData *const snapshot = [data copy];
+  dispatch_async(SonarCppBridgingQueue(), ^{
+    @autoreleasepool {
+      // The frame is written straight from the NSData's bytes, which it keeps
+      // alive until it has been sent.
+      auto buffer = snapshot.length == 0
+        ? folly::IOBuf::create(0)
+        : folly::IOBuf::takeOwnership(
+            const_cast<void *>(snapshot.bytes),
+            snapshot.length,
+            [](void *, void *retainedData) { CFRelease(retainedData); },
+            const_cast<void *>(CFBridgingRetain(snapshot)));
+      conn->sendBinary(
+        [snapshotMethod UTF8String],
+        facebook::cxxutils::convertIdToFollyDynamic(snapshotMetadata, true),
+        std::move(buffer));
+    }
+  });
+  return YES;
+}
+
+- (void)cacheResponsesOf:(NSString *)method version:(NSString *)version
+{
+  conn_->cacheResponses([method UTF8String], [version UTF8String]);
+}
+
+- (void)invalidateResponses:(NSString *)version
+{
+  conn_->invalidateResponses([version UTF8String]);
 }
 
 - (void)receive:(NSString *)method withBlock:(SonarReceiver)receiver
@@ -38,7 +104,7 @@
       @autoreleasepool {
         SonarCppBridgingResponder *const objCResponder =
         [[SonarCppBridgingResponder alloc] initWithCppResponder:std::move(responder)];
-        receiver(facebook::cxxutils::convertFollyDynamicToId(message), objCResponder);
+        receiver(facebook::cxxutils::convertFollyDynamicToLazyId(message), objCResponder);
       }
     };
     conn_->receive([method UTF8String], lambda);
@@ -0,0 +1,15 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#import <Foundation/Foundation.h>
+
+/**
+The serial queue the bridging connection and responders convert Objective-C
+payloads on, off the thread that hands them over, which is often the main
+thread. Being serial, it keeps messages in the order they were handed over.
+*/
+dispatch_queue_t SonarCppBridgingQueue(void);
@@ -9,6 +9,8 @@
 
 #import <FBCxxUtils/FBCxxFollyDynamicConvert.h>
 
+#import "SonarCppBridgingQueue.h"
+
 @implementation SonarCppBridgingResponder {
   std::unique_ptr<facebook::sonar::SonarResponder> responder_;
 }
@@ -28,8 +30,29 @@
 
 #pragma mark - SonarResponder
 
-- (void)success:(NSDictionary *)response { responder_->success(facebook::cxxutils::convertIdToFollyDynamic(response, true)); }
+// Receivers mostly respond on the main thread, so responses are converted
+// on the bridging queue instead. The top level is copied, so that a mutable
+// response can be reused once this returns; what it contains can't be
+// mutated anymore.
+
+- (void)success:(NSDictionary *)response
+{
+  NSDictionary *const snapshot = [response copy];
+  dispatch_async(SonarCppBridgingQueue(), ^{
+    @autoreleasepool {
+      self->responder_->successJson(facebook::cxxutils::convertIdToJson(snapshot, true));
+    }
+  });
+}
 
-- (void)error:(NSDictionary *)response { responder_->error(facebook::cxxutils::convertIdToFollyDynamic(response, true)); }
+- (void)error:(NSDictionary *)response
+{
+  NSDictionary *const snapshot = [response copy];
+  dispatch_async(SonarCppBridgingQueue(), ^{
+    @autoreleasepool {
+      self->responder_->error(facebook::cxxutils::convertIdToFollyDynamic(snapshot, true));
+    }
+  });
+}
 
 @end
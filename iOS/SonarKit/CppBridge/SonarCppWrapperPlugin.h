@@ -25,10 +25,13 @@ Objective-C plugins if they want.
 */
 class SonarCppWrapperPlugin final : public facebook::sonar::SonarPlugin {
 public:
-  // Under ARC copying objCPlugin *does* increment its retain count
-  SonarCppWrapperPlugin(ObjCPlugin objCPlugin) : _objCPlugin(objCPlugin) {}
+  // Under ARC copying objCPlugin *does* increment its retain count.
+  // Plugin identifiers never change, so it is read once here rather than
+  // messaging the Objective-C plugin on every lookup.
+  SonarCppWrapperPlugin(ObjCPlugin objCPlugin)
+      : _objCPlugin(objCPlugin), _identifier([[objCPlugin identifier] UTF8String]) {}
 
-  std::string identifier() const override { return [[_objCPlugin identifier] UTF8String]; }
+  std::string identifier() const override { return _identifier; }
 
   void didConnect(std::shared_ptr<facebook::sonar::SonarConnection> conn) override
   {
@@ -42,6 +45,7 @@ public:
 
 private:
   ObjCPlugin _objCPlugin;
+  const std::string _identifier;
 };
 
 } // namespace sonar
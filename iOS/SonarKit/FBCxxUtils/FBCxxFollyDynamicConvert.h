@@ -3,6 +3,9 @@
 
 #import <Foundation/Foundation.h>
 
+#include <memory>
+#include <string>
+
 #include <folly/dynamic.h>
 
 namespace facebook {
@@ -11,4 +14,20 @@ namespace cxxutils {
 folly::dynamic convertIdToFollyDynamic(id json, bool nullifyNanAndInf = false);
 id convertFollyDynamicToId(const folly::dynamic &dyn);
 
+/*
+ * Like convertFollyDynamicToId, but objects and arrays are returned as an
+ * NSDictionary or NSArray backed by dyn, which only converts the children
+ * that are actually read. Passing one back to convertIdToFollyDynamic or
+ * convertIdToJson uses the backing dynamic directly.
+ */
+id convertFollyDynamicToLazyId(folly::dynamic dyn);
+
+/*
+ * Serializes json the way folly::toJson(convertIdToFollyDynamic(json)) would,
+ * but writes straight from the Foundation objects without building the
+ * folly::dynamic tree first. Dictionary keys that aren't strings are written
+ * using their description.
+ */
+std::string convertIdToJson(id json, bool nullifyNanAndInf = false);
+
 } }
@@ -4,6 +4,24 @@
 
 #import <objc/runtime.h>
 
+#include <cmath>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <folly/Conv.h>
+#include <folly/json.h>
+
+// Views over a shared folly::dynamic, for convertFollyDynamicToLazyId.
+@interface FBCxxFollyDynamicDictionary : NSDictionary
+- (instancetype)initWithRoot:(std::shared_ptr<const folly::dynamic>)root value:(const folly::dynamic *)value;
+- (const folly::dynamic &)dynamic;
+@end
+
+@interface FBCxxFollyDynamicArray : NSArray
+- (instancetype)initWithRoot:(std::shared_ptr<const folly::dynamic>)root value:(const folly::dynamic *)value;
+- (const folly::dynamic &)dynamic;
+@end
+
 namespace facebook {
 namespace cxxutils {
 
@@ -11,7 +29,12 @@ namespace cxxutils {
  * The implementation is taken from RCTFollyConvert(https://fburl.com/vzw8ql2q)
  */
 
-id convertFollyDynamicToId(const folly::dynamic &dyn)
+// Dictionary keys such as "name" or "id" repeat throughout a tree, and
+// NSStrings are immutable, so each distinct key is only created once per
+// conversion. The StringPieces point into the dynamic being converted.
+using KeyCache = std::unordered_map<folly::StringPiece, NSString *>;
+
+static id convertFollyDynamicToId(const folly::dynamic &dyn, KeyCache &keys)
 {
   // I could imagine an implementation which avoids copies by wrapping the
   // dynamic in a derived class of NSDictionary.  We can do that if profiling
@@ -31,7 +54,7 @@ id convertFollyDynamicToId(const folly::dynamic &dyn)
     case folly::dynamic::ARRAY: {
       NSMutableArray *array = [[NSMutableArray alloc] initWithCapacity:dyn.size()];
       for (auto &elem : dyn) {
-        id obj = convertFollyDynamicToId(elem);
+        id obj = convertFollyDynamicToId(elem, keys);
         if (obj) {
           [array addObject:obj];
         }
@@ -41,9 +64,18 @@ id convertFollyDynamicToId(const folly::dynamic &dyn)
     case folly::dynamic::OBJECT: {
       NSMutableDictionary *dict = [[NSMutableDictionary alloc] initWithCapacity:dyn.size()];
       for (auto &elem : dyn.items()) {
-        id obj = convertFollyDynamicToId(elem.second);
-        if (obj) {
-          dict[convertFollyDynamicToId(elem.first)] = obj;
+        id obj = convertFollyDynamicToId(elem.second, keys);
+        if (!obj) {
+          continue;
+        }
+        if (elem.first.isString()) {
+          NSString *&key = keys[elem.first.stringPiece()];
+          if (!key) {
+            key = convertFollyDynamicToId(elem.first, keys);
+          }
+          dict[key] = obj;
+        } else {
+          dict[convertFollyDynamicToId(elem.first, keys)] = obj;
         }
       }
       return dict;
@@ -51,9 +83,61 @@ id convertFollyDynamicToId(const folly::dynamic &dyn)
   }
 }
 
+id convertFollyDynamicToId(const folly::dynamic &dyn)
+{
+  KeyCache keys;
+  return convertFollyDynamicToId(dyn, keys);
+}
+
+static id convertFollyDynamicToLazyId(const std::shared_ptr<const folly::dynamic> &root, const folly::dynamic &value)
+{
+  if (value.isObject()) {
+    return [[FBCxxFollyDynamicDictionary alloc] initWithRoot:root value:&value];
+  } else if (value.isArray()) {
+    return [[FBCxxFollyDynamicArray alloc] initWithRoot:root value:&value];
+  }
+  return convertFollyDynamicToId(value);
+}
+
+id convertFollyDynamicToLazyId(folly::dynamic dyn)
+{
+  auto root = std::make_shared<const folly::dynamic>(std::move(dyn));
+  return convertFollyDynamicToLazyId(root, *root);
+}
+
+// Hands f the UTF-8 bytes of string. When the string already stores them
+// they are used in place, otherwise they are converted into a buffer that is
+// reused across calls, instead of a new NSData for every string.
+template <typename F>
+static void withUTF8Bytes(NSString *string, F &&f)
+{
+  const auto cfString = (__bridge CFStringRef)string;
+  if (const char *bytes = CFStringGetCStringPtr(cfString, kCFStringEncodingUTF8)) {
+    f(folly::StringPiece(bytes));
+    return;
+  }
+  static thread_local std::string buffer;
+  const CFIndex length = CFStringGetLength(cfString);
+  buffer.resize(CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8));
+  CFIndex used = 0;
+  CFStringGetBytes(
+    cfString,
+    CFRangeMake(0, length),
+    kCFStringEncodingUTF8,
+    0,
+    false,
+    reinterpret_cast<UInt8 *>(&buffer[0]),
+    buffer.size(),
+    &used);
+  f(folly::StringPiece(buffer.data(), used));
+}
+
 folly::dynamic convertIdToFollyDynamic(id json, bool nullifyNanAndInf)
 {
-  if (json == nil || json == (id)kCFNull) {
+  if ([json isKindOfClass:[FBCxxFollyDynamicDictionary class]] ||
+      [json isKindOfClass:[FBCxxFollyDynamicArray class]]) {
+    return [json dynamic];
+  } else if (json == nil || json == (id)kCFNull) {
     return nullptr;
   } else if ([json isKindOfClass:[NSNumber class]]) {
     const char *objCType = [json objCType];
@@ -104,8 +188,9 @@ folly::dynamic convertIdToFollyDynamic(id json, bool nullifyNanAndInf)
         //   fall through
     }
   } else if ([json isKindOfClass:[NSString class]]) {
-    NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
-    return std::string(reinterpret_cast<const char *>(data.bytes), data.length);
+    std::string string;
+    withUTF8Bytes(json, [&](folly::StringPiece bytes) { string.assign(bytes.data(), bytes.size()); });
+    return string;
   } else if ([json isKindOfClass:[NSArray class]]) {
     folly::dynamic array = folly::dynamic::array;
     for (id element in json) {
@@ -124,5 +209,215 @@ folly::dynamic convertIdToFollyDynamic(id json, bool nullifyNanAndInf)
 
   return nil;
 }
+
+static void appendJson(id json, bool nullifyNanAndInf, std::string &out)
+{
+  if ([json isKindOfClass:[FBCxxFollyDynamicDictionary class]] ||
+      [json isKindOfClass:[FBCxxFollyDynamicArray class]]) {
+    out.append(folly::toJson([json dynamic]));
+  } else if (json == nil || json == (id)kCFNull) {
+    out.append("null");
+  } else if ([json isKindOfClass:[NSNumber class]]) {
+    const char *objCType = [json objCType];
+    switch (objCType[0]) {
+      case _C_BOOL:
+        out.append([json boolValue] ? "true" : "false");
+        return;
+      case _C_CHR:
+        // See convertIdToFollyDynamic for why BOOL needs this check.
+        if ([json isKindOfClass:[@YES class]]) {
+          out.append([json boolValue] ? "true" : "false");
+        } else {
+          folly::toAppend([json longLongValue], &out);
+        }
+        return;
+      case _C_UCHR:
+      case _C_SHT:
+      case _C_USHT:
+      case _C_INT:
+      case _C_UINT:
+      case _C_LNG:
+      case _C_ULNG:
+      case _C_LNG_LNG:
+      case _C_ULNG_LNG:
+        folly::toAppend([json longLongValue], &out);
+        return;
+      case _C_FLT:
+      case _C_DBL: {
+        const double value = [json doubleValue];
+        if (isnan(value) || isinf(value)) {
+          if (!nullifyNanAndInf) {
+            throw std::runtime_error("convertIdToJson: value was a NaN or INF");
+          }
+          out.append("null");
+        } else {
+          folly::toAppend(value, &out);
+        }
+        return;
+      }
+    }
+    out.append("null");
+  } else if ([json isKindOfClass:[NSString class]]) {
+    withUTF8Bytes(json, [&](folly::StringPiece bytes) {
+      folly::json::escapeString(bytes, out, folly::json::serialization_opts());
+    });
+  } else if ([json isKindOfClass:[NSArray class]]) {
+    out.push_back('[');
+    bool first = true;
+    for (id element in json) {
+      if (!first) {
+        out.push_back(',');
+      }
+      first = false;
+      appendJson(element, nullifyNanAndInf, out);
+    }
+    out.push_back(']');
+  } else if ([json isKindOfClass:[NSDictionary class]]) {
+    out.push_back('{');
+    bool first = true;
+    for (id key in json) {
+      if (!first) {
+        out.push_back(',');
+      }
+      first = false;
+      appendJson([key isKindOfClass:[NSString class]] ? key : [key description], nullifyNanAndInf, out);
+      out.push_back(':');
+      appendJson([json objectForKey:key], nullifyNanAndInf, out);
+    }
+    out.push_back('}');
+  } else {
+    out.append("null");
+  }
+}
+
+std::string convertIdToJson(id json, bool nullifyNanAndInf)
+{
+  std::string out;
+  appendJson(json, nullifyNanAndInf, out);
+  return out;
+}
+}
+}
+
+using facebook::cxxutils::convertFollyDynamicToLazyId;
+
+// Children are converted on first access and kept, so that reading the same
+// key twice returns the same object.
+@implementation FBCxxFollyDynamicDictionary
+{
+  std::shared_ptr<const folly::dynamic> _root;
+  const folly::dynamic *_value;
+  NSMutableDictionary *_children;
+  NSArray *_keys;
+}
+
+- (instancetype)initWithRoot:(std::shared_ptr<const folly::dynamic>)root value:(const folly::dynamic *)value
+{
+  if (self = [super init]) {
+    _root = std::move(root);
+    _value = value;
+  }
+  return self;
 }
+
+- (const folly::dynamic &)dynamic
+{
+  return *_value;
+}
+
+- (NSUInteger)count
+{
+  return _value->size();
+}
+
+- (id)objectForKey:(id)key
+{
+  if (key == nil) {
+    return nil;
+  }
+  @synchronized(self) {
+    id child = _children[key];
+    if (child) {
+      return child;
+    }
+    folly::dynamic lookup = nullptr;
+    if ([key isKindOfClass:[NSString class]]) {
+      facebook::cxxutils::withUTF8Bytes(key, [&](folly::StringPiece bytes) { lookup = bytes.str(); });
+    } else {
+      lookup = facebook::cxxutils::convertIdToFollyDynamic(key);
+    }
+    const auto value = _value->get_ptr(lookup);
+    if (!value) {
+      return nil;
+    }
+    child = convertFollyDynamicToLazyId(_root, *value);
+    if (!_children) {
+      _children = [NSMutableDictionary new];
+    }
+    _children[key] = child;
+    return child;
+  }
 }
+
+- (NSEnumerator *)keyEnumerator
+{
+  @synchronized(self) {
+    if (!_keys) {
+      NSMutableArray *keys = [[NSMutableArray alloc] initWithCapacity:_value->size()];
+      for (const auto &key : _value->keys()) {
+        [keys addObject:facebook::cxxutils::convertFollyDynamicToId(key)];
+      }
+      _keys = keys;
+    }
+    return [_keys objectEnumerator];
+  }
+}
+
+@end
+
+@implementation FBCxxFollyDynamicArray
+{
+  std::shared_ptr<const folly::dynamic> _root;
+  const folly::dynamic *_value;
+  NSMutableDictionary<NSNumber *, id> *_children;
+}
+
+- (instancetype)initWithRoot:(std::shared_ptr<const folly::dynamic>)root value:(const folly::dynamic *)value
+{
+  if (self = [super init]) {
+    _root = std::move(root);
+    _value = value;
+  }
+  return self;
+}
+
+- (const folly::dynamic &)dynamic
+{
+  return *_value;
+}
+
+- (NSUInteger)count
+{
+  return _value->size();
+}
+
+- (id)objectAtIndex:(NSUInteger)index
+{
+  if (index >= _value->size()) {
+    [NSException raise:NSRangeException format:@"index %lu beyond bounds [0 .. %lu]",
+      (unsigned long)index, (unsigned long)_value->size()];
+  }
+  @synchronized(self) {
+    id child = _children[@(index)];
+    if (!child) {
+      child = convertFollyDynamicToLazyId(_root, (*_value)[index]);
+      if (!_children) {
+        _children = [NSMutableDictionary new];
+      }
+      _children[@(index)] = child;
+    }
+    return child;
+  }
+}
+
+@end
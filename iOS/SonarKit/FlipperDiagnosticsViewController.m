@@ -64,13 +64,27 @@ static NSString *const kSKCellIdentifier = @"FlipperDiagnosticStateTableStableCe
 }
 
 - (void)updateStateTable {
-  self.tableDataSource.elements = [[SonarClient sharedClient] getStateElements];
+  NSArray<NSDictionary *> *elements = [[SonarClient sharedClient] getStateElements];
+  // The client hands out the same array until a step changes.
+  if (elements == self.tableDataSource.elements) {
+    return;
+  }
+  self.tableDataSource.elements = elements;
   [self.stateTable reloadData];
 }
 
+- (NSString *)transportSummary {
+  NSDictionary *transport = [[SonarClient sharedClient] getMetrics][@"transport"];
+  long long rtt = [transport[@"keepaliveRttMicros"] longLongValue];
+  return [NSString stringWithFormat:@"Frames in/out: %@/%@, bytes in/out: %@/%@, keepalive RTT: %@",
+          transport[@"framesReceived"], transport[@"framesSent"],
+          transport[@"bytesReceived"], transport[@"bytesSent"],
+          rtt < 0 ? @"-" : [NSString stringWithFormat:@"%lld ms", rtt / 1000]];
+}
+
 - (void)updateLogView {
   NSString *state = [[SonarClient sharedClient] getState];
-  self.logLabel.text = state;
+  self.logLabel.text = [NSString stringWithFormat:@"%@\n\n%@", [self transportSummary], state];
   [self.logLabel sizeToFit];
   self.scrollView.contentSize = self.logLabel.frame.size;
 
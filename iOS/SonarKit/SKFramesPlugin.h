@@ -0,0 +1,28 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#if FB_SONARKIT_ENABLED
+
+#import <Foundation/Foundation.h>
+
+#import "SonarPlugin.h"
+
+/**
+ Sends frame duration histograms, missed refreshes and the CPU time of
+ Sonar's own threads to the desktop's Frames plugin once per summary
+ interval, see the C++ SonarFramesPlugin. Frames are timed with a
+ CADisplayLink on the main run loop while a desktop is connected.
+ */
+@interface SKFramesPlugin : NSObject <SonarPlugin>
+
+/** Summarizes once a second. */
+- (instancetype)init;
+- (instancetype)initWithSummaryInterval:(NSTimeInterval)summaryInterval NS_DESIGNATED_INITIALIZER;
+
+@end
+
+#endif
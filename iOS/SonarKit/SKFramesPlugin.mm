@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#if FB_SONARKIT_ENABLED
+
+#import "SKFramesPlugin.h"
+
+#import <QuartzCore/QuartzCore.h>
+
+#import <Sonar/SonarFramesPlugin.h>
+
+#import "SonarCppBridgingConnection.h"
+
+using facebook::sonar::SonarFramesPlugin;
+
+@implementation SKFramesPlugin
+{
+  std::unique_ptr<SonarFramesPlugin> _plugin;
+  // Only touched on the main thread. Retains the plugin until invalidated.
+  CADisplayLink *_displayLink;
+  CFTimeInterval _refreshPeriod;
+}
+
+- (instancetype)init
+{
+  return [self initWithSummaryInterval:1];
+}
+
+- (instancetype)initWithSummaryInterval:(NSTimeInterval)summaryInterval
+{
+  if (self = [super init]) {
+    _plugin = std::make_unique<SonarFramesPlugin>(std::chrono::milliseconds((int64_t)(summaryInterval * 1000)));
+  }
+  return self;
+}
+
+- (void)displayLinkFired:(CADisplayLink *)displayLink
+{
+  // Only known once the link has fired.
+  if (displayLink.duration > 0 && displayLink.duration != _refreshPeriod) {
+    _refreshPeriod = displayLink.duration;
+    _plugin->setRefreshPeriod(std::chrono::nanoseconds((int64_t)(_refreshPeriod * 1e9)));
+  }
+  _plugin->onFrame((int64_t)(displayLink.timestamp * 1e9));
+}
+
+#pragma mark - SonarPlugin
+
+- (NSString *)identifier
+{
+  return @(SonarFramesPlugin::kIdentifier);
+}
+
+- (void)didConnect:(id<SonarConnection>)connection
+{
+  // Only SonarClient's own connections have a C++ side to send to.
+  if (![(NSObject *)connection isKindOfClass:[SonarCppBridgingConnection class]]) {
+    return;
+  }
+  _plugin->didConnect([(SonarCppBridgingConnection *)connection cppConnection]);
+  dispatch_async(dispatch_get_main_queue(), ^{
+    if (self->_displayLink == nil) {
+      self->_displayLink = [CADisplayLink displayLinkWithTarget:self selector:@selector(displayLinkFired:)];
+      [self->_displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+    }
+  });
+}
+
+- (void)didDisconnect
+{
+  dispatch_async(dispatch_get_main_queue(), ^{
+    [self->_displayLink invalidate];
+    self->_displayLink = nil;
+  });
+  _plugin->didDisconnect();
+}
+
+@end
+
+#endif
@@ -0,0 +1,24 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#if FB_SONARKIT_ENABLED
+
+#import <Foundation/Foundation.h>
+
+#import "SonarPlugin.h"
+
+/**
+ Samples the app's resident size, memory footprint and malloc heap for the
+ desktop's Memory plugin, see the C++ SonarMemoryPlugin. Sampling runs on
+ Sonar's own thread while a desktop is connected, at the rate the desktop
+ picks.
+ */
+@interface SKMemoryPlugin : NSObject <SonarPlugin>
+
+@end
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#if FB_SONARKIT_ENABLED
+
+#import "SKMemoryPlugin.h"
+
+#import <Sonar/SonarMemoryPlugin.h>
+
+#import "SonarCppBridgingConnection.h"
+
+using facebook::sonar::SonarMemoryPlugin;
+
+@implementation SKMemoryPlugin
+{
+  // Samples are scheduled with a weak reference to it.
+  std::shared_ptr<SonarMemoryPlugin> _plugin;
+}
+
+- (instancetype)init
+{
+  if (self = [super init]) {
+    _plugin = std::make_shared<SonarMemoryPlugin>();
+  }
+  return self;
+}
+
+#pragma mark - SonarPlugin
+
+- (NSString *)identifier
+{
+  return @(SonarMemoryPlugin::kIdentifier);
+}
+
+- (void)didConnect:(id<SonarConnection>)connection
+{
+  // Only SonarClient's own connections have a C++ side to send to.
+  if (![(NSObject *)connection isKindOfClass:[SonarCppBridgingConnection class]]) {
+    return;
+  }
+  _plugin->didConnect([(SonarCppBridgingConnection *)connection cppConnection]);
+}
+
+- (void)didDisconnect
+{
+  _plugin->didDisconnect();
+}
+
+@end
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#if FB_SONARKIT_ENABLED
+
+#import <Foundation/Foundation.h>
+
+#import "SonarPlugin.h"
+
+/** Counts events, such as cache hits. */
+@interface SKMetricsCounter : NSObject
+- (void)add:(int64_t)amount;
+@end
+
+/** A value that is set rather than added to, such as a queue depth. */
+@interface SKMetricsGauge : NSObject
+- (void)set:(double)value;
+@end
+
+/** A distribution of values, such as durations in microseconds. */
+@interface SKMetricsHistogram : NSObject
+- (void)record:(int64_t)value;
+@end
+
+/**
+ Streams app defined counters, gauges and histograms to the desktop's Metrics
+ plugin, see the C++ SonarMetricsPlugin. Values are recorded into per-thread
+ shards, without building a message each, and sent together once per flush
+ interval. Look metrics up by name once and keep the handle.
+
+ Past the C++ limit on names, handles do nothing.
+ */
+@interface SKMetricsPlugin : NSObject <SonarPlugin>
+
+/** Flushes once a second. */
+- (instancetype)init;
+- (instancetype)initWithFlushInterval:(NSTimeInterval)flushInterval NS_DESIGNATED_INITIALIZER;
+
+- (SKMetricsCounter *)counterNamed:(NSString *)name;
+- (SKMetricsGauge *)gaugeNamed:(NSString *)name;
+- (SKMetricsHistogram *)histogramNamed:(NSString *)name;
+
+@end
+
+#endif
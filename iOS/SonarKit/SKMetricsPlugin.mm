@@ -0,0 +1,136 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#if FB_SONARKIT_ENABLED
+
+#import "SKMetricsPlugin.h"
+
+#import <Sonar/SonarMetricsPlugin.h>
+
+#import "SonarCppBridgingConnection.h"
+
+using facebook::sonar::SonarCounter;
+using facebook::sonar::SonarGauge;
+using facebook::sonar::SonarHistogram;
+using facebook::sonar::SonarMetricsPlugin;
+
+@implementation SKMetricsCounter
+{
+  SonarCounter _counter;
+}
+
+- (instancetype)initWithCounter:(SonarCounter)counter
+{
+  if (self = [super init]) {
+    _counter = counter;
+  }
+  return self;
+}
+
+- (void)add:(int64_t)amount
+{
+  _counter.add(amount);
+}
+
+@end
+
+@implementation SKMetricsGauge
+{
+  SonarGauge _gauge;
+}
+
+- (instancetype)initWithGauge:(SonarGauge)gauge
+{
+  if (self = [super init]) {
+    _gauge = gauge;
+  }
+  return self;
+}
+
+- (void)set:(double)value
+{
+  _gauge.set(value);
+}
+
+@end
+
+@implementation SKMetricsHistogram
+{
+  SonarHistogram _histogram;
+}
+
+- (instancetype)initWithHistogram:(SonarHistogram)histogram
+{
+  if (self = [super init]) {
+    _histogram = histogram;
+  }
+  return self;
+}
+
+- (void)record:(int64_t)value
+{
+  _histogram.record(value);
+}
+
+@end
+
+@implementation SKMetricsPlugin
+{
+  std::unique_ptr<SonarMetricsPlugin> _plugin;
+}
+
+- (instancetype)init
+{
+  return [self initWithFlushInterval:1];
+}
+
+- (instancetype)initWithFlushInterval:(NSTimeInterval)flushInterval
+{
+  if (self = [super init]) {
+    _plugin = std::make_unique<SonarMetricsPlugin>(std::chrono::milliseconds((int64_t)(flushInterval * 1000)));
+  }
+  return self;
+}
+
+- (SKMetricsCounter *)counterNamed:(NSString *)name
+{
+  return [[SKMetricsCounter alloc] initWithCounter:_plugin->counter([name UTF8String])];
+}
+
+- (SKMetricsGauge *)gaugeNamed:(NSString *)name
+{
+  return [[SKMetricsGauge alloc] initWithGauge:_plugin->gauge([name UTF8String])];
+}
+
+- (SKMetricsHistogram *)histogramNamed:(NSString *)name
+{
+  return [[SKMetricsHistogram alloc] initWithHistogram:_plugin->histogram([name UTF8String])];
+}
+
+#pragma mark - SonarPlugin
+
+- (NSString *)identifier
+{
+  return @(SonarMetricsPlugin::kIdentifier);
+}
+
+- (void)didConnect:(id<SonarConnection>)connection
+{
+  // Only SonarClient's own connections have a C++ side to flush to.
+  if ([(NSObject *)connection isKindOfClass:[SonarCppBridgingConnection class]]) {
+    _plugin->didConnect([(SonarCppBridgingConnection *)connection cppConnection]);
+  }
+}
+
+- (void)didDisconnect
+{
+  _plugin->didDisconnect();
+}
+
+@end
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#if FB_SONARKIT_ENABLED
+
+#import <Foundation/Foundation.h>
+
+#import "SonarPlugin.h"
+
+/**
+ A name to record trace events with. Ends are matched with the latest begin
+ on the same thread, whatever their name.
+ */
+@interface SKTraceName : NSObject
+- (void)begin;
+- (void)end;
+- (void)instant;
+@end
+
+/**
+ Records begin, end and instant events for the desktop's Trace plugin, see
+ the C++ SonarTracePlugin. Each thread writes into a fixed-size ring of its
+ own, without locking or allocating, and the desktop either streams what was
+ recorded or asks for a dump of the rings. Look names up once and keep the
+ handle.
+
+ Past the C++ limit on names, handles do nothing.
+ */
+@interface SKTracePlugin : NSObject <SonarPlugin>
+
+/** 4096 events per thread, flushed every 250ms while streaming. */
+- (instancetype)init;
+/** eventsPerThread is rounded up to a power of two. */
+- (instancetype)initWithEventsPerThread:(NSUInteger)eventsPerThread
+                          flushInterval:(NSTimeInterval)flushInterval NS_DESIGNATED_INITIALIZER;
+
+- (SKTraceName *)nameFor:(NSString *)name;
+
+/** Sends everything the rings hold to the desktop, if it is connected. */
+- (void)dump;
+
+@end
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#if FB_SONARKIT_ENABLED
+
+#import "SKTracePlugin.h"
+
+#import <Sonar/SonarTracePlugin.h>
+
+#import "SonarCppBridgingConnection.h"
+
+using facebook::sonar::SonarTraceName;
+using facebook::sonar::SonarTracePlugin;
+
+@implementation SKTraceName
+{
+  SonarTraceName _name;
+}
+
+- (instancetype)initWithName:(SonarTraceName)name
+{
+  if (self = [super init]) {
+    _name = name;
+  }
+  return self;
+}
+
+- (void)begin
+{
+  _name.begin();
+}
+
+- (void)end
+{
+  _name.end();
+}
+
+- (void)instant
+{
+  _name.instant();
+}
+
+@end
+
+@implementation SKTracePlugin
+{
+  std::unique_ptr<SonarTracePlugin> _plugin;
+}
+
+- (instancetype)init
+{
+  return [self initWithEventsPerThread:4096 flushInterval:0.25];
+}
+
+- (instancetype)initWithEventsPerThread:(NSUInteger)eventsPerThread
+                          flushInterval:(NSTimeInterval)flushInterval
+{
+  if (self = [super init]) {
+    _plugin = std::make_unique<SonarTracePlugin>(eventsPerThread, std::chrono::milliseconds((int64_t)(flushInterval * 1000)));
+  }
+  return self;
+}
+
+- (SKTraceName *)nameFor:(NSString *)name
+{
+  return [[SKTraceName alloc] initWithName:_plugin->name([name UTF8String])];
+}
+
+- (void)dump
+{
+  _plugin->dump();
+}
+
+#pragma mark - SonarPlugin
+
+- (NSString *)identifier
+{
+  return @(SonarTracePlugin::kIdentifier);
+}
+
+- (void)didConnect:(id<SonarConnection>)connection
+{
+  // Only SonarClient's own connections have a C++ side to send to.
+  if ([(NSObject *)connection isKindOfClass:[SonarCppBridgingConnection class]]) {
+    _plugin->didConnect([(SonarCppBridgingConnection *)connection cppConnection]);
+  }
+}
+
+- (void)didDisconnect
+{
+  _plugin->didDisconnect();
+}
+
+@end
+
+#endif
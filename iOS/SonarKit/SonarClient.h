@@ -11,6 +11,21 @@
 #import "SonarPlugin.h"
 #import "FlipperStateUpdateListener.h"
 
+/**
+How a physical device reaches the Sonar desktop. Simulators share the Mac's network and always connect directly.
+*/
+typedef NS_ENUM(NSInteger, SonarClientTransport) {
+  /**
+  Over USB: the client connects to ports on the device itself, which are forwarded to the Mac over usbmuxd by the
+  desktop. Lower and steadier latency than Wi-Fi.
+  */
+  SonarClientTransportUSB,
+  /**
+  Straight to the desktop's ports over the network, for when something else makes them reachable.
+  */
+  SonarClientTransportNetwork,
+};
+
 /**
 Represents a connection between the Sonar desktop och client side. Manages the lifecycle of attached
 plugin instances.
@@ -27,6 +42,14 @@ Register a plugin with the client.
 */
 - (void)addPlugin:(NSObject<SonarPlugin> *)plugin;
 
+/**
+Register a plugin that is only created once the Sonar desktop initializes it, or once
+pluginWithIdentifier: asks for it. The identifier is listed to the desktop in the meantime, so
+plugins that are expensive to set up cost nothing until they're used. factory is called at most
+once, on Sonar's own thread, and must return a plugin with the given identifier.
+*/
+- (void)addPluginWithIdentifier:(NSString *)identifier factory:(NSObject<SonarPlugin> *(^)(void))factory;
+
 /**
 Unregister a plugin with the client.
 */
@@ -37,6 +60,18 @@ Retrieve the plugin with a given identifier which was previously registered with
 */
 - (NSObject<SonarPlugin> *)pluginWithIdentifier:(NSString *)identifier;
 
+/**
+Whether the Sonar desktop is connected and has initialized the plugin with the given identifier.
+Cheap enough to check before doing work that is only useful to the desktop.
+*/
+- (BOOL)isPluginActive:(NSString *)identifier;
+
+/**
+How to reach the desktop from a physical device, SonarClientTransportUSB unless changed. Takes effect on the next call to
+start.
+*/
+@property (nonatomic, assign) SonarClientTransport transport;
+
 /**
 Establish a connection to the Sonar desktop.
 */
@@ -47,6 +82,14 @@ Stop the connection to the Sonar desktop.
 */
 - (void)stop;
 
+/**
+For when the app goes to the background, instead of stop, which disconnects every plugin. Plugin messages are held and
+reconnecting is put off until resume, while the connection and the plugins connected over it are kept.
+*/
+- (void)suspend;
+
+- (void)resume;
+
 /**
 Get the log of state changes from the sonar client
 */
@@ -57,6 +100,11 @@ Get the log of state changes from the sonar client
  */
 - (NSArray<NSDictionary *> *)getStateElements;
 
+/**
+ Per plugin traffic and transport counters, as the desktop gets them from the "__metrics" method.
+ */
+- (NSDictionary *)getMetrics;
+
 /**
 Subscribe a ViewController to state update change notifications
 */
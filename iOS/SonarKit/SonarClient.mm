@@ -10,25 +10,40 @@
 #import "SonarClient.h"
 #import "SonarCppWrapperPlugin.h"
 #import <Sonar/SonarClient.h>
+#import <Sonar/SonarMemoryBudget.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/io/async/ScopedEventBaseThread.h>
 #import <UIKit/UIKit.h>
 #include "SKStateUpdateCPPWrapper.h"
 #import "FlipperDiagnosticsViewController.h"
+#import <FBCxxUtils/FBCxxFollyDynamicConvert.h>
 
 #if !TARGET_OS_SIMULATOR
-//#import "SKPortForwardingServer.h"
+#import "SKPortForwardingServer.h"
 #endif
 
 using WrapperPlugin = facebook::sonar::SonarCppWrapperPlugin;
 
 @implementation SonarClient {
   facebook::sonar::SonarClient *_cppClient;
-  folly::ScopedEventBaseThread sonarThread;
-  folly::ScopedEventBaseThread connectionThread;
+  // Started along with the connection, on the first start, rather than while
+  // the app is still launching.
+  std::unique_ptr<folly::ScopedEventBaseThread> sonarThread;
+  std::unique_ptr<folly::ScopedEventBaseThread> connectionThread;
 #if !TARGET_OS_SIMULATOR
- // SKPortForwardingServer *_server;
+  // One per port, each over its own USB channel, the way the desktop's
+  // forwarders expect them.
+  SKPortForwardingServer *_secureServer;
+  SKPortForwardingServer *_insecureServer;
 #endif
+  // Warnings ahead of the one UIApplication posts, graded.
+  dispatch_source_t _memoryPressureSource;
+  // The last snapshots of the state and what was made of them, handed out
+  // again while they don't change. Guarded by @synchronized on self.
+  std::shared_ptr<const std::string> _state;
+  NSString *_stateString;
+  std::shared_ptr<const std::vector<facebook::sonar::StateElement>> _stateElements;
+  NSArray<NSDictionary *> *_stateElementsArray;
 }
 
 + (instancetype)sharedClient
@@ -51,35 +66,66 @@ using WrapperPlugin = facebook::sonar::SonarCppWrapperPlugin;
     NSString *appId = appName;
     NSString *privateAppDirectory = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES)[0];
 
-    NSFileManager *manager = [NSFileManager defaultManager];
-
-    if ([manager fileExistsAtPath:privateAppDirectory isDirectory:NULL] == NO) {
-      //TODO: Handle errors properly
-      [manager createDirectoryAtPath:privateAppDirectory withIntermediateDirectories:YES attributes:nil error:nil];
-    }
-
 #if TARGET_OS_SIMULATOR
     deviceName = [NSString stringWithFormat:@"%@ %@", [[UIDevice currentDevice] model], @"Simulator"];
 #endif
 
-    facebook::sonar::SonarClient::init({
-      {
-        "localhost",
-        "iOS",
-        [deviceName UTF8String],
-        [deviceId UTF8String],
-        [appName UTF8String],
-        [appId UTF8String],
-        [privateAppDirectory UTF8String],
-      },
-      sonarThread.getEventBase(),
-      connectionThread.getEventBase()
+    // UIDevice is read here, on the main thread, everything else waits for
+    // the first start.
+    facebook::sonar::DeviceData deviceData{
+      "localhost",
+      "iOS",
+      [deviceName UTF8String],
+      [deviceId UTF8String],
+      [appName UTF8String],
+      [appId UTF8String],
+      [privateAppDirectory UTF8String],
+    };
+    facebook::sonar::SonarClient::initDeferred([self, deviceData, privateAppDirectory]() {
+      NSFileManager *manager = [NSFileManager defaultManager];
+
+      if ([manager fileExistsAtPath:privateAppDirectory isDirectory:NULL] == NO) {
+        //TODO: Handle errors properly
+        [manager createDirectoryAtPath:privateAppDirectory withIntermediateDirectories:YES attributes:nil error:nil];
+      }
+
+      sonarThread = std::make_unique<folly::ScopedEventBaseThread>();
+      connectionThread = std::make_unique<folly::ScopedEventBaseThread>();
+      return facebook::sonar::SonarInitConfig{
+        deviceData,
+        sonarThread->getEventBase(),
+        connectionThread->getEventBase()
+      };
     });
     _cppClient = facebook::sonar::SonarClient::instance();
+    [self observeMemoryPressure];
   }
   return self;
 }
 
+// Sheds Sonar's buffers when the system runs low on memory, rather than get
+// the app killed.
+- (void)observeMemoryPressure
+{
+  [[NSNotificationCenter defaultCenter] addObserverForName:UIApplicationDidReceiveMemoryWarningNotification
+                                                    object:nil
+                                                     queue:nil
+                                                usingBlock:^(NSNotification *note) {
+    facebook::sonar::SonarMemoryBudget::shared().onMemoryPressure(facebook::sonar::SonarMemoryPressure::Critical);
+  }];
+  _memoryPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE,
+                                                 0,
+                                                 DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                 dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+  dispatch_source_t source = _memoryPressureSource;
+  dispatch_source_set_event_handler(source, ^{
+    const bool critical = dispatch_source_get_data(source) & DISPATCH_MEMORYPRESSURE_CRITICAL;
+    facebook::sonar::SonarMemoryBudget::shared().onMemoryPressure(
+      critical ? facebook::sonar::SonarMemoryPressure::Critical : facebook::sonar::SonarMemoryPressure::Moderate);
+  });
+  dispatch_resume(source);
+}
+
 - (void)refreshPlugins
 {
   _cppClient->refreshPlugins();
@@ -90,6 +136,20 @@ using WrapperPlugin = facebook::sonar::SonarCppWrapperPlugin;
   _cppClient->addPlugin(std::make_shared<WrapperPlugin>(plugin));
 }
 
+- (void)addPluginWithIdentifier:(NSString *)identifier factory:(NSObject<SonarPlugin> *(^)(void))factory
+{
+  NSObject<SonarPlugin> *(^copiedFactory)(void) = [factory copy];
+  _cppClient->addPluginFactory([identifier UTF8String], [copiedFactory]() -> std::shared_ptr<facebook::sonar::SonarPlugin> {
+    @autoreleasepool {
+      NSObject<SonarPlugin> *plugin = copiedFactory();
+      if (plugin == nil) {
+        return nullptr;
+      }
+      return std::make_shared<WrapperPlugin>(plugin);
+    }
+  });
+}
+
 - (void)removePlugin:(NSObject<SonarPlugin> *)plugin
 {
   _cppClient->removePlugin(std::make_shared<WrapperPlugin>(plugin));
@@ -104,12 +164,22 @@ using WrapperPlugin = facebook::sonar::SonarCppWrapperPlugin;
   return nil;
 }
 
+- (BOOL)isPluginActive:(NSString *)identifier
+{
+  return _cppClient->isPluginActive([identifier UTF8String]);
+}
+
 - (void)start;
 {
 #if !TARGET_OS_SIMULATOR
-  // _server = [SKPortForwardingServer new];
-  // [_server forwardConnectionsFromPort:8088];
-  // [_server listenForMultiplexingChannelOnPort:8078];
+  if (_transport == SonarClientTransportUSB && !_secureServer) {
+    _secureServer = [SKPortForwardingServer new];
+    [_secureServer forwardConnectionsFromPort:8088];
+    [_secureServer listenForMultiplexingChannelOnPort:8078];
+    _insecureServer = [SKPortForwardingServer new];
+    [_insecureServer forwardConnectionsFromPort:8089];
+    [_insecureServer listenForMultiplexingChannelOnPort:8079];
+  }
 #endif
   _cppClient->start();
 }
@@ -118,19 +188,49 @@ using WrapperPlugin = facebook::sonar::SonarCppWrapperPlugin;
 {
   _cppClient->stop();
 #if !TARGET_OS_SIMULATOR
-  // [_server close];
-  // _server = nil;
+  [_secureServer close];
+  _secureServer = nil;
+  [_insecureServer close];
+  _insecureServer = nil;
 #endif
 }
 
+- (void)suspend
+{
+  _cppClient->suspend();
+}
+
+- (void)resume
+{
+  _cppClient->resume();
+}
+
 - (NSString *)getState {
-  return @(_cppClient->getState().c_str());
+  const auto state = _cppClient->getState();
+  @synchronized (self) {
+    if (state != _state) {
+      _stateString = @(state->c_str());
+      _state = state;
+    }
+    return _stateString;
+  }
 }
 
 - (NSArray *)getStateElements {
+  const auto elements = _cppClient->getStateElements();
+  @synchronized (self) {
+    if (elements != _stateElements) {
+      _stateElementsArray = [self arrayFromStateElements:*elements];
+      _stateElements = elements;
+    }
+    return _stateElementsArray;
+  }
+}
+
+- (NSArray<NSDictionary *> *)arrayFromStateElements:(const std::vector<facebook::sonar::StateElement> &)elements {
   NSMutableArray<NSDictionary<NSString *, NSString *>*> *const array = [NSMutableArray array];
 
-  for (facebook::sonar::StateElement element: _cppClient->getStateElements()) {
+  for (const facebook::sonar::StateElement &element: elements) {
     facebook::sonar::State state = element.state_;
     NSString *stateString;
     switch (state) {
@@ -152,10 +252,15 @@ using WrapperPlugin = facebook::sonar::SonarCppWrapperPlugin;
     }
     [array addObject:@{
                        @"name": [NSString stringWithUTF8String:element.name_.c_str()],
-                       @"state": stateString
+                       @"state": stateString,
+                       @"duration": [NSString stringWithFormat:@"%lld ms", (long long)element.timings_.lastMs]
                        }];
   }
-  return array;
+  return [array copy];
+}
+
+- (NSDictionary *)getMetrics {
+  return facebook::cxxutils::convertFollyDynamicToId(_cppClient->getMetrics());
 }
 
 - (void)subscribeForUpdates:(id<FlipperStateUpdateListener>)controller {
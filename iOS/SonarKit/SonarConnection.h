@@ -14,6 +14,8 @@ typedef void (^SonarReceiver)(NSDictionary*, id<SonarResponder>);
 
 /**
 Represents a connection between the Desktop and mobile plugins with corresponding identifiers.
+Params are serialized on a background queue, after the send returns, so the containers in
+them must not be mutated afterwards.
 */
 @protocol SonarConnection
 
@@ -22,6 +24,35 @@ Invoke a method on the Sonar desktop plugin with with a matching identifier.
 */
 - (void)send:(NSString *)method withParams:(NSDictionary *)params;
 
+@optional
+
+/**
+Same as send:withParams:, for params that are already serialized as a JSON object.
+*/
+- (void)send:(NSString *)method withJSONParams:(NSData *)json;
+
+/**
+Send binary data, such as a response body, without encoding it into a string. metadata is
+delivered as the params of the call. Returns NO without sending anything if the desktop can't
+receive binary data, in which case callers should fall back to send:withParams:.
+*/
+- (BOOL)send:(NSString *)method withMetadata:(NSDictionary *)metadata data:(NSData *)data;
+
+/**
+Serve repeat calls of method with identical params from the last response, until the counter
+named version is bumped with invalidateResponses:. Only for methods whose response depends on
+nothing but their params and the state that counter covers.
+*/
+- (void)cacheResponsesOf:(NSString *)method version:(NSString *)version;
+
+/**
+Drop the cached responses that depend on the counter named version. Takes effect before it
+returns, so that calls coming in afterwards see the change.
+*/
+- (void)invalidateResponses:(NSString *)version;
+
+@required
+
 /**
 Register a receiver to be notified of incoming calls of the given method from the Sonar desktop
 plugin with a matching identifier.
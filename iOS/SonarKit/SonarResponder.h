@@ -9,6 +9,8 @@
 
 /**
 Acts as a hook for providing return values to remote called from Sonar desktop plugins.
+Responses are serialized on a background queue, after these return, so the containers in
+them must not be mutated afterwards.
 */
 @protocol SonarResponder
 
@@ -15,6 +15,13 @@
 #import "SKMacros.h"
 #import "SKPortForwardingCommon.h"
 
+// Largest frame a single read from a client socket turns into.
+static const NSUInteger SKPortForwardingMaxFrameLength = 256 * 1024;
+// Bytes read from a client socket that may be waiting to go out over the
+// channel before reading from it pauses, so that reads don't wait for each
+// frame to be sent but memory stays bounded.
+static const NSUInteger SKPortForwardingMaxBytesInFlight = 1024 * 1024;
+
 @interface SKPortForwardingServer () <PTChannelDelegate, GCDAsyncSocketDelegate>
 
 @property (nonatomic, weak) PTChannel *serverChannel;
@@ -25,6 +32,9 @@
 @property (nonatomic, assign) UInt32 lastClientSocketTag;
 @property (nonatomic, strong) dispatch_queue_t socketQueue;
 @property (nonatomic, strong) PTProtocol *protocol;
+@property (nonatomic, strong) NSMutableDictionary<NSNumber *, NSNumber *> *bytesInFlight;
+@property (nonatomic, strong) NSMutableSet<NSNumber *> *pausedSockets;
+@property (nonatomic, strong) NSMutableArray<id<NSObject>> *observers;
 
 @end
 
@@ -36,6 +46,9 @@
     _socketQueue = dispatch_queue_create("SKPortForwardingServer", DISPATCH_QUEUE_SERIAL);
     _lastClientSocketTag = 0;
     _clientSockets = [NSMutableDictionary dictionary];
+    _bytesInFlight = [NSMutableDictionary dictionary];
+    _pausedSockets = [NSMutableSet set];
+    _observers = [NSMutableArray array];
     _protocol = [[PTProtocol alloc] initWithDispatchQueue:_socketQueue];
   }
   return self;
@@ -44,15 +57,15 @@
 - (void)dealloc
 {
   [self close];
-  [[NSNotificationCenter defaultCenter] removeObserver:self];
 }
 
 - (void)forwardConnectionsFromPort:(NSUInteger)port
 {
   [self _forwardConnectionsFromPort:port reportError:YES];
-  [[NSNotificationCenter defaultCenter] addObserverForName:UIApplicationDidBecomeActiveNotification object:nil queue:nil usingBlock:^(NSNotification *note) {
-    [self _forwardConnectionsFromPort:port reportError:NO];
-  }];
+  SKPortForwardingServer __weak *weakSelf = self;
+  [_observers addObject:[[NSNotificationCenter defaultCenter] addObserverForName:UIApplicationDidBecomeActiveNotification object:nil queue:nil usingBlock:^(NSNotification *note) {
+    [weakSelf _forwardConnectionsFromPort:port reportError:NO];
+  }]];
 }
 
 - (void)_forwardConnectionsFromPort:(NSUInteger)port reportError:(BOOL)shouldReportError
@@ -71,9 +84,10 @@
 - (void)listenForMultiplexingChannelOnPort:(NSUInteger)port
 {
   [self _listenForMultiplexingChannelOnPort:port reportError:YES];
-  [[NSNotificationCenter defaultCenter] addObserverForName:UIApplicationDidBecomeActiveNotification object:nil queue:nil usingBlock:^(NSNotification *note) {
-    [self _listenForMultiplexingChannelOnPort:port reportError:NO];
-  }];
+  SKPortForwardingServer __weak *weakSelf = self;
+  [_observers addObject:[[NSNotificationCenter defaultCenter] addObserverForName:UIApplicationDidBecomeActiveNotification object:nil queue:nil usingBlock:^(NSNotification *note) {
+    [weakSelf _listenForMultiplexingChannelOnPort:port reportError:NO];
+  }]];
 }
 
 - (void)_listenForMultiplexingChannelOnPort:(NSUInteger)port reportError:(BOOL)shouldReportError
@@ -93,6 +107,10 @@
 
 - (void)close
 {
+  for (id<NSObject> observer in _observers) {
+    [[NSNotificationCenter defaultCenter] removeObserver:observer];
+  }
+  [_observers removeAllObjects];
   if (self.serverChannel) {
     [self.serverChannel close];
     self.serverChannel = nil;
@@ -120,7 +138,12 @@
   //NSLog(@"didReceiveFrameOfType: %u, %u, %@", type, tag, payload);
   if (type == SKPortForwardingFrameTypeWriteToPipe) {
     GCDAsyncSocket *sock = self.clientSockets[@(tag)];
-    [sock writeData:[NSData dataWithBytes:payload.data length:payload.length] withTimeout:-1 tag:0];
+    // The payload stays mapped for as long as the PTData lives, so keep it
+    // alive until the socket is done with the bytes instead of copying them.
+    NSData *data = [[NSData alloc] initWithBytesNoCopy:payload.data length:payload.length deallocator:^(void *bytes, NSUInteger length) {
+      [payload self];
+    }];
+    [sock writeData:data withTimeout:-1 tag:0];
     SKTrace(@"channel -> socket (%d), %zu bytes", tag, payload.length);
   }
 
@@ -136,6 +159,8 @@
     [sock disconnect];
   }
   [self.clientSockets removeAllObjects];
+  [self.bytesInFlight removeAllObjects];
+  [self.pausedSockets removeAllObjects];
   SKTrace(@"Disconnected from %@, error = %@", channel.userInfo, error);
 }
 
@@ -148,6 +173,7 @@
     if (!self.peerChannel) {
       [newSocket setDelegate:nil];
       [newSocket disconnect];
+      return;
     }
 
     UInt32 tag = ++self->_lastClientSocketTag;
@@ -156,7 +182,7 @@
     self.clientSockets[@(tag)] = newSocket;
     [self.peerChannel sendFrameOfType:SKPortForwardingFrameTypeOpenPipe tag:self->_lastClientSocketTag withPayload:nil callback:^(NSError *error) {
       SKTrace(@"open socket (%d), error = %@", (unsigned int)tag, error);
-      [newSocket readDataWithTimeout:-1 tag:0];
+      [self _readFromSocket:newSocket];
     }];
   };
 
@@ -171,16 +197,47 @@
 {
   UInt32 tag = [[sock userData] unsignedIntValue];
   SKTrace(@"Incoming data on socket (%d) - %lu bytes", (unsigned int)tag, (unsigned long)data.length);
+  NSNumber *key = @(tag);
+  NSUInteger inFlight = [_bytesInFlight[key] unsignedIntegerValue] + data.length;
+  _bytesInFlight[key] = @(inFlight);
   [_peerChannel sendFrameOfType:SKPortForwardingFrameTypeWriteToPipe tag:tag withPayload:NSDataToGCDData(data) callback:^(NSError *error) {
     SKTrace(@"socket (%d) -> channel %lu bytes, error = %@", (unsigned int)tag, (unsigned long)data.length, error);
-    [sock readDataWithTimeout:-1 tag:_];
+    [self _socket:sock didSendBytes:data.length];
   }];
+  if (inFlight < SKPortForwardingMaxBytesInFlight) {
+    [self _readFromSocket:sock];
+  } else {
+    [_pausedSockets addObject:key];
+  }
+}
+
+- (void)_readFromSocket:(GCDAsyncSocket *)sock
+{
+  [sock readDataWithTimeout:-1 buffer:nil bufferOffset:0 maxLength:SKPortForwardingMaxFrameLength tag:0];
+}
+
+- (void)_socket:(GCDAsyncSocket *)sock didSendBytes:(NSUInteger)length
+{
+  NSNumber *key = sock.userData;
+  NSNumber *inFlight = _bytesInFlight[key];
+  if (!inFlight) {
+    // Disconnected meanwhile.
+    return;
+  }
+  NSUInteger remaining = inFlight.unsignedIntegerValue - length;
+  _bytesInFlight[key] = @(remaining);
+  if (remaining < SKPortForwardingMaxBytesInFlight && [_pausedSockets containsObject:key]) {
+    [_pausedSockets removeObject:key];
+    [self _readFromSocket:sock];
+  }
 }
 
 - (void)socketDidDisconnect:(GCDAsyncSocket *)sock withError:(NSError *)err
 {
   UInt32 tag = [sock.userData unsignedIntValue];
   [_clientSockets removeObjectForKey:@(tag)];
+  [_bytesInFlight removeObjectForKey:@(tag)];
+  [_pausedSockets removeObject:@(tag)];
   [_peerChannel sendFrameOfType:SKPortForwardingFrameTypeClosePipe tag:tag withPayload:nil callback:^(NSError *error) {
     SKTrace(@"socket (%d) disconnected, err = %@, peer error = %@", (unsigned int)tag, err, error);
   }];
@@ -50,6 +50,7 @@
     #include <sys/socket.h>
     #include <sys/time.h>
     #include <sys/types.h>
+    #include <sys/uio.h>
     #include <unistd.h>
     #include <stdint.h>
     #ifndef _SOCKET_T_DEFINED
@@ -69,6 +70,16 @@
     #define SOCKET_EWOULDBLOCK EWOULDBLOCK
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define EASYWSCLIENT_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define EASYWSCLIENT_NEON
+#endif
+
+#include <algorithm>
+#include <deque>
 #include <vector>
 #include <string>
 
@@ -76,9 +87,83 @@
 
 using easywsclient::Callback_Imp;
 using easywsclient::BytesCallback_Imp;
+using easywsclient::SpanCallback_Imp;
 
 namespace { // private module-only namespace
 
+// Most segments handed to a single write, well below any IOV_MAX.
+const size_t TX_MAX_SEGMENTS = 64;
+
+// XORs data in place with the repeating 4 byte key, as both masking and
+// unmasking do. Bytes before the first 8 byte boundary and after the last
+// whole word are done one at a time, everything in between 16 or 8 bytes at
+// a time with the key repeated to fill a register.
+void apply_mask(uint8_t* data, size_t size, const uint8_t masking_key[4]) {
+    size_t i = 0;
+    while (i != size && ((uintptr_t) (data + i) & 0x7) != 0) {
+        data[i] ^= masking_key[i&0x3];
+        ++i;
+    }
+    if (size - i >= 8) {
+        // Widths are multiples of 4, so the key stays in phase from here on.
+        uint8_t key_bytes[8];
+        for (size_t k = 0; k != 8; ++k) { key_bytes[k] = masking_key[(i+k)&0x3]; }
+        uint64_t key_word;
+        memcpy(&key_word, key_bytes, 8);
+#if defined(EASYWSCLIENT_SSE2)
+        const __m128i key_vector = _mm_set1_epi64x((long long) key_word);
+        for (; size - i >= 16; i += 16) {
+            __m128i* block = (__m128i*) (data + i);
+            _mm_storeu_si128(block, _mm_xor_si128(_mm_loadu_si128(block), key_vector));
+        }
+#elif defined(EASYWSCLIENT_NEON)
+        const uint8x16_t key_vector = vreinterpretq_u8_u64(vdupq_n_u64(key_word));
+        for (; size - i >= 16; i += 16) {
+            vst1q_u8(data + i, veorq_u8(vld1q_u8(data + i), key_vector));
+        }
+#endif
+        for (; size - i >= 8; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            word ^= key_word;
+            memcpy(data + i, &word, 8);
+        }
+    }
+    for (; i != size; ++i) {
+        data[i] ^= masking_key[i&0x3];
+    }
+}
+
+// A piece of a queued frame still to be written.
+struct tx_segment {
+    const uint8_t* data;
+    size_t size;
+};
+
+// Writes as much of the segments as the socket takes, in one call, returning
+// the number of bytes written like send() does.
+ssize_t send_segments(socket_t sockfd, const tx_segment* segments, size_t count) {
+#ifdef _WIN32
+    WSABUF buffers[TX_MAX_SEGMENTS];
+    for (size_t i = 0; i != count; ++i) {
+        buffers[i].buf = (char*) segments[i].data;
+        buffers[i].len = (ULONG) segments[i].size;
+    }
+    DWORD sent = 0;
+    if (WSASend(sockfd, buffers, (DWORD) count, &sent, 0, NULL, NULL) == SOCKET_ERROR) {
+        return -1;
+    }
+    return (ssize_t) sent;
+#else
+    struct iovec buffers[TX_MAX_SEGMENTS];
+    for (size_t i = 0; i != count; ++i) {
+        buffers[i].iov_base = (void*) segments[i].data;
+        buffers[i].iov_len = segments[i].size;
+    }
+    return writev(sockfd, buffers, (int) count);
+#endif
+}
+
 socket_t hostname_connect(const std::string& hostname, int port) {
     struct addrinfo hints;
     struct addrinfo *result;
@@ -115,13 +200,18 @@ class _DummyWebSocket : public easywsclient::WebSocket
   public:
     void poll(int timeout) { }
     void send(const std::string& message) { }
+    void send(std::string&& message) { }
     void sendBinary(const std::string& message) { }
+    void sendBinary(std::string&& message) { }
     void sendBinary(const std::vector<uint8_t>& message) { }
     void sendPing() { }
     void close() { }
     readyStateValues getReadyState() const { return CLOSED; }
+    int getSocket() const { return -1; }
+    bool hasPendingWrites() const { return false; }
     void _dispatch(Callback_Imp & callable) { }
     void _dispatchBinary(BytesCallback_Imp& callable) { }
+    void _dispatchSpan(SpanCallback_Imp& callable) { }
 };
 
 
@@ -165,21 +255,49 @@ class _RealWebSocket : public easywsclient::WebSocket
         uint8_t masking_key[4];
     };
 
+    // Received bytes that weren't dispatched yet are rxbuf[rxbegin, rxend).
+    // Dispatching only moves rxbegin forward, and the unread bytes are moved
+    // back to the front only once there is too little room left after them to
+    // read into, so each byte is moved at most about once instead of shifting
+    // the whole buffer for every frame.
     std::vector<uint8_t> rxbuf;
-    std::vector<uint8_t> txbuf;
+    size_t rxbegin;
+    size_t rxend;
+    // Frames waiting to be written, each its header followed by its payload,
+    // which is written from where it is rather than copied into one buffer.
+    struct tx_frame {
+        uint8_t header[14];
+        size_t header_size;
+        std::string payload;
+        // How much of the header and then the payload was written already.
+        size_t sent;
+    };
+    std::deque<tx_frame> txqueue;
     std::vector<uint8_t> receivedData;
 
     socket_t sockfd;
     readyStateValues readyState;
     bool useMask;
 
-    _RealWebSocket(socket_t sockfd, bool useMask) : sockfd(sockfd), readyState(OPEN), useMask(useMask) {
+    // Smallest room to read into, so that a busy socket is drained in a few
+    // large reads.
+    static const size_t RX_READ_SIZE = 64 * 1024;
+
+    _RealWebSocket(socket_t sockfd, bool useMask) : rxbegin(0), rxend(0), sockfd(sockfd), readyState(OPEN), useMask(useMask) {
     }
 
     readyStateValues getReadyState() const {
       return readyState;
     }
 
+    int getSocket() const {
+      return (int) sockfd;
+    }
+
+    bool hasPendingWrites() const {
+      return !txqueue.empty();
+    }
+
     void poll(int timeout) { // timeout in milliseconds
         if (readyState == CLOSED) {
             if (timeout > 0) {
@@ -195,33 +313,42 @@ class _RealWebSocket : public easywsclient::WebSocket
             FD_ZERO(&rfds);
             FD_ZERO(&wfds);
             FD_SET(sockfd, &rfds);
-            if (txbuf.size()) { FD_SET(sockfd, &wfds); }
+            if (!txqueue.empty()) { FD_SET(sockfd, &wfds); }
             select(sockfd + 1, &rfds, &wfds, 0, timeout > 0 ? &tv : 0);
         }
         while (true) {
             // FD_ISSET(0, &rfds) will be true
-            int N = rxbuf.size();
-            ssize_t ret;
-            rxbuf.resize(N + 1500);
-            ret = recv(sockfd, (char*)&rxbuf[0] + N, 1500, 0);
+            if (rxbuf.size() - rxend < RX_READ_SIZE) { makeRxRoom(RX_READ_SIZE); }
+            ssize_t ret = recv(sockfd, (char*)&rxbuf[rxend], rxbuf.size() - rxend, 0);
             if (false) { }
             else if (ret < 0 && (socketerrno == SOCKET_EWOULDBLOCK || socketerrno == SOCKET_EAGAIN_EINPROGRESS)) {
-                rxbuf.resize(N);
                 break;
             }
             else if (ret <= 0) {
-                rxbuf.resize(N);
                 closesocket(sockfd);
                 readyState = CLOSED;
                 fputs(ret < 0 ? "Connection error!\n" : "Connection closed!\n", stderr);
                 break;
             }
             else {
-                rxbuf.resize(N + ret);
+                rxend += ret;
             }
         }
-        while (txbuf.size()) {
-            int ret = ::send(sockfd, (char*)&txbuf[0], txbuf.size(), 0);
+        while (!txqueue.empty()) {
+            tx_segment segments[TX_MAX_SEGMENTS];
+            size_t count = 0;
+            for (std::deque<tx_frame>::const_iterator frame = txqueue.begin(); frame != txqueue.end() && count + 2 <= TX_MAX_SEGMENTS; ++frame) {
+                if (frame->sent < frame->header_size) {
+                    tx_segment header = { frame->header + frame->sent, frame->header_size - frame->sent };
+                    segments[count++] = header;
+                }
+                const size_t payload_sent = frame->sent > frame->header_size ? frame->sent - frame->header_size : 0;
+                if (payload_sent < frame->payload.size()) {
+                    tx_segment payload = { (const uint8_t*) frame->payload.data() + payload_sent, frame->payload.size() - payload_sent };
+                    segments[count++] = payload;
+                }
+            }
+            ssize_t ret = send_segments(sockfd, segments, count);
             if (false) { } // ??
             else if (ret < 0 && (socketerrno == SOCKET_EWOULDBLOCK || socketerrno == SOCKET_EAGAIN_EINPROGRESS)) {
                 break;
@@ -233,47 +360,84 @@ class _RealWebSocket : public easywsclient::WebSocket
                 break;
             }
             else {
-                txbuf.erase(txbuf.begin(), txbuf.begin() + ret);
+                size_t written = ret;
+                while (written) {
+                    tx_frame& frame = txqueue.front();
+                    const size_t left = frame.header_size + frame.payload.size() - frame.sent;
+                    if (written < left) {
+                        frame.sent += written;
+                        break;
+                    }
+                    written -= left;
+                    txqueue.pop_front();
+                }
             }
         }
-        if (!txbuf.size() && readyState == CLOSING) {
+        if (txqueue.empty() && readyState == CLOSING) {
             closesocket(sockfd);
             readyState = CLOSED;
         }
     }
 
+    void makeRxRoom(size_t room) {
+        if (rxbegin > 0) {
+            memmove(&rxbuf[0], &rxbuf[rxbegin], rxend - rxbegin);
+            rxend -= rxbegin;
+            rxbegin = 0;
+        }
+        if (rxbuf.size() - rxend < room) {
+            rxbuf.resize(std::max(rxbuf.size() * 2, rxend + room));
+        }
+    }
+
     // Callable must have signature: void(const std::string & message).
     // Should work with C functions, C++ functors, and C++11 std::function and
     // lambda:
     //template<class Callable>
     //void dispatch(Callable callable)
     virtual void _dispatch(Callback_Imp & callable) {
-        struct CallbackAdapter : public BytesCallback_Imp
-            // Adapt void(const std::string<uint8_t>&) to void(const std::string&)
+        struct CallbackAdapter : public SpanCallback_Imp
+            // Adapt void(const uint8_t*, size_t) to void(const std::string&)
         {
             Callback_Imp& callable;
             CallbackAdapter(Callback_Imp& callable) : callable(callable) { }
-            void operator()(const std::vector<uint8_t>& message) {
-                std::string stringMessage(message.begin(), message.end());
+            void operator()(const uint8_t* data, size_t size) {
+                std::string stringMessage((const char*) data, size);
                 callable(stringMessage);
             }
         };
-        CallbackAdapter bytesCallback(callable);
-        _dispatchBinary(bytesCallback);
+        CallbackAdapter spanCallback(callable);
+        _dispatchSpan(spanCallback);
     }
 
     virtual void _dispatchBinary(BytesCallback_Imp & callable) {
+        struct CallbackAdapter : public SpanCallback_Imp
+            // Adapt void(const uint8_t*, size_t) to void(const std::vector<uint8_t>&)
+        {
+            BytesCallback_Imp& callable;
+            CallbackAdapter(BytesCallback_Imp& callable) : callable(callable) { }
+            void operator()(const uint8_t* data, size_t size) {
+                const std::vector<uint8_t> message(data, data + size);
+                callable(message);
+            }
+        };
+        CallbackAdapter spanCallback(callable);
+        _dispatchSpan(spanCallback);
+    }
+
+    virtual void _dispatchSpan(SpanCallback_Imp & callable) {
         // TODO: consider acquiring a lock on rxbuf...
         while (true) {
             wsheader_type ws;
-            if (rxbuf.size() < 2) { return; /* Need at least 2 */ }
-            const uint8_t * data = (uint8_t *) &rxbuf[0]; // peek, but don't consume
+            const size_t available = rxend - rxbegin;
+            if (available < 2) { break; /* Need at least 2 */ }
+            uint8_t * data = &rxbuf[rxbegin]; // peek, but don't consume
             ws.fin = (data[0] & 0x80) == 0x80;
             ws.opcode = (wsheader_type::opcode_type) (data[0] & 0x0f);
             ws.mask = (data[1] & 0x80) == 0x80;
             ws.N0 = (data[1] & 0x7f);
             ws.header_size = 2 + (ws.N0 == 126? 2 : 0) + (ws.N0 == 127? 8 : 0) + (ws.mask? 4 : 0);
-            if (rxbuf.size() < ws.header_size) { return; /* Need: ws.header_size - rxbuf.size() */ }
+            if (available < ws.header_size) { break; /* Need: ws.header_size - available */ }
             int i = 0;
             if (ws.N0 < 126) {
                 ws.N = ws.N0;
@@ -309,64 +473,85 @@ class _RealWebSocket : public easywsclient::WebSocket
                 ws.masking_key[2] = 0;
                 ws.masking_key[3] = 0;
             }
-            if (rxbuf.size() < ws.header_size+ws.N) { return; /* Need: ws.header_size+ws.N - rxbuf.size() */ }
+            if (available < ws.header_size+ws.N) { break; /* Need: ws.header_size+ws.N - available */ }
 
             // We got a whole message, now do something with it:
+            uint8_t * payload = data + ws.header_size;
+            const size_t size = (size_t) ws.N;
             if (false) { }
             else if (
                    ws.opcode == wsheader_type::TEXT_FRAME
                 || ws.opcode == wsheader_type::BINARY_FRAME
                 || ws.opcode == wsheader_type::CONTINUATION
             ) {
-                if (ws.mask) { for (size_t i = 0; i != ws.N; ++i) { rxbuf[i+ws.header_size] ^= ws.masking_key[i&0x3]; } }
-                receivedData.insert(receivedData.end(), rxbuf.begin()+ws.header_size, rxbuf.begin()+ws.header_size+(size_t)ws.N);// just feed
-                if (ws.fin) {
-                    callable((const std::vector<uint8_t>) receivedData);
-                    receivedData.erase(receivedData.begin(), receivedData.end());
-                    std::vector<uint8_t> ().swap(receivedData);// free memory
+                if (ws.mask) { apply_mask(payload, size, ws.masking_key); }
+                if (ws.fin && receivedData.empty()) {
+                    // Unfragmented, hand out the bytes where they are.
+                    callable(payload, size);
+                }
+                else {
+                    receivedData.insert(receivedData.end(), payload, payload + size);// just feed
+                    if (ws.fin) {
+                        callable(receivedData.data(), receivedData.size());
+                        std::vector<uint8_t> ().swap(receivedData);// free memory
+                    }
                 }
             }
             else if (ws.opcode == wsheader_type::PING) {
-                if (ws.mask) { for (size_t i = 0; i != ws.N; ++i) { rxbuf[i+ws.header_size] ^= ws.masking_key[i&0x3]; } }
-                std::string data(rxbuf.begin()+ws.header_size, rxbuf.begin()+ws.header_size+(size_t)ws.N);
-                sendData(wsheader_type::PONG, data.size(), data.begin(), data.end());
+                if (ws.mask) { apply_mask(payload, size, ws.masking_key); }
+                sendData(wsheader_type::PONG, std::string((const char*) payload, size));
             }
             else if (ws.opcode == wsheader_type::PONG) { }
             else if (ws.opcode == wsheader_type::CLOSE) { close(); }
             else { fprintf(stderr, "ERROR: Got unexpected WebSocket message.\n"); close(); }
 
-            rxbuf.erase(rxbuf.begin(), rxbuf.begin() + ws.header_size+(size_t)ws.N);
+            rxbegin += ws.header_size + size;
+        }
+        if (rxbegin == rxend) {
+            // Nothing left over, so the next read starts at the front for free.
+            rxbegin = rxend = 0;
         }
     }
 
     void sendPing() {
-        std::string empty;
-        sendData(wsheader_type::PING, empty.size(), empty.begin(), empty.end());
+        sendData(wsheader_type::PING, std::string());
     }
 
     void send(const std::string& message) {
-        sendData(wsheader_type::TEXT_FRAME, message.size(), message.begin(), message.end());
+        sendData(wsheader_type::TEXT_FRAME, message);
+    }
+
+    void send(std::string&& message) {
+        sendData(wsheader_type::TEXT_FRAME, std::move(message));
     }
 
     void sendBinary(const std::string& message) {
-        sendData(wsheader_type::BINARY_FRAME, message.size(), message.begin(), message.end());
+        sendData(wsheader_type::BINARY_FRAME, message);
+    }
+
+    void sendBinary(std::string&& message) {
+        sendData(wsheader_type::BINARY_FRAME, std::move(message));
     }
 
     void sendBinary(const std::vector<uint8_t>& message) {
-        sendData(wsheader_type::BINARY_FRAME, message.size(), message.begin(), message.end());
+        sendData(wsheader_type::BINARY_FRAME, std::string(message.begin(), message.end()));
     }
 
-    template<class Iterator>
-    void sendData(wsheader_type::opcode_type type, uint64_t message_size, Iterator message_begin, Iterator message_end) {
+    void sendData(wsheader_type::opcode_type type, std::string message) {
         // TODO:
         // Masking key should (must) be derived from a high quality random
         // number generator, to mitigate attacks on non-WebSocket friendly
         // middleware:
         const uint8_t masking_key[4] = { 0x12, 0x34, 0x56, 0x78 };
-        // TODO: consider acquiring a lock on txbuf...
+        // TODO: consider acquiring a lock on txqueue...
         if (readyState == CLOSING || readyState == CLOSED) { return; }
-        std::vector<uint8_t> header;
-        header.assign(2 + (message_size >= 126 ? 2 : 0) + (message_size >= 65536 ? 6 : 0) + (useMask ? 4 : 0), 0);
+        const uint64_t message_size = message.size();
+        // N.B. - txqueue will keep growing until it can be transmitted over the socket:
+        txqueue.push_back(tx_frame());
+        tx_frame& frame = txqueue.back();
+        uint8_t* header = frame.header;
+        frame.header_size = 2 + (message_size >= 126 ? 2 : 0) + (message_size >= 65536 ? 6 : 0) + (useMask ? 4 : 0);
+        frame.sent = 0;
         header[0] = 0x80 | type;
         if (false) { }
         else if (message_size < 126) {
@@ -406,14 +591,9 @@ class _RealWebSocket : public easywsclient::WebSocket
                 header[13] = masking_key[3];
             }
         }
-        // N.B. - txbuf will keep growing until it can be transmitted over the socket:
-        txbuf.insert(txbuf.end(), header.begin(), header.end());
-        txbuf.insert(txbuf.end(), message_begin, message_end);
-        if (useMask) {
-            size_t message_offset = txbuf.size() - message_size;
-            for (size_t i = 0; i != message_size; ++i) {
-                txbuf[message_offset + i] ^= masking_key[i&0x3];
-            }
+        frame.payload.swap(message);
+        if (useMask && message_size) {
+            apply_mask((uint8_t*) &frame.payload[0], message_size, masking_key);
         }
     }
 
@@ -421,8 +601,11 @@ class _RealWebSocket : public easywsclient::WebSocket
         if(readyState == CLOSING || readyState == CLOSED) { return; }
         readyState = CLOSING;
         uint8_t closeFrame[6] = {0x88, 0x80, 0x00, 0x00, 0x00, 0x00}; // last 4 bytes are a masking key
-        std::vector<uint8_t> header(closeFrame, closeFrame+6);
-        txbuf.insert(txbuf.end(), header.begin(), header.end());
+        txqueue.push_back(tx_frame());
+        tx_frame& frame = txqueue.back();
+        memcpy(frame.header, closeFrame, 6);
+        frame.header_size = 6;
+        frame.sent = 0;
     }
 
 };
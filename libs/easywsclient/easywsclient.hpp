@@ -8,6 +8,8 @@
 // wget https://raw.github.com/dhbaird/easywsclient/master/easywsclient.hpp
 // wget https://raw.github.com/dhbaird/easywsclient/master/easywsclient.cpp
 
+#include <stddef.h>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -15,6 +17,7 @@ namespace easywsclient {
 
 struct Callback_Imp { virtual void operator()(const std::string& message) = 0; };
 struct BytesCallback_Imp { virtual void operator()(const std::vector<uint8_t>& message) = 0; };
+struct SpanCallback_Imp { virtual void operator()(const uint8_t* data, size_t size) = 0; };
 
 class WebSocket {
   public:
@@ -30,11 +33,18 @@ class WebSocket {
     virtual ~WebSocket() { }
     virtual void poll(int timeout = 0) = 0; // timeout in milliseconds
     virtual void send(const std::string& message) = 0;
+    // Taking over the message saves copying it into the send queue.
+    virtual void send(std::string&& message) = 0;
     virtual void sendBinary(const std::string& message) = 0;
+    virtual void sendBinary(std::string&& message) = 0;
     virtual void sendBinary(const std::vector<uint8_t>& message) = 0;
     virtual void sendPing() = 0;
     virtual void close() = 0;
     virtual readyStateValues getReadyState() const = 0;
+    // For waiting on the socket in an event loop instead of in poll(): call
+    // poll(0) once it is readable, or writable while hasPendingWrites().
+    virtual int getSocket() const = 0;
+    virtual bool hasPendingWrites() const = 0;
 
     template<class Callable>
     void dispatch(Callable callable)
@@ -62,9 +72,26 @@ class WebSocket {
         _dispatchBinary(callback);
     }
 
+    template<class Callable>
+    void dispatchSpan(Callable callable)
+        // For callbacks that accept a (const uint8_t* data, size_t size) pair.
+        // The bytes point into the receive buffer and are only valid until the
+        // callback returns, which saves copying each message. The callback
+        // must not call poll().
+    {
+        struct _Callback : public SpanCallback_Imp {
+            Callable& callable;
+            _Callback(Callable& callable) : callable(callable) { }
+            void operator()(const uint8_t* data, size_t size) { callable(data, size); }
+        };
+        _Callback callback(callable);
+        _dispatchSpan(callback);
+    }
+
   protected:
     virtual void _dispatch(Callback_Imp& callable) = 0;
     virtual void _dispatchBinary(BytesCallback_Imp& callable) = 0;
+    virtual void _dispatchSpan(SpanCallback_Imp& callable) = 0;
 };
 
 } // namespace easywsclient
@@ -0,0 +1,109 @@
+#ifndef EASYWSCLIENT_FOLLY_HPP
+#define EASYWSCLIENT_FOLLY_HPP
+
+// Not part of upstream easywsclient. Drives a WebSocket from a
+// folly::EventBase, so that any number of them can share a thread that is
+// already running an event loop, instead of each needing a thread of its own
+// blocking in poll().
+
+#include "easywsclient.hpp"
+
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace easywsclient {
+
+class EventBaseWebSocket : private folly::EventHandler {
+  public:
+    // The bytes are only valid during the call, see WebSocket::dispatchSpan.
+    typedef std::function<void(const uint8_t* data, size_t size)> MessageCallback;
+    typedef std::function<void()> CloseCallback;
+
+    // Takes over socket, which must be a connected one from from_url() or
+    // from_url_no_mask(), not create_dummy(). Must be created, used and
+    // destroyed on the EventBase's thread.
+    EventBaseWebSocket(
+        folly::EventBase* eventBase,
+        WebSocket::pointer socket,
+        MessageCallback onMessage,
+        CloseCallback onClose = CloseCallback())
+        : folly::EventHandler(eventBase, socket->getSocket()),
+          socket(socket),
+          onMessage(std::move(onMessage)),
+          onClose(std::move(onClose)),
+          registeredEvents(0) {
+        updateRegistration();
+    }
+
+    ~EventBaseWebSocket() {
+        unregisterHandler();
+    }
+
+    // Sending only queues the frame, it is written once the socket is
+    // writable. Safe to call from the message callback.
+    void send(std::string message) {
+        socket->send(std::move(message));
+        updateRegistration();
+    }
+
+    void sendBinary(std::string message) {
+        socket->sendBinary(std::move(message));
+        updateRegistration();
+    }
+
+    void sendBinary(const std::vector<uint8_t>& message) {
+        socket->sendBinary(message);
+        updateRegistration();
+    }
+
+    void close() {
+        socket->close();
+        updateRegistration();
+    }
+
+    WebSocket::readyStateValues getReadyState() const {
+        return socket->getReadyState();
+    }
+
+  private:
+    void handlerReady(uint16_t) noexcept override {
+        socket->poll(0);
+        socket->dispatchSpan([this](const uint8_t* data, size_t size) {
+            onMessage(data, size);
+        });
+        updateRegistration();
+    }
+
+    void updateRegistration() {
+        if (socket->getReadyState() == WebSocket::CLOSED) {
+            unregisterHandler();
+            registeredEvents = 0;
+            if (onClose) {
+                CloseCallback callback;
+                callback.swap(onClose);
+                callback();
+            }
+            return;
+        }
+        const uint16_t events = READ | PERSIST |
+            (socket->hasPendingWrites() ? WRITE : 0);
+        if (events != registeredEvents) {
+            registerHandler(events);
+            registeredEvents = events;
+        }
+    }
+
+    std::unique_ptr<WebSocket> socket;
+    MessageCallback onMessage;
+    CloseCallback onClose;
+    uint16_t registeredEvents;
+};
+
+} // namespace easywsclient
+
+#endif /* EASYWSCLIENT_FOLLY_HPP */
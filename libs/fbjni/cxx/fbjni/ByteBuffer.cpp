@@ -7,6 +7,7 @@
  */
 #include <fbjni/ByteBuffer.h>
 
+#include <cstring>
 #include <stdexcept>
 
 namespace facebook {
@@ -25,6 +26,16 @@ void JBuffer::rewind() const {
   meth(self());
 }
 
+size_t JBuffer::position() const {
+  static auto meth = javaClassStatic()->getMethod<jint()>("position");
+  return static_cast<size_t>(meth(self()));
+}
+
+size_t JBuffer::limit() const {
+  static auto meth = javaClassStatic()->getMethod<jint()>("limit");
+  return static_cast<size_t>(meth(self()));
+}
+
 local_ref<JByteBuffer> JByteBuffer::wrapBytes(uint8_t* data, size_t size) {
   // env->NewDirectByteBuffer requires that size is positive. Android's
   // dalvik returns an invalid result and Android's art aborts if size == 0.
@@ -70,6 +81,25 @@ size_t JByteBuffer::getDirectSize() const {
   return static_cast<size_t>(size);
 }
 
+void JByteBuffer::getBytes(size_t index, size_t length, uint8_t* out) const {
+  if (isDirect()) {
+    if (index > getDirectSize() || length > getDirectSize() - index) {
+      throwNewJavaException("java/lang/IndexOutOfBoundsException", "java.lang.IndexOutOfBoundsException");
+    }
+    std::memcpy(out, getDirectBytes() + index, length);
+    return;
+  }
+  static auto arrayMeth = javaClassStatic()->getMethod<JArrayByte::javaobject()>("array");
+  static auto offsetMeth = javaClassStatic()->getMethod<jint()>("arrayOffset");
+  auto array = arrayMeth(self());
+  const auto offset = static_cast<size_t>(offsetMeth(self()));
+  if (index > array->size() - offset || length > array->size() - offset - index) {
+    throwNewJavaException("java/lang/IndexOutOfBoundsException", "java.lang.IndexOutOfBoundsException");
+  }
+  array->getRegion(
+      static_cast<jsize>(offset + index), static_cast<jsize>(length), reinterpret_cast<jbyte*>(out));
+}
+
 bool JByteBuffer::isDirect() const {
   static auto meth = javaClassStatic()->getMethod<jboolean()>("isDirect");
   return meth(self());
@@ -17,6 +17,8 @@ public:
   static constexpr const char* kJavaDescriptor = "Ljava/nio/Buffer;";
 
   void rewind() const;
+  size_t position() const;
+  size_t limit() const;
 };
 
 // JNI's NIO support has some awkward preconditions and error reporting. This
@@ -31,6 +33,12 @@ class JByteBuffer : public JavaClass<JByteBuffer, JBuffer> {
 
   uint8_t* getDirectBytes() const;
   size_t getDirectSize() const;
+
+  // Copies length bytes starting at the absolute index into out. This is a
+  // single memcpy for direct buffers and a single region copy out of the
+  // backing array for heap buffers. Read-only heap buffers don't expose their
+  // array and aren't supported.
+  void getBytes(size_t index, size_t length, uint8_t* out) const;
 };
 
 }}
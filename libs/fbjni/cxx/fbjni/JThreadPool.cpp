@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#include <fbjni/JThreadPool.h>
+
+namespace facebook {
+namespace jni {
+
+namespace {
+// How many local references a task is expected to need; JNI grows the frame
+// if it needs more.
+constexpr jint kTaskLocalCapacity = 16;
+}
+
+JThreadPool::JThreadPool(size_t threadCount) {
+  threads_.reserve(threadCount);
+  for (size_t i = 0; i < threadCount; i++) {
+    threads_.emplace_back([this] {
+      ThreadScope::WithClassLoader([this] { run(); });
+    });
+  }
+}
+
+JThreadPool::~JThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  available_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void JThreadPool::add(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  available_.notify_one();
+}
+
+void JThreadPool::run() {
+  JNIEnv* env = Environment::current();
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      available_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    JniLocalScope scope(env, kTaskLocalCapacity);
+    try {
+      task();
+    } catch (const std::exception& e) {
+      FBJNI_LOGE("error in pool task: %s", e.what());
+    } catch (...) {
+      FBJNI_LOGE("error in pool task");
+    }
+  }
+}
+
+}
+}
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fbjni/fbjni.h>
+
+namespace facebook {
+namespace jni {
+
+/**
+ * A fixed set of native worker threads for background work that calls into
+ * Java. Each worker is attached once, with the application class loader, for
+ * its whole lifetime, so tasks can use JNI and find app classes without
+ * attaching and detaching around every one of them.
+ *
+ * Each task runs in its own local reference frame. Exceptions escaping a
+ * task are logged and dropped.
+ */
+class JThreadPool {
+ public:
+  explicit JThreadPool(size_t threadCount);
+
+  /**
+   * Runs the tasks that were already added, then joins the workers. Must not
+   * be called from one of them.
+   */
+  ~JThreadPool();
+
+  JThreadPool(const JThreadPool&) = delete;
+  JThreadPool& operator=(const JThreadPool&) = delete;
+
+  /**
+   * Queues task to run on the next free worker, in the order added.
+   */
+  void add(std::function<void()> task);
+
+  size_t threadCount() const {
+    return threads_.size();
+  }
+
+ private:
+  void run();
+
+  std::mutex mutex_;
+  std::condition_variable available_;
+  std::deque<std::function<void()>> tasks_;
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+};
+
+}
+}
@@ -15,5 +15,6 @@ JNIEXPORT jint JNI_OnLoad(JavaVM* vm, void* reserved) {
     HybridDataOnLoad();
     JNativeRunnable::OnLoad();
     ThreadScope::OnLoad();
+    ExceptionsOnLoad();
   });
 }
@@ -187,7 +187,7 @@ inline bool JClass::isAssignableFrom(alias_ref<JClass> other) const noexcept {
 
 template<typename F>
 inline JConstructor<F> JClass::getConstructor() const {
-  return getConstructor<F>(jmethod_traits_from_cxx<F>::constructor_descriptor().c_str());
+  return getConstructor<F>(jmethod_traits_from_cxx<F>::static_constructor_descriptor());
 }
 
 template<typename F>
@@ -198,7 +198,7 @@ inline JConstructor<F> JClass::getConstructor(const char* descriptor) const {
 
 template<typename F>
 inline JMethod<F> JClass::getMethod(const char* name) const {
-  return getMethod<F>(name, jmethod_traits_from_cxx<F>::descriptor().c_str());
+  return getMethod<F>(name, jmethod_traits_from_cxx<F>::static_descriptor());
 }
 
 template<typename F>
@@ -213,7 +213,7 @@ inline JMethod<F> JClass::getMethod(
 
 template<typename F>
 inline JStaticMethod<F> JClass::getStaticMethod(const char* name) const {
-  return getStaticMethod<F>(name, jmethod_traits_from_cxx<F>::descriptor().c_str());
+  return getStaticMethod<F>(name, jmethod_traits_from_cxx<F>::static_descriptor());
 }
 
 template<typename F>
@@ -228,7 +228,7 @@ inline JStaticMethod<F> JClass::getStaticMethod(
 
 template<typename F>
 inline JNonvirtualMethod<F> JClass::getNonvirtualMethod(const char* name) const {
-  return getNonvirtualMethod<F>(name, jmethod_traits_from_cxx<F>::descriptor().c_str());
+  return getNonvirtualMethod<F>(name, jmethod_traits_from_cxx<F>::static_descriptor());
 }
 
 template<typename F>
@@ -238,6 +238,10 @@ class JClass : public JavaClass<JClass, JObject, jclass> {
   /// By default, C++ exceptions raised will be converted to Java exceptions.
   /// To avoid this and get the "standard" JNI behavior of a crash when a C++
   /// exception is crashing out of the JNI method, declare the method noexcept.
+  ///
+  /// Methods annotated with @FastNative or @CriticalNative in Java are
+  /// registered with makeFastNativeMethod and makeCriticalNativeMethod, see
+  /// Registration.h.
   void registerNatives(std::initializer_list<NativeMethod> methods);
 
   /// Check to see if the class is assignable from another class
@@ -330,6 +334,11 @@ class JString : public JavaClass<JString, JObject, jstring> {
   /// Convenience method to convert a jstring object to a std::string
   std::string toStdString() const;
 
+  /// Like toStdString, but converts into out, reusing its buffer. Callers that
+  /// convert many strings, e.g. field names, can keep one buffer around and
+  /// avoid allocating per string.
+  void toStdString(std::string& out) const;
+
   /// Convenience method to convert a jstring object to a std::u16string
   std::u16string toU16String() const;
 };
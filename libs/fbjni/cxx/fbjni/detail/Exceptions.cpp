@@ -14,6 +14,7 @@
 #endif
 
 #include <alloca.h>
+#include <atomic>
 #include <cstdlib>
 #include <ios>
 #include <stdexcept>
@@ -89,6 +90,16 @@ class JCppSystemErrorException : public JavaClass<JCppSystemErrorException, JThr
   }
 };
 
+std::atomic<bool> gCppStackTracesInJavaExceptions{true};
+
+// Allocating a new error is exactly what is likely to fail once memory has
+// run out, so bad_alloc is always reported with this one.
+alias_ref<JThrowable> preallocatedOutOfMemoryError() {
+  static const auto error =
+    make_global(JOutOfMemoryError::create("Out of memory in native code"));
+  return error;
+}
+
 // Exception throwing & translating functions //////////////////////////////////////////////////////
 
 // Functions that throw Java exceptions
@@ -257,8 +268,9 @@ local_ref<JThrowable> convertCppExceptionToJavaException(std::exception_ptr ptr)
     current = ex.getThrowable();
   } catch (const std::ios_base::failure& ex) {
     current = JIOException::create(ex.what());
-  } catch (const std::bad_alloc& ex) {
-    current = JOutOfMemoryError::create(ex.what());
+  } catch (const std::bad_alloc&) {
+    current = make_local(preallocatedOutOfMemoryError());
+    addCppStack = false;
   } catch (const std::out_of_range& ex) {
     current = JArrayIndexOutOfBoundsException::create(ex.what());
   } catch (const std::system_error& ex) {
@@ -273,7 +285,7 @@ local_ref<JThrowable> convertCppExceptionToJavaException(std::exception_ptr ptr)
     current = JUnknownCppException::create();
   }
 
-  if (addCppStack) {
+  if (addCppStack && gCppStackTracesInJavaExceptions.load(std::memory_order_relaxed)) {
     addCppStacktraceToJavaException(current, ptr);
   }
   return current;
@@ -300,7 +312,9 @@ local_ref<JThrowable> getJavaExceptionForCppException(std::exception_ptr ptr) {
   local_ref<JThrowable> previous;
   auto func = [&previous] (std::exception_ptr ptr) {
     auto current = convertCppExceptionToJavaException(ptr);
-    if (previous) {
+    // The preallocated error is shared, so it can't take a cause.
+    if (previous && !Environment::current()->IsSameObject(
+          current.get(), preallocatedOutOfMemoryError().get())) {
       current->initCause(previous);
     }
     previous = current;
@@ -318,6 +332,8 @@ void translatePendingCppExceptionToJavaException() {
     auto exc = JUnknownCppException::create();
 #endif
     setJavaExceptionAndAbortOnFailure(exc);
+  } catch (const std::bad_alloc&) {
+    setJavaExceptionAndAbortOnFailure(preallocatedOutOfMemoryError());
   } catch (...) {
 #ifndef FBJNI_NO_EXCEPTION_PTR
     FBJNI_LOGE(
@@ -331,6 +347,14 @@ void translatePendingCppExceptionToJavaException() {
   }
 }
 
+void setCppStackTracesInJavaExceptions(bool enabled) noexcept {
+  gCppStackTracesInJavaExceptions.store(enabled, std::memory_order_relaxed);
+}
+
+void ExceptionsOnLoad() {
+  preallocatedOutOfMemoryError();
+}
+
 // JniException ////////////////////////////////////////////////////////////////////////////////////
 
 const std::string JniException::kExceptionMessageFailure_ = "Unable to get exception message.";
@@ -125,6 +125,16 @@ local_ref<JThrowable> getJavaExceptionForCppBackTrace();
 
 local_ref<JThrowable> getJavaExceptionForCppBackTrace(const char* msg);
 
+/**
+ * Controls whether Java exceptions translated from C++ exceptions get the C++ stack trace
+ * prepended to their stack trace. This is on by default. Turning it off skips symbolizing the
+ * native stack and rebuilding the Java stack trace on every translation, for code that routinely
+ * reports expected errors to Java. getJavaExceptionForCppBackTrace is not affected.
+ */
+void setCppStackTracesInJavaExceptions(bool enabled) noexcept;
+
+void ExceptionsOnLoad();
+
 // For convenience, some exception names in java.lang are available here.
 const char* const gJavaLangIllegalArgumentException = "java/lang/IllegalArgumentException";
 
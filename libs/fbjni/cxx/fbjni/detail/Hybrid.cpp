@@ -16,6 +16,17 @@ local_ref<HybridData> HybridData::create() {
   return newInstance();
 }
 
+local_ref<HybridData> HybridData::create(std::unique_ptr<BaseHybridClass> nativePointer) {
+  static const auto destructorField =
+    javaClassStatic()->getField<HybridDestructor::javaobject>("mDestructor");
+  static const auto pointerField =
+    HybridDestructor::javaClassStatic()->getField<jlong>("mNativePointer");
+  auto hybridData = newInstance();
+  auto destructor = hybridData->getFieldValue(destructorField);
+  destructor->setFieldValue(pointerField, reinterpret_cast<jlong>(nativePointer.release()));
+  return hybridData;
+}
+
 }
 
 namespace {
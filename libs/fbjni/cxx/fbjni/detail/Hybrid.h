@@ -25,6 +25,9 @@ public:
 struct HybridData : public JavaClass<HybridData> {
   constexpr static auto kJavaDescriptor = "Lcom/facebook/jni/HybridData;";
   static local_ref<HybridData> create();
+  // Creates a HybridData which owns nativePointer. A new HybridData can't
+  // own anything yet, so this skips the check setNativePointer makes.
+  static local_ref<HybridData> create(std::unique_ptr<BaseHybridClass> nativePointer);
 };
 
 class HybridDestructor : public JavaClass<HybridDestructor> {
@@ -166,9 +169,7 @@ protected:
   }
 
   static local_ref<detail::HybridData> makeHybridData(std::unique_ptr<T> cxxPart) {
-    auto hybridData = detail::HybridData::create();
-    setNativePointer(hybridData, std::move(cxxPart));
-    return hybridData;
+    return detail::HybridData::create(std::move(cxxPart));
   }
 
   template <typename... Args>
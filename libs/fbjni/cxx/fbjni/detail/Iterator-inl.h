@@ -117,6 +117,59 @@ class Iterator {
   value_type entry_;
 };
 
+template <typename E>
+class ListIterator {
+ public:
+  typedef local_ref<E> value_type;
+  typedef ptrdiff_t difference_type;
+  typedef value_type* pointer;
+  typedef value_type& reference;
+  typedef std::input_iterator_tag iterator_category;
+
+  typedef typename JArrayClass<jobject>::javaobject Elements;
+
+  // begin ctor
+  ListIterator(global_ref<Elements>&& elements)
+      : elements_(std::move(elements))
+      , size_(elements_->size())
+      , i_(-1) {
+    ++(*this);
+  }
+
+  // end ctor
+  ListIterator()
+      : size_(0)
+      , i_(-1) {}
+
+  bool operator==(const ListIterator& it) const { return i_ == it.i_; }
+  bool operator!=(const ListIterator& it) const { return !(*this == it); }
+  const value_type& operator*() const { assert(i_ != -1); return entry_; }
+  const value_type* operator->() const { assert(i_ != -1); return &entry_; }
+  ListIterator& operator++() {  // preincrement
+    if (static_cast<size_t>(i_ + 1) < size_) {
+      ++i_;
+      entry_ = dynamic_ref_cast<JniType<E>>(elements_->getElement(i_));
+    } else {
+      i_ = -1;
+      entry_.reset();
+    }
+    return *this;
+  }
+  ListIterator operator++(int) {  // postincrement
+    ListIterator ret;
+    ret.i_ = i_;
+    ret.entry_ = std::move(entry_);
+    ++(*this);
+    return ret;
+  }
+
+  global_ref<Elements> elements_;
+  size_t size_;
+  // set to -1 at end
+  std::ptrdiff_t i_;
+  value_type entry_;
+};
+
 }
 
 template <typename E>
@@ -166,6 +219,31 @@ size_t JCollection<E>::size() const {
   return sizeMethod(this->self());
 }
 
+template <typename E>
+struct JList<E>::Iterator : public detail::ListIterator<E> {
+  using detail::ListIterator<E>::ListIterator;
+};
+
+template <typename E>
+local_ref<E> JList<E>::get(size_t index) const {
+  static auto getMethod =
+    JList<E>::javaClassStatic()->template getMethod<jobject(jint)>("get");
+  return dynamic_ref_cast<JniType<E>>(getMethod(this->self(), static_cast<jint>(index)));
+}
+
+template <typename E>
+typename JList<E>::Iterator JList<E>::begin() const {
+  static auto toArrayMethod =
+    JList<E>::javaClassStatic()->template getMethod<
+      typename detail::ListIterator<E>::Elements()>("toArray");
+  return Iterator(make_global(toArrayMethod(this->self())));
+}
+
+template <typename E>
+typename JList<E>::Iterator JList<E>::end() const {
+  return Iterator();
+}
+
 template <typename K, typename V>
 struct JMap<K,V>::Iterator : public detail::Iterator<detail::MapIteratorHelper<K,V>> {
   using detail::Iterator<detail::MapIteratorHelper<K,V>>::Iterator;
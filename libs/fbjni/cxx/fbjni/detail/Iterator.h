@@ -92,6 +92,23 @@ struct JCollection : JavaClass<JCollection<E>, JIterable<E>> {
 template <typename E = jobject>
 struct JList : JavaClass<JList<E>, JCollection<E>> {
   constexpr static auto kJavaDescriptor = "Ljava/util/List;";
+
+  struct Iterator;
+
+  /**
+   * Returns the element at the given index.
+   */
+  local_ref<E> get(size_t index) const;
+
+  /**
+   * Iterating over a List works like iterating over any Iterable, except
+   * that begin() takes a snapshot of the list with a single call to
+   * toArray(). The elements are then read out of that array, so a list of n
+   * elements costs one Java call instead of 2n calls through
+   * java.util.Iterator. Changes made to the list after begin() are not seen.
+   */
+  Iterator begin() const;
+  Iterator end() const;
 };
 
 template <typename E = jobject>
@@ -7,6 +7,7 @@
  */
 #pragma once
 
+#include <initializer_list>
 #include <jni.h>
 
 #include "Common.h"
@@ -391,6 +392,124 @@ inline std::string JMethodDescriptor() {
   return "()" + JavaDescriptor<R>();
 }
 
+// Descriptors that are known at compile time, or nullptr if the type only knows its descriptor
+// at runtime. A function rather than a constant so that nothing is instantiated for types that
+// are still incomplete.
+template<typename T>
+struct ConstexprDescriptor {
+  static constexpr const char* get() {
+    return ReprType<T>::kJavaDescriptor;
+  }
+};
+
+#pragma push_macro("DEFINE_CONSTEXPR_DESCRIPTOR")
+#undef DEFINE_CONSTEXPR_DESCRIPTOR
+
+#define DEFINE_CONSTEXPR_DESCRIPTOR(TYPE, DSC)               \
+template<>                                                   \
+struct ConstexprDescriptor<TYPE> {                           \
+  static constexpr const char* get() { return #DSC; }        \
+};                                                           \
+template<>                                                   \
+struct ConstexprDescriptor<TYPE ## Array> {                  \
+  static constexpr const char* get() { return "[" #DSC; }    \
+};
+
+template<>
+struct ConstexprDescriptor<void> {
+  static constexpr const char* get() { return "V"; }
+};
+
+DEFINE_CONSTEXPR_DESCRIPTOR(jboolean, Z)
+DEFINE_CONSTEXPR_DESCRIPTOR(jbyte,    B)
+DEFINE_CONSTEXPR_DESCRIPTOR(jchar,    C)
+DEFINE_CONSTEXPR_DESCRIPTOR(jshort,   S)
+DEFINE_CONSTEXPR_DESCRIPTOR(jint,     I)
+DEFINE_CONSTEXPR_DESCRIPTOR(jlong,    J)
+DEFINE_CONSTEXPR_DESCRIPTOR(jfloat,   F)
+DEFINE_CONSTEXPR_DESCRIPTOR(jdouble,  D)
+
+#pragma pop_macro("DEFINE_CONSTEXPR_DESCRIPTOR")
+
+constexpr bool allConstexpr() {
+  return true;
+}
+
+template<typename... Rest>
+constexpr bool allConstexpr(const char* first, Rest... rest) {
+  return first != nullptr && allConstexpr(rest...);
+}
+
+constexpr size_t descriptorsLength() {
+  return 0;
+}
+
+template<typename... Rest>
+constexpr size_t descriptorsLength(const char* first, Rest... rest) {
+  size_t length = 0;
+  while (first[length] != '\0') {
+    length++;
+  }
+  return length + descriptorsLength(rest...);
+}
+
+template<size_t N>
+struct DescriptorChars {
+  char value[N + 1];
+};
+
+constexpr void appendDescriptor(char* out, size_t& offset, const char* descriptor) {
+  for (size_t i = 0; descriptor[i] != '\0'; i++) {
+    out[offset++] = descriptor[i];
+  }
+}
+
+template<size_t N>
+constexpr DescriptorChars<N> makeMethodDescriptor(
+    const char* ret,
+    std::initializer_list<const char*> args) {
+  DescriptorChars<N> chars{};
+  size_t offset = 0;
+  chars.value[offset++] = '(';
+  for (auto arg : args) {
+    appendDescriptor(chars.value, offset, arg);
+  }
+  chars.value[offset++] = ')';
+  appendDescriptor(chars.value, offset, ret);
+  chars.value[offset] = '\0';
+  return chars;
+}
+
+template<bool IsConstexpr, typename R, typename... Args>
+struct StaticMethodDescriptor {
+  static const char* get() {
+    static const std::string descriptor = JMethodDescriptor<R, Args...>();
+    return descriptor.c_str();
+  }
+};
+
+template<typename R, typename... Args>
+struct StaticMethodDescriptor<true, R, Args...> {
+  static constexpr size_t kLength = 2 + descriptorsLength(
+      ConstexprDescriptor<R>::get(), ConstexprDescriptor<Args>::get()...);
+  static constexpr DescriptorChars<kLength> kDescriptor = makeMethodDescriptor<kLength>(
+      ConstexprDescriptor<R>::get(), {ConstexprDescriptor<Args>::get()...});
+
+  static const char* get() {
+    return kDescriptor.value;
+  }
+};
+
+template<typename R, typename... Args>
+constexpr DescriptorChars<StaticMethodDescriptor<true, R, Args...>::kLength>
+    StaticMethodDescriptor<true, R, Args...>::kDescriptor;
+
+template<typename R, typename... Args>
+using StaticMethodDescriptorFor = StaticMethodDescriptor<
+    allConstexpr(ConstexprDescriptor<R>::get(), ConstexprDescriptor<Args>::get()...),
+    R,
+    Args...>;
+
 } // internal
 
 template<typename R, typename... Args>
@@ -403,4 +522,14 @@ inline std::string jmethod_traits<R(Args...)>::constructor_descriptor() {
   return internal::JMethodDescriptor<void, Args...>();
 }
 
+template<typename R, typename... Args>
+inline const char* jmethod_traits<R(Args...)>::static_descriptor() {
+  return internal::StaticMethodDescriptorFor<R, Args...>::get();
+}
+
+template<typename R, typename... Args>
+inline const char* jmethod_traits<R(Args...)>::static_constructor_descriptor() {
+  return internal::StaticMethodDescriptorFor<void, Args...>::get();
+}
+
 }}
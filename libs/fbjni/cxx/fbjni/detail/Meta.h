@@ -262,6 +262,12 @@ template<typename R, typename... Args>
 struct jmethod_traits<R(Args...)> {
   static std::string descriptor();
   static std::string constructor_descriptor();
+
+  /// The same descriptors as C strings that live for the rest of the program. When every type
+  /// involved has a fixed descriptor, these are generated at compile time; otherwise (e.g. for
+  /// arrays of objects and hybrid classes) they are built once on first use.
+  static const char* static_descriptor();
+  static const char* static_constructor_descriptor();
 };
 
 
@@ -77,10 +77,13 @@ inline void GlobalReferenceAllocator::deleteReference(jobject reference) const n
   internal::dbglog("Global release: %p", reference);
 
   if (reference) {
+    assert(verifyReference(reference));
+    if (ReferenceReleaseScope::defer(reference, JNIGlobalRefType)) {
+      return;
+    }
     #ifdef FBJNI_DEBUG_REFS
       ++internal::g_reference_stats.globals_deleted;
     #endif
-    assert(verifyReference(reference));
     Environment::current()->DeleteGlobalRef(reference);
   }
 }
@@ -106,10 +109,13 @@ inline void WeakGlobalReferenceAllocator::deleteReference(jobject reference) con
   internal::dbglog("Weak Global release: %p", reference);
 
   if (reference) {
+    assert(verifyReference(reference));
+    if (ReferenceReleaseScope::defer(reference, JNIWeakGlobalRefType)) {
+      return;
+    }
     #ifdef FBJNI_DEBUG_REFS
       ++internal::g_reference_stats.weaks_deleted;
     #endif
-    assert(verifyReference(reference));
     Environment::current()->DeleteWeakGlobalRef(reference);
   }
 }
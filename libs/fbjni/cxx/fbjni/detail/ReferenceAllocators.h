@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include <cstddef>
+
 #include "Common.h"
 
 namespace facebook { namespace jni {
@@ -42,6 +44,43 @@ class WeakGlobalReferenceAllocator {
   bool verifyReference(jobject reference) const noexcept;
 };
 
+/**
+ * RAII object that batches releasing global and weak global references. While one is on the
+ * stack, global and weak references deleted on the same thread are queued instead of being
+ * released one at a time, and are released together when the scope ends or its queue fills up.
+ * Scopes nest; references go to the innermost one.
+ *
+ * This is meant for code that drops many references in a row, such as tearing down a batch of
+ * responders or plugins. JNI has no way to point an existing global reference at another object,
+ * so references cannot be pooled and reused; batching their release is what can be saved.
+ */
+class ReferenceReleaseScope {
+ public:
+  ReferenceReleaseScope() noexcept;
+  ReferenceReleaseScope(const ReferenceReleaseScope&) = delete;
+  ReferenceReleaseScope& operator=(const ReferenceReleaseScope&) = delete;
+  ~ReferenceReleaseScope() noexcept;
+
+  /// Releases all queued references now
+  void flush() noexcept;
+
+  /// Queues reference to be released by the innermost scope on this thread. Returns false if
+  /// there is no such scope, in which case the caller has to release it.
+  static bool defer(jobject reference, jobjectRefType refType) noexcept;
+
+ private:
+  static constexpr size_t kCapacity = 32;
+
+  struct Pending {
+    jobject reference;
+    jobjectRefType refType;
+  };
+
+  ReferenceReleaseScope* outer_;
+  size_t size_;
+  Pending pending_[kCapacity];
+};
+
 /**
  * @return Helper based on GetObjectRefType.  Since this isn't defined
  * on all versions of Java or Android, if the type can't be
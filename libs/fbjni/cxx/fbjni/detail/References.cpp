@@ -26,6 +26,56 @@ JniLocalScope::~JniLocalScope() {
 
 namespace {
 
+thread_local ReferenceReleaseScope* currentReleaseScope = nullptr;
+
+}
+
+ReferenceReleaseScope::ReferenceReleaseScope() noexcept
+    : outer_(currentReleaseScope), size_(0) {
+  currentReleaseScope = this;
+}
+
+ReferenceReleaseScope::~ReferenceReleaseScope() noexcept {
+  flush();
+  currentReleaseScope = outer_;
+}
+
+void ReferenceReleaseScope::flush() noexcept {
+  if (size_ == 0) {
+    return;
+  }
+  auto env = Environment::current();
+  for (size_t i = 0; i < size_; ++i) {
+    if (pending_[i].refType == JNIGlobalRefType) {
+      #ifdef FBJNI_DEBUG_REFS
+        ++internal::g_reference_stats.globals_deleted;
+      #endif
+      env->DeleteGlobalRef(pending_[i].reference);
+    } else {
+      #ifdef FBJNI_DEBUG_REFS
+        ++internal::g_reference_stats.weaks_deleted;
+      #endif
+      env->DeleteWeakGlobalRef(pending_[i].reference);
+    }
+  }
+  size_ = 0;
+}
+
+/* static */
+bool ReferenceReleaseScope::defer(jobject reference, jobjectRefType refType) noexcept {
+  auto scope = currentReleaseScope;
+  if (!scope) {
+    return false;
+  }
+  if (scope->size_ == kCapacity) {
+    scope->flush();
+  }
+  scope->pending_[scope->size_++] = {reference, refType};
+  return true;
+}
+
+namespace {
+
 #ifdef __ANDROID__
 
 int32_t getAndroidApiLevel() {
@@ -109,6 +109,53 @@ struct MethodWrapper {
   }
 };
 
+template <typename T>
+struct IsCriticalNativeType : std::integral_constant<bool,
+    std::is_same<T, jboolean>::value || std::is_same<T, jbyte>::value ||
+    std::is_same<T, jchar>::value || std::is_same<T, jshort>::value ||
+    std::is_same<T, jint>::value || std::is_same<T, jlong>::value ||
+    std::is_same<T, jfloat>::value || std::is_same<T, jdouble>::value> {};
+
+template <typename... Args>
+struct AreCriticalNativeTypes : std::true_type {};
+
+template <typename T, typename... Args>
+struct AreCriticalNativeTypes<T, Args...> : std::integral_constant<bool,
+    IsCriticalNativeType<T>::value && AreCriticalNativeTypes<Args...>::value> {};
+
+// registration wrappers for @CriticalNative functions, which get neither
+// env nor class.
+template<typename F, F func, typename R, typename... Args>
+struct CriticalWrapper {
+  static_assert(
+      std::is_void<R>::value || IsCriticalNativeType<R>::value,
+      "@CriticalNative methods can only return primitives");
+  static_assert(
+      AreCriticalNativeTypes<Args...>::value,
+      "@CriticalNative methods can only take primitives");
+
+  JNI_ENTRY_POINT static R call(Args... args) noexcept {
+    return (*func)(args...);
+  }
+
+  JNI_ENTRY_POINT static R callWithEnv(JNIEnv*, jclass, Args... args) noexcept {
+    return (*func)(args...);
+  }
+};
+
+template<typename F, F func, typename R, typename... Args>
+inline NativeMethodWrapper* criticalWrapJNIMethod(R (*)(Args... args)) {
+  // This intentionally erases the real type; JNI will do it anyway
+  return criticalNativesSupported()
+      ? reinterpret_cast<NativeMethodWrapper*>(&(CriticalWrapper<F, func, R, Args...>::call))
+      : reinterpret_cast<NativeMethodWrapper*>(&(CriticalWrapper<F, func, R, Args...>::callWithEnv));
+}
+
+template<typename R, typename... Args>
+inline std::string makeCriticalDescriptor(R (*)(Args... args)) {
+  return jmethod_traits<R(Args...)>::descriptor();
+}
+
 template<typename F, F func, typename C, typename R, typename... Args>
 inline NativeMethodWrapper* exceptionWrapJNIMethod(R (*)(JNIEnv*, C, Args... args)) {
   // This intentionally erases the real type; JNI will do it anyway
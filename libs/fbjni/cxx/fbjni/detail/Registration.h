@@ -7,6 +7,7 @@
  */
 #pragma once
 
+#include <functional>
 #include <jni.h>
 #include "References.h"
 
@@ -44,6 +45,18 @@ std::string makeDescriptor(R (*func)(alias_ref<C>, Args... args));
 template<typename R, typename C, typename... Args>
 std::string makeDescriptor(R (C::*method0)(Args... args));
 
+// Wrap a function taking and returning only primitives, without env or
+// class, for a static @CriticalNative method.
+template<typename F, F func, typename R, typename... Args>
+NativeMethodWrapper* criticalWrapJNIMethod(R (*func0)(Args... args));
+
+template<typename R, typename... Args>
+std::string makeCriticalDescriptor(R (*func)(Args... args));
+
+// Whether the runtime honours @CriticalNative, which ART does from Android
+// 8.0. Dalvik and older ART call critical natives like any other.
+bool criticalNativesSupported();
+
 }
 
 // We have to use macros here, because the func needs to be used
@@ -66,6 +79,44 @@ std::string makeDescriptor(R (C::*method0)(Args... args));
 #define makeNativeMethodN(a, b, c, count, ...) makeNativeMethod ## count
 #define makeNativeMethod(...) makeNativeMethodN(__VA_ARGS__, 3, 2)(__VA_ARGS__)
 
+// For a Java method annotated with @FastNative, which ART calls without
+// changing the thread's state. Registration is the same as for any other
+// native, but the function must not block or run for long, since the
+// garbage collector waits for it.
+#define makeFastNativeMethod(...) makeNativeMethod(__VA_ARGS__)
+
+// For a static Java method annotated with @CriticalNative, which ART calls
+// as a plain C function: func takes and returns primitives only (jint,
+// jlong, jboolean, ...), without the env or class, and must not throw, as
+// there is no env to throw into Java with. The annotation is not checked,
+// and calling a critical native without it, or the other way around, will
+// crash. Where @CriticalNative isn't honoured, a stub dropping the env and
+// class is registered instead.
+#define makeCriticalNativeMethod2(name, func)                           \
+  { name "", ::facebook::jni::detail::makeCriticalDescriptor(&func),    \
+      ::facebook::jni::detail::criticalWrapJNIMethod<decltype(&func), &func>(&func) }
+
+#define makeCriticalNativeMethod3(name, desc, func)                     \
+  { name "", desc,                                                      \
+      ::facebook::jni::detail::criticalWrapJNIMethod<decltype(&func), &func>(&func) }
+
+#define makeCriticalNativeMethodN(a, b, c, count, ...) makeCriticalNativeMethod ## count
+#define makeCriticalNativeMethod(...) makeCriticalNativeMethodN(__VA_ARGS__, 3, 2)(__VA_ARGS__)
+
+/**
+ * Runs lookups on a new thread attached with the application class loader
+ * and returns immediately. This is meant to be called from the function
+ * passed to initialize(), to resolve the classes and method ids that
+ * upcalls need (typically by calling javaClassStatic() and getMethod()
+ * into function-local statics) without delaying library load or the first
+ * call that needs them. A lookup that is still in progress when it is first
+ * used elsewhere simply blocks until it is done.
+ *
+ * Natives still have to be registered synchronously, before JNI_OnLoad
+ * returns. Exceptions thrown by lookups are logged and dropped.
+ */
+void preloadInBackground(std::function<void()>&& lookups);
+
 }}
 
 #include "Registration-inl.h"
@@ -7,8 +7,17 @@
  */
 #include "utf8.h"
 
+#include <cstring>
+
 #include "Log.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FBJNI_UTF8_NEON 1
+#endif
+
 namespace facebook {
 namespace jni {
 
@@ -52,6 +61,62 @@ inline bool isFourByteUTF8Encoding(const T* utf8) {
   return ((*utf8 & 0xF8) == 0xF0);
 }
 
+// Characters in [1, 0x7f] are the same in utf-8 and modified utf-8, and are the
+// common case by far. These return how many such characters str starts with,
+// looking at 16 bytes at a time. They only look at whole blocks, so the result
+// may be short; callers fall back to the byte by byte loops for the rest.
+
+inline size_t asciiRunLength(const uint8_t* str, size_t len) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= len; i += 16) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+    // The sign bit is set for bytes >= 0x80, and cmpeq sets it for NULs.
+    const int mask = _mm_movemask_epi8(_mm_or_si128(chunk, _mm_cmpeq_epi8(chunk, zero)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#elif defined(FBJNI_UTF8_NEON)
+  const uint8x16_t one = vdupq_n_u8(1);
+  const uint8x16_t limit = vdupq_n_u8(0x7f);
+  for (; i + 16 <= len; i += 16) {
+    // NULs wrap around to 0xff, so this flags everything outside [1, 0x7f].
+    const uint8x16_t other = vcgeq_u8(vsubq_u8(vld1q_u8(str + i), one), limit);
+    const uint64x2_t lanes = vreinterpretq_u64_u8(other);
+    if ((vgetq_lane_u64(lanes, 0) | vgetq_lane_u64(lanes, 1)) != 0) {
+      break;
+    }
+  }
+#endif
+  return i;
+}
+
+inline size_t asciiRunLength(const uint16_t* str, size_t len) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i high = _mm_set1_epi16(static_cast<short>(0xff80));
+  for (; i + 8 <= len; i += 8) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+    const __m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(chunk, high), zero);
+    if (_mm_movemask_epi8(ascii) != 0xffff) {
+      break;
+    }
+  }
+#elif defined(FBJNI_UTF8_NEON)
+  const uint16x8_t high = vdupq_n_u16(0xff80);
+  for (; i + 8 <= len; i += 8) {
+    const uint64x2_t lanes = vreinterpretq_u64_u16(vandq_u16(vld1q_u16(str + i), high));
+    if ((vgetq_lane_u64(lanes, 0) | vgetq_lane_u64(lanes, 1)) != 0) {
+      break;
+    }
+  }
+#endif
+  return i;
+}
+
 }
 
 namespace detail {
@@ -59,7 +124,14 @@ namespace detail {
 size_t modifiedLength(const std::string& str) {
   // Scan for supplementary characters
   size_t j = 0;
+  const auto data = reinterpret_cast<const uint8_t*>(str.data());
   for (size_t i = 0; i < str.size(); ) {
+    const size_t run = asciiRunLength(data + i, str.size() - i);
+    if (run > 0) {
+      i += run;
+      j += run;
+      continue;
+    }
     if (str[i] == 0) {
       i += 1;
       j += 2;
@@ -103,6 +175,16 @@ void utf8ToModifiedUTF8(const uint8_t* utf8, size_t len, uint8_t* modified, size
 {
   size_t j = 0;
   for (size_t i = 0; i < len; ) {
+    const size_t run = asciiRunLength(utf8 + i, len - i);
+    if (run > 0) {
+      if (j + run > modifiedBufLen) {
+        FBJNI_LOGF("output buffer is too short");
+      }
+      memcpy(modified + j, utf8 + i, run);
+      i += run;
+      j += run;
+      continue;
+    }
     if (j >= modifiedBufLen) {
       FBJNI_LOGF("output buffer is too short");
     }
@@ -169,6 +251,14 @@ std::string modifiedUTF8ToUTF8(const uint8_t* modified, size_t len) noexcept {
   std::string utf8(len, 0);
   size_t j = 0;
   for (size_t i = 0; i < len; ) {
+    const size_t run = asciiRunLength(modified + i, len - i);
+    if (run > 0) {
+      memcpy(&utf8[j], modified + i, run);
+      i += run;
+      j += run;
+      continue;
+    }
+
     // surrogate pair: 1101 10xx  xxxx xxxx  1101 11xx  xxxx xxxx
     // encoded pair: 1110 1101  1010 xxxx  10xx xxxx  1110 1101  1011 xxxx  10xx xxxx
 
@@ -219,6 +309,12 @@ size_t utf16toUTF8Length(const uint16_t* utf16String, size_t utf16StringLen) {
   auto utf16StringEnd = utf16String + utf16StringLen;
   auto idx16 = utf16String;
   while (idx16 < utf16StringEnd) {
+    const size_t run = asciiRunLength(idx16, utf16StringEnd - idx16);
+    utf8StringLen += run;
+    idx16 += run;
+    if (idx16 == utf16StringEnd) {
+      break;
+    }
     auto ch = *idx16++;
     if (ch < kUtf8OneByteBoundary) {
       utf8StringLen++;
@@ -238,16 +334,40 @@ size_t utf16toUTF8Length(const uint16_t* utf16String, size_t utf16StringLen) {
   return utf8StringLen;
 }
 
-std::string utf16toUTF8(const uint16_t* utf16String, size_t utf16StringLen) noexcept {
+void utf16toUTF8(const uint16_t* utf16String, size_t utf16StringLen, std::string& out) noexcept {
   if (!utf16String || utf16StringLen <= 0) {
-    return "";
+    out.clear();
+    return;
+  }
+
+  // Most strings are plain ASCII. Those convert one unit to one byte, so they
+  // skip the length pass and reuse out's buffer.
+  auto ascii = asciiRunLength(utf16String, utf16StringLen);
+  while (ascii < utf16StringLen && utf16String[ascii] < kUtf8OneByteBoundary) {
+    ascii++;
+  }
+  if (ascii == utf16StringLen) {
+    out.resize(utf16StringLen);
+    for (size_t k = 0; k < utf16StringLen; k++) {
+      out[k] = static_cast<char>(utf16String[k]);
+    }
+    return;
   }
 
-  std::string utf8String(utf16toUTF8Length(utf16String, utf16StringLen), '\0');
-  auto idx8 = utf8String.begin();
+  out.resize(utf16toUTF8Length(utf16String, utf16StringLen));
+  auto idx8 = out.begin();
   auto idx16 = utf16String;
   auto utf16StringEnd = utf16String + utf16StringLen;
   while (idx16 < utf16StringEnd) {
+    const size_t run = asciiRunLength(idx16, utf16StringEnd - idx16);
+    for (size_t k = 0; k < run; k++) {
+      idx8[k] = static_cast<char>(idx16[k]);
+    }
+    idx8 += run;
+    idx16 += run;
+    if (idx16 == utf16StringEnd) {
+      break;
+    }
     auto ch = *idx16++;
     if (ch < kUtf8OneByteBoundary) {
       *idx8++ = (ch & 0x7F);
@@ -270,7 +390,11 @@ std::string utf16toUTF8(const uint16_t* utf16String, size_t utf16StringLen) noex
       *idx8++ = 0b10000000 | (ch & 0x3F);
     }
   }
+}
 
+std::string utf16toUTF8(const uint16_t* utf16String, size_t utf16StringLen) noexcept {
+  std::string utf8String;
+  utf16toUTF8(utf16String, utf16StringLen, utf8String);
   return utf8String;
 }
 
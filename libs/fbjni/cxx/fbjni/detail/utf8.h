@@ -21,6 +21,8 @@ size_t modifiedLength(const std::string& str);
 size_t modifiedLength(const uint8_t* str, size_t* length);
 std::string modifiedUTF8ToUTF8(const uint8_t* modified, size_t len) noexcept;
 std::string utf16toUTF8(const uint16_t* utf16Bytes, size_t len) noexcept;
+// Like the above, but converts into out, reusing its buffer.
+void utf16toUTF8(const uint16_t* utf16Bytes, size_t len, std::string& out) noexcept;
 
 }
 
@@ -7,11 +7,17 @@
  */
 #include <fbjni/fbjni.h>
 
+#include <cstdlib>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 #include <fbjni/detail/utf8.h>
 
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif
+
 namespace facebook {
 namespace jni {
 
@@ -52,6 +58,35 @@ jint initialize(JavaVM* vm, std::function<void()>&& init_fn) noexcept {
   return JNI_VERSION_1_6;
 }
 
+void preloadInBackground(std::function<void()>&& lookups) {
+  std::thread([](std::function<void()>&& fn) {
+    try {
+      ThreadScope::WithClassLoader(std::move(fn));
+    } catch (const std::exception& e) {
+      FBJNI_LOGE("error preloading: %s", e.what());
+    } catch (...) {
+      FBJNI_LOGE("error preloading");
+    }
+  }, std::move(lookups)).detach();
+}
+
+namespace detail {
+
+bool criticalNativesSupported() {
+#ifdef __ANDROID__
+  static const bool supported = [] {
+    char sdk[PROP_VALUE_MAX] = {};
+    __system_property_get("ro.build.version.sdk", sdk);
+    return atoi(sdk) >= 26;
+  }();
+  return supported;
+#else
+  return false;
+#endif
+}
+
+}
+
 alias_ref<JClass> findClassStatic(const char* name) {
   const auto env = detail::currentOrNull();
   if (!env) {
@@ -78,9 +113,15 @@ local_ref<JClass> findClassLocal(const char* name) {
 // jstring /////////////////////////////////////////////////////////////////////////////////////////
 
 std::string JString::toStdString() const {
+  std::string result;
+  toStdString(result);
+  return result;
+}
+
+void JString::toStdString(std::string& out) const {
   const auto env = Environment::current();
   auto utf16String = JStringUtf16Extractor(env, self());
-  return detail::utf16toUTF8(utf16String.chars(), utf16String.length());
+  detail::utf16toUTF8(utf16String.chars(), utf16String.length(), out);
 }
 
 std::u16string JString::toU16String() const {
@@ -43,7 +43,9 @@ class IosFlagsSaver {
 
 struct BacktraceState {
   size_t skip;
-  vector<InstructionPointer>& stackTrace;
+  InstructionPointer* stackTrace;
+  size_t capacity;
+  size_t size;
 };
 
 _Unwind_Reason_Code unwindCallback(struct _Unwind_Context* context, void* arg) {
@@ -56,22 +58,23 @@ _Unwind_Reason_Code unwindCallback(struct _Unwind_Context* context, void* arg) {
     return _URC_NO_REASON;
   }
 
-  if (state->stackTrace.size() == state->stackTrace.capacity()) {
+  if (state->size == state->capacity) {
     return _URC_END_OF_STACK;
   }
 
-  state->stackTrace.push_back(absoluteProgramCounter);
+  state->stackTrace[state->size++] = absoluteProgramCounter;
 
   return _URC_NO_REASON;
 }
 
-void captureBacktrace(size_t skip, vector<InstructionPointer>& stackTrace) {
+size_t captureBacktrace(size_t skip, InstructionPointer* stackTrace, size_t capacity) {
   // Beware of a bug on some platforms, which makes the trace loop until the
   // buffer is full when it reaches a noexcept function. It seems to be fixed in
   // newer versions of gcc. https://gcc.gnu.org/bugzilla/show_bug.cgi?id=56846
   // TODO(t10738439): Investigate workaround for the stack trace bug
-  BacktraceState state = {skip, stackTrace};
+  BacktraceState state = {skip, stackTrace, capacity, 0};
   _Unwind_Backtrace(unwindCallback, &state);
+  return state.size;
 }
 
 // this is a pointer to a function
@@ -97,8 +100,13 @@ std::string StackTraceElement::buildId() const {
 }
 
 void getStackTrace(vector<InstructionPointer>& stackTrace, size_t skip) {
-  stackTrace.clear();
-  captureBacktrace(skip + 1, stackTrace);
+  stackTrace.resize(stackTrace.capacity());
+  stackTrace.resize(
+      captureBacktrace(skip + 1, stackTrace.data(), stackTrace.size()));
+}
+
+size_t getStackTrace(InstructionPointer* buffer, size_t capacity, size_t skip) {
+  return captureBacktrace(skip + 1, buffer, capacity);
 }
 
 // TODO(t10737622): Improve on-device symbolification
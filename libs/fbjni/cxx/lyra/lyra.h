@@ -109,6 +109,22 @@ void setLibraryIdentifierFunction(LibraryIdentifierFunctionType func);
  */
 void getStackTrace(std::vector<InstructionPointer>& stackTrace, size_t skip = 0);
 
+/**
+ * Populate a caller provided buffer with the current stack trace, without
+ * allocating. This only records program counters, which is cheap enough to do
+ * whenever an exception is thrown. Symbolicating them is left to whoever ends
+ * up printing the trace.
+ *
+ * @param buffer The buffer that will receive the stack trace
+ *
+ * @param capacity The maximum number of frames captured
+ *
+ * @param skip The number of frames to skip before capturing the trace
+ *
+ * @return The number of frames captured
+ */
+size_t getStackTrace(InstructionPointer* buffer, size_t capacity, size_t skip = 0);
+
 /**
  * Creates a vector and populates it with the current stack trace
  *
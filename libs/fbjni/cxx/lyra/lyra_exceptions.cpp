@@ -37,7 +37,8 @@ void logExceptionAndAbort() {
     FBJNI_LOGE("Uncaught exception: %s", toString(ptr).c_str());
     auto trace = getExceptionTraceHolder(ptr);
     if (trace) {
-      logStackTrace(getStackTraceSymbols(trace->stackTrace_));
+      logStackTrace(getStackTraceSymbols(std::vector<InstructionPointer>(
+          trace->stackTrace_, trace->stackTrace_ + trace->stackTraceSize_)));
     }
   }
   if (gTerminateHandler) {
@@ -46,17 +47,12 @@ void logExceptionAndAbort() {
     FBJNI_LOGF("Uncaught exception and no gTerminateHandler set");
   }
 }
-
-const std::vector<InstructionPointer> emptyTrace;
 } // namespace
 
 ExceptionTraceHolder::~ExceptionTraceHolder() {}
 
-detail::ExceptionTraceHolder::ExceptionTraceHolder() {
-  // TODO(cjhopman): This should be done more safely (i.e. use preallocated space, etc.).
-  stackTrace_.reserve(128);
-  getStackTrace(stackTrace_, 1);
-}
+detail::ExceptionTraceHolder::ExceptionTraceHolder()
+    : stackTraceSize_(getStackTrace(stackTrace_, kDefaultLimit, 1)) {}
 
 
 void ensureRegisteredTerminateHandler() {
@@ -64,9 +60,13 @@ void ensureRegisteredTerminateHandler() {
   (void)initializer;
 }
 
-const std::vector<InstructionPointer>& getExceptionTrace(std::exception_ptr ptr) {
+std::vector<InstructionPointer> getExceptionTrace(std::exception_ptr ptr) {
   auto holder = getExceptionTraceHolder(ptr);
-  return holder ? holder->stackTrace_ : emptyTrace;
+  if (!holder) {
+    return {};
+  }
+  return std::vector<InstructionPointer>(
+      holder->stackTrace_, holder->stackTrace_ + holder->stackTraceSize_);
 }
 
 std::string toString(std::exception_ptr ptr) {
@@ -24,7 +24,10 @@ namespace detail {
     ExceptionTraceHolder(const ExceptionTraceHolder&) = delete;
     ExceptionTraceHolder(ExceptionTraceHolder&&) = default;
 
-    std::vector<InstructionPointer> stackTrace_;
+    // Only the raw program counters, so that throwing doesn't allocate or
+    // symbolicate anything. See getExceptionTrace.
+    InstructionPointer stackTrace_[kDefaultLimit];
+    size_t stackTraceSize_;
   };
 
   template <typename E, bool hasTraceHolder>
@@ -38,9 +41,10 @@ namespace detail {
 }
 
 /**
- * Retrieves the stack trace of an exception
+ * Retrieves the stack trace of an exception. It still needs to be passed to
+ * getStackTraceSymbols before it can be printed.
  */
-const std::vector<InstructionPointer>& getExceptionTrace(std::exception_ptr ptr);
+std::vector<InstructionPointer> getExceptionTrace(std::exception_ptr ptr);
 
 /**
  * Throw an exception and store the stack trace. This works like
@@ -11,9 +11,15 @@ import type Logger from './fb-stubs/Logger.js';
 
 import plugins from './plugins/index.js';
 import {ReactiveSocket, PartialResponder} from 'rsocket-core';
+import {
+  COMPRESSION_DICTIONARY,
+  isDeflated,
+} from './utils/compressionDictionary.js';
+import {expandColumnar} from './utils/columnar.js';
 
 const EventEmitter = (require('events'): any);
 const invariant = require('invariant');
+const zlib = require('zlib');
 
 type Plugins = Array<string>;
 
@@ -45,11 +51,14 @@ export default class Client extends EventEmitter {
 
     this.broadcastCallbacks = new Map();
     this.requestCallbacks = new Map();
+    this.fragments = new Map();
+    this.pendingInits = [];
+    this.supportsInitMany = true;
 
     const client = this;
     this.responder = {
-      fireAndForget: (payload: {data: string}) => {
-        client.onMessage(payload.data);
+      fireAndForget: (payload: {data: Buffer | string, metadata: ?Buffer}) => {
+        client.onMessage(payload.data, payload.metadata);
       },
     };
 
@@ -79,12 +88,22 @@ export default class Client extends EventEmitter {
 
   broadcastCallbacks: Map<?string, Map<string, Set<Function>>>;
 
+  // Plugins to init, sent together before the next message goes out.
+  pendingInits: Array<string>;
+  // Cleared once the device turns down initMany.
+  supportsInitMany: boolean;
+
+  // Parts of fragmented messages received so far, by fragment id.
+  fragments: Map<number, {parts: Array<Buffer>, envelope: ?string}>;
+
   requestCallbacks: Map<
     number,
     {|
       resolve: (data: any) => void,
       reject: (err: Error) => void,
       metadata: RequestMetadata,
+      onChunk: ?(chunk: Object) => void,
+      chunks: Array<Object>,
     |},
   >;
 
@@ -117,7 +136,21 @@ export default class Client extends EventEmitter {
     this.emit('plugins-change');
   }
 
-  onMessage(msg: string) {
+  onMessage(data: Buffer | string, metadata: ?Buffer) {
+    // Binary frames carry the message in the metadata and raw bytes as data.
+    const isBinary = metadata != null && metadata.length > 0;
+    let msg = isBinary ? metadata : data;
+    if (Buffer.isBuffer(msg)) {
+      if (isDeflated(msg)) {
+        try {
+          msg = zlib.inflateSync(msg, {dictionary: COMPRESSION_DICTIONARY});
+        } catch (err) {
+          console.error(`Invalid compressed frame: ${err}`, 'clientMessage');
+          return;
+        }
+      }
+      msg = msg.toString('utf8');
+    }
     if (typeof msg !== 'string') {
       return;
     }
@@ -129,6 +162,55 @@ export default class Client extends EventEmitter {
       console.error(`Invalid JSON: ${msg}`, 'clientMessage');
       return;
     }
+    if (msg.includes('"__columns"')) {
+      rawData = expandColumnar(rawData);
+    }
+
+    if (isBinary && rawData.method === 'fragment') {
+      this.onFragment(rawData, data);
+      return;
+    }
+
+    this.handleMessageData(rawData, isBinary ? data : null);
+  }
+
+  // Devices split large messages into fragments so that they can send more
+  // urgent messages in between. The fragments of a message arrive in order.
+  onFragment(
+    fragment: {id: number, index: number, count: number, envelope?: string},
+    data: Buffer | string,
+  ) {
+    const {id, index, count, envelope} = fragment;
+    if (index === 0) {
+      this.fragments.set(id, {parts: [], envelope});
+    }
+    const message = this.fragments.get(id);
+    if (message == null) {
+      // The first fragment went to an earlier connection.
+      return;
+    }
+    message.parts.push(Buffer.isBuffer(data) ? data : Buffer.from(data));
+    if (message.parts.length < count) {
+      return;
+    }
+    this.fragments.delete(id);
+    const whole = Buffer.concat(message.parts);
+    if (message.envelope != null) {
+      this.onMessage(whole, Buffer.from(message.envelope));
+    } else {
+      this.onMessage(whole, null);
+    }
+  }
+
+  handleMessageData(rawData: Object, binaryData?: ?(Buffer | string)) {
+    if (rawData.method === 'batch' && Array.isArray(rawData.messages)) {
+      // Devices with batching enabled coalesce bursts of messages into a
+      // single frame.
+      for (const message of rawData.messages) {
+        this.handleMessageData(message);
+      }
+      return;
+    }
 
     const data: {|
       id?: number,
@@ -136,6 +218,8 @@ export default class Client extends EventEmitter {
       params?: Object,
       success?: Object,
       error?: Object,
+      seq?: number,
+      chunk?: Object,
     |} = rawData;
 
     console.debug(data, 'message:receive');
@@ -165,7 +249,7 @@ export default class Client extends EventEmitter {
         const methodCallbacks: ?Set<Function> = apiCallbacks.get(params.method);
         if (methodCallbacks) {
           for (const callback of methodCallbacks) {
-            callback(params.params);
+            callback(params.params, binaryData);
           }
         }
       }
@@ -176,7 +260,21 @@ export default class Client extends EventEmitter {
     if (!callbacks) {
       return;
     }
+
+    if (data.chunk != null) {
+      // Part of a streamed response, more messages with this id follow.
+      if (callbacks.onChunk) {
+        callbacks.onChunk(data.chunk);
+      } else {
+        callbacks.chunks.push(data.chunk);
+      }
+      return;
+    }
     this.requestCallbacks.delete(id);
+
+    if (data.success && callbacks.chunks.length > 0) {
+      data.success = {...data.success, chunks: callbacks.chunks};
+    }
     this.finishTimingRequestResponse(callbacks.metadata);
 
     if (data.success) {
@@ -224,7 +322,50 @@ export default class Client extends EventEmitter {
     methodCallbacks.delete(callback);
   }
 
-  rawCall(method: string, params?: Object): Promise<Object> {
+  // Plugins inited in the same tick are sent to the device in one
+  // initMany, which connects them in one go. The inits go out before any
+  // other message, so the plugins' own calls still find them inited.
+  initPlugin(plugin: string) {
+    this.pendingInits.push(plugin);
+    if (this.pendingInits.length === 1) {
+      setImmediate(() => this.flushInits());
+    }
+  }
+
+  flushInits() {
+    const plugins = this.pendingInits;
+    if (plugins.length === 0) {
+      return;
+    }
+    this.pendingInits = [];
+    if (plugins.length === 1 || !this.supportsInitMany) {
+      plugins.forEach(plugin => this.rawSend('init', {plugin}));
+      return;
+    }
+    this.rawCall('initMany', {plugins}).catch(() => {
+      // Older devices don't know initMany.
+      this.supportsInitMany = false;
+      plugins.forEach(plugin => this.rawSend('init', {plugin}));
+    });
+  }
+
+  deinitPlugin(plugin: string) {
+    const pending = this.pendingInits.indexOf(plugin);
+    if (pending >= 0) {
+      this.pendingInits.splice(pending, 1);
+      return;
+    }
+    this.rawSend('deinit', {plugin});
+  }
+
+  rawCall(
+    method: string,
+    params?: Object,
+    onChunk?: (chunk: Object) => void,
+  ): Promise<Object> {
+    if (method !== 'initMany') {
+      this.flushInits();
+    }
     return new Promise((resolve, reject) => {
       const id = this.messageIdCounter++;
       const metadata: RequestMetadata = {
@@ -232,20 +373,45 @@ export default class Client extends EventEmitter {
         id,
         params,
       };
-      this.requestCallbacks.set(id, {reject, resolve, metadata});
+      this.requestCallbacks.set(id, {
+        reject,
+        resolve,
+        metadata,
+        onChunk,
+        chunks: [],
+      });
 
       const data = {
         id,
         method,
         params,
+        chunked: true,
+        binary: true,
+        compression: 'deflate',
+        fragments: true,
+        columnar: true,
       };
 
       console.debug(data, 'message:call');
       this.startTimingRequestResponse({method, id, params});
-      this.connection.fireAndForget({data: JSON.stringify(data)});
+      this.connection.fireAndForget({data: Buffer.from(JSON.stringify(data))});
     });
   }
 
+  // Tells the device to stop working on all outstanding calls to the given
+  // plugin, e.g. because the user navigated away from it. The pending
+  // promises are rejected.
+  cancelCalls(api: string) {
+    for (const [id, callbacks] of this.requestCallbacks) {
+      const {params} = callbacks.metadata;
+      if (params && params.api === api) {
+        this.requestCallbacks.delete(id);
+        this.rawSend('cancel', {id});
+        callbacks.reject({message: 'Cancelled'});
+      }
+    }
+  }
+
   startTimingRequestResponse(data: RequestMetadata) {
     performance.mark(this.getPerformanceMark(data));
   }
@@ -269,19 +435,65 @@ export default class Client extends EventEmitter {
   }
 
   rawSend(method: string, params?: Object): void {
+    if (method !== 'init') {
+      this.flushInits();
+    }
     const data = {
       method,
       params,
     };
     console.debug(data, 'message:send');
-    this.connection.fireAndForget({data: JSON.stringify(data)});
+    this.connection.fireAndForget({data: Buffer.from(JSON.stringify(data))});
   }
 
   call(api: string, method: string, params?: Object): Promise<Object> {
     return this.rawCall('execute', {api, method, params});
   }
 
+  // Like call, but hands each chunk of a streamed response to onChunk as it
+  // arrives instead of collecting them into the result.
+  callStream(
+    api: string,
+    method: string,
+    params: ?Object,
+    onChunk: (chunk: Object) => void,
+  ): Promise<Object> {
+    return this.rawCall('execute', {api, method, params}, onChunk);
+  }
+
+  // Calls a method registered with receivePaged, handing each page of items
+  // to onPage as it arrives and fetching the next one until there are none
+  // left. Resolves once the last page has been handed over.
+  async callPaged(
+    api: string,
+    method: string,
+    params: ?Object,
+    onPage: (items: Array<any>) => void,
+    pageSize: number = 100,
+  ): Promise<void> {
+    let page = await this.call(api, method, {...params, pageSize});
+    onPage(page.items);
+    while (page.hasMore) {
+      page = await this.call(api, 'fetchNextPage', {
+        cursor: page.cursor,
+        pageSize,
+      });
+      onPage(page.items);
+    }
+  }
+
   send(api: string, method: string, params?: Object): void {
     return this.rawSend('execute', {api, method, params});
   }
+
+  // Limits how often a plugin method may send to the desktop, the device
+  // drops the rest. Without rate and sampleEvery the limits are lifted.
+  // Resolves to the plugin's policies along with how much each dropped.
+  setSendPolicy(
+    plugin: string,
+    method: string,
+    policy: {rate?: number, burst?: number, sampleEvery?: number},
+  ): Promise<Object> {
+    return this.rawCall('__sendPolicy', {plugin, method, ...policy});
+  }
 }
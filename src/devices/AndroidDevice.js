@@ -79,12 +79,19 @@ export default class AndroidDevice extends BaseDevice {
   }
 
   reverse(): Promise<void> {
+    // Apps configured with a local socket connect through it on emulators
+    // too, as it skips the emulator's TCP stack.
+    const local = this.adb.reverse(
+      this.serial,
+      'localabstract:sonar',
+      'tcp:8087',
+    );
     if (this.deviceType === 'physical') {
-      return this.adb
-        .reverse(this.serial, 'tcp:8088', 'tcp:8088')
+      return local
+        .then(_ => this.adb.reverse(this.serial, 'tcp:8088', 'tcp:8088'))
         .then(_ => this.adb.reverse(this.serial, 'tcp:8089', 'tcp:8089'));
     } else {
-      return Promise.resolve();
+      return local;
     }
   }
 
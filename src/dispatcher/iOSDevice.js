@@ -24,12 +24,18 @@ type iOSSimulatorDevice = {|
 
 type IOSDeviceMap = {[id: string]: Array<iOSSimulatorDevice>};
 
-// start port forwarding server for real device connections
-const portForwarder: ChildProcess = exec(
-  'PortForwardingMacApp.app/Contents/MacOS/PortForwardingMacApp -portForward=8088 -multiplexChannelPort=8078',
+// start port forwarding servers for real device connections, one for each of
+// the secure and insecure ports, matching SonarClient's USB transport
+const portForwarders: Array<ChildProcess> = [
+  [8088, 8078],
+  [8089, 8079],
+].map(([port, multiplexChannelPort]) =>
+  child_process.exec(
+    `PortForwardingMacApp.app/Contents/MacOS/PortForwardingMacApp -portForward=${port} -multiplexChannelPort=${multiplexChannelPort}`,
+  ),
 );
 window.addEventListener('beforeunload', () => {
-  portForwarder.kill();
+  portForwarders.forEach(portForwarder => portForwarder.kill());
 });
 
 function querySimulatorDevices(store: Store): Promise<IOSDeviceMap> {
@@ -19,6 +19,12 @@ const invariant = require('invariant');
 export type PluginClient = {|
   send: (method: string, params?: Object) => void,
   call: (method: string, params?: Object) => Promise<any>,
+  callPaged: (
+    method: string,
+    params: ?Object,
+    onPage: (items: Array<any>) => void,
+    pageSize?: number,
+  ) => Promise<void>,
   subscribe: (method: string, callback: (params: any) => void) => void,
 |};
 
@@ -110,6 +116,8 @@ export class SonarPlugin<S = *, A = *, P = *> extends SonarBasePlugin<S, A, P> {
     this.realClient = props.target;
     this.client = {
       call: (method, params) => this.realClient.call(id, method, params),
+      callPaged: (method, params, onPage, pageSize) =>
+        this.realClient.callPaged(id, method, params, onPage, pageSize),
       send: (method, params) => this.realClient.send(id, method, params),
       subscribe: (method, callback) => {
         this.subscriptions.push({
@@ -159,12 +167,12 @@ export class SonarPlugin<S = *, A = *, P = *> extends SonarBasePlugin<S, A, P> {
     // run plugin teardown
     this.teardown();
     if (this.realClient.connected) {
-      this.realClient.rawSend('deinit', {plugin: this.constructor.id});
+      this.realClient.deinitPlugin(this.constructor.id);
     }
   }
 
   _init() {
-    this.realClient.rawSend('init', {plugin: this.constructor.id});
+    this.realClient.initPlugin(this.constructor.id);
     this.init();
   }
 }
@@ -0,0 +1,204 @@
+/**
+ * Copyright 2018-present Facebook.
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ * @format
+ */
+
+import {
+  ManagedTable,
+  FlexColumn,
+  FlexRow,
+  Panel,
+  Text,
+  Toolbar,
+  Button,
+  SonarPlugin,
+  styled,
+  colors,
+} from 'sonar';
+
+// How many summaries are kept, one per second by default.
+const MAX_SUMMARIES = 300;
+
+// Sent once per summary interval with the frames since the previous one.
+type FramesMessage = {|
+  interval: number,
+  frames: number,
+  // Refreshes that frames took longer than one refresh too many.
+  missed: number,
+  longestUs: number,
+  refreshPeriodUs: number,
+  // CPU time of Sonar's own threads, what the inspector costs the app.
+  sonarCpuUs: number,
+  // Upper bounds of the buckets, the last bucket holds everything longer.
+  // Once per connection.
+  bucketsMs?: Array<number>,
+  buckets: Array<number>,
+|};
+
+type Summary = {|
+  time: number,
+  interval: number,
+  frames: number,
+  missed: number,
+  longestUs: number,
+  refreshPeriodUs: number,
+  sonarCpuUs: number,
+|};
+
+type State = {|
+  bucketsMs: Array<number>,
+  // Frames per bucket since the plugin was opened or cleared.
+  buckets: Array<number>,
+  summaries: Array<Summary>,
+|};
+
+const COLUMNS = {
+  time: {value: 'Time'},
+  fps: {value: 'FPS'},
+  frames: {value: 'Frames'},
+  missed: {value: 'Missed refreshes'},
+  longest: {value: 'Longest (ms)'},
+  sonar: {value: 'Sonar CPU'},
+};
+
+const COLUMN_SIZES = {
+  time: '15%',
+  fps: '12%',
+  frames: '12%',
+  missed: '18%',
+  longest: '15%',
+  sonar: 'flex',
+};
+
+const Bar = styled('div')(({fraction, janky}) => ({
+  backgroundColor: janky ? colors.red : colors.green,
+  height: 12,
+  width: `${Math.round(fraction * 100)}%`,
+  minWidth: fraction > 0 ? 1 : 0,
+}));
+
+const BarLabel = styled(Text)({
+  width: 90,
+  flexShrink: 0,
+});
+
+function bucketLabel(bucketsMs: Array<number>, index: number): string {
+  return index < bucketsMs.length
+    ? `≤ ${bucketsMs[index]} ms`
+    : `> ${bucketsMs[bucketsMs.length - 1]} ms`;
+}
+
+// CPU time as a share of one core over the interval.
+function cpuShare(summary: Summary): string {
+  const share = summary.sonarCpuUs / Math.max(summary.interval * 1000, 1);
+  return `${(share * 100).toFixed(1)}% (${(summary.sonarCpuUs / 1000).toFixed(
+    1,
+  )} ms)`;
+}
+
+export default class extends SonarPlugin<State> {
+  static title = 'Frames';
+  static id = 'Frames';
+  static icon = 'apps';
+
+  state = {
+    bucketsMs: [],
+    buckets: [],
+    summaries: [],
+  };
+
+  reducers = {
+    Summary(state: State, {message}: {message: FramesMessage}) {
+      const buckets = message.buckets.map(
+        (count, i) => (state.buckets[i] || 0) + count,
+      );
+      const summary = {
+        time: Date.now(),
+        interval: message.interval,
+        frames: message.frames,
+        missed: message.missed,
+        longestUs: message.longestUs,
+        refreshPeriodUs: message.refreshPeriodUs,
+        sonarCpuUs: message.sonarCpuUs,
+      };
+      const summaries = state.summaries.concat([summary]);
+      return {
+        bucketsMs: message.bucketsMs || state.bucketsMs,
+        buckets,
+        summaries: summaries.slice(
+          Math.max(summaries.length - MAX_SUMMARIES, 0),
+        ),
+      };
+    },
+    Clear(state: State) {
+      return {buckets: [], summaries: []};
+    },
+  };
+
+  init() {
+    this.client.subscribe('frames', (message: FramesMessage) => {
+      this.dispatchAction({message, type: 'Summary'});
+    });
+  }
+
+  clear = () => {
+    this.dispatchAction({type: 'Clear'});
+  };
+
+  renderHistogram() {
+    const {bucketsMs, buckets, summaries} = this.state;
+    const total = buckets.reduce((sum, count) => sum + count, 0);
+    const last = summaries[summaries.length - 1];
+    const refreshMs = last ? last.refreshPeriodUs / 1000 : 16.7;
+    return (
+      <Panel heading="Frame durations" floating={false} fill={false}>
+        {buckets.map((count, i) => (
+          <FlexRow key={i}>
+            <BarLabel>{bucketLabel(bucketsMs, i)}</BarLabel>
+            <Bar
+              fraction={total > 0 ? count / total : 0}
+              janky={i > 0 && bucketsMs[i - 1] >= refreshMs * 1.5}
+            />
+            <Text>&nbsp;{count}</Text>
+          </FlexRow>
+        ))}
+      </Panel>
+    );
+  }
+
+  render() {
+    const {summaries} = this.state;
+    return (
+      <FlexColumn fill={true}>
+        <Toolbar>
+          <Button onClick={this.clear}>Clear</Button>
+        </Toolbar>
+        {this.renderHistogram()}
+        <ManagedTable
+          columnSizes={COLUMN_SIZES}
+          columns={COLUMNS}
+          rowLineHeight={26}
+          stickyBottom={true}
+          rows={summaries.map(summary => ({
+            key: String(summary.time),
+            columns: {
+              time: {value: new Date(summary.time).toLocaleTimeString()},
+              fps: {
+                value: (
+                  (summary.frames * 1000) /
+                  Math.max(summary.interval, 1)
+                ).toFixed(1),
+              },
+              frames: {value: summary.frames},
+              missed: {value: summary.missed},
+              longest: {value: (summary.longestUs / 1000).toFixed(1)},
+              sonar: {value: cpuShare(summary)},
+            },
+          }))}
+        />
+      </FlexColumn>
+    );
+  }
+}
@@ -5,7 +5,12 @@
  * @format
  */
 
-import type {ElementID, Element, ElementSearchResultSet} from 'sonar';
+import type {
+  ElementID,
+  Element,
+  ElementData,
+  ElementSearchResultSet,
+} from 'sonar';
 import {
   colors,
   Glyph,
@@ -93,6 +98,12 @@ type GetNodesOptions = {|
   forAccessibilityEvent?: boolean,
 |};
 
+type DataEdit = {|
+  id: ?ElementID,
+  path: Array<string>,
+  value: any,
+|};
+
 type TrackArgs = {|
   type: TrackType,
   eventName: string,
@@ -169,6 +180,58 @@ class LayoutSearchInput extends Component<
   }
 }
 
+// Devices asked for compactValues may send geometry packed, as
+// {__type__: 'rect', __mutable__, value: [x, y, width, height]} and so on,
+// with each number in hundredths of a point. They're expanded back into the
+// objects the sidebar shows and edits.
+const PACKED_FIELDS = {
+  rect: [
+    ['origin', 'x'],
+    ['origin', 'y'],
+    ['size', 'width'],
+    ['size', 'height'],
+  ],
+  size: [['width'], ['height']],
+  point: [['x'], ['y']],
+  insets: [['top'], ['left'], ['bottom'], ['right']],
+};
+
+function expandPackedValues(value: any): any {
+  if (value == null || typeof value !== 'object' || Array.isArray(value)) {
+    return value;
+  }
+  const fields = PACKED_FIELDS[value.__type__];
+  if (fields && Array.isArray(value.value)) {
+    const expanded = {};
+    fields.forEach(([first, second], i) => {
+      const number = value.value[i] / 100;
+      const leaf = value.__mutable__
+        ? {__type__: 'auto', __mutable__: true, value: number}
+        : number;
+      if (second == null) {
+        expanded[first] = leaf;
+      } else {
+        expanded[first] = {...expanded[first], [second]: leaf};
+      }
+    });
+    return expanded;
+  }
+  if (value.__type__ != null) {
+    return value;
+  }
+  const expanded = {};
+  for (const key in value) {
+    expanded[key] = expandPackedValues(value[key]);
+  }
+  return expanded;
+}
+
+function expandElementData(element: Element): Element {
+  return element.data
+    ? {...element, data: expandPackedValues(element.data)}
+    : element;
+}
+
 export default class Layout extends SonarPlugin<InspectorState> {
   static title = 'Layout';
   static id = 'Inspector';
@@ -597,7 +660,8 @@ export default class Layout extends SonarPlugin<InspectorState> {
     });
 
     performance.mark('LayoutInspectorInitialize');
-    this.client.call('getRoot').then((element: Element) => {
+    this.client.call('getRoot', {compactValues: true}).then((root: Element) => {
+      const element = expandElementData(root);
       this.dispatchAction({elements: [element], type: 'UpdateElements'});
       this.dispatchAction({root: element.id, type: 'SetRoot'});
       this.performInitialExpand(element, false).then(() => {
@@ -685,8 +749,8 @@ export default class Layout extends SonarPlugin<InspectorState> {
     options: GetNodesOptions,
   ): Promise<Array<Element>> {
     const {force, ax, forAccessibilityEvent} = options;
+    const elems = ax ? this.state.AXelements : this.state.elements;
     if (!force) {
-      const elems = ax ? this.state.AXelements : this.state.elements;
       // always force undefined elements and elements that need to be expanded
       // over in the main tree (e.g. fragments)
       ids = ids.filter(id => {
@@ -704,22 +768,65 @@ export default class Layout extends SonarPlugin<InspectorState> {
         ? 'accessibility:getNodes'
         : 'LayoutInspectorGetNodes';
 
+      // Clients which hash their nodes leave out the sections of a node that
+      // haven't changed since we fetched it, so send what we already have.
+      const hashes = {};
+      for (const id of ids) {
+        if (elems[id] && elems[id].hashes) {
+          hashes[id] = elems[id].hashes;
+        }
+      }
+
       performance.mark(mark);
       return this.client
         .call(ax ? 'getAXNodes' : 'getNodes', {
           ids,
           forAccessibilityEvent,
           selected: this.state.AXselected,
+          hashes,
+          structureOnly: true,
+          compactValues: true,
         })
-        .then(({elements}: GetNodesResult) => {
+        .then((result: GetNodesResult) => {
           this.props.logger.trackTimeSince(mark, eventName);
-          return Promise.resolve(elements);
+          const elements = result.elements.map(expandElementData);
+          this.getOmittedData(elements, ax);
+          return Promise.resolve(
+            elements.map(
+              element =>
+                elems[element.id]
+                  ? {...elems[element.id], ...element}
+                  : element,
+            ),
+          );
         });
     } else {
       return Promise.resolve([]);
     }
   }
 
+  // Clients that support it leave the data of nodes out of getNodes, as it's
+  // only shown for the selected one, which is then fetched with getNodeData.
+  getOmittedData(elements: Array<Element>, ax: boolean) {
+    const selected = ax ? this.state.AXselected : this.state.selected;
+    const element = elements.find(element => element.id === selected);
+    if (
+      !element ||
+      element.data ||
+      (element.hashes && element.hashes.data)
+    ) {
+      return;
+    }
+    this.client
+      .call('getNodeData', {id: element.id, compactValues: true})
+      .then(({id, data}: {id: ElementID, data: ElementData}) => {
+        this.dispatchAction({
+          elements: [{id, data: expandPackedValues(data)}],
+          type: ax ? 'UpdateAXElements' : 'UpdateElements',
+        });
+      });
+  }
+
   isExpanded(key: ElementID, ax: boolean): boolean {
     return ax
       ? this.state.AXelements[key].expanded
@@ -924,19 +1031,32 @@ export default class Layout extends SonarPlugin<InspectorState> {
     ];
   }
 
+  // Edits made while the previous batch is on its way, such as while a value
+  // is dragged, are sent together with setDataMany, the latest value per path
+  // winning. Clients that don't have setDataMany get a setData per edit.
+  pendingEdits: Array<DataEdit> = [];
+  pendingEditsAX: boolean = false;
+  editsInFlight: boolean = false;
+  supportsSetDataMany: boolean = true;
+
   onDataValueChanged = (path: Array<string>, value: any) => {
     const ax = this.state.inAXMode;
     const id = ax ? this.state.AXselected : this.state.selected;
-    this.client
-      .call('setData', {id, path, value, ax})
-      .then((element: Element) => {
-        if (ax) {
-          this.dispatchAction({
-            elements: [element],
-            type: 'UpdateAXElements',
-          });
-        }
-      });
+    if (!this.supportsSetDataMany) {
+      this.setData({id, path, value}, ax);
+    } else {
+      if (this.pendingEdits.length > 0 && this.pendingEditsAX !== ax) {
+        this.flushEdits();
+      }
+      const key = path.join('.');
+      this.pendingEdits = this.pendingEdits
+        .filter(edit => edit.id !== id || edit.path.join('.') !== key)
+        .concat([{id, path, value}]);
+      this.pendingEditsAX = ax;
+      if (!this.editsInFlight) {
+        this.flushEdits();
+      }
+    }
 
     const eventName = ax
       ? 'accessibility:dataValueChanged'
@@ -948,6 +1068,48 @@ export default class Layout extends SonarPlugin<InspectorState> {
     });
   };
 
+  setData(edit: DataEdit, ax: boolean) {
+    this.client
+      .call('setData', {...edit, ax})
+      .then((element: Element) => {
+        if (ax) {
+          this.dispatchAction({
+            elements: [element],
+            type: 'UpdateAXElements',
+          });
+        }
+      });
+  }
+
+  flushEdits() {
+    const edits = this.pendingEdits;
+    const ax = this.pendingEditsAX;
+    this.pendingEdits = [];
+    if (edits.length === 0) {
+      this.editsInFlight = false;
+      return;
+    }
+    this.editsInFlight = true;
+    this.client
+      .call('setDataMany', {edits, ax})
+      .then(({elements}: {elements: Array<Element>}) => {
+        this.dispatchAction({
+          elements,
+          type: ax ? 'UpdateAXElements' : 'UpdateElements',
+        });
+        this.flushEdits();
+      })
+      .catch(() => {
+        // Clients from before setDataMany.
+        this.supportsSetDataMany = false;
+        this.editsInFlight = false;
+        edits
+          .concat(this.pendingEdits)
+          .forEach(edit => this.setData(edit, ax));
+        this.pendingEdits = [];
+      });
+  }
+
   // returns object with all sidebar elements that should show more information
   // on hover (needs to be kept up-to-date if names of properties change)
   getAccessibilityTooltips() {
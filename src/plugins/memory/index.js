@@ -0,0 +1,231 @@
+/**
+ * Copyright 2018-present Facebook.
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ * @format
+ */
+
+import {
+  ManagedTable,
+  FlexColumn,
+  Toolbar,
+  Spacer,
+  Button,
+  ButtonGroup,
+  Text,
+  SonarPlugin,
+} from 'sonar';
+
+// How many samples are kept per field.
+const MAX_SAMPLES = 600;
+
+// Faster rates are batched more, so that roughly one message a second is
+// sent.
+const RATES = [
+  {label: '100ms', sampleIntervalMs: 100, batchSize: 10},
+  {label: '250ms', sampleIntervalMs: 250, batchSize: 4},
+  {label: '1s', sampleIntervalMs: 1000, batchSize: 1},
+  {label: '5s', sampleIntervalMs: 5000, batchSize: 1},
+];
+
+const LABELS = {
+  rss: 'Resident set',
+  pss: 'PSS',
+  footprint: 'Footprint',
+  nativeHeap: 'Native heap',
+  javaHeap: 'Java heap',
+};
+
+// Each value is the difference to the previous sample, in kB, the first
+// sample of a connection being the difference to 0. Fields only come with
+// the first batch of a connection.
+type MemoryMessage = {|
+  fields?: Array<string>,
+  samples: Array<number>,
+|};
+
+type Field = {|
+  name: string,
+  current: number,
+  min: number,
+  max: number,
+  history: Array<number>,
+|};
+
+type State = {|
+  fields: Array<Field>,
+  sampleIntervalMs: number,
+|};
+
+const COLUMNS = {
+  name: {value: 'Name'},
+  current: {value: 'Current'},
+  min: {value: 'Min'},
+  max: {value: 'Max'},
+  history: {value: 'History'},
+};
+
+const COLUMN_SIZES = {
+  name: '20%',
+  current: '15%',
+  min: '15%',
+  max: '15%',
+  history: 'flex',
+};
+
+function formatKb(kb: number): string {
+  return kb >= 1024 ? `${(kb / 1024).toFixed(1)} MB` : `${kb} kB`;
+}
+
+function Sparkline(props: {|values: Array<number>, min: number, max: number|}) {
+  const {values, min, max} = props;
+  const width = 200;
+  const height = 20;
+  const range = Math.max(max - min, 1);
+  const step = width / Math.max(values.length - 1, 1);
+  const points = values
+    .map(
+      (value, i) =>
+        `${(i * step).toFixed(1)},${(
+          height -
+          ((value - min) / range) * height
+        ).toFixed(1)}`,
+    )
+    .join(' ');
+  return (
+    <svg width={width} height={height}>
+      <polyline points={points} fill="none" stroke="#0084ff" />
+    </svg>
+  );
+}
+
+export default class extends SonarPlugin<State> {
+  static title = 'Memory';
+  static id = 'Memory';
+  static icon = 'internet';
+
+  state = {
+    fields: [],
+    sampleIntervalMs: 250,
+  };
+
+  reducers = {
+    Samples(state: State, {message}: {message: MemoryMessage}) {
+      let fields = message.fields
+        ? message.fields.map(name => ({
+            name,
+            current: 0,
+            min: Infinity,
+            max: -Infinity,
+            history: [],
+          }))
+        : state.fields.map(field => ({
+            ...field,
+            history: field.history.slice(),
+          }));
+      if (fields.length === 0) {
+        return state;
+      }
+      const stride = fields.length + 1;
+      // Each sample starts with the milliseconds since the previous one.
+      for (let i = 0; i + stride <= message.samples.length; i += stride) {
+        fields.forEach((field, j) => {
+          field.current += message.samples[i + j + 1];
+          field.min = Math.min(field.min, field.current);
+          field.max = Math.max(field.max, field.current);
+          field.history.push(field.current);
+        });
+      }
+      fields = fields.map(field => ({
+        ...field,
+        history: field.history.slice(
+          Math.max(field.history.length - MAX_SAMPLES, 0),
+        ),
+      }));
+      return {fields};
+    },
+    Clear(state: State) {
+      return {
+        fields: state.fields.map(field => ({
+          ...field,
+          min: field.current,
+          max: field.current,
+          history: [field.current],
+        })),
+      };
+    },
+    SetRate(state: State, {sampleIntervalMs}: {sampleIntervalMs: number}) {
+      return {sampleIntervalMs};
+    },
+  };
+
+  init() {
+    this.client.subscribe('memory', (message: MemoryMessage) => {
+      this.dispatchAction({message, type: 'Samples'});
+    });
+    this.setRate(
+      RATES.find(rate => rate.sampleIntervalMs === this.state.sampleIntervalMs),
+    );
+  }
+
+  setRate(rate: {sampleIntervalMs: number, batchSize: number}) {
+    this.client
+      .call('configure', {
+        sampleIntervalMs: rate.sampleIntervalMs,
+        batchSize: rate.batchSize,
+      })
+      .then(({sampleIntervalMs}) =>
+        this.dispatchAction({sampleIntervalMs, type: 'SetRate'}),
+      );
+  }
+
+  clear = () => {
+    this.dispatchAction({type: 'Clear'});
+  };
+
+  render() {
+    const {fields, sampleIntervalMs} = this.state;
+    return (
+      <FlexColumn fill={true}>
+        <Toolbar>
+          <Text>Sample every&nbsp;</Text>
+          <ButtonGroup>
+            {RATES.map(rate => (
+              <Button
+                key={rate.label}
+                selected={rate.sampleIntervalMs === sampleIntervalMs}
+                onClick={() => this.setRate(rate)}>
+                {rate.label}
+              </Button>
+            ))}
+          </ButtonGroup>
+          <Spacer />
+          <Button onClick={this.clear}>Clear</Button>
+        </Toolbar>
+        <ManagedTable
+          columnSizes={COLUMN_SIZES}
+          columns={COLUMNS}
+          rowLineHeight={26}
+          rows={fields.map(field => ({
+            key: field.name,
+            columns: {
+              name: {value: LABELS[field.name] || field.name},
+              current: {value: formatKb(field.current)},
+              min: {value: formatKb(field.min)},
+              max: {value: formatKb(field.max)},
+              history: {
+                value: (
+                  <Sparkline
+                    values={field.history}
+                    min={field.min}
+                    max={field.max}
+                  />
+                ),
+              },
+            },
+          }))}
+        />
+      </FlexColumn>
+    );
+  }
+}
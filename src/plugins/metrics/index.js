@@ -0,0 +1,167 @@
+/**
+ * Copyright 2018-present Facebook.
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ * @format
+ */
+
+import {ManagedTable, FlexColumn} from 'sonar';
+import {SonarPlugin} from 'sonar';
+
+type Names = {|
+  offset: number,
+  names: Array<string>,
+|};
+
+// Sent once per flush interval with what changed since the previous one.
+// Metrics refer to their names by index, names come along once per
+// connection.
+type MetricsMessage = {|
+  interval: number,
+  counterNames?: Names,
+  gaugeNames?: Names,
+  histogramNames?: Names,
+  // Flat [index, delta, ...] list.
+  counters: Array<number>,
+  // Flat [index, value, ...] list.
+  gauges: Array<number>,
+  // [index, count, sum, min, max, [bucket, count, ...]], where bucket i
+  // holds values below 2^i.
+  histograms: Array<Array<any>>,
+|};
+
+type Metric = {|
+  kind: 'counter' | 'gauge' | 'histogram',
+  value: string,
+  detail: string,
+|};
+
+type State = {|
+  counterNames: Array<string>,
+  gaugeNames: Array<string>,
+  histogramNames: Array<string>,
+  totals: {[name: string]: number},
+  metrics: {[name: string]: Metric},
+|};
+
+const COLUMNS = {
+  name: {value: 'Name'},
+  kind: {value: 'Kind'},
+  value: {value: 'Value'},
+  detail: {value: 'Last interval'},
+};
+
+const COLUMN_SIZES = {
+  name: '35%',
+  kind: '10%',
+  value: '20%',
+  detail: 'flex',
+};
+
+function withNames(known: Array<string>, update: ?Names): Array<string> {
+  if (update == null) {
+    return known;
+  }
+  return known.slice(0, update.offset).concat(update.names);
+}
+
+// The smallest power of two above which a tenth of the values fall.
+function p90(buckets: Array<number>, count: number): number {
+  let seen = 0;
+  for (let i = 0; i + 1 < buckets.length; i += 2) {
+    seen += buckets[i + 1];
+    if (seen >= count * 0.9) {
+      return Math.pow(2, buckets[i]);
+    }
+  }
+  return Infinity;
+}
+
+export default class extends SonarPlugin<State> {
+  static title = 'Metrics';
+  static id = 'Metrics';
+  static icon = 'bar-chart';
+
+  state = {
+    counterNames: [],
+    gaugeNames: [],
+    histogramNames: [],
+    totals: {},
+    metrics: {},
+  };
+
+  reducers = {
+    Metrics(state: State, {message}: {message: MetricsMessage}) {
+      const counterNames = withNames(state.counterNames, message.counterNames);
+      const gaugeNames = withNames(state.gaugeNames, message.gaugeNames);
+      const histogramNames = withNames(
+        state.histogramNames,
+        message.histogramNames,
+      );
+      const seconds = Math.max(message.interval, 1) / 1000;
+      const totals = {...state.totals};
+      const metrics = {...state.metrics};
+
+      for (let i = 0; i + 1 < message.counters.length; i += 2) {
+        const name = counterNames[message.counters[i]];
+        const delta = message.counters[i + 1];
+        totals[name] = (totals[name] || 0) + delta;
+        metrics[name] = {
+          kind: 'counter',
+          value: String(totals[name]),
+          detail: `+${delta} (${(delta / seconds).toFixed(1)}/s)`,
+        };
+      }
+      for (let i = 0; i + 1 < message.gauges.length; i += 2) {
+        const name = gaugeNames[message.gauges[i]];
+        metrics[name] = {
+          kind: 'gauge',
+          value: String(message.gauges[i + 1]),
+          detail: '',
+        };
+      }
+      for (const [index, count, sum, min, max, buckets] of message.histograms) {
+        const name = histogramNames[index];
+        metrics[name] = {
+          kind: 'histogram',
+          value: `avg ${(sum / count).toFixed(1)}`,
+          detail: `${count} values, min ${min}, max ${max}, p90 < ${p90(
+            buckets,
+            count,
+          )}`,
+        };
+      }
+      return {counterNames, gaugeNames, histogramNames, totals, metrics};
+    },
+  };
+
+  init() {
+    this.client.subscribe('metrics', (message: MetricsMessage) => {
+      this.dispatchAction({message, type: 'Metrics'});
+    });
+  }
+
+  render() {
+    const {metrics} = this.state;
+    return (
+      <FlexColumn fill={true}>
+        <ManagedTable
+          columnSizes={COLUMN_SIZES}
+          columns={COLUMNS}
+          rowLineHeight={26}
+          rows={Object.keys(metrics)
+            .sort()
+            .map(name => ({
+              key: name,
+              columns: {
+                name: {value: name},
+                kind: {value: metrics[name].kind},
+                value: {value: metrics[name].value},
+                detail: {value: metrics[name].detail},
+              },
+            }))}
+        />
+      </FlexColumn>
+    );
+  }
+}
@@ -0,0 +1,87 @@
+/**
+ * Copyright 2018-present Facebook.
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ * @format
+ */
+
+// What the device is asked to capture, see setFilter in the device plugins.
+// Every key is optional, and an empty filter captures everything.
+export type CaptureFilter = {
+  host?: string,
+  pathPrefix?: string,
+  methods?: Array<string>,
+  minStatus?: number,
+  maxStatus?: number,
+  contentType?: string,
+  maxBodyBytes?: number,
+};
+
+const SIZE_UNITS = {'': 1, k: 1024, kb: 1024, m: 1024 * 1024, mb: 1024 * 1024};
+
+function parseStatus(value: string, filter: CaptureFilter) {
+  let match = /^([1-5])xx$/i.exec(value);
+  if (match) {
+    filter.minStatus = Number(match[1]) * 100;
+    filter.maxStatus = filter.minStatus + 99;
+    return;
+  }
+  match = /^(\d+)(?:-(\d+))?$/.exec(value);
+  if (!match) {
+    throw new Error(`Not a status or status range: ${value}`);
+  }
+  filter.minStatus = Number(match[1]);
+  filter.maxStatus = match[2] != null ? Number(match[2]) : filter.minStatus;
+}
+
+function parseSize(value: string): number {
+  const match = /^(\d+)\s*([a-z]*)$/i.exec(value);
+  const unit = match ? SIZE_UNITS[match[2].toLowerCase()] : null;
+  if (!match || unit == null) {
+    throw new Error(`Not a size: ${value}`);
+  }
+  return Number(match[1]) * unit;
+}
+
+/**
+ * Parses space separated terms such as
+ * `host:example.com path:/api method:GET,POST status:4xx type:application/json size:64k`
+ * into the filter sent to the device. Throws on terms it doesn't know.
+ */
+export function parseCaptureFilter(expression: string): CaptureFilter {
+  const filter: CaptureFilter = {};
+  for (const term of expression.trim().split(/\s+/)) {
+    if (term === '') {
+      continue;
+    }
+    const colon = term.indexOf(':');
+    const key = colon > 0 ? term.slice(0, colon).toLowerCase() : '';
+    const value = term.slice(colon + 1);
+    if (value === '') {
+      throw new Error(`Missing value in ${term}`);
+    }
+    switch (key) {
+      case 'host':
+        filter.host = value;
+        break;
+      case 'path':
+        filter.pathPrefix = value;
+        break;
+      case 'method':
+        filter.methods = value.split(',').map(method => method.toUpperCase());
+        break;
+      case 'status':
+        parseStatus(value, filter);
+        break;
+      case 'type':
+        filter.contentType = value;
+        break;
+      case 'size':
+        filter.maxBodyBytes = parseSize(value);
+        break;
+      default:
+        throw new Error(`Unknown filter term: ${term}`);
+    }
+  }
+  return filter;
+}
@@ -10,9 +10,11 @@ import type {TableHighlightedRows, TableRows, TableBodyRow} from 'sonar';
 import {
   ContextMenu,
   FlexColumn,
+  FlexRow,
   Button,
   Text,
   Glyph,
+  Input,
   colors,
   PureComponent,
   SonarSidebar,
@@ -20,6 +22,7 @@ import {
 } from 'sonar';
 import {SonarPlugin, SearchableTable} from 'sonar';
 import RequestDetails from './RequestDetails.js';
+import {parseCaptureFilter} from './captureFilter.js';
 import {URL} from 'url';
 
 type RequestId = string;
@@ -27,6 +30,9 @@ type RequestId = string;
 type PersistedState = {|
   requests: {[id: RequestId]: Request},
   responses: {[id: RequestId]: Response},
+  // The expression the device was last asked to filter by, see
+  // parseCaptureFilter.
+  captureFilter?: string,
 |};
 
 type State = {|
@@ -49,6 +55,8 @@ export type Response = {|
   reason: string,
   headers: Array<Header>,
   data: ?string,
+  // The device has a formatter for this response, which it runs on request.
+  formattable?: boolean,
 |};
 
 export type Header = {|
@@ -125,8 +133,45 @@ export default class extends SonarPlugin<State, *, PersistedState> {
     selectedIds: [],
   };
 
+  // Header names the device has interned on this connection, see
+  // decodeHeaders.
+  headerNames: Array<string> = [];
+
+  // Devices may send headers as a flat [name, value, ...] compactHeaders
+  // list, where names they have sent before are replaced by their index in
+  // headerNames. Names new to the table come along in newHeaderNames.
+  decodeHeaders<T: Object>(message: T): T {
+    const {compactHeaders, newHeaderNames, newHeaderNamesOffset} = message;
+    if (compactHeaders == null) {
+      return message;
+    }
+    if (newHeaderNames != null) {
+      this.headerNames.length = newHeaderNamesOffset;
+      this.headerNames.push(...newHeaderNames);
+    }
+    const headers = [];
+    for (let i = 0; i + 1 < compactHeaders.length; i += 2) {
+      const name = compactHeaders[i];
+      headers.push({
+        key: typeof name === 'number' ? this.headerNames[name] : name,
+        value: compactHeaders[i + 1],
+      });
+    }
+    return {...message, headers};
+  }
+
   init() {
-    this.client.subscribe('newRequest', (request: Request) => {
+    const {captureFilter} = this.props.persistedState;
+    if (captureFilter) {
+      this.pushCaptureFilter(captureFilter);
+    }
+    // Devices that can send binary frames send bodies as the frame's data
+    // instead of a base64 string in the message.
+    this.client.subscribe('newRequest', (request: Request, raw: ?Buffer) => {
+      if (raw != null) {
+        request = {...request, data: Buffer.from(raw).toString('base64')};
+      }
+      request = this.decodeHeaders(request);
       this.props.setPersistedState({
         requests: {
           ...this.props.persistedState.requests,
@@ -134,7 +179,11 @@ export default class extends SonarPlugin<State, *, PersistedState> {
         },
       });
     });
-    this.client.subscribe('newResponse', (response: Response) => {
+    this.client.subscribe('newResponse', (response: Response, raw: ?Buffer) => {
+      if (raw != null) {
+        response = {...response, data: Buffer.from(raw).toString('base64')};
+      }
+      response = this.decodeHeaders(response);
       this.props.setPersistedState({
         responses: {
           ...this.props.persistedState.responses,
@@ -142,10 +191,63 @@ export default class extends SonarPlugin<State, *, PersistedState> {
         },
       });
     });
+    // Sent for requests whose response the capture filter leaves out.
+    this.client.subscribe('dropRequest', ({id}: {id: RequestId}) => {
+      const {[id]: dropped, ...requests} = this.props.persistedState.requests;
+      if (dropped != null) {
+        this.props.setPersistedState({requests});
+      }
+    });
   }
 
-  onRowHighlighted = (selectedIds: Array<RequestId>) =>
+  // Filtering on the device saves it capturing and sending what would only
+  // be filtered out here.
+  pushCaptureFilter(expression: string) {
+    let filter;
+    try {
+      filter = parseCaptureFilter(expression);
+    } catch (e) {
+      return;
+    }
+    this.client.call('setFilter', filter).catch(() => {
+      // Devices without the filter send everything.
+    });
+  }
+
+  onCaptureFilterChange = (expression: string) => {
+    this.props.setPersistedState({captureFilter: expression});
+    this.pushCaptureFilter(expression);
+  };
+
+  onRowHighlighted = (selectedIds: Array<RequestId>) => {
     this.setState({selectedIds});
+    if (selectedIds.length === 1) {
+      this.formatResponse(selectedIds[0]);
+    }
+  };
+
+  // Formatting is left to when a response is opened, so that the device
+  // doesn't spend time on responses nobody looks at.
+  formatResponse(id: RequestId) {
+    const response = this.props.persistedState.responses[id];
+    if (response == null || !response.formattable) {
+      return;
+    }
+    this.client
+      .call('formatResponse', {id})
+      .then(({data}: {data: ?string}) => {
+        const {responses} = this.props.persistedState;
+        this.props.setPersistedState({
+          responses: {
+            ...responses,
+            [id]: {...responses[id], data, formattable: false},
+          },
+        });
+      })
+      .catch(() => {
+        // Shown as it was sent.
+      });
+  }
 
   clearLogs = () => {
     this.setState({selectedIds: []});
@@ -176,6 +278,8 @@ export default class extends SonarPlugin<State, *, PersistedState> {
           responses={responses || {}}
           clear={this.clearLogs}
           onRowHighlighted={this.onRowHighlighted}
+          captureFilter={this.props.persistedState.captureFilter || ''}
+          onCaptureFilterChange={this.onCaptureFilterChange}
         />
         <SonarSidebar>{this.renderSidebar()}</SonarSidebar>
       </FlexColumn>
@@ -188,6 +292,8 @@ type NetworkTableProps = {
   responses: {[id: RequestId]: Response},
   clear: () => void,
   onRowHighlighted: (keys: TableHighlightedRows) => void,
+  captureFilter: string,
+  onCaptureFilterChange: (expression: string) => void,
 };
 
 type NetworkTableState = {|
@@ -332,13 +438,74 @@ class NetworkTable extends PureComponent<NetworkTableProps, NetworkTableState> {
           onRowHighlighted={this.props.onRowHighlighted}
           rowLineHeight={26}
           zebra={false}
-          actions={<Button onClick={this.props.clear}>Clear Table</Button>}
+          actions={
+            <FlexRow>
+              <CaptureFilterInput
+                value={this.props.captureFilter}
+                onSubmit={this.props.onCaptureFilterChange}
+              />
+              <Button onClick={this.props.clear}>Clear Table</Button>
+            </FlexRow>
+          }
         />
       </NetworkTable.ContextMenu>
     );
   }
 }
 
+// Applied on enter, so that the device isn't sent every keystroke.
+class CaptureFilterInput extends PureComponent<
+  {
+    value: string,
+    onSubmit: (expression: string) => void,
+  },
+  {
+    value: string,
+    error: ?string,
+  },
+> {
+  static Input = styled(Input)(({invalid}) => ({
+    width: 280,
+    borderColor: invalid ? colors.red : undefined,
+  }));
+
+  state = {
+    value: this.props.value,
+    error: null,
+  };
+
+  onChange = (e: SyntheticInputEvent<>) => {
+    this.setState({value: e.target.value, error: null});
+  };
+
+  onKeyDown = (e: SyntheticKeyboardEvent<>) => {
+    if (e.key !== 'Enter') {
+      return;
+    }
+    try {
+      parseCaptureFilter(this.state.value);
+    } catch (error) {
+      this.setState({error: error.message});
+      return;
+    }
+    this.props.onSubmit(this.state.value);
+  };
+
+  render() {
+    return (
+      <CaptureFilterInput.Input
+        compact={true}
+        placeholder="Capture only, e.g. host:example.com status:4xx"
+        title={this.state.error || undefined}
+        invalid={this.state.error != null}
+        value={this.state.value}
+        onChange={this.onChange}
+        onKeyDown={this.onKeyDown}
+      />
+    );
+  }
+}
+
 const Icon = styled(Glyph)({
   marginTop: -3,
   marginRight: 3,
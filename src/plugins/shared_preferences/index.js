@@ -26,13 +26,26 @@ type SharedPreferencesChangeEvent = {|
   value: string,
 |};
 
+type SharedPreferencesChangesEvent = {|
+  version: number,
+  changes: Array<SharedPreferencesChangeEvent>,
+|};
+
 export type SharedPreferences = {
   [name: string]: any,
 };
 
+type SharedPreferencesDelta = {|
+  version: number,
+  full: boolean,
+  entries: SharedPreferences,
+  deleted: Array<string>,
+|};
+
 type SharedPreferencesState = {|
   sharedPreferences: ?SharedPreferences,
   changesList: Array<SharedPreferencesChangeEvent>,
+  version: number,
 |};
 
 const CHANGELOG_COLUMNS = {
@@ -73,6 +86,7 @@ export default class extends SonarPlugin<SharedPreferencesState> {
   state = {
     changesList: [],
     sharedPreferences: null,
+    version: 0,
   };
 
   reducers = {
@@ -80,34 +94,60 @@ export default class extends SonarPlugin<SharedPreferencesState> {
       return {
         changesList: state.changesList,
         sharedPreferences: results.results,
+        version: 0,
+      };
+    },
+
+    ApplySharedPreferencesDelta(state: SharedPreferencesState, event: Object) {
+      const delta: SharedPreferencesDelta = event.delta;
+      // Batches that arrived while the request was in flight may already be
+      // newer than the response.
+      if (!delta.full && delta.version <= state.version) {
+        return state;
+      }
+      const sharedPreferences = delta.full
+        ? {...delta.entries}
+        : {...(state.sharedPreferences || {}), ...delta.entries};
+      delta.deleted.forEach(name => {
+        delete sharedPreferences[name];
+      });
+      return {
+        changesList: state.changesList,
+        sharedPreferences,
+        version: delta.version,
       };
     },
 
     ChangeSharedPreferences(state: SharedPreferencesState, event: Object) {
       const sharedPreferences = {...(state.sharedPreferences || {})};
-      if (event.change.deleted) {
-        delete sharedPreferences[event.change.name];
-      } else {
-        sharedPreferences[event.change.name] = event.change.value;
-      }
+      // A response we already applied may have had newer values than this.
+      const changes = event.version > state.version ? event.changes : [];
+      changes.forEach(change => {
+        if (change.deleted) {
+          delete sharedPreferences[change.name];
+        } else {
+          sharedPreferences[change.name] = change.value;
+        }
+      });
       return {
-        changesList: [event.change, ...state.changesList],
+        changesList: [...event.changes].reverse().concat(state.changesList),
         sharedPreferences,
+        version: Math.max(state.version, event.version),
       };
     },
   };
 
   init() {
-    this.client
-      .call('getSharedPreferences')
-      .then((results: SharedPreferences) => {
-        this.dispatchAction({results, type: 'UpdateSharedPreferences'});
-      });
+    this.fetchSharedPreferences();
 
     this.client.subscribe(
-      'sharedPreferencesChange',
-      (change: SharedPreferencesChangeEvent) => {
-        this.dispatchAction({change, type: 'ChangeSharedPreferences'});
+      'sharedPreferencesChanges',
+      ({version, changes}: SharedPreferencesChangesEvent) => {
+        this.dispatchAction({
+          changes,
+          version,
+          type: 'ChangeSharedPreferences',
+        });
       },
     );
     this.client.subscribe(
@@ -118,6 +158,16 @@ export default class extends SonarPlugin<SharedPreferencesState> {
     );
   }
 
+  // Only asks for what changed since the version we have, or for everything
+  // on the first call.
+  fetchSharedPreferences() {
+    this.client
+      .call('getSharedPreferences', {since: this.state.version})
+      .then((delta: SharedPreferencesDelta) => {
+        this.dispatchAction({delta, type: 'ApplySharedPreferencesDelta'});
+      });
+  }
+
   onSharedPreferencesChanged = (path: Array<string>, value: any) => {
     const values = this.state.sharedPreferences;
 
@@ -130,9 +180,10 @@ export default class extends SonarPlugin<SharedPreferencesState> {
       .call('setSharedPreference', {
         preferenceName: path[0],
         preferenceValue: newValue,
+        since: this.state.version,
       })
-      .then((results: SharedPreferences) => {
-        this.dispatchAction({results, type: 'UpdateSharedPreferences'});
+      .then((delta: SharedPreferencesDelta) => {
+        this.dispatchAction({delta, type: 'ApplySharedPreferencesDelta'});
       });
   };
 
@@ -0,0 +1,303 @@
+/**
+ * Copyright 2018-present Facebook.
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ * @format
+ */
+
+import {
+  ManagedTable,
+  FlexColumn,
+  Toolbar,
+  Spacer,
+  Button,
+  ButtonGroup,
+  Text,
+  SonarPlugin,
+} from 'sonar';
+import {clipboard, remote} from 'electron';
+import fs from 'fs';
+
+// Bytes per event in a binary chunk: a uint64 timestamp in nanoseconds, a
+// uint32 name index, a uint16 thread index, a uint8 phase and a zero byte,
+// all little endian.
+const RECORD_SIZE = 16;
+// Older events are dropped on the desktop too, past this many.
+const MAX_EVENTS = 200000;
+
+type Names = {|
+  offset: number,
+  names: Array<string>,
+|};
+
+// Events refer to names and threads by index, which come along once per
+// connection. Without binary support the events are in `events`, as a flat
+// [timestamp, name, thread, phase, ...] list.
+type TraceChunk = {|
+  names?: Names,
+  // [index, tid, name] of threads that weren't sent yet.
+  threads?: Array<[number, number, string]>,
+  count: number,
+  dropped: number,
+  dump: boolean,
+  events?: Array<number>,
+|};
+
+type TraceEvent = {|
+  timestamp: number,
+  name: number,
+  thread: number,
+  phase: string,
+|};
+
+type Thread = {|
+  tid: number,
+  name: string,
+|};
+
+type State = {|
+  streaming: boolean,
+  names: Array<string>,
+  threads: {[index: number]: Thread},
+  events: Array<TraceEvent>,
+  dropped: number,
+|};
+
+type Span = {|
+  count: number,
+  total: number,
+  max: number,
+|};
+
+const COLUMNS = {
+  name: {value: 'Name'},
+  count: {value: 'Count'},
+  total: {value: 'Total (ms)'},
+  average: {value: 'Average (ms)'},
+  max: {value: 'Max (ms)'},
+};
+
+const COLUMN_SIZES = {
+  name: 'flex',
+  count: '12%',
+  total: '15%',
+  average: '15%',
+  max: '15%',
+};
+
+function decodeEvents(chunk: TraceChunk, data: ?Buffer): Array<TraceEvent> {
+  const events = [];
+  if (data != null && typeof data !== 'string') {
+    for (let offset = 0; offset + RECORD_SIZE <= data.length; ) {
+      events.push({
+        timestamp:
+          data.readUInt32LE(offset + 4) * 0x100000000 +
+          data.readUInt32LE(offset),
+        name: data.readUInt32LE(offset + 8),
+        thread: data.readUInt16LE(offset + 12),
+        phase: String.fromCharCode(data.readUInt8(offset + 14)),
+      });
+      offset += RECORD_SIZE;
+    }
+  } else if (chunk.events != null) {
+    const fields = chunk.events;
+    for (let i = 0; i + 3 < fields.length; i += 4) {
+      events.push({
+        timestamp: fields[i],
+        name: fields[i + 1],
+        thread: fields[i + 2],
+        phase: String.fromCharCode(fields[i + 3]),
+      });
+    }
+  }
+  return events;
+}
+
+// Durations of the begin and end pairs of each name, matching ends with
+// the latest begin on the same thread.
+function spans(
+  events: Array<TraceEvent>,
+  names: Array<string>,
+): {[name: string]: Span} {
+  const result = {};
+  const stacks = {};
+  for (const event of events) {
+    const stack = stacks[event.thread] || (stacks[event.thread] = []);
+    if (event.phase === 'B') {
+      stack.push(event);
+    } else if (event.phase === 'E' && stack.length > 0) {
+      const begin = stack.pop();
+      const name = names[begin.name] || String(begin.name);
+      const span =
+        result[name] || (result[name] = {count: 0, total: 0, max: 0});
+      const duration = event.timestamp - begin.timestamp;
+      span.count++;
+      span.total += duration;
+      span.max = Math.max(span.max, duration);
+    }
+  }
+  return result;
+}
+
+function toChromeTrace(state: State): string {
+  const traceEvents = Object.keys(state.threads).map(index => ({
+    name: 'thread_name',
+    ph: 'M',
+    pid: 0,
+    tid: state.threads[Number(index)].tid,
+    args: {name: state.threads[Number(index)].name},
+  }));
+  for (const event of state.events) {
+    const thread = state.threads[event.thread];
+    traceEvents.push({
+      name: state.names[event.name] || String(event.name),
+      ph: event.phase,
+      // Microseconds.
+      ts: event.timestamp / 1000,
+      pid: 0,
+      tid: thread ? thread.tid : event.thread,
+      ...(event.phase === 'i' ? {s: 't'} : {}),
+    });
+  }
+  return JSON.stringify({traceEvents, displayTimeUnit: 'ns'});
+}
+
+function milliseconds(nanoseconds: number): string {
+  return (nanoseconds / 1e6).toFixed(3);
+}
+
+export default class extends SonarPlugin<State> {
+  static title = 'Trace';
+  static id = 'Trace';
+  static icon = 'flash';
+
+  state = {
+    streaming: false,
+    names: [],
+    threads: {},
+    events: [],
+    dropped: 0,
+  };
+
+  reducers = {
+    Chunk(state: State, {chunk, data}: {chunk: TraceChunk, data: ?Buffer}) {
+      const names =
+        chunk.names == null
+          ? state.names
+          : state.names.slice(0, chunk.names.offset).concat(chunk.names.names);
+      const threads = {...state.threads};
+      for (const [index, tid, name] of chunk.threads || []) {
+        threads[index] = {tid, name: name || `Thread ${tid}`};
+      }
+      // A dump replaces what was there, it holds everything the app has.
+      const events = (chunk.dump ? [] : state.events).concat(
+        decodeEvents(chunk, data),
+      );
+      return {
+        names,
+        threads,
+        events: events.slice(Math.max(events.length - MAX_EVENTS, 0)),
+        dropped: state.dropped + chunk.dropped,
+      };
+    },
+    Streaming(state: State, {streaming}: {streaming: boolean}) {
+      return {streaming};
+    },
+    Clear(state: State) {
+      return {events: [], dropped: 0};
+    },
+  };
+
+  init() {
+    this.client.subscribe('traceChunk', (chunk: TraceChunk, data: ?Buffer) => {
+      this.dispatchAction({chunk, data, type: 'Chunk'});
+    });
+    // The app stops streaming when it disconnects.
+    if (this.state.streaming) {
+      this.client.call('stream', {enabled: true});
+    }
+  }
+
+  toggleStreaming = () => {
+    const streaming = !this.state.streaming;
+    this.client.call('stream', {enabled: streaming});
+    this.dispatchAction({streaming, type: 'Streaming'});
+  };
+
+  dump = () => {
+    this.client.call('dump');
+  };
+
+  clear = () => {
+    this.dispatchAction({type: 'Clear'});
+  };
+
+  copyTrace = () => {
+    clipboard.writeText(toChromeTrace(this.state));
+  };
+
+  saveTrace = () => {
+    remote.dialog.showSaveDialog(
+      {
+        defaultPath: 'trace.json',
+        filters: [{name: 'Chrome trace', extensions: ['json']}],
+      },
+      (path: ?string) => {
+        if (path != null) {
+          fs.writeFileSync(path, toChromeTrace(this.state));
+        }
+      },
+    );
+  };
+
+  render() {
+    const {streaming, events, names, dropped} = this.state;
+    const byName = spans(events, names);
+    return (
+      <FlexColumn fill={true}>
+        <Toolbar>
+          <ButtonGroup>
+            <Button onClick={this.toggleStreaming}>
+              {streaming ? 'Stop' : 'Stream'}
+            </Button>
+            <Button onClick={this.dump}>Dump</Button>
+            <Button onClick={this.clear}>Clear</Button>
+          </ButtonGroup>
+          <Spacer />
+          <Text>
+            {events.length} events
+            {dropped > 0 ? `, ${dropped} dropped` : ''}
+          </Text>
+          <ButtonGroup>
+            <Button onClick={this.copyTrace} disabled={events.length === 0}>
+              Copy Chrome trace
+            </Button>
+            <Button onClick={this.saveTrace} disabled={events.length === 0}>
+              Save Chrome trace…
+            </Button>
+          </ButtonGroup>
+        </Toolbar>
+        <ManagedTable
+          columnSizes={COLUMN_SIZES}
+          columns={COLUMNS}
+          rowLineHeight={26}
+          rows={Object.keys(byName)
+            .sort((a, b) => byName[b].total - byName[a].total)
+            .map(name => {
+              const span = byName[name];
+              return {
+                key: name,
+                columns: {
+                  name: {value: name},
+                  count: {value: span.count},
+                  total: {value: milliseconds(span.total)},
+                  average: {value: milliseconds(span.total / span.count)},
+                  max: {value: milliseconds(span.max)},
+                },
+              };
+            })}
+        />
+      </FlexColumn>
+    );
+  }
+}
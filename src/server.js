@@ -10,7 +10,7 @@ import type Logger from './fb-stubs/Logger';
 import type {ClientQuery} from './Client.js';
 
 import CertificateProvider from './utils/CertificateProvider';
-import {RSocketServer, ReactiveSocket} from 'rsocket-core';
+import {RSocketServer, ReactiveSocket, BufferEncoders} from 'rsocket-core';
 import RSocketTCPServer from 'rsocket-tcp-server';
 import {Single} from 'rsocket-flowable';
 import Client from './Client.js';
@@ -23,9 +23,12 @@ const net = require('net');
 
 const SECURE_PORT = 8088;
 const INSECURE_PORT = 8089;
+// Plain text, but trusted, as it only listens on localhost. Devices reach
+// it through `adb reverse localabstract:sonar tcp:8087`.
+const LOCAL_PORT = 8087;
 
 type RSocket = {|
-  fireAndForget(payload: {data: string}): void,
+  fireAndForget(payload: {data: string | Buffer}): void,
   connectionStatus(): any,
   close(): void,
 |};
@@ -39,6 +42,7 @@ export default class Server extends EventEmitter {
   connections: Map<string, ClientInfo>;
   secureServer: RSocketServer;
   insecureServer: RSocketServer;
+  localServer: RSocketServer;
   certificateProvider: CertificateProvider;
   connectionTracker: ConnectionTracker;
   logger: Logger;
@@ -71,9 +75,15 @@ export default class Server extends EventEmitter {
         options => (this.secureServer = this.startServer(SECURE_PORT, options)),
       );
     this.insecureServer = this.startServer(INSECURE_PORT);
+    this.localServer = this.startServer(LOCAL_PORT, undefined, true);
   }
 
-  startServer(port: number, sslConfig?: SecureServerConfig) {
+  startServer(
+    port: number,
+    sslConfig?: SecureServerConfig,
+    local?: boolean = false,
+  ) {
+    const trusted = Boolean(sslConfig) || local;
     const server = this;
     const serverFactory = onConnect => {
       const transportServer = sslConfig
@@ -89,7 +99,7 @@ export default class Server extends EventEmitter {
         .on('listening', () => {
           console.debug(
             `${
-              sslConfig ? 'Secure' : 'Certificate'
+              local ? 'Local' : sslConfig ? 'Secure' : 'Certificate'
             } server started on port ${port}`,
             'server',
           );
@@ -97,23 +107,29 @@ export default class Server extends EventEmitter {
       return transportServer;
     };
     const rsServer = new RSocketServer({
-      getRequestHandler: sslConfig
+      getRequestHandler: trusted
         ? this._trustedRequestHandler
         : this._untrustedRequestHandler,
-      transport: new RSocketTCPServer({
-        port: port,
-        serverFactory: serverFactory,
-      }),
+      // Trusted servers exchange raw buffers, so that devices can send
+      // binary and compressed frames. The certificate exchange stays text.
+      transport: new RSocketTCPServer(
+        {
+          port: port,
+          host: local ? 'localhost' : undefined,
+          serverFactory: serverFactory,
+        },
+        trusted ? BufferEncoders : undefined,
+      ),
     });
 
     rsServer.start();
     return rsServer;
   }
 
-  _trustedRequestHandler = (conn: RSocket, connectRequest: {data: string}) => {
+  _trustedRequestHandler = (conn: RSocket, connectRequest: {data: Buffer}) => {
     const server = this;
 
-    const clientData: ClientQuery = JSON.parse(connectRequest.data);
+    const clientData: ClientQuery = JSON.parse(connectRequest.data.toString());
     this.connectionTracker.logConnectionAttempt(clientData);
 
     const client = this.addConnection(conn, clientData);
@@ -50,6 +50,8 @@ export type Element = {|
   data: ElementData,
   decoration: string,
   extraInfo: ElementExtraInfo,
+  // Hashes of the attributes, data and children, if the client sends them.
+  hashes?: {[section: string]: string},
 |};
 
 export default class ElementsInspector extends Component<{
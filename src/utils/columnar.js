@@ -0,0 +1,39 @@
+/**
+ * Copyright 2018-present Facebook.
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ * @format
+ */
+
+// Devices write arrays of same-shaped objects column by column, as
+// {__columns: [keys], __values: [[values of the first key], ...]}, see
+// toColumnarJson in xplat/Sonar/SonarMessageEncoding.h. This turns them back
+// into arrays of objects, in place where possible.
+export function expandColumnar(value: any): any {
+  if (Array.isArray(value)) {
+    for (let i = 0; i < value.length; i++) {
+      value[i] = expandColumnar(value[i]);
+    }
+    return value;
+  }
+  if (value == null || typeof value !== 'object') {
+    return value;
+  }
+  const {__columns: columns, __values: values} = value;
+  if (Array.isArray(columns) && Array.isArray(values)) {
+    const length = values.length > 0 ? values[0].length : 0;
+    const rows = new Array(length);
+    for (let i = 0; i < length; i++) {
+      const row = {};
+      for (let c = 0; c < columns.length; c++) {
+        row[columns[c]] = expandColumnar(values[c][i]);
+      }
+      rows[i] = row;
+    }
+    return rows;
+  }
+  for (const key in value) {
+    value[key] = expandColumnar(value[key]);
+  }
+  return value;
+}
@@ -0,0 +1,38 @@
+/**
+ * Copyright 2018-present Facebook.
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ * @format
+ */
+
+// Preset dictionary for compressed device frames. Must be kept byte for byte
+// in sync with kDictionary in xplat/Sonar/SonarCompression.cpp.
+export const COMPRESSION_DICTIONARY = Buffer.from(
+  '"reason":"OK","status":200,' +
+    '{"key":"Content-Type","value":"application/json"},' +
+    '{"key":"Content-Length","value":"' +
+    '"url":"https://' +
+    '"method":"newResponse","params":{' +
+    '"method":"newRequest","params":{' +
+    '"api":"Network",' +
+    '"api":"Inspector",' +
+    '"decoration":"","extraInfo":{},' +
+    '"attributes":[{"name":"","value":""}],' +
+    '"children":[""],' +
+    '"expanded":false,' +
+    '{"id":"","name":"","data":{' +
+    '"timestamp":' +
+    '"headers":[],"data":"' +
+    '{"id":1,"success":{' +
+    '{"method":"execute","params":{"api":"',
+);
+
+// zlib streams start with a CMF byte for deflate and a header checksum.
+// Uncompressed frames start with '{' or a MessagePack map, which never match.
+export function isDeflated(frame: Buffer): boolean {
+  return (
+    frame.length >= 2 &&
+    (frame[0] & 0x0f) === 8 &&
+    ((frame[0] << 8) | frame[1]) % 31 === 0
+  );
+}
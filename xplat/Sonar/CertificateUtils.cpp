@@ -8,10 +8,14 @@
 #include "CertificateUtils.h"
 
 #include <fcntl.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/obj_mac.h>
 #include <openssl/pem.h>
 #include <openssl/rsa.h>
 #include <sys/stat.h>
 #include <cstring>
+#include <ctime>
 
 void free(
     EVP_PKEY* pKey,
@@ -20,10 +24,57 @@ void free(
     BIO* privateKey,
     BIO* csrBio);
 
+// Keys are rotated after this long even if the desktop keeps accepting
+// requests signed with them.
+static constexpr time_t kMaxPrivateKeyAgeSeconds = 30 * 24 * 60 * 60;
+
+// The key in privateKeyFile, if a new request can be signed with it rather
+// than generating one: it parses, is of keyType and isn't too old. Null
+// otherwise.
+static EVP_PKEY* loadReusablePrivateKey(
+    const char* privateKeyFile,
+    CertificateKeyType keyType) {
+  struct stat info;
+  if (stat(privateKeyFile, &info) != 0 || info.st_size == 0 ||
+      time(NULL) - info.st_mtime > kMaxPrivateKeyAgeSeconds) {
+    return NULL;
+  }
+  FILE* privateKeyFp = fopen(privateKeyFile, "r");
+  if (privateKeyFp == NULL) {
+    return NULL;
+  }
+  EVP_PKEY* pKey = PEM_read_PrivateKey(privateKeyFp, NULL, NULL, NULL);
+  fclose(privateKeyFp);
+
+  bool usable = false;
+  if (pKey != NULL && keyType == CertificateKeyType::ECDSA_P256) {
+    EC_KEY* ecKey = EVP_PKEY_get1_EC_KEY(pKey);
+    usable = ecKey != NULL &&
+        EC_GROUP_get_curve_name(EC_KEY_get0_group(ecKey)) ==
+            NID_X9_62_prime256v1 &&
+        EC_KEY_check_key(ecKey) == 1;
+    EC_KEY_free(ecKey);
+  } else if (pKey != NULL) {
+    RSA* rsa = EVP_PKEY_get1_RSA(pKey);
+    usable = rsa != NULL && EVP_PKEY_bits(pKey) >= 2048 &&
+        RSA_check_key(rsa) == 1;
+    RSA_free(rsa);
+  }
+  if (!usable) {
+    // Whatever failed above left errors on the queue.
+    ERR_clear_error();
+    EVP_PKEY_free(pKey);
+    return NULL;
+  }
+  return pKey;
+}
+
 bool generateCertSigningRequest(
     const char* appId,
     const char* csrFile,
-    const char* privateKeyFile) {
+    const char* privateKeyFile,
+    CertificateKeyType keyType,
+    bool reuseExistingKey) {
   int ret = 0;
   BIGNUM* bne = NULL;
 
@@ -43,31 +94,56 @@ bool generateCertSigningRequest(
 
   X509_REQ* x509_req = X509_REQ_new();
   EVP_PKEY* pKey = EVP_PKEY_new();
-  RSA* rsa = RSA_new();
+  RSA* rsa = NULL;
   BIO* privateKey = NULL;
   BIO* csrBio = NULL;
 
-  EVP_PKEY_assign_RSA(pKey, rsa);
+  EVP_PKEY* storedKey =
+      reuseExistingKey ? loadReusablePrivateKey(privateKeyFile, keyType) : NULL;
+  if (storedKey != NULL) {
+    // Generating a key, RSA ones especially, is by far the slowest part of
+    // an exchange.
+    EVP_PKEY_free(pKey);
+    pKey = storedKey;
+  } else if (keyType == CertificateKeyType::ECDSA_P256) {
+    EC_KEY* ecKey = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+    if (ecKey == NULL) {
+      free(pKey, x509_req, bne, privateKey, csrBio);
+      return -1;
+    }
+    // Encode the curve by name, which is what peers expect in certificates.
+    EC_KEY_set_asn1_flag(ecKey, OPENSSL_EC_NAMED_CURVE);
+    ret = EC_KEY_generate_key(ecKey);
+    if (ret != 1) {
+      EC_KEY_free(ecKey);
+      free(pKey, x509_req, bne, privateKey, csrBio);
+      return ret;
+    }
+    EVP_PKEY_assign_EC_KEY(pKey, ecKey);
+  } else {
+    rsa = RSA_new();
+    EVP_PKEY_assign_RSA(pKey, rsa);
 
-  // Generate rsa key
-  bne = BN_new();
-  BN_set_flags(bne, BN_FLG_CONSTTIME);
-  ret = BN_set_word(bne, e);
-  if (ret != 1) {
-    free(pKey, x509_req, bne, privateKey, csrBio);
-    return ret;
-  }
+    // Generate rsa key
+    bne = BN_new();
+    BN_set_flags(bne, BN_FLG_CONSTTIME);
+    ret = BN_set_word(bne, e);
+    if (ret != 1) {
+      free(pKey, x509_req, bne, privateKey, csrBio);
+      return ret;
+    }
 
-  ret = RSA_generate_key_ex(rsa, bits, bne, NULL);
-  if (ret != 1) {
-    free(pKey, x509_req, bne, privateKey, csrBio);
-    return ret;
+    ret = RSA_generate_key_ex(rsa, bits, bne, NULL);
+    if (ret != 1) {
+      free(pKey, x509_req, bne, privateKey, csrBio);
+      return ret;
+    }
   }
 
-  {
+  if (storedKey == NULL) {
     // Write private key to a file
     int privateKeyFd =
-        open(privateKeyFile, O_CREAT | O_WRONLY, S_IWUSR | S_IRUSR);
+        open(privateKeyFile, O_CREAT | O_WRONLY | O_TRUNC, S_IWUSR | S_IRUSR);
     if (privateKeyFd < 0) {
       free(pKey, x509_req, bne, privateKey, csrBio);
       return -1;
@@ -78,20 +154,23 @@ bool generateCertSigningRequest(
       return -1;
     }
     privateKey = BIO_new_fp(privateKeyFp, BIO_CLOSE);
-    ret =
-        PEM_write_bio_RSAPrivateKey(privateKey, rsa, NULL, NULL, 0, NULL, NULL);
+    if (keyType == CertificateKeyType::ECDSA_P256) {
+      ret = PEM_write_bio_PrivateKey(
+          privateKey, pKey, NULL, NULL, 0, NULL, NULL);
+    } else {
+      ret = PEM_write_bio_RSAPrivateKey(
+          privateKey, rsa, NULL, NULL, 0, NULL, NULL);
+    }
     if (ret != 1) {
       free(pKey, x509_req, bne, privateKey, csrBio);
       return ret;
     }
-  }
-
-  rsa = NULL;
 
-  ret = BIO_flush(privateKey);
-  if (ret != 1) {
-    free(pKey, x509_req, bne, privateKey, csrBio);
-    return ret;
+    ret = BIO_flush(privateKey);
+    if (ret != 1) {
+      free(pKey, x509_req, bne, privateKey, csrBio);
+      return ret;
+    }
   }
 
   ret = X509_REQ_set_version(x509_req, nVersion);
@@ -182,7 +261,8 @@ bool generateCertSigningRequest(
 
   {
     // Write CSR to a file
-    int csrFd = open(csrFile, O_CREAT | O_WRONLY, S_IWUSR | S_IRUSR);
+    int csrFd =
+        open(csrFile, O_CREAT | O_WRONLY | O_TRUNC, S_IWUSR | S_IRUSR);
     if (csrFd < 0) {
       free(pKey, x509_req, bne, privateKey, csrBio);
       return -1;
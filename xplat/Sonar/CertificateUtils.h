@@ -8,13 +8,24 @@
 #ifndef CertificateUtils_hpp
 #define CertificateUtils_hpp
 
-#include <openssl/pem.h>
-#include <openssl/rsa.h>
 #include <stdio.h>
 
+enum class CertificateKeyType {
+  // Compatible with every desktop version.
+  RSA2048,
+  // Much faster to generate, especially on older devices.
+  ECDSA_P256,
+};
+
+/* Writes a signing request for appId to csrFile. With reuseExistingKey, it
+   is signed with the key already in privateKeyFile if that is of keyType,
+   valid and less than 30 days old; otherwise a new key of keyType is
+   generated and written to privateKeyFile. */
 bool generateCertSigningRequest(
     const char* appId,
     const char* csrFile,
-    const char* privateKeyFile);
+    const char* privateKeyFile,
+    CertificateKeyType keyType = CertificateKeyType::RSA2048,
+    bool reuseExistingKey = false);
 
 #endif /* CertificateUtils_hpp */
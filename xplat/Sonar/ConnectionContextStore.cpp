@@ -2,8 +2,8 @@
 #include "CertificateUtils.h"
 #include "Log.h"
 #include <sys/stat.h>
-#include <iostream>
-#include <fstream>
+#include <thread>
+#include <folly/FileUtil.h>
 #include <folly/json.h>
 
 using namespace facebook::sonar;
@@ -14,64 +14,162 @@ static constexpr auto CLIENT_CERT_FILE_NAME = "device.crt";
 static constexpr auto PRIVATE_KEY_FILE = "privateKey.pem";
 static constexpr auto CONNECTION_CONFIG_FILE = "connection_config.json";
 
-bool fileExists(std::string fileName);
 std::string loadStringFromFile(std::string fileName);
-void writeStringToFile(std::string content, std::string fileName);
 
-ConnectionContextStore::ConnectionContextStore(DeviceData deviceData): deviceData_(deviceData) {}
+ConnectionContextStore::ConnectionContextStore(
+    DeviceData deviceData,
+    CertificateKeyType keyType)
+    : deviceData_(deviceData),
+      keyType_(keyType),
+      snapshot_(std::make_shared<Snapshot>()) {}
 
-bool ConnectionContextStore::hasRequiredFiles() {
-  std::string caCert = loadStringFromFile(absoluteFilePath(SONAR_CA_FILE_NAME));
-  std::string clientCert =
-      loadStringFromFile(absoluteFilePath(CLIENT_CERT_FILE_NAME));
-  std::string privateKey =
-      loadStringFromFile(absoluteFilePath(PRIVATE_KEY_FILE));
+bool ConnectionContextStore::fallBackToRSAKeys() {
+  return keyType_.exchange(CertificateKeyType::RSA2048) !=
+      CertificateKeyType::RSA2048;
+}
 
-  if (caCert == "" || clientCert == "" || privateKey == "") {
-    return false;
+folly::Future<folly::Unit> ConnectionContextStore::load() {
+  folly::Promise<folly::Unit> promise;
+  auto loaded = promise.getFuture();
+  std::thread([self = shared_from_this(),
+               promise = std::move(promise)]() mutable {
+    promise.setWith([&self]() { self->refresh(); });
+  }).detach();
+  return loaded;
+}
+
+void ConnectionContextStore::refresh() {
+  std::lock_guard<std::mutex> lock(refreshMutex_);
+  // Checking the files' sizes and modification times is enough to tell
+  // whether they changed, without reading them.
+  std::string stamp;
+  bool hasRequiredFiles = true;
+  for (auto file : {SONAR_CA_FILE_NAME,
+                    CLIENT_CERT_FILE_NAME,
+                    PRIVATE_KEY_FILE,
+                    CONNECTION_CONFIG_FILE}) {
+    struct stat info;
+    const bool exists = stat(absoluteFilePath(file).c_str(), &info) == 0;
+    if (exists) {
+      stamp += std::to_string(info.st_mtime) + ":" +
+          std::to_string(info.st_size) + ";";
+    } else {
+      stamp += "missing;";
+    }
+    if (file != CONNECTION_CONFIG_FILE && (!exists || info.st_size == 0)) {
+      hasRequiredFiles = false;
+    }
+  }
+  if (snapshot()->stamp == stamp) {
+    return;
+  }
+
+  auto next = std::make_shared<Snapshot>();
+  next->stamp = stamp;
+  next->hasRequiredFiles = hasRequiredFiles;
+
+  /* On android we can't reliably get the serial of the current device
+     So rely on our locally written config, which is provided by the
+     desktop app.
+     For backwards compatibility, when this isn't present, fall back to the
+     unreliable source. */
+  next->deviceId = deviceData_.deviceId;
+  std::string config =
+      loadStringFromFile(absoluteFilePath(CONNECTION_CONFIG_FILE));
+  if (!config.empty()) {
+    try {
+      auto maybeDeviceId = folly::parseJson(config)["deviceId"];
+      if (maybeDeviceId.isString()) {
+        next->deviceId = maybeDeviceId.getString();
+      }
+    } catch (const std::exception& e) {
+      log(LogLevel::Error, std::string("Unable to parse connection config: ") + e.what());
+    }
   }
-  return true;
+
+  // Parsing the PEM files is relatively expensive and reconnects are
+  // frequent, so the context is built once per version of the files.
+  if (hasRequiredFiles) {
+    try {
+      auto sslContext = std::make_shared<folly::SSLContext>();
+      sslContext->loadTrustedCertificates(
+          absoluteFilePath(SONAR_CA_FILE_NAME).c_str());
+      sslContext->setVerificationOption(
+          folly::SSLContext::SSLVerifyPeerEnum::VERIFY);
+      sslContext->loadCertKeyPairFromFiles(
+          absoluteFilePath(CLIENT_CERT_FILE_NAME).c_str(),
+          absoluteFilePath(PRIVATE_KEY_FILE).c_str());
+      sslContext->authenticate(true, false);
+      // Keep client sessions around so that a transport which reuses them can
+      // do an abbreviated handshake.
+      SSL_CTX_set_session_cache_mode(
+          sslContext->getSSLCtx(), SSL_SESS_CACHE_CLIENT);
+      next->sslContext = std::move(sslContext);
+    } catch (const std::exception& e) {
+      // Left for getSSLContext to report, so that the connection attempt
+      // fails and eventually falls back to a certificate exchange.
+      log(LogLevel::Error, std::string("Unable to load certificates: ") + e.what());
+    }
+  }
+
+  std::lock_guard<std::mutex> snapshotLock(snapshotMutex_);
+  snapshot_ = std::move(next);
+}
+
+std::shared_ptr<const ConnectionContextStore::Snapshot>
+ConnectionContextStore::snapshot() {
+  std::lock_guard<std::mutex> lock(snapshotMutex_);
+  return snapshot_;
+}
+
+void ConnectionContextStore::invalidate() {
+  // Files can be rewritten within the same second at the same size, so
+  // don't rely on the stamp to notice.
+  std::lock_guard<std::mutex> lock(snapshotMutex_);
+  auto next = std::make_shared<Snapshot>(*snapshot_);
+  next->stamp.clear();
+  snapshot_ = std::move(next);
+}
+
+bool ConnectionContextStore::hasRequiredFiles() {
+  return snapshot()->hasRequiredFiles;
 }
 
 std::string ConnectionContextStore::createCertificateSigningRequest() {
   ensureSonarDirExists();
+  // A new private key may be about to be written.
+  invalidate();
+  // Exchanges are mostly redone because the desktop's CA changed, which
+  // doesn't call for a new key.
   generateCertSigningRequest(
       deviceData_.appId.c_str(),
       absoluteFilePath(CSR_FILE_NAME).c_str(),
-      absoluteFilePath(PRIVATE_KEY_FILE).c_str());
-      std::string csr = loadStringFromFile(absoluteFilePath(CSR_FILE_NAME));
+      absoluteFilePath(PRIVATE_KEY_FILE).c_str(),
+      keyType_,
+      true);
+  std::string csr = loadStringFromFile(absoluteFilePath(CSR_FILE_NAME));
 
   return csr;
 }
 
 std::shared_ptr<SSLContext> ConnectionContextStore::getSSLContext() {
-  std::shared_ptr<folly::SSLContext> sslContext =
-      std::make_shared<folly::SSLContext>();
-  sslContext->loadTrustedCertificates(
-      absoluteFilePath(SONAR_CA_FILE_NAME).c_str());
-  sslContext->setVerificationOption(
-      folly::SSLContext::SSLVerifyPeerEnum::VERIFY);
-  sslContext->loadCertKeyPairFromFiles(
-      absoluteFilePath(CLIENT_CERT_FILE_NAME).c_str(),
-      absoluteFilePath(PRIVATE_KEY_FILE).c_str());
-  sslContext->authenticate(true, false);
+  auto sslContext = snapshot()->sslContext;
+  if (!sslContext) {
+    throw std::runtime_error("Certificates could not be loaded");
+  }
   return sslContext;
 }
 
 std::string ConnectionContextStore::getDeviceId() {
-  /* On android we can't reliably get the serial of the current device
-     So rely on our locally written config, which is provided by the
-     desktop app.
-     For backwards compatibility, when this isn't present, fall back to the
-     unreliable source. */
-  std::string config = loadStringFromFile(absoluteFilePath(CONNECTION_CONFIG_FILE));
-  auto maybeDeviceId = folly::parseJson(config)["deviceId"];
-  return maybeDeviceId.isString() ? maybeDeviceId.getString() : deviceData_.deviceId;
+  return snapshot()->deviceId;
 }
 
 void ConnectionContextStore::storeConnectionConfig(folly::dynamic& config) {
-  std::string json = folly::toJson(config);
-  writeStringToFile(json, absoluteFilePath(CONNECTION_CONFIG_FILE));
+  // Written to a temporary file and renamed over the old one, so that a
+  // crash halfway through never leaves a truncated config behind.
+  folly::writeFileAtomic(
+      absoluteFilePath(CONNECTION_CONFIG_FILE), folly::toJson(config));
+  invalidate();
 }
 
 std::string ConnectionContextStore::absoluteFilePath(const char* filename) {
@@ -91,34 +189,20 @@ bool ConnectionContextStore::ensureSonarDirExists() {
   } else if (info.st_mode & S_IFDIR) {
     return true;
   } else {
-    log("ERROR: Sonar path exists but is not a directory: " + dirPath);
+    log(LogLevel::Error, "Sonar path exists but is not a directory: " + dirPath);
     return false;
   }
 }
 
 std::string loadStringFromFile(std::string fileName) {
-  if (!fileExists(fileName)) {
+  std::string contents;
+  struct stat info;
+  if (stat(fileName.c_str(), &info) != 0) {
     return "";
   }
-  std::stringstream buffer;
-  std::ifstream stream;
-  std::string line;
-  stream.open(fileName.c_str());
-  if (!stream) {
-    log("ERROR: Unable to open ifstream: " + fileName);
+  if (!folly::readFile(fileName.c_str(), contents)) {
+    log(LogLevel::Error, "Unable to read file: " + fileName);
     return "";
   }
-  buffer << stream.rdbuf();
-  std::string s = buffer.str();
-  return s;
-}
-
-void writeStringToFile(std::string content, std::string fileName) {
-  std::ofstream out(fileName);
-  out << content;
-}
-
-bool fileExists(std::string fileName) {
-  struct stat buffer;
-  return stat(fileName.c_str(), &buffer) == 0;
+  return contents;
 }
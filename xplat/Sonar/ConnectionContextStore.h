@@ -1,8 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <folly/futures/Future.h>
 #include <folly/io/async/SSLContext.h>
 #include <folly/dynamic.h>
+#include "CertificateUtils.h"
 #include "SonarInitConfig.h"
 
 using namespace folly;
@@ -10,22 +15,52 @@ using namespace folly;
 namespace facebook {
 namespace sonar {
 
-class ConnectionContextStore {
+/* Reads of the connection context are served from a cache that load()
+   refreshes off the calling thread, so connecting never waits on the
+   filesystem. The desktop writes the certificates itself, so load() checks
+   whether the files changed every time, and only reads them if they did. */
+class ConnectionContextStore
+    : public std::enable_shared_from_this<ConnectionContextStore> {
 
 public:
-  ConnectionContextStore(DeviceData deviceData);
+  ConnectionContextStore(
+      DeviceData deviceData,
+      CertificateKeyType keyType = CertificateKeyType::RSA2048);
+  /* Brings the cache up to date with the files on disk, on a thread of its
+     own. The getters below reflect the files as of the last load. */
+  folly::Future<folly::Unit> load();
   bool hasRequiredFiles();
   std::string createCertificateSigningRequest();
   std::shared_ptr<SSLContext> getSSLContext();
   std::string getCertificateDirectoryPath();
   std::string getDeviceId();
   void storeConnectionConfig(folly::dynamic& config);
+  /* Use RSA keys for subsequent signing requests, for desktops that can't
+     sign other key types. Returns false if RSA was already in use. */
+  bool fallBackToRSAKeys();
 
 private:
+  struct Snapshot {
+    std::string stamp;
+    bool hasRequiredFiles = false;
+    std::string deviceId;
+    std::shared_ptr<SSLContext> sslContext;
+  };
+
   DeviceData deviceData_;
+  std::atomic<CertificateKeyType> keyType_;
+
+  // Held for all of a refresh, so that only one reads the files at a time.
+  std::mutex refreshMutex_;
+  // Only held to swap snapshot_, so that readers never wait on the files.
+  std::mutex snapshotMutex_;
+  std::shared_ptr<const Snapshot> snapshot_;
 
   std::string absoluteFilePath(const char* filename);
   bool ensureSonarDirExists();
+  void refresh();
+  std::shared_ptr<const Snapshot> snapshot();
+  void invalidate();
 
 };
 
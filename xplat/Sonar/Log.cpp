@@ -1,5 +1,12 @@
 #include "Log.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
 #ifdef __ANDROID__
 #include <android/log.h>
 #endif
@@ -7,14 +14,155 @@
 namespace facebook {
 namespace sonar {
 
-  void log(const std::string& message) {
+namespace {
+
+constexpr size_t kSlotCount = 128;
+constexpr size_t kSlotBytes = 480;
+
+/* Bounded multi producer queue of messages, one slot each, for the single
+   thread that writes them. A slot's sequence tells whose turn it is: equal
+   to the position for a producer to fill it, one past it for the writer to
+   read it. Producers never block, and never wait on the writer. */
+class LogQueue {
+ public:
+  LogQueue() {
+    for (size_t i = 0; i < kSlotCount; i++) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    std::thread([this] { run(); }).detach();
+  }
+
+  void push(LogLevel level, const std::string& message) {
+    size_t position = tail_.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+      slot = &slots_[position % kSlotCount];
+      const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+      const auto difference = static_cast<intptr_t>(sequence) -
+          static_cast<intptr_t>(position);
+      if (difference == 0) {
+        if (tail_.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (difference < 0) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        position = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    slot->level = level;
+    slot->length = std::min(message.size(), kSlotBytes);
+    memcpy(slot->text, message.data(), slot->length);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    // Doesn't take the lock, a wakeup that is missed is made up for by the
+    // writer's timeout.
+    available_.notify_one();
+  }
+
+  void flush(std::chrono::milliseconds timeout) {
+    const size_t target = tail_.load(std::memory_order_acquire);
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (written_.load(std::memory_order_acquire) < target &&
+           std::chrono::steady_clock::now() < deadline) {
+      available_.notify_one();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    LogLevel level;
+    size_t length;
+    char text[kSlotBytes];
+  };
+
+  void run() {
+    size_t head = 0;
+    while (true) {
+      Slot& slot = slots_[head % kSlotCount];
+      if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+        reportDropped();
+        std::unique_lock<std::mutex> lock(mutex_);
+        available_.wait_for(lock, std::chrono::milliseconds(50));
+        continue;
+      }
+      write(slot.level, slot.text, slot.length);
+      slot.sequence.store(head + kSlotCount, std::memory_order_release);
+      written_.store(++head, std::memory_order_release);
+    }
+  }
+
+  void reportDropped() {
+    const size_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+      const std::string message =
+          std::to_string(dropped) + " log messages dropped";
+      write(LogLevel::Warning, message.data(), message.size());
+    }
+  }
+
+  static void write(LogLevel level, const char* text, size_t length) {
   #ifdef __ANDROID__
-    __android_log_print(ANDROID_LOG_INFO, "sonar", "sonar: %s", message.c_str());
+    int priority = ANDROID_LOG_INFO;
+    switch (level) {
+      case LogLevel::Debug: priority = ANDROID_LOG_DEBUG; break;
+      case LogLevel::Info: priority = ANDROID_LOG_INFO; break;
+      case LogLevel::Warning: priority = ANDROID_LOG_WARN; break;
+      case LogLevel::Error: priority = ANDROID_LOG_ERROR; break;
+    }
+    __android_log_print(
+        priority, "sonar", "sonar: %.*s", static_cast<int>(length), text);
   #else
-    printf("sonar: %s\n", message.c_str());
+    const char* prefix = level == LogLevel::Error
+        ? "ERROR: "
+        : level == LogLevel::Warning ? "WARNING: " : "";
+    printf("sonar: %s%.*s\n", prefix, static_cast<int>(length), text);
   #endif
   }
 
+  Slot slots_[kSlotCount];
+  std::atomic<size_t> tail_{0};
+  std::atomic<size_t> written_{0};
+  std::atomic<size_t> dropped_{0};
+  std::mutex mutex_;
+  std::condition_variable available_;
+};
+
+// Never destroyed, the writer runs until the process exits.
+LogQueue& logQueue() {
+  static auto queue = new LogQueue();
+  return *queue;
+}
+
+} // namespace
+
+  void writeLog(LogLevel level, const std::string& message) {
+    logQueue().push(level, message);
+  }
+
+  void flushLog(std::chrono::milliseconds timeout) {
+    logQueue().flush(timeout);
+  }
+
+  bool LogRateLimiter::allow(
+      std::chrono::steady_clock::time_point now,
+      uint64_t& suppressed) {
+    const int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              now.time_since_epoch())
+                              .count();
+    int64_t next = nextNs_.load(std::memory_order_relaxed);
+    if (nowNs < next ||
+        !nextNs_.compare_exchange_strong(
+            next, nowNs + intervalNs_, std::memory_order_relaxed)) {
+      suppressed_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+    return true;
+  }
 
 } // namespace sonar
 } // namespace facebook
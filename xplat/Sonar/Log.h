@@ -1,11 +1,97 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string>
 
+// Messages below this level are compiled out, see LogLevel. Info by
+// default; build with -DSONAR_MIN_LOG_LEVEL=0 to see debug messages.
+#ifndef SONAR_MIN_LOG_LEVEL
+#define SONAR_MIN_LOG_LEVEL 1
+#endif
+
 namespace facebook {
 namespace sonar {
 
-  void log(const std::string& message);
+  enum class LogLevel : uint8_t {
+    Debug = 0,
+    Info = 1,
+    Warning = 2,
+    Error = 3,
+  };
+
+  constexpr bool isLogLevelEnabled(LogLevel level) {
+    return static_cast<int>(level) >= SONAR_MIN_LOG_LEVEL;
+  }
+
+  /* Queues message to be written to logcat or stdout by a thread of its
+     own, so that logging never waits on the log. Messages are truncated to
+     a few hundred bytes, and dropped, and counted, if the queue is full. */
+  void writeLog(LogLevel level, const std::string& message);
+
+  inline void log(LogLevel level, const std::string& message) {
+    if (isLogLevelEnabled(level)) {
+      writeLog(level, message);
+    }
+  }
+
+  inline void log(const std::string& message) {
+    log(LogLevel::Info, message);
+  }
+
+  /* Waits for the messages queued so far to be written, up to timeout. */
+  void flushLog(
+      std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+  /* Lets at most one message per interval through, for a log site that can
+     fire in a loop, and counts the ones it holds back. Safe to share between
+     threads. */
+  class LogRateLimiter {
+   public:
+    explicit constexpr LogRateLimiter(std::chrono::milliseconds interval)
+        : intervalNs_(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(interval)
+                  .count()) {}
+
+    /* Whether to log now. If so, suppressed is how many messages were held
+       back since the last one let through. */
+    bool allow(std::chrono::steady_clock::time_point now, uint64_t& suppressed);
+
+   private:
+    const int64_t intervalNs_;
+    std::atomic<int64_t> nextNs_{INT64_MIN};
+    std::atomic<uint64_t> suppressed_{0};
+  };
 
 } // namespace sonar
 } // namespace facebook
+
+// Same as log, but message isn't even built below SONAR_MIN_LOG_LEVEL.
+#define SONAR_LOG(level, message)                                          \
+  do {                                                                     \
+    if (::facebook::sonar::isLogLevelEnabled(level)) {                     \
+      ::facebook::sonar::writeLog(level, message);                         \
+    }                                                                      \
+  } while (0)
+
+// Logs message at most once every intervalMs from this site, noting how
+// many were suppressed meanwhile. message is only built if it is logged.
+#define SONAR_LOG_EVERY_MS(level, intervalMs, message)                     \
+  do {                                                                     \
+    if (::facebook::sonar::isLogLevelEnabled(level)) {                     \
+      static ::facebook::sonar::LogRateLimiter sonarLogLimiter{            \
+          std::chrono::milliseconds(intervalMs)};                          \
+      uint64_t sonarLogSuppressed = 0;                                     \
+      if (sonarLogLimiter.allow(                                           \
+              std::chrono::steady_clock::now(), sonarLogSuppressed)) {     \
+        ::facebook::sonar::writeLog(                                       \
+            level,                                                         \
+            sonarLogSuppressed == 0                                        \
+                ? std::string(message)                                     \
+                : std::string(message) + " (" +                            \
+                    std::to_string(sonarLogSuppressed) +                   \
+                    " more suppressed)");                                  \
+      }                                                                    \
+    }                                                                      \
+  } while (0)
@@ -0,0 +1,850 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarBroker.h"
+#include "Log.h"
+#include "SonarMessageEncoding.h"
+
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/AsyncSocketException.h>
+#include <folly/json.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+
+namespace facebook {
+namespace sonar {
+
+using folly::dynamic;
+
+namespace {
+
+constexpr size_t kLengthBytes = 4;
+constexpr size_t kReadBytes = 16 * 1024;
+constexpr int kBacklog = 16;
+constexpr uint32_t kRetryMs = 1000;
+
+// Leading NUL for the abstract namespace, which leaves no file behind and
+// needs no directory both processes can write to.
+folly::SocketAddress brokerAddress(const std::string& name) {
+  folly::SocketAddress address;
+  address.setFromPath(std::string(1, '\0') + name);
+  return address;
+}
+
+bool isSameUser(int fd) {
+#ifdef __linux__
+  struct ucred credentials;
+  socklen_t length = sizeof(credentials);
+  return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) ==
+      0 &&
+      credentials.uid == getuid();
+#else
+  // Abstract sockets only exist on Linux.
+  return false;
+#endif
+}
+
+} // namespace
+
+/**
+ One end of a broker connection. Calls onFrame for every frame read, and
+ onClose once when the connection drops or carries garbage, after which
+ it must be destroyed outside of its own callbacks. Only used on the
+ socket's event base.
+ */
+class SonarBrokerChannel : public folly::AsyncReader::ReadCallback,
+                           public folly::AsyncWriter::WriteCallback {
+ public:
+  using FrameHandler =
+      std::function<void(SonarBrokerFrameType type, std::string payload)>;
+
+  SonarBrokerChannel(
+      folly::AsyncSocket::UniquePtr socket,
+      FrameHandler onFrame,
+      std::function<void()> onClose)
+      : socket_(std::move(socket)),
+        onFrame_(std::move(onFrame)),
+        onClose_(std::move(onClose)) {
+    socket_->setReadCB(this);
+  }
+
+  ~SonarBrokerChannel() override {
+    // Failing the pending writes must not call onClose_.
+    closed_ = true;
+    socket_->setReadCB(nullptr);
+    socket_->closeNow();
+  }
+
+  void send(const std::string& frame) {
+    if (!closed_) {
+      socket_->writeChain(this, folly::IOBuf::copyBuffer(frame));
+    }
+  }
+
+  void getReadBuffer(void** buffer, size_t* length) override {
+    *buffer = readBuffer_;
+    *length = kReadBytes;
+  }
+
+  void readDataAvailable(size_t length) noexcept override {
+    reader_.append(readBuffer_, length);
+    SonarBrokerFrameType type;
+    std::string payload;
+    while (!closed_ && reader_.next(type, payload)) {
+      onFrame_(type, std::move(payload));
+    }
+    if (reader_.failed()) {
+      close();
+    }
+  }
+
+  void readEOF() noexcept override {
+    close();
+  }
+
+  void readErr(const folly::AsyncSocketException&) noexcept override {
+    close();
+  }
+
+  void writeSuccess() noexcept override {}
+
+  void writeErr(size_t, const folly::AsyncSocketException&) noexcept
+      override {
+    close();
+  }
+
+ private:
+  folly::AsyncSocket::UniquePtr socket_;
+  const FrameHandler onFrame_;
+  const std::function<void()> onClose_;
+  SonarBrokerFrameReader reader_;
+  char readBuffer_[kReadBytes];
+  bool closed_ = false;
+
+  void close() {
+    if (closed_) {
+      return;
+    }
+    closed_ = true;
+    socket_->setReadCB(nullptr);
+    onClose_();
+  }
+};
+
+std::string encodeBrokerFrame(
+    SonarBrokerFrameType type,
+    folly::StringPiece payload) {
+  const auto length = static_cast<uint32_t>(payload.size() + 1);
+  std::string frame;
+  frame.reserve(kLengthBytes + length);
+  for (size_t i = 0; i < kLengthBytes; i++) {
+    frame.push_back(static_cast<char>(length >> (i * 8)));
+  }
+  frame.push_back(static_cast<char>(type));
+  frame.append(payload.data(), payload.size());
+  return frame;
+}
+
+constexpr size_t SonarBrokerFrameReader::kMaxFrameBytes;
+
+void SonarBrokerFrameReader::append(const char* data, size_t size) {
+  if (failed_) {
+    return;
+  }
+  // Drop what was read already before growing the buffer.
+  if (offset_ > 0 && offset_ >= buffer_.size() / 2) {
+    buffer_.erase(0, offset_);
+    offset_ = 0;
+  }
+  buffer_.append(data, size);
+}
+
+bool SonarBrokerFrameReader::next(
+    SonarBrokerFrameType& type,
+    std::string& payload) {
+  if (failed_ || buffer_.size() - offset_ < kLengthBytes) {
+    return false;
+  }
+  uint32_t length = 0;
+  for (size_t i = 0; i < kLengthBytes; i++) {
+    length |= static_cast<uint32_t>(static_cast<uint8_t>(buffer_[offset_ + i]))
+        << (i * 8);
+  }
+  if (length == 0 || length > kMaxFrameBytes) {
+    failed_ = true;
+    return false;
+  }
+  if (buffer_.size() - offset_ - kLengthBytes < length) {
+    return false;
+  }
+  type = static_cast<SonarBrokerFrameType>(buffer_[offset_ + kLengthBytes]);
+  payload.assign(buffer_, offset_ + kLengthBytes + 1, length - 1);
+  offset_ += kLengthBytes + length;
+  if (offset_ == buffer_.size()) {
+    buffer_.clear();
+    offset_ = 0;
+  }
+  return true;
+}
+
+SonarBrokerWebSocket::SonarBrokerWebSocket(
+    std::unique_ptr<SonarWebSocket> socket,
+    std::string name,
+    folly::EventBase* eventBase)
+    : socket_(std::move(socket)),
+      name_(std::move(name)),
+      eventBase_(eventBase) {
+  socket_->setCallbacks(this);
+}
+
+SonarBrokerWebSocket::~SonarBrokerWebSocket() {
+  eventBase_->runImmediatelyOrRunInEventBaseThreadAndWait(
+      [this]() { closeSatellites(); });
+}
+
+void SonarBrokerWebSocket::start() {
+  eventBase_->add([this]() { listen(); });
+  socket_->start();
+}
+
+void SonarBrokerWebSocket::stop() {
+  socket_->stop();
+  eventBase_->add([this]() { closeSatellites(); });
+}
+
+void SonarBrokerWebSocket::setSuspended(bool suspended) {
+  socket_->setSuspended(suspended);
+}
+
+bool SonarBrokerWebSocket::isOpen() const {
+  return socket_->isOpen();
+}
+
+void SonarBrokerWebSocket::setCallbacks(Callbacks* callbacks) {
+  callbacks_ = callbacks;
+}
+
+void SonarBrokerWebSocket::sendMessage(const dynamic& message) {
+  if (isPluginsAnswer(message)) {
+    auto merged = message;
+    mergePlugins(merged);
+    socket_->sendMessage(std::move(merged));
+    return;
+  }
+  socket_->sendMessage(message);
+}
+
+void SonarBrokerWebSocket::sendMessage(dynamic&& message) {
+  if (isPluginsAnswer(message)) {
+    mergePlugins(message);
+  }
+  socket_->sendMessage(std::move(message));
+}
+
+void SonarBrokerWebSocket::sendExecute(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    dynamic&& params) {
+  socket_->sendExecute(api, method, std::move(params));
+}
+
+void SonarBrokerWebSocket::sendExecuteLatest(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    folly::StringPiece key,
+    dynamic&& params) {
+  socket_->sendExecuteLatest(api, method, key, std::move(params));
+}
+
+void SonarBrokerWebSocket::sendJson(std::string message) {
+  socket_->sendJson(std::move(message));
+}
+
+void SonarBrokerWebSocket::sendExecuteJson(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    std::string params) {
+  socket_->sendExecuteJson(api, method, std::move(params));
+}
+
+bool SonarBrokerWebSocket::sendSerializedExecute(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    const std::string& payload,
+    SonarMessageEncoding encoding) {
+  return socket_->sendSerializedExecute(api, method, payload, encoding);
+}
+
+SonarMessageEncoding SonarBrokerWebSocket::getEncoding() const {
+  return socket_->getEncoding();
+}
+
+bool SonarBrokerWebSocket::sendBinary(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    const dynamic& metadata,
+    std::unique_ptr<folly::IOBuf> data) {
+  return socket_->sendBinary(api, method, metadata, std::move(data));
+}
+
+bool SonarBrokerWebSocket::supportsBinary() const {
+  return socket_->supportsBinary();
+}
+
+size_t SonarBrokerWebSocket::getBufferedBytes() const {
+  return socket_->getBufferedBytes();
+}
+
+void SonarBrokerWebSocket::notifyWhenDrained() {
+  socket_->notifyWhenDrained();
+}
+
+void SonarBrokerWebSocket::setMetrics(std::shared_ptr<SonarMetrics> metrics) {
+  socket_->setMetrics(std::move(metrics));
+}
+
+void SonarBrokerWebSocket::onConnected() {
+  broadcast(SonarBrokerFrameType::Connected);
+  if (callbacks_) {
+    callbacks_->onConnected();
+  }
+}
+
+void SonarBrokerWebSocket::onDisconnected() {
+  broadcast(SonarBrokerFrameType::Disconnected);
+  if (callbacks_) {
+    callbacks_->onDisconnected();
+  }
+}
+
+void SonarBrokerWebSocket::onMessageReceived(const dynamic& message) {
+  const auto* method = message.get_ptr("method");
+  if (method && method->isString()) {
+    const auto& name = method->getString();
+    const auto* params = message.get_ptr("params");
+    if (params && !params->isObject()) {
+      params = nullptr;
+    }
+    uint64_t satellite;
+    if (name == "getPlugins") {
+      const auto* id = message.get_ptr("id");
+      if (id && id->isInt()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pluginRequests_.insert(id->getInt());
+      }
+    } else if (
+        name == "init" || name == "deinit" || name == "__sendPolicy" ||
+        name == "execute") {
+      if (params &&
+          route(params->getDefault(name == "execute" ? "api" : "plugin"),
+                satellite)) {
+        relay(satellite, folly::toJson(message));
+        return;
+      }
+    } else if (name == "initMany" || name == "deinitMany") {
+      if (relayMany(message)) {
+        return;
+      }
+    } else if (name == "cancel") {
+      // Whoever doesn't know the request ignores it.
+      std::vector<uint64_t> all;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : satellitePlugins_) {
+          all.push_back(entry.first);
+        }
+      }
+      const auto json = folly::toJson(message);
+      for (const auto each : all) {
+        relay(each, json);
+      }
+    }
+  }
+  if (callbacks_) {
+    callbacks_->onMessageReceived(message);
+  }
+}
+
+bool SonarBrokerWebSocket::willDispatch(const std::string& api) {
+  if (hasRoutes_.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (routes_.count(api)) {
+      return true;
+    }
+  }
+  return callbacks_ ? callbacks_->willDispatch(api) : false;
+}
+
+void SonarBrokerWebSocket::onOutboundQueueDrained() {
+  if (callbacks_) {
+    callbacks_->onOutboundQueueDrained();
+  }
+}
+
+bool SonarBrokerWebSocket::route(const dynamic& plugin, uint64_t& satellite) {
+  if (!plugin.isString() || !hasRoutes_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto found = routes_.find(plugin.getString());
+  if (found == routes_.end()) {
+    return false;
+  }
+  satellite = found->second;
+  return true;
+}
+
+bool SonarBrokerWebSocket::relayMany(const dynamic& message) {
+  const auto* params = message.get_ptr("params");
+  if (!params || !params->isObject() ||
+      !params->getDefault("plugins").isArray()) {
+    return false;
+  }
+  std::map<uint64_t, dynamic> relayed;
+  dynamic own = dynamic::array();
+  for (const auto& plugin : (*params)["plugins"]) {
+    uint64_t satellite;
+    if (route(plugin, satellite)) {
+      relayed.emplace(satellite, dynamic::array()).first->second.push_back(
+          plugin);
+    } else {
+      own.push_back(plugin);
+    }
+  }
+  if (relayed.empty()) {
+    return false;
+  }
+  const auto& method = message["method"];
+  for (auto& entry : relayed) {
+    // Without an id, so that only this process answers the desktop.
+    relay(
+        entry.first,
+        folly::toJson(dynamic::object("method", method)(
+            "params", dynamic::object("plugins", std::move(entry.second)))));
+  }
+  if (!own.empty()) {
+    auto ours = message;
+    ours["params"]["plugins"] = std::move(own);
+    if (callbacks_) {
+      callbacks_->onMessageReceived(ours);
+    }
+  } else if (method == "initMany" && message.count("id")) {
+    socket_->sendMessage(
+        dynamic::object("id", message["id"])("success", dynamic::object()));
+  }
+  return true;
+}
+
+bool SonarBrokerWebSocket::isPluginsAnswer(const dynamic& message) {
+  if (!message.isObject() || !message.count("success")) {
+    return false;
+  }
+  const auto* id = message.get_ptr("id");
+  if (!id || !id->isInt()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pluginRequests_.erase(id->getInt()) > 0;
+}
+
+void SonarBrokerWebSocket::mergePlugins(dynamic& message) {
+  auto& success = message["success"];
+  if (!success.isObject() || !success.getDefault("plugins").isArray()) {
+    return;
+  }
+  std::vector<std::string> sorted;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ownPlugins_.clear();
+    for (const auto& plugin : success["plugins"]) {
+      if (plugin.isString()) {
+        ownPlugins_.insert(plugin.getString());
+        sorted.push_back(plugin.getString());
+      }
+    }
+    rebuildRoutes();
+    for (const auto& entry : routes_) {
+      sorted.push_back(entry.first);
+    }
+  }
+  // Sorted so the desktop always sees the same order.
+  std::sort(sorted.begin(), sorted.end());
+  dynamic plugins = dynamic::array();
+  for (auto& plugin : sorted) {
+    plugins.push_back(std::move(plugin));
+  }
+  success["plugins"] = std::move(plugins);
+}
+
+void SonarBrokerWebSocket::rebuildRoutes() {
+  routes_.clear();
+  // Satellite ids grow, so the one that connected first wins.
+  std::map<uint64_t, const std::vector<std::string>*> ordered;
+  for (const auto& entry : satellitePlugins_) {
+    ordered.emplace(entry.first, &entry.second);
+  }
+  for (const auto& entry : ordered) {
+    for (const auto& plugin : *entry.second) {
+      if (!ownPlugins_.count(plugin)) {
+        routes_.emplace(plugin, entry.first);
+      }
+    }
+  }
+  hasRoutes_.store(!routes_.empty(), std::memory_order_release);
+}
+
+void SonarBrokerWebSocket::listen() {
+  if (server_) {
+    return;
+  }
+  server_ = folly::AsyncServerSocket::newSocket(eventBase_);
+  try {
+    server_->bind(brokerAddress(name_));
+    server_->addAcceptCallback(this, eventBase_);
+    server_->listen(kBacklog);
+    server_->startAccepting();
+  } catch (const std::exception& e) {
+    log(LogLevel::Error,
+        "Failed to listen for other processes on " + name_ + ": " + e.what());
+    server_.reset();
+  }
+}
+
+void SonarBrokerWebSocket::closeSatellites() {
+  server_.reset();
+  satellites_.clear();
+  pluginQueries_.clear();
+  std::lock_guard<std::mutex> lock(mutex_);
+  satellitePlugins_.clear();
+  rebuildRoutes();
+}
+
+void SonarBrokerWebSocket::connectionAccepted(
+    int fd,
+    const folly::SocketAddress&) noexcept {
+  if (!isSameUser(fd)) {
+    log(LogLevel::Warning, "Refused a process of another user on " + name_);
+    ::close(fd);
+    return;
+  }
+  const auto satellite = nextSatellite_++;
+  satellites_.emplace(
+      satellite,
+      std::make_unique<SonarBrokerChannel>(
+          folly::AsyncSocket::UniquePtr(new folly::AsyncSocket(eventBase_, fd)),
+          [this, satellite](SonarBrokerFrameType type, std::string payload) {
+            satelliteFrame(satellite, type, std::move(payload));
+          },
+          [this, satellite]() { satelliteClosed(satellite); }));
+  if (socket_->isOpen()) {
+    satellites_[satellite]->send(
+        encodeBrokerFrame(SonarBrokerFrameType::Connected, ""));
+  }
+  queryPlugins(satellite);
+}
+
+void SonarBrokerWebSocket::acceptError(const std::exception& ex) noexcept {
+  log(LogLevel::Warning,
+      std::string("Failed to accept a connection from another process: ") +
+          ex.what());
+}
+
+void SonarBrokerWebSocket::satelliteFrame(
+    uint64_t satellite,
+    SonarBrokerFrameType type,
+    std::string payload) {
+  if (type == SonarBrokerFrameType::ForDesktop) {
+    socket_->sendJson(std::move(payload));
+    return;
+  }
+  if (type != SonarBrokerFrameType::ForBroker) {
+    return;
+  }
+  dynamic message;
+  try {
+    message = folly::parseJson(payload);
+  } catch (const std::exception& e) {
+    log(LogLevel::Error,
+        std::string("Malformed message from another process: ") + e.what());
+    return;
+  }
+  if (message.getDefault("method") == "refreshPlugins") {
+    queryPlugins(satellite);
+    return;
+  }
+  const auto id = message.getDefault("id");
+  const auto query = id.isInt() ? pluginQueries_.find(id.getInt())
+                                : pluginQueries_.end();
+  if (query == pluginQueries_.end() || query->second != satellite) {
+    return;
+  }
+  pluginQueries_.erase(query);
+  const auto plugins = message.getDefault("success").getDefault("plugins");
+  if (!plugins.isArray()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& list = satellitePlugins_[satellite];
+    list.clear();
+    for (const auto& plugin : plugins) {
+      if (plugin.isString()) {
+        list.push_back(plugin.getString());
+      }
+    }
+    rebuildRoutes();
+  }
+  if (socket_->isOpen()) {
+    socket_->sendMessage(dynamic::object("method", "refreshPlugins"));
+  }
+}
+
+void SonarBrokerWebSocket::satelliteClosed(uint64_t satellite) {
+  const auto found = satellites_.find(satellite);
+  if (found == satellites_.end()) {
+    return;
+  }
+  // Destroyed outside of its own callbacks.
+  eventBase_->runInLoop(
+      [channel = std::shared_ptr<SonarBrokerChannel>(
+           std::move(found->second))]() {});
+  satellites_.erase(found);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!satellitePlugins_.erase(satellite)) {
+      return;
+    }
+    rebuildRoutes();
+  }
+  if (socket_->isOpen()) {
+    socket_->sendMessage(dynamic::object("method", "refreshPlugins"));
+  }
+}
+
+void SonarBrokerWebSocket::queryPlugins(uint64_t satellite) {
+  const auto channel = satellites_.find(satellite);
+  if (channel == satellites_.end()) {
+    return;
+  }
+  const auto id = nextRequestId_--;
+  pluginQueries_[id] = satellite;
+  channel->second->send(encodeBrokerFrame(
+      SonarBrokerFrameType::DesktopMessage,
+      folly::toJson(dynamic::object("id", id)("method", "getPlugins"))));
+}
+
+void SonarBrokerWebSocket::broadcast(SonarBrokerFrameType type) {
+  eventBase_->add([this, type]() {
+    const auto frame = encodeBrokerFrame(type, "");
+    for (const auto& satellite : satellites_) {
+      satellite.second->send(frame);
+    }
+  });
+}
+
+void SonarBrokerWebSocket::relay(uint64_t satellite, std::string message) {
+  eventBase_->add(
+      [this,
+       satellite,
+       frame = encodeBrokerFrame(
+           SonarBrokerFrameType::DesktopMessage, message)]() {
+        const auto channel = satellites_.find(satellite);
+        if (channel != satellites_.end()) {
+          channel->second->send(frame);
+        }
+      });
+}
+
+SonarBrokeredWebSocket::SonarBrokeredWebSocket(
+    std::string name,
+    folly::EventBase* callbackWorker,
+    folly::EventBase* connectionWorker)
+    : name_(std::move(name)),
+      callbackWorker_(callbackWorker),
+      connectionWorker_(connectionWorker) {}
+
+SonarBrokeredWebSocket::~SonarBrokeredWebSocket() {
+  connectionWorker_->runImmediatelyOrRunInEventBaseThreadAndWait([this]() {
+    started_ = false;
+    connecting_.reset();
+    channel_.reset();
+  });
+}
+
+void SonarBrokeredWebSocket::start() {
+  connectionWorker_->add([this]() {
+    if (started_) {
+      return;
+    }
+    started_ = true;
+    connect();
+  });
+}
+
+void SonarBrokeredWebSocket::stop() {
+  connectionWorker_->add([this]() {
+    started_ = false;
+    connecting_.reset();
+    channel_.reset();
+    disconnected();
+  });
+}
+
+bool SonarBrokeredWebSocket::isOpen() const {
+  return open_;
+}
+
+void SonarBrokeredWebSocket::setCallbacks(Callbacks* callbacks) {
+  callbacks_ = callbacks;
+}
+
+void SonarBrokeredWebSocket::sendMessage(const dynamic& message) {
+  // Answers to the broker's requests have negative ids, see
+  // SonarBrokerWebSocket.
+  const auto id = message.getDefault("id");
+  const auto forBroker = (id.isInt() && id.getInt() < 0) ||
+      message.getDefault("method") == "refreshPlugins";
+  send(
+      forBroker ? SonarBrokerFrameType::ForBroker
+                : SonarBrokerFrameType::ForDesktop,
+      folly::toJson(message));
+}
+
+void SonarBrokeredWebSocket::sendJson(std::string message) {
+  // Only plugins send pre-serialized messages, never one for the broker.
+  send(SonarBrokerFrameType::ForDesktop, message);
+}
+
+void SonarBrokeredWebSocket::sendExecuteJson(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    std::string params) {
+  auto payload = executeEnvelopePrefix(api, method, SonarMessageEncoding::JSON);
+  payload.append(params);
+  payload.append(executeEnvelopeSuffix(SonarMessageEncoding::JSON));
+  send(SonarBrokerFrameType::ForDesktop, payload);
+}
+
+bool SonarBrokeredWebSocket::sendSerializedExecute(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    const std::string& payload,
+    SonarMessageEncoding encoding) {
+  if (encoding != SonarMessageEncoding::JSON) {
+    return false;
+  }
+  send(SonarBrokerFrameType::ForDesktop, payload);
+  return true;
+}
+
+void SonarBrokeredWebSocket::send(
+    SonarBrokerFrameType type,
+    folly::StringPiece payload) {
+  // The broker asks for our plugins before the desktop connects.
+  if (!open_ && type == SonarBrokerFrameType::ForDesktop) {
+    return;
+  }
+  connectionWorker_->add([this, frame = encodeBrokerFrame(type, payload)]() {
+    if (channel_) {
+      channel_->send(frame);
+    }
+  });
+}
+
+void SonarBrokeredWebSocket::connect() {
+  if (!started_ || connecting_ || channel_) {
+    return;
+  }
+  connecting_ = folly::AsyncSocket::newSocket(connectionWorker_);
+  connecting_->connect(this, brokerAddress(name_));
+}
+
+void SonarBrokeredWebSocket::retryLater() {
+  connectionWorker_->runAfterDelay([this]() { connect(); }, kRetryMs);
+}
+
+void SonarBrokeredWebSocket::connectSuccess() noexcept {
+  channel_ = std::make_unique<SonarBrokerChannel>(
+      std::move(connecting_),
+      [this](SonarBrokerFrameType type, std::string payload) {
+        received(type, std::move(payload));
+      },
+      [this]() { closed(); });
+}
+
+void SonarBrokeredWebSocket::connectErr(
+    const folly::AsyncSocketException& ex) noexcept {
+  SONAR_LOG_EVERY_MS(
+      LogLevel::Debug,
+      60000,
+      std::string("Waiting for the process that owns the connection: ") +
+          ex.what());
+  connecting_.reset();
+  retryLater();
+}
+
+void SonarBrokeredWebSocket::received(
+    SonarBrokerFrameType type,
+    std::string payload) {
+  switch (type) {
+    case SonarBrokerFrameType::Connected:
+      if (!open_.exchange(true)) {
+        callbackWorker_->add([this]() {
+          if (callbacks_) {
+            callbacks_->onConnected();
+          }
+        });
+      }
+      return;
+    case SonarBrokerFrameType::Disconnected:
+      disconnected();
+      return;
+    case SonarBrokerFrameType::DesktopMessage:
+      callbackWorker_->add([this, payload = std::move(payload)]() {
+        dynamic message;
+        try {
+          message = folly::parseJson(payload);
+        } catch (const std::exception& e) {
+          log(LogLevel::Error,
+              std::string("Malformed message from the broker: ") + e.what());
+          return;
+        }
+        if (callbacks_) {
+          callbacks_->onMessageReceived(message);
+        }
+      });
+      return;
+    default:
+      return;
+  }
+}
+
+void SonarBrokeredWebSocket::closed() {
+  // Destroyed outside of its own callbacks.
+  connectionWorker_->runInLoop(
+      [channel = std::shared_ptr<SonarBrokerChannel>(std::move(channel_))]() {
+      });
+  disconnected();
+  retryLater();
+}
+
+void SonarBrokeredWebSocket::disconnected() {
+  if (open_.exchange(false)) {
+    callbackWorker_->add([this]() {
+      if (callbacks_) {
+        callbacks_->onDisconnected();
+      }
+    });
+  }
+}
+
+} // namespace sonar
+} // namespace facebook
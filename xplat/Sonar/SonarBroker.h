@@ -0,0 +1,283 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarWebSocket.h>
+#include <folly/Range.h>
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+class SonarBrokerChannel;
+
+enum class SonarBrokerFrameType : char {
+  // Broker to satellite: a message from the desktop.
+  DesktopMessage = 'M',
+  // Broker to satellite: the desktop connected or disconnected.
+  Connected = 'C',
+  Disconnected = 'X',
+  // Satellite to broker: a message to pass on to the desktop.
+  ForDesktop = 'D',
+  // Satellite to broker: an answer to the broker's own request, or a change
+  // of its plugins.
+  ForBroker = 'B',
+};
+
+/**
+ Frames of a 4 byte little-endian length, a type byte and the payload, the
+ length counting the type byte, as sent between a broker and its
+ satellites.
+ */
+std::string encodeBrokerFrame(
+    SonarBrokerFrameType type,
+    folly::StringPiece payload);
+
+class SonarBrokerFrameReader {
+ public:
+  /**
+   Frames claiming to be larger than this fail the reader, since the stream
+   can't be trusted anymore.
+   */
+  static constexpr size_t kMaxFrameBytes = 64 * 1024 * 1024;
+
+  void append(const char* data, size_t size);
+
+  /**
+   Takes the next complete frame. Returns false if there is none yet.
+   */
+  bool next(SonarBrokerFrameType& type, std::string& payload);
+
+  bool failed() const {
+    return failed_;
+  }
+
+ private:
+  std::string buffer_;
+  size_t offset_ = 0;
+  bool failed_ = false;
+};
+
+/**
+ Shares one desktop connection between the processes of a multi-process
+ app. Wraps the socket of the process that connects to the desktop and
+ listens on an abstract-namespace Unix socket for the SonarBrokeredWebSockets
+ of the other processes. Their plugins are listed along with the ones of
+ this process, and messages for them are relayed to the process they live
+ in, so the desktop sees a single app. When two processes have a plugin
+ with the same identifier, the one of this process wins, then the one of
+ the process that connected first.
+
+ Only processes of the same user may connect. Satellites are served on the
+ given event base, messages from the desktop are routed on the wrapped
+ socket's thread.
+ */
+class SonarBrokerWebSocket
+    : public SonarWebSocket,
+      private SonarWebSocket::Callbacks,
+      private folly::AsyncServerSocket::AcceptCallback {
+ public:
+  SonarBrokerWebSocket(
+      std::unique_ptr<SonarWebSocket> socket,
+      std::string name,
+      folly::EventBase* eventBase);
+
+  ~SonarBrokerWebSocket();
+
+  void start() override;
+
+  void stop() override;
+
+  /**
+   Holds the messages of the other processes too.
+   */
+  void setSuspended(bool suspended) override;
+
+  bool isOpen() const override;
+
+  void setCallbacks(Callbacks* callbacks) override;
+
+  void sendMessage(const folly::dynamic& message) override;
+
+  void sendMessage(folly::dynamic&& message) override;
+
+  void sendExecute(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      folly::dynamic&& params) override;
+
+  void sendExecuteLatest(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      folly::StringPiece key,
+      folly::dynamic&& params) override;
+
+  void sendJson(std::string message) override;
+
+  void sendExecuteJson(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      std::string params) override;
+
+  bool sendSerializedExecute(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      const std::string& payload,
+      SonarMessageEncoding encoding) override;
+
+  SonarMessageEncoding getEncoding() const override;
+
+  bool sendBinary(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      const folly::dynamic& metadata,
+      std::unique_ptr<folly::IOBuf> data) override;
+
+  bool supportsBinary() const override;
+
+  size_t getBufferedBytes() const override;
+
+  void notifyWhenDrained() override;
+
+  void setMetrics(std::shared_ptr<SonarMetrics> metrics) override;
+
+ private:
+  const std::unique_ptr<SonarWebSocket> socket_;
+  const std::string name_;
+  folly::EventBase* eventBase_;
+  Callbacks* callbacks_ = nullptr;
+
+  // Only touched on eventBase_.
+  folly::AsyncServerSocket::UniquePtr server_;
+  std::unordered_map<uint64_t, std::unique_ptr<SonarBrokerChannel>>
+      satellites_;
+  uint64_t nextSatellite_ = 0;
+  // Ids of our own getPlugins requests are negative, so they never collide
+  // with the desktop's, and map to the satellite they were sent to.
+  int64_t nextRequestId_ = -1;
+  std::unordered_map<int64_t, uint64_t> pluginQueries_;
+
+  std::mutex mutex_;
+  // All guarded by mutex_.
+  std::unordered_map<uint64_t, std::vector<std::string>> satellitePlugins_;
+  std::unordered_set<std::string> ownPlugins_;
+  // Which satellite each plugin that isn't one of ours lives in.
+  std::unordered_map<std::string, uint64_t> routes_;
+  // The desktop's getPlugins requests that this process hasn't answered yet.
+  std::unordered_set<int64_t> pluginRequests_;
+  // Whether routes_ is non-empty, so that messages for our own plugins
+  // don't need the lock while no satellite has plugins.
+  std::atomic<bool> hasRoutes_{false};
+
+  void onConnected() override;
+  void onDisconnected() override;
+  void onMessageReceived(const folly::dynamic& message) override;
+  bool willDispatch(const std::string& api) override;
+  void onOutboundQueueDrained() override;
+
+  void connectionAccepted(
+      int fd,
+      const folly::SocketAddress& clientAddr) noexcept override;
+  void acceptError(const std::exception& ex) noexcept override;
+
+  void listen();
+  void closeSatellites();
+  void satelliteFrame(
+      uint64_t satellite,
+      SonarBrokerFrameType type,
+      std::string payload);
+  void satelliteClosed(uint64_t satellite);
+  void queryPlugins(uint64_t satellite);
+  void broadcast(SonarBrokerFrameType type);
+  void relay(uint64_t satellite, std::string message);
+  // Relays the plugins of an initMany or deinitMany that live in satellites,
+  // returns false if none do.
+  bool relayMany(const folly::dynamic& message);
+  bool route(const folly::dynamic& plugin, uint64_t& satellite);
+  // Both must be called with mutex_ held.
+  void rebuildRoutes();
+  bool isPluginsAnswer(const folly::dynamic& message);
+  void mergePlugins(folly::dynamic& message);
+};
+
+/**
+ Connects a process of a multi-process app to the SonarBrokerWebSocket of
+ the process that owns the desktop connection, rather than to the desktop
+ itself. It is open while the broker is connected to the desktop. While
+ the broker can't be reached it keeps retrying, so that processes can start
+ in any order.
+ */
+class SonarBrokeredWebSocket : public SonarWebSocket,
+                               private folly::AsyncSocket::ConnectCallback {
+ public:
+  SonarBrokeredWebSocket(
+      std::string name,
+      folly::EventBase* callbackWorker,
+      folly::EventBase* connectionWorker);
+
+  ~SonarBrokeredWebSocket();
+
+  void start() override;
+
+  void stop() override;
+
+  bool isOpen() const override;
+
+  void setCallbacks(Callbacks* callbacks) override;
+
+  using SonarWebSocket::sendMessage;
+  void sendMessage(const folly::dynamic& message) override;
+
+  void sendJson(std::string message) override;
+
+  void sendExecuteJson(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      std::string params) override;
+
+  bool sendSerializedExecute(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      const std::string& payload,
+      SonarMessageEncoding encoding) override;
+
+ private:
+  const std::string name_;
+  folly::EventBase* callbackWorker_;
+  folly::EventBase* connectionWorker_;
+  Callbacks* callbacks_ = nullptr;
+  std::atomic<bool> open_{false};
+
+  // Only touched on connectionWorker_.
+  bool started_ = false;
+  folly::AsyncSocket::UniquePtr connecting_;
+  std::unique_ptr<SonarBrokerChannel> channel_;
+
+  void connectSuccess() noexcept override;
+  void connectErr(const folly::AsyncSocketException& ex) noexcept override;
+
+  void connect();
+  void retryLater();
+  void send(SonarBrokerFrameType type, folly::StringPiece payload);
+  void received(SonarBrokerFrameType type, std::string payload);
+  void closed();
+  void disconnected();
+};
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,282 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarCaptureWebSocket.h"
+#include "Log.h"
+#include <fcntl.h>
+#include <folly/json.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace facebook {
+namespace sonar {
+
+namespace {
+
+constexpr size_t kLengthBytes = 4;
+
+void putLength(char* out, uint32_t length) {
+  for (size_t i = 0; i < kLengthBytes; i++) {
+    out[i] = static_cast<char>(length >> (i * 8));
+  }
+}
+
+uint32_t getLength(const char* in) {
+  uint32_t length = 0;
+  for (size_t i = 0; i < kLengthBytes; i++) {
+    length |= static_cast<uint32_t>(static_cast<uint8_t>(in[i])) << (i * 8);
+  }
+  return length;
+}
+
+void readCaptureFile(
+    const std::string& path,
+    const std::function<void(folly::StringPiece)>& onMessage) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return;
+  }
+  const std::string contents(
+      (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  size_t offset = 0;
+  while (offset + kLengthBytes <= contents.size()) {
+    const auto length = getLength(contents.data() + offset);
+    offset += kLengthBytes;
+    if (length == 0 || offset + length > contents.size()) {
+      return;
+    }
+    onMessage(folly::StringPiece(contents.data() + offset, length));
+    offset += length;
+  }
+}
+
+} // namespace
+
+SonarCaptureWebSocket::SonarCaptureWebSocket(
+    std::string path,
+    size_t fileBytes,
+    folly::EventBase* eventBase)
+    : path_(std::move(path)),
+      fileBytes_(std::max(fileBytes, kLengthBytes * 2)),
+      eventBase_(eventBase) {}
+
+SonarCaptureWebSocket::~SonarCaptureWebSocket() {
+  open_ = false;
+  eventBase_->runImmediatelyOrRunInEventBaseThreadAndWait([this]() {
+    drain();
+    closeFile();
+  });
+}
+
+void SonarCaptureWebSocket::start() {
+  eventBase_->add([this]() {
+    if (open_ || !openFile()) {
+      return;
+    }
+    open_ = true;
+    if (callbacks_) {
+      callbacks_->onConnected();
+    }
+    requestPlugins();
+  });
+}
+
+void SonarCaptureWebSocket::stop() {
+  eventBase_->add([this]() {
+    if (!open_.exchange(false)) {
+      return;
+    }
+    drain();
+    closeFile();
+    initedPlugins_.clear();
+    if (callbacks_) {
+      callbacks_->onDisconnected();
+    }
+  });
+}
+
+bool SonarCaptureWebSocket::isOpen() const {
+  return open_;
+}
+
+void SonarCaptureWebSocket::setCallbacks(Callbacks* callbacks) {
+  callbacks_ = callbacks;
+}
+
+void SonarCaptureWebSocket::sendMessage(const folly::dynamic& message) {
+  const auto id = message.getDefault("id");
+  if (id.isInt() && id.getInt() == pluginsRequestId_) {
+    // Our own request, not plugin traffic.
+    const auto plugins =
+        message.getDefault("success").getDefault("plugins");
+    eventBase_->add([this, plugins]() { initPlugins(plugins); });
+    return;
+  }
+  if (message.getDefault("method") == "refreshPlugins") {
+    eventBase_->add([this]() { requestPlugins(); });
+    return;
+  }
+  enqueue(folly::toJson(message));
+}
+
+void SonarCaptureWebSocket::sendJson(std::string message) {
+  // Only plugins send pre-serialized messages, never one we need to look at.
+  enqueue(std::move(message));
+}
+
+void SonarCaptureWebSocket::sendExecuteJson(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    std::string params) {
+  auto payload = executeEnvelopePrefix(api, method, SonarMessageEncoding::JSON);
+  payload.append(params);
+  payload.append(executeEnvelopeSuffix(SonarMessageEncoding::JSON));
+  enqueue(std::move(payload));
+}
+
+bool SonarCaptureWebSocket::sendSerializedExecute(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    const std::string& payload,
+    SonarMessageEncoding encoding) {
+  if (encoding != SonarMessageEncoding::JSON) {
+    return false;
+  }
+  enqueue(payload);
+  return true;
+}
+
+void SonarCaptureWebSocket::enqueue(std::string payload) {
+  if (!open_) {
+    return;
+  }
+  if (queue_.push({std::move(payload), SonarMessageEncoding::JSON})) {
+    eventBase_->add([this]() { drain(); });
+  }
+}
+
+void SonarCaptureWebSocket::drain() {
+  for (const auto& message : queue_.drain()) {
+    append(message.payload);
+  }
+}
+
+void SonarCaptureWebSocket::append(const std::string& payload) {
+  if (!mapping_) {
+    return;
+  }
+  // Keep room for the terminating zero length.
+  const auto needed = kLengthBytes + payload.size();
+  if (needed + kLengthBytes > fileBytes_) {
+    droppedMessages_++;
+    return;
+  }
+  if (writeOffset_ + needed + kLengthBytes > fileBytes_) {
+    rotate();
+    if (!mapping_) {
+      return;
+    }
+  }
+  // The data goes in before its length, so a crash mid-write leaves the
+  // previous end marker in place.
+  memcpy(mapping_ + writeOffset_ + kLengthBytes, payload.data(), payload.size());
+  putLength(mapping_ + writeOffset_, static_cast<uint32_t>(payload.size()));
+  writeOffset_ += needed;
+}
+
+bool SonarCaptureWebSocket::openFile() {
+  const auto slash = path_.rfind('/');
+  if (slash != std::string::npos) {
+    mkdir(path_.substr(0, slash).c_str(), 0775);
+  }
+  fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd_ < 0) {
+    log("Failed to open capture file " + path_);
+    return false;
+  }
+  // A new file reads as zeros, which is the end marker.
+  if (ftruncate(fd_, fileBytes_) != 0) {
+    log("Failed to size capture file " + path_);
+    closeFile();
+    return false;
+  }
+  void* mapping =
+      mmap(nullptr, fileBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (mapping == MAP_FAILED) {
+    log("Failed to map capture file " + path_);
+    closeFile();
+    return false;
+  }
+  mapping_ = static_cast<char*>(mapping);
+  writeOffset_ = 0;
+  return true;
+}
+
+void SonarCaptureWebSocket::closeFile() {
+  if (mapping_) {
+    munmap(mapping_, fileBytes_);
+    mapping_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void SonarCaptureWebSocket::rotate() {
+  closeFile();
+  std::rename(path_.c_str(), (path_ + ".1").c_str());
+  openFile();
+}
+
+void SonarCaptureWebSocket::requestPlugins() {
+  if (!open_ || !callbacks_) {
+    return;
+  }
+  const auto id = nextRequestId_++;
+  pluginsRequestId_ = id;
+  callbacks_->onMessageReceived(
+      folly::dynamic::object("id", id)("method", "getPlugins"));
+}
+
+void SonarCaptureWebSocket::initPlugins(const folly::dynamic& plugins) {
+  if (!open_ || !callbacks_ || !plugins.isArray()) {
+    return;
+  }
+  for (const auto& plugin : plugins) {
+    if (!plugin.isString() || !initedPlugins_.insert(plugin.getString()).second) {
+      continue;
+    }
+    callbacks_->onMessageReceived(folly::dynamic::object("method", "init")(
+        "params", folly::dynamic::object("plugin", plugin)));
+  }
+}
+
+void SonarCaptureWebSocket::readCapture(
+    const std::string& path,
+    const std::function<void(folly::StringPiece)>& onMessage) {
+  readCaptureFile(path + ".1", onMessage);
+  readCaptureFile(path, onMessage);
+}
+
+void SonarCaptureWebSocket::replay(
+    const std::string& path,
+    SonarWebSocket& socket) {
+  readCapture(path, [&socket](folly::StringPiece message) {
+    socket.sendMessage(folly::parseJson(message));
+  });
+}
+
+} // namespace sonar
+} // namespace facebook
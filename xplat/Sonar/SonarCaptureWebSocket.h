@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarOutboundQueue.h>
+#include <Sonar/SonarWebSocket.h>
+#include <folly/Range.h>
+#include <folly/io/async/EventBase.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <unordered_set>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Records plugin traffic to a file instead of sending it to a desktop, for
+ runs where no desktop is attached. It acts as its own desktop and inits
+ every plugin once started.
+
+ Messages are appended to a memory-mapped file as records of a 4 byte
+ little-endian length followed by the serialized JSON message. A zero length
+ marks the end. Once the file is full it is moved to "<path>.1" and a new
+ one is started, so a capture never takes more than twice the file size.
+ Producers only serialize and push onto a lock-free queue; the file is only
+ written from the given event base.
+ */
+class SonarCaptureWebSocket : public SonarWebSocket {
+ public:
+  SonarCaptureWebSocket(
+      std::string path,
+      size_t fileBytes,
+      folly::EventBase* eventBase);
+
+  ~SonarCaptureWebSocket();
+
+  void start() override;
+
+  void stop() override;
+
+  bool isOpen() const override;
+
+  using SonarWebSocket::sendMessage;
+  void sendMessage(const folly::dynamic& message) override;
+
+  void sendJson(std::string message) override;
+
+  void sendExecuteJson(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      std::string params) override;
+
+  bool sendSerializedExecute(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      const std::string& payload,
+      SonarMessageEncoding encoding) override;
+
+  void setCallbacks(Callbacks* callbacks) override;
+
+  /**
+   Number of messages that were too large to fit in a capture file.
+   */
+  size_t getDroppedMessages() const {
+    return droppedMessages_;
+  }
+
+  /**
+   Calls onMessage with every message of the capture at path, oldest first,
+   including the file that was rotated out if there is one.
+   */
+  static void readCapture(
+      const std::string& path,
+      const std::function<void(folly::StringPiece)>& onMessage);
+
+  /**
+   Sends every message of the capture at path over the given socket, so a
+   desktop can look at a run it wasn't attached to.
+   */
+  static void replay(const std::string& path, SonarWebSocket& socket);
+
+ private:
+  const std::string path_;
+  const size_t fileBytes_;
+  folly::EventBase* eventBase_;
+  Callbacks* callbacks_ = nullptr;
+  std::atomic<bool> open_{false};
+  std::atomic<size_t> droppedMessages_{0};
+  SonarOutboundQueue queue_;
+
+  // Only touched on eventBase_.
+  int fd_ = -1;
+  char* mapping_ = nullptr;
+  size_t writeOffset_ = 0;
+  int64_t nextRequestId_ = 0;
+  std::unordered_set<std::string> initedPlugins_;
+  // Read by sendMessage to recognize the answer to our own request.
+  std::atomic<int64_t> pluginsRequestId_{-1};
+
+  void enqueue(std::string payload);
+  void drain();
+  void append(const std::string& payload);
+  bool openFile();
+  void closeFile();
+  void rotate();
+  void requestPlugins();
+  void initPlugins(const folly::dynamic& plugins);
+};
+
+} // namespace sonar
+} // namespace facebook
@@ -7,13 +7,21 @@
  */
 
 #include "SonarClient.h"
+#include "SonarBroker.h"
+#include "SonarCaptureWebSocket.h"
+#include "SonarConditionedWebSocket.h"
 #include "SonarConnectionImpl.h"
+#include "SonarDeferredWebSocket.h"
+#include "SonarMemoryBudget.h"
 #include "SonarResponderImpl.h"
 #include "SonarState.h"
 #include "SonarStep.h"
+#include "SonarThreadCpu.h"
+#include "SonarTrace.h"
 #include "SonarWebSocketImpl.h"
 #include "ConnectionContextStore.h"
 #include "Log.h"
+#include <algorithm>
 #include <vector>
 
 #if FB_SONARKIT_ENABLED
@@ -25,175 +33,684 @@ static SonarClient* kInstance;
 
 using folly::dynamic;
 
+namespace {
+
+enum class DesktopMethod {
+  Execute,
+  Cancel,
+  Metrics,
+  GetPlugins,
+  Init,
+  Deinit,
+  InitMany,
+  DeinitMany,
+  SendPolicy,
+  Unknown,
+};
+
+// One hash lookup instead of comparing against every method in turn.
+DesktopMethod resolveMethod(const dynamic& method) {
+  static const auto methods =
+      new std::unordered_map<std::string, DesktopMethod>{
+          {"execute", DesktopMethod::Execute},
+          {"cancel", DesktopMethod::Cancel},
+          {"__metrics", DesktopMethod::Metrics},
+          {"getPlugins", DesktopMethod::GetPlugins},
+          {"init", DesktopMethod::Init},
+          {"deinit", DesktopMethod::Deinit},
+          {"initMany", DesktopMethod::InitMany},
+          {"deinitMany", DesktopMethod::DeinitMany},
+          {"__sendPolicy", DesktopMethod::SendPolicy},
+      };
+  if (!method.isString()) {
+    return DesktopMethod::Unknown;
+  }
+  const auto iter = methods->find(method.getString());
+  return iter == methods->end() ? DesktopMethod::Unknown : iter->second;
+}
+
+} // namespace
+
+namespace {
+
+std::unique_ptr<SonarWebSocket> createSocket(
+    SonarInitConfig config,
+    std::shared_ptr<SonarState> state) {
+  // Keep listener and UI work off the threads that record connection steps.
+  state->setUpdateExecutor(config.callbackWorker);
+  SonarMemoryBudget::shared().setCapBytes(config.memoryBudgetBytes);
+  // What runs on them is what Sonar costs the app, see SonarFramesPlugin.
+  config.callbackWorker->runInEventBaseThread(registerSonarThread);
+  if (config.connectionWorker != config.callbackWorker) {
+    config.connectionWorker->runInEventBaseThread(registerSonarThread);
+  }
+  const auto brokerSocketName = config.brokerSocketName;
+  const auto linkConditions = config.linkConditions;
+  const auto callbackWorker = config.callbackWorker;
+  const auto connectionWorker = config.connectionWorker;
+  if (!brokerSocketName.empty() && !config.brokerOwner) {
+    // Needs neither certificates nor the desktop's address.
+    return std::make_unique<SonarBrokeredWebSocket>(
+        brokerSocketName, callbackWorker, connectionWorker);
+  }
+  auto context = std::make_shared<ConnectionContextStore>(
+      config.deviceData, config.certificateKeyType);
+  std::unique_ptr<SonarWebSocket> socket =
+      std::make_unique<SonarWebSocketImpl>(
+          std::move(config), std::move(state), std::move(context));
+  if (linkConditions.enabled) {
+    socket = std::make_unique<SonarConditionedWebSocket>(
+        std::move(socket), linkConditions, callbackWorker);
+  }
+  if (brokerSocketName.empty()) {
+    return socket;
+  }
+  return std::make_unique<SonarBrokerWebSocket>(
+      std::move(socket), brokerSocketName, connectionWorker);
+}
+
+void addCaptureSocket(SonarClient* client, const SonarInitConfig& config) {
+  if (config.captureFileBytes > 0) {
+    client->addSocket(std::make_unique<SonarCaptureWebSocket>(
+        config.deviceData.privateAppDirectory + "/sonar/capture.log",
+        config.captureFileBytes,
+        config.callbackWorker));
+  }
+}
+
+} // namespace
+
 void SonarClient::init(SonarInitConfig config) {
   auto state = std::make_shared<SonarState>();
-  auto context = std::make_shared<ConnectionContextStore>(config.deviceData);
-  kInstance =
-      new SonarClient(std::make_unique<SonarWebSocketImpl>(std::move(config), state, context), state);
+  const auto captureConfig = config;
+  kInstance = new SonarClient(
+      createSocket(std::move(config), state),
+      state,
+      captureConfig.callbackWorker);
+  addCaptureSocket(kInstance, captureConfig);
+  kInstance->watchLoops(captureConfig);
+}
+
+void SonarClient::initDeferred(std::function<SonarInitConfig()> makeConfig) {
+  auto state = std::make_shared<SonarState>();
+  auto socket = std::make_unique<SonarDeferredWebSocket>(
+      [makeConfig = std::move(makeConfig), state]() {
+        auto config = makeConfig();
+        // Runs inside the first start(), ahead of the observers being
+        // started, so the capture socket is started along with them.
+        addCaptureSocket(kInstance, config);
+        kInstance->setRefreshEventBase(config.callbackWorker);
+        kInstance->watchLoops(config);
+        return createSocket(std::move(config), state);
+      });
+  kInstance = new SonarClient(std::move(socket), state);
 }
 
 SonarClient* SonarClient::instance() {
   return kInstance;
 }
 
+void SonarClient::watchLoops(const SonarInitConfig& config) {
+  if (config.loopStallThresholdMs <= 0) {
+    return;
+  }
+  watchdog_ = std::make_unique<SonarLoopWatchdog>(
+      metrics_,
+      std::chrono::milliseconds(100),
+      std::chrono::milliseconds(config.loopStallThresholdMs));
+  watchdog_->watch("callback", config.callbackWorker);
+  watchdog_->watch("connection", config.connectionWorker);
+  watchdog_->start();
+}
+
 void SonarClient::setStateListener(
     std::shared_ptr<SonarStateUpdateListener> stateListener) {
-  log("Setting state listener");
+  SONAR_LOG(LogLevel::Debug, "Setting state listener");
   sonarState_->setUpdateListener(stateListener);
 }
 
-void SonarClient::addPlugin(std::shared_ptr<SonarPlugin> plugin) {
-  log("SonarClient::addPlugin " + plugin->identifier());
+void SonarClient::addPlugin(
+    std::shared_ptr<SonarPlugin> plugin,
+    std::shared_ptr<folly::Executor> executor) {
+  SONAR_LOG(LogLevel::Debug, "SonarClient::addPlugin " + plugin->identifier());
   auto step = sonarState_->start("Add plugin " + plugin->identifier());
 
-  std::lock_guard<std::mutex> lock(mutex_);
-  performAndReportError([this, plugin, step]() {
-    if (plugins_.find(plugin->identifier()) != plugins_.end()) {
+  auto lock = metrics_->clientLock().lock(mutex_);
+  performAndReportError([this, plugin, executor, step]() {
+    if (pluginFactories_.count(plugin->identifier()) ||
+        !plugins_.emplace(plugin->identifier(), plugin).second) {
       throw std::out_of_range(
           "plugin " + plugin->identifier() + " already added.");
     }
-    plugins_[plugin->identifier()] = plugin;
+    if (executor) {
+      pluginExecutors_[plugin->identifier()] = executor;
+    }
     step->complete();
-    if (connected_) {
-      refreshPlugins();
+    scheduleRefresh();
+  });
+}
+
+void SonarClient::addPlugins(
+    const std::vector<std::shared_ptr<SonarPlugin>>& plugins,
+    std::shared_ptr<folly::Executor> executor) {
+  auto lock = metrics_->clientLock().lock(mutex_);
+  for (const auto& plugin : plugins) {
+    SONAR_LOG(LogLevel::Debug, "SonarClient::addPlugins " + plugin->identifier());
+    auto step = sonarState_->start("Add plugin " + plugin->identifier());
+    performAndReportError([this, &plugin, &executor, step]() {
+      if (pluginFactories_.count(plugin->identifier()) ||
+          !plugins_.emplace(plugin->identifier(), plugin).second) {
+        throw std::out_of_range(
+            "plugin " + plugin->identifier() + " already added.");
+      }
+      if (executor) {
+        pluginExecutors_[plugin->identifier()] = executor;
+      }
+      step->complete();
+    });
+  }
+  scheduleRefresh();
+}
+
+void SonarClient::addPluginFactory(
+    const std::string& identifier,
+    std::function<std::shared_ptr<SonarPlugin>()> factory,
+    std::shared_ptr<folly::Executor> executor) {
+  SONAR_LOG(LogLevel::Debug, "SonarClient::addPluginFactory " + identifier);
+  auto step = sonarState_->start("Add plugin factory " + identifier);
+
+  auto lock = metrics_->clientLock().lock(mutex_);
+  performAndReportError([this, &identifier, &factory, executor, step]() {
+    if (plugins_.count(identifier) ||
+        !pluginFactories_.emplace(identifier, std::move(factory)).second) {
+      throw std::out_of_range("plugin " + identifier + " already added.");
+    }
+    if (executor) {
+      pluginExecutors_[identifier] = executor;
     }
+    step->complete();
+    scheduleRefresh();
   });
 }
 
+std::shared_ptr<SonarPlugin> SonarClient::findPlugin(
+    folly::StringPiece identifier) {
+  const auto plugin = plugins_.find(identifier);
+  if (plugin != plugins_.end()) {
+    return plugin->second;
+  }
+  const auto factory = pluginFactories_.find(identifier);
+  if (factory == pluginFactories_.end()) {
+    return nullptr;
+  }
+  auto step = sonarState_->start("Create plugin " + identifier.str());
+  // Taken out first, so that a factory that throws isn't called again.
+  const auto create = std::move(factory->second);
+  pluginFactories_.erase(factory);
+  auto created = create();
+  if (!created || created->identifier() != identifier) {
+    throw std::out_of_range(
+        "factory for plugin " + identifier.str() +
+        " created a different plugin.");
+  }
+  plugins_.emplace(identifier, created);
+  step->complete();
+  return created;
+}
+
+std::pair<std::shared_ptr<SonarPlugin>, std::shared_ptr<SonarConnectionImpl>>
+SonarClient::initPlugin(
+    const std::string& identifier,
+    SonarWebSocket* socket,
+    const dynamic& method) {
+  const auto plugin = findPlugin(identifier);
+  if (!plugin) {
+    throw std::out_of_range(
+        "plugin " + identifier + " not found for method " +
+        method.getString());
+  }
+  const auto executor = pluginExecutors_.find(identifier);
+  auto& conn = connections_[identifier];
+  if (conn && !conn->hasSocket(socket)) {
+    // Another desktop is already looking at the plugin, share its
+    // connection.
+    conn->addSocket(socket);
+    return {plugin, nullptr};
+  }
+  const auto previous = conn;
+  if (previous) {
+    previous->deactivate();
+  }
+  conn = std::make_shared<SonarConnectionImpl>(
+      socket,
+      identifier,
+      executor == pluginExecutors_.end() ? nullptr : executor->second,
+      metrics_);
+  if (previous) {
+    for (const auto other : *previous->getSockets()) {
+      if (other != socket) {
+        conn->addSocket(other);
+      }
+    }
+  }
+  const auto policies = sendPolicies_.find(identifier);
+  if (policies != sendPolicies_.end()) {
+    for (const auto& policy : policies->second) {
+      conn->setSendPolicy(policy.first, policy.second);
+    }
+  }
+  return {plugin, conn};
+}
+
 void SonarClient::removePlugin(std::shared_ptr<SonarPlugin> plugin) {
-  log("SonarClient::removePlugin " + plugin->identifier());
+  SONAR_LOG(LogLevel::Debug, "SonarClient::removePlugin " + plugin->identifier());
 
-  std::lock_guard<std::mutex> lock(mutex_);
+  auto lock = metrics_->clientLock().lock(mutex_);
   performAndReportError([this, plugin]() {
     if (plugins_.find(plugin->identifier()) == plugins_.end()) {
       throw std::out_of_range("plugin " + plugin->identifier() + " not added.");
     }
     disconnect(plugin);
     plugins_.erase(plugin->identifier());
-    if (connected_) {
-      refreshPlugins();
-    }
+    pluginExecutors_.erase(plugin->identifier());
+    scheduleRefresh();
   });
 }
 
 std::shared_ptr<SonarPlugin> SonarClient::getPlugin(
-    const std::string& identifier) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (plugins_.find(identifier) == plugins_.end()) {
-    return nullptr;
+    folly::StringPiece identifier) {
+  auto lock = metrics_->clientLock().lock(mutex_);
+  std::shared_ptr<SonarPlugin> plugin;
+  performAndReportError([this, &identifier, &plugin]() {
+    plugin = findPlugin(identifier);
+  });
+  return plugin;
+}
+
+bool SonarClient::hasPlugin(folly::StringPiece identifier) {
+  auto lock = metrics_->clientLock().lock(mutex_);
+  return plugins_.find(identifier) != plugins_.end() ||
+      pluginFactories_.find(identifier) != pluginFactories_.end();
+}
+
+bool SonarClient::isPluginActive(folly::StringPiece identifier) const {
+  if (!connected_) {
+    return false;
   }
-  return plugins_.at(identifier);
+  const auto active = std::atomic_load(&activeConnections_);
+  return active->find(identifier) != active->end();
+}
+
+void SonarClient::addSocket(std::unique_ptr<SonarWebSocket> socket) {
+  auto raw = socket.get();
+  auto lock = metrics_->clientLock().lock(mutex_);
+  observers_.push_back(std::make_unique<Observer>(
+      Observer{ObserverCallbacks(this, raw), std::move(socket)}));
+  raw->setCallbacks(&observers_.back()->callbacks);
+  raw->setMetrics(metrics_);
 }
 
-bool SonarClient::hasPlugin(const std::string& identifier) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  return plugins_.find(identifier) != plugins_.end();
+void SonarClient::disconnect(
+    std::shared_ptr<SonarPlugin> plugin,
+    SonarWebSocket* socket) {
+  const auto conn = connections_.find(plugin->identifier());
+  if (conn != connections_.end() && conn->second->removeSocket(socket) == 0) {
+    disconnect(plugin);
+  }
 }
 
 void SonarClient::disconnect(std::shared_ptr<SonarPlugin> plugin) {
-  const auto& conn = connections_.find(plugin->identifier());
+  const auto conn = connections_.find(plugin->identifier());
   if (conn != connections_.end()) {
-    connections_.erase(plugin->identifier());
+    conn->second->deactivate();
+    connections_.erase(conn);
+    publishConnections();
     plugin->didDisconnect();
   }
 }
 
+void SonarClient::publishConnections() {
+  std::atomic_store(
+      &activeConnections_,
+      std::shared_ptr<const Connections>(
+          std::make_shared<Connections>(connections_)));
+}
+
+void SonarClient::scheduleRefresh() {
+  getPluginsResponse_ = nullptr;
+  if (!connected_) {
+    // Desktops fetch the plugins when they connect anyway.
+    return;
+  }
+  if (!refreshEventBase_) {
+    refreshPlugins();
+    return;
+  }
+  if (refreshScheduled_) {
+    return;
+  }
+  refreshScheduled_ = true;
+  refreshEventBase_->runInEventBaseThread([this]() {
+    auto lock = metrics_->clientLock().lock(mutex_);
+    refreshScheduled_ = false;
+    if (connected_) {
+      refreshPlugins();
+    }
+  });
+}
+
+void SonarClient::setRefreshEventBase(folly::EventBase* eventBase) {
+  auto lock = metrics_->clientLock().lock(mutex_);
+  refreshEventBase_ = eventBase;
+}
+
 void SonarClient::refreshPlugins() {
   dynamic message = dynamic::object("method", "refreshPlugins");
   socket_->sendMessage(message);
+  for (const auto& observer : observers_) {
+    observer->socket->sendMessage(message);
+  }
 }
 
 void SonarClient::onConnected() {
+  socketConnected(socket_.get());
+}
+
+void SonarClient::onDisconnected() {
+  socketDisconnected(socket_.get());
+}
+
+void SonarClient::onMessageReceived(const dynamic& message) {
+  SONAR_TRACE_SCOPE("onMessageReceived");
+  messageReceived(socket_.get(), message);
+}
+
+void SonarClient::onOutboundQueueDrained() {
+  socketDrained(socket_.get());
+}
+
+bool SonarClient::willDispatch(const std::string& api) {
+  // Errs on the side of parsing, a plugin that is active for another
+  // desktop still gets the right error from messageReceived.
+  return isPluginActive(api);
+}
+
+void SonarClient::socketConnected(SonarWebSocket* socket) {
   log("SonarClient::onConnected");
 
-  std::lock_guard<std::mutex> lock(mutex_);
+  auto lock = metrics_->clientLock().lock(mutex_);
+  connectedSockets_.insert(socket);
   connected_ = true;
 }
 
-void SonarClient::onDisconnected() {
+void SonarClient::socketDisconnected(SonarWebSocket* socket) {
   log("SonarClient::onDisconnected");
   auto step = sonarState_->start("Trigger onDisconnected callbacks");
-  std::lock_guard<std::mutex> lock(mutex_);
-  connected_ = false;
-  performAndReportError([this, step]() {
-    for (const auto& iter : plugins_) {
-      disconnect(iter.second);
-    }
-    step->complete();
-  });
+  auto lock = metrics_->clientLock().lock(mutex_);
+  connectedSockets_.erase(socket);
+  connected_ = !connectedSockets_.empty();
+  performAndReportError(
+      [this, step, socket]() {
+        for (const auto& iter : plugins_) {
+          disconnect(iter.second, socket);
+        }
+        step->complete();
+      },
+      socket);
 }
 
-void SonarClient::onMessageReceived(const dynamic& message) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  performAndReportError([this, &message]() {
+void SonarClient::messageReceived(
+    SonarWebSocket* socket,
+    const dynamic& message) {
+  performAndReportError([this, socket, &message]() {
     const auto& method = message["method"];
     const auto& params = message.getDefault("params");
+    const auto resolved = resolveMethod(method);
 
-    std::unique_ptr<SonarResponderImpl> responder;
-    if (message.find("id") != message.items().end()) {
-      responder.reset(
-          new SonarResponderImpl(socket_.get(), message["id"].getInt()));
+    if (resolved == DesktopMethod::Cancel) {
+      cancelRequest(params["id"].getInt());
+      return;
     }
 
-    if (method == "getPlugins") {
-      dynamic identifiers = dynamic::array();
-      for (const auto& elem : plugins_) {
-        identifiers.push_back(elem.first);
-      }
-      dynamic response = dynamic::object("plugins", identifiers);
-      responder->success(response);
-      return;
+    std::unique_ptr<SonarResponderImpl> responder;
+    if (message.find("id") != message.items().end()) {
+      responder.reset(new SonarResponderImpl(
+          socket,
+          message["id"].getInt(),
+          resolved == DesktopMethod::Execute ? trackRequest(message) : nullptr,
+          message.getDefault("chunked", false).asBool()));
     }
 
-    if (method == "init") {
-      const auto identifier = params["plugin"].getString();
-      if (plugins_.find(identifier) == plugins_.end()) {
+    if (resolved == DesktopMethod::Execute) {
+      // Look the connection up in the published copy, so that execute calls
+      // don't take the client lock at all. The shared_ptr keeps the
+      // connection alive even if the receiver deinits the plugin.
+      const auto& identifier = params["api"].getString();
+      const auto connections = std::atomic_load(&activeConnections_);
+      const auto connection = connections->find(identifier);
+      if (connection == connections->end() ||
+          !connection->second->hasSocket(socket)) {
         throw std::out_of_range(
-            "plugin " + identifier + " not found for method " +
+            "connection " + identifier + " not found for method " +
             method.getString());
       }
-      const auto plugin = plugins_.at(identifier);
-      auto& conn = connections_[plugin->identifier()];
-      conn = std::make_shared<SonarConnectionImpl>(
-          socket_.get(), plugin->identifier());
-      plugin->didConnect(conn);
+      connection->second->call(
+          params["method"].getString(),
+          params.getDefault("params"),
+          std::move(responder));
       return;
     }
 
-    if (method == "deinit") {
-      const auto identifier = params["plugin"].getString();
-      if (plugins_.find(identifier) == plugins_.end()) {
-        throw std::out_of_range(
-            "plugin " + identifier + " not found for method " +
-            method.getString());
+    if (resolved == DesktopMethod::Metrics) {
+      if (responder) {
+        responder->success(getMetrics());
       }
-      const auto plugin = plugins_.at(identifier);
-      disconnect(plugin);
       return;
     }
 
-    if (method == "execute") {
-      const auto identifier = params["api"].getString();
-      if (connections_.find(identifier) == connections_.end()) {
-        throw std::out_of_range(
-            "connection " + identifier + " not found for method " +
-            method.getString());
+    auto lock = metrics_->clientLock().lock(mutex_);
+
+    switch (resolved) {
+      case DesktopMethod::GetPlugins: {
+        // Desktops ask again on every reconnect, so the response is kept
+        // until the plugins change, see scheduleRefresh.
+        if (getPluginsResponse_.isNull()) {
+          // Sorted so the desktop always sees the same order.
+          std::vector<std::string> sorted;
+          sorted.reserve(plugins_.size() + pluginFactories_.size());
+          for (const auto& elem : plugins_) {
+            sorted.push_back(elem.first.str());
+          }
+          for (const auto& elem : pluginFactories_) {
+            sorted.push_back(elem.first.str());
+          }
+          std::sort(sorted.begin(), sorted.end());
+          dynamic identifiers = dynamic::array();
+          for (auto& identifier : sorted) {
+            identifiers.push_back(std::move(identifier));
+          }
+          getPluginsResponse_ =
+              dynamic::object("plugins", std::move(identifiers));
+        }
+        // Through success rather than successJson, so that the broker and
+        // capture sockets, which only look at sendMessage, see the answer.
+        responder->success(getPluginsResponse_);
+        return;
       }
-      const auto& conn = connections_.at(params["api"].getString());
-      conn->call(
-          params["method"].getString(),
-          params.getDefault("params"),
-          std::move(responder));
-      return;
+
+      case DesktopMethod::Init: {
+        const auto& identifier = params["plugin"].getString();
+        const auto connecting = initPlugin(identifier, socket, method);
+        if (connecting.second) {
+          publishConnections();
+          connecting.first->didConnect(connecting.second);
+        }
+        return;
+      }
+
+      case DesktopMethod::InitMany: {
+        // Every connection is published at once, then plugins with an
+        // executor of their own connect on it, in parallel with the rest.
+        std::vector<std::pair<
+            std::shared_ptr<SonarPlugin>,
+            std::shared_ptr<SonarConnectionImpl>>>
+            connecting;
+        for (const auto& identifier : params["plugins"]) {
+          performAndReportError(
+              [&]() {
+                auto plugin =
+                    initPlugin(identifier.getString(), socket, method);
+                if (plugin.second) {
+                  connecting.push_back(std::move(plugin));
+                }
+              },
+              socket);
+        }
+        publishConnections();
+        for (const auto& plugin : connecting) {
+          const auto executor =
+              pluginExecutors_.find(plugin.first->identifier());
+          if (executor == pluginExecutors_.end()) {
+            performAndReportError(
+                [&]() { plugin.first->didConnect(plugin.second); }, socket);
+            continue;
+          }
+          executor->second->add([plugin]() {
+            // Skipped if the plugin was deinited in the meantime.
+            if (!plugin.second->isActive()) {
+              return;
+            }
+            try {
+              plugin.first->didConnect(plugin.second);
+            } catch (const std::exception& e) {
+              plugin.second->error(e.what(), "<none>");
+            }
+          });
+        }
+        // Desktops call initMany rather than send it, and fall back to init
+        // on clients that don't know it.
+        if (responder) {
+          responder->success(dynamic::object());
+        }
+        return;
+      }
+
+      case DesktopMethod::Deinit: {
+        const auto& identifier = params["plugin"].getString();
+        const auto plugin = plugins_.find(identifier);
+        if (plugin == plugins_.end()) {
+          throw std::out_of_range(
+              "plugin " + identifier + " not found for method " +
+              method.getString());
+        }
+        disconnect(plugin->second, socket);
+        return;
+      }
+
+      case DesktopMethod::DeinitMany: {
+        for (const auto& identifier : params["plugins"]) {
+          performAndReportError(
+              [&]() {
+                const auto plugin = plugins_.find(identifier.getString());
+                if (plugin == plugins_.end()) {
+                  throw std::out_of_range(
+                      "plugin " + identifier.getString() +
+                      " not found for method " + method.getString());
+                }
+                disconnect(plugin->second, socket);
+              },
+              socket);
+        }
+        return;
+      }
+
+      case DesktopMethod::SendPolicy: {
+        // Limits one method of a plugin, or lifts the limits if params has
+        // no rate and no sampleEvery. Responds with the plugin's policies
+        // and what they dropped so far.
+        const auto& identifier = params["plugin"].getString();
+        const auto& pluginMethod = params["method"].getString();
+        const auto policy = SonarSendPolicy::fromDynamic(params);
+        auto& policies = sendPolicies_[identifier];
+        if (policy.isUnlimited()) {
+          policies.erase(pluginMethod);
+        } else {
+          policies[pluginMethod] = policy;
+        }
+        const auto conn = connections_.find(identifier);
+        dynamic result = dynamic::object();
+        if (conn != connections_.end() && conn->second) {
+          conn->second->setSendPolicy(pluginMethod, policy);
+          result = conn->second->getSendPolicies();
+        } else {
+          for (const auto& iter : policies) {
+            result[iter.first] = iter.second.toDynamic();
+          }
+        }
+        if (policies.empty()) {
+          sendPolicies_.erase(identifier);
+        }
+        if (responder) {
+          responder->success(dynamic::object("policies", std::move(result)));
+        }
+        return;
+      }
+
+      default:
+        break;
     }
 
-    dynamic response =
-        dynamic::object("message", "Received unknown method: " + method);
-    responder->error(response);
-  });
+    responder->error(
+        dynamic::object("message", "Received unknown method: " + method));
+  }, socket);
+}
+
+void SonarClient::socketDrained(SonarWebSocket* socket) {
+  auto lock = metrics_->clientLock().lock(mutex_);
+  for (const auto& iter : connections_) {
+    if (iter.second->hasSocket(socket)) {
+      iter.second->onSocketDrained();
+    }
+  }
+}
+
+std::shared_ptr<SonarRequestCancellation> SonarClient::trackRequest(
+    const dynamic& message) {
+  static constexpr size_t kPruneThreshold = 64;
+
+  auto cancellation = std::make_shared<SonarRequestCancellation>();
+  const auto timeout = message.find("timeout");
+  if (timeout != message.items().end()) {
+    cancellation->deadline = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(timeout->second.asInt());
+  }
+
+  std::lock_guard<std::mutex> lock(inFlightMutex_);
+  if (inFlightRequests_.size() >= kPruneThreshold) {
+    for (auto iter = inFlightRequests_.begin();
+         iter != inFlightRequests_.end();) {
+      iter = iter->second.expired() ? inFlightRequests_.erase(iter) : ++iter;
+    }
+  }
+  inFlightRequests_[message["id"].getInt()] = cancellation;
+  return cancellation;
 }
 
-void SonarClient::performAndReportError(const std::function<void()>& func) {
+void SonarClient::cancelRequest(int64_t id) {
+  std::lock_guard<std::mutex> lock(inFlightMutex_);
+  const auto request = inFlightRequests_.find(id);
+  if (request == inFlightRequests_.end()) {
+    return;
+  }
+  if (const auto cancellation = request->second.lock()) {
+    cancellation->cancelled = true;
+  }
+  inFlightRequests_.erase(request);
+}
+
+void SonarClient::performAndReportError(
+    const std::function<void()>& func,
+    SonarWebSocket* socket) {
   try {
     func();
   } catch (std::exception& e) {
@@ -201,16 +718,21 @@ void SonarClient::performAndReportError(const std::function<void()>& func) {
       dynamic message = dynamic::object(
           "error",
           dynamic::object("message", e.what())("stacktrace", "<none>"));
-      socket_->sendMessage(message);
+      (socket ? socket : socket_.get())->sendMessage(message);
     }
   }
 }
 
-std::string SonarClient::getState() {
+folly::dynamic SonarClient::getMetrics() const {
+  return metrics_->toDynamic();
+}
+
+std::shared_ptr<const std::string> SonarClient::getState() {
   return sonarState_->getState();
 }
 
-std::vector<StateElement> SonarClient::getStateElements() {
+std::shared_ptr<const std::vector<StateElement>>
+SonarClient::getStateElements() {
   return sonarState_->getStateElements();
 }
 
@@ -10,11 +10,21 @@
 
 #include <Sonar/SonarConnectionImpl.h>
 #include <Sonar/SonarInitConfig.h>
+#include <Sonar/SonarLoopWatchdog.h>
+#include <Sonar/SonarMetrics.h>
+#include <Sonar/SonarNameMap.h>
 #include <Sonar/SonarPlugin.h>
+#include <Sonar/SonarResponderImpl.h>
 #include <Sonar/SonarState.h>
 #include <Sonar/SonarWebSocket.h>
-#include <map>
+#include <folly/Executor.h>
+#include <folly/io/async/EventBase.h>
+#include <atomic>
+#include <functional>
 #include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include "SonarStep.h"
 #include <vector>
 
@@ -29,6 +39,14 @@ class SonarClient : public SonarWebSocket::Callbacks {
    */
   static void init(SonarInitConfig config);
 
+  /**
+   Same as init, but defers everything a connection needs, such as its
+   threads, certificates and files, to the first start(). makeConfig is
+   called once, on the thread that first calls start(), so it can create the
+   workers it returns. Plugins can be added in the meantime.
+   */
+  static void initDeferred(std::function<SonarInitConfig()> makeConfig);
+
   /**
    Standard accessor for the shared SonarClient instance. This returns a
    singleton instance to a shared SonarClient. First call to this function will
@@ -38,34 +56,115 @@ class SonarClient : public SonarWebSocket::Callbacks {
   static SonarClient* instance();
 
   /**
-   Only public for testing
+   Only public for testing. With a refreshEventBase, the desktop is told
+   about added and removed plugins once per turn of its loop rather than
+   after every change.
    */
-  SonarClient(std::unique_ptr<SonarWebSocket> socket, std::shared_ptr<SonarState> state)
-      : socket_(std::move(socket)), sonarState_(state) {
+  SonarClient(
+      std::unique_ptr<SonarWebSocket> socket,
+      std::shared_ptr<SonarState> state,
+      folly::EventBase* refreshEventBase = nullptr)
+      : socket_(std::move(socket)),
+        sonarState_(state),
+        refreshEventBase_(refreshEventBase) {
     auto step = sonarState_->start("Create client");
     socket_->setCallbacks(this);
+    socket_->setMetrics(metrics_);
     step->complete();
   }
 
   void start() {
     auto step = sonarState_->start("Start client");
     socket_->start();
+    for (const auto& observer : observers_) {
+      observer->socket->start();
+    }
+    step->complete();
+  }
+
+  /**
+   For when the app goes to the background, instead of stop(), which
+   disconnects every plugin and has to set everything up again on start().
+   Plugin messages are held until resume(), within
+   SonarInitConfig::suspendedBufferBytes, and a dropped connection is only
+   reconnected or resumed then. The connection, its TLS context and the
+   plugins connected over it are kept, so resuming is nearly instant.
+   */
+  void suspend() {
+    auto step = sonarState_->start("Suspend client");
+    socket_->setSuspended(true);
+    for (const auto& observer : observers_) {
+      observer->socket->setSuspended(true);
+    }
+    step->complete();
+  }
+
+  void resume() {
+    auto step = sonarState_->start("Resume client");
+    socket_->setSuspended(false);
+    for (const auto& observer : observers_) {
+      observer->socket->setSuspended(false);
+    }
     step->complete();
   }
 
   void stop() {
     auto step = sonarState_->start("Stop client");
     socket_->stop();
+    for (const auto& observer : observers_) {
+      observer->socket->stop();
+    }
     step->complete();
   }
 
+  /**
+   Adds a connection to another desktop, such as a recorder attached next to
+   an engineer's desktop. Each desktop inits plugins on its own, and plugin
+   messages are serialized once and sent to every desktop that has inited
+   the plugin. Must be called before start().
+   */
+  void addSocket(std::unique_ptr<SonarWebSocket> socket);
+
   void onConnected() override;
 
   void onDisconnected() override;
 
   void onMessageReceived(const folly::dynamic& message) override;
 
-  void addPlugin(std::shared_ptr<SonarPlugin> plugin);
+  void onOutboundQueueDrained() override;
+
+  bool willDispatch(const std::string& api) override;
+
+  /**
+   Register a plugin. If an executor is given, the plugin's receivers are
+   invoked on it instead of on the callback worker, so that slow plugins
+   don't hold up each other.
+   */
+  void addPlugin(
+      std::shared_ptr<SonarPlugin> plugin,
+      std::shared_ptr<folly::Executor> executor = nullptr);
+
+  /**
+   Same as addPlugin, for a plugin that is only constructed once a desktop
+   initializes it, or once getPlugin asks for it. The identifier is listed
+   to desktops in the meantime, so plugins that are expensive to set up
+   cost nothing until they're used. factory is called at most once, with
+   the client lock held, and must return a plugin with the given
+   identifier.
+   */
+  void addPluginFactory(
+      const std::string& identifier,
+      std::function<std::shared_ptr<SonarPlugin>()> factory,
+      std::shared_ptr<folly::Executor> executor = nullptr);
+
+  /**
+   Same as calling addPlugin for each of them, but the desktop is told
+   about them in one go. A plugin that is already added is reported and
+   skipped, the others are still added.
+   */
+  void addPlugins(
+      const std::vector<std::shared_ptr<SonarPlugin>>& plugins,
+      std::shared_ptr<folly::Executor> executor = nullptr);
 
   void removePlugin(std::shared_ptr<SonarPlugin> plugin);
 
@@ -74,30 +173,157 @@ class SonarClient : public SonarWebSocket::Callbacks {
   void setStateListener(
       std::shared_ptr<SonarStateUpdateListener> stateListener);
 
-  std::shared_ptr<SonarPlugin> getPlugin(const std::string& identifier);
+  std::shared_ptr<SonarPlugin> getPlugin(folly::StringPiece identifier);
+
+  /**
+   The same snapshot for every call until a step is recorded, see
+   SonarState::getState.
+   */
+  std::shared_ptr<const std::string> getState();
 
-  std::string getState();
+  std::shared_ptr<const std::vector<StateElement>> getStateElements();
 
-  std::vector<StateElement> getStateElements();
+  /**
+   Traffic per plugin and method since the client was created, along with
+   counters for the underlying connection. The desktop can request the same
+   snapshot with the built-in "__metrics" method.
+   */
+  folly::dynamic getMetrics() const;
 
   template <typename P>
-  std::shared_ptr<P> getPlugin(const std::string& identifier) {
+  std::shared_ptr<P> getPlugin(folly::StringPiece identifier) {
     return std::static_pointer_cast<P>(getPlugin(identifier));
   }
 
-  bool hasPlugin(const std::string& identifier);
+  bool hasPlugin(folly::StringPiece identifier);
+
+  /**
+   Whether a desktop is connected and has initialized the given plugin.
+   Doesn't take the client lock, so instrumentation can call it on hot paths
+   to skip work nobody would see.
+   */
+  bool isPluginActive(folly::StringPiece identifier) const;
 
  private:
+  // Forwards the events of an additional socket, along with which socket
+  // they came from.
+  class ObserverCallbacks : public SonarWebSocket::Callbacks {
+   public:
+    ObserverCallbacks(SonarClient* client, SonarWebSocket* socket)
+        : client_(client), socket_(socket) {}
+
+    void onConnected() override {
+      client_->socketConnected(socket_);
+    }
+
+    void onDisconnected() override {
+      client_->socketDisconnected(socket_);
+    }
+
+    void onMessageReceived(const folly::dynamic& message) override {
+      client_->messageReceived(socket_, message);
+    }
+
+    void onOutboundQueueDrained() override {
+      client_->socketDrained(socket_);
+    }
+
+    bool willDispatch(const std::string& api) override {
+      return client_->willDispatch(api);
+    }
+
+   private:
+    SonarClient* client_;
+    SonarWebSocket* socket_;
+  };
+
+  struct Observer {
+    ObserverCallbacks callbacks;
+    // Destroyed first, so it can't call into destroyed callbacks.
+    std::unique_ptr<SonarWebSocket> socket;
+  };
+
   static SonarClient* instance_;
-  bool connected_ = false;
+  // Whether any desktop is connected.
+  std::atomic<bool> connected_{false};
   std::unique_ptr<SonarWebSocket> socket_;
-  std::map<std::string, std::shared_ptr<SonarPlugin>> plugins_;
-  std::map<std::string, std::shared_ptr<SonarConnectionImpl>> connections_;
+  std::vector<std::unique_ptr<Observer>> observers_;
+  std::unordered_set<SonarWebSocket*> connectedSockets_;
+  // Registries are searchable by StringPiece, so that plugins can be looked
+  // up by a string literal without copying it.
+  SonarNameMap<std::shared_ptr<SonarPlugin>> plugins_;
+  // Plugins that haven't been constructed yet, moved to plugins_ once they
+  // are.
+  SonarNameMap<std::function<std::shared_ptr<SonarPlugin>()>> pluginFactories_;
+  using Connections = SonarNameMap<std::shared_ptr<SonarConnectionImpl>>;
+  Connections connections_;
+  // The response to getPlugins, null until it's asked for and after plugins
+  // are added or removed. Kept as a dynamic rather than serialized, as the
+  // sockets that wrap others look into it. Guarded by mutex_.
+  folly::dynamic getPluginsResponse_;
+  std::unordered_map<std::string, std::shared_ptr<folly::Executor>>
+      pluginExecutors_;
+  // Send policies set by the desktop, by plugin and method. Kept across
+  // connections, so that they also apply once a plugin is initialized again.
+  std::unordered_map<
+      std::string,
+      std::unordered_map<std::string, SonarSendPolicy>>
+      sendPolicies_;
+  // Always taken through metrics_->clientLock(), so that contention shows up
+  // in getMetrics().
   std::mutex mutex_;
+  // Copy of connections_, replaced, never modified, under mutex_ so that
+  // isPluginActive and execute calls can read it without locking.
+  std::shared_ptr<const Connections> activeConnections_{
+      std::make_shared<const Connections>()};
   std::shared_ptr<SonarState> sonarState_;
+  std::shared_ptr<SonarMetrics> metrics_{std::make_shared<SonarMetrics>()};
+  // Probes the workers of the socket from config, see watchLoops.
+  std::unique_ptr<SonarLoopWatchdog> watchdog_;
+  // Where refreshPlugins is deferred to, see scheduleRefresh. Set under
+  // mutex_, since a deferred client only gets it on start.
+  folly::EventBase* refreshEventBase_;
+  bool refreshScheduled_ = false;
+  // Requests that are still being worked on, keyed by id, so that a cancel
+  // from the desktop can reach their responders. Entries expire on their
+  // own once the responder is destroyed.
+  std::unordered_map<int64_t, std::weak_ptr<SonarRequestCancellation>>
+      inFlightRequests_;
+  std::mutex inFlightMutex_;
 
-  void performAndReportError(const std::function<void()>& func);
+  void socketConnected(SonarWebSocket* socket);
+  void socketDisconnected(SonarWebSocket* socket);
+  void messageReceived(SonarWebSocket* socket, const folly::dynamic& message);
+  void socketDrained(SonarWebSocket* socket);
+  void performAndReportError(
+      const std::function<void()>& func,
+      SonarWebSocket* socket = nullptr);
   void disconnect(std::shared_ptr<SonarPlugin> plugin);
+  // Sets up the plugin's connection for socket, for init and initMany.
+  // Returns the plugin and, if it still needs didConnect, its new
+  // connection. Unpublished until publishConnections. Called with mutex_
+  // held.
+  std::pair<std::shared_ptr<SonarPlugin>, std::shared_ptr<SonarConnectionImpl>>
+  initPlugin(
+      const std::string& identifier,
+      SonarWebSocket* socket,
+      const folly::dynamic& method);
+  // The plugin with identifier, constructing it if it was added as a
+  // factory. Null if there is none. Called with mutex_ held.
+  std::shared_ptr<SonarPlugin> findPlugin(folly::StringPiece identifier);
+  void disconnect(std::shared_ptr<SonarPlugin> plugin, SonarWebSocket* socket);
+  void publishConnections();
+  // Tells connected desktops to fetch the plugins again, once for all the
+  // changes made until refreshEventBase_ gets to it. Called with mutex_
+  // held.
+  void scheduleRefresh();
+  void setRefreshEventBase(folly::EventBase* eventBase);
+  std::shared_ptr<SonarRequestCancellation> trackRequest(
+      const folly::dynamic& message);
+  void cancelRequest(int64_t id);
+  // Starts probing the callback and connection workers for lag, unless
+  // config disables it.
+  void watchLoops(const SonarInitConfig& config);
 };
 
 } // namespace sonar
@@ -0,0 +1,123 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarCompression.h"
+#include <zlib.h>
+#include <stdexcept>
+
+namespace facebook {
+namespace sonar {
+
+namespace {
+
+// zlib favours matches near the end of the dictionary, so the most common
+// strings go last. Must be kept in sync with the desktop's copy in
+// src/utils/compressionDictionary.js.
+constexpr char kDictionary[] =
+    "\"reason\":\"OK\",\"status\":200,"
+    "{\"key\":\"Content-Type\",\"value\":\"application/json\"},"
+    "{\"key\":\"Content-Length\",\"value\":\""
+    "\"url\":\"https://"
+    "\"method\":\"newResponse\",\"params\":{"
+    "\"method\":\"newRequest\",\"params\":{"
+    "\"api\":\"Network\","
+    "\"api\":\"Inspector\","
+    "\"decoration\":\"\",\"extraInfo\":{},"
+    "\"attributes\":[{\"name\":\"\",\"value\":\"\"}],"
+    "\"children\":[\"\"],"
+    "\"expanded\":false,"
+    "{\"id\":\"\",\"name\":\"\",\"data\":{"
+    "\"timestamp\":"
+    "\"headers\":[],\"data\":\""
+    "{\"id\":1,\"success\":{"
+    "{\"method\":\"execute\",\"params\":{\"api\":\"";
+
+constexpr size_t kChunkSize = 16 * 1024;
+
+} // namespace
+
+folly::StringPiece compressionDictionary() {
+  return folly::StringPiece(kDictionary, sizeof(kDictionary) - 1);
+}
+
+std::string deflateFrame(folly::StringPiece frame) {
+  z_stream stream{};
+  if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+    throw std::runtime_error("deflateInit failed");
+  }
+  const auto dictionary = compressionDictionary();
+  deflateSetDictionary(
+      &stream,
+      reinterpret_cast<const Bytef*>(dictionary.data()),
+      dictionary.size());
+
+  std::string out;
+  out.resize(deflateBound(&stream, frame.size()));
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(frame.data()));
+  stream.avail_in = frame.size();
+  stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  stream.avail_out = out.size();
+  const int result = deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  if (result != Z_STREAM_END) {
+    throw std::runtime_error("deflate failed");
+  }
+  return out;
+}
+
+bool isDeflatedFrame(folly::StringPiece frame) {
+  if (frame.size() < 2) {
+    return false;
+  }
+  const auto cmf = static_cast<uint8_t>(frame[0]);
+  const auto flg = static_cast<uint8_t>(frame[1]);
+  return (cmf & 0x0f) == Z_DEFLATED && ((cmf << 8) | flg) % 31 == 0;
+}
+
+std::string inflateFrame(folly::StringPiece frame) {
+  z_stream stream{};
+  if (inflateInit(&stream) != Z_OK) {
+    throw std::runtime_error("inflateInit failed");
+  }
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(frame.data()));
+  stream.avail_in = frame.size();
+
+  std::string out;
+  int result = Z_OK;
+  while (result != Z_STREAM_END) {
+    const auto offset = out.size();
+    out.resize(offset + kChunkSize);
+    stream.next_out = reinterpret_cast<Bytef*>(&out[offset]);
+    stream.avail_out = kChunkSize;
+    result = inflate(&stream, Z_NO_FLUSH);
+    if (result == Z_NEED_DICT) {
+      const auto dictionary = compressionDictionary();
+      result = inflateSetDictionary(
+          &stream,
+          reinterpret_cast<const Bytef*>(dictionary.data()),
+          dictionary.size());
+    }
+    out.resize(offset + kChunkSize - stream.avail_out);
+    if (result != Z_OK && result != Z_STREAM_END) {
+      inflateEnd(&stream);
+      throw std::invalid_argument("inflate failed: invalid or truncated frame");
+    }
+    if (result == Z_OK && stream.avail_in == 0 && stream.avail_out != 0) {
+      inflateEnd(&stream);
+      throw std::invalid_argument("inflate failed: truncated frame");
+    }
+  }
+  inflateEnd(&stream);
+  return out;
+}
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,48 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Range.h>
+#include <string>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Name of the compression scheme as advertised in the connection setup
+ payload and by the desktop.
+ */
+constexpr const char* kDeflateCompression = "deflate";
+
+/**
+ Preset dictionary made of the keys and envelopes that dominate Inspector
+ and Network traffic. The desktop has an identical copy, zlib verifies that
+ both sides agree through the dictionary id in the stream header.
+ */
+folly::StringPiece compressionDictionary();
+
+/**
+ Compresses a frame into a zlib stream using the preset dictionary.
+ */
+std::string deflateFrame(folly::StringPiece frame);
+
+/**
+ Whether a frame is a zlib stream. JSON frames start with '{' and
+ MessagePack messages with a map tag, neither of which is a valid zlib
+ header, so compressed frames need no separate marker.
+ */
+bool isDeflatedFrame(folly::StringPiece frame);
+
+/**
+ Throws std::invalid_argument if the frame is not a valid zlib stream.
+ */
+std::string inflateFrame(folly::StringPiece frame);
+
+} // namespace sonar
+} // namespace facebook
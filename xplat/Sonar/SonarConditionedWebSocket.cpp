@@ -0,0 +1,411 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarConditionedWebSocket.h"
+
+#include <folly/Random.h>
+#include <folly/json.h>
+#include <algorithm>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+using folly::dynamic;
+
+namespace {
+
+// Close enough to the envelope around the params of an "execute".
+constexpr size_t kExecuteEnvelopeBytes = 48;
+
+size_t executeBytes(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    size_t paramsBytes) {
+  return kExecuteEnvelopeBytes + api.size() + method.size() + paramsBytes;
+}
+
+} // namespace
+
+SonarConditionedWebSocket::SonarConditionedWebSocket(
+    std::unique_ptr<SonarWebSocket> socket,
+    SonarLinkConditions conditions,
+    folly::EventBase* eventBase)
+    : socket_(std::move(socket)),
+      eventBase_(eventBase),
+      conditions_(conditions) {
+  socket_->setCallbacks(this);
+}
+
+SonarConditionedWebSocket::~SonarConditionedWebSocket() {
+  eventBase_->runImmediatelyOrRunInEventBaseThreadAndWait([this]() {
+    timer_.reset();
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_.clear();
+  });
+}
+
+void SonarConditionedWebSocket::setConditions(SonarLinkConditions conditions) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  conditions_ = conditions;
+}
+
+SonarLinkConditions SonarConditionedWebSocket::getConditions() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return conditions_;
+}
+
+void SonarConditionedWebSocket::start() {
+  socket_->start();
+}
+
+void SonarConditionedWebSocket::stop() {
+  socket_->stop();
+}
+
+void SonarConditionedWebSocket::setSuspended(bool suspended) {
+  socket_->setSuspended(suspended);
+}
+
+bool SonarConditionedWebSocket::isOpen() const {
+  return socket_->isOpen();
+}
+
+void SonarConditionedWebSocket::setCallbacks(Callbacks* callbacks) {
+  callbacks_ = callbacks;
+}
+
+void SonarConditionedWebSocket::sendMessage(const dynamic& message) {
+  sendMessage(dynamic(message));
+}
+
+void SonarConditionedWebSocket::sendMessage(dynamic&& message) {
+  // Serialized only to know its size, the socket serializes it its own way.
+  const auto bytes = folly::toJson(message).size();
+  hold(true, bytes, [this, message = std::move(message)]() mutable {
+    socket_->sendMessage(std::move(message));
+  });
+}
+
+void SonarConditionedWebSocket::sendExecute(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    dynamic&& params) {
+  if (shouldDrop()) {
+    return;
+  }
+  const auto bytes = executeBytes(api, method, folly::toJson(params).size());
+  // Copied, the names are only borrowed for the duration of the call.
+  hold(
+      true,
+      bytes,
+      [this,
+       api = api.str(),
+       method = method.str(),
+       params = std::move(params)]() mutable {
+        socket_->sendExecute(api, method, std::move(params));
+      });
+}
+
+void SonarConditionedWebSocket::sendExecuteLatest(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    folly::StringPiece key,
+    dynamic&& params) {
+  if (shouldDrop()) {
+    return;
+  }
+  // Replacing happens in the socket, once the message is through the link.
+  const auto bytes = executeBytes(api, method, folly::toJson(params).size());
+  hold(
+      true,
+      bytes,
+      [this,
+       api = api.str(),
+       method = method.str(),
+       key = key.str(),
+       params = std::move(params)]() mutable {
+        socket_->sendExecuteLatest(api, method, key, std::move(params));
+      });
+}
+
+void SonarConditionedWebSocket::sendJson(std::string message) {
+  const auto bytes = message.size();
+  hold(true, bytes, [this, message = std::move(message)]() mutable {
+    socket_->sendJson(std::move(message));
+  });
+}
+
+void SonarConditionedWebSocket::sendExecuteJson(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    std::string params) {
+  if (shouldDrop()) {
+    return;
+  }
+  const auto bytes = executeBytes(api, method, params.size());
+  hold(
+      true,
+      bytes,
+      [this,
+       api = api.str(),
+       method = method.str(),
+       params = std::move(params)]() mutable {
+        socket_->sendExecuteJson(api, method, std::move(params));
+      });
+}
+
+SonarMessageEncoding SonarConditionedWebSocket::getEncoding() const {
+  return socket_->getEncoding();
+}
+
+bool SonarConditionedWebSocket::sendBinary(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    const dynamic& metadata,
+    std::unique_ptr<folly::IOBuf> data) {
+  if (!socket_->supportsBinary()) {
+    return false;
+  }
+  if (shouldDrop()) {
+    return true;
+  }
+  const auto bytes = executeBytes(
+      api,
+      method,
+      folly::toJson(metadata).size() + data->computeChainDataLength());
+  // Lost like a dropped event should the socket stop carrying binary frames
+  // in the meantime.
+  hold(
+      true,
+      bytes,
+      [this,
+       api = api.str(),
+       method = method.str(),
+       metadata,
+       data = std::move(data)]() mutable {
+        socket_->sendBinary(api, method, metadata, std::move(data));
+      });
+  return true;
+}
+
+bool SonarConditionedWebSocket::supportsBinary() const {
+  return socket_->supportsBinary();
+}
+
+size_t SonarConditionedWebSocket::getBufferedBytes() const {
+  return socket_->getBufferedBytes() + heldBytes_;
+}
+
+void SonarConditionedWebSocket::notifyWhenDrained() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (heldBytes_ > 0) {
+      // Asked of the socket once the link let everything through.
+      drainRequested_ = true;
+      return;
+    }
+  }
+  socket_->notifyWhenDrained();
+}
+
+void SonarConditionedWebSocket::setMetrics(
+    std::shared_ptr<SonarMetrics> metrics) {
+  socket_->setMetrics(std::move(metrics));
+}
+
+void SonarConditionedWebSocket::onConnected() {
+  if (callbacks_) {
+    callbacks_->onConnected();
+  }
+}
+
+void SonarConditionedWebSocket::onDisconnected() {
+  // Whatever is still on the link is lost with the connection.
+  releaseAll();
+  if (callbacks_) {
+    callbacks_->onDisconnected();
+  }
+}
+
+void SonarConditionedWebSocket::onMessageReceived(const dynamic& message) {
+  if (message.getDefault("method") == "__linkConditions") {
+    answerLinkConditions(message);
+    return;
+  }
+  hold(false, 0, [this, message]() {
+    if (callbacks_) {
+      callbacks_->onMessageReceived(message);
+    }
+  });
+}
+
+bool SonarConditionedWebSocket::willDispatch(const std::string& api) {
+  return callbacks_ ? callbacks_->willDispatch(api) : true;
+}
+
+void SonarConditionedWebSocket::onOutboundQueueDrained() {
+  if (callbacks_) {
+    callbacks_->onOutboundQueueDrained();
+  }
+}
+
+bool SonarConditionedWebSocket::shouldDrop() {
+  double dropRate;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dropRate = conditions_.dropRate;
+  }
+  if (dropRate <= 0 || folly::Random::randDouble01() >= dropRate) {
+    return false;
+  }
+  droppedMessages_++;
+  return true;
+}
+
+void SonarConditionedWebSocket::hold(
+    bool outbound,
+    size_t bytes,
+    folly::Function<void()> deliver) {
+  const auto now = Clock::now();
+  bool immediate = false;
+  bool rearm = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& link = outbound ? outbound_ : inbound_;
+    auto sent = std::max(now, link.freeAt);
+    if (outbound && conditions_.bandwidthBytesPerSecond > 0) {
+      sent += std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(
+              static_cast<double>(bytes) /
+              conditions_.bandwidthBytesPerSecond));
+    }
+    link.freeAt = sent;
+    auto delay = std::chrono::milliseconds(conditions_.latencyMs);
+    if (conditions_.jitterMs > 0) {
+      delay += std::chrono::milliseconds(
+          folly::Random::rand32(conditions_.jitterMs + 1));
+    }
+    const auto arrival = std::max(sent + delay, link.lastArrival);
+    link.lastArrival = arrival;
+    if (arrival <= now && held_.empty()) {
+      // Nothing to simulate, and nothing held back to overtake.
+      immediate = true;
+    } else {
+      held_.emplace(arrival, Held{bytes, std::move(deliver)});
+      heldBytes_ += bytes;
+      rearm = !armed_ || arrival < armedFor_;
+      if (rearm) {
+        armed_ = true;
+        armedFor_ = arrival;
+      }
+    }
+  }
+  if (immediate) {
+    deliver();
+    return;
+  }
+  if (rearm) {
+    eventBase_->add([this]() { arm(); });
+  }
+}
+
+void SonarConditionedWebSocket::arm() {
+  Clock::time_point next;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (held_.empty()) {
+      armed_ = false;
+      return;
+    }
+    next = held_.begin()->first;
+    armed_ = true;
+    armedFor_ = next;
+  }
+  if (!timer_) {
+    timer_ = std::make_unique<Timer>(eventBase_, this);
+  }
+  const auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+      next - Clock::now());
+  // Rounded up, so the timer doesn't fire just before the message is due.
+  timer_->scheduleTimeout(
+      static_cast<uint32_t>(std::max<int64_t>(0, delay.count() + 1)));
+}
+
+void SonarConditionedWebSocket::deliverDue() {
+  std::vector<folly::Function<void()>> due;
+  bool drained = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = Clock::now();
+    auto end = held_.upper_bound(now);
+    for (auto it = held_.begin(); it != end; ++it) {
+      heldBytes_ -= it->second.bytes;
+      due.push_back(std::move(it->second.deliver));
+    }
+    held_.erase(held_.begin(), end);
+    armed_ = false;
+    if (drainRequested_ && heldBytes_ == 0) {
+      drainRequested_ = false;
+      drained = true;
+    }
+  }
+  for (auto& deliver : due) {
+    deliver();
+  }
+  if (drained) {
+    socket_->notifyWhenDrained();
+  }
+  arm();
+}
+
+void SonarConditionedWebSocket::releaseAll() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  held_.clear();
+  heldBytes_ = 0;
+  outbound_ = Link();
+  inbound_ = Link();
+}
+
+void SonarConditionedWebSocket::answerLinkConditions(const dynamic& message) {
+  SonarLinkConditions conditions;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto params = message.getDefault("params");
+    if (params.isObject()) {
+      conditions_.latencyMs = static_cast<int>(
+          params.getDefault("latencyMs", conditions_.latencyMs).asInt());
+      conditions_.jitterMs = static_cast<int>(
+          params.getDefault("jitterMs", conditions_.jitterMs).asInt());
+      conditions_.bandwidthBytesPerSecond =
+          static_cast<size_t>(params
+                                  .getDefault(
+                                      "bandwidthBytesPerSecond",
+                                      static_cast<int64_t>(
+                                          conditions_.bandwidthBytesPerSecond))
+                                  .asInt());
+      conditions_.dropRate =
+          params.getDefault("dropRate", conditions_.dropRate).asDouble();
+    }
+    conditions = conditions_;
+  }
+  if (!message.count("id")) {
+    return;
+  }
+  // Straight to the desktop, so the answer doesn't wait for the new latency.
+  socket_->sendMessage(dynamic::object("id", message["id"])(
+      "success",
+      dynamic::object("latencyMs", conditions.latencyMs)(
+          "jitterMs", conditions.jitterMs)(
+          "bandwidthBytesPerSecond",
+          static_cast<int64_t>(conditions.bandwidthBytesPerSecond))(
+          "dropRate", conditions.dropRate)));
+}
+
+} // namespace sonar
+} // namespace facebook
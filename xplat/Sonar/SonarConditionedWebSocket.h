@@ -0,0 +1,176 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarInitConfig.h>
+#include <Sonar/SonarWebSocket.h>
+#include <folly/Function.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Wraps a socket to make its connection behave like a slow one, for testing
+ plugins and the transport over Wi-Fi debugging or a remote lab. Messages
+ in both directions are held back for the latency and jitter of the
+ conditions, and messages leaving the device queue up behind each other at
+ the given bandwidth. Held back bytes count towards getBufferedBytes(), so
+ backpressure sees them like a slow link.
+
+ The desktop can change the conditions with a __linkConditions call whose
+ params hold any of the fields of SonarLinkConditions by name. It answers
+ with the conditions now in effect.
+
+ sendSerializedExecute always returns false. The shared serialization of
+ observer sockets isn't worth simulating, and callers fall back to
+ sendExecute.
+ */
+class SonarConditionedWebSocket : public SonarWebSocket,
+                                  private SonarWebSocket::Callbacks {
+ public:
+  SonarConditionedWebSocket(
+      std::unique_ptr<SonarWebSocket> socket,
+      SonarLinkConditions conditions,
+      folly::EventBase* eventBase);
+
+  ~SonarConditionedWebSocket();
+
+  void setConditions(SonarLinkConditions conditions);
+
+  SonarLinkConditions getConditions() const;
+
+  /**
+   Number of plugin events dropped for the dropRate of the conditions.
+   */
+  size_t getDroppedMessages() const {
+    return droppedMessages_;
+  }
+
+  void start() override;
+
+  void stop() override;
+
+  void setSuspended(bool suspended) override;
+
+  bool isOpen() const override;
+
+  void setCallbacks(Callbacks* callbacks) override;
+
+  void sendMessage(const folly::dynamic& message) override;
+
+  void sendMessage(folly::dynamic&& message) override;
+
+  void sendExecute(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      folly::dynamic&& params) override;
+
+  void sendExecuteLatest(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      folly::StringPiece key,
+      folly::dynamic&& params) override;
+
+  void sendJson(std::string message) override;
+
+  void sendExecuteJson(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      std::string params) override;
+
+  SonarMessageEncoding getEncoding() const override;
+
+  bool sendBinary(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      const folly::dynamic& metadata,
+      std::unique_ptr<folly::IOBuf> data) override;
+
+  bool supportsBinary() const override;
+
+  size_t getBufferedBytes() const override;
+
+  void notifyWhenDrained() override;
+
+  void setMetrics(std::shared_ptr<SonarMetrics> metrics) override;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  class Timer : public folly::AsyncTimeout {
+   public:
+    Timer(folly::EventBase* eventBase, SonarConditionedWebSocket* socket)
+        : folly::AsyncTimeout(eventBase), socket_(socket) {}
+
+    void timeoutExpired() noexcept override {
+      socket_->deliverDue();
+    }
+
+   private:
+    SonarConditionedWebSocket* socket_;
+  };
+
+  // Where a direction of the link is busy until, and when its last message
+  // arrives, which the next one can't arrive before.
+  struct Link {
+    Clock::time_point freeAt;
+    Clock::time_point lastArrival;
+  };
+
+  struct Held {
+    size_t bytes;
+    folly::Function<void()> deliver;
+  };
+
+  const std::unique_ptr<SonarWebSocket> socket_;
+  folly::EventBase* eventBase_;
+  Callbacks* callbacks_ = nullptr;
+  std::atomic<size_t> heldBytes_{0};
+  std::atomic<size_t> droppedMessages_{0};
+
+  mutable std::mutex mutex_;
+  // All guarded by mutex_.
+  SonarLinkConditions conditions_;
+  Link outbound_;
+  Link inbound_;
+  // Keyed by arrival. Messages with the same arrival stay in the order they
+  // were held back in.
+  std::multimap<Clock::time_point, Held> held_;
+  // When the timer is set to fire, if it is.
+  bool armed_ = false;
+  Clock::time_point armedFor_;
+  bool drainRequested_ = false;
+
+  // Created, armed and destroyed on eventBase_.
+  std::unique_ptr<Timer> timer_;
+
+  void onConnected() override;
+  void onDisconnected() override;
+  void onMessageReceived(const folly::dynamic& message) override;
+  bool willDispatch(const std::string& api) override;
+  void onOutboundQueueDrained() override;
+
+  // Drops plugin events at the dropRate, returns true if this one is.
+  bool shouldDrop();
+  void hold(bool outbound, size_t bytes, folly::Function<void()> deliver);
+  void arm();
+  void deliverDue();
+  void releaseAll();
+  void answerLinkConditions(const folly::dynamic& message);
+};
+
+} // namespace sonar
+} // namespace facebook
@@ -8,32 +8,191 @@
 
 #pragma once
 
+#include <Sonar/SonarFields.h>
+#include <Sonar/SonarMessageWriter.h>
 #include <Sonar/SonarResponder.h>
+#include <Sonar/SonarStreamResponder.h>
+#include <folly/Range.h>
+#include <folly/futures/Future.h>
 #include <folly/json.h>
+#include <chrono>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace facebook {
 namespace sonar {
 
+/**
+Takes every call for a plugin's methods in one virtual call, instead of
+each method having a receiver of its own, see SonarTypedPlugin.h.
+*/
+class SonarCallDispatcher {
+ public:
+  virtual ~SonarCallDispatcher() {}
+
+  /**
+  Index of the receiver for method, or -1 if there is none.
+  */
+  virtual int find(const std::string& method) const = 0;
+
+  virtual void dispatch(
+      int index,
+      const folly::dynamic& params,
+      std::unique_ptr<SonarResponder> responder) = 0;
+
+  virtual std::vector<std::string> methods() const = 0;
+};
+
 /**
 Represents a connection between the Desktop and mobile plugins
-with corresponding identifiers.
+with corresponding identifiers. Method names and keys are only borrowed for
+the duration of a call, so sending with a string literal doesn't allocate.
 */
 class SonarConnection {
  public:
   using SonarReceiver = std::function<
       void(const folly::dynamic&, std::unique_ptr<SonarResponder>)>;
 
+  /**
+  A receiver that responds by completing the returned future instead of
+  calling a responder. The value becomes the success response and an
+  exception becomes the error response.
+  */
+  using SonarAsyncReceiver =
+      std::function<folly::Future<folly::dynamic>(const folly::dynamic&)>;
+
+  using SonarStreamReceiver = std::function<
+      void(const folly::dynamic&, std::unique_ptr<SonarStreamResponder>)>;
+
+  /**
+  Produces a paginated result a page at a time, see receivePaged. Each call
+  appends at most pageSize items and returns whether more follow. Never
+  called concurrently.
+  */
+  using SonarCursor = std::function<bool(size_t pageSize, folly::dynamic&)>;
+
+  using SonarPagedReceiver = std::function<SonarCursor(const folly::dynamic&)>;
+
+  /**
+  Writes the fields of a message's params, see sendWith.
+  */
+  using SonarMessageBuilder = std::function<void(SonarMessageWriter&)>;
+
   virtual ~SonarConnection() {}
 
   /**
   Invoke a method on the Sonar desktop plugin with with a matching identifier.
   */
   virtual void send(
-      const std::string& method,
+      folly::StringPiece method,
       const folly::dynamic& params) = 0;
 
+  /**
+  Same as above, but takes ownership of params so that they can be moved
+  into the outgoing message instead of being copied.
+  */
+  virtual void send(folly::StringPiece method, folly::dynamic&& params) {
+    send(method, static_cast<const folly::dynamic&>(params));
+  }
+
+  /**
+  Same as send, for updates where only the newest value matters, such as a
+  highlight or a status. The message replaces any earlier one with the same
+  key that is still waiting to be sent.
+  */
+  virtual void sendLatest(
+      folly::StringPiece key,
+      folly::StringPiece method,
+      folly::dynamic&& params) {
+    send(method, std::move(params));
+  }
+
+  /**
+  Same as send, for params that are already serialized as JSON, such as
+  those coming from Java or Objective-C. Avoids parsing them just to
+  serialize them again.
+  */
+  virtual void sendJson(folly::StringPiece method, std::string params) {
+    send(method, folly::parseJson(params));
+  }
+
+  /**
+  Same as send, with params written by build straight into the outgoing
+  message rather than put together as a folly::dynamic first. build is
+  called once, before this returns, inside the params object.
+  */
+  virtual void sendWith(
+      folly::StringPiece method,
+      const SonarMessageBuilder& build) {
+    std::string params;
+    SonarMessageWriter writer(params);
+    build(writer);
+    writer.endObject();
+    sendJson(method, std::move(params));
+  }
+
+  /**
+  Same as send, with a value whose type describes its fields with
+  sonarFields(), see SonarFields.h, as the params. The fields are written
+  straight into the outgoing message, without building a folly::dynamic.
+  */
+  template <
+      typename T,
+      typename = typename std::enable_if<HasSonarFields<T>::value>::type>
+  void send(folly::StringPiece method, const T& value) {
+    sendWith(method, [&value](SonarMessageWriter& writer) {
+      writeSonarFields(writer, value);
+    });
+  }
+
+  /**
+  Send binary data, such as an image, to the desktop plugin without
+  encoding it into a string. metadata describes the data and is delivered
+  as the params of the call. Returns false if the desktop can't receive
+  binary data; data is dropped then, so callers that need a fallback should
+  check supportsBinary() first.
+  */
+  virtual bool sendBinary(
+      folly::StringPiece method,
+      const folly::dynamic& metadata,
+      std::unique_ptr<folly::IOBuf> data) {
+    return false;
+  }
+
+  virtual bool supportsBinary() const {
+    return false;
+  }
+
+  /**
+  Like send, but refuses the message instead of queueing it when more than
+  the high watermark is already waiting to be written. Returns whether the
+  message was accepted. After a refusal, the onWritable callback is invoked
+  once the backlog has been written.
+  */
+  virtual bool trySend(folly::StringPiece method, folly::dynamic&& params) {
+    send(method, std::move(params));
+    return true;
+  }
+
+  /**
+  Number of buffered bytes above which trySend refuses messages.
+  0 means no limit.
+  */
+  virtual void setHighWatermark(size_t bytes) {}
+
+  virtual void onWritable(std::function<void()> callback) {}
+
+  /**
+  False once the desktop has deinitialized the plugin or disconnected.
+  Messages sent after that are dropped, so callers can skip building them.
+  */
+  virtual bool isActive() const {
+    return true;
+  }
+
   /**
   Report an error to the Sonar desktop app
   */
@@ -43,11 +202,147 @@ class SonarConnection {
 
   /**
   Register a receiver to be notified of incoming calls of the given
-  method from the Sonar desktop plugin with a matching identifier.
+  method from the Sonar desktop plugin with a matching identifier. Safe to
+  call from any thread, also while calls are being dispatched; a call that
+  is already on its way sees either the old or the new receiver. Calls look
+  their receiver up without locking, and receive waits for the lookups that
+  may still see the old receivers, not for the calls themselves.
   */
   virtual void receive(
-      const std::string& method,
+      folly::StringPiece method,
       const SonarReceiver& receiver) = 0;
+
+  /**
+  Register an async receiver. If the future hasn't completed within the
+  timeout, the desktop gets an error response and the eventual result is
+  dropped.
+  */
+  virtual void receive(
+      folly::StringPiece method,
+      const SonarAsyncReceiver& receiver,
+      std::chrono::milliseconds timeout = std::chrono::seconds(30)) {
+    receive(
+        method,
+        SonarReceiver([receiver, method = method.str(), timeout](
+                          const folly::dynamic& params,
+                          std::unique_ptr<SonarResponder> responder) {
+          std::shared_ptr<SonarResponder> shared(std::move(responder));
+          folly::makeFutureWith([&] { return receiver(params); })
+              .within(timeout)
+              .then([shared, method](folly::Try<folly::dynamic>&& result) {
+                if (!shared) {
+                  return;
+                }
+                if (result.hasValue()) {
+                  shared->success(std::move(result).value());
+                } else if (result.hasException<folly::FutureTimeout>()) {
+                  shared->error(folly::dynamic::object(
+                      "message", "receiver " + method + " timed out"));
+                } else {
+                  shared->error(folly::dynamic::object(
+                      "message", result.exception().what().toStdString()));
+                }
+              });
+        }));
+  }
+
+  /**
+  Hands calls of the dispatcher's methods to it, in place of any receivers
+  registered for them.
+  */
+  virtual void setDispatcher(std::shared_ptr<SonarCallDispatcher> dispatcher) {
+    for (const auto& method : dispatcher->methods()) {
+      const int index = dispatcher->find(method);
+      receive(
+          method,
+          SonarReceiver([dispatcher, index](
+                            const folly::dynamic& params,
+                            std::unique_ptr<SonarResponder> responder) {
+            dispatcher->dispatch(index, params, std::move(responder));
+          }));
+    }
+  }
+
+  /**
+  Answers repeat calls of method with the same params from the response to
+  the first, kept serialized, without calling the receiver again, until
+  invalidateResponses bumps version. For methods whose response only
+  depends on their params and on state whose changes the plugin reports,
+  such as a hierarchy's root or a preferences file. Errors, pages and
+  chunked responses aren't kept.
+  */
+  virtual void cacheResponses(
+      folly::StringPiece method,
+      folly::StringPiece version) {}
+
+  /**
+  Bumps version, so that the next call of each method cached against it
+  runs its receiver. Call it right after the state the responses depend on
+  has changed.
+  */
+  virtual void invalidateResponses(folly::StringPiece version) {}
+
+  /**
+  Register a receiver that responds with a stream of chunks.
+  */
+  virtual void receiveStream(
+      folly::StringPiece method,
+      const SonarStreamReceiver& receiver) {
+    receive(
+        method,
+        SonarReceiver([receiver](
+                          const folly::dynamic& params,
+                          std::unique_ptr<SonarResponder> responder) {
+          receiver(
+              params,
+              std::make_unique<SonarStreamResponder>(std::move(responder)));
+        }));
+  }
+
+  /**
+  Holds on to cursor so that the desktop can fetch the rest of a paginated
+  result with fetchNextPage. Returns the cursor's id, or 0 if the
+  connection can't hold cursors. Cursors that haven't been fetched from
+  for a while are dropped.
+  */
+  virtual int64_t openCursor(SonarCursor cursor) {
+    return 0;
+  }
+
+  /**
+  Register a receiver whose result may be too large to send in one
+  response. The desktop asks for at most pageSize items a page and fetches
+  the rest from the cursor the receiver returned, so that only what the
+  cursor needs to resume is held on the device between pages. Without a
+  pageSize, or if the connection can't hold cursors, everything comes in
+  one page.
+  */
+  virtual void receivePaged(
+      folly::StringPiece method,
+      const SonarPagedReceiver& receiver) {
+    receive(
+        method,
+        SonarReceiver([this, receiver](
+                          const folly::dynamic& params,
+                          std::unique_ptr<SonarResponder> responder) {
+          auto cursor = receiver(params);
+          folly::dynamic items = folly::dynamic::array();
+          const int64_t pageSize =
+              params.isObject() ? params.getDefault("pageSize", 0).asInt() : 0;
+          bool hasMore = cursor &&
+              cursor(pageSize > 0 ? pageSize : SIZE_MAX, items);
+          int64_t cursorId = 0;
+          if (hasMore && pageSize > 0) {
+            cursorId = openCursor(cursor);
+          }
+          if (hasMore && cursorId == 0) {
+            while (cursor(SIZE_MAX, items)) {
+            }
+            hasMore = false;
+          }
+          responder->page(cursorId, std::move(items), hasMore);
+        }));
+  }
 };
 
 } // namespace sonar
@@ -9,52 +9,587 @@
 #pragma once
 
 #include <Sonar/SonarConnection.h>
+#include <Sonar/SonarMessageEncoding.h>
+#include <Sonar/SonarMetrics.h>
+#include <Sonar/SonarNameMap.h>
+#include <Sonar/SonarPublished.h>
+#include <Sonar/SonarResponseCache.h>
+#include <Sonar/SonarSendPolicy.h>
+#include <Sonar/SonarTrace.h>
 #include <Sonar/SonarWebSocket.h>
-#include <map>
+#include <folly/Executor.h>
+#include <folly/ScopeGuard.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace facebook {
 namespace sonar {
 
-class SonarConnectionImpl : public SonarConnection {
+class SonarConnectionImpl
+    : public SonarConnection,
+      public std::enable_shared_from_this<SonarConnectionImpl> {
  public:
-  SonarConnectionImpl(SonarWebSocket* socket, const std::string& name)
-      : socket_(socket), name_(name) {}
+  SonarConnectionImpl(
+      SonarWebSocket* socket,
+      const std::string& name,
+      std::shared_ptr<folly::Executor> executor = nullptr,
+      std::shared_ptr<SonarMetrics> metrics = nullptr)
+      : sockets_(std::make_shared<const Sockets>(Sockets{socket})),
+        name_(name),
+        executor_(std::move(executor)),
+        metrics_(std::move(metrics)),
+        fetchNextPage_(std::make_shared<SonarReceiver>(
+            [this](
+                const folly::dynamic& params,
+                std::unique_ptr<SonarResponder> responder) {
+              fetchNextPage(params, std::move(responder));
+            })) {}
 
   void call(
       const std::string& method,
       const folly::dynamic& params,
       std::unique_ptr<SonarResponder> responder) {
-    if (receivers_.find(method) == receivers_.end()) {
-      throw std::out_of_range("receiver " + method + " not found.");
+    std::shared_ptr<SonarCallDispatcher> dispatcher;
+    const int index = dispatcher_.read(
+        [&](const std::shared_ptr<SonarCallDispatcher>& current) {
+          const int found = current ? current->find(method) : -1;
+          if (found >= 0) {
+            dispatcher = current;
+          }
+          return found;
+        });
+    std::shared_ptr<SonarReceiver> receiver;
+    if (index < 0) {
+      receiver = receivers_.read([&](const Receivers& receivers) {
+        const auto iter = receivers.find(method);
+        return iter != receivers.end() ? iter->second : nullptr;
+      });
+      if (!receiver && method == kFetchNextPage) {
+        receiver = fetchNextPage_;
+      } else if (!receiver) {
+        throw std::out_of_range("receiver " + method + " not found.");
+      }
+    }
+    auto metrics = metrics_ ? metrics_->forMethod(name_, method) : nullptr;
+    // Answered right here, without hopping to the plugin's executor.
+    if (responseCache_->respond(method, params, responder)) {
+      if (metrics) {
+        metrics->responsesFromCache++;
+      }
+      return;
+    }
+    if (!executor_) {
+      invoke(
+          receiver.get(),
+          dispatcher.get(),
+          index,
+          params,
+          std::move(responder),
+          metrics_.get(),
+          metrics.get());
+      return;
+    }
+    // Errors can't propagate back to the caller once we've hopped
+    // executors, so report them the same way the client would.
+    executor_->add([this,
+                    self = shared_from_this(),
+                    receiver,
+                    dispatcher,
+                    index,
+                    metrics,
+                    params,
+                    responder = std::move(responder)]() mutable {
+      try {
+        invoke(
+            receiver.get(),
+            dispatcher.get(),
+            index,
+            params,
+            std::move(responder),
+            metrics_.get(),
+            metrics.get());
+      } catch (const std::exception& e) {
+        error(e.what(), "<none>");
+      }
+    });
+  }
+
+  using SonarConnection::send;
+
+  void send(folly::StringPiece method, const folly::dynamic& params) override {
+    send(method, folly::dynamic(params));
+  }
+
+  void send(folly::StringPiece method, folly::dynamic&& params) override {
+    if (!admit(method)) {
+      return;
+    }
+    const auto sockets = getSockets();
+    if (sockets->size() == 1) {
+      sockets->front()->sendExecute(name_, method, std::move(params));
+      return;
+    }
+    // Serialize once per encoding rather than once per socket, so that
+    // additional desktops don't multiply the cost of plugin traffic.
+    std::string serialized[2];
+    for (const auto socket : *sockets) {
+      const auto encoding = socket->getEncoding();
+      auto& payload = serialized[static_cast<size_t>(encoding)];
+      if (payload.empty()) {
+        payload = serializeExecute(name_, method, params, encoding);
+      }
+      if (!socket->sendSerializedExecute(name_, method, payload, encoding)) {
+        socket->sendExecute(name_, method, folly::dynamic(params));
+      }
+    }
+  }
+
+  void sendLatest(
+      folly::StringPiece key,
+      folly::StringPiece method,
+      folly::dynamic&& params) override {
+    if (!admit(method)) {
+      return;
+    }
+    const auto sockets = getSockets();
+    for (size_t i = 0; i < sockets->size(); i++) {
+      const auto socket = (*sockets)[i];
+      if (i + 1 == sockets->size()) {
+        socket->sendExecuteLatest(name_, method, key, std::move(params));
+      } else {
+        socket->sendExecuteLatest(name_, method, key, folly::dynamic(params));
+      }
+    }
+  }
+
+  void sendWith(folly::StringPiece method, const SonarMessageBuilder& build)
+      override {
+    if (!admit(method)) {
+      return;
+    }
+    // Write the whole message into the connection's buffer, so that it is
+    // serialized in a single pass and, once the buffer has grown to fit the
+    // plugin's messages, without allocating. A concurrent or nested send
+    // gets a buffer of its own instead of waiting.
+    std::unique_lock<std::mutex> lock(bufferMutex_, std::try_to_lock);
+    std::string local;
+    auto& payload = lock.owns_lock() ? buffer_ : local;
+    payload.clear();
+    SonarMessageWriter writer(payload);
+    writer.put("method", "execute")
+        .beginObject("params")
+        .put("api", name_)
+        .put("method", method)
+        .beginObject("params");
+    build(writer);
+    writer.endObject().endObject().endObject();
+
+    for (const auto socket : *getSockets()) {
+      if (!socket->sendSerializedExecute(
+              name_, method, payload, SonarMessageEncoding::JSON)) {
+        socket->sendJson(payload);
+      }
+    }
+    if (payload.capacity() > kMaxRetainedBufferBytes) {
+      std::string().swap(payload);
+    }
+  }
+
+  void sendJson(folly::StringPiece method, std::string params) override {
+    if (!admit(method)) {
+      return;
+    }
+    const auto sockets = getSockets();
+    for (size_t i = 0; i < sockets->size(); i++) {
+      const auto socket = (*sockets)[i];
+      if (i + 1 == sockets->size()) {
+        socket->sendExecuteJson(name_, method, std::move(params));
+      } else {
+        socket->sendExecuteJson(name_, method, params);
+      }
     }
-    receivers_.at(method)(params, std::move(responder));
   }
 
-  void send(const std::string& method, const folly::dynamic& params) override {
-    folly::dynamic message = folly::dynamic::object("method", "execute")(
-        "params",
-        folly::dynamic::object("api", name_)("method", method)(
-            "params", params));
-    socket_->sendMessage(message);
+  bool sendBinary(
+      folly::StringPiece method,
+      const folly::dynamic& metadata,
+      std::unique_ptr<folly::IOBuf> data) override {
+    if (!supportsBinary()) {
+      return false;
+    }
+    if (!admit(method)) {
+      // Dropped like any other message, callers must not fall back to send.
+      return true;
+    }
+    const auto sockets = getSockets();
+    if (sockets->size() == 1) {
+      return sockets->front()->sendBinary(
+          name_, method, metadata, std::move(data));
+    }
+    for (const auto socket : *sockets) {
+      // IOBuf clones share the underlying buffer.
+      socket->sendBinary(name_, method, metadata, data->clone());
+    }
+    return true;
+  }
+
+  bool supportsBinary() const override {
+    const auto sockets = getSockets();
+    return std::all_of(
+        sockets->begin(), sockets->end(), [](const SonarWebSocket* socket) {
+          return socket->supportsBinary();
+        });
+  }
+
+  bool trySend(folly::StringPiece method, folly::dynamic&& params) override {
+    const size_t watermark = highWatermark_;
+    if (watermark > 0) {
+      // The slowest desktop holds up the others, like a single one would.
+      for (const auto socket : *getSockets()) {
+        if (socket->getBufferedBytes() >= watermark) {
+          blocked_ = true;
+          socket->notifyWhenDrained();
+          return false;
+        }
+      }
+    }
+    send(method, std::move(params));
+    return true;
+  }
+
+  void setHighWatermark(size_t bytes) override {
+    highWatermark_ = bytes;
+  }
+
+  void onWritable(std::function<void()> callback) override {
+    std::lock_guard<std::mutex> lock(writableMutex_);
+    writableCallback_ = std::move(callback);
+  }
+
+  /**
+  Called by the client once the socket has written its backlog.
+  */
+  void onSocketDrained() {
+    if (!blocked_.exchange(false)) {
+      return;
+    }
+    std::function<void()> callback;
+    {
+      std::lock_guard<std::mutex> lock(writableMutex_);
+      callback = writableCallback_;
+    }
+    if (callback) {
+      callback();
+    }
+  }
+
+  /**
+  Limits the messages the plugin sends with method, replacing any previous
+  policy for it. An unlimited policy removes the limits.
+  */
+  void setSendPolicy(const std::string& method, const SonarSendPolicy& policy) {
+    std::lock_guard<std::mutex> lock(throttlesMutex_);
+    auto throttles = throttles_.latest();
+    if (policy.isUnlimited()) {
+      throttles.erase(method);
+    } else {
+      throttles[method] = std::make_shared<SonarSendThrottle>(policy);
+    }
+    throttles_.publish(std::move(throttles));
+  }
+
+  /**
+  The policy of each limited method and how many messages it dropped since
+  the policy was set.
+  */
+  folly::dynamic getSendPolicies() const {
+    std::lock_guard<std::mutex> lock(throttlesMutex_);
+    folly::dynamic policies = folly::dynamic::object();
+    for (const auto& throttle : throttles_.latest()) {
+      auto policy = throttle.second->policy().toDynamic();
+      policy["dropped"] = throttle.second->dropped();
+      policies[throttle.first.str()] = std::move(policy);
+    }
+    return policies;
+  }
+
+  void cacheResponses(folly::StringPiece method, folly::StringPiece version)
+      override {
+    responseCache_->cacheMethod(method, version);
+  }
+
+  void invalidateResponses(folly::StringPiece version) override {
+    responseCache_->bump(version);
+  }
+
+  bool isActive() const override {
+    return active_;
+  }
+
+  /**
+  Called by the client once the plugin has been disconnected. Drops the
+  receivers, which may own the connection, through the bindings of the
+  platform for instance. Calls being answered keep theirs.
+  */
+  void deactivate() {
+    active_ = false;
+    {
+      std::lock_guard<std::mutex> lock(receiversMutex_);
+      receivers_.publish(Receivers());
+      dispatcher_.publish(nullptr);
+    }
+    responseCache_->clear();
+    std::lock_guard<std::mutex> lock(cursorsMutex_);
+    cursors_.clear();
+  }
+
+  using Sockets = std::vector<SonarWebSocket*>;
+
+  /**
+  Desktops that have initialized the plugin. Replaced, never modified, so
+  that sending doesn't need to lock.
+  */
+  std::shared_ptr<const Sockets> getSockets() const {
+    return std::atomic_load(&sockets_);
+  }
+
+  bool hasSocket(SonarWebSocket* socket) const {
+    const auto sockets = getSockets();
+    return std::find(sockets->begin(), sockets->end(), socket) !=
+        sockets->end();
+  }
+
+  /**
+  Called by the client when another desktop initializes the plugin.
+  */
+  void addSocket(SonarWebSocket* socket) {
+    std::lock_guard<std::mutex> lock(socketsMutex_);
+    auto sockets = std::make_shared<Sockets>(*getSockets());
+    sockets->push_back(socket);
+    std::atomic_store(
+        &sockets_, std::shared_ptr<const Sockets>(std::move(sockets)));
+  }
+
+  /**
+  Called by the client when a desktop deinitializes the plugin or goes
+  away. Returns the number of desktops left.
+  */
+  size_t removeSocket(SonarWebSocket* socket) {
+    std::lock_guard<std::mutex> lock(socketsMutex_);
+    auto sockets = std::make_shared<Sockets>(*getSockets());
+    sockets->erase(
+        std::remove(sockets->begin(), sockets->end(), socket), sockets->end());
+    const auto remaining = sockets->size();
+    std::atomic_store(
+        &sockets_, std::shared_ptr<const Sockets>(std::move(sockets)));
+    return remaining;
   }
 
   void error(const std::string& message, const std::string& stacktrace)
       override {
-    socket_->sendMessage(folly::dynamic::object(
+    const folly::dynamic error = folly::dynamic::object(
         "error",
-        folly::dynamic::object("message", message)("stacktrace", stacktrace)));
+        folly::dynamic::object("message", message)("stacktrace", stacktrace));
+    for (const auto socket : *getSockets()) {
+      socket->sendMessage(error);
+    }
   }
 
-  void receive(const std::string& method, const SonarReceiver& receiver)
+  using SonarConnection::receive;
+
+  void receive(folly::StringPiece method, const SonarReceiver& receiver)
       override {
-    receivers_[method] = receiver;
+    std::lock_guard<std::mutex> lock(receiversMutex_);
+    auto receivers = receivers_.latest();
+    receivers[method] = std::make_shared<SonarReceiver>(receiver);
+    receivers_.publish(std::move(receivers));
+  }
+
+  void setDispatcher(
+      std::shared_ptr<SonarCallDispatcher> dispatcher) override {
+    std::lock_guard<std::mutex> lock(receiversMutex_);
+    dispatcher_.publish(std::move(dispatcher));
+  }
+
+  int64_t openCursor(SonarCursor cursor) override {
+    std::lock_guard<std::mutex> lock(cursorsMutex_);
+    if (!active_) {
+      return 0;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    expireCursors(now);
+    if (cursors_.size() >= kMaxCursors) {
+      // Make room by dropping the one fetched from least recently.
+      cursors_.erase(std::min_element(
+          cursors_.begin(),
+          cursors_.end(),
+          [](const Cursors::value_type& a, const Cursors::value_type& b) {
+            return a.second.lastUsed < b.second.lastUsed;
+          }));
+    }
+    const auto cursorId = nextCursorId_++;
+    cursors_.emplace(cursorId, OpenCursor{std::move(cursor), now});
+    return cursorId;
   }
 
  private:
-  SonarWebSocket* socket_;
+  std::shared_ptr<const Sockets> sockets_;
+  std::mutex socketsMutex_;
   std::string name_;
-  std::map<std::string, SonarReceiver> receivers_;
+  std::shared_ptr<folly::Executor> executor_;
+  std::shared_ptr<SonarMetrics> metrics_;
+  // Hashed, and searchable by StringPiece so that sends can look method up
+  // without copying it into a std::string.
+  using Receivers = SonarNameMap<std::shared_ptr<SonarReceiver>>;
+  // Published under receiversMutex_, and looked up by calls without
+  // locking. Calls copy the receiver out, so it stays alive while they run
+  // and replacing it only waits for the lookups.
+  std::mutex receiversMutex_;
+  SonarPublished<Receivers> receivers_;
+  SonarPublished<std::shared_ptr<SonarCallDispatcher>> dispatcher_;
+  // Shared with the responders of calls that are being answered, which
+  // may outlive the connection.
+  const std::shared_ptr<SonarResponseCache> responseCache_{
+      std::make_shared<SonarResponseCache>()};
+  using Throttles = SonarNameMap<std::shared_ptr<SonarSendThrottle>>;
+  // Published under throttlesMutex_, like receivers_.
+  mutable std::mutex throttlesMutex_;
+  SonarPublished<Throttles> throttles_;
+  std::atomic<size_t> highWatermark_{0};
+  std::atomic<bool> blocked_{false};
+  std::atomic<bool> active_{true};
+  std::mutex writableMutex_;
+  std::function<void()> writableCallback_;
+  // Don't hold on to the memory of an occasional huge message.
+  static constexpr size_t kMaxRetainedBufferBytes = 256 * 1024;
+  std::mutex bufferMutex_;
+  std::string buffer_;
+
+  // Built in for every plugin, unless it registers a receiver of its own.
+  static constexpr const char* kFetchNextPage = "fetchNextPage";
+  static constexpr int64_t kDefaultPageSize = 100;
+  static constexpr int64_t kMaxPageSize = 10000;
+  // Cursors are only held for desktops that keep fetching from them, and
+  // only a few at a time, so that abandoned ones don't pile up.
+  static constexpr size_t kMaxCursors = 16;
+  static constexpr int64_t kCursorIdleSeconds = 60;
+  struct OpenCursor {
+    SonarCursor next;
+    std::chrono::steady_clock::time_point lastUsed;
+  };
+  using Cursors = std::unordered_map<int64_t, OpenCursor>;
+  std::mutex cursorsMutex_;
+  Cursors cursors_;
+  int64_t nextCursorId_ = 1;
+  const std::shared_ptr<SonarReceiver> fetchNextPage_;
+
+  void expireCursors(std::chrono::steady_clock::time_point now) {
+    for (auto iter = cursors_.begin(); iter != cursors_.end();) {
+      if (now - iter->second.lastUsed >=
+          std::chrono::seconds(kCursorIdleSeconds)) {
+        iter = cursors_.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+  }
+
+  void fetchNextPage(
+      const folly::dynamic& params,
+      std::unique_ptr<SonarResponder> responder) {
+    const int64_t cursorId = params["cursor"].asInt();
+    int64_t pageSize = params.getDefault("pageSize", 0).asInt();
+    if (pageSize <= 0) {
+      pageSize = kDefaultPageSize;
+    } else if (pageSize > kMaxPageSize) {
+      pageSize = kMaxPageSize;
+    }
+    // Taken out while it runs, so that the cursor isn't held under the lock
+    // and a second fetch of the same page fails rather than racing it.
+    SonarCursor cursor;
+    {
+      std::lock_guard<std::mutex> lock(cursorsMutex_);
+      expireCursors(std::chrono::steady_clock::now());
+      const auto iter = cursors_.find(cursorId);
+      if (iter != cursors_.end()) {
+        cursor = std::move(iter->second.next);
+        cursors_.erase(iter);
+      }
+    }
+    if (!cursor) {
+      responder->error(folly::dynamic::object(
+          "message",
+          "cursor " + std::to_string(cursorId) + " not found or expired"));
+      return;
+    }
+    folly::dynamic items = folly::dynamic::array();
+    bool hasMore = cursor(pageSize, items);
+    if (hasMore) {
+      std::lock_guard<std::mutex> lock(cursorsMutex_);
+      if (active_) {
+        cursors_.emplace(
+            cursorId,
+            OpenCursor{std::move(cursor), std::chrono::steady_clock::now()});
+      } else {
+        hasMore = false;
+      }
+    }
+    responder->page(hasMore ? cursorId : 0, std::move(items), hasMore);
+  }
+
+  bool admit(folly::StringPiece method) {
+    // Copied out, since admitting locks the throttle.
+    const auto throttle = throttles_.read([&](const Throttles& throttles) {
+      if (throttles.empty()) {
+        return std::shared_ptr<SonarSendThrottle>();
+      }
+      const auto iter = throttles.find(method);
+      return iter != throttles.end() ? iter->second : nullptr;
+    });
+    if (!throttle || throttle->admit()) {
+      return true;
+    }
+    if (metrics_) {
+      metrics_->forMethod(name_, method)->messagesDropped++;
+    }
+    return false;
+  }
+
+  // Calls receiver, or if there is none the dispatcher's receiver at index.
+  static void invoke(
+      const SonarReceiver* receiver,
+      SonarCallDispatcher* dispatcher,
+      int index,
+      const folly::dynamic& params,
+      std::unique_ptr<SonarResponder> responder,
+      SonarMetrics* clientMetrics,
+      SonarMethodMetrics* metrics) {
+    SONAR_TRACE_SCOPE("receiver");
+    const auto start = std::chrono::steady_clock::now();
+    // So that SonarLoopWatchdog can tell whose receiver stalled a loop.
+    if (clientMetrics) {
+      clientMetrics->enterReceiver(metrics);
+    }
+    // Account for receivers that throw too, they still held up the thread.
+    SCOPE_EXIT {
+      if (metrics) {
+        metrics->receiverMicros += microsSince(start);
+      }
+      if (clientMetrics) {
+        clientMetrics->exitReceiver(metrics);
+      }
+    };
+    if (receiver) {
+      (*receiver)(params, std::move(responder));
+    } else {
+      dispatcher->dispatch(index, params, std::move(responder));
+    }
+  }
 };
 
 } // namespace sonar
@@ -0,0 +1,190 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarWebSocket.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Stands in for a socket that is only created on the first start(), so that
+ whatever creating it costs, such as threads, TLS contexts and file access,
+ isn't paid during app startup. Until then it is closed and drops whatever
+ is sent to it, as a socket that never connected would.
+ */
+class SonarDeferredWebSocket : public SonarWebSocket {
+ public:
+  using Factory = std::function<std::unique_ptr<SonarWebSocket>()>;
+
+  explicit SonarDeferredWebSocket(Factory factory)
+      : factory_(std::move(factory)) {}
+
+  void start() override {
+    create()->start();
+  }
+
+  void stop() override {
+    if (auto socket = socket_.load()) {
+      socket->stop();
+    }
+  }
+
+  void setSuspended(bool suspended) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    suspended_ = suspended;
+    if (owned_) {
+      owned_->setSuspended(suspended);
+    }
+  }
+
+  bool isOpen() const override {
+    auto socket = socket_.load();
+    return socket && socket->isOpen();
+  }
+
+  void sendMessage(const folly::dynamic& message) override {
+    if (auto socket = socket_.load()) {
+      socket->sendMessage(message);
+    }
+  }
+
+  void sendMessage(folly::dynamic&& message) override {
+    if (auto socket = socket_.load()) {
+      socket->sendMessage(std::move(message));
+    }
+  }
+
+  void sendExecute(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      folly::dynamic&& params) override {
+    if (auto socket = socket_.load()) {
+      socket->sendExecute(api, method, std::move(params));
+    }
+  }
+
+  void sendExecuteLatest(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      folly::StringPiece key,
+      folly::dynamic&& params) override {
+    if (auto socket = socket_.load()) {
+      socket->sendExecuteLatest(api, method, key, std::move(params));
+    }
+  }
+
+  void sendJson(std::string message) override {
+    if (auto socket = socket_.load()) {
+      socket->sendJson(std::move(message));
+    }
+  }
+
+  void sendExecuteJson(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      std::string params) override {
+    if (auto socket = socket_.load()) {
+      socket->sendExecuteJson(api, method, std::move(params));
+    }
+  }
+
+  bool sendSerializedExecute(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      const std::string& payload,
+      SonarMessageEncoding encoding) override {
+    auto socket = socket_.load();
+    // Nothing to send to yet counts as sent, rather than making callers
+    // serialize it again for sendExecute.
+    return !socket ||
+        socket->sendSerializedExecute(api, method, payload, encoding);
+  }
+
+  SonarMessageEncoding getEncoding() const override {
+    auto socket = socket_.load();
+    return socket ? socket->getEncoding() : SonarMessageEncoding::JSON;
+  }
+
+  bool sendBinary(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      const folly::dynamic& metadata,
+      std::unique_ptr<folly::IOBuf> data) override {
+    auto socket = socket_.load();
+    return !socket ||
+        socket->sendBinary(api, method, metadata, std::move(data));
+  }
+
+  bool supportsBinary() const override {
+    auto socket = socket_.load();
+    return socket && socket->supportsBinary();
+  }
+
+  size_t getBufferedBytes() const override {
+    auto socket = socket_.load();
+    return socket ? socket->getBufferedBytes() : 0;
+  }
+
+  void notifyWhenDrained() override {
+    if (auto socket = socket_.load()) {
+      socket->notifyWhenDrained();
+    } else if (callbacks_) {
+      callbacks_->onOutboundQueueDrained();
+    }
+  }
+
+  void setMetrics(std::shared_ptr<SonarMetrics> metrics) override {
+    metrics_ = std::move(metrics);
+  }
+
+  void setCallbacks(Callbacks* callbacks) override {
+    callbacks_ = callbacks;
+  }
+
+  /**
+   Whether the socket was created yet.
+   */
+  bool isCreated() const {
+    return socket_.load() != nullptr;
+  }
+
+ private:
+  SonarWebSocket* create() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!owned_) {
+      owned_ = factory_();
+      factory_ = nullptr;
+      owned_->setMetrics(metrics_);
+      owned_->setCallbacks(callbacks_);
+      if (suspended_) {
+        owned_->setSuspended(true);
+      }
+      socket_ = owned_.get();
+    }
+    return owned_.get();
+  }
+
+  std::mutex mutex_;
+  Factory factory_;
+  std::unique_ptr<SonarWebSocket> owned_;
+  // Published once owned_ is set up, so that sends don't take the lock.
+  std::atomic<SonarWebSocket*> socket_{nullptr};
+  std::shared_ptr<SonarMetrics> metrics_;
+  Callbacks* callbacks_ = nullptr;
+  // Guarded by mutex_, applied once the socket is created.
+  bool suspended_ = false;
+};
+
+} // namespace sonar
+} // namespace facebook
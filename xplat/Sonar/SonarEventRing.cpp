@@ -0,0 +1,233 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarEventRing.h"
+
+#include <fcntl.h>
+#include <folly/Random.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+
+namespace facebook {
+namespace sonar {
+
+namespace {
+
+// Written where a record doesn't fit before the end of the arena, to send
+// readers back to the start. Too little room for it means the same.
+const uint32_t kWrapMarker = UINT32_MAX;
+
+const uint32_t kMagic = 0x534b4552; // "SKER"
+const uint32_t kVersion = 1;
+
+} // namespace
+
+SonarEventRing::SonarEventRing(
+    size_t maxEvents,
+    size_t capacityBytes,
+    DropPolicy dropPolicy)
+    : maxEvents_(maxEvents),
+      capacity_(capacityBytes),
+      dropPolicy_(dropPolicy),
+      ownedStorage_(new uint8_t[sizeof(State) + capacityBytes]),
+      mappedSize_(0),
+      state_(reinterpret_cast<State*>(ownedStorage_.get())),
+      data_(ownedStorage_.get() + sizeof(State)) {
+  reset();
+}
+
+SonarEventRing::SonarEventRing(
+    uint8_t* storage,
+    size_t mappedSize,
+    size_t maxEvents,
+    size_t capacityBytes,
+    DropPolicy dropPolicy)
+    : maxEvents_(maxEvents),
+      capacity_(capacityBytes),
+      dropPolicy_(dropPolicy),
+      mappedSize_(mappedSize),
+      state_(reinterpret_cast<State*>(storage)),
+      data_(storage + sizeof(State)) {
+  if (!restore()) {
+    reset();
+  }
+  while (state_->count > maxEvents_) {
+    pop();
+  }
+}
+
+std::unique_ptr<SonarEventRing> SonarEventRing::mapped(
+    const std::string& path,
+    size_t maxEvents,
+    size_t capacityBytes,
+    DropPolicy dropPolicy) {
+  const size_t size = sizeof(State) + capacityBytes;
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    return nullptr;
+  }
+  void* storage = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    storage = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (storage == MAP_FAILED) {
+    return nullptr;
+  }
+  return std::unique_ptr<SonarEventRing>(new SonarEventRing(
+      static_cast<uint8_t*>(storage),
+      size,
+      maxEvents,
+      capacityBytes,
+      dropPolicy));
+}
+
+SonarEventRing::~SonarEventRing() {
+  if (mappedSize_ != 0) {
+    munmap(state_, mappedSize_);
+  }
+}
+
+bool SonarEventRing::restore() const {
+  const State& state = *state_;
+  if (state.magic != kMagic || state.version != kVersion ||
+      state.capacity != capacity_ || capacity_ < sizeof(Header) ||
+      state.head > capacity_ || state.tail > capacity_) {
+    return false;
+  }
+  // The previous launch may have died halfway through a push, so only
+  // trust the records if walking them ends up exactly at the tail.
+  uint64_t offset = state.head;
+  for (uint64_t i = 0; i < state.count; i++) {
+    Header header;
+    offset = recordAt(offset, header);
+    offset += sizeof(header) + uint64_t(header.methodLength) +
+        header.paramsLength;
+    if (offset > capacity_) {
+      return false;
+    }
+  }
+  return state.count == 0 || offset == state.tail;
+}
+
+void SonarEventRing::reset() {
+  *state_ = {kMagic, kVersion, capacity_, 0, 0, 0};
+}
+
+bool SonarEventRing::hasRoom(size_t size) const {
+  if (state_->count == 0) {
+    return size <= capacity_;
+  }
+  if (state_->count == maxEvents_) {
+    return false;
+  }
+  if (state_->tail > state_->head) {
+    return state_->tail + size <= capacity_ || size <= state_->head;
+  }
+  return state_->tail + size <= state_->head;
+}
+
+void SonarEventRing::push(folly::StringPiece method, folly::StringPiece params) {
+  const size_t size = sizeof(Header) + method.size() + params.size();
+  if (maxEvents_ == 0 || size > capacity_) {
+    return;
+  }
+  if (!hasRoom(size)) {
+    switch (dropPolicy_) {
+      case DropPolicy::DropNewest:
+        return;
+      case DropPolicy::Sample:
+        ++overflow_;
+        if (folly::Random::rand64(maxEvents_ + overflow_) >= maxEvents_) {
+          return;
+        }
+        break;
+      case DropPolicy::DropOldest:
+        break;
+    }
+    while (!hasRoom(size)) {
+      pop();
+    }
+  }
+  if (state_->count == 0) {
+    state_->head = state_->tail = 0;
+  } else if (state_->tail > state_->head && state_->tail + size > capacity_) {
+    if (capacity_ - state_->tail >= sizeof(kWrapMarker)) {
+      std::memcpy(data_ + state_->tail, &kWrapMarker, sizeof(kWrapMarker));
+    }
+    state_->tail = 0;
+  }
+  const Header header = {uint32_t(method.size()), uint32_t(params.size())};
+  uint8_t* out = data_ + state_->tail;
+  std::memcpy(out, &header, sizeof(header));
+  std::memcpy(out + sizeof(header), method.data(), method.size());
+  std::memcpy(
+      out + sizeof(header) + method.size(), params.data(), params.size());
+  state_->tail += size;
+  ++state_->count;
+}
+
+size_t SonarEventRing::recordAt(size_t offset, Header& header) const {
+  if (capacity_ - offset < sizeof(header)) {
+    offset = 0;
+  } else {
+    uint32_t marker;
+    std::memcpy(&marker, data_ + offset, sizeof(marker));
+    if (marker == kWrapMarker) {
+      offset = 0;
+    }
+  }
+  std::memcpy(&header, data_ + offset, sizeof(header));
+  return offset;
+}
+
+void SonarEventRing::front(
+    folly::StringPiece& method,
+    folly::StringPiece& params) const {
+  Header header;
+  const auto offset = recordAt(state_->head, header);
+  const char* record =
+      reinterpret_cast<const char*>(data_ + offset + sizeof(header));
+  method = folly::StringPiece(record, header.methodLength);
+  params =
+      folly::StringPiece(record + header.methodLength, header.paramsLength);
+}
+
+void SonarEventRing::pop() {
+  Header header;
+  const auto offset = recordAt(state_->head, header);
+  state_->head =
+      offset + sizeof(header) + header.methodLength + header.paramsLength;
+  if (--state_->count == 0) {
+    state_->head = state_->tail = 0;
+    overflow_ = 0;
+  }
+}
+
+size_t SonarEventRing::usedBytes() const {
+  if (state_->count == 0) {
+    return 0;
+  }
+  if (state_->tail > state_->head) {
+    return state_->tail - state_->head;
+  }
+  // Wrapped, the space skipped at the end of the arena included.
+  return capacity_ - state_->head + state_->tail;
+}
+
+size_t SonarEventRing::evict(size_t bytes) {
+  const size_t before = usedBytes();
+  while (!empty() && before - usedBytes() < bytes) {
+    pop();
+  }
+  return before - usedBytes();
+}
+
+} // namespace sonar
+} // namespace facebook
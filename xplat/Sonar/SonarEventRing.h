@@ -0,0 +1,160 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Range.h>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Fixed size ring of serialized events, oldest first, for plugins to buffer
+ events in while disconnected. Each event is a method name and its params
+ serialized as JSON, stored back to back in a single preallocated arena, so
+ buffered events cost their serialized size and nothing else, and pushing
+ and evicting never allocate. Not thread safe.
+ */
+class SonarEventRing {
+ public:
+  /**
+   What happens to pushed events once the ring is full.
+   */
+  enum class DropPolicy {
+    // New events replace the oldest ones.
+    DropOldest,
+    // New events are dropped.
+    DropNewest,
+    // New events are kept less and less often, replacing the oldest ones:
+    // the n-th event past a full ring of maxEvents is kept with probability
+    // maxEvents / (maxEvents + n).
+    Sample,
+  };
+
+  SonarEventRing(
+      size_t maxEvents,
+      size_t capacityBytes,
+      DropPolicy dropPolicy = DropPolicy::DropOldest);
+
+  /**
+   A ring kept in the file at path, mapped into memory, so that events
+   buffered by one launch are still there for the next. Buffering only
+   writes to the mapping, leaving it to the system to write it back.
+   Returns null if the file can't be mapped.
+   */
+  static std::unique_ptr<SonarEventRing> mapped(
+      const std::string& path,
+      size_t maxEvents,
+      size_t capacityBytes,
+      DropPolicy dropPolicy = DropPolicy::DropOldest);
+
+  ~SonarEventRing();
+
+  SonarEventRing(const SonarEventRing&) = delete;
+  SonarEventRing& operator=(const SonarEventRing&) = delete;
+
+  bool empty() const {
+    return state_->count == 0;
+  }
+
+  size_t size() const {
+    return state_->count;
+  }
+
+  /**
+   Adds an event, making room for it according to the drop policy.
+   */
+  void push(folly::StringPiece method, folly::StringPiece params);
+
+  /**
+   The oldest event. The pieces point into the ring and are only valid
+   until it is next modified.
+   */
+  void front(folly::StringPiece& method, folly::StringPiece& params) const;
+
+  void pop();
+
+  /**
+   Bytes of the arena taken up by the events held.
+   */
+  size_t usedBytes() const;
+
+  /**
+   Drops the oldest events until at least bytes were freed, or the ring is
+   empty. Returns how many bytes were freed.
+   */
+  size_t evict(size_t bytes);
+
+  /**
+   Hands up to limit of the oldest events to send(method, params), straight
+   from the arena, removing each once send returns. Returns how many were
+   sent.
+   */
+  template <typename Send>
+  size_t drain(
+      Send&& send,
+      size_t limit = std::numeric_limits<size_t>::max()) {
+    size_t sent = 0;
+    folly::StringPiece method, params;
+    while (sent < limit && !empty()) {
+      front(method, params);
+      send(method, params);
+      pop();
+      sent++;
+    }
+    return sent;
+  }
+
+ private:
+  struct Header {
+    uint32_t methodLength;
+    uint32_t paramsLength;
+  };
+
+  // Kept at the start of the storage, ahead of the records, so that a
+  // mapped ring can be picked up again.
+  struct State {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    // Offsets of the oldest record and of the end of the newest one.
+    uint64_t head;
+    uint64_t tail;
+    uint64_t count;
+  };
+
+  SonarEventRing(
+      uint8_t* storage,
+      size_t mappedSize,
+      size_t maxEvents,
+      size_t capacityBytes,
+      DropPolicy dropPolicy);
+
+  bool restore() const;
+  void reset();
+  bool hasRoom(size_t size) const;
+  size_t recordAt(size_t offset, Header& header) const;
+
+  const size_t maxEvents_;
+  const size_t capacity_;
+  const DropPolicy dropPolicy_;
+  std::unique_ptr<uint8_t[]> ownedStorage_;
+  // Non-zero when the storage is a mapping to unmap.
+  const size_t mappedSize_;
+  State* const state_;
+  uint8_t* const data_;
+  // Events that arrived while full, for the sample policy.
+  size_t overflow_ = 0;
+};
+
+} // namespace sonar
+} // namespace facebook
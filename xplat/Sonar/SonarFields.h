@@ -0,0 +1,366 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarMessageWriter.h>
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Types that are sent as JSON objects describe their fields with a static
+ constexpr sonarFields() returning a tuple of sonarField:
+
+   struct Highlight {
+     std::string id;
+     bool isAlignmentMode;
+
+     static constexpr auto sonarFields() {
+       return std::make_tuple(
+           sonarField("id", &Highlight::id),
+           sonarField("isAlignmentMode", &Highlight::isAlignmentMode));
+     }
+   };
+
+ writeSonarFields then writes a value with one SonarMessageWriter call per
+ field, resolved at compile time, and readSonarFields reads one back from
+ the params of a call. Fields can be numbers, bools, enums, strings,
+ folly::dynamic, folly::Optional (null when empty), vectors, maps with
+ string keys, and other types with sonarFields.
+ */
+template <typename T, typename M>
+struct SonarField {
+  const char* name;
+  M T::*member;
+};
+
+template <typename T, typename M>
+constexpr SonarField<T, M> sonarField(const char* name, M T::*member) {
+  return SonarField<T, M>{name, member};
+}
+
+template <typename T>
+using SonarFieldsOf = decltype(T::sonarFields());
+
+template <typename T, typename = void>
+struct HasSonarFields : std::false_type {};
+
+template <typename T>
+struct HasSonarFields<T, decltype(void(T::sonarFields()))> : std::true_type {};
+
+template <typename T>
+typename std::enable_if<HasSonarFields<T>::value>::type writeSonarFields(
+    SonarMessageWriter& writer,
+    const T& value);
+
+template <typename T>
+typename std::enable_if<HasSonarFields<T>::value>::type readSonarFields(
+    const folly::dynamic& params,
+    T& value);
+
+namespace detail {
+
+inline void writeSonarValue(SonarMessageWriter& writer, bool value) {
+  writer.value(value);
+}
+
+inline void writeSonarValue(SonarMessageWriter& writer, double value) {
+  writer.value(value);
+}
+
+inline void writeSonarValue(SonarMessageWriter& writer, float value) {
+  writer.value(static_cast<double>(value));
+}
+
+template <typename T>
+typename std::enable_if<
+    std::is_integral<T>::value && !std::is_same<T, bool>::value>::type
+writeSonarValue(SonarMessageWriter& writer, T value) {
+  writer.value(value);
+}
+
+template <typename T>
+typename std::enable_if<std::is_enum<T>::value>::type writeSonarValue(
+    SonarMessageWriter& writer,
+    T value) {
+  writer.value(static_cast<typename std::underlying_type<T>::type>(value));
+}
+
+inline void writeSonarValue(
+    SonarMessageWriter& writer,
+    const std::string& value) {
+  writer.value(value);
+}
+
+inline void writeSonarValue(SonarMessageWriter& writer, const char* value) {
+  writer.value(value);
+}
+
+inline void writeSonarValue(
+    SonarMessageWriter& writer,
+    const folly::dynamic& value) {
+  writer.valueDynamic(value);
+}
+
+template <typename T>
+typename std::enable_if<HasSonarFields<T>::value>::type writeSonarValue(
+    SonarMessageWriter& writer,
+    const T& value) {
+  writer.beginObject();
+  writeSonarFields(writer, value);
+  writer.endObject();
+}
+
+template <typename T>
+void writeSonarValue(
+    SonarMessageWriter& writer,
+    const folly::Optional<T>& value);
+
+template <typename T>
+void writeSonarValue(SonarMessageWriter& writer, const std::vector<T>& value);
+
+template <typename T>
+void writeSonarValue(
+    SonarMessageWriter& writer,
+    const std::map<std::string, T>& value);
+
+template <typename T>
+void writeSonarValue(
+    SonarMessageWriter& writer,
+    const std::unordered_map<std::string, T>& value);
+
+template <typename T>
+void writeSonarValue(
+    SonarMessageWriter& writer,
+    const folly::Optional<T>& value) {
+  if (value.hasValue()) {
+    writeSonarValue(writer, value.value());
+  } else {
+    writer.valueNull();
+  }
+}
+
+template <typename T>
+void writeSonarValue(SonarMessageWriter& writer, const std::vector<T>& value) {
+  writer.beginArray();
+  for (const auto& element : value) {
+    writeSonarValue(writer, element);
+  }
+  writer.endArray();
+}
+
+template <typename Map>
+void writeSonarMap(SonarMessageWriter& writer, const Map& value) {
+  writer.beginObject();
+  for (const auto& entry : value) {
+    writer.key(entry.first);
+    writeSonarValue(writer, entry.second);
+  }
+  writer.endObject();
+}
+
+template <typename T>
+void writeSonarValue(
+    SonarMessageWriter& writer,
+    const std::map<std::string, T>& value) {
+  writeSonarMap(writer, value);
+}
+
+template <typename T>
+void writeSonarValue(
+    SonarMessageWriter& writer,
+    const std::unordered_map<std::string, T>& value) {
+  writeSonarMap(writer, value);
+}
+
+template <typename T, typename Fields, size_t... I>
+void writeSonarFieldList(
+    SonarMessageWriter& writer,
+    const T& value,
+    const Fields& fields,
+    std::index_sequence<I...>) {
+  (void)std::initializer_list<int>{
+      (writer.key(std::get<I>(fields).name),
+       writeSonarValue(writer, value.*(std::get<I>(fields).member)),
+       0)...};
+}
+
+} // namespace detail
+
+/**
+ Writes the fields of value, inside the object the writer is in.
+ */
+template <typename T>
+typename std::enable_if<HasSonarFields<T>::value>::type writeSonarFields(
+    SonarMessageWriter& writer,
+    const T& value) {
+  constexpr auto fields = T::sonarFields();
+  detail::writeSonarFieldList(
+      writer,
+      value,
+      fields,
+      std::make_index_sequence<std::tuple_size<SonarFieldsOf<T>>::value>());
+}
+
+namespace detail {
+
+inline void readSonarValue(const folly::dynamic& in, bool& out) {
+  out = in.asBool();
+}
+
+template <typename T>
+typename std::enable_if<
+    std::is_integral<T>::value && !std::is_same<T, bool>::value>::type
+readSonarValue(const folly::dynamic& in, T& out) {
+  out = static_cast<T>(in.asInt());
+}
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type
+readSonarValue(const folly::dynamic& in, T& out) {
+  out = static_cast<T>(in.asDouble());
+}
+
+template <typename T>
+typename std::enable_if<std::is_enum<T>::value>::type readSonarValue(
+    const folly::dynamic& in,
+    T& out) {
+  out = static_cast<T>(in.asInt());
+}
+
+inline void readSonarValue(const folly::dynamic& in, std::string& out) {
+  out = in.getString();
+}
+
+inline void readSonarValue(const folly::dynamic& in, folly::dynamic& out) {
+  out = in;
+}
+
+template <typename T>
+typename std::enable_if<HasSonarFields<T>::value>::type readSonarValue(
+    const folly::dynamic& in,
+    T& out) {
+  readSonarFields(in, out);
+}
+
+template <typename T>
+void readSonarValue(const folly::dynamic& in, folly::Optional<T>& out);
+
+template <typename T>
+void readSonarValue(const folly::dynamic& in, std::vector<T>& out);
+
+template <typename T>
+void readSonarValue(const folly::dynamic& in, std::map<std::string, T>& out);
+
+template <typename T>
+void readSonarValue(
+    const folly::dynamic& in,
+    std::unordered_map<std::string, T>& out);
+
+template <typename T>
+void readSonarValue(const folly::dynamic& in, folly::Optional<T>& out) {
+  if (in.isNull()) {
+    out.clear();
+    return;
+  }
+  T value;
+  readSonarValue(in, value);
+  out = std::move(value);
+}
+
+template <typename T>
+void readSonarValue(const folly::dynamic& in, std::vector<T>& out) {
+  out.clear();
+  out.reserve(in.size());
+  for (const auto& element : in) {
+    out.emplace_back();
+    readSonarValue(element, out.back());
+  }
+}
+
+template <typename Map>
+void readSonarMap(const folly::dynamic& in, Map& out) {
+  out.clear();
+  for (const auto& entry : in.items()) {
+    readSonarValue(entry.second, out[entry.first.getString()]);
+  }
+}
+
+template <typename T>
+void readSonarValue(const folly::dynamic& in, std::map<std::string, T>& out) {
+  readSonarMap(in, out);
+}
+
+template <typename T>
+void readSonarValue(
+    const folly::dynamic& in,
+    std::unordered_map<std::string, T>& out) {
+  readSonarMap(in, out);
+}
+
+template <typename M>
+void readSonarField(
+    const folly::dynamic& params,
+    const char* name,
+    M& member) {
+  const auto& field = params.getDefault(name);
+  if (!field.isNull()) {
+    readSonarValue(field, member);
+  }
+}
+
+template <typename T, typename Fields, size_t... I>
+void readSonarFieldList(
+    const folly::dynamic& params,
+    T& value,
+    const Fields& fields,
+    std::index_sequence<I...>) {
+  (void)std::initializer_list<int>{(
+      readSonarField(
+          params,
+          std::get<I>(fields).name,
+          value.*(std::get<I>(fields).member)),
+      0)...};
+}
+
+} // namespace detail
+
+/**
+ Reads the fields of value from params. Fields that are missing or null
+ keep the value they had. Throws folly::TypeError if params or a field has
+ the wrong type.
+ */
+template <typename T>
+typename std::enable_if<HasSonarFields<T>::value>::type readSonarFields(
+    const folly::dynamic& params,
+    T& value) {
+  if (params.isNull()) {
+    return;
+  }
+  constexpr auto fields = T::sonarFields();
+  detail::readSonarFieldList(
+      params,
+      value,
+      fields,
+      std::make_index_sequence<std::tuple_size<SonarFieldsOf<T>>::value>());
+}
+
+} // namespace sonar
+} // namespace facebook
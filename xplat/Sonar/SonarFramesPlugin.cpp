@@ -0,0 +1,187 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarFramesPlugin.h"
+#include "SonarThreadCpu.h"
+
+#include <algorithm>
+
+namespace facebook {
+namespace sonar {
+
+constexpr const char* SonarFramesPlugin::kIdentifier;
+
+namespace {
+
+constexpr int64_t kNanosPerMs = 1000000;
+constexpr int64_t kDefaultRefreshPeriod = 16666667;
+// Gaps longer than this are the app being paused or in the background, not
+// a frame.
+constexpr int64_t kMaxFrameDuration = 10000 * kNanosPerMs;
+
+// Only onFrame writes, so there is no need for a read-modify-write.
+inline void increment(std::atomic<int64_t>& cell, int64_t amount = 1) {
+  cell.store(
+      cell.load(std::memory_order_relaxed) + amount,
+      std::memory_order_relaxed);
+}
+
+size_t bucketOf(int64_t duration) {
+  size_t bucket = 0;
+  while (bucket + 1 < detail::kSonarFrameBuckets &&
+         duration > detail::kSonarFrameBucketsMs[bucket] * kNanosPerMs) {
+    bucket++;
+  }
+  return bucket;
+}
+
+} // namespace
+
+SonarFramesPlugin::SonarFramesPlugin(std::chrono::milliseconds summaryInterval)
+    : summaryInterval_(summaryInterval),
+      refreshPeriod_(kDefaultRefreshPeriod),
+      summarizedAt_(std::chrono::steady_clock::now()) {
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+SonarFramesPlugin::~SonarFramesPlugin() {
+  stopSummarizing();
+}
+
+void SonarFramesPlugin::onFrame(int64_t frameTimeNanos) {
+  const int64_t last =
+      lastFrameTime_.exchange(frameTimeNanos, std::memory_order_relaxed);
+  const int64_t duration = frameTimeNanos - last;
+  if (last == 0 || duration <= 0 || duration > kMaxFrameDuration) {
+    return;
+  }
+  increment(frames_);
+  increment(buckets_[bucketOf(duration)]);
+  // A frame that took two and a half refreshes missed two, rounding off the
+  // jitter of the frame times.
+  const int64_t period = refreshPeriod_.load(std::memory_order_relaxed);
+  const int64_t missed = (duration + period / 2) / period - 1;
+  if (missed > 0) {
+    increment(missed_, missed);
+  }
+  if (duration > longestFrame_.load(std::memory_order_relaxed)) {
+    longestFrame_.store(duration, std::memory_order_relaxed);
+  }
+}
+
+void SonarFramesPlugin::setRefreshPeriod(std::chrono::nanoseconds period) {
+  if (period.count() > 0) {
+    refreshPeriod_.store(period.count(), std::memory_order_relaxed);
+  }
+}
+
+std::string SonarFramesPlugin::identifier() const {
+  return kIdentifier;
+}
+
+void SonarFramesPlugin::didConnect(std::shared_ptr<SonarConnection> conn) {
+  stopSummarizing();
+  // Frames only come while connected, the gap since the last one isn't one.
+  lastFrameTime_.store(0, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(connectionMutex_);
+    connection_ = std::move(conn);
+    sentBuckets_ = false;
+    lastSonarCpu_ = sonarThreadsCpuNanos();
+    summarizedAt_ = std::chrono::steady_clock::now();
+  }
+  stopSummarizer_ = false;
+  summarizer_ = std::thread([this] {
+    std::unique_lock<std::mutex> lock(summarizerMutex_);
+    while (!summarizerWakeup_.wait_for(
+        lock, summaryInterval_, [this] { return stopSummarizer_; })) {
+      lock.unlock();
+      summarize();
+      lock.lock();
+    }
+  });
+}
+
+void SonarFramesPlugin::didDisconnect() {
+  stopSummarizing();
+  std::lock_guard<std::mutex> lock(connectionMutex_);
+  connection_ = nullptr;
+}
+
+void SonarFramesPlugin::stopSummarizing() {
+  if (!summarizer_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(summarizerMutex_);
+    stopSummarizer_ = true;
+  }
+  summarizerWakeup_.notify_all();
+  summarizer_.join();
+}
+
+void SonarFramesPlugin::summarize() {
+  std::lock_guard<std::mutex> lock(connectionMutex_);
+  if (!connection_ || !connection_->isActive()) {
+    return;
+  }
+
+  const int64_t frames = frames_.load(std::memory_order_relaxed);
+  const int64_t missed = missed_.load(std::memory_order_relaxed);
+  int64_t buckets[detail::kSonarFrameBuckets];
+  for (size_t i = 0; i < detail::kSonarFrameBuckets; i++) {
+    buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+  }
+  const int64_t longest = longestFrame_.exchange(0, std::memory_order_relaxed);
+  // Threads that exited take their time with them, which can make the
+  // total go down.
+  const int64_t sonarCpu = sonarThreadsCpuNanos();
+  const int64_t sonarCpuDelta = std::max<int64_t>(sonarCpu - lastSonarCpu_, 0);
+  lastSonarCpu_ = sonarCpu;
+
+  const auto now = std::chrono::steady_clock::now();
+  if (frames == lastFrames_ && sonarCpuDelta == 0) {
+    return;
+  }
+  const auto interval =
+      std::chrono::duration_cast<std::chrono::milliseconds>(now - summarizedAt_);
+  summarizedAt_ = now;
+
+  connection_->sendWith("frames", [&](SonarMessageWriter& writer) {
+    writer.put("interval", static_cast<int64_t>(interval.count()))
+        .put("frames", frames - lastFrames_)
+        .put("missed", missed - lastMissed_)
+        .put("longestUs", longest / 1000)
+        .put("refreshPeriodUs",
+             refreshPeriod_.load(std::memory_order_relaxed) / 1000)
+        .put("sonarCpuUs", sonarCpuDelta / 1000);
+    // The bounds go out once per connection.
+    if (!sentBuckets_) {
+      writer.beginArray("bucketsMs");
+      for (auto bound : detail::kSonarFrameBucketsMs) {
+        writer.add(bound);
+      }
+      writer.endArray();
+    }
+    writer.beginArray("buckets");
+    for (size_t i = 0; i < detail::kSonarFrameBuckets; i++) {
+      writer.add(buckets[i] - lastBuckets_[i]);
+    }
+    writer.endArray();
+  });
+
+  sentBuckets_ = true;
+  lastFrames_ = frames;
+  lastMissed_ = missed;
+  std::copy(std::begin(buckets), std::end(buckets), std::begin(lastBuckets_));
+}
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,110 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarPlugin.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace facebook {
+namespace sonar {
+
+namespace detail {
+
+// Upper bounds of the frame duration buckets in milliseconds, the last
+// bucket holds everything longer.
+constexpr int64_t kSonarFrameBucketsMs[] =
+    {8, 12, 17, 25, 34, 50, 67, 100, 167, 250, 500, 1000};
+constexpr size_t kSonarFrameBuckets =
+    sizeof(kSonarFrameBucketsMs) / sizeof(kSonarFrameBucketsMs[0]) + 1;
+
+} // namespace detail
+
+/**
+ Sends a summary of the app's frame durations to the desktop's Frames
+ plugin once per summaryInterval: a histogram of how long frames took, how
+ many refreshes were missed, and how much CPU time Sonar's own threads took
+ meanwhile, so that jank can be told apart from what the inspector costs.
+
+ The platform calls onFrame for every frame, from a vsync driven callback
+ such as a Choreographer.FrameCallback or a CADisplayLink, while the plugin
+ is connected. Recording a frame is a few relaxed atomic stores, the
+ summaries are put together on the plugin's own thread.
+ */
+class SonarFramesPlugin : public SonarPlugin {
+ public:
+  static constexpr const char* kIdentifier = "Frames";
+
+  explicit SonarFramesPlugin(
+      std::chrono::milliseconds summaryInterval = std::chrono::seconds(1));
+
+  ~SonarFramesPlugin();
+
+  /**
+   The time the frame started, in nanoseconds on a clock that is the same
+   for every call, such as Choreographer's frameTimeNanos. Only called from
+   one thread at a time.
+   */
+  void onFrame(int64_t frameTimeNanos);
+
+  /**
+   The display's refresh period, which frames missing refreshes are
+   counted against. 60Hz unless set.
+   */
+  void setRefreshPeriod(std::chrono::nanoseconds period);
+
+  std::string identifier() const override;
+  void didConnect(std::shared_ptr<SonarConnection> conn) override;
+  void didDisconnect() override;
+
+  /**
+   Sends a summary of the frames since the last one, unless there were none
+   and Sonar's threads didn't run either. Called on the plugin's own thread
+   while connected.
+   */
+  void summarize();
+
+ private:
+  void stopSummarizing();
+
+  const std::chrono::milliseconds summaryInterval_;
+
+  // Written by onFrame only, as totals since the plugin was created, so that
+  // summaries can read them without a read-modify-write.
+  std::atomic<int64_t> lastFrameTime_{0};
+  std::atomic<int64_t> refreshPeriod_;
+  std::atomic<int64_t> frames_{0};
+  std::atomic<int64_t> missed_{0};
+  std::atomic<int64_t> buckets_[detail::kSonarFrameBuckets];
+  // Since the last summary, which resets it.
+  std::atomic<int64_t> longestFrame_{0};
+
+  // Guarded by connectionMutex_.
+  std::mutex connectionMutex_;
+  std::shared_ptr<SonarConnection> connection_;
+  bool sentBuckets_ = false;
+  int64_t lastFrames_ = 0;
+  int64_t lastMissed_ = 0;
+  int64_t lastBuckets_[detail::kSonarFrameBuckets] = {};
+  int64_t lastSonarCpu_ = 0;
+  std::chrono::steady_clock::time_point summarizedAt_;
+
+  std::thread summarizer_;
+  std::mutex summarizerMutex_;
+  std::condition_variable summarizerWakeup_;
+  bool stopSummarizer_ = false;
+};
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,207 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarHostRace.h"
+
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/AsyncSocketException.h>
+#include <memory>
+#include <stdexcept>
+
+namespace facebook {
+namespace sonar {
+
+namespace {
+
+class Race;
+
+class Probe : public folly::AsyncSocket::ConnectCallback {
+ public:
+  Probe(Race* race, size_t candidate) : race_(race), candidate_(candidate) {}
+
+  void connectSuccess() noexcept override;
+  void connectErr(const folly::AsyncSocketException& ex) noexcept override;
+
+  folly::AsyncSocket::UniquePtr socket;
+
+ private:
+  Race* race_;
+  const size_t candidate_;
+};
+
+/**
+ One race between the candidates, kept alive by its timers and by itself
+ until it is decided.
+ */
+class Race : public std::enable_shared_from_this<Race> {
+ public:
+  Race(
+      folly::EventBase* eventBase,
+      std::vector<folly::SocketAddress> addresses,
+      std::chrono::milliseconds timeout)
+      : eventBase_(eventBase),
+        addresses_(std::move(addresses)),
+        timeout_(timeout) {}
+
+  folly::Future<size_t> start(std::chrono::milliseconds stagger) {
+    self_ = shared_from_this();
+    auto winner = promise_.getFuture();
+    startNext();
+    for (size_t i = 1; i < addresses_.size(); i++) {
+      eventBase_->runAfterDelay(
+          [self = shared_from_this()]() { self->startNext(); },
+          stagger.count() * i);
+    }
+    return winner;
+  }
+
+  void succeeded(size_t candidate) {
+    if (!decided_) {
+      decide();
+      promise_.setValue(candidate);
+    }
+  }
+
+  void failed(const folly::AsyncSocketException& ex) {
+    error_ = folly::make_exception_wrapper<folly::AsyncSocketException>(ex);
+    if (++failures_ == addresses_.size()) {
+      if (!decided_) {
+        decide();
+        promise_.setException(std::move(error_));
+      }
+      return;
+    }
+    // Don't wait for the stagger when a host is already known not to work.
+    startNext();
+  }
+
+ private:
+  folly::EventBase* eventBase_;
+  const std::vector<folly::SocketAddress> addresses_;
+  const std::chrono::milliseconds timeout_;
+  folly::Promise<size_t> promise_;
+  std::vector<std::unique_ptr<Probe>> probes_;
+  size_t next_ = 0;
+  size_t failures_ = 0;
+  bool decided_ = false;
+  folly::exception_wrapper error_;
+  std::shared_ptr<Race> self_;
+
+  void startNext() {
+    if (decided_ || next_ >= addresses_.size()) {
+      return;
+    }
+    const auto candidate = next_++;
+    probes_.push_back(std::make_unique<Probe>(this, candidate));
+    auto probe = probes_.back().get();
+    probe->socket = folly::AsyncSocket::newSocket(eventBase_);
+    probe->socket->connect(probe, addresses_[candidate], timeout_.count());
+  }
+
+  // The probes only tell which host works, the winner's connection is
+  // closed too. They are destroyed outside of their callbacks.
+  void decide() {
+    decided_ = true;
+    eventBase_->runInLoop([self = std::move(self_)]() {
+      for (auto& probe : self->probes_) {
+        probe->socket->closeNow();
+      }
+      self->probes_.clear();
+    });
+  }
+};
+
+void Probe::connectSuccess() noexcept {
+  race_->succeeded(candidate_);
+}
+
+void Probe::connectErr(const folly::AsyncSocketException& ex) noexcept {
+  race_->failed(ex);
+}
+
+} // namespace
+
+SonarHostRace::SonarHostRace(
+    std::vector<std::string> hosts,
+    std::chrono::milliseconds stagger,
+    std::chrono::milliseconds timeout)
+    : hosts_(std::move(hosts)), stagger_(stagger), timeout_(timeout) {}
+
+void SonarHostRace::resolve() {
+  resolved_.clear();
+  for (const auto& host : hosts_) {
+    folly::SocketAddress address;
+    try {
+      // Blocks on getaddrinfo, which is why it's cached.
+      address.setFromHostPort(host, 0);
+      resolved_.push_back(address);
+    } catch (const std::exception&) {
+      resolved_.push_back(folly::none);
+    }
+  }
+  isResolved_ = true;
+}
+
+folly::Future<folly::SocketAddress> SonarHostRace::pick(
+    folly::EventBase* eventBase,
+    uint16_t port) {
+  if (!isResolved_) {
+    resolve();
+  }
+  if (!winner_) {
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < resolved_.size(); i++) {
+      if (resolved_[i]) {
+        candidates.push_back(i);
+      }
+    }
+    if (candidates.empty()) {
+      isResolved_ = false;
+      return folly::makeFuture<folly::SocketAddress>(std::runtime_error(
+          "None of the desktop's hosts resolved to an address"));
+    }
+    if (candidates.size() == 1) {
+      winner_ = candidates.front();
+    } else {
+      std::vector<folly::SocketAddress> addresses;
+      for (const auto candidate : candidates) {
+        addresses.push_back(*resolved_[candidate]);
+        addresses.back().setPort(port);
+      }
+      auto race =
+          std::make_shared<Race>(eventBase, std::move(addresses), timeout_);
+      return race->start(stagger_)
+          .thenValue([this, candidates, port](size_t winner) {
+            winner_ = candidates[winner];
+            auto address = *resolved_[*winner_];
+            address.setPort(port);
+            return address;
+          })
+          .onError([this](folly::exception_wrapper error) {
+            // The network may have changed under the cached addresses.
+            isResolved_ = false;
+            return folly::makeFuture<folly::SocketAddress>(std::move(error));
+          });
+    }
+  }
+  auto address = *resolved_[*winner_];
+  address.setPort(port);
+  return folly::makeFuture(std::move(address));
+}
+
+void SonarHostRace::forget() {
+  // The first failure races the cached addresses again, the second in a
+  // row resolves them again.
+  if (!winner_) {
+    isResolved_ = false;
+  }
+  winner_ = folly::none;
+}
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/SocketAddress.h>
+#include <folly/futures/Future.h>
+#include <folly/io/async/EventBase.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Picks which of several hosts the desktop is reached on, for devices and
+ emulators that reach it on a different address depending on how they are
+ set up (localhost through adb reverse, 10.0.2.2 from the stock emulator,
+ a LAN address).
+
+ Hosts are resolved once and cached. With more than one, they are raced
+ the happy eyeballs way: each host is dialled a little after the previous
+ one, or as soon as the previous one fails, and the first to accept a TCP
+ connection wins. The winner is picked straight away, without a race, the
+ next time. Must be used on one EventBase's thread.
+ */
+class SonarHostRace {
+ public:
+  explicit SonarHostRace(
+      std::vector<std::string> hosts,
+      std::chrono::milliseconds stagger = std::chrono::milliseconds(250),
+      std::chrono::milliseconds timeout = std::chrono::seconds(5));
+
+  /**
+   The address to connect to the desktop on port, completing on eventBase.
+   Fails with the last error if none of the hosts could be connected to.
+   */
+  folly::Future<folly::SocketAddress> pick(
+      folly::EventBase* eventBase,
+      uint16_t port);
+
+  /**
+   Called when connecting to the picked address failed, so that the next
+   pick races the hosts again.
+   */
+  void forget();
+
+ private:
+  const std::vector<std::string> hosts_;
+  const std::chrono::milliseconds stagger_;
+  const std::chrono::milliseconds timeout_;
+  // The addresses hosts_ resolved to, by index, a host that didn't resolve
+  // being none.
+  std::vector<folly::Optional<folly::SocketAddress>> resolved_;
+  bool isResolved_ = false;
+  folly::Optional<size_t> winner_;
+
+  void resolve();
+};
+
+} // namespace sonar
+} // namespace facebook
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <Sonar/CertificateUtils.h>
 #include <folly/io/async/EventBase.h>
 #include <map>
 
@@ -24,6 +25,70 @@ struct DeviceData {
   std::string privateAppDirectory;
 };
 
+struct ReconnectPolicy {
+  /**
+  Delay before the first reconnect attempt after a failure or disconnect.
+  */
+  int initialDelayMs = 2000;
+
+  /**
+  Upper bound for the delay between attempts.
+  */
+  int maxDelayMs = 16000;
+
+  /**
+  Factor by which the delay grows after each consecutive failed attempt.
+  */
+  double multiplier = 2.0;
+
+  /**
+  Fraction of the delay that is randomized, so that a fleet of devices
+  doesn't retry in lockstep.
+  */
+  double jitter = 0.2;
+
+  /**
+  When set, no attempts are scheduled in the background. A new connection
+  is only attempted when the client is started again.
+  */
+  bool connectOnDemand = false;
+};
+
+/**
+Conditions of a slow link to simulate between the device and the desktop,
+see SonarConditionedWebSocket. For testing how plugins, batching,
+compression and backpressure behave over Wi-Fi debugging or a remote lab.
+*/
+struct SonarLinkConditions {
+  /**
+  Whether to simulate a link at all. When set, the desktop can also change
+  the conditions with a __linkConditions call, even if all of them are 0.
+  */
+  bool enabled = false;
+
+  /**
+  Delay added to every message, in both directions.
+  */
+  int latencyMs = 0;
+
+  /**
+  Up to this much more delay, picked at random for each message. Messages
+  still arrive in order, as they do over TCP.
+  */
+  int jitterMs = 0;
+
+  /**
+  Bytes per second messages leave the device at. 0 for no limit.
+  */
+  size_t bandwidthBytesPerSecond = 0;
+
+  /**
+  Fraction of plugin events that are lost. Responses to the desktop are
+  never dropped, so calls don't hang.
+  */
+  double dropRate = 0;
+};
+
 struct SonarInitConfig {
   /**
   Map of client specific configuration data such as app name, device name, etc.
@@ -36,9 +101,165 @@ struct SonarInitConfig {
   folly::EventBase* callbackWorker;
 
   /**
-  EventBase to be used to maintain the network connection.
+  EventBase to be used to maintain the network connection. May be the same
+  as callbackWorker, which runs everything on one thread and spares each
+  message the hop from the callback thread to the connection thread.
   */
   folly::EventBase* connectionWorker;
+
+  /**
+  Opt-in batching of outgoing messages. Messages sent within this many
+  milliseconds of each other are coalesced into a single frame. Requires a
+  desktop that understands batch frames. 0 disables batching.
+  */
+  int batchWindowMs = 0;
+
+  /**
+  A pending batch is flushed early once it holds this many bytes.
+  */
+  size_t batchMaxBytes = 64 * 1024;
+
+  /**
+  Frames of at least this many bytes are deflated if the desktop accepts
+  compressed frames. Smaller frames aren't worth the CPU. 0 disables
+  compression.
+  */
+  size_t compressionThreshold = 1024;
+
+  /**
+  Messages larger than this are sent in fragments of this size if the
+  desktop reassembles them, so that responses and events can go out between
+  the fragments of a large screenshot or layout dump instead of waiting
+  behind all of it. 0 disables fragmenting.
+  */
+  size_t fragmentBytes = 64 * 1024;
+
+  /**
+  Interval between keepalives on the desktop connection. A dead connection
+  is noticed after a few missed keepalives, so shorter intervals detect
+  drops on flaky networks sooner and longer ones wake the radio less often.
+  Values below one second are raised to one second.
+  */
+  int keepaliveIntervalMs = 10000;
+
+  /**
+  How long an attempt to connect to the desktop, TCP and TLS handshakes
+  included, may take before it is given up and retried like a failed one.
+  Doesn't apply while waiting for the desktop on listenPort. 0 waits as
+  long as the attempt takes.
+  */
+  int connectTimeoutMs = 15000;
+
+  /**
+  Hosts the desktop may also be reached on, besides deviceData.host, such
+  as localhost through `adb reverse` on an emulator. They are raced with
+  deviceData.host, which is dialled first, and the first one to accept a
+  connection is connected to from then on.
+  */
+  std::vector<std::string> fallbackHosts;
+
+  /**
+  Cap on the memory all of Sonar's buffers take together, such as events
+  buffered while disconnected and the outbound queue, in bytes. Over it,
+  the largest buffers drop their oldest contents first, see
+  SonarMemoryBudget. 0 leaves each buffer to its own limits.
+  */
+  size_t memoryBudgetBytes = 0;
+
+  /**
+  Bytes of sent frames to keep for resuming the secure connection. When
+  set, a connection that drops is resumed within resumeWindowMs without
+  disconnecting plugins, so neither side has to rebuild plugin state.
+  Requires a desktop whose rsocket server supports resumption. 0 disables
+  resumption.
+  */
+  size_t resumeBufferBytes = 0;
+
+  /**
+  How long to keep trying to resume before giving up and reconnecting.
+  */
+  int resumeWindowMs = 5000;
+
+  /**
+  Name of an abstract-namespace Unix socket to reach the desktop through
+  instead of TCP, as set up with
+  `adb reverse localabstract:<name> tcp:8087`. The socket is only
+  reachable from the device, so the connection skips TLS and the
+  certificate exchange. Empty to connect over TCP.
+  */
+  std::string localSocketName;
+
+  /**
+  When set, the device doesn't connect out but listens on this loopback
+  port for the desktop to connect in, as it can through
+  `adb forward tcp:<port> tcp:<port>`. Like localSocketName, only the
+  device itself can reach the port, so the connection skips TLS and the
+  certificate exchange. Connections can't be resumed. 0 to connect out.
+  */
+  uint16_t listenPort = 0;
+
+  /**
+  When set, a certificate exchange opens the TCP connection to the secure
+  port while the desktop signs the certificate, and the secure connection
+  only does the TLS handshake on it once the certificate arrives, saving a
+  TCP setup when onboarding. That connection can't be resumed.
+  */
+  bool preopenSecureSocket = false;
+
+  /**
+  Name of an abstract-namespace Unix socket through which the processes of
+  a multi-process app share one connection to the desktop, which then sees
+  them as a single app. The process with brokerOwner set connects to the
+  desktop and relays the plugins of the others, which connect to it rather
+  than to the desktop, see SonarBrokerWebSocket. Empty for every process to
+  connect on its own.
+  */
+  std::string brokerSocketName;
+
+  /**
+  Whether this process owns the desktop connection when brokerSocketName is
+  set. Exactly one process of the app should.
+  */
+  bool brokerOwner = false;
+
+  /**
+  When set, plugin traffic is also recorded to
+  privateAppDirectory/sonar/capture.log, rotating to capture.log.1 once the
+  file reaches this many bytes, for runs without a desktop attached. Every
+  plugin is inited for the capture. 0 disables capturing.
+  */
+  size_t captureFileBytes = 0;
+
+  /**
+  Cap on the plugin messages held while the client is suspended, in bytes,
+  past which the oldest are dropped, see SonarClient::suspend. They count
+  towards memoryBudgetBytes as well.
+  */
+  size_t suspendedBufferBytes = 4 * 1024 * 1024;
+
+  /**
+  How long Sonar's event loops may take to get to posted work before it
+  counts as a stall, which is logged along with the receiver that held the
+  loop up. Their lag shows up under "loops" in the client's metrics. 0
+  disables probing the loops.
+  */
+  int loopStallThresholdMs = 250;
+
+  /**
+  Slow link to simulate, off by default.
+  */
+  SonarLinkConditions linkConditions;
+
+  /**
+  How to retry when the desktop can't be reached or the connection drops.
+  */
+  ReconnectPolicy reconnectPolicy;
+
+  /**
+  Type of key to generate for the certificate signing request. If the
+  desktop fails to sign an ECDSA request, the client falls back to RSA.
+  */
+  CertificateKeyType certificateKeyType = CertificateKeyType::RSA2048;
 };
 
 } // namespace sonar
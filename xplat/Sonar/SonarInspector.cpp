@@ -0,0 +1,540 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarInspector.h"
+
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <algorithm>
+
+namespace facebook {
+namespace sonar {
+
+using folly::dynamic;
+
+namespace {
+
+constexpr size_t kDefaultSearchResultsLimit = 100;
+
+constexpr uint64_t kFNVOffsetBasis = 14695981039346656037ULL;
+constexpr uint64_t kFNVPrime = 1099511628211ULL;
+
+// As a string, since JavaScript numbers can't hold 64 bit integers.
+std::string contentHash(folly::StringPiece json) {
+  uint64_t hash = kFNVOffsetBasis;
+  for (const auto c : json) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= kFNVPrime;
+  }
+  return folly::to<std::string>(hash);
+}
+
+// Serializes one section of a node on its own, so that it can be hashed
+// before deciding whether to send it. The writer always starts inside an
+// object, so the section is written as that object's only value and then
+// cut back out of it.
+template <typename Write>
+folly::StringPiece writeSection(std::string& out, Write&& write) {
+  out.clear();
+  SonarMessageWriter writer(out);
+  writer.key("s");
+  write(writer);
+  writer.end();
+  // Without the leading {"s": and the closing }.
+  return folly::StringPiece(out).subpiece(5, out.size() - 6);
+}
+
+bool isKnown(
+    const dynamic* knownHashes,
+    const char* section,
+    const std::string& hash) {
+  if (!knownHashes) {
+    return false;
+  }
+  const auto known = knownHashes->get_ptr(section);
+  return known && known->isString() && known->getString() == hash;
+}
+
+size_t asSize(const dynamic* value, size_t otherwise) {
+  if (!value || !value->isNumber()) {
+    return otherwise;
+  }
+  const auto number = value->asInt();
+  return number < 0 ? 0 : static_cast<size_t>(number);
+}
+
+std::string lowerCased(std::string value) {
+  folly::toLowerAscii(value);
+  return value;
+}
+
+} // namespace
+
+SonarInspectorGetNodes::SonarInspectorGetNodes(
+    SonarInspector& inspector,
+    const dynamic& params)
+    : inspector_(inspector),
+      knownHashes_(params.getDefault("hashes")),
+      structureOnly_(params.getDefault("structureOnly", false).asBool()),
+      writer_(response_) {
+  if (const auto ids = params.get_ptr("ids")) {
+    if (ids->isArray()) {
+      for (const auto& id : *ids) {
+        if (id.isString()) {
+          ids_.push_back(id.getString());
+        }
+      }
+    }
+  }
+  if (const auto range = params.get_ptr("childrenRange")) {
+    if (range->isObject()) {
+      childrenOffset_ = asSize(range->get_ptr("offset"), 0);
+      childrenLimit_ = asSize(range->get_ptr("limit"), childrenLimit_);
+    }
+  }
+  writer_.beginArray("elements");
+}
+
+bool SonarInspectorGetNodes::run(std::chrono::nanoseconds budget) {
+  const auto deadline = std::chrono::steady_clock::now() + budget;
+  while (next_ < ids_.size()) {
+    const auto& id = ids_[next_++];
+    auto node = inspector_.lookUp(id);
+    if (!node && (node = inspector_.adapter_->find(id))) {
+      inspector_.track(node, id, "");
+    }
+    if (node) {
+      const dynamic* known = nullptr;
+      if (knownHashes_.isObject()) {
+        known = knownHashes_.get_ptr(id);
+        if (known && !known->isObject()) {
+          known = nullptr;
+        }
+      }
+      writer_.beginObject();
+      inspector_.writeNode(
+          id,
+          node,
+          writer_,
+          known,
+          structureOnly_,
+          childrenOffset_,
+          childrenLimit_);
+      writer_.endObject();
+    }
+    if (std::chrono::steady_clock::now() >= deadline) {
+      break;
+    }
+  }
+  if (next_ < ids_.size()) {
+    return false;
+  }
+  if (!writer_.isComplete()) {
+    writer_.endArray().endObject();
+  }
+  return true;
+}
+
+std::string SonarInspectorGetNodes::takeResponse() {
+  return std::move(response_);
+}
+
+SonarInspector::SonarInspector(std::unique_ptr<SonarInspectorAdapter> adapter)
+    : adapter_(std::move(adapter)) {}
+
+SonarInspector::~SonarInspector() {
+  reset();
+}
+
+std::string SonarInspector::getRoot() {
+  const auto root = adapter_->root();
+  if (!root) {
+    return "{}";
+  }
+  const auto id = track(root, "");
+  std::string response;
+  SonarMessageWriter writer(response);
+  writeNode(
+      id, root, writer, nullptr, false, 0, std::numeric_limits<size_t>::max());
+  writer.end();
+  return response;
+}
+
+std::unique_ptr<SonarInspectorGetNodes> SonarInspector::getNodes(
+    const dynamic& params) {
+  return std::unique_ptr<SonarInspectorGetNodes>(
+      new SonarInspectorGetNodes(*this, params));
+}
+
+std::string SonarInspector::getSearchResults(const dynamic& params) {
+  const auto queryParam = params.get_ptr("query");
+  const auto query =
+      queryParam && queryParam->isString() ? queryParam->getString() : "";
+  const auto lowerQuery = lowerCased(query);
+  const auto offset = asSize(params.get_ptr("offset"), 0);
+  const auto limit =
+      asSize(params.get_ptr("limit"), kDefaultSearchResultsLimit);
+
+  updateIndex();
+
+  // In tree order, like the desktop shows them.
+  std::vector<std::string> matches;
+  size_t total = 0;
+  std::vector<const std::string*> stack;
+  if (!indexRoot_.empty()) {
+    stack.push_back(&indexRoot_);
+  }
+  while (!stack.empty()) {
+    const auto& id = *stack.back();
+    stack.pop_back();
+    const auto entry = index_.find(id);
+    if (entry == index_.end()) {
+      continue;
+    }
+    if (entry->second.name.find(lowerQuery) != std::string::npos ||
+        entry->second.lowerId.find(lowerQuery) != std::string::npos) {
+      if (total >= offset && matches.size() < limit) {
+        matches.push_back(id);
+      }
+      total++;
+    }
+    const auto& children = entry->second.children;
+    for (auto child = children.rbegin(); child != children.rend(); ++child) {
+      stack.push_back(&*child);
+    }
+  }
+
+  std::unordered_set<std::string> included;
+  for (const auto& match : matches) {
+    for (auto id = match; !id.empty() && included.insert(id).second;) {
+      const auto entry = index_.find(id);
+      id = entry == index_.end() ? "" : entry->second.parent;
+    }
+  }
+  const std::unordered_set<std::string> matching(
+      matches.begin(), matches.end());
+
+  std::string response;
+  SonarMessageWriter writer(response);
+  writer.key("results");
+  if (included.count(indexRoot_)) {
+    writeSearchTree(indexRoot_, included, matching, writer);
+  } else {
+    writer.valueNull();
+  }
+  writer.put("query", query).put("offset", offset).put("total", total);
+  writer.end();
+  return response;
+}
+
+std::string SonarInspector::nodeAt(double x, double y) {
+  auto node = adapter_->root();
+  if (!node || !adapter_->bounds(node).contains(x, y)) {
+    return "";
+  }
+  auto id = track(node, "");
+  std::vector<SonarInspectorNode> children;
+  for (;;) {
+    children.clear();
+    adapter_->children(node, children);
+    // Later children are drawn over earlier ones.
+    auto hit = std::find_if(
+        children.rbegin(),
+        children.rend(),
+        [this, x, y](SonarInspectorNode child) {
+          return adapter_->bounds(child).contains(x, y);
+        });
+    if (hit == children.rend()) {
+      return id;
+    }
+    node = *hit;
+    id = track(node, id);
+  }
+}
+
+void SonarInspector::invalidate(SonarInspectorNode node) {
+  if (node) {
+    invalidated_.insert(node);
+  }
+}
+
+bool SonarInspector::flushInvalidated(SonarMessageWriter& writer) {
+  if (invalidated_.empty()) {
+    return false;
+  }
+  std::unordered_set<std::string> ids;
+  for (const auto node : invalidated_) {
+    auto id = adapter_->identifier(node);
+    staleIndex_.insert(id);
+    if (tracked_.count(id)) {
+      ids.insert(std::move(id));
+    }
+  }
+  invalidated_.clear();
+
+  bool reported = false;
+  for (const auto& id : ids) {
+    bool hasInvalidatedAncestor = false;
+    // Bounded, in case the adapter's tree has a cycle.
+    auto steps = tracked_.size();
+    for (auto it = tracked_.find(id); it != tracked_.end() && steps-- > 0;) {
+      const auto& parent = it->second.parent;
+      if (parent.empty()) {
+        break;
+      }
+      if (ids.count(parent)) {
+        hasInvalidatedAncestor = true;
+        break;
+      }
+      it = tracked_.find(parent);
+    }
+    if (hasInvalidatedAncestor) {
+      continue;
+    }
+    if (!reported) {
+      writer.beginArray("nodes");
+      reported = true;
+    }
+    writer.beginObject().put("id", id).endObject();
+  }
+  if (reported) {
+    writer.endArray();
+  }
+  return reported;
+}
+
+SonarInspectorNode SonarInspector::lookUp(const std::string& id) const {
+  const auto it = tracked_.find(id);
+  return it == tracked_.end() ? nullptr : it->second.node;
+}
+
+void SonarInspector::reset() {
+  for (const auto& tracked : tracked_) {
+    adapter_->release(tracked.second.node);
+  }
+  tracked_.clear();
+  invalidated_.clear();
+  index_.clear();
+  indexRoot_.clear();
+  staleIndex_.clear();
+}
+
+std::string SonarInspector::track(
+    SonarInspectorNode node,
+    const std::string& parent) {
+  auto id = adapter_->identifier(node);
+  track(node, id, parent);
+  return id;
+}
+
+void SonarInspector::track(
+    SonarInspectorNode node,
+    const std::string& id,
+    const std::string& parent) {
+  const auto result = tracked_.emplace(id, Tracked{node, parent});
+  if (result.second) {
+    adapter_->retain(node);
+    return;
+  }
+  auto& tracked = result.first->second;
+  if (tracked.node != node) {
+    // The id now belongs to a new node, such as a recycled cell's.
+    adapter_->retain(node);
+    adapter_->release(tracked.node);
+    tracked.node = node;
+  }
+  if (!parent.empty()) {
+    tracked.parent = parent;
+  }
+}
+
+void SonarInspector::writeNode(
+    const std::string& id,
+    SonarInspectorNode node,
+    SonarMessageWriter& writer,
+    const dynamic* knownHashes,
+    bool structureOnly,
+    size_t childrenOffset,
+    size_t childrenLimit) {
+  writer.put("id", id);
+  writer.put("name", adapter_->name(node));
+  writer.put("decoration", adapter_->decoration(node));
+
+  children_.clear();
+  adapter_->children(node, children_);
+  const auto childCount = children_.size();
+  const auto start = std::min(childrenOffset, childCount);
+  const auto end = start + std::min(childrenLimit, childCount - start);
+
+  // Sections are sent as soon as they are hashed, since they share section_.
+  std::string hashes[3];
+  auto section = writeSection(section_, [&](SonarMessageWriter& out) {
+    out.beginArray();
+    for (auto i = start; i < end; i++) {
+      out.add(track(children_[i], id));
+    }
+    out.endArray();
+  });
+  hashes[0] = contentHash(section);
+  if (!isKnown(knownHashes, "children", hashes[0])) {
+    writer.putRaw("children", section);
+  }
+  writer.put("childCount", childCount);
+
+  section = writeSection(section_, [&](SonarMessageWriter& out) {
+    out.beginArray();
+    SonarInspectorAttributes attributes(out);
+    adapter_->attributes(node, attributes);
+    out.endArray();
+  });
+  hashes[1] = contentHash(section);
+  if (!isKnown(knownHashes, "attributes", hashes[1])) {
+    writer.putRaw("attributes", section);
+  }
+
+  if (!structureOnly) {
+    section = writeSection(section_, [&](SonarMessageWriter& out) {
+      out.beginObject();
+      adapter_->data(node, out);
+      out.endObject();
+    });
+    hashes[2] = contentHash(section);
+    if (!isKnown(knownHashes, "data", hashes[2])) {
+      writer.putRaw("data", section);
+    }
+  }
+
+  writer.beginObject("hashes");
+  writer.put("children", hashes[0]).put("attributes", hashes[1]);
+  if (!structureOnly) {
+    writer.put("data", hashes[2]);
+  }
+  writer.endObject();
+
+  adapter_->extra(node, writer);
+}
+
+void SonarInspector::updateIndex() {
+  for (const auto node : invalidated_) {
+    staleIndex_.insert(adapter_->identifier(node));
+  }
+
+  const auto root = adapter_->root();
+  const auto rootId = root ? adapter_->identifier(root) : "";
+  if (rootId != indexRoot_) {
+    index_.clear();
+    staleIndex_.clear();
+    indexRoot_ = rootId;
+    if (root) {
+      indexNode(root, "");
+    }
+    return;
+  }
+
+  for (const auto& id : staleIndex_) {
+    // Nodes which aren't indexed are either new, in which case their parent
+    // was invalidated too, or have gone along with an invalidated ancestor.
+    const auto entry = index_.find(id);
+    const auto node = lookUp(id);
+    if (entry == index_.end() || !node) {
+      continue;
+    }
+    const auto parent = entry->second.parent;
+    unindex(id);
+    indexNode(node, parent);
+  }
+  staleIndex_.clear();
+}
+
+void SonarInspector::indexNode(
+    SonarInspectorNode node,
+    const std::string& parent) {
+  struct Pending {
+    SonarInspectorNode node;
+    std::string id;
+    std::string parent;
+  };
+  std::vector<Pending> stack;
+  stack.push_back(Pending{node, adapter_->identifier(node), parent});
+  std::vector<SonarInspectorNode> children;
+  while (!stack.empty()) {
+    auto pending = std::move(stack.back());
+    stack.pop_back();
+    // Nodes are tracked as they are indexed, so that matches can be sent
+    // without walking the hierarchy again.
+    track(pending.node, pending.id, pending.parent);
+    auto& entry = index_[pending.id];
+    entry.name = lowerCased(adapter_->name(pending.node));
+    entry.lowerId = lowerCased(pending.id);
+    entry.parent = pending.parent;
+    entry.children.clear();
+
+    children.clear();
+    adapter_->children(pending.node, children);
+    for (const auto child : children) {
+      auto childId = adapter_->identifier(child);
+      entry.children.push_back(childId);
+      stack.push_back(Pending{child, std::move(childId), pending.id});
+    }
+  }
+}
+
+void SonarInspector::unindex(const std::string& id) {
+  std::vector<std::string> stack{id};
+  while (!stack.empty()) {
+    const auto entry = index_.find(stack.back());
+    stack.pop_back();
+    if (entry == index_.end()) {
+      continue;
+    }
+    stack.insert(
+        stack.end(),
+        entry->second.children.begin(),
+        entry->second.children.end());
+    index_.erase(entry);
+  }
+}
+
+void SonarInspector::writeSearchTree(
+    const std::string& id,
+    const std::unordered_set<std::string>& included,
+    const std::unordered_set<std::string>& matches,
+    SonarMessageWriter& writer) {
+  const auto node = lookUp(id);
+  const auto entry = index_.find(id);
+  if (!node || entry == index_.end()) {
+    writer.valueNull();
+    return;
+  }
+  writer.beginObject().put("id", id).put("isMatch", matches.count(id) > 0);
+  writer.beginObject("element");
+  writeNode(
+      id, node, writer, nullptr, true, 0, std::numeric_limits<size_t>::max());
+  writer.endObject();
+
+  bool hasChildren = false;
+  for (const auto& child : entry->second.children) {
+    if (!included.count(child)) {
+      continue;
+    }
+    if (!hasChildren) {
+      writer.beginArray("children");
+      hasChildren = true;
+    }
+    writeSearchTree(child, included, matches, writer);
+  }
+  if (hasChildren) {
+    writer.endArray();
+  } else {
+    writer.putNull("children");
+  }
+  writer.endObject();
+}
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,313 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarMessageWriter.h>
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ A node of the platform's hierarchy, such as a UIView or a global reference
+ to an android.view.View. The inspector never looks inside one, it only
+ compares them and hands them back to its adapter.
+ */
+using SonarInspectorNode = const void*;
+
+/**
+ Where a node is on screen, in screen coordinates.
+ */
+struct SonarInspectorBounds {
+  double x = 0;
+  double y = 0;
+  double width = 0;
+  double height = 0;
+
+  bool contains(double px, double py) const {
+    return px >= x && py >= y && px < x + width && py < y + height;
+  }
+};
+
+/**
+ Writes the attributes of a node, which are sent as an array of objects with
+ a name and a value.
+ */
+class SonarInspectorAttributes {
+ public:
+  explicit SonarInspectorAttributes(SonarMessageWriter& writer)
+      : writer_(writer) {}
+
+  template <typename T>
+  SonarInspectorAttributes& add(folly::StringPiece name, T&& value) {
+    writer_.beginObject().put("name", name);
+    writer_.put("value", std::forward<T>(value)).endObject();
+    return *this;
+  }
+
+ private:
+  SonarMessageWriter& writer_;
+};
+
+/**
+ How SonarInspector reaches the platform's hierarchy. Only called from the
+ thread the inspector is used on, which is the platform's UI thread.
+ */
+class SonarInspectorAdapter {
+ public:
+  virtual ~SonarInspectorAdapter() {}
+
+  virtual SonarInspectorNode root() = 0;
+
+  /**
+   Tells the node apart from every other node for as long as it lives.
+   */
+  virtual std::string identifier(SonarInspectorNode node) = 0;
+
+  virtual std::string name(SonarInspectorNode node) = 0;
+
+  /**
+   The icon the desktop shows the node with.
+   */
+  virtual std::string decoration(SonarInspectorNode node) {
+    return "";
+  }
+
+  /**
+   Appends the node's children, in order, to children.
+   */
+  virtual void children(
+      SonarInspectorNode node,
+      std::vector<SonarInspectorNode>& children) = 0;
+
+  virtual void attributes(
+      SonarInspectorNode node,
+      SonarInspectorAttributes& attributes) = 0;
+
+  /**
+   Writes the sections of the node's sidebar as keys of the open object.
+   This is the expensive part of a node, only written when the desktop
+   doesn't ask for just the structure.
+   */
+  virtual void data(SonarInspectorNode node, SonarMessageWriter& writer) = 0;
+
+  /**
+   Writes keys of the node which aren't part of any section, and so aren't
+   hashed or left out, as keys of the open object.
+   */
+  virtual void extra(SonarInspectorNode node, SonarMessageWriter& writer) {}
+
+  virtual SonarInspectorBounds bounds(SonarInspectorNode node) = 0;
+
+  /**
+   The node with the id, for ids the platform handed out itself rather than
+   through the inspector, or nullptr.
+   */
+  virtual SonarInspectorNode find(const std::string& id) {
+    return nullptr;
+  }
+
+  /**
+   Called when the inspector starts and stops referring to a node by its
+   identifier, for platforms where the node has to be kept alive meanwhile.
+   */
+  virtual void retain(SonarInspectorNode node) {}
+
+  virtual void release(SonarInspectorNode node) {}
+};
+
+class SonarInspector;
+
+/**
+ One getNodes call, captured a slice at a time so that a large hierarchy
+ doesn't keep the UI thread from rendering frames. See SonarInspector.
+ */
+class SonarInspectorGetNodes {
+ public:
+  SonarInspectorGetNodes(const SonarInspectorGetNodes&) = delete;
+  SonarInspectorGetNodes& operator=(const SonarInspectorGetNodes&) = delete;
+
+  /**
+   Captures nodes until budget is spent, at least one, and returns whether
+   every node was captured. Call it again on a later turn of the UI thread
+   until it does.
+   */
+  bool run(std::chrono::nanoseconds budget);
+
+  /**
+   The response to the call, once run returned true.
+   */
+  std::string takeResponse();
+
+ private:
+  friend class SonarInspector;
+
+  SonarInspectorGetNodes(
+      SonarInspector& inspector,
+      const folly::dynamic& params);
+
+  SonarInspector& inspector_;
+  std::vector<std::string> ids_;
+  size_t next_ = 0;
+  folly::dynamic knownHashes_;
+  bool structureOnly_;
+  size_t childrenOffset_ = 0;
+  size_t childrenLimit_ = std::numeric_limits<size_t>::max();
+  std::string response_;
+  SonarMessageWriter writer_;
+};
+
+/**
+ The platform independent part of the Inspector plugin: tracking the nodes
+ the desktop knows by id, capturing and serializing them, leaving out the
+ sections the desktop already has, searching the hierarchy and coalescing
+ invalidations. The platform's plugin registers the receivers, reaches its
+ views through a SonarInspectorAdapter and calls into this on its UI
+ thread, which everything here must be used from.
+
+ Nodes are written straight into the response with SonarMessageWriter, the
+ same way for every platform:
+
+   {"id", "name", "decoration", "children": [ids], "childCount",
+    "attributes": [{"name", "value"}], "data": {...},
+    "hashes": {"attributes", "data", "children"}, ...}
+
+ where hashes are of the serialized sections. A getNodes call sends the
+ hashes of the copy the desktop has for each id, and sections with the same
+ hash are left out.
+ */
+class SonarInspector {
+ public:
+  explicit SonarInspector(std::unique_ptr<SonarInspectorAdapter> adapter);
+
+  ~SonarInspector();
+
+  SonarInspector(const SonarInspector&) = delete;
+  SonarInspector& operator=(const SonarInspector&) = delete;
+
+  /**
+   The response to getRoot.
+   */
+  std::string getRoot();
+
+  /**
+   Starts a getNodes call, for params of the form {ids, hashes,
+   structureOnly, childrenRange: {offset, limit}}. Only the children within
+   childrenRange are tracked and listed, along with how many there are.
+   */
+  std::unique_ptr<SonarInspectorGetNodes> getNodes(
+      const folly::dynamic& params);
+
+  /**
+   The response to getSearchResults, for params of the form {query, offset,
+   limit}: the matches and their ancestors as a tree, and the total number
+   of matches. Names and ids are matched ignoring ASCII case.
+   */
+  std::string getSearchResults(const folly::dynamic& params);
+
+  /**
+   The id of the deepest node whose bounds contain the point, or an empty
+   string if even the root's don't. For selecting a node by touching it.
+   */
+  std::string nodeAt(double x, double y);
+
+  /**
+   Notes that a node changed. Invalidated nodes are reported together by
+   flushInvalidated, once per frame or less.
+   */
+  void invalidate(SonarInspectorNode node);
+
+  /**
+   Writes the params of an invalidate message, {nodes: [{id}]}, for the
+   tracked nodes invalidated since the last call, leaving out those under
+   another of them since the desktop refetches whole subtrees. Returns
+   false, having written nothing, when there is nothing to report.
+   */
+  bool flushInvalidated(SonarMessageWriter& writer);
+
+  /**
+   The tracked node with the id, or nullptr. getNodes also asks the adapter
+   to find ids that aren't tracked.
+   */
+  SonarInspectorNode lookUp(const std::string& id) const;
+
+  size_t trackedCount() const {
+    return tracked_.size();
+  }
+
+  /**
+   Forgets every node, for when the desktop disconnects.
+   */
+  void reset();
+
+ private:
+  friend class SonarInspectorGetNodes;
+
+  struct Tracked {
+    SonarInspectorNode node;
+    // Empty for the root, and for nodes whose parent isn't known.
+    std::string parent;
+  };
+
+  struct IndexEntry {
+    // Lower cased, so matching doesn't fold case on every search.
+    std::string name;
+    std::string lowerId;
+    std::string parent;
+    std::vector<std::string> children;
+  };
+
+  std::string track(SonarInspectorNode node, const std::string& parent);
+  void track(
+      SonarInspectorNode node,
+      const std::string& id,
+      const std::string& parent);
+  void writeNode(
+      const std::string& id,
+      SonarInspectorNode node,
+      SonarMessageWriter& writer,
+      const folly::dynamic* knownHashes,
+      bool structureOnly,
+      size_t childrenOffset,
+      size_t childrenLimit);
+  void updateIndex();
+  void indexNode(SonarInspectorNode node, const std::string& parent);
+  void unindex(const std::string& id);
+  void writeSearchTree(
+      const std::string& id,
+      const std::unordered_set<std::string>& included,
+      const std::unordered_set<std::string>& matches,
+      SonarMessageWriter& writer);
+
+  std::unique_ptr<SonarInspectorAdapter> adapter_;
+  std::unordered_map<std::string, Tracked> tracked_;
+  std::unordered_set<SonarInspectorNode> invalidated_;
+
+  std::unordered_map<std::string, IndexEntry> index_;
+  std::string indexRoot_;
+  std::unordered_set<std::string> staleIndex_;
+
+  // Reused, so that sections of nodes are serialized without allocating.
+  std::string section_;
+  std::vector<SonarInspectorNode> children_;
+};
+
+} // namespace sonar
+} // namespace facebook
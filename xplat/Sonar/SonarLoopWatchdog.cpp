@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarLoopWatchdog.h"
+#include "Log.h"
+
+#include <folly/Conv.h>
+
+namespace facebook {
+namespace sonar {
+
+SonarLoopWatchdog::SonarLoopWatchdog(
+    std::shared_ptr<SonarMetrics> metrics,
+    std::chrono::milliseconds interval,
+    std::chrono::milliseconds stallThreshold)
+    : metrics_(std::move(metrics)),
+      interval_(interval),
+      stallThreshold_(stallThreshold) {}
+
+SonarLoopWatchdog::~SonarLoopWatchdog() {
+  stop();
+}
+
+void SonarLoopWatchdog::watch(
+    const std::string& name,
+    folly::EventBase* eventBase) {
+  for (const auto& loop : loops_) {
+    // The connection worker may well be the callback worker.
+    if (loop.eventBase == eventBase) {
+      return;
+    }
+  }
+  loops_.push_back(Loop{name, eventBase, metrics_->forLoop(name), nullptr});
+}
+
+void SonarLoopWatchdog::start() {
+  if (checker_.joinable()) {
+    return;
+  }
+  stopChecker_ = false;
+  checker_ = std::thread([this] {
+    std::unique_lock<std::mutex> lock(checkerMutex_);
+    while (!checkerWakeup_.wait_for(
+        lock, interval_, [this] { return stopChecker_; })) {
+      lock.unlock();
+      check();
+      lock.lock();
+    }
+  });
+}
+
+void SonarLoopWatchdog::stop() {
+  if (!checker_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(checkerMutex_);
+    stopChecker_ = true;
+  }
+  checkerWakeup_.notify_all();
+  checker_.join();
+}
+
+void SonarLoopWatchdog::check() {
+  const auto now = std::chrono::steady_clock::now();
+  for (auto& loop : loops_) {
+    const auto& probe = loop.probe;
+    if (probe && !probe->ran.load(std::memory_order_acquire)) {
+      // Still waiting. Only one probe is outstanding at a time, so a stuck
+      // loop doesn't pile them up.
+      if (!probe->reported && now - probe->posted >= stallThreshold_) {
+        probe->reported = true;
+        const auto lag = microsSince(probe->posted);
+        std::string plugin;
+        std::string method;
+        metrics_->runningReceiver(probe->posted, plugin, method);
+        SONAR_LOG(
+            LogLevel::Warning,
+            folly::to<std::string>(
+                "Sonar ",
+                loop.name,
+                " loop stalled for ",
+                lag / 1000,
+                "ms",
+                plugin.empty() ? "" : " in receiver ",
+                plugin,
+                plugin.empty() ? "" : "::",
+                method));
+        loop.lag->recordStall(lag, std::move(plugin), std::move(method));
+      }
+      continue;
+    }
+    auto next = std::make_shared<Probe>();
+    next->posted = now;
+    loop.probe = next;
+    loop.eventBase->runInEventBaseThread([next, lag = loop.lag]() {
+      lag->recordLag(microsSince(next->posted));
+      next->ran.store(true, std::memory_order_release);
+    });
+  }
+}
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarMetrics.h>
+#include <folly/io/async/EventBase.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Probes Sonar's event loops from a thread of its own. Every interval it
+ posts a probe to each loop that has answered the last one, and the probe
+ records how long it waited to run in the loop's SonarLoopLagMetrics. A
+ probe still waiting past stallThreshold is reported once, with the plugin
+ method whose receiver was running all that time, if there was one, so a
+ slow receiver can be told apart from a loop that is just busy.
+ */
+class SonarLoopWatchdog {
+ public:
+  SonarLoopWatchdog(
+      std::shared_ptr<SonarMetrics> metrics,
+      std::chrono::milliseconds interval = std::chrono::milliseconds(100),
+      std::chrono::milliseconds stallThreshold =
+          std::chrono::milliseconds(250));
+
+  ~SonarLoopWatchdog();
+
+  /**
+   Starts probing eventBase, as name in the metrics. Loops are only added
+   before start().
+   */
+  void watch(const std::string& name, folly::EventBase* eventBase);
+
+  void start();
+
+  void stop();
+
+  /**
+   Probes every loop once. Called on the watchdog's own thread every
+   interval, and public for testing.
+   */
+  void check();
+
+ private:
+  struct Probe {
+    std::chrono::steady_clock::time_point posted;
+    std::atomic<bool> ran{false};
+    bool reported = false;
+  };
+
+  struct Loop {
+    std::string name;
+    folly::EventBase* eventBase;
+    std::shared_ptr<SonarLoopLagMetrics> lag;
+    std::shared_ptr<Probe> probe;
+  };
+
+  const std::shared_ptr<SonarMetrics> metrics_;
+  const std::chrono::milliseconds interval_;
+  const std::chrono::milliseconds stallThreshold_;
+  // Only touched by check(), on one thread at a time.
+  std::vector<Loop> loops_;
+
+  std::thread checker_;
+  std::mutex checkerMutex_;
+  std::condition_variable checkerWakeup_;
+  bool stopChecker_ = false;
+};
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,141 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarMemoryBudget.h"
+
+#include <algorithm>
+
+namespace facebook {
+namespace sonar {
+
+SonarMemoryBudget::Account::Account(
+    SonarMemoryBudget* budget,
+    std::string name,
+    Evict evict)
+    : budget_(budget), name_(std::move(name)), evict_(std::move(evict)) {}
+
+SonarMemoryBudget::Account::~Account() {
+  budget_->usedBytes_ -= bytes_;
+  std::lock_guard<std::mutex> lock(budget_->mutex_);
+  auto& accounts = budget_->accounts_;
+  accounts.erase(
+      std::remove_if(
+          accounts.begin(),
+          accounts.end(),
+          [](const std::weak_ptr<Account>& account) {
+            return account.expired();
+          }),
+      accounts.end());
+}
+
+void SonarMemoryBudget::Account::setBytes(size_t bytes) {
+  const size_t previous = bytes_.exchange(bytes);
+  if (bytes <= previous) {
+    budget_->usedBytes_ -= previous - bytes;
+    return;
+  }
+  const size_t used = budget_->usedBytes_ += bytes - previous;
+  const size_t cap = budget_->capBytes_;
+  if (cap > 0 && used > cap) {
+    budget_->enforce();
+  }
+}
+
+SonarMemoryBudget& SonarMemoryBudget::shared() {
+  static auto budget = new SonarMemoryBudget();
+  return *budget;
+}
+
+SonarMemoryBudget::SonarMemoryBudget(size_t capBytes) : capBytes_(capBytes) {}
+
+SonarMemoryBudget::~SonarMemoryBudget() = default;
+
+void SonarMemoryBudget::setCapBytes(size_t capBytes) {
+  capBytes_ = capBytes;
+  if (capBytes > 0 && usedBytes_ > capBytes) {
+    enforce();
+  }
+}
+
+std::shared_ptr<SonarMemoryBudget::Account> SonarMemoryBudget::open(
+    std::string name,
+    Evict evict) {
+  std::shared_ptr<Account> account(
+      new Account(this, std::move(name), std::move(evict)));
+  std::lock_guard<std::mutex> lock(mutex_);
+  accounts_.push_back(account);
+  return account;
+}
+
+std::vector<SonarMemoryBudget::Usage> SonarMemoryBudget::usage() const {
+  std::vector<Usage> usage;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& weakAccount : accounts_) {
+      if (auto account = weakAccount.lock()) {
+        usage.push_back({account->name(), account->bytes()});
+      }
+    }
+  }
+  std::sort(usage.begin(), usage.end(), [](const Usage& a, const Usage& b) {
+    return a.bytes > b.bytes;
+  });
+  return usage;
+}
+
+std::vector<std::shared_ptr<SonarMemoryBudget::Account>>
+SonarMemoryBudget::evictableAccounts() const {
+  std::vector<std::shared_ptr<Account>> evictable;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& weakAccount : accounts_) {
+    auto account = weakAccount.lock();
+    if (account && account->evict_ && account->bytes() > 0) {
+      evictable.push_back(std::move(account));
+    }
+  }
+  return evictable;
+}
+
+void SonarMemoryBudget::onMemoryPressure(SonarMemoryPressure pressure) {
+  // Asked even while enforcing the cap, pressure calls for more.
+  for (const auto& account : evictableAccounts()) {
+    const size_t bytes = account->bytes();
+    account->evict_(
+        pressure == SonarMemoryPressure::Critical ? bytes : bytes - bytes / 2);
+  }
+}
+
+void SonarMemoryBudget::enforce() {
+  if (enforcing_.exchange(true)) {
+    return;
+  }
+  auto evictable = evictableAccounts();
+  std::sort(
+      evictable.begin(),
+      evictable.end(),
+      [](const std::shared_ptr<Account>& a, const std::shared_ptr<Account>& b) {
+        return a->bytes() > b->bytes();
+      });
+  // Down to nine tenths of the cap, so that the next few reports don't go
+  // over it again straight away.
+  const size_t target = capBytes_ - capBytes_ / 10;
+  const size_t used = usedBytes_;
+  size_t excess = used > target ? used - target : 0;
+  for (const auto& account : evictable) {
+    if (excess == 0) {
+      break;
+    }
+    const size_t bytes = std::min(excess, account->bytes());
+    account->evict_(bytes);
+    excess -= bytes;
+  }
+  enforcing_ = false;
+}
+
+} // namespace sonar
+} // namespace facebook
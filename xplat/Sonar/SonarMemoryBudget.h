@@ -0,0 +1,144 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ How hard the system is pressed for memory, from Android's onTrimMemory
+ levels and iOS's memory warnings.
+ */
+enum class SonarMemoryPressure {
+  // Buffers drop half of what they hold.
+  Moderate,
+  // Buffers drop everything they hold, the app is about to be killed
+  // otherwise.
+  Critical,
+};
+
+/**
+ Bounds the memory Sonar's buffers take altogether, such as the events
+ plugins buffer while disconnected, the outbound queue and response body
+ caches. Each buffer opens an account and keeps it up to date with what it
+ holds. Once the total goes over the cap, the buffers that can evict are
+ asked to, the largest ones first, until the total would be back under
+ nine tenths of the cap.
+
+ Reporting is a couple of atomic updates, so buffers can report on every
+ change. The cap is SonarInitConfig::memoryBudgetBytes for the shared
+ budget, 0 leaving the total unbounded.
+ */
+class SonarMemoryBudget {
+ public:
+  /**
+   Asked to free about bytes of what the buffer holds, oldest first. Called
+   without locks held on whichever thread pushed the total over the cap, so
+   buffers that aren't thread safe should hop to their own thread, and
+   report what they hold from there.
+   */
+  using Evict = std::function<void(size_t bytes)>;
+
+  class Account {
+   public:
+    ~Account();
+
+    Account(const Account&) = delete;
+    Account& operator=(const Account&) = delete;
+
+    /**
+     What the buffer holds now, in bytes.
+     */
+    void setBytes(size_t bytes);
+
+    size_t bytes() const {
+      return bytes_;
+    }
+
+    const std::string& name() const {
+      return name_;
+    }
+
+   private:
+    friend class SonarMemoryBudget;
+    Account(SonarMemoryBudget* budget, std::string name, Evict evict);
+
+    SonarMemoryBudget* const budget_;
+    const std::string name_;
+    const Evict evict_;
+    std::atomic<size_t> bytes_{0};
+  };
+
+  struct Usage {
+    std::string name;
+    size_t bytes;
+  };
+
+  /**
+   The budget Sonar's own buffers and plugins report to.
+   */
+  static SonarMemoryBudget& shared();
+
+  explicit SonarMemoryBudget(size_t capBytes = 0);
+
+  /**
+   Must outlive its accounts.
+   */
+  ~SonarMemoryBudget();
+
+  void setCapBytes(size_t capBytes);
+
+  size_t capBytes() const {
+    return capBytes_;
+  }
+
+  size_t usedBytes() const {
+    return usedBytes_;
+  }
+
+  /**
+   Opens an account for a buffer, closed once it is destroyed. A buffer
+   without evict, such as one whose contents can't be dropped, still counts
+   towards the total.
+   */
+  std::shared_ptr<Account> open(std::string name, Evict evict = nullptr);
+
+  /**
+   What each open account holds, largest first.
+   */
+  std::vector<Usage> usage() const;
+
+  /**
+   Asks every buffer that can evict to shed what pressure calls for,
+   whatever the cap. Buffers that hold nothing aren't asked.
+   */
+  void onMemoryPressure(SonarMemoryPressure pressure);
+
+ private:
+  void enforce();
+  std::vector<std::shared_ptr<Account>> evictableAccounts() const;
+
+  std::atomic<size_t> capBytes_;
+  std::atomic<size_t> usedBytes_{0};
+  // Set while buffers are asked to evict, so that what they report
+  // meanwhile doesn't ask them again.
+  std::atomic<bool> enforcing_{false};
+  mutable std::mutex mutex_;
+  std::vector<std::weak_ptr<Account>> accounts_;
+};
+
+} // namespace sonar
+} // namespace facebook
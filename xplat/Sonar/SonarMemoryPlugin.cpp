@@ -0,0 +1,319 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarMemoryPlugin.h"
+
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <malloc/malloc.h>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
+#endif
+
+namespace facebook {
+namespace sonar {
+
+constexpr const char* SonarMemoryPlugin::kIdentifier;
+
+namespace {
+
+constexpr int64_t kMinSampleIntervalMs = 50;
+constexpr int64_t kMaxSampleIntervalMs = 60000;
+constexpr size_t kMaxBatchSize = 600;
+
+#if defined(__linux__)
+
+/**
+ A /proc file that is read again and again, through a descriptor kept open
+ and into the same buffer, so that a sample doesn't open a file or
+ allocate.
+ */
+template <size_t kBufferSize>
+class ProcFile {
+ public:
+  explicit ProcFile(const char* path) : fd_(open(path, O_RDONLY | O_CLOEXEC)) {}
+
+  ~ProcFile() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  ProcFile(const ProcFile&) = delete;
+  ProcFile& operator=(const ProcFile&) = delete;
+
+  /**
+   The file's contents, or null if it can't be read. Valid until the next
+   read.
+   */
+  const char* read() {
+    if (fd_ < 0) {
+      return nullptr;
+    }
+    const ssize_t size = pread(fd_, buffer_, kBufferSize - 1, 0);
+    if (size <= 0) {
+      return nullptr;
+    }
+    buffer_[size] = '\0';
+    return buffer_;
+  }
+
+ private:
+  const int fd_;
+  char buffer_[kBufferSize];
+};
+
+int64_t readRssKb() {
+  static auto statm = new ProcFile<128>("/proc/self/statm");
+  static const int64_t pageKb = sysconf(_SC_PAGESIZE) / 1024;
+  const char* contents = statm->read();
+  if (!contents) {
+    return -1;
+  }
+  // Total program size, then the resident set, in pages.
+  char* end = nullptr;
+  strtoll(contents, &end, 10);
+  return strtoll(end, nullptr, 10) * pageKb;
+}
+
+// Walks all mappings, which takes long enough to only be done once a
+// second. Needs Linux 4.14, which older Android devices don't have.
+int64_t readPssKb() {
+  static auto rollup = new ProcFile<2048>("/proc/self/smaps_rollup");
+  static auto lastRead = std::chrono::steady_clock::time_point();
+  static int64_t lastPss = -1;
+  const auto now = std::chrono::steady_clock::now();
+  if (now - lastRead < std::chrono::seconds(1)) {
+    return lastPss;
+  }
+  lastRead = now;
+  const char* contents = rollup->read();
+  const char* pss = contents ? strstr(contents, "\nPss:") : nullptr;
+  lastPss = pss ? strtoll(pss + strlen("\nPss:"), nullptr, 10) : -1;
+  return lastPss;
+}
+
+int64_t readNativeHeapKb() {
+  return static_cast<int64_t>(mallinfo().uordblks) / 1024;
+}
+
+std::vector<SonarMemorySource> platformSources() {
+  return {
+      {"rss", readRssKb},
+      {"pss", readPssKb},
+      {"nativeHeap", readNativeHeapKb},
+  };
+}
+
+#elif defined(__APPLE__)
+
+int64_t readResidentKb() {
+  mach_task_basic_info_data_t info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(
+          mach_task_self(),
+          MACH_TASK_BASIC_INFO,
+          reinterpret_cast<task_info_t>(&info),
+          &count) != KERN_SUCCESS) {
+    return -1;
+  }
+  return info.resident_size / 1024;
+}
+
+// What iOS counts against the app's memory limit, the closest it has to
+// PSS.
+int64_t readFootprintKb() {
+  task_vm_info_data_t info;
+  mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+  if (task_info(
+          mach_task_self(),
+          TASK_VM_INFO,
+          reinterpret_cast<task_info_t>(&info),
+          &count) != KERN_SUCCESS) {
+    return -1;
+  }
+  return info.phys_footprint / 1024;
+}
+
+int64_t readNativeHeapKb() {
+  malloc_statistics_t stats;
+  malloc_zone_statistics(nullptr, &stats);
+  return stats.size_in_use / 1024;
+}
+
+std::vector<SonarMemorySource> platformSources() {
+  return {
+      {"rss", readResidentKb},
+      {"footprint", readFootprintKb},
+      {"nativeHeap", readNativeHeapKb},
+  };
+}
+
+#else
+
+std::vector<SonarMemorySource> platformSources() {
+  return {};
+}
+
+#endif
+
+std::vector<SonarMemorySource> withPlatformSources(
+    std::vector<SonarMemorySource> extraSources) {
+  auto sources = platformSources();
+  for (auto& source : extraSources) {
+    sources.push_back(std::move(source));
+  }
+  return sources;
+}
+
+} // namespace
+
+SonarMemoryPlugin::SonarMemoryPlugin(
+    std::vector<SonarMemorySource> extraSources)
+    : sources_(withPlatformSources(std::move(extraSources))) {}
+
+SonarMemoryPlugin::~SonarMemoryPlugin() = default;
+
+std::string SonarMemoryPlugin::identifier() const {
+  return kIdentifier;
+}
+
+std::vector<std::string> SonarMemoryPlugin::fields() const {
+  std::vector<std::string> fields;
+  for (const auto& source : sources_) {
+    fields.push_back(source.name);
+  }
+  return fields;
+}
+
+void SonarMemoryPlugin::didConnect(std::shared_ptr<SonarConnection> conn) {
+  conn->receive(
+      "configure",
+      [this](const folly::dynamic& params, std::unique_ptr<SonarResponder> responder) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (params.count("sampleIntervalMs")) {
+          sampleInterval_ = std::chrono::milliseconds(std::min(
+              std::max(params["sampleIntervalMs"].asInt(), kMinSampleIntervalMs),
+              kMaxSampleIntervalMs));
+        }
+        if (params.count("batchSize")) {
+          batchSize_ = std::min<size_t>(
+              std::max<int64_t>(params["batchSize"].asInt(), 1), kMaxBatchSize);
+        }
+        responder->success(folly::dynamic::object(
+            "sampleIntervalMs", static_cast<int64_t>(sampleInterval_.count()))(
+            "batchSize", static_cast<int64_t>(batchSize_)));
+      });
+
+  uint64_t generation;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    connection_ = std::move(conn);
+    eventBase_ = folly::EventBaseManager::get()->getExistingEventBase();
+    generation = ++generation_;
+    sentFields_ = false;
+    last_.assign(sources_.size(), 0);
+    lastTime_ = std::chrono::steady_clock::now();
+    pending_.clear();
+    pendingSamples_ = 0;
+  }
+  scheduleSample(generation);
+}
+
+void SonarMemoryPlugin::didDisconnect() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  generation_++;
+  connection_ = nullptr;
+  eventBase_ = nullptr;
+}
+
+void SonarMemoryPlugin::scheduleSample(uint64_t generation) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!eventBase_ || generation != generation_) {
+    return;
+  }
+  // The plugin may be removed while a sample is scheduled.
+  std::weak_ptr<SonarMemoryPlugin> weakThis = shared_from_this();
+  eventBase_->runAfterDelay(
+      [weakThis, generation] {
+        if (auto self = weakThis.lock()) {
+          self->runScheduledSample(generation);
+        }
+      },
+      sampleInterval_.count());
+}
+
+void SonarMemoryPlugin::runScheduledSample(uint64_t generation) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_) {
+      return;
+    }
+  }
+  sample();
+  scheduleSample(generation);
+}
+
+void SonarMemoryPlugin::sample() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!connection_) {
+    return;
+  }
+  const auto now = std::chrono::steady_clock::now();
+  pending_.push_back(
+      std::chrono::duration_cast<std::chrono::milliseconds>(now - lastTime_)
+          .count());
+  lastTime_ = now;
+  for (size_t i = 0; i < sources_.size(); i++) {
+    const int64_t value = sources_[i].read();
+    const int64_t current = value < 0 ? last_[i] : value;
+    pending_.push_back(current - last_[i]);
+    last_[i] = current;
+  }
+  if (++pendingSamples_ >= batchSize_) {
+    lock.unlock();
+    sendBatch();
+  }
+}
+
+void SonarMemoryPlugin::sendBatch() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!connection_ || pending_.empty()) {
+    return;
+  }
+  if (connection_->isActive()) {
+    connection_->sendWith("memory", [this](SonarMessageWriter& writer) {
+      if (!sentFields_) {
+        writer.beginArray("fields");
+        for (const auto& source : sources_) {
+          writer.add(source.name);
+        }
+        writer.endArray();
+      }
+      writer.beginArray("samples");
+      for (auto value : pending_) {
+        writer.add(value);
+      }
+      writer.endArray();
+    });
+    sentFields_ = true;
+  }
+  pending_.clear();
+  pendingSamples_ = 0;
+}
+
+} // namespace sonar
+} // namespace facebook
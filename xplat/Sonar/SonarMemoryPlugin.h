@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarPlugin.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace folly {
+class EventBase;
+}
+
+namespace facebook {
+namespace sonar {
+
+/**
+ A value the memory plugin samples, in kilobytes. read returns a negative
+ value when it isn't available, and is called on the Sonar event base.
+ */
+struct SonarMemorySource {
+  std::string name;
+  std::function<int64_t()> read;
+};
+
+/**
+ Samples the process's memory use, such as its resident set and native
+ heap, from sources that are cheap to read (/proc/self/statm, mallinfo and
+ task_info), and sends them to the desktop's Memory plugin in batches. The
+ desktop picks the sampling interval and the batch size with "configure".
+
+ Each value in a "memory" batch is the difference to the previous sample,
+ the first sample of a connection being the difference to 0:
+
+   {"fields": ["rss", ...], "samples": [dtMs, drss, ..., dtMs, drss, ...]}
+
+ where fields only come with the first batch of a connection. Sampling runs
+ on the event base didConnect is called on, while connected.
+ */
+class SonarMemoryPlugin
+    : public SonarPlugin,
+      public std::enable_shared_from_this<SonarMemoryPlugin> {
+ public:
+  static constexpr const char* kIdentifier = "Memory";
+
+  /**
+   extraSources are sampled after the built in ones, such as the Java heap
+   on Android.
+   */
+  explicit SonarMemoryPlugin(std::vector<SonarMemorySource> extraSources = {});
+
+  ~SonarMemoryPlugin();
+
+  std::string identifier() const override;
+  void didConnect(std::shared_ptr<SonarConnection> conn) override;
+  void didDisconnect() override;
+
+  /**
+   Takes a sample, and sends the batch once it has batchSize of them.
+   */
+  void sample();
+
+  /**
+   Sends the samples taken since the last batch, if any.
+   */
+  void sendBatch();
+
+  /**
+   The sources sampled on this platform, in order.
+   */
+  std::vector<std::string> fields() const;
+
+ private:
+  void scheduleSample(uint64_t generation);
+  void runScheduledSample(uint64_t generation);
+
+  const std::vector<SonarMemorySource> sources_;
+
+  std::mutex mutex_;
+  std::shared_ptr<SonarConnection> connection_;
+  folly::EventBase* eventBase_ = nullptr;
+  // Bumped on every connect and disconnect, so that a sample scheduled
+  // before doesn't run anymore.
+  uint64_t generation_ = 0;
+  std::chrono::milliseconds sampleInterval_{250};
+  size_t batchSize_ = 4;
+  bool sentFields_ = false;
+  // The last sample, unavailable values carried over from the one before.
+  std::vector<int64_t> last_;
+  std::chrono::steady_clock::time_point lastTime_;
+  std::vector<int64_t> pending_;
+  size_t pendingSamples_ = 0;
+};
+
+} // namespace sonar
+} // namespace facebook
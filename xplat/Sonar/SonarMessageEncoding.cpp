@@ -0,0 +1,758 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarMessageEncoding.h"
+#include <folly/Conv.h>
+#include <folly/json.h>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+namespace facebook {
+namespace sonar {
+
+const char* encodingName(SonarMessageEncoding encoding) {
+  switch (encoding) {
+    case SonarMessageEncoding::MessagePack:
+      return "msgpack";
+    case SonarMessageEncoding::JSON:
+    default:
+      return "json";
+  }
+}
+
+std::string serializeMessage(
+    const folly::dynamic& message,
+    SonarMessageEncoding encoding) {
+  if (encoding == SonarMessageEncoding::MessagePack) {
+    return msgpack::toMessagePack(message);
+  }
+  return folly::toJson(message);
+}
+
+std::string serializeBatch(
+    const std::vector<std::string>& messages,
+    SonarMessageEncoding encoding) {
+  if (encoding == SonarMessageEncoding::MessagePack) {
+    return msgpack::batchFromMessagePack(messages);
+  }
+  size_t size = 32;
+  for (const auto& message : messages) {
+    size += message.size() + 1;
+  }
+  std::string out;
+  out.reserve(size);
+  out.append("{\"method\":\"batch\",\"messages\":[");
+  for (size_t i = 0; i < messages.size(); i++) {
+    if (i > 0) {
+      out.push_back(',');
+    }
+    out.append(messages[i]);
+  }
+  out.append("]}");
+  return out;
+}
+
+std::string executeEnvelopePrefix(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    SonarMessageEncoding encoding) {
+  if (encoding == SonarMessageEncoding::MessagePack) {
+    return msgpack::executeEnvelopePrefix(api, method);
+  }
+  std::string out("{\"method\":\"execute\",\"params\":{\"api\":");
+  out.append(folly::toJson(api));
+  out.append(",\"method\":");
+  out.append(folly::toJson(method));
+  out.append(",\"params\":");
+  return out;
+}
+
+const char* executeEnvelopeSuffix(SonarMessageEncoding encoding) {
+  return encoding == SonarMessageEncoding::MessagePack ? "" : "}}";
+}
+
+std::string serializeExecute(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    const folly::dynamic& params,
+    SonarMessageEncoding encoding) {
+  auto payload = executeEnvelopePrefix(api, method, encoding);
+  if (encoding == SonarMessageEncoding::MessagePack) {
+    msgpack::appendMessagePack(params, payload);
+  } else {
+    payload.append(folly::toJson(params));
+  }
+  payload.append(executeEnvelopeSuffix(encoding));
+  return payload;
+}
+
+namespace {
+
+// Below this, the column header costs about as much as it saves.
+constexpr size_t kMinColumnarRows = 4;
+
+bool isHomogeneous(const folly::dynamic& array) {
+  if (array.size() < kMinColumnarRows) {
+    return false;
+  }
+  const auto& first = array[0];
+  if (!first.isObject() || first.empty()) {
+    return false;
+  }
+  for (const auto& key : first.keys()) {
+    if (!key.isString()) {
+      return false;
+    }
+  }
+  for (size_t i = 1; i < array.size(); i++) {
+    const auto& row = array[i];
+    if (!row.isObject() || row.size() != first.size()) {
+      return false;
+    }
+    for (const auto& key : first.keys()) {
+      if (row.find(key) == row.items().end()) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void appendJsonString(folly::StringPiece value, std::string& out) {
+  static const folly::json::serialization_opts opts;
+  folly::json::escapeString(value, out, opts);
+}
+
+} // namespace
+
+void appendColumnarJson(const folly::dynamic& value, std::string& out) {
+  switch (value.type()) {
+    case folly::dynamic::OBJECT: {
+      out.push_back('{');
+      bool first = true;
+      for (const auto& pair : value.items()) {
+        if (!first) {
+          out.push_back(',');
+        }
+        first = false;
+        appendJsonString(pair.first.asString(), out);
+        out.push_back(':');
+        appendColumnarJson(pair.second, out);
+      }
+      out.push_back('}');
+      return;
+    }
+    case folly::dynamic::ARRAY: {
+      if (isHomogeneous(value)) {
+        const auto keys = value[0].keys();
+        out.append("{\"__columns\":[");
+        bool first = true;
+        for (const auto& key : keys) {
+          if (!first) {
+            out.push_back(',');
+          }
+          first = false;
+          appendJsonString(key.getString(), out);
+        }
+        out.append("],\"__values\":[");
+        first = true;
+        for (const auto& key : keys) {
+          out.append(first ? "[" : ",[");
+          first = false;
+          for (size_t i = 0; i < value.size(); i++) {
+            if (i > 0) {
+              out.push_back(',');
+            }
+            appendColumnarJson(value[i].at(key), out);
+          }
+          out.push_back(']');
+        }
+        out.append("]}");
+        return;
+      }
+      out.push_back('[');
+      for (size_t i = 0; i < value.size(); i++) {
+        if (i > 0) {
+          out.push_back(',');
+        }
+        appendColumnarJson(value[i], out);
+      }
+      out.push_back(']');
+      return;
+    }
+    case folly::dynamic::STRING:
+      appendJsonString(value.getString(), out);
+      return;
+    case folly::dynamic::INT64:
+      folly::toAppend(value.getInt(), &out);
+      return;
+    case folly::dynamic::BOOL:
+      out.append(value.getBool() ? "true" : "false");
+      return;
+    case folly::dynamic::NULLT:
+      out.append("null");
+      return;
+    default:
+      out.append(folly::toJson(value));
+      return;
+  }
+}
+
+std::string toColumnarJson(const folly::dynamic& value) {
+  std::string out;
+  appendColumnarJson(value, out);
+  return out;
+}
+
+SonarMessageEncoding detectEncoding(folly::StringPiece frame) {
+  for (auto c : frame) {
+    if (!isspace(static_cast<unsigned char>(c))) {
+      return c == '{' ? SonarMessageEncoding::JSON
+                      : SonarMessageEncoding::MessagePack;
+    }
+  }
+  return SonarMessageEncoding::JSON;
+}
+
+folly::dynamic deserializeMessage(folly::StringPiece frame) {
+  if (detectEncoding(frame) == SonarMessageEncoding::MessagePack) {
+    return msgpack::parseMessagePack(frame);
+  }
+  return folly::parseJson(frame);
+}
+
+namespace {
+
+/**
+ Walks a JSON frame without building anything. Strings are only read when
+ they have no escapes, everything else can only be skipped.
+ */
+class JsonPeeker {
+ public:
+  explicit JsonPeeker(folly::StringPiece frame)
+      : p_(frame.begin()), end_(frame.end()) {}
+
+  bool consume(char c) {
+    skipWhitespace();
+    if (p_ == end_ || *p_ != c) {
+      return false;
+    }
+    p_++;
+    return true;
+  }
+
+  bool atEnd() {
+    skipWhitespace();
+    return p_ == end_;
+  }
+
+  bool readPlainString(folly::StringPiece& out) {
+    if (!consume('"')) {
+      return false;
+    }
+    const auto start = p_;
+    while (p_ != end_ && *p_ != '"') {
+      if (*p_ == '\\') {
+        return false;
+      }
+      p_++;
+    }
+    if (p_ == end_) {
+      return false;
+    }
+    out = folly::StringPiece(start, p_++);
+    return true;
+  }
+
+  bool readInteger(int64_t& out) {
+    skipWhitespace();
+    const auto start = p_;
+    while (p_ != end_ &&
+           (*p_ == '-' || isdigit(static_cast<unsigned char>(*p_)))) {
+      p_++;
+    }
+    const auto parsed = folly::tryTo<int64_t>(folly::StringPiece(start, p_));
+    if (!parsed.hasValue()) {
+      return false;
+    }
+    out = parsed.value();
+    return true;
+  }
+
+  bool skipValue() {
+    skipWhitespace();
+    if (p_ == end_) {
+      return false;
+    }
+    if (*p_ == '"') {
+      return skipString();
+    }
+    if (*p_ != '{' && *p_ != '[') {
+      while (p_ != end_ && *p_ != ',' && *p_ != '}' && *p_ != ']' &&
+             !isspace(static_cast<unsigned char>(*p_))) {
+        p_++;
+      }
+      return true;
+    }
+    size_t depth = 0;
+    while (p_ != end_) {
+      switch (*p_) {
+        case '"':
+          if (!skipString()) {
+            return false;
+          }
+          continue;
+        case '{':
+        case '[':
+          depth++;
+          break;
+        case '}':
+        case ']':
+          if (--depth == 0) {
+            p_++;
+            return true;
+          }
+          break;
+      }
+      p_++;
+    }
+    return false;
+  }
+
+ private:
+  void skipWhitespace() {
+    while (p_ != end_ && isspace(static_cast<unsigned char>(*p_))) {
+      p_++;
+    }
+  }
+
+  bool skipString() {
+    for (p_++; p_ != end_; p_++) {
+      if (*p_ == '\\') {
+        if (++p_ == end_) {
+          return false;
+        }
+      } else if (*p_ == '"') {
+        p_++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const char* p_;
+  const char* end_;
+};
+
+bool peekParams(JsonPeeker& peek, SonarExecuteRoute& route) {
+  if (!peek.consume('{')) {
+    return false;
+  }
+  bool hasApi = false;
+  bool hasMethod = false;
+  if (!peek.consume('}')) {
+    do {
+      folly::StringPiece key;
+      if (!peek.readPlainString(key) || !peek.consume(':')) {
+        return false;
+      }
+      folly::StringPiece value;
+      if (key == "api") {
+        if (!peek.readPlainString(value)) {
+          return false;
+        }
+        route.api = value.str();
+        hasApi = true;
+      } else if (key == "method") {
+        if (!peek.readPlainString(value)) {
+          return false;
+        }
+        route.method = value.str();
+        hasMethod = true;
+      } else if (!peek.skipValue()) {
+        return false;
+      }
+    } while (peek.consume(','));
+    if (!peek.consume('}')) {
+      return false;
+    }
+  }
+  return hasApi && hasMethod;
+}
+
+} // namespace
+
+bool peekExecuteRoute(folly::StringPiece frame, SonarExecuteRoute& route) {
+  if (detectEncoding(frame) != SonarMessageEncoding::JSON) {
+    return false;
+  }
+  JsonPeeker peek(frame);
+  if (!peek.consume('{') || peek.consume('}')) {
+    return false;
+  }
+  bool isExecute = false;
+  bool hasParams = false;
+  do {
+    folly::StringPiece key;
+    if (!peek.readPlainString(key) || !peek.consume(':')) {
+      return false;
+    }
+    if (key == "method") {
+      folly::StringPiece method;
+      if (!peek.readPlainString(method) || method != "execute") {
+        return false;
+      }
+      isExecute = true;
+    } else if (key == "id") {
+      int64_t id;
+      if (!peek.readInteger(id)) {
+        return false;
+      }
+      route.id = id;
+    } else if (key == "params") {
+      if (!peekParams(peek, route)) {
+        return false;
+      }
+      hasParams = true;
+    } else if (!peek.skipValue()) {
+      return false;
+    }
+  } while (peek.consume(','));
+  return peek.consume('}') && peek.atEnd() && isExecute && hasParams;
+}
+
+namespace msgpack {
+
+namespace {
+
+void putByte(std::string& out, uint8_t byte) {
+  out.push_back(static_cast<char>(byte));
+}
+
+void putBigEndian(std::string& out, uint64_t value, size_t bytes) {
+  for (size_t i = bytes; i > 0; i--) {
+    putByte(out, static_cast<uint8_t>(value >> ((i - 1) * 8)));
+  }
+}
+
+void putInt(std::string& out, int64_t value) {
+  if (value >= 0) {
+    if (value < 0x80) {
+      putByte(out, static_cast<uint8_t>(value));
+    } else if (value <= 0xff) {
+      putByte(out, 0xcc);
+      putBigEndian(out, value, 1);
+    } else if (value <= 0xffff) {
+      putByte(out, 0xcd);
+      putBigEndian(out, value, 2);
+    } else if (value <= 0xffffffffLL) {
+      putByte(out, 0xce);
+      putBigEndian(out, value, 4);
+    } else {
+      putByte(out, 0xcf);
+      putBigEndian(out, value, 8);
+    }
+  } else {
+    if (value >= -32) {
+      putByte(out, static_cast<uint8_t>(value));
+    } else if (value >= INT8_MIN) {
+      putByte(out, 0xd0);
+      putBigEndian(out, static_cast<uint64_t>(value), 1);
+    } else if (value >= INT16_MIN) {
+      putByte(out, 0xd1);
+      putBigEndian(out, static_cast<uint64_t>(value), 2);
+    } else if (value >= INT32_MIN) {
+      putByte(out, 0xd2);
+      putBigEndian(out, static_cast<uint64_t>(value), 4);
+    } else {
+      putByte(out, 0xd3);
+      putBigEndian(out, static_cast<uint64_t>(value), 8);
+    }
+  }
+}
+
+void putDouble(std::string& out, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  putByte(out, 0xcb);
+  putBigEndian(out, bits, 8);
+}
+
+void putString(std::string& out, folly::StringPiece str) {
+  const auto size = str.size();
+  if (size < 32) {
+    putByte(out, 0xa0 | static_cast<uint8_t>(size));
+  } else if (size <= 0xff) {
+    putByte(out, 0xd9);
+    putBigEndian(out, size, 1);
+  } else if (size <= 0xffff) {
+    putByte(out, 0xda);
+    putBigEndian(out, size, 2);
+  } else {
+    putByte(out, 0xdb);
+    putBigEndian(out, size, 4);
+  }
+  out.append(str.data(), size);
+}
+
+void putContainerHeader(
+    std::string& out,
+    size_t size,
+    uint8_t fixMask,
+    uint8_t tag16,
+    uint8_t tag32) {
+  if (size < 16) {
+    putByte(out, fixMask | static_cast<uint8_t>(size));
+  } else if (size <= 0xffff) {
+    putByte(out, tag16);
+    putBigEndian(out, size, 2);
+  } else {
+    putByte(out, tag32);
+    putBigEndian(out, size, 4);
+  }
+}
+
+class Parser {
+ public:
+  explicit Parser(folly::StringPiece data)
+      : pos_(reinterpret_cast<const uint8_t*>(data.begin())),
+        end_(reinterpret_cast<const uint8_t*>(data.end())) {}
+
+  folly::dynamic parseDocument() {
+    auto value = parseValue(0);
+    if (pos_ != end_) {
+      throw std::invalid_argument("msgpack: trailing bytes after document");
+    }
+    return value;
+  }
+
+ private:
+  static constexpr int kMaxDepth = 256;
+
+  const uint8_t* pos_;
+  const uint8_t* end_;
+
+  void require(size_t bytes) {
+    if (static_cast<size_t>(end_ - pos_) < bytes) {
+      throw std::invalid_argument("msgpack: unexpected end of input");
+    }
+  }
+
+  uint64_t readBigEndian(size_t bytes) {
+    require(bytes);
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+      value = (value << 8) | *pos_++;
+    }
+    return value;
+  }
+
+  int64_t readSigned(size_t bytes) {
+    const auto raw = readBigEndian(bytes);
+    const auto shift = 64 - bytes * 8;
+    return static_cast<int64_t>(raw << shift) >> shift;
+  }
+
+  folly::dynamic readString(size_t size) {
+    require(size);
+    folly::dynamic str =
+        std::string(reinterpret_cast<const char*>(pos_), size);
+    pos_ += size;
+    return str;
+  }
+
+  folly::dynamic readArray(size_t size, int depth) {
+    folly::dynamic array = folly::dynamic::array();
+    for (size_t i = 0; i < size; i++) {
+      array.push_back(parseValue(depth + 1));
+    }
+    return array;
+  }
+
+  folly::dynamic readMap(size_t size, int depth) {
+    folly::dynamic object = folly::dynamic::object();
+    for (size_t i = 0; i < size; i++) {
+      auto key = parseValue(depth + 1);
+      object.insert(std::move(key), parseValue(depth + 1));
+    }
+    return object;
+  }
+
+  folly::dynamic parseValue(int depth) {
+    if (depth > kMaxDepth) {
+      throw std::invalid_argument("msgpack: nesting too deep");
+    }
+    require(1);
+    const uint8_t tag = *pos_++;
+
+    if (tag < 0x80) {
+      return static_cast<int64_t>(tag);
+    }
+    if (tag >= 0xe0) {
+      return static_cast<int64_t>(static_cast<int8_t>(tag));
+    }
+    if ((tag & 0xf0) == 0x80) {
+      return readMap(tag & 0x0f, depth);
+    }
+    if ((tag & 0xf0) == 0x90) {
+      return readArray(tag & 0x0f, depth);
+    }
+    if ((tag & 0xe0) == 0xa0) {
+      return readString(tag & 0x1f);
+    }
+
+    switch (tag) {
+      case 0xc0:
+        return nullptr;
+      case 0xc2:
+        return false;
+      case 0xc3:
+        return true;
+      case 0xca: {
+        const auto bits = static_cast<uint32_t>(readBigEndian(4));
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return static_cast<double>(value);
+      }
+      case 0xcb: {
+        const auto bits = readBigEndian(8);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+      }
+      case 0xcc:
+        return static_cast<int64_t>(readBigEndian(1));
+      case 0xcd:
+        return static_cast<int64_t>(readBigEndian(2));
+      case 0xce:
+        return static_cast<int64_t>(readBigEndian(4));
+      case 0xcf: {
+        const auto value = readBigEndian(8);
+        if (value > static_cast<uint64_t>(INT64_MAX)) {
+          return static_cast<double>(value);
+        }
+        return static_cast<int64_t>(value);
+      }
+      case 0xd0:
+        return readSigned(1);
+      case 0xd1:
+        return readSigned(2);
+      case 0xd2:
+        return readSigned(4);
+      case 0xd3:
+        return readSigned(8);
+      case 0xd9:
+      case 0xc4:
+        return readString(readBigEndian(1));
+      case 0xda:
+      case 0xc5:
+        return readString(readBigEndian(2));
+      case 0xdb:
+      case 0xc6:
+        return readString(readBigEndian(4));
+      case 0xdc:
+        return readArray(readBigEndian(2), depth);
+      case 0xdd:
+        return readArray(readBigEndian(4), depth);
+      case 0xde:
+        return readMap(readBigEndian(2), depth);
+      case 0xdf:
+        return readMap(readBigEndian(4), depth);
+      default:
+        throw std::invalid_argument(
+            "msgpack: unsupported type tag " + std::to_string(tag));
+    }
+  }
+};
+
+} // namespace
+
+void appendMessagePack(const folly::dynamic& value, std::string& out) {
+  switch (value.type()) {
+    case folly::dynamic::NULLT:
+      putByte(out, 0xc0);
+      break;
+    case folly::dynamic::BOOL:
+      putByte(out, value.getBool() ? 0xc3 : 0xc2);
+      break;
+    case folly::dynamic::INT64:
+      putInt(out, value.getInt());
+      break;
+    case folly::dynamic::DOUBLE:
+      putDouble(out, value.getDouble());
+      break;
+    case folly::dynamic::STRING:
+      putString(out, value.getString());
+      break;
+    case folly::dynamic::ARRAY:
+      putContainerHeader(out, value.size(), 0x90, 0xdc, 0xdd);
+      for (const auto& element : value) {
+        appendMessagePack(element, out);
+      }
+      break;
+    case folly::dynamic::OBJECT:
+      putContainerHeader(out, value.size(), 0x80, 0xde, 0xdf);
+      for (const auto& pair : value.items()) {
+        appendMessagePack(pair.first, out);
+        appendMessagePack(pair.second, out);
+      }
+      break;
+  }
+}
+
+std::string batchFromMessagePack(const std::vector<std::string>& messages) {
+  size_t size = 32;
+  for (const auto& message : messages) {
+    size += message.size();
+  }
+  std::string out;
+  out.reserve(size);
+  putContainerHeader(out, 2, 0x80, 0xde, 0xdf);
+  putString(out, "method");
+  putString(out, "batch");
+  putString(out, "messages");
+  putContainerHeader(out, messages.size(), 0x90, 0xdc, 0xdd);
+  for (const auto& message : messages) {
+    out.append(message);
+  }
+  return out;
+}
+
+std::string executeEnvelopePrefix(
+    folly::StringPiece api,
+    folly::StringPiece method) {
+  std::string out;
+  putContainerHeader(out, 2, 0x80, 0xde, 0xdf);
+  putString(out, "method");
+  putString(out, "execute");
+  putString(out, "params");
+  putContainerHeader(out, 3, 0x80, 0xde, 0xdf);
+  putString(out, "api");
+  putString(out, api);
+  putString(out, "method");
+  putString(out, method);
+  // The serialized params value follows, and completes both maps.
+  putString(out, "params");
+  return out;
+}
+
+std::string toMessagePack(const folly::dynamic& value) {
+  std::string out;
+  appendMessagePack(value, out);
+  return out;
+}
+
+folly::dynamic parseMessagePack(folly::StringPiece data) {
+  return Parser(data).parseDocument();
+}
+
+} // namespace msgpack
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+#include <string>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Wire encodings understood by the Sonar client. JSON is always supported and
+ is what older desktops speak. MessagePack is only used once the desktop has
+ shown that it understands it.
+ */
+enum class SonarMessageEncoding { JSON, MessagePack };
+
+/**
+ Name of the encoding as advertised in the connection setup payload.
+ */
+const char* encodingName(SonarMessageEncoding encoding);
+
+/**
+ Serializes a message using the given encoding.
+ */
+std::string serializeMessage(
+    const folly::dynamic& message,
+    SonarMessageEncoding encoding);
+
+/**
+ Same as serializing value as JSON, except that arrays of objects that all
+ have the same keys are written column by column, as
+ {"__columns": [keys...], "__values": [[values of the first key...], ...]},
+ so that the keys are only sent once. Only for desktops that announced
+ "columnar": true, which expand them back into arrays.
+ */
+std::string toColumnarJson(const folly::dynamic& value);
+
+void appendColumnarJson(const folly::dynamic& value, std::string& out);
+
+/**
+ Wraps already serialized messages into a single
+ {"method": "batch", "messages": [...]} frame without re-parsing them.
+ All messages must have been serialized with the given encoding.
+ */
+std::string serializeBatch(
+    const std::vector<std::string>& messages,
+    SonarMessageEncoding encoding);
+
+/**
+ Bytes that go before and after an already serialized params payload to form
+ {"method": "execute", "params": {"api": api, "method": method, "params": ...}}
+ in the given encoding. These only depend on (api, method), so callers can
+ compute them once and reuse them for every message.
+ */
+std::string executeEnvelopePrefix(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    SonarMessageEncoding encoding);
+
+const char* executeEnvelopeSuffix(SonarMessageEncoding encoding);
+
+/**
+ Serializes a complete "execute" message, for callers that send the same
+ message over several connections.
+ */
+std::string serializeExecute(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    const folly::dynamic& params,
+    SonarMessageEncoding encoding);
+
+/**
+ Detects which encoding a frame was sent in. JSON messages are always
+ objects, so they start with '{' (optionally after whitespace), which is
+ never a valid first byte of a MessagePack map.
+ */
+SonarMessageEncoding detectEncoding(folly::StringPiece frame);
+
+/**
+ Parses a frame in whichever encoding it was sent in.
+ */
+folly::dynamic deserializeMessage(folly::StringPiece frame);
+
+/**
+ Where an incoming "execute" call is headed.
+ */
+struct SonarExecuteRoute {
+  folly::Optional<int64_t> id;
+  std::string api;
+  std::string method;
+};
+
+/**
+ Reads the id, plugin and method of an "execute" JSON frame without parsing
+ its params, so that calls nobody will dispatch can be turned away without
+ materializing them. Returns false for other messages, for MessagePack
+ frames and for anything it doesn't understand, such as escaped plugin
+ names; callers then parse the frame as usual.
+ */
+bool peekExecuteRoute(folly::StringPiece frame, SonarExecuteRoute& route);
+
+namespace msgpack {
+
+std::string toMessagePack(const folly::dynamic& value);
+
+void appendMessagePack(const folly::dynamic& value, std::string& out);
+
+std::string batchFromMessagePack(const std::vector<std::string>& messages);
+
+std::string executeEnvelopePrefix(
+    folly::StringPiece api,
+    folly::StringPiece method);
+
+/**
+ Throws std::invalid_argument if the input is truncated, malformed or has
+ trailing bytes.
+ */
+folly::dynamic parseMessagePack(folly::StringPiece data);
+
+} // namespace msgpack
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,175 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarMessageWriter.h"
+
+#include <folly/json.h>
+#include <cmath>
+#include <stdexcept>
+
+namespace facebook {
+namespace sonar {
+
+constexpr unsigned SonarMessageWriter::kMaxDepth;
+
+namespace {
+
+// Checks that only catch misuse run in debug builds. Checks that keep the
+// writer itself from going out of bounds always run.
+#ifndef NDEBUG
+void check(bool condition, const char* message) {
+  if (!condition) {
+    throw std::logic_error(message);
+  }
+}
+#else
+inline void check(bool, const char*) {}
+#endif
+
+void appendDouble(double value, std::string& out) {
+  if (!std::isfinite(value)) {
+    out.append("null");
+    return;
+  }
+  folly::toAppend(value, &out);
+}
+
+} // namespace
+
+SonarMessageWriter::SonarMessageWriter(std::string& out) : out_(out) {
+  open('{', false);
+}
+
+SonarMessageWriter& SonarMessageWriter::key(folly::StringPiece key) {
+  if (depth_ == 0) {
+    throw std::logic_error("The message was already finished");
+  }
+  check(!inArray(), "Keys can only be written inside an object");
+  check(!pendingKey_, "The previous key has no value");
+  const uint64_t bit = uint64_t(1) << (depth_ - 1);
+  if (empty_ & bit) {
+    empty_ &= ~bit;
+  } else {
+    out_.push_back(',');
+  }
+  writeString(key);
+  out_.push_back(':');
+  pendingKey_ = true;
+  return *this;
+}
+
+SonarMessageWriter& SonarMessageWriter::value(folly::StringPiece value) {
+  beforeValue();
+  writeString(value);
+  return *this;
+}
+
+SonarMessageWriter& SonarMessageWriter::value(double value) {
+  beforeValue();
+  appendDouble(value, out_);
+  return *this;
+}
+
+SonarMessageWriter& SonarMessageWriter::value(bool value) {
+  beforeValue();
+  out_.append(value ? "true" : "false");
+  return *this;
+}
+
+SonarMessageWriter& SonarMessageWriter::valueNull() {
+  beforeValue();
+  out_.append("null");
+  return *this;
+}
+
+SonarMessageWriter& SonarMessageWriter::valueDynamic(
+    const folly::dynamic& value) {
+  beforeValue();
+  out_.append(folly::toJson(value));
+  return *this;
+}
+
+SonarMessageWriter& SonarMessageWriter::valueRaw(folly::StringPiece json) {
+  beforeValue();
+  out_.append(json.data(), json.size());
+  return *this;
+}
+
+SonarMessageWriter& SonarMessageWriter::beginObject() {
+  beforeValue();
+  open('{', false);
+  return *this;
+}
+
+SonarMessageWriter& SonarMessageWriter::beginArray() {
+  beforeValue();
+  open('[', true);
+  return *this;
+}
+
+SonarMessageWriter& SonarMessageWriter::endObject() {
+  check(depth_ == 0 || !inArray(), "endObject closing an array");
+  return end();
+}
+
+SonarMessageWriter& SonarMessageWriter::endArray() {
+  check(depth_ == 0 || inArray(), "endArray closing an object");
+  return end();
+}
+
+SonarMessageWriter& SonarMessageWriter::end() {
+  if (depth_ == 0) {
+    throw std::logic_error("Nothing left to close");
+  }
+  check(!pendingKey_, "The last key has no value");
+  pendingKey_ = false;
+  depth_--;
+  const uint64_t bit = uint64_t(1) << depth_;
+  out_.push_back(arrays_ & bit ? ']' : '}');
+  empty_ &= ~bit;
+  arrays_ &= ~bit;
+  return *this;
+}
+
+void SonarMessageWriter::beforeValue() {
+  if (depth_ == 0) {
+    throw std::logic_error("The message was already finished");
+  }
+  if (pendingKey_) {
+    pendingKey_ = false;
+    return;
+  }
+  check(inArray(), "Values inside an object need a key");
+  const uint64_t bit = uint64_t(1) << (depth_ - 1);
+  if (empty_ & bit) {
+    empty_ &= ~bit;
+  } else {
+    out_.push_back(',');
+  }
+}
+
+void SonarMessageWriter::writeString(folly::StringPiece value) {
+  static const folly::json::serialization_opts opts;
+  folly::json::escapeString(value, out_, opts);
+}
+
+void SonarMessageWriter::open(char bracket, bool array) {
+  if (depth_ == kMaxDepth) {
+    throw std::length_error("Message is nested too deeply");
+  }
+  const uint64_t bit = uint64_t(1) << depth_;
+  empty_ |= bit;
+  if (array) {
+    arrays_ |= bit;
+  }
+  depth_++;
+  out_.push_back(bracket);
+}
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,174 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Conv.h>
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Writes a JSON object straight into a string, SAX style, instead of building
+ a folly::dynamic tree where every node, key and bucket is its own
+ allocation only to serialize and free it right away. Writing into a string
+ that is reused keeps allocations down to growing it now and then, and
+ writing into the outgoing message's own buffer serializes it in one pass.
+
+ Starts out inside the root object. Within an object, every value follows a
+ key(); put(key, value) does both. Within an array values are written with
+ value(), or add(). Objects and arrays are opened with beginObject and
+ beginArray and closed with endObject, endArray or end. Debug builds throw
+ std::logic_error when calls don't make up valid JSON; duplicate keys are
+ never checked for.
+ */
+class SonarMessageWriter {
+ public:
+  /**
+   Appends to out, which callers can clear and reuse between messages.
+   */
+  explicit SonarMessageWriter(std::string& out);
+
+  SonarMessageWriter(const SonarMessageWriter&) = delete;
+  SonarMessageWriter& operator=(const SonarMessageWriter&) = delete;
+
+  SonarMessageWriter& key(folly::StringPiece key);
+
+  SonarMessageWriter& value(folly::StringPiece value);
+
+  SonarMessageWriter& value(const std::string& value) {
+    return this->value(folly::StringPiece(value));
+  }
+
+  SonarMessageWriter& value(const char* value) {
+    return this->value(folly::StringPiece(value));
+  }
+
+  template <
+      typename T,
+      typename = typename std::enable_if<
+          std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+  SonarMessageWriter& value(T value) {
+    beforeValue();
+    folly::toAppend(value, &out_);
+    return *this;
+  }
+
+  /**
+   Writes null for NaN and infinities, which JSON can't represent.
+   */
+  SonarMessageWriter& value(double value);
+
+  SonarMessageWriter& value(bool value);
+
+  SonarMessageWriter& valueNull();
+
+  /**
+   Serializes a value that already is a folly::dynamic in place.
+   */
+  SonarMessageWriter& valueDynamic(const folly::dynamic& value);
+
+  /**
+   Copies in a value that is already serialized, such as an earlier
+   writer's output. It isn't checked to be valid JSON.
+   */
+  SonarMessageWriter& valueRaw(folly::StringPiece json);
+
+  SonarMessageWriter& beginObject();
+
+  SonarMessageWriter& beginArray();
+
+  SonarMessageWriter& endObject();
+
+  SonarMessageWriter& endArray();
+
+  /**
+   Closes the innermost object or array. Closing the root object finishes
+   the message, after which nothing more may be written.
+   */
+  SonarMessageWriter& end();
+
+  /**
+   Whether every object and array, including the root object, was closed.
+   */
+  bool isComplete() const {
+    return depth_ == 0;
+  }
+
+  // Shorthands for writing a key followed by its value.
+
+  template <typename T>
+  SonarMessageWriter& put(folly::StringPiece key, T&& value) {
+    return this->key(key).value(std::forward<T>(value));
+  }
+
+  SonarMessageWriter& putNull(folly::StringPiece key) {
+    return this->key(key).valueNull();
+  }
+
+  SonarMessageWriter& putDynamic(
+      folly::StringPiece key,
+      const folly::dynamic& value) {
+    return this->key(key).valueDynamic(value);
+  }
+
+  SonarMessageWriter& putRaw(folly::StringPiece key, folly::StringPiece json) {
+    return this->key(key).valueRaw(json);
+  }
+
+  SonarMessageWriter& beginObject(folly::StringPiece key) {
+    return this->key(key).beginObject();
+  }
+
+  SonarMessageWriter& beginArray(folly::StringPiece key) {
+    return this->key(key).beginArray();
+  }
+
+  template <typename T>
+  SonarMessageWriter& add(T&& value) {
+    return this->value(std::forward<T>(value));
+  }
+
+  SonarMessageWriter& addNull() {
+    return valueNull();
+  }
+
+  SonarMessageWriter& addDynamic(const folly::dynamic& value) {
+    return valueDynamic(value);
+  }
+
+ private:
+  // Nesting is tracked in a bitmask rather than a stack so that writing
+  // doesn't allocate, which limits it to this many levels.
+  static constexpr unsigned kMaxDepth = 64;
+
+  void beforeValue();
+  void writeString(folly::StringPiece value);
+  void open(char bracket, bool array);
+  bool inArray() const {
+    return arrays_ & (uint64_t(1) << (depth_ - 1));
+  }
+
+  std::string& out_;
+  unsigned depth_ = 0;
+  // Bit i is set while level i+1 has no elements yet.
+  uint64_t empty_ = 0;
+  // Bit i is set if level i+1 is an array.
+  uint64_t arrays_ = 0;
+  // Whether a key was written that still needs its value.
+  bool pendingKey_ = false;
+};
+
+} // namespace sonar
+} // namespace facebook
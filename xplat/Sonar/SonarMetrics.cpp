@@ -0,0 +1,201 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarMetrics.h"
+
+namespace facebook {
+namespace sonar {
+
+constexpr size_t SonarMetrics::kMaxMethods;
+constexpr int64_t SonarLoopLagMetrics::kBucketsMs[];
+constexpr size_t SonarLoopLagMetrics::kBuckets;
+
+namespace {
+
+int64_t value(const std::atomic<uint64_t>& counter) {
+  return static_cast<int64_t>(counter.load(std::memory_order_relaxed));
+}
+
+} // namespace
+
+folly::dynamic SonarMethodMetrics::toDynamic() const {
+  return folly::dynamic::object("messagesSent", value(messagesSent))(
+      "bytesSent", value(bytesSent))(
+      "serializationMicros", value(serializationMicros))(
+      "queueWaitMicros", value(queueWaitMicros))(
+      "messagesDropped", value(messagesDropped))(
+      "messagesReceived", value(messagesReceived))(
+      "bytesReceived", value(bytesReceived))("parseMicros", value(parseMicros))(
+      "receiverMicros", value(receiverMicros))(
+      "responsesFromCache", value(responsesFromCache));
+}
+
+folly::dynamic SonarTransportMetrics::toDynamic() const {
+  return folly::dynamic::object("framesSent", value(framesSent))(
+      "framesReceived", value(framesReceived))("bytesSent", value(bytesSent))(
+      "bytesReceived", value(bytesReceived))("connections", value(connections))(
+      "disconnections", value(disconnections))(
+      "resumptions", value(resumptions))(
+      "keepalivesSent", value(keepalivesSent))(
+      "keepalivesReceived", value(keepalivesReceived))(
+      "keepaliveRttMicros", keepaliveRttMicros.load())(
+      "smoothedRttMicros", smoothedRttMicros.load());
+}
+
+std::unique_lock<std::mutex> SonarLockMetrics::lock(std::mutex& mutex) {
+  acquisitions++;
+  std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+  if (lock.owns_lock()) {
+    return lock;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  lock.lock();
+  const auto waited = microsSince(start);
+  contended++;
+  waitMicros += waited;
+  auto max = maxWaitMicros.load();
+  while (waited > max && !maxWaitMicros.compare_exchange_weak(max, waited)) {
+  }
+  return lock;
+}
+
+void SonarLoopLagMetrics::recordLag(uint64_t micros) {
+  size_t bucket = 0;
+  while (bucket + 1 < kBuckets &&
+         micros > static_cast<uint64_t>(kBucketsMs[bucket]) * 1000) {
+    bucket++;
+  }
+  probes++;
+  buckets[bucket]++;
+  auto max = maxLagMicros.load();
+  while (micros > max && !maxLagMicros.compare_exchange_weak(max, micros)) {
+  }
+}
+
+void SonarLoopLagMetrics::recordStall(
+    uint64_t micros,
+    std::string plugin,
+    std::string method) {
+  stalls++;
+  std::lock_guard<std::mutex> lock(mutex_);
+  lastStall_ =
+      folly::dynamic::object("lagMicros", static_cast<int64_t>(micros))(
+          "plugin", std::move(plugin))("method", std::move(method));
+}
+
+folly::dynamic SonarLoopLagMetrics::toDynamic() const {
+  folly::dynamic bounds = folly::dynamic::array;
+  for (auto bound : kBucketsMs) {
+    bounds.push_back(bound);
+  }
+  folly::dynamic counts = folly::dynamic::array;
+  for (const auto& bucket : buckets) {
+    counts.push_back(value(bucket));
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  return folly::dynamic::object("probes", value(probes))(
+      "bucketsMs", std::move(bounds))("buckets", std::move(counts))(
+      "maxLagMicros", value(maxLagMicros))("stalls", value(stalls))(
+      "lastStall", lastStall_);
+}
+
+folly::dynamic SonarLockMetrics::toDynamic() const {
+  return folly::dynamic::object("acquisitions", value(acquisitions))(
+      "contended", value(contended))("waitMicros", value(waitMicros))(
+      "maxWaitMicros", value(maxWaitMicros));
+}
+
+std::shared_ptr<SonarMethodMetrics> SonarMetrics::forMethod(
+    folly::StringPiece plugin,
+    folly::StringPiece method) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Looked up on every message, only copied into a key the first time.
+  const auto iter = methods_.find(std::make_pair(plugin, method));
+  if (iter != methods_.end()) {
+    return iter->second;
+  }
+  if (methods_.size() >= kMaxMethods) {
+    if (!overflow_) {
+      overflow_ = std::make_shared<SonarMethodMetrics>();
+    }
+    return overflow_;
+  }
+  auto metrics = std::make_shared<SonarMethodMetrics>();
+  methods_.emplace(std::make_pair(plugin.str(), method.str()), metrics);
+  return metrics;
+}
+
+std::shared_ptr<SonarLoopLagMetrics> SonarMetrics::forLoop(
+    const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& loop = loops_[name];
+  if (!loop) {
+    loop = std::make_shared<SonarLoopLagMetrics>();
+  }
+  return loop;
+}
+
+void SonarMetrics::enterReceiver(SonarMethodMetrics* method) {
+  runningSince_.store(
+      std::chrono::steady_clock::now().time_since_epoch().count(),
+      std::memory_order_relaxed);
+  running_.store(method, std::memory_order_release);
+}
+
+void SonarMetrics::exitReceiver(SonarMethodMetrics* method) {
+  running_.compare_exchange_strong(method, nullptr);
+}
+
+bool SonarMetrics::runningReceiver(
+    std::chrono::steady_clock::time_point startedBefore,
+    std::string& plugin,
+    std::string& method) const {
+  const auto running = running_.load(std::memory_order_acquire);
+  if (!running ||
+      runningSince_.load(std::memory_order_relaxed) >
+          startedBefore.time_since_epoch().count()) {
+    return false;
+  }
+  // Only looked up on a stall, so that receivers only pay for two stores.
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& entry : methods_) {
+    if (entry.second.get() == running) {
+      plugin = entry.first.first;
+      method = entry.first.second;
+      return true;
+    }
+  }
+  plugin = method = "<other>";
+  return true;
+}
+
+folly::dynamic SonarMetrics::toDynamic() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  folly::dynamic plugins = folly::dynamic::object();
+  for (const auto& entry : methods_) {
+    const auto& plugin = entry.first.first;
+    if (plugins.find(plugin) == plugins.items().end()) {
+      plugins[plugin] = folly::dynamic::object();
+    }
+    plugins[plugin][entry.first.second] = entry.second->toDynamic();
+  }
+  if (overflow_) {
+    plugins["<other>"] =
+        folly::dynamic::object("<other>", overflow_->toDynamic());
+  }
+  folly::dynamic loops = folly::dynamic::object();
+  for (const auto& entry : loops_) {
+    loops[entry.first] = entry.second->toDynamic();
+  }
+  return folly::dynamic::object("plugins", std::move(plugins))(
+      "transport", transport_.toDynamic())(
+      "clientLock", clientLock_.toDynamic())("loops", std::move(loops));
+}
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,227 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Traffic counters for a single plugin method. Each counter is updated
+ independently, so a snapshot taken while messages are in flight may be
+ off by one message.
+ */
+struct SonarMethodMetrics {
+  // Messages sent by the plugin.
+  std::atomic<uint64_t> messagesSent{0};
+  std::atomic<uint64_t> bytesSent{0};
+  std::atomic<uint64_t> serializationMicros{0};
+  // Time between a message being queued and being handed to rsocket.
+  std::atomic<uint64_t> queueWaitMicros{0};
+  // Messages dropped by the method's SonarSendPolicy.
+  std::atomic<uint64_t> messagesDropped{0};
+
+  // Calls made by the desktop.
+  std::atomic<uint64_t> messagesReceived{0};
+  std::atomic<uint64_t> bytesReceived{0};
+  std::atomic<uint64_t> parseMicros{0};
+  std::atomic<uint64_t> receiverMicros{0};
+  // Calls answered from SonarConnection::cacheResponses, without the
+  // receiver.
+  std::atomic<uint64_t> responsesFromCache{0};
+
+  folly::dynamic toDynamic() const;
+};
+
+/**
+ Counters for the rsocket connection, across reconnects.
+ */
+struct SonarTransportMetrics {
+  std::atomic<uint64_t> framesSent{0};
+  std::atomic<uint64_t> framesReceived{0};
+  std::atomic<uint64_t> bytesSent{0};
+  std::atomic<uint64_t> bytesReceived{0};
+  std::atomic<uint64_t> connections{0};
+  std::atomic<uint64_t> disconnections{0};
+  // Dropped connections that were resumed without disconnecting plugins.
+  std::atomic<uint64_t> resumptions{0};
+  std::atomic<uint64_t> keepalivesSent{0};
+  std::atomic<uint64_t> keepalivesReceived{0};
+  // Round trip of the most recent answered keepalive, -1 until one was.
+  std::atomic<int64_t> keepaliveRttMicros{-1};
+  // Exponentially weighted average of keepalive round trips, -1 until one
+  // was answered. Steadier than the last sample, so better suited to tuning
+  // batching and compression against.
+  std::atomic<int64_t> smoothedRttMicros{-1};
+
+  folly::dynamic toDynamic() const;
+};
+
+/**
+ Contention on a lock. Uncontended acquisitions only cost a try_lock, so
+ this is cheap enough to leave on.
+ */
+struct SonarLockMetrics {
+  std::atomic<uint64_t> acquisitions{0};
+  // Acquisitions that had to wait for another thread to release the lock.
+  std::atomic<uint64_t> contended{0};
+  std::atomic<uint64_t> waitMicros{0};
+  std::atomic<uint64_t> maxWaitMicros{0};
+
+  /**
+   Locks the mutex, counting how long it took if it was held.
+   */
+  std::unique_lock<std::mutex> lock(std::mutex& mutex);
+
+  folly::dynamic toDynamic() const;
+};
+
+/**
+ How long work posted to an event loop waited before it ran, as probed by
+ SonarLoopWatchdog. A probe that hasn't run past the stall threshold counts
+ as a stall, along with the receiver that was running at the time.
+ */
+struct SonarLoopLagMetrics {
+  // Upper bounds of the lag buckets in milliseconds, the last bucket holds
+  // everything longer.
+  static constexpr int64_t kBucketsMs[] = {1, 2, 5, 10, 25, 50, 100, 250, 1000};
+  static constexpr size_t kBuckets =
+      sizeof(kBucketsMs) / sizeof(kBucketsMs[0]) + 1;
+
+  std::atomic<uint64_t> probes{0};
+  std::atomic<uint64_t> buckets[kBuckets] = {};
+  std::atomic<uint64_t> maxLagMicros{0};
+  std::atomic<uint64_t> stalls{0};
+
+  void recordLag(uint64_t micros);
+
+  /**
+   Keeps what was running when the loop stalled, for lastStall. Empty
+   names if no receiver was.
+   */
+  void recordStall(uint64_t micros, std::string plugin, std::string method);
+
+  folly::dynamic toDynamic() const;
+
+ private:
+  mutable std::mutex mutex_;
+  // Guarded by mutex_.
+  folly::dynamic lastStall_ = nullptr;
+};
+
+/**
+ Orders (plugin, method) pairs of strings and string pieces alike, so that
+ maps keyed by them can be searched without copying the names.
+ */
+struct SonarMethodKeyLess {
+  using is_transparent = void;
+
+  template <typename A, typename B>
+  bool operator()(const A& a, const B& b) const {
+    const int plugin =
+        folly::StringPiece(a.first).compare(folly::StringPiece(b.first));
+    return plugin < 0 ||
+        (plugin == 0 &&
+         folly::StringPiece(a.second) < folly::StringPiece(b.second));
+  }
+};
+
+/**
+ Per plugin and per method traffic metrics, shared by the client, its
+ connections and the socket, along with the transport counters.
+ */
+class SonarMetrics {
+ public:
+  /**
+   Counters for the given plugin method, created on first use.
+   */
+  std::shared_ptr<SonarMethodMetrics> forMethod(
+      folly::StringPiece plugin,
+      folly::StringPiece method);
+
+  SonarTransportMetrics& transport() {
+    return transport_;
+  }
+
+  /**
+   Contention on the client lock, which every incoming message takes.
+   */
+  SonarLockMetrics& clientLock() {
+    return clientLock_;
+  }
+
+  /**
+   Lag of the named event loop, created on first use.
+   */
+  std::shared_ptr<SonarLoopLagMetrics> forLoop(const std::string& name);
+
+  /**
+   Marks the receiver counted in method as running, until exitReceiver.
+   Only the innermost receiver is tracked, which is what holds up its
+   thread.
+   */
+  void enterReceiver(SonarMethodMetrics* method);
+
+  void exitReceiver(SonarMethodMetrics* method);
+
+  /**
+   The plugin and method of the receiver that has been running since at
+   least startedBefore, if there is one.
+   */
+  bool runningReceiver(
+      std::chrono::steady_clock::time_point startedBefore,
+      std::string& plugin,
+      std::string& method) const;
+
+  /**
+   Snapshot as {"plugins": {plugin: {method: {counter: value}}},
+   "transport": {counter: value}, "clientLock": {counter: value},
+   "loops": {loop: {counter: value}}}.
+   */
+  folly::dynamic toDynamic() const;
+
+ private:
+  // Methods come from the desktop as well, so don't let a misbehaving peer
+  // grow this without bounds. Anything past the limit shares one entry.
+  static constexpr size_t kMaxMethods = 1024;
+
+  mutable std::mutex mutex_;
+  std::map<
+      std::pair<std::string, std::string>,
+      std::shared_ptr<SonarMethodMetrics>,
+      SonarMethodKeyLess>
+      methods_;
+  std::shared_ptr<SonarMethodMetrics> overflow_;
+  std::map<std::string, std::shared_ptr<SonarLoopLagMetrics>> loops_;
+  // The receiver running, and since when in steady_clock ticks. Cleared
+  // only by the receiver that set it.
+  std::atomic<SonarMethodMetrics*> running_{nullptr};
+  std::atomic<int64_t> runningSince_{0};
+  SonarTransportMetrics transport_;
+  SonarLockMetrics clientLock_;
+};
+
+inline uint64_t microsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+} // namespace sonar
+} // namespace facebook
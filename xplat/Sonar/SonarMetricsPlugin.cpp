@@ -0,0 +1,413 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarMetricsPlugin.h"
+#include "SonarThreadShards.h"
+
+#include <folly/Bits.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace facebook {
+namespace sonar {
+
+constexpr const char* SonarMetricsPlugin::kIdentifier;
+
+namespace detail {
+
+namespace {
+
+constexpr int64_t kNoMin = std::numeric_limits<int64_t>::max();
+constexpr int64_t kNoMax = std::numeric_limits<int64_t>::min();
+
+enum Kind { kCounters, kGauges, kHistograms, kKinds };
+
+constexpr size_t kCapacity[kKinds] = {
+    kSonarMaxCounters,
+    kSonarMaxGauges,
+    kSonarMaxHistograms,
+};
+
+// Only the owning thread writes, so there is no need for a read-modify-write.
+inline void addTo(std::atomic<int64_t>& cell, int64_t amount) {
+  cell.store(cell.load(std::memory_order_relaxed) + amount,
+             std::memory_order_relaxed);
+}
+
+inline int64_t read(const std::atomic<int64_t>& cell) {
+  return cell.load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+SonarHistogramCell::SonarHistogramCell() : min(kNoMin), max(kNoMax) {
+  for (auto& bucket : buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+SonarMetricsShard::SonarMetricsShard() {
+  for (auto& counter : counters) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+}
+
+/**
+ What the plugin and its handles share, so that handles stay usable after
+ the plugin is gone. Shards are owned here and folded into retired when
+ their thread exits.
+ */
+class SonarMetricsCore
+    : public std::enable_shared_from_this<SonarMetricsCore> {
+ public:
+  SonarMetricsCore() : id(nextSonarThreadShardsOwnerId()) {
+    for (auto& gauge : gauges) {
+      gauge.store(NAN, std::memory_order_relaxed);
+    }
+    std::fill(std::begin(lastGauges), std::end(lastGauges), NAN);
+  }
+
+  SonarMetricsShard& shard() {
+    return sonarThreadShard<SonarMetricsCore, SonarMetricsShard>(*this);
+  }
+
+  SonarMetricsShard* createShard();
+
+  size_t registerName(Kind kind, const std::string& name);
+
+  void retire(SonarMetricsShard* shard);
+
+  const uint64_t id;
+  // NaN until set.
+  std::atomic<double> gauges[kSonarMaxGauges];
+
+  // Everything below is guarded by mutex.
+  std::mutex mutex;
+  std::vector<std::string> names[kKinds];
+  std::unordered_map<std::string, size_t> indices[kKinds];
+  std::vector<std::unique_ptr<SonarMetricsShard>> shards;
+  SonarMetricsShard retired;
+
+  // Totals as of the last flush.
+  int64_t lastCounters[kSonarMaxCounters] = {};
+  double lastGauges[kSonarMaxGauges];
+  int64_t lastHistogramCounts[kSonarMaxHistograms] = {};
+  int64_t lastHistogramSums[kSonarMaxHistograms] = {};
+  int64_t lastBuckets[kSonarMaxHistograms][kSonarHistogramBuckets] = {};
+};
+
+SonarMetricsShard* SonarMetricsCore::createShard() {
+  std::lock_guard<std::mutex> lock(mutex);
+  shards.push_back(std::make_unique<SonarMetricsShard>());
+  return shards.back().get();
+}
+
+size_t SonarMetricsCore::registerName(Kind kind, const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = indices[kind].find(name);
+  if (it != indices[kind].end()) {
+    return it->second;
+  }
+  if (names[kind].size() == kCapacity[kind]) {
+    return std::string::npos;
+  }
+  const size_t index = names[kind].size();
+  names[kind].push_back(name);
+  indices[kind].emplace(name, index);
+  return index;
+}
+
+void SonarMetricsCore::retire(SonarMetricsShard* shard) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (size_t i = 0; i < kSonarMaxCounters; i++) {
+    addTo(retired.counters[i], read(shard->counters[i]));
+  }
+  for (size_t i = 0; i < kSonarMaxHistograms; i++) {
+    auto& from = shard->histograms[i];
+    auto& to = retired.histograms[i];
+    addTo(to.count, read(from.count));
+    addTo(to.sum, read(from.sum));
+    to.min.store(std::min(read(to.min), read(from.min)));
+    to.max.store(std::max(read(to.max), read(from.max)));
+    for (size_t b = 0; b < kSonarHistogramBuckets; b++) {
+      addTo(to.buckets[b], read(from.buckets[b]));
+    }
+  }
+  shards.erase(
+      std::remove_if(
+          shards.begin(),
+          shards.end(),
+          [shard](const std::unique_ptr<SonarMetricsShard>& owned) {
+            return owned.get() == shard;
+          }),
+      shards.end());
+}
+
+} // namespace detail
+
+using detail::SonarMetricsCore;
+
+void SonarCounter::add(int64_t amount) const {
+  if (core_) {
+    detail::addTo(core_->shard().counters[index_], amount);
+  }
+}
+
+void SonarGauge::set(double value) const {
+  if (core_) {
+    core_->gauges[index_].store(value, std::memory_order_relaxed);
+  }
+}
+
+void SonarHistogram::record(int64_t value) const {
+  if (!core_) {
+    return;
+  }
+  auto& cell = core_->shard().histograms[index_];
+  detail::addTo(cell.count, 1);
+  detail::addTo(cell.sum, value);
+  if (value < detail::read(cell.min)) {
+    cell.min.store(value, std::memory_order_relaxed);
+  }
+  if (value > detail::read(cell.max)) {
+    cell.max.store(value, std::memory_order_relaxed);
+  }
+  const size_t bucket = value <= 0
+      ? 0
+      : std::min<size_t>(
+            folly::findLastSet(static_cast<uint64_t>(value)),
+            detail::kSonarHistogramBuckets - 1);
+  detail::addTo(cell.buckets[bucket], 1);
+}
+
+SonarMetricsPlugin::SonarMetricsPlugin(std::chrono::milliseconds flushInterval)
+    : flushInterval_(flushInterval),
+      core_(std::make_shared<SonarMetricsCore>()),
+      flushedAt_(std::chrono::steady_clock::now()) {}
+
+SonarMetricsPlugin::~SonarMetricsPlugin() {
+  stopFlushing();
+}
+
+SonarCounter SonarMetricsPlugin::counter(const std::string& name) {
+  const auto index = core_->registerName(detail::kCounters, name);
+  return index == std::string::npos ? SonarCounter()
+                                    : SonarCounter(core_, index);
+}
+
+SonarGauge SonarMetricsPlugin::gauge(const std::string& name) {
+  const auto index = core_->registerName(detail::kGauges, name);
+  return index == std::string::npos ? SonarGauge() : SonarGauge(core_, index);
+}
+
+SonarHistogram SonarMetricsPlugin::histogram(const std::string& name) {
+  const auto index = core_->registerName(detail::kHistograms, name);
+  return index == std::string::npos ? SonarHistogram()
+                                    : SonarHistogram(core_, index);
+}
+
+std::string SonarMetricsPlugin::identifier() const {
+  return kIdentifier;
+}
+
+void SonarMetricsPlugin::didConnect(std::shared_ptr<SonarConnection> conn) {
+  stopFlushing();
+  {
+    std::lock_guard<std::mutex> lock(connectionMutex_);
+    connection_ = std::move(conn);
+    std::fill(std::begin(sentNames_), std::end(sentNames_), 0);
+  }
+  stopFlusher_ = false;
+  flusher_ = std::thread([this] {
+    std::unique_lock<std::mutex> lock(flusherMutex_);
+    while (!flusherWakeup_.wait_for(
+        lock, flushInterval_, [this] { return stopFlusher_; })) {
+      lock.unlock();
+      flush();
+      lock.lock();
+    }
+  });
+}
+
+void SonarMetricsPlugin::didDisconnect() {
+  stopFlushing();
+  std::lock_guard<std::mutex> lock(connectionMutex_);
+  connection_ = nullptr;
+}
+
+void SonarMetricsPlugin::stopFlushing() {
+  if (!flusher_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(flusherMutex_);
+    stopFlusher_ = true;
+  }
+  flusherWakeup_.notify_all();
+  flusher_.join();
+}
+
+namespace {
+
+struct HistogramDelta {
+  size_t index;
+  int64_t count;
+  int64_t sum;
+  int64_t min;
+  int64_t max;
+  // Bucket and count pairs, for the buckets that grew.
+  std::vector<int64_t> buckets;
+};
+
+constexpr const char* kNamesKeys[detail::kKinds] = {
+    "counterNames",
+    "gaugeNames",
+    "histogramNames",
+};
+
+} // namespace
+
+void SonarMetricsPlugin::flush() {
+  std::lock_guard<std::mutex> connectionLock(connectionMutex_);
+  if (!connection_ || !connection_->isActive()) {
+    return;
+  }
+
+  // Counters as a flat index, value list.
+  std::vector<int64_t> counters;
+  std::vector<std::pair<size_t, double>> gauges;
+  std::vector<HistogramDelta> histograms;
+  // The ones the desktop hasn't been sent yet.
+  std::vector<std::string> newNames[detail::kKinds];
+
+  auto& core = *core_;
+  {
+    std::lock_guard<std::mutex> lock(core.mutex);
+    for (size_t i = 0; i < core.names[detail::kCounters].size(); i++) {
+      int64_t total = detail::read(core.retired.counters[i]);
+      for (const auto& shard : core.shards) {
+        total += detail::read(shard->counters[i]);
+      }
+      if (total != core.lastCounters[i]) {
+        counters.push_back(i);
+        counters.push_back(total - core.lastCounters[i]);
+        core.lastCounters[i] = total;
+      }
+    }
+
+    for (size_t i = 0; i < core.names[detail::kGauges].size(); i++) {
+      const double value = core.gauges[i].load(std::memory_order_relaxed);
+      const double last = core.lastGauges[i];
+      if (!std::isnan(value) && (std::isnan(last) || value != last)) {
+        gauges.emplace_back(i, value);
+        core.lastGauges[i] = value;
+      }
+    }
+
+    for (size_t i = 0; i < core.names[detail::kHistograms].size(); i++) {
+      auto& retired = core.retired.histograms[i];
+      int64_t count = detail::read(retired.count);
+      int64_t sum = detail::read(retired.sum);
+      int64_t min = retired.min.exchange(detail::kNoMin);
+      int64_t max = retired.max.exchange(detail::kNoMax);
+      int64_t buckets[detail::kSonarHistogramBuckets];
+      for (size_t b = 0; b < detail::kSonarHistogramBuckets; b++) {
+        buckets[b] = detail::read(retired.buckets[b]);
+      }
+      for (const auto& shard : core.shards) {
+        auto& cell = shard->histograms[i];
+        count += detail::read(cell.count);
+        sum += detail::read(cell.sum);
+        min = std::min(min, cell.min.exchange(detail::kNoMin));
+        max = std::max(max, cell.max.exchange(detail::kNoMax));
+        for (size_t b = 0; b < detail::kSonarHistogramBuckets; b++) {
+          buckets[b] += detail::read(cell.buckets[b]);
+        }
+      }
+      if (count == core.lastHistogramCounts[i]) {
+        continue;
+      }
+      HistogramDelta delta{i,
+                           count - core.lastHistogramCounts[i],
+                           sum - core.lastHistogramSums[i],
+                           min,
+                           max,
+                           {}};
+      for (size_t b = 0; b < detail::kSonarHistogramBuckets; b++) {
+        if (buckets[b] != core.lastBuckets[i][b]) {
+          delta.buckets.push_back(b);
+          delta.buckets.push_back(buckets[b] - core.lastBuckets[i][b]);
+          core.lastBuckets[i][b] = buckets[b];
+        }
+      }
+      core.lastHistogramCounts[i] = count;
+      core.lastHistogramSums[i] = sum;
+      histograms.push_back(std::move(delta));
+    }
+
+    for (size_t kind = 0; kind < detail::kKinds; kind++) {
+      newNames[kind].assign(
+          core.names[kind].begin() + sentNames_[kind], core.names[kind].end());
+    }
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  if (counters.empty() && gauges.empty() && histograms.empty()) {
+    return;
+  }
+  const auto interval =
+      std::chrono::duration_cast<std::chrono::milliseconds>(now - flushedAt_);
+  flushedAt_ = now;
+
+  connection_->sendWith("metrics", [&](SonarMessageWriter& writer) {
+    writer.put("interval", static_cast<int64_t>(interval.count()));
+    // Names go out once per connection, metrics refer to them by index.
+    for (size_t kind = 0; kind < detail::kKinds; kind++) {
+      if (newNames[kind].empty()) {
+        continue;
+      }
+      writer.beginObject(kNamesKeys[kind])
+          .put("offset", sentNames_[kind])
+          .beginArray("names");
+      for (const auto& name : newNames[kind]) {
+        writer.add(name);
+      }
+      writer.endArray().endObject();
+    }
+    writer.beginArray("counters");
+    for (auto value : counters) {
+      writer.add(value);
+    }
+    writer.endArray().beginArray("gauges");
+    for (const auto& gauge : gauges) {
+      writer.add(gauge.first).add(gauge.second);
+    }
+    writer.endArray().beginArray("histograms");
+    for (const auto& histogram : histograms) {
+      writer.beginArray()
+          .add(histogram.index)
+          .add(histogram.count)
+          .add(histogram.sum)
+          .add(histogram.min)
+          .add(histogram.max)
+          .beginArray();
+      for (auto value : histogram.buckets) {
+        writer.add(value);
+      }
+      writer.endArray().endArray();
+    }
+    writer.endArray();
+  });
+  for (size_t kind = 0; kind < detail::kKinds; kind++) {
+    sentNames_[kind] += newNames[kind].size();
+  }
+}
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,180 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarPlugin.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+namespace detail {
+
+constexpr size_t kSonarMaxCounters = 256;
+constexpr size_t kSonarMaxGauges = 256;
+constexpr size_t kSonarMaxHistograms = 64;
+// Bucket i holds values below 2^i and at least 2^(i-1), the last one
+// everything above.
+constexpr size_t kSonarHistogramBuckets = 32;
+
+struct SonarHistogramCell {
+  std::atomic<int64_t> count{0};
+  std::atomic<int64_t> sum{0};
+  // Since the last flush, which resets them.
+  std::atomic<int64_t> min;
+  std::atomic<int64_t> max;
+  std::atomic<int64_t> buckets[kSonarHistogramBuckets];
+
+  SonarHistogramCell();
+};
+
+/**
+ The counts of one thread. Only that thread writes them, with plain loads
+ and stores rather than read-modify-writes, and flushes only read them, so
+ recording never contends with other threads or waits for a flush.
+ */
+struct SonarMetricsShard {
+  std::atomic<int64_t> counters[kSonarMaxCounters];
+  SonarHistogramCell histograms[kSonarMaxHistograms];
+
+  SonarMetricsShard();
+};
+
+class SonarMetricsCore;
+
+} // namespace detail
+
+/**
+ A count of events, such as cache hits, sent to the desktop as how much it
+ grew since the last flush. Cheap to copy. add() is lock free and doesn't
+ allocate other than the first time a thread records any metric.
+ */
+class SonarCounter {
+ public:
+  SonarCounter() = default;
+
+  void add(int64_t amount = 1) const;
+
+ private:
+  friend class SonarMetricsPlugin;
+  SonarCounter(std::shared_ptr<detail::SonarMetricsCore> core, size_t index)
+      : core_(std::move(core)), index_(index) {}
+
+  // Null once the plugin ran out of counters; adding does nothing then.
+  std::shared_ptr<detail::SonarMetricsCore> core_;
+  size_t index_ = 0;
+};
+
+/**
+ A value that is set rather than accumulated, such as a queue depth. Only
+ the latest value is sent, and only when it changed since the last flush.
+ */
+class SonarGauge {
+ public:
+  SonarGauge() = default;
+
+  void set(double value) const;
+
+ private:
+  friend class SonarMetricsPlugin;
+  SonarGauge(std::shared_ptr<detail::SonarMetricsCore> core, size_t index)
+      : core_(std::move(core)), index_(index) {}
+
+  std::shared_ptr<detail::SonarMetricsCore> core_;
+  size_t index_ = 0;
+};
+
+/**
+ A distribution of values, such as durations in microseconds, sent as the
+ count, sum, min, max and power of two buckets of the values recorded since
+ the last flush. Min and max may be off for values recorded while a flush
+ is resetting them.
+ */
+class SonarHistogram {
+ public:
+  SonarHistogram() = default;
+
+  void record(int64_t value) const;
+
+ private:
+  friend class SonarMetricsPlugin;
+  SonarHistogram(std::shared_ptr<detail::SonarMetricsCore> core, size_t index)
+      : core_(std::move(core)), index_(index) {}
+
+  std::shared_ptr<detail::SonarMetricsCore> core_;
+  size_t index_ = 0;
+};
+
+/**
+ Streams app defined counters, gauges and histograms to the desktop's
+ Metrics plugin. Recording goes to per-thread shards instead of through
+ SonarConnection::send, and every flushInterval the shards are added up
+ into one "metrics" message with whatever changed since the previous one.
+
+ Metrics are looked up by name once, and the handle kept:
+
+   static auto hits = metricsPlugin->counter("cache.hits");
+   hits.add();
+
+ Each kind has a fixed number of names, see detail::kSonarMax*, past which
+ the handles do nothing. Shards take about 20KB per thread that records.
+ */
+class SonarMetricsPlugin : public SonarPlugin {
+ public:
+  static constexpr const char* kIdentifier = "Metrics";
+
+  explicit SonarMetricsPlugin(
+      std::chrono::milliseconds flushInterval = std::chrono::seconds(1));
+
+  ~SonarMetricsPlugin();
+
+  SonarCounter counter(const std::string& name);
+  SonarGauge gauge(const std::string& name);
+  SonarHistogram histogram(const std::string& name);
+
+  std::string identifier() const override;
+  void didConnect(std::shared_ptr<SonarConnection> conn) override;
+  void didDisconnect() override;
+
+  /**
+   Sends what changed since the last flush, unless nothing did. Called on
+   the plugin's own thread while connected.
+   */
+  void flush();
+
+ private:
+  void stopFlushing();
+
+  const std::chrono::milliseconds flushInterval_;
+  const std::shared_ptr<detail::SonarMetricsCore> core_;
+
+  std::mutex connectionMutex_;
+  std::shared_ptr<SonarConnection> connection_;
+  // How many counter, gauge and histogram names the desktop has been sent
+  // on connection_.
+  size_t sentNames_[3] = {};
+  std::chrono::steady_clock::time_point flushedAt_;
+
+  std::thread flusher_;
+  std::mutex flusherMutex_;
+  std::condition_variable flusherWakeup_;
+  bool stopFlusher_ = false;
+};
+
+} // namespace sonar
+} // namespace facebook
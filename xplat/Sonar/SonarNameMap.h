@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/hash/SpookyHashV2.h>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ The key of a SonarNameMap. The keys stored in a map own their characters,
+ the ones it is searched with only borrow them, so that looking up a name
+ passed as a StringPiece doesn't copy it.
+ */
+class SonarNameKey {
+ public:
+  explicit SonarNameKey(std::string name)
+      : owned_(std::move(name)), name_(owned_) {}
+
+  SonarNameKey(const SonarNameKey& other) : SonarNameKey(other.name_.str()) {}
+
+  SonarNameKey(SonarNameKey&& other) noexcept
+      : owned_(std::move(other.owned_)),
+        name_(other.borrowed_ ? other.name_ : folly::StringPiece(owned_)),
+        borrowed_(other.borrowed_) {}
+
+  SonarNameKey& operator=(const SonarNameKey&) = delete;
+  SonarNameKey& operator=(SonarNameKey&&) = delete;
+
+  /**
+   A key to search with, only valid while name is.
+   */
+  static SonarNameKey borrow(folly::StringPiece name) {
+    return SonarNameKey(name, Borrowed{});
+  }
+
+  /**
+   Only for the keys stored in a map, borrowed ones are empty.
+   */
+  const std::string& str() const {
+    return owned_;
+  }
+
+  folly::StringPiece piece() const {
+    return name_;
+  }
+
+  bool operator==(const SonarNameKey& other) const {
+    return name_ == other.name_;
+  }
+
+  struct Hash {
+    size_t operator()(const SonarNameKey& key) const {
+      return static_cast<size_t>(folly::hash::SpookyHashV2::Hash64(
+          key.name_.data(), key.name_.size(), 0));
+    }
+  };
+
+ private:
+  struct Borrowed {};
+
+  SonarNameKey(folly::StringPiece name, Borrowed)
+      : name_(name), borrowed_(true) {}
+
+  std::string owned_;
+  folly::StringPiece name_;
+  bool borrowed_ = false;
+};
+
+/**
+ A hashed map from names, such as plugin identifiers or method names, that
+ can be searched by StringPiece. The unordered_map of C++14 can only be
+ searched by its key type, which is why the key is a SonarNameKey rather
+ than a std::string.
+ */
+template <typename Value>
+class SonarNameMap
+    : public std::unordered_map<SonarNameKey, Value, SonarNameKey::Hash> {
+  using Base = std::unordered_map<SonarNameKey, Value, SonarNameKey::Hash>;
+
+ public:
+  using Base::Base;
+  using Base::erase;
+
+  typename Base::iterator find(folly::StringPiece name) {
+    return Base::find(SonarNameKey::borrow(name));
+  }
+
+  typename Base::const_iterator find(folly::StringPiece name) const {
+    return Base::find(SonarNameKey::borrow(name));
+  }
+
+  size_t count(folly::StringPiece name) const {
+    return Base::count(SonarNameKey::borrow(name));
+  }
+
+  size_t erase(folly::StringPiece name) {
+    return Base::erase(SonarNameKey::borrow(name));
+  }
+
+  /**
+   Copies name only if it isn't in the map yet.
+   */
+  template <typename... Args>
+  std::pair<typename Base::iterator, bool> emplace(
+      folly::StringPiece name,
+      Args&&... args) {
+    const auto found = find(name);
+    if (found != this->end()) {
+      return {found, false};
+    }
+    return Base::emplace(
+        std::piecewise_construct,
+        std::forward_as_tuple(name.str()),
+        std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  Value& operator[](folly::StringPiece name) {
+    return emplace(name).first->second;
+  }
+};
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarNetworkBodyStore.h"
+
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <unistd.h>
+#include <iterator>
+
+namespace facebook {
+namespace sonar {
+
+SonarNetworkBodyStore::SonarNetworkBodyStore(
+    size_t memoryBytes,
+    std::string spillDirectory,
+    size_t diskBytes)
+    : memoryBytes_(memoryBytes),
+      spillDirectory_(std::move(spillDirectory)),
+      diskBytes_(spillDirectory_.empty() ? 0 : diskBytes) {}
+
+SonarNetworkBodyStore::~SonarNetworkBodyStore() {
+  clear();
+}
+
+void SonarNetworkBodyStore::put(const std::string& id, std::string body) {
+  erase(id);
+  const auto size = body.size();
+  if (size > memoryBytes_ && size > diskBytes_) {
+    return;
+  }
+  inMemory_.push_back(id);
+  entries_.emplace(
+      id, Entry{std::move(body), size, "", std::prev(inMemory_.end())});
+  memoryUsed_ += size;
+  while (memoryUsed_ > memoryBytes_) {
+    spillOldest();
+  }
+}
+
+bool SonarNetworkBodyStore::get(const std::string& id, std::string& body)
+    const {
+  const auto entry = entries_.find(id);
+  if (entry == entries_.end()) {
+    return false;
+  }
+  if (entry->second.path.empty()) {
+    body = entry->second.body;
+    return true;
+  }
+  // The file may have been deleted from under us, by a cache cleaner say.
+  return folly::readFile(entry->second.path.c_str(), body);
+}
+
+void SonarNetworkBodyStore::erase(const std::string& id) {
+  const auto entry = entries_.find(id);
+  if (entry != entries_.end()) {
+    remove(entry);
+  }
+}
+
+void SonarNetworkBodyStore::clear() {
+  while (!entries_.empty()) {
+    remove(entries_.begin());
+  }
+}
+
+void SonarNetworkBodyStore::spillOldest() {
+  const auto entry = entries_.find(inMemory_.front());
+  auto& spilling = entry->second;
+  if (spilling.size > diskBytes_) {
+    remove(entry);
+    return;
+  }
+  const auto path = folly::to<std::string>(
+      spillDirectory_, "/sonar-body-", getpid(), "-", nextFile_++);
+  if (!folly::writeFile(spilling.body, path.c_str())) {
+    ::unlink(path.c_str());
+    remove(entry);
+    return;
+  }
+  memoryUsed_ -= spilling.size;
+  diskUsed_ += spilling.size;
+  spilling.body = std::string();
+  spilling.path = path;
+  inMemory_.erase(spilling.order);
+  spilled_.push_back(entry->first);
+  spilling.order = std::prev(spilled_.end());
+
+  while (diskUsed_ > diskBytes_) {
+    remove(entries_.find(spilled_.front()));
+  }
+}
+
+void SonarNetworkBodyStore::remove(
+    std::unordered_map<std::string, Entry>::iterator entry) {
+  auto& removed = entry->second;
+  if (removed.path.empty()) {
+    memoryUsed_ -= removed.size;
+    inMemory_.erase(removed.order);
+  } else {
+    ::unlink(removed.path.c_str());
+    diskUsed_ -= removed.size;
+    spilled_.erase(removed.order);
+  }
+  entries_.erase(entry);
+}
+
+} // namespace sonar
+} // namespace facebook
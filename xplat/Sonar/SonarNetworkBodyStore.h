@@ -0,0 +1,94 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Full bodies of captured requests and responses, for the desktop to fetch
+ when one is opened, since only the first part of a body is sent along with
+ the response. Up to memoryBytes of bodies are kept in memory. Past that the
+ oldest ones spill into files in spillDirectory, up to diskBytes of them,
+ and the oldest of those are deleted in turn. Without a spillDirectory,
+ bodies that don't fit in memory are dropped, oldest first.
+
+ Not thread safe.
+ */
+class SonarNetworkBodyStore {
+ public:
+  SonarNetworkBodyStore(
+      size_t memoryBytes,
+      std::string spillDirectory = "",
+      size_t diskBytes = 0);
+
+  /**
+   Deletes the spilled files.
+   */
+  ~SonarNetworkBodyStore();
+
+  SonarNetworkBodyStore(const SonarNetworkBodyStore&) = delete;
+  SonarNetworkBodyStore& operator=(const SonarNetworkBodyStore&) = delete;
+
+  /**
+   Keeps the body under id, replacing an earlier one. A body too large for
+   both memory and disk isn't kept.
+   */
+  void put(const std::string& id, std::string body);
+
+  /**
+   Whether there is a body for id, which is then read into body.
+   */
+  bool get(const std::string& id, std::string& body) const;
+
+  void erase(const std::string& id);
+
+  void clear();
+
+  size_t memoryBytes() const {
+    return memoryUsed_;
+  }
+
+  size_t diskBytes() const {
+    return diskUsed_;
+  }
+
+ private:
+  struct Entry {
+    // Empty once spilled.
+    std::string body;
+    size_t size;
+    // Set once spilled.
+    std::string path;
+    std::list<std::string>::iterator order;
+  };
+
+  void spillOldest();
+  void remove(std::unordered_map<std::string, Entry>::iterator entry);
+
+  const size_t memoryBytes_;
+  const std::string spillDirectory_;
+  const size_t diskBytes_;
+  size_t memoryUsed_ = 0;
+  size_t diskUsed_ = 0;
+  uint64_t nextFile_ = 0;
+  std::unordered_map<std::string, Entry> entries_;
+  // Ids oldest first, of the bodies in memory and of the spilled ones.
+  std::list<std::string> inMemory_;
+  std::list<std::string> spilled_;
+};
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,722 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarNetworkCapture.h"
+
+#include <Sonar/SonarConnection.h>
+#include <Sonar/SonarResponder.h>
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+namespace facebook {
+namespace sonar {
+
+constexpr const char* SonarNetworkCapture::kIdentifier;
+constexpr size_t SonarNetworkHeaderTable::kMaxNames;
+constexpr size_t SonarNetworkCapture::kMaxSkippedRequests;
+constexpr size_t SonarNetworkCapture::kMaxPendingRequests;
+constexpr size_t SonarNetworkEndpointStats::kBucketCount;
+constexpr std::array<int64_t, SonarNetworkEndpointStats::kBucketCount - 1>
+    SonarNetworkEndpointStats::kBucketUpperBoundsMs;
+constexpr const char* SonarNetworkStats::kOtherHost;
+
+namespace {
+
+std::string nonEmptyString(const folly::dynamic& params, const char* key) {
+  const auto value = params.get_ptr(key);
+  return value && value->isString() ? value->getString() : "";
+}
+
+bool startsWithIgnoringCase(
+    folly::StringPiece value,
+    folly::StringPiece prefix) {
+  return value.size() >= prefix.size() &&
+      std::equal(
+             prefix.begin(),
+             prefix.end(),
+             value.begin(),
+             folly::AsciiCaseInsensitive());
+}
+
+bool equalsIgnoringCase(folly::StringPiece a, folly::StringPiece b) {
+  return a.size() == b.size() && startsWithIgnoringCase(a, b);
+}
+
+// The host, without user info or port, and the path, without the query or
+// fragment, of an absolute URL.
+void splitUrl(
+    folly::StringPiece url,
+    folly::StringPiece& host,
+    folly::StringPiece& path) {
+  const auto scheme = url.find("://");
+  auto rest =
+      scheme == folly::StringPiece::npos ? url : url.subpiece(scheme + 3);
+  const auto authorityEnd = rest.find_first_of("/?#");
+  auto authority = rest.subpiece(0, authorityEnd);
+  const auto at = authority.rfind('@');
+  if (at != folly::StringPiece::npos) {
+    authority.advance(at + 1);
+  }
+  if (authority.startsWith('[')) {
+    // An IPv6 address, which is full of colons.
+    host = authority.subpiece(0, authority.find(']') + 1);
+  } else {
+    host = authority.subpiece(0, authority.find(':'));
+  }
+  if (authorityEnd == folly::StringPiece::npos || rest[authorityEnd] != '/') {
+    path = folly::StringPiece();
+    return;
+  }
+  path = rest.subpiece(authorityEnd);
+  path = path.subpiece(0, path.find_first_of("?#"));
+}
+
+// Ids, rather than part of the route: all digits, or long enough runs of
+// hex digits and dashes to be hashes or UUIDs.
+bool isIdSegment(folly::StringPiece segment) {
+  if (segment.empty()) {
+    return false;
+  }
+  bool digits = true;
+  bool hex = true;
+  for (const char c : segment) {
+    digits = digits && c >= '0' && c <= '9';
+    hex = hex && (isxdigit(static_cast<unsigned char>(c)) || c == '-');
+  }
+  return digits || (hex && segment.size() >= 16);
+}
+
+// The body's size, or what Content-Length says for adapters that don't
+// collect bodies.
+uint64_t bodyBytes(
+    const std::vector<SonarNetworkHeader>& headers,
+    const std::string& body) {
+  if (!body.empty()) {
+    return body.size();
+  }
+  for (const auto& header : headers) {
+    if (equalsIgnoringCase(header.name, "content-length")) {
+      const auto length =
+          folly::tryTo<uint64_t>(folly::trimWhitespace(header.value));
+      return length.hasValue() ? length.value() : 0;
+    }
+  }
+  return 0;
+}
+
+constexpr char kBase64Alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void appendBase64(folly::StringPiece data, std::string& out) {
+  out.reserve(out.size() + (data.size() + 2) / 3 * 4);
+  const auto bytes = reinterpret_cast<const uint8_t*>(data.data());
+  size_t i = 0;
+  for (; i + 2 < data.size(); i += 3) {
+    const uint32_t triple =
+        (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+    out.push_back(kBase64Alphabet[(triple >> 18) & 0x3f]);
+    out.push_back(kBase64Alphabet[(triple >> 12) & 0x3f]);
+    out.push_back(kBase64Alphabet[(triple >> 6) & 0x3f]);
+    out.push_back(kBase64Alphabet[triple & 0x3f]);
+  }
+  const auto left = data.size() - i;
+  if (left > 0) {
+    const uint32_t triple =
+        (bytes[i] << 16) | (left == 2 ? bytes[i + 1] << 8 : 0);
+    out.push_back(kBase64Alphabet[(triple >> 18) & 0x3f]);
+    out.push_back(kBase64Alphabet[(triple >> 12) & 0x3f]);
+    out.push_back(left == 2 ? kBase64Alphabet[(triple >> 6) & 0x3f] : '=');
+    out.push_back('=');
+  }
+}
+
+// Writes up to limit bytes of the body as data, in base64, and whether and
+// by how much it was truncated. Returns whether it was.
+bool writeData(
+    SonarMessageWriter& writer,
+    folly::StringPiece body,
+    size_t limit,
+    std::string& scratch) {
+  if (body.empty()) {
+    writer.putNull("data");
+    return false;
+  }
+  const bool truncated = body.size() > limit;
+  if (truncated) {
+    writer.put("dataTruncated", true).put("dataLength", body.size());
+  }
+  scratch.clear();
+  appendBase64(body.subpiece(0, limit), scratch);
+  writer.put("data", scratch);
+  return truncated;
+}
+
+} // namespace
+
+SonarNetworkCaptureFilter::SonarNetworkCaptureFilter(
+    const folly::dynamic& params) {
+  if (!params.isObject()) {
+    return;
+  }
+  host_ = nonEmptyString(params, "host");
+  folly::toLowerAscii(host_);
+  if (!host_.empty()) {
+    hostSuffix_ = "." + host_;
+  }
+  pathPrefix_ = nonEmptyString(params, "pathPrefix");
+  if (const auto methods = params.get_ptr("methods")) {
+    if (methods->isArray()) {
+      for (const auto& method : *methods) {
+        if (method.isString()) {
+          methods_.push_back(method.getString());
+        }
+      }
+    }
+  }
+  if (const auto minStatus = params.get_ptr("minStatus")) {
+    if (minStatus->isNumber()) {
+      minStatus_ = static_cast<int>(minStatus->asInt());
+    }
+  }
+  if (const auto maxStatus = params.get_ptr("maxStatus")) {
+    if (maxStatus->isNumber()) {
+      maxStatus_ = static_cast<int>(maxStatus->asInt());
+    }
+  }
+  contentType_ = nonEmptyString(params, "contentType");
+  if (const auto maxBodyBytes = params.get_ptr("maxBodyBytes")) {
+    if (maxBodyBytes->isNumber()) {
+      maxBodyBytes_ =
+          static_cast<size_t>(std::max<int64_t>(0, maxBodyBytes->asInt()));
+    }
+  }
+}
+
+bool SonarNetworkCaptureFilter::acceptsRequest(
+    folly::StringPiece method,
+    folly::StringPiece url) const {
+  if (!methods_.empty()) {
+    const auto requestMethod = method.empty() ? "GET" : method;
+    const auto found = std::any_of(
+        methods_.begin(), methods_.end(), [&](const std::string& accepted) {
+          return equalsIgnoringCase(accepted, requestMethod);
+        });
+    if (!found) {
+      return false;
+    }
+  }
+  if (host_.empty() && pathPrefix_.empty()) {
+    return true;
+  }
+  folly::StringPiece host, path;
+  splitUrl(url, host, path);
+  if (!host_.empty() && !equalsIgnoringCase(host, host_) &&
+      !(host.size() > hostSuffix_.size() &&
+        equalsIgnoringCase(
+            host.subpiece(host.size() - hostSuffix_.size()), hostSuffix_))) {
+    return false;
+  }
+  return pathPrefix_.empty() || path.startsWith(pathPrefix_);
+}
+
+bool SonarNetworkCaptureFilter::acceptsResponse(
+    int status,
+    folly::StringPiece contentType) const {
+  if (status < minStatus_ || status > maxStatus_) {
+    return false;
+  }
+  return contentType_.empty() ||
+      startsWithIgnoringCase(contentType, contentType_);
+}
+
+void SonarNetworkHeaderTable::write(
+    SonarNetworkHeaderTable* table,
+    const std::vector<SonarNetworkHeader>& headers,
+    SonarMessageWriter& writer) {
+  const size_t offset = table ? table->names_.size() : 0;
+  size_t added = 0;
+  writer.beginArray("compactHeaders");
+  for (const auto& header : headers) {
+    if (!table) {
+      writer.add(header.name);
+    } else {
+      const auto known = table->names_.find(header.name);
+      if (known != table->names_.end()) {
+        writer.add(known->second);
+      } else if (table->names_.size() < kMaxNames) {
+        const auto index = table->names_.size();
+        table->names_.emplace(header.name, index);
+        writer.add(index);
+        added++;
+      } else {
+        writer.add(header.name);
+      }
+    }
+    writer.add(header.value);
+  }
+  writer.endArray();
+  if (added == 0) {
+    return;
+  }
+  // In the order they were given indices, each only once.
+  writer.beginArray("newHeaderNames");
+  auto next = offset;
+  for (const auto& header : headers) {
+    const auto known = table->names_.find(header.name);
+    if (known != table->names_.end() && known->second == next) {
+      writer.add(header.name);
+      next++;
+    }
+  }
+  writer.endArray();
+  writer.put("newHeaderNamesOffset", offset);
+}
+
+void SonarNetworkEndpointStats::recordLatency(int64_t ms) {
+  ms = std::max<int64_t>(0, ms);
+  size_t bucket = 0;
+  while (bucket < kBucketUpperBoundsMs.size() &&
+         ms >= kBucketUpperBoundsMs[bucket]) {
+    bucket++;
+  }
+  latencyBuckets[bucket]++;
+  latencies++;
+  maxLatencyMs = std::max(maxLatencyMs, ms);
+}
+
+int64_t SonarNetworkEndpointStats::latencyPercentile(double fraction) const {
+  if (latencies == 0) {
+    return 0;
+  }
+  const auto rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(fraction * latencies)));
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < kBucketUpperBoundsMs.size(); bucket++) {
+    seen += latencyBuckets[bucket];
+    if (seen >= rank) {
+      return std::min(kBucketUpperBoundsMs[bucket], maxLatencyMs);
+    }
+  }
+  return maxLatencyMs;
+}
+
+void SonarNetworkEndpointStats::write(SonarMessageWriter& writer) const {
+  writer.put("requests", requests)
+      .put("responses", responses)
+      .put("errors", errors)
+      .put("failures", failures)
+      .put("reusedConnections", reusedConnections)
+      .put("bytesSent", bytesSent)
+      .put("bytesReceived", bytesReceived);
+  writer.beginObject("latencyMs")
+      .put("p50", latencyPercentile(0.5))
+      .put("p90", latencyPercentile(0.9))
+      .put("p99", latencyPercentile(0.99))
+      .put("max", maxLatencyMs)
+      .endObject();
+  writer.beginArray("latencyBuckets");
+  for (const auto count : latencyBuckets) {
+    writer.add(count);
+  }
+  writer.endArray();
+}
+
+SonarNetworkStats::SonarNetworkStats(size_t maxEndpoints, size_t maxPending)
+    : maxEndpoints_(maxEndpoints), maxPending_(maxPending) {}
+
+std::string SonarNetworkStats::pathTemplate(folly::StringPiece path) {
+  std::string out;
+  out.reserve(path.size());
+  size_t start = 0;
+  while (true) {
+    const auto end = path.find('/', start);
+    const auto segment = path.subpiece(
+        start,
+        end == folly::StringPiece::npos ? folly::StringPiece::npos
+                                        : end - start);
+    if (isIdSegment(segment)) {
+      out.append("{id}");
+    } else {
+      out.append(segment.begin(), segment.end());
+    }
+    if (end == folly::StringPiece::npos) {
+      break;
+    }
+    out.push_back('/');
+    start = end + 1;
+  }
+  return out.empty() ? "/" : out;
+}
+
+SonarNetworkEndpointStats& SonarNetworkStats::stats(const Endpoint& endpoint) {
+  const auto entry = endpoints_.find(endpoint);
+  if (entry != endpoints_.end()) {
+    return entry->second;
+  }
+  if (endpoints_.size() >= maxEndpoints_) {
+    return endpoints_[Endpoint(kOtherHost, "")];
+  }
+  return endpoints_[endpoint];
+}
+
+void SonarNetworkStats::recordRequest(const SonarNetworkRequest& request) {
+  folly::StringPiece host, path;
+  splitUrl(request.url, host, path);
+  Endpoint endpoint(host.str(), pathTemplate(path));
+  folly::toLowerAscii(endpoint.first);
+  auto& stats = this->stats(endpoint);
+  stats.requests++;
+  stats.bytesSent += request.body.size();
+  // Past the limit, responses count as unmatched rather than growing the
+  // table for requests that never complete.
+  if (pending_.size() < maxPending_) {
+    pending_[request.id] = Pending{std::move(endpoint), request.timestamp};
+  }
+}
+
+void SonarNetworkStats::recordResponse(const SonarNetworkResponse& response) {
+  const auto pending = pending_.find(response.id);
+  if (pending == pending_.end()) {
+    unmatched_++;
+    return;
+  }
+  auto& stats = this->stats(pending->second.endpoint);
+  stats.responses++;
+  if (response.status == 0) {
+    stats.failures++;
+  } else if (response.status >= 400) {
+    stats.errors++;
+  }
+  if (response.reusedConnection) {
+    stats.reusedConnections++;
+  }
+  stats.bytesReceived += bodyBytes(response.headers, response.body);
+  stats.recordLatency(response.timestamp - pending->second.timestamp);
+  pending_.erase(pending);
+}
+
+void SonarNetworkStats::writeSummary(SonarMessageWriter& writer) {
+  writer.beginArray("bucketUpperBoundsMs");
+  for (const auto bound : SonarNetworkEndpointStats::kBucketUpperBoundsMs) {
+    writer.add(bound);
+  }
+  writer.endArray();
+  writer.beginArray("endpoints");
+  for (const auto& entry : endpoints_) {
+    writer.beginObject()
+        .put("host", entry.first.first)
+        .put("path", entry.first.second);
+    entry.second.write(writer);
+    writer.endObject();
+  }
+  writer.endArray();
+  writer.put("unmatched", unmatched_);
+  endpoints_.clear();
+  unmatched_ = 0;
+}
+
+void SonarNetworkStats::clear() {
+  endpoints_.clear();
+  pending_.clear();
+  unmatched_ = 0;
+}
+
+SonarNetworkCapture::SonarNetworkCapture(SonarNetworkCaptureConfig config)
+    : config_(std::move(config)),
+      buffered_(
+          config_.bufferFile.empty()
+              ? nullptr
+              : SonarEventRing::mapped(
+                    config_.bufferFile,
+                    config_.bufferedEvents,
+                    config_.bufferedBytes)),
+      bodies_(
+          config_.bodyMemoryBytes,
+          config_.bodySpillDirectory,
+          config_.bodyDiskBytes),
+      skippedOrder_(kMaxSkippedRequests),
+      aggregating_(config_.aggregate),
+      summaryInterval_(config_.summaryIntervalMs),
+      summaryStarted_(std::chrono::steady_clock::now()),
+      stats_(config_.summaryEndpoints, kMaxPendingRequests) {
+  if (!buffered_) {
+    buffered_ = std::make_unique<SonarEventRing>(
+        config_.bufferedEvents, config_.bufferedBytes);
+  }
+}
+
+std::string SonarNetworkCapture::identifier() const {
+  return kIdentifier;
+}
+
+template <typename Write>
+void SonarNetworkCapture::send(const char* method, Write&& write) {
+  params_.clear();
+  SonarMessageWriter writer(params_);
+  write(writer, connection_ ? &headerNames_ : nullptr);
+  writer.end();
+  if (connection_) {
+    connection_->sendJson(method, params_);
+  } else {
+    buffered_->push(method, params_);
+  }
+}
+
+bool SonarNetworkCapture::acceptsRequest(
+    folly::StringPiece method,
+    folly::StringPiece url) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return filter_.acceptsRequest(method, url);
+}
+
+size_t SonarNetworkCapture::maxBodyBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Bodies past the inline limit are still kept for getResponseBody.
+  const auto kept = std::max(
+      config_.inlineBodyBytes,
+      std::max(config_.bodyMemoryBytes, config_.bodyDiskBytes));
+  return std::min(filter_.maxBodyBytes(), kept);
+}
+
+void SonarNetworkCapture::setFilter(const folly::dynamic& params) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  filter_ = SonarNetworkCaptureFilter(params);
+}
+
+void SonarNetworkCapture::reportRequest(const SonarNetworkRequest& request) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!filter_.acceptsRequest(request.method, request.url)) {
+    // A ring of the most recent ones, in case responses never come.
+    auto& oldest = skippedOrder_[nextSkipped_];
+    skipped_.erase(oldest);
+    oldest = request.id;
+    skipped_.insert(request.id);
+    nextSkipped_ = (nextSkipped_ + 1) % kMaxSkippedRequests;
+    return;
+  }
+  if (aggregating_) {
+    stats_.recordRequest(request);
+    maybeSendSummary();
+    return;
+  }
+  const bool withBody = request.body.size() <= filter_.maxBodyBytes();
+  std::string scratch;
+  send(
+      "newRequest",
+      [&](SonarMessageWriter& writer, SonarNetworkHeaderTable* table) {
+        writer.put("id", request.id).put("timestamp", request.timestamp);
+        writer.put("method", request.method).put("url", request.url);
+        SonarNetworkHeaderTable::write(table, request.headers, writer);
+        writeData(
+            writer,
+            withBody ? folly::StringPiece(request.body) : folly::StringPiece(),
+            config_.inlineBodyBytes,
+            scratch);
+      });
+}
+
+void SonarNetworkCapture::reportResponse(SonarNetworkResponse response) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (skipped_.erase(response.id)) {
+    return;
+  }
+  if (aggregating_) {
+    // Every status counts, the error rates are what summaries are for.
+    stats_.recordResponse(response);
+    maybeSendSummary();
+    return;
+  }
+  folly::StringPiece contentType;
+  for (const auto& header : response.headers) {
+    if (equalsIgnoringCase(header.name, "content-type")) {
+      contentType = header.value;
+      break;
+    }
+  }
+  if (!filter_.acceptsResponse(response.status, contentType)) {
+    // The request was sent already, the desktop drops it.
+    sendDropRequest(response.id);
+    return;
+  }
+
+  const bool withBody = response.body.size() <= filter_.maxBodyBytes();
+  bool truncated = false;
+  std::string scratch;
+  send(
+      "newResponse",
+      [&](SonarMessageWriter& writer, SonarNetworkHeaderTable* table) {
+        writer.put("id", response.id).put("timestamp", response.timestamp);
+        writer.put("status", response.status).put("reason", response.reason);
+        if (response.formattable) {
+          writer.put("formattable", true);
+        }
+        SonarNetworkHeaderTable::write(table, response.headers, writer);
+        truncated = writeData(
+            writer,
+            withBody ? folly::StringPiece(response.body) : folly::StringPiece(),
+            config_.inlineBodyBytes,
+            scratch);
+      });
+  if (truncated) {
+    // The desktop fetches the rest with getResponseBody.
+    bodies_.put(response.id, std::move(response.body));
+  }
+}
+
+void SonarNetworkCapture::reportDropped(const std::string& id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Aggregated requests were never sent, so there's nothing to drop.
+  if (!aggregating_) {
+    sendDropRequest(id);
+  }
+}
+
+void SonarNetworkCapture::sendDropRequest(const std::string& id) {
+  send(
+      "dropRequest", [&](SonarMessageWriter& writer, SonarNetworkHeaderTable*) {
+        writer.put("id", id);
+      });
+}
+
+void SonarNetworkCapture::didConnect(std::shared_ptr<SonarConnection> conn) {
+  conn->receive(
+      "getResponseBody",
+      [this](
+          const folly::dynamic& params,
+          std::unique_ptr<SonarResponder> responder) {
+        onGetResponseBody(params, std::move(responder));
+      });
+  conn->receive(
+      "setFilter",
+      [this](
+          const folly::dynamic& params,
+          std::unique_ptr<SonarResponder> responder) {
+        setFilter(params);
+        responder->success(folly::dynamic::object());
+      });
+  conn->receive(
+      "setAggregation",
+      [this](
+          const folly::dynamic& params,
+          std::unique_ptr<SonarResponder> responder) {
+        onSetAggregation(params);
+        responder->success(folly::dynamic::object());
+      });
+  conn->receive(
+      "getSummary",
+      [this](
+          const folly::dynamic& params,
+          std::unique_ptr<SonarResponder> responder) {
+        std::string summary;
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          SonarMessageWriter writer(summary);
+          writeSummary(writer);
+          writer.end();
+        }
+        responder->successJson(std::move(summary));
+      });
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Buffered events were written without the header table, which starts
+  // over for every connection.
+  buffered_->drain(
+      [&conn](folly::StringPiece method, folly::StringPiece params) {
+        conn->sendJson(method, params.str());
+      });
+  headerNames_.clear();
+  connection_ = std::move(conn);
+}
+
+void SonarNetworkCapture::didDisconnect() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  connection_ = nullptr;
+  // Everything is captured again while no desktop is around to say
+  // otherwise.
+  filter_ = SonarNetworkCaptureFilter();
+  bodies_.clear();
+}
+
+void SonarNetworkCapture::onSetAggregation(const folly::dynamic& params) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool enabled = true;
+  if (params.isObject()) {
+    if (const auto enable = params.get_ptr("enabled")) {
+      enabled = enable->isBool() && enable->getBool();
+    }
+    if (const auto interval = params.get_ptr("intervalMs")) {
+      if (interval->isNumber()) {
+        summaryInterval_ =
+            std::chrono::milliseconds(std::max<int64_t>(0, interval->asInt()));
+      }
+    }
+  }
+  if (enabled == aggregating_) {
+    return;
+  }
+  if (aggregating_ && !stats_.empty()) {
+    // What was counted since the last summary.
+    sendSummary();
+  }
+  aggregating_ = enabled;
+  stats_.clear();
+  summaryStarted_ = std::chrono::steady_clock::now();
+}
+
+void SonarNetworkCapture::writeSummary(SonarMessageWriter& writer) {
+  const auto now = std::chrono::steady_clock::now();
+  writer.put(
+      "intervalMs",
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          now - summaryStarted_)
+          .count());
+  stats_.writeSummary(writer);
+  summaryStarted_ = now;
+}
+
+void SonarNetworkCapture::sendSummary() {
+  send(
+      "networkSummary",
+      [this](SonarMessageWriter& writer, SonarNetworkHeaderTable*) {
+        writeSummary(writer);
+      });
+}
+
+void SonarNetworkCapture::maybeSendSummary() {
+  if (summaryInterval_.count() > 0 && !stats_.empty() &&
+      std::chrono::steady_clock::now() - summaryStarted_ >= summaryInterval_) {
+    sendSummary();
+  }
+}
+
+void SonarNetworkCapture::onGetResponseBody(
+    const folly::dynamic& params,
+    std::unique_ptr<SonarResponder> responder) {
+  const auto id = params.get_ptr("id");
+  std::string body;
+  bool found = false;
+  if (id && (id->isString() || id->isNumber())) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    found = bodies_.get(id->asString(), body);
+  }
+  if (!found) {
+    responder->error(
+        folly::dynamic::object("error", "response body is not available"));
+    return;
+  }
+  std::string data;
+  appendBase64(body, data);
+  responder->success(
+      folly::dynamic::object("id", *id)("data", std::move(data)));
+}
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,346 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarEventRing.h>
+#include <Sonar/SonarMessageWriter.h>
+#include <Sonar/SonarNetworkBodyStore.h>
+#include <Sonar/SonarPlugin.h>
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+struct SonarNetworkHeader {
+  std::string name;
+  std::string value;
+};
+
+/**
+ A request as the platform's adapter saw it. The id pairs it with its
+ response.
+ */
+struct SonarNetworkRequest {
+  std::string id;
+  int64_t timestamp = 0;
+  std::string method;
+  std::string url;
+  std::vector<SonarNetworkHeader> headers;
+  std::string body;
+};
+
+struct SonarNetworkResponse {
+  std::string id;
+  int64_t timestamp = 0;
+  // 0 for a request that failed before there was a response.
+  int status = 0;
+  std::string reason;
+  std::vector<SonarNetworkHeader> headers;
+  std::string body;
+  // Whether the request went over a connection that was already open, for
+  // adapters that can tell, such as from NSURLSessionTaskTransactionMetrics.
+  bool reusedConnection = false;
+  // Whether the platform can format the body for the desktop, which then
+  // asks for it with formatResponse, as Android's formatters do.
+  bool formattable = false;
+};
+
+/**
+ Which requests the desktop wants to see, as pushed with setFilter. Every
+ key of the params is optional, and an empty filter captures everything:
+ host (which also matches its subdomains), pathPrefix, methods, minStatus,
+ maxStatus, contentType (a prefix) and maxBodyBytes.
+ */
+class SonarNetworkCaptureFilter {
+ public:
+  SonarNetworkCaptureFilter() = default;
+
+  explicit SonarNetworkCaptureFilter(const folly::dynamic& params);
+
+  bool acceptsRequest(folly::StringPiece method, folly::StringPiece url) const;
+
+  /**
+   Only needs what is known before the body arrives.
+   */
+  bool acceptsResponse(int status, folly::StringPiece contentType) const;
+
+  /**
+   Bodies longer than this are reported without their data.
+   */
+  size_t maxBodyBytes() const {
+    return maxBodyBytes_;
+  }
+
+ private:
+  std::string host_;
+  // "." and the host, which subdomains end in.
+  std::string hostSuffix_;
+  std::string pathPrefix_;
+  // Upper cased.
+  std::vector<std::string> methods_;
+  int minStatus_ = 0;
+  int maxStatus_ = std::numeric_limits<int>::max();
+  std::string contentType_;
+  size_t maxBodyBytes_ = std::numeric_limits<size_t>::max();
+};
+
+/**
+ Header names sent before on the same connection are replaced by their
+ index in a table the desktop keeps for the connection. Names new to the
+ table are sent along, in newHeaderNames, starting at index
+ newHeaderNamesOffset. Not thread safe.
+ */
+class SonarNetworkHeaderTable {
+ public:
+  // So that requests with made up header names can't grow the table
+  // forever. Names past it are sent as they are.
+  static constexpr size_t kMaxNames = 1024;
+
+  /**
+   Writes headers as compactHeaders, a flat [name, value, ...] array, and
+   the names that the table doesn't have yet. Without a table, every name
+   is written as it is, as for events buffered for a later connection.
+   */
+  static void write(
+      SonarNetworkHeaderTable* table,
+      const std::vector<SonarNetworkHeader>& headers,
+      SonarMessageWriter& writer);
+
+  void clear() {
+    names_.clear();
+  }
+
+ private:
+  std::unordered_map<std::string, size_t> names_;
+};
+
+/**
+ What the requests to one endpoint added up to over a summary interval.
+ */
+struct SonarNetworkEndpointStats {
+  static constexpr size_t kBucketCount = 12;
+  static constexpr std::array<int64_t, kBucketCount - 1> kBucketUpperBoundsMs{
+      {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000}};
+
+  void recordLatency(int64_t ms);
+
+  /**
+   Upper bound of the bucket that the given fraction of latencies is in,
+   or the slowest latency if that is the last bucket. 0 without latencies.
+   */
+  int64_t latencyPercentile(double fraction) const;
+
+  void write(SonarMessageWriter& writer) const;
+
+  uint64_t requests = 0;
+  uint64_t responses = 0;
+  // Responses with a 4xx or 5xx status.
+  uint64_t errors = 0;
+  // Requests that failed before there was a response.
+  uint64_t failures = 0;
+  uint64_t reusedConnections = 0;
+  uint64_t bytesSent = 0;
+  uint64_t bytesReceived = 0;
+  std::array<uint32_t, kBucketCount> latencyBuckets{};
+  uint64_t latencies = 0;
+  int64_t maxLatencyMs = 0;
+};
+
+/**
+ Streaming statistics of requests, keyed by host and path template, for the
+ Network plugin's aggregation mode. The template is the path with segments
+ that look like ids, all digits or long runs of hex digits, replaced by
+ {id}, so that /users/42 and /users/43 count together. Not thread safe.
+ */
+class SonarNetworkStats {
+ public:
+  // Where endpoints past maxEndpoints are counted.
+  static constexpr const char* kOtherHost = "<other>";
+
+  SonarNetworkStats(size_t maxEndpoints, size_t maxPending);
+
+  static std::string pathTemplate(folly::StringPiece path);
+
+  void recordRequest(const SonarNetworkRequest& request);
+
+  void recordResponse(const SonarNetworkResponse& response);
+
+  bool empty() const {
+    return endpoints_.empty() && unmatched_ == 0;
+  }
+
+  /**
+   Writes bucketUpperBoundsMs, endpoints, one object per endpoint with its
+   host, path and counters, and unmatched, the responses to requests that
+   weren't seen, then starts over. Requests still waiting for their
+   response are remembered, their responses count towards the next
+   summary.
+   */
+  void writeSummary(SonarMessageWriter& writer);
+
+  void clear();
+
+ private:
+  using Endpoint = std::pair<std::string, std::string>;
+
+  struct Pending {
+    Endpoint endpoint;
+    int64_t timestamp;
+  };
+
+  SonarNetworkEndpointStats& stats(const Endpoint& endpoint);
+
+  const size_t maxEndpoints_;
+  const size_t maxPending_;
+  std::map<Endpoint, SonarNetworkEndpointStats> endpoints_;
+  std::unordered_map<std::string, Pending> pending_;
+  uint64_t unmatched_ = 0;
+};
+
+struct SonarNetworkCaptureConfig {
+  // The part of a body sent along with its request or response. All of it
+  // is kept in the body store, for getResponseBody.
+  size_t inlineBodyBytes = 64 * 1024;
+  // Events kept while no desktop is connected.
+  size_t bufferedEvents = 500;
+  size_t bufferedBytes = 16 * 1024 * 1024;
+  // A file to buffer events in, mapped into memory, so that requests made
+  // before the desktop connects, such as the ones from app startup, outlast
+  // the app restarting. Events are buffered in memory without one, or if
+  // it can't be mapped.
+  std::string bufferFile;
+  // Full response bodies kept for getResponseBody.
+  size_t bodyMemoryBytes = 8 * 1024 * 1024;
+  // Where response bodies spill to once they don't fit in memory, such as
+  // a directory in the app's cache. Without one they are dropped.
+  std::string bodySpillDirectory;
+  size_t bodyDiskBytes = 64 * 1024 * 1024;
+  // Start out sending summaries rather than every request, see
+  // SonarNetworkCapture.
+  bool aggregate = false;
+  // How often summaries are sent, 0 for only when the desktop asks.
+  int64_t summaryIntervalMs = 10000;
+  size_t summaryEndpoints = 256;
+};
+
+/**
+ The platform independent part of the Network plugin: filtering, buffering
+ while disconnected, keeping bodies for the desktop to fetch and encoding
+ requests and responses into messages. The platform's adapter, around
+ NSURLSession or an OkHttp interceptor, reports what it sees from any
+ thread, and can ask acceptsRequest first to skip copying headers and
+ bodies of requests the desktop isn't interested in.
+
+ Sends newRequest, newResponse and dropRequest, for a request that was
+ reported before its response was filtered out, and receives
+ getResponseBody and setFilter.
+
+ In aggregation mode, switched with setAggregation {enabled, intervalMs},
+ requests that pass the filter's request criteria are only counted in a
+ SonarNetworkStats, and a networkSummary is sent with the first report
+ after each interval, so an app that is idle sends nothing. getSummary
+ responds with the summary so far and starts the next interval. The mode
+ outlasts the desktop disconnecting, so a soak test can run unattended
+ while its summaries are buffered.
+ */
+class SonarNetworkCapture : public SonarPlugin {
+ public:
+  static constexpr const char* kIdentifier = "Network";
+
+  explicit SonarNetworkCapture(
+      SonarNetworkCaptureConfig config = SonarNetworkCaptureConfig());
+
+  bool acceptsRequest(folly::StringPiece method, folly::StringPiece url) const;
+
+  /**
+   The most of a body that is worth collecting, for adapters that copy
+   bodies as they stream by.
+   */
+  size_t maxBodyBytes() const;
+
+  /**
+   Replaces the filter, as setFilter does, for adapters that also receive
+   setFilter themselves to check requests before collecting them.
+   */
+  void setFilter(const folly::dynamic& params);
+
+  void reportRequest(const SonarNetworkRequest& request);
+
+  void reportResponse(SonarNetworkResponse response);
+
+  /**
+   For adapters that check responses against the filter themselves, so
+   that the desktop drops the request of a response that was left out.
+   */
+  void reportDropped(const std::string& id);
+
+  std::string identifier() const override;
+  void didConnect(std::shared_ptr<SonarConnection> conn) override;
+  void didDisconnect() override;
+
+ private:
+  // Requests left out by the filter whose responses haven't come yet,
+  // whose responses are left out too.
+  static constexpr size_t kMaxSkippedRequests = 256;
+  // Requests waiting for their response in aggregation mode.
+  static constexpr size_t kMaxPendingRequests = 1024;
+
+  template <typename Write>
+  void send(const char* method, Write&& write);
+
+  void onGetResponseBody(
+      const folly::dynamic& params,
+      std::unique_ptr<SonarResponder> responder);
+
+  void onSetAggregation(const folly::dynamic& params);
+
+  // Called with mutex_ held.
+  void sendDropRequest(const std::string& id);
+
+  // Called with mutex_ held, like the two below.
+  void writeSummary(SonarMessageWriter& writer);
+  void sendSummary();
+  void maybeSendSummary();
+
+  const SonarNetworkCaptureConfig config_;
+
+  mutable std::mutex mutex_;
+  // All guarded by mutex_.
+  std::shared_ptr<SonarConnection> connection_;
+  SonarNetworkCaptureFilter filter_;
+  SonarNetworkHeaderTable headerNames_;
+  std::unique_ptr<SonarEventRing> buffered_;
+  SonarNetworkBodyStore bodies_;
+  std::unordered_set<std::string> skipped_;
+  std::vector<std::string> skippedOrder_;
+  size_t nextSkipped_ = 0;
+  bool aggregating_;
+  std::chrono::milliseconds summaryInterval_;
+  std::chrono::steady_clock::time_point summaryStarted_;
+  SonarNetworkStats stats_;
+  // Reused for serializing messages.
+  std::string params_;
+};
+
+} // namespace sonar
+} // namespace facebook
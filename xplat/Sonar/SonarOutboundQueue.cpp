@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarOutboundQueue.h"
+#include <folly/io/Cursor.h>
+#include <algorithm>
+
+namespace facebook {
+namespace sonar {
+
+SonarOutboundQueue::~SonarOutboundQueue() {
+  Node* node = head_.exchange(nullptr);
+  while (node) {
+    Node* next = node->next;
+    delete node;
+    node = next;
+  }
+}
+
+bool SonarOutboundQueue::push(SonarOutboundMessage message) {
+  Node* node = new Node{std::move(message), nullptr};
+  depth_.fetch_add(1, std::memory_order_relaxed);
+  Node* head = head_.load(std::memory_order_relaxed);
+  do {
+    node->next = head;
+  } while (!head_.compare_exchange_weak(
+      head, node, std::memory_order_release, std::memory_order_relaxed));
+  return head == nullptr;
+}
+
+std::vector<SonarOutboundMessage> SonarOutboundQueue::drain() {
+  Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+  std::vector<SonarOutboundMessage> messages;
+  while (node) {
+    Node* next = node->next;
+    messages.push_back(std::move(node->message));
+    delete node;
+    node = next;
+  }
+  // The list is built newest first.
+  std::reverse(messages.begin(), messages.end());
+  depth_.fetch_sub(messages.size(), std::memory_order_relaxed);
+  return messages;
+}
+
+uint64_t SonarLatestMessages::mark(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint64_t generation = nextGeneration_++;
+  latest_[key] = generation;
+  return generation;
+}
+
+bool SonarLatestMessages::isLatest(
+    const std::string& key,
+    uint64_t generation) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Once the newest message was sent, any older one left is superseded too.
+  const auto latest = latest_.find(key);
+  return latest != latest_.end() && latest->second == generation;
+}
+
+bool SonarLatestMessages::take(const std::string& key, uint64_t generation) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto latest = latest_.find(key);
+  if (latest == latest_.end() || latest->second != generation) {
+    return false;
+  }
+  latest_.erase(latest);
+  return true;
+}
+
+namespace {
+
+size_t bodySize(const SonarOutboundMessage& message) {
+  return message.data ? message.data->computeChainDataLength()
+                      : message.payload.size();
+}
+
+} // namespace
+
+void SonarOutboundLanes::push(SonarOutboundMessage message, bool fragment) {
+  const bool fragmented =
+      fragment && exceedsFragmentSize(bodySize(message));
+  auto& lane = lanes_[static_cast<size_t>(message.priority)];
+  lane.push_back(Entry{std::move(message), fragmented});
+}
+
+bool SonarOutboundLanes::empty() const {
+  for (const auto& lane : lanes_) {
+    if (!lane.empty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+SonarOutboundLanes::Entry* SonarOutboundLanes::next() {
+  for (auto& lane : lanes_) {
+    if (!lane.empty()) {
+      return &lane.front();
+    }
+  }
+  return nullptr;
+}
+
+void SonarOutboundLanes::pop(const Entry& entry) {
+  for (auto& lane : lanes_) {
+    if (!lane.empty() && &lane.front() == &entry) {
+      lane.pop_front();
+      return;
+    }
+  }
+}
+
+std::unique_ptr<folly::IOBuf> SonarOutboundLanes::nextFragment(
+    Entry& entry,
+    SonarOutboundFragment& fragment) {
+  if (!entry.body) {
+    if (entry.message.data) {
+      // payload stays behind as the envelope.
+      entry.body = std::move(entry.message.data);
+    } else {
+      entry.body = folly::IOBuf::copyBuffer(entry.message.payload);
+      entry.message.payload.clear();
+    }
+    entry.bodySize = entry.body->computeChainDataLength();
+    entry.id = nextFragmentId_++;
+  }
+  const size_t size = std::min(fragmentBytes_, entry.bodySize - entry.offset);
+  folly::io::Cursor cursor(entry.body.get());
+  cursor.skip(entry.offset);
+  std::unique_ptr<folly::IOBuf> data;
+  cursor.clone(data, size);
+
+  fragment.id = entry.id;
+  fragment.index = entry.index;
+  fragment.count = (entry.bodySize + fragmentBytes_ - 1) / fragmentBytes_;
+  fragment.envelope = entry.index == 0 && !entry.message.payload.empty()
+      ? &entry.message.payload
+      : nullptr;
+  entry.offset += size;
+  entry.index++;
+  return data;
+}
+
+size_t SonarOutboundLanes::clear() {
+  size_t bytes = 0;
+  for (auto& lane : lanes_) {
+    for (const auto& entry : lane) {
+      if (entry.body) {
+        bytes += entry.bodySize - entry.offset;
+      } else {
+        bytes += entry.message.payload.size();
+        if (entry.message.data) {
+          bytes += entry.message.data->computeChainDataLength();
+        }
+      }
+    }
+    lane.clear();
+  }
+  return bytes;
+}
+
+} // namespace sonar
+} // namespace facebook
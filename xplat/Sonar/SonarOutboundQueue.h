@@ -0,0 +1,228 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarMessageEncoding.h>
+#include <Sonar/SonarMetrics.h>
+#include <folly/io/IOBuf.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Which lane a message waits in before it is handed to the connection. Lanes
+ are served highest first, so a response to the desktop never waits behind a
+ screenshot or a large layout dump.
+ */
+enum class SonarMessagePriority : uint8_t {
+  // Responses, errors, and connection control messages.
+  Interactive,
+  // Plugin events.
+  Events,
+  // Binary frames.
+  Bulk,
+};
+
+struct SonarOutboundMessage {
+  std::string payload;
+  SonarMessageEncoding encoding;
+  // For binary frames, the frame data. payload is then the JSON metadata.
+  std::unique_ptr<folly::IOBuf> data;
+  // Counters of the plugin method that sent the message, if any.
+  std::shared_ptr<SonarMethodMetrics> metrics;
+  std::chrono::steady_clock::time_point enqueuedAt;
+  SonarMessagePriority priority = SonarMessagePriority::Interactive;
+  // Whether payload was already deflated, see SonarCompression.h.
+  bool deflated = false;
+  // Set for messages sent with sendExecuteLatest, see SonarLatestMessages.
+  std::string latestKey;
+  uint64_t generation = 0;
+};
+
+/**
+ Tracks the newest message queued for each key of sendExecuteLatest, so that
+ older messages for the same key are dropped instead of sent. Producers mark
+ a message as the newest from any thread; the consumer asks whether a
+ message is still the newest before sending it.
+ */
+class SonarLatestMessages {
+ public:
+  /**
+   Returns the generation of a new message for key, which supersedes all
+   messages for key marked before.
+   */
+  uint64_t mark(const std::string& key);
+
+  /**
+   Whether nothing newer was marked for key since the message with this
+   generation.
+   */
+  bool isLatest(const std::string& key, uint64_t generation) const;
+
+  /**
+   Like isLatest, and forgets key if it is, for when the message is sent.
+   */
+  bool take(const std::string& key, uint64_t generation);
+
+ private:
+  mutable std::mutex mutex_;
+  uint64_t nextGeneration_ = 1;
+  std::unordered_map<std::string, uint64_t> latest_;
+};
+
+/**
+ Lock-free multi-producer single-consumer queue of serialized messages.
+ Producers push from any thread; a single consumer takes everything that has
+ been queued so far in one go, in the order it was pushed.
+ */
+class SonarOutboundQueue {
+ public:
+  SonarOutboundQueue() = default;
+  SonarOutboundQueue(const SonarOutboundQueue&) = delete;
+  SonarOutboundQueue& operator=(const SonarOutboundQueue&) = delete;
+  ~SonarOutboundQueue();
+
+  /**
+   Returns true if the queue was empty before this push, in which case the
+   caller is responsible for scheduling a drain.
+   */
+  bool push(SonarOutboundMessage message);
+
+  /**
+   Removes and returns all queued messages, oldest first.
+   Must only be called from the consumer thread.
+   */
+  std::vector<SonarOutboundMessage> drain();
+
+  /**
+   Number of messages pushed but not drained yet.
+   */
+  size_t depth() const {
+    return depth_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Node {
+    SonarOutboundMessage message;
+    Node* next;
+  };
+
+  std::atomic<Node*> head_{nullptr};
+  std::atomic<size_t> depth_{0};
+};
+
+struct SonarOutboundFragment {
+  // Shared by all fragments of a message, unique per SonarOutboundLanes.
+  uint64_t id;
+  size_t index;
+  size_t count;
+  // For fragments of a binary message, its metadata. Only on the first one.
+  const std::string* envelope;
+};
+
+/**
+ Holds drained messages until they are handed to the connection, in one lane
+ per SonarMessagePriority. Each lane keeps the order its messages were pushed
+ in, and is only served while all higher lanes are empty.
+
+ Messages pushed with fragment set that are larger than fragmentBytes go out
+ in fragments of that size, one per sendNext call, so that the caller can let
+ higher priority messages in between fragments instead of behind the whole
+ message. Fragments of one message are never interleaved with other messages
+ of the same lane. Only used on the consumer thread.
+ */
+class SonarOutboundLanes {
+ public:
+  /**
+   0 never fragments.
+   */
+  explicit SonarOutboundLanes(size_t fragmentBytes)
+      : fragmentBytes_(fragmentBytes) {}
+
+  SonarOutboundLanes(const SonarOutboundLanes&) = delete;
+  SonarOutboundLanes& operator=(const SonarOutboundLanes&) = delete;
+
+  void push(SonarOutboundMessage message, bool fragment);
+
+  bool empty() const;
+
+  /**
+   Whether a message of this size is sent in fragments, if allowed.
+   */
+  bool exceedsFragmentSize(size_t size) const {
+    return fragmentBytes_ > 0 && size > fragmentBytes_;
+  }
+
+  /**
+   Hands the next message in line to sendMessage(SonarOutboundMessage), or
+   if it is fragmented, its next fragment to
+   sendFragment(const SonarOutboundFragment&, std::unique_ptr<IOBuf>).
+   Returns whether a fragment was sent. Does nothing if empty.
+   */
+  template <typename SendMessage, typename SendFragment>
+  bool sendNext(SendMessage&& sendMessage, SendFragment&& sendFragment) {
+    Entry* entry = next();
+    if (!entry) {
+      return false;
+    }
+    if (!entry->fragmented) {
+      auto message = std::move(entry->message);
+      pop(*entry);
+      sendMessage(std::move(message));
+      return false;
+    }
+    SonarOutboundFragment fragment;
+    auto data = nextFragment(*entry, fragment);
+    const bool last = fragment.index + 1 == fragment.count;
+    sendFragment(fragment, std::move(data));
+    if (last) {
+      pop(*entry);
+    }
+    return true;
+  }
+
+  /**
+   Drops everything, returning the number of bytes that were not sent.
+   */
+  size_t clear();
+
+ private:
+  struct Entry {
+    SonarOutboundMessage message;
+    bool fragmented;
+    // Set up when the first fragment is taken.
+    std::unique_ptr<folly::IOBuf> body;
+    size_t bodySize = 0;
+    size_t offset = 0;
+    uint64_t id = 0;
+    size_t index = 0;
+  };
+
+  Entry* next();
+  void pop(const Entry& entry);
+  std::unique_ptr<folly::IOBuf> nextFragment(
+      Entry& entry,
+      SonarOutboundFragment& fragment);
+
+  const size_t fragmentBytes_;
+  std::array<std::deque<Entry>, 3> lanes_;
+  uint64_t nextFragmentId_ = 1;
+};
+
+} // namespace sonar
+} // namespace facebook
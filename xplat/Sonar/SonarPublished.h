@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/ScopeGuard.h>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <utility>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ A value that is read on every call or message but only replaced now and
+ then, such as a connection's receivers. Reading is wait-free: a reader
+ registers in one of two counters, reads the current value and deregisters,
+ without taking a lock or touching a reference count. std::atomic_load of a
+ shared_ptr instead takes a spinlock from a pool shared by every shared_ptr
+ in the process.
+
+ publish waits for the readers that may still see the previous value before
+ deleting it. Readers that arrive meanwhile register in the other counter and
+ see the new value, so a steady stream of them can't hold publish up.
+ */
+template <typename T>
+class SonarPublished {
+ public:
+  explicit SonarPublished(T value = T()) : current_(new T(std::move(value))) {}
+
+  ~SonarPublished() {
+    delete current_.load(std::memory_order_relaxed);
+  }
+
+  SonarPublished(const SonarPublished&) = delete;
+  SonarPublished& operator=(const SonarPublished&) = delete;
+
+  /**
+   Calls read with the current value, which stays alive until read returns.
+   Safe from any thread. read should be quick, since publish waits for it,
+   and must not publish.
+   */
+  template <typename Read>
+  auto read(Read&& read) const -> decltype(read(std::declval<const T&>())) {
+    auto& readers = readers_[epoch_.load() & 1];
+    readers.fetch_add(1);
+    SCOPE_EXIT {
+      readers.fetch_sub(1, std::memory_order_release);
+    };
+    return read(*current_.load());
+  }
+
+  /**
+   The current value, for the writer to build the next one from. Only valid
+   while publishing is serialized, as publish requires.
+   */
+  const T& latest() const {
+    return *current_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   Replaces the value. Calls must be serialized by the caller, with a mutex
+   for instance.
+   */
+  void publish(T value) {
+    const auto previous = current_.exchange(new T(std::move(value)));
+    const auto epoch = epoch_.load(std::memory_order_relaxed);
+    // Readers registered under the next epoch from an earlier publish may
+    // still have loaded the previous value.
+    waitForReaders(readers_[(epoch + 1) & 1]);
+    epoch_.store(epoch + 1);
+    waitForReaders(readers_[epoch & 1]);
+    delete previous;
+  }
+
+ private:
+  static void waitForReaders(const std::atomic<size_t>& readers) {
+    while (readers.load() != 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  std::atomic<const T*> current_;
+  std::atomic<size_t> epoch_{0};
+  mutable std::atomic<size_t> readers_[2]{{0}, {0}};
+};
+
+} // namespace sonar
+} // namespace facebook
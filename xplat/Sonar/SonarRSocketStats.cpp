@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarRSocketStats.h"
+#include <chrono>
+
+namespace facebook {
+namespace sonar {
+
+namespace {
+
+int64_t nowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+void SonarRSocketStats::socketConnected() {
+  metrics_->transport().connections++;
+}
+
+void SonarRSocketStats::socketDisconnected() {
+  metrics_->transport().disconnections++;
+  // A keepalive that was in flight will never be answered.
+  keepaliveSentAt_ = 0;
+}
+
+void SonarRSocketStats::bytesWritten(size_t bytes) {
+  metrics_->transport().bytesSent += bytes;
+}
+
+void SonarRSocketStats::bytesRead(size_t bytes) {
+  metrics_->transport().bytesReceived += bytes;
+}
+
+void SonarRSocketStats::frameWritten(rsocket::FrameType frameType) {
+  metrics_->transport().framesSent++;
+}
+
+void SonarRSocketStats::frameRead(rsocket::FrameType frameType) {
+  metrics_->transport().framesReceived++;
+}
+
+void SonarRSocketStats::keepaliveSent() {
+  metrics_->transport().keepalivesSent++;
+  // Only the oldest unanswered keepalive is timed, so that a slow answer
+  // isn't attributed to a later keepalive.
+  int64_t expected = 0;
+  keepaliveSentAt_.compare_exchange_strong(expected, nowMicros());
+}
+
+void SonarRSocketStats::keepaliveReceived() {
+  metrics_->transport().keepalivesReceived++;
+  const auto sentAt = keepaliveSentAt_.exchange(0);
+  if (sentAt == 0) {
+    return;
+  }
+  auto& transport = metrics_->transport();
+  const auto rtt = nowMicros() - sentAt;
+  transport.keepaliveRttMicros = rtt;
+  // Same gain as TCP's smoothed RTT. Only written from the connection
+  // thread, so there's no need for a compare-exchange loop.
+  const auto smoothed = transport.smoothedRttMicros.load();
+  transport.smoothedRttMicros =
+      smoothed < 0 ? rtt : smoothed + (rtt - smoothed) / 8;
+}
+
+} // namespace sonar
+} // namespace facebook
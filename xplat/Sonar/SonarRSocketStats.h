@@ -0,0 +1,52 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarMetrics.h>
+#include <rsocket/RSocketStats.h>
+#include <atomic>
+#include <memory>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Feeds rsocket's transport instrumentation into the transport counters of
+ SonarMetrics. Called on the connection thread.
+ */
+class SonarRSocketStats : public rsocket::RSocketStats {
+ public:
+  explicit SonarRSocketStats(std::shared_ptr<SonarMetrics> metrics)
+      : metrics_(std::move(metrics)) {}
+
+  void socketConnected() override;
+
+  void socketDisconnected() override;
+
+  void bytesWritten(size_t bytes) override;
+
+  void bytesRead(size_t bytes) override;
+
+  void frameWritten(rsocket::FrameType frameType) override;
+
+  void frameRead(rsocket::FrameType frameType) override;
+
+  void keepaliveSent() override;
+
+  void keepaliveReceived() override;
+
+ private:
+  std::shared_ptr<SonarMetrics> metrics_;
+  // When the keepalive that hasn't been answered yet was sent, in steady
+  // clock microseconds, or 0 if there is none.
+  std::atomic<int64_t> keepaliveSentAt_{0};
+};
+
+} // namespace sonar
+} // namespace facebook
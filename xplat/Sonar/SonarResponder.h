@@ -8,7 +8,9 @@
 
 #pragma once
 
+#include <Sonar/SonarMessageWriter.h>
 #include <folly/json.h>
+#include <functional>
 
 namespace facebook {
 namespace sonar {
@@ -26,10 +28,73 @@ class SonarResponder {
    */
   virtual void success(const folly::dynamic& response) const = 0;
 
+  /**
+   * Same as above, but allows the response to be moved into the outgoing
+   * message instead of being copied.
+   */
+  virtual void success(folly::dynamic&& response) const {
+    success(static_cast<const folly::dynamic&>(response));
+  }
+
+  /**
+   * Same as success, for a response that is already serialized as JSON.
+   */
+  virtual void successJson(std::string response) const {
+    success(folly::parseJson(response));
+  }
+
+  /**
+   * Same as success, with the response written by build straight into JSON
+   * rather than put together as a folly::dynamic first. build is called
+   * once, before this returns, inside the response object.
+   */
+  virtual void successWith(
+      const std::function<void(SonarMessageWriter&)>& build) const {
+    std::string response;
+    SonarMessageWriter writer(response);
+    build(writer);
+    writer.endObject();
+    successJson(std::move(response));
+  }
+
+  /**
+   * Deliver one page of a paginated result, see
+   * SonarConnection::receivePaged. While hasMore, the Sonar desktop app
+   * fetches the next page from cursorId with fetchNextPage.
+   */
+  virtual void page(int64_t cursorId, folly::dynamic&& items, bool hasMore)
+      const {
+    success(folly::dynamic::object("cursor", cursorId)(
+        "items", std::move(items))("hasMore", hasMore));
+  }
+
   /**
    * Inform the Sonar desktop app of an error in handling the request.
    */
   virtual void error(const folly::dynamic& response) const = 0;
+
+  virtual void error(folly::dynamic&& response) const {
+    error(static_cast<const folly::dynamic&>(response));
+  }
+
+  /**
+   * Send part of a response ahead of the final success. Returns false,
+   * leaving chunk untouched, if the desktop can't receive chunks.
+   * Use SonarStreamResponder rather than calling this directly.
+   */
+  virtual bool sendChunk(folly::dynamic&& chunk) const {
+    return false;
+  }
+
+  /**
+   * Whether the Sonar desktop app has given up on this request, either by
+   * cancelling it or because its deadline has passed. Long running
+   * receivers should check this periodically and stop early, since any
+   * response sent after cancellation is dropped.
+   */
+  virtual bool isCancelled() const {
+    return false;
+  }
 };
 
 } // namespace sonar
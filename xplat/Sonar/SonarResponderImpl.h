@@ -11,30 +11,162 @@
 #include <Sonar/SonarResponder.h>
 #include <Sonar/SonarWebSocket.h>
 #include <folly/json.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
 
 namespace facebook {
 namespace sonar {
 
+/**
+Shared between a responder and the client, which flips it when the desktop
+sends a cancel for the request.
+*/
+struct SonarRequestCancellation {
+  std::atomic<bool> cancelled{false};
+  std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::time_point::max();
+
+  bool isCancelled() const {
+    return cancelled || std::chrono::steady_clock::now() >= deadline;
+  }
+};
+
 class SonarResponderImpl : public SonarResponder {
  public:
-  SonarResponderImpl(SonarWebSocket* socket, int64_t responseID)
-      : socket_(socket), responseID_(responseID) {}
+  SonarResponderImpl(
+      SonarWebSocket* socket,
+      int64_t responseID,
+      std::shared_ptr<SonarRequestCancellation> cancellation = nullptr,
+      bool acceptsChunks = false)
+      : socket_(socket),
+        responseID_(responseID),
+        cancellation_(std::move(cancellation)),
+        acceptsChunks_(acceptsChunks) {}
 
   void success(const folly::dynamic& response) const override {
-    const folly::dynamic message =
-        folly::dynamic::object("id", responseID_)("success", response);
-    socket_->sendMessage(message);
+    success(folly::dynamic(response));
+  }
+
+  void success(folly::dynamic&& response) const override {
+    if (isCancelled()) {
+      return;
+    }
+    socket_->sendMessage(
+        folly::dynamic::object("id", responseID_)("success", std::move(response)));
+  }
+
+  void successJson(std::string response) const override {
+    if (isCancelled()) {
+      return;
+    }
+    std::string message("{\"id\":");
+    message.append(std::to_string(responseID_));
+    message.append(",\"success\":");
+    message.append(response);
+    message.push_back('}');
+    socket_->sendJson(std::move(message));
+  }
+
+  void successWith(const std::function<void(SonarMessageWriter&)>& build)
+      const override {
+    if (isCancelled()) {
+      return;
+    }
+    // The response is written right into the envelope, so the whole
+    // message ends up in one string.
+    std::string message("{\"id\":");
+    message.append(std::to_string(responseID_));
+    message.append(",\"success\":");
+    SonarMessageWriter writer(message);
+    build(writer);
+    writer.endObject();
+    message.push_back('}');
+    socket_->sendJson(std::move(message));
   }
 
   void error(const folly::dynamic& response) const override {
-    const folly::dynamic message =
-        folly::dynamic::object("id", responseID_)("error", response);
-    socket_->sendMessage(message);
+    error(folly::dynamic(response));
+  }
+
+  void error(folly::dynamic&& response) const override {
+    if (isCancelled()) {
+      return;
+    }
+    socket_->sendMessage(
+        folly::dynamic::object("id", responseID_)("error", std::move(response)));
+  }
+
+  bool sendChunk(folly::dynamic&& chunk) const override {
+    if (!acceptsChunks_) {
+      return false;
+    }
+    if (!isCancelled()) {
+      socket_->sendMessage(folly::dynamic::object("id", responseID_)(
+          "seq", nextChunk_++)("chunk", std::move(chunk)));
+    }
+    return true;
+  }
+
+  bool isCancelled() const override {
+    return cancellation_ && cancellation_->isCancelled();
+  }
+
+  // Every request with an id gets a responder, and chatty plugins go through
+  // thousands a second, so their memory is recycled rather than handed back
+  // to malloc each time. Receivers destroy responders on whatever thread
+  // they like, hence the lock.
+  static void* operator new(size_t size) {
+    if (size == sizeof(SonarResponderImpl)) {
+      auto& pool = freeBlocks();
+      std::lock_guard<std::mutex> lock(pool.mutex);
+      if (!pool.blocks.empty()) {
+        const auto block = pool.blocks.back();
+        pool.blocks.pop_back();
+        return block;
+      }
+    }
+    return ::operator new(size);
+  }
+
+  static void operator delete(void* pointer, size_t size) {
+    if (size == sizeof(SonarResponderImpl)) {
+      auto& pool = freeBlocks();
+      std::lock_guard<std::mutex> lock(pool.mutex);
+      if (pool.blocks.size() < kMaxFreeBlocks) {
+        pool.blocks.push_back(pointer);
+        return;
+      }
+    }
+    ::operator delete(pointer);
   }
 
  private:
+  // Enough for bursts of concurrent requests without holding on to much.
+  static constexpr size_t kMaxFreeBlocks = 256;
+
+  struct FreeBlocks {
+    FreeBlocks() {
+      blocks.reserve(kMaxFreeBlocks);
+    }
+    std::mutex mutex;
+    std::vector<void*> blocks;
+  };
+
+  static FreeBlocks& freeBlocks() {
+    // Leaked, responders may still be destroyed during static destruction.
+    static auto pool = new FreeBlocks();
+    return *pool;
+  }
+
   SonarWebSocket* socket_;
   int64_t responseID_;
+  std::shared_ptr<SonarRequestCancellation> cancellation_;
+  bool acceptsChunks_;
+  mutable int64_t nextChunk_ = 0;
 };
 
 } // namespace sonar
@@ -0,0 +1,205 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarResponseCache.h"
+
+#include <folly/json.h>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Passes the response on to the desktop, serialized once for both the
+ desktop and the cache. Errors, pages and chunked responses aren't kept.
+ */
+class SonarResponseCache::CachingResponder : public SonarResponder {
+ public:
+  CachingResponder(
+      std::shared_ptr<SonarResponseCache> cache,
+      std::string key,
+      std::string version,
+      uint64_t atVersion,
+      std::unique_ptr<SonarResponder> responder)
+      : cache_(std::move(cache)),
+        key_(std::move(key)),
+        version_(std::move(version)),
+        atVersion_(atVersion),
+        responder_(std::move(responder)) {}
+
+  void success(const folly::dynamic& response) const override {
+    successJson(folly::toJson(response));
+  }
+
+  void success(folly::dynamic&& response) const override {
+    successJson(folly::toJson(response));
+  }
+
+  void successJson(std::string response) const override {
+    if (!chunked_) {
+      cache_->store(key_, version_, atVersion_, response);
+    }
+    responder_->successJson(std::move(response));
+  }
+
+  void page(int64_t cursorId, folly::dynamic&& items, bool hasMore)
+      const override {
+    responder_->page(cursorId, std::move(items), hasMore);
+  }
+
+  void error(const folly::dynamic& response) const override {
+    responder_->error(response);
+  }
+
+  void error(folly::dynamic&& response) const override {
+    responder_->error(std::move(response));
+  }
+
+  bool sendChunk(folly::dynamic&& chunk) const override {
+    chunked_ = true;
+    return responder_->sendChunk(std::move(chunk));
+  }
+
+  bool isCancelled() const override {
+    return responder_->isCancelled();
+  }
+
+ private:
+  const std::shared_ptr<SonarResponseCache> cache_;
+  const std::string key_;
+  const std::string version_;
+  const uint64_t atVersion_;
+  const std::unique_ptr<SonarResponder> responder_;
+  mutable bool chunked_ = false;
+};
+
+void SonarResponseCache::cacheMethod(
+    folly::StringPiece method,
+    folly::StringPiece version) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  methods_[method.str()] = version.str();
+  hasMethods_ = true;
+}
+
+void SonarResponseCache::bump(folly::StringPiece version) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto counter = versions_.find(version);
+  if (counter != versions_.end()) {
+    counter->second++;
+  } else {
+    versions_.emplace(version.str(), 1);
+  }
+}
+
+bool SonarResponseCache::respond(
+    const std::string& method,
+    const folly::dynamic& params,
+    std::unique_ptr<SonarResponder>& responder) {
+  if (!hasMethods_ || !responder) {
+    return false;
+  }
+  std::string version;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto cached = methods_.find(method);
+    if (cached == methods_.end()) {
+      return false;
+    }
+    version = cached->second;
+  }
+
+  // Sorted, so that params that only differ in the order of their keys
+  // share a response.
+  folly::json::serialization_opts opts;
+  opts.sort_keys = true;
+  std::string key = method;
+  key.push_back('\n');
+  key.append(folly::json::serialize(params, opts));
+
+  uint64_t atVersion = 0;
+  std::string response;
+  bool hit = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto counter = versions_.find(version);
+    atVersion = counter != versions_.end() ? counter->second : 0;
+    const auto entry = index_.find(key);
+    if (entry != index_.end()) {
+      if (entry->second->atVersion == atVersion) {
+        entries_.splice(entries_.begin(), entries_, entry->second);
+        response = entry->second->response;
+        hit = true;
+      } else {
+        bytes_ -= entry->second->response.size();
+        entries_.erase(entry->second);
+        index_.erase(entry);
+      }
+    }
+  }
+
+  if (hit) {
+    responder->successJson(std::move(response));
+    return true;
+  }
+  responder = std::make_unique<CachingResponder>(
+      shared_from_this(),
+      std::move(key),
+      std::move(version),
+      atVersion,
+      std::move(responder));
+  return false;
+}
+
+void SonarResponseCache::store(
+    std::string key,
+    const std::string& version,
+    uint64_t atVersion,
+    std::string response) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // The counter has moved on while the response was computed, so it may
+  // already be out of date.
+  const auto counter = versions_.find(version);
+  if ((counter != versions_.end() ? counter->second : 0) != atVersion ||
+      response.size() > maxBytes_) {
+    return;
+  }
+  const auto existing = index_.find(key);
+  if (existing != index_.end()) {
+    bytes_ -= existing->second->response.size();
+    entries_.erase(existing->second);
+    index_.erase(existing);
+  }
+  bytes_ += response.size();
+  entries_.push_front(Entry{key, atVersion, std::move(response)});
+  index_.emplace(std::move(key), entries_.begin());
+  while (bytes_ > maxBytes_) {
+    const auto& oldest = entries_.back();
+    bytes_ -= oldest.response.size();
+    index_.erase(oldest.key);
+    entries_.pop_back();
+  }
+}
+
+void SonarResponseCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  index_.clear();
+  bytes_ = 0;
+}
+
+size_t SonarResponseCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+size_t SonarResponseCache::bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+} // namespace sonar
+} // namespace facebook
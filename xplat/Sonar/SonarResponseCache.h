@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarResponder.h>
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ The serialized responses of a plugin's cached methods, see
+ SonarConnection::cacheResponses, keyed by method and params. Each response
+ is kept along with the version of the counter it depends on at the time
+ the call came in, and only served while the counter is still at that
+ version. The least recently served go once they take more than maxBytes.
+ Thread safe.
+ */
+class SonarResponseCache
+    : public std::enable_shared_from_this<SonarResponseCache> {
+ public:
+  static constexpr size_t kDefaultMaxBytes = 1024 * 1024;
+
+  explicit SonarResponseCache(size_t maxBytes = kDefaultMaxBytes)
+      : maxBytes_(maxBytes) {}
+
+  /**
+   Caches the responses to method for as long as the counter named version
+   doesn't change.
+   */
+  void cacheMethod(folly::StringPiece method, folly::StringPiece version);
+
+  /**
+   Bumps the counter named version, so that the responses that depend on it
+   are computed again. Cheap, stale responses are dropped as they're found.
+   */
+  void bump(folly::StringPiece version);
+
+  /**
+   Answers a call of a cached method with a current response, returning
+   true. Otherwise returns false, and for cached methods replaces responder
+   with one that keeps the response on its way through.
+   */
+  bool respond(
+      const std::string& method,
+      const folly::dynamic& params,
+      std::unique_ptr<SonarResponder>& responder);
+
+  void clear();
+
+  size_t size() const;
+
+  size_t bytes() const;
+
+ private:
+  class CachingResponder;
+
+  struct Entry {
+    std::string key;
+    uint64_t atVersion;
+    std::string response;
+  };
+
+  void store(
+      std::string key,
+      const std::string& version,
+      uint64_t atVersion,
+      std::string response);
+
+  const size_t maxBytes_;
+  // Checked without locking, so that plugins that don't cache anything
+  // don't pay for calls.
+  std::atomic<bool> hasMethods_{false};
+  mutable std::mutex mutex_;
+  // Method to the name of the counter its responses depend on.
+  std::map<std::string, std::string, std::less<>> methods_;
+  std::map<std::string, uint64_t, std::less<>> versions_;
+  // Most recently served first.
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  size_t bytes_ = 0;
+};
+
+} // namespace sonar
+} // namespace facebook
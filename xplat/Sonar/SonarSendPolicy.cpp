@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarSendPolicy.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace facebook {
+namespace sonar {
+
+namespace {
+
+double nonNegative(const folly::dynamic& params, const char* key) {
+  const auto& value = params.getDefault(key, 0);
+  if (!value.isNumber() || value.asDouble() < 0) {
+    throw std::invalid_argument(
+        std::string(key) + " must be a non-negative number");
+  }
+  return value.asDouble();
+}
+
+} // namespace
+
+SonarSendPolicy SonarSendPolicy::fromDynamic(const folly::dynamic& params) {
+  SonarSendPolicy policy;
+  policy.rate = nonNegative(params, "rate");
+  policy.burst = nonNegative(params, "burst");
+  policy.sampleEvery = static_cast<uint32_t>(
+      std::max(1.0, std::min(nonNegative(params, "sampleEvery"), 1e9)));
+  return policy;
+}
+
+folly::dynamic SonarSendPolicy::toDynamic() const {
+  return folly::dynamic::object("rate", rate)("burst", burst)(
+      "sampleEvery", sampleEvery);
+}
+
+SonarSendThrottle::SonarSendThrottle(SonarSendPolicy policy)
+    : policy_(policy),
+      capacity_(
+          std::max(policy.burst > 0 ? policy.burst : policy.rate, 1.0)),
+      tokens_(capacity_),
+      refilledAt_(std::chrono::steady_clock::now()) {}
+
+bool SonarSendThrottle::admit(std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (policy_.sampleEvery > 1 && seen_++ % policy_.sampleEvery != 0) {
+    dropped_++;
+    return false;
+  }
+  if (policy_.rate <= 0) {
+    return true;
+  }
+  if (now > refilledAt_) {
+    const std::chrono::duration<double> elapsed = now - refilledAt_;
+    tokens_ = std::min(capacity_, tokens_ + elapsed.count() * policy_.rate);
+    refilledAt_ = now;
+  }
+  if (tokens_ < 1) {
+    dropped_++;
+    return false;
+  }
+  tokens_ -= 1;
+  return true;
+}
+
+uint64_t SonarSendThrottle::dropped() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dropped_;
+}
+
+} // namespace sonar
+} // namespace facebook
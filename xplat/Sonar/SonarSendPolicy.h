@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/dynamic.h>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Limits on how often a plugin method may send to the desktop, set by the
+ desktop with the "__sendPolicy" method. Messages over the limits are
+ dropped on the device, before they are serialized.
+ */
+struct SonarSendPolicy {
+  // Messages per second on average, 0 for no limit.
+  double rate = 0;
+  // Messages that may be sent at once after a quiet period. 0 allows one
+  // second's worth.
+  double burst = 0;
+  // Only every sampleEvery-th message is considered for sending, 1 for all.
+  uint32_t sampleEvery = 1;
+
+  /**
+   Reads the fields from the params of "__sendPolicy", throwing
+   std::invalid_argument for negative or non-numeric values.
+   */
+  static SonarSendPolicy fromDynamic(const folly::dynamic& params);
+
+  folly::dynamic toDynamic() const;
+
+  /**
+   Whether the policy lets every message through.
+   */
+  bool isUnlimited() const {
+    return rate <= 0 && sampleEvery <= 1;
+  }
+};
+
+/**
+ Applies a SonarSendPolicy to the messages of one method: first sampling,
+ then a token bucket of burst tokens refilled at rate. Thread safe.
+ */
+class SonarSendThrottle {
+ public:
+  explicit SonarSendThrottle(SonarSendPolicy policy);
+
+  /**
+   Whether a message sent at now may go out. Counts it as dropped if not.
+   */
+  bool admit(std::chrono::steady_clock::time_point now =
+                 std::chrono::steady_clock::now());
+
+  uint64_t dropped() const;
+
+  const SonarSendPolicy& policy() const {
+    return policy_;
+  }
+
+ private:
+  const SonarSendPolicy policy_;
+  const double capacity_;
+  mutable std::mutex mutex_;
+  double tokens_;
+  std::chrono::steady_clock::time_point refilledAt_;
+  uint64_t seen_ = 0;
+  uint64_t dropped_ = 0;
+};
+
+} // namespace sonar
+} // namespace facebook
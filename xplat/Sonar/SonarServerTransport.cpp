@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarServerTransport.h"
+#include "Log.h"
+
+#include <stdexcept>
+
+namespace facebook {
+namespace sonar {
+
+namespace {
+
+// A desktop coming back reconnects to every device at once, so take
+// everything that queued up in one go instead of one per loop iteration.
+constexpr uint32_t kMaxAcceptAtOnce = 64;
+constexpr int kBacklog = 64;
+
+} // namespace
+
+SonarServerTransport::SonarServerTransport(
+    folly::EventBase* eventBase,
+    uint16_t port)
+    : eventBase_(eventBase),
+      socket_(folly::AsyncServerSocket::newSocket(eventBase)) {
+  // Lets a restarted app listen again right away, while connections of the
+  // previous process linger.
+  socket_->setReusePortEnabled(true);
+  socket_->setMaxAcceptAtOnce(kMaxAcceptAtOnce);
+  // Never drop connections to shed load, there are only ever a few.
+  socket_->setAcceptRateAdjustSpeed(0);
+  socket_->bind(folly::SocketAddress("127.0.0.1", port));
+  socket_->addAcceptCallback(this, eventBase_);
+  socket_->listen(kBacklog);
+  socket_->startAccepting();
+}
+
+SonarServerTransport::~SonarServerTransport() {
+  socket_.reset();
+  if (waiting_) {
+    waiting_->setException(std::runtime_error("Stopped listening"));
+  }
+}
+
+folly::Future<folly::AsyncSocket::UniquePtr> SonarServerTransport::accept() {
+  if (queued_) {
+    return folly::makeFuture(std::move(queued_));
+  }
+  if (waiting_) {
+    waiting_->setException(std::runtime_error("Replaced by another accept"));
+  }
+  waiting_.emplace();
+  return waiting_->getFuture();
+}
+
+void SonarServerTransport::connectionAccepted(
+    int fd,
+    const folly::SocketAddress&) noexcept {
+  folly::AsyncSocket::UniquePtr socket(new folly::AsyncSocket(eventBase_, fd));
+  // Accepted sockets only inherit TCP_NODELAY from the listening one on
+  // some platforms.
+  socket->setNoDelay(true);
+  if (waiting_) {
+    auto promise = std::move(*waiting_);
+    waiting_.clear();
+    promise.setValue(std::move(socket));
+    return;
+  }
+  // Only the latest connection is kept, the desktop gave up on older ones.
+  queued_ = std::move(socket);
+}
+
+void SonarServerTransport::acceptError(const std::exception& ex) noexcept {
+  log(std::string("Failed to accept a connection from the desktop: ") +
+      ex.what());
+}
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/futures/Future.h>
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/EventBase.h>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Listens on a loopback port for the desktop to connect to the device, for
+ when the desktop can reach the device (e.g. through `adb forward`) rather
+ than the other way around.
+
+ Only one connection is used at a time. One that arrives while the previous
+ one is still in use waits for the next accept() rather than being refused,
+ so a desktop reconnecting to many devices at once isn't sent into a retry
+ loop. Must be created, used and destroyed on its EventBase's thread.
+ */
+class SonarServerTransport
+    : private folly::AsyncServerSocket::AcceptCallback {
+ public:
+  SonarServerTransport(folly::EventBase* eventBase, uint16_t port);
+  ~SonarServerTransport() override;
+
+  /**
+   Completes on the EventBase with the next connection from the desktop.
+   Replaces any accept() still waiting, which fails.
+   */
+  folly::Future<folly::AsyncSocket::UniquePtr> accept();
+
+ private:
+  void connectionAccepted(
+      int fd,
+      const folly::SocketAddress& clientAddr) noexcept override;
+  void acceptError(const std::exception& ex) noexcept override;
+
+  folly::EventBase* eventBase_;
+  folly::AsyncServerSocket::UniquePtr socket_;
+  folly::Optional<folly::Promise<folly::AsyncSocket::UniquePtr>> waiting_;
+  folly::AsyncSocket::UniquePtr queued_;
+};
+
+} // namespace sonar
+} // namespace facebook
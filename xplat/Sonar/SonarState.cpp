@@ -8,59 +8,270 @@
 #include "SonarState.h"
 #include "SonarStateUpdateListener.h"
 #include "SonarStep.h"
+#include <folly/Executor.h>
+#include <algorithm>
+#include <cstdio>
 #include <vector>
 
 using namespace facebook::sonar;
 
+constexpr size_t SonarState::kMaxLogEntries;
+constexpr size_t StepTimings::kBucketCount;
+constexpr std::array<int64_t, StepTimings::kBucketCount - 1>
+    StepTimings::kBucketUpperBoundsMs;
+
+void StepTimings::record(std::chrono::milliseconds duration) {
+  const int64_t ms = duration.count();
+  size_t bucket = 0;
+  while (bucket < kBucketUpperBoundsMs.size() &&
+         ms >= kBucketUpperBoundsMs[bucket]) {
+    bucket++;
+  }
+  buckets[bucket]++;
+  count++;
+  lastMs = ms;
+  totalMs += ms;
+  maxMs = std::max(maxMs, ms);
+}
+
 /* Class responsible for collecting state updates and combining them into a
  * view of the current state of the sonar client. */
 
 
-SonarState::SonarState(): log("") {}
+SonarState::SonarState() {
+  log.reserve(kMaxLogEntries);
+  logAccount = SonarMemoryBudget::shared().open(
+      "Connection log", [this](size_t bytes) { evictLog(bytes); });
+}
+
+SonarState::~SonarState() = default;
+
 void SonarState::setUpdateListener(
     std::shared_ptr<SonarStateUpdateListener> listener) {
+  std::lock_guard<std::mutex> lock(mutex);
   mListener = listener;
 }
 
 void SonarState::started(std::string step) {
-  if (stateMap.find(step) == stateMap.end()) {
-    insertOrder.push_back(step);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stateMap.find(step) == stateMap.end()) {
+      insertOrder.push_back(step);
+    }
+    stateMap[step] = State::in_progress;
+    changed();
   }
-  stateMap[step] = State::in_progress;
-  if (mListener) {
-    mListener->onUpdate();
+  notifyListener();
+}
+
+void SonarState::success(
+    std::string step,
+    std::chrono::milliseconds duration) {
+  size_t bytes;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stateMap[step] = State::success;
+    timings[step].record(duration);
+    append(State::success, std::move(step), "", duration);
+    bytes = logBytes;
+    changed();
   }
+  // Outside the lock, the budget may call back into evictLog.
+  logAccount->setBytes(bytes);
+  notifyListener();
 }
 
-void SonarState::success(std::string step) {
-  log = log + "[Success] " + step + "\n";
-  stateMap[step] = State::success;
-  if (mListener) {
-    mListener->onUpdate();
+void SonarState::failed(
+    std::string step,
+    std::string errorMessage,
+    std::chrono::milliseconds duration) {
+  size_t bytes;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stateMap[step] = State::failed;
+    timings[step].record(duration);
+    append(State::failed, std::move(step), std::move(errorMessage), duration);
+    bytes = logBytes;
+    changed();
   }
+  logAccount->setBytes(bytes);
+  notifyListener();
+}
+
+void SonarState::setUpdateExecutor(folly::Executor* executor) {
+  updateExecutor = executor;
 }
 
-void SonarState::failed(std::string step, std::string errorMessage) {
-  log = log + "[Failed] " + step + ": " + errorMessage + "\n";
-  stateMap[step] = State::failed;
-  if (mListener) {
-    mListener->onUpdate();
+void SonarState::changed() {
+  version.store(
+      version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void SonarState::notifyListener() {
+  const auto deliver = [this]() {
+    updatePending = false;
+    std::shared_ptr<SonarStateUpdateListener> listener;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      listener = mListener;
+    }
+    if (listener) {
+      listener->onUpdate();
+    }
+  };
+
+  folly::Executor* executor = updateExecutor;
+  if (!executor) {
+    deliver();
+    return;
+  }
+  if (!updatePending.exchange(true)) {
+    executor->add(deliver);
   }
 }
 
+void SonarState::append(
+    State state,
+    std::string step,
+    std::string message,
+    std::chrono::milliseconds duration) {
+  const auto now = std::chrono::steady_clock::now();
+  if (log.size() < kMaxLogEntries) {
+    log.push_back({now, state, std::move(step), std::move(message), duration});
+    logBytes += entryBytes(log.back());
+    return;
+  }
+  // Overwrite the oldest entry in place.
+  auto& entry = log[logStart];
+  logBytes -= entryBytes(entry);
+  entry.time = now;
+  entry.state = state;
+  entry.step = std::move(step);
+  entry.message = std::move(message);
+  entry.duration = duration;
+  logBytes += entryBytes(entry);
+  logStart = (logStart + 1) % kMaxLogEntries;
+}
+
+size_t SonarState::entryBytes(const LogEntry& entry) const {
+  return sizeof(entry) + entry.step.capacity() + entry.message.capacity();
+}
+
+void SonarState::evictLog(size_t bytes) {
+  size_t remaining;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<LogEntry> kept;
+    kept.reserve(kMaxLogEntries);
+    size_t freed = 0;
+    for (size_t i = 0; i < log.size(); i++) {
+      auto& entry = log[(logStart + i) % log.size()];
+      if (freed < bytes) {
+        freed += entryBytes(entry);
+      } else {
+        kept.push_back(std::move(entry));
+      }
+    }
+    log = std::move(kept);
+    logStart = 0;
+    logBytes = logBytes > freed ? logBytes - freed : 0;
+    remaining = logBytes;
+    changed();
+  }
+  logAccount->setBytes(remaining);
+}
+
+template <typename T>
+void SonarState::publish(
+    SonarPublished<Snapshot<T>>& snapshot,
+    uint64_t snapshotVersion,
+    std::shared_ptr<const T> value) {
+  std::lock_guard<std::mutex> lock(snapshotMutex);
+  const auto& latest = snapshot.latest();
+  if (latest.value && latest.version >= snapshotVersion) {
+    return;
+  }
+  Snapshot<T> published;
+  published.version = snapshotVersion;
+  published.value = std::move(value);
+  snapshot.publish(std::move(published));
+}
+
 // TODO: Currently returns string, but should really provide a better
 // representation of the current state so the UI can show it in a more intuitive
 // way
-std::string SonarState::getState() {
-  return log;
+std::shared_ptr<const std::string> SonarState::getState() {
+  auto current =
+      stateSnapshot.read([this](const Snapshot<std::string>& snapshot) {
+        return snapshot.version == version.load(std::memory_order_acquire)
+            ? snapshot.value
+            : nullptr;
+      });
+  if (current) {
+    return current;
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  const auto rebuiltVersion = version.load(std::memory_order_relaxed);
+  auto rebuilt = std::make_shared<std::string>();
+  auto& out = *rebuilt;
+  out.reserve(log.size() * 56);
+  for (size_t i = 0; i < log.size(); i++) {
+    const auto& entry = log[(logStart + i) % log.size()];
+    // Seconds since the client was created.
+    char time[24];
+    snprintf(
+        time,
+        sizeof(time),
+        "+%.3fs ",
+        std::chrono::duration<double>(entry.time - created).count());
+    char duration[24];
+    snprintf(
+        duration,
+        sizeof(duration),
+        " (%lldms)",
+        static_cast<long long>(entry.duration.count()));
+    out.append(time);
+    if (entry.state == State::success) {
+      out.append("[Success] ").append(entry.step).append(duration);
+    } else {
+      out.append("[Failed] ")
+          .append(entry.step)
+          .append(duration)
+          .append(": ")
+          .append(entry.message);
+    }
+    out.append("\n");
+  }
+  lock.unlock();
+  publish<std::string>(stateSnapshot, rebuiltVersion, rebuilt);
+  return rebuilt;
 }
 
-std::vector<StateElement> SonarState::getStateElements() {
-  std::vector<StateElement> v;
-  for (auto stepName : insertOrder) {
-    v.push_back(StateElement(stepName, stateMap[stepName]));
+std::shared_ptr<const std::vector<StateElement>>
+SonarState::getStateElements() {
+  using Elements = std::vector<StateElement>;
+  auto current =
+      elementsSnapshot.read([this](const Snapshot<Elements>& snapshot) {
+        return snapshot.version == version.load(std::memory_order_acquire)
+            ? snapshot.value
+            : nullptr;
+      });
+  if (current) {
+    return current;
+  }
+  auto rebuilt = std::make_shared<Elements>();
+  uint64_t rebuiltVersion;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    rebuiltVersion = version.load(std::memory_order_relaxed);
+    rebuilt->reserve(insertOrder.size());
+    for (const auto& stepName : insertOrder) {
+      rebuilt->push_back(
+          StateElement(stepName, stateMap[stepName], timings[stepName]));
+    }
   }
-  return v;
+  publish<Elements>(elementsSnapshot, rebuiltVersion, rebuilt);
+  return rebuilt;
 }
 
 std::shared_ptr<SonarStep> SonarState::start(std::string step_name) {
@@ -8,24 +8,53 @@
 
 #pragma once
 
+#include <Sonar/SonarMemoryBudget.h>
+#include <Sonar/SonarPublished.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
-#include <map>
 
 class SonarStep;
 class SonarStateUpdateListener;
 
+namespace folly {
+class Executor;
+}
+
 namespace facebook {
 namespace sonar {
 
 enum State { success, in_progress, failed };
 
+/* How long the runs of a step took, bucketed by kBucketUpperBoundsMs with a
+ final bucket for everything slower. */
+struct StepTimings {
+  static constexpr size_t kBucketCount = 8;
+  static constexpr std::array<int64_t, kBucketCount - 1> kBucketUpperBoundsMs{
+      {10, 50, 100, 500, 1000, 5000, 10000}};
+
+  void record(std::chrono::milliseconds duration);
+
+  std::array<uint32_t, kBucketCount> buckets{};
+  uint32_t count = 0;
+  int64_t lastMs = 0;
+  int64_t totalMs = 0;
+  int64_t maxMs = 0;
+};
+
 class StateElement {
 public:
-  StateElement(std::string name, State state): name_(name), state_(state) {};
+  StateElement(std::string name, State state, StepTimings timings = {})
+      : name_(name), state_(state), timings_(timings) {};
   std::string name_;
   State state_;
+  StepTimings timings_;
 };
 
 }
@@ -36,9 +65,23 @@ class SonarState {
 
  public:
   SonarState();
+  ~SonarState();
   void setUpdateListener(std::shared_ptr<SonarStateUpdateListener>);
-  std::string getState();
-  std::vector<facebook::sonar::StateElement> getStateElements();
+
+  /* Deliver listener updates on the given executor instead of on the thread
+   that recorded the step. Updates that arrive while one is pending are
+   coalesced into it, since the listener only learns that something
+   changed and has to query the state anyway. */
+  void setUpdateExecutor(folly::Executor* executor);
+
+  /* Both return a snapshot that is only rebuilt once a step was recorded
+   since, so diagnostics screens polling them don't hold up the threads
+   recording steps. Until then every poll gets the same snapshot, without
+   copying or locking, and callers can compare it to the last one to skip
+   redrawing. */
+  std::shared_ptr<const std::string> getState();
+  std::shared_ptr<const std::vector<facebook::sonar::StateElement>>
+  getStateElements();
 
   /* To record a state update, call start() with the name of the step to get a
    SonarStep object. Call complete on this to register it successful,
@@ -47,12 +90,70 @@ class SonarState {
   std::shared_ptr<SonarStep> start(std::string step);
 
  private:
-  void success(std::string);
-  void failed(std::string, std::string);
+  void success(std::string, std::chrono::milliseconds);
+  void failed(std::string, std::string, std::chrono::milliseconds);
   void started(std::string);
 
+  struct LogEntry {
+    std::chrono::steady_clock::time_point time;
+    facebook::sonar::State state;
+    std::string step;
+    std::string message;
+    std::chrono::milliseconds duration;
+  };
+
+  // Only the most recent entries are kept, so a client that has been
+  // failing to connect for hours has the same footprint as a fresh one.
+  static constexpr size_t kMaxLogEntries = 256;
+
+  // What getState or getStateElements returned for a version.
+  template <typename T>
+  struct Snapshot {
+    uint64_t version = 0;
+    std::shared_ptr<const T> value;
+  };
+
+  // Bumps version, called with mutex held after every change.
+  void changed();
+  // Unless a reader that raced this one already published a newer one.
+  template <typename T>
+  void publish(
+      facebook::sonar::SonarPublished<Snapshot<T>>& snapshot,
+      uint64_t snapshotVersion,
+      std::shared_ptr<const T> value);
+  void notifyListener();
+  // Drops the oldest log entries until at least bytes were freed.
+  void evictLog(size_t bytes);
+  size_t entryBytes(const LogEntry& entry) const;
+  void append(
+      facebook::sonar::State state,
+      std::string step,
+      std::string message,
+      std::chrono::milliseconds duration);
+
   std::shared_ptr<SonarStateUpdateListener> mListener = nullptr;
-  std::string log;
+  std::atomic<folly::Executor*> updateExecutor{nullptr};
+  std::atomic<bool> updatePending{false};
+  std::mutex mutex;
+  const std::chrono::steady_clock::time_point created =
+      std::chrono::steady_clock::now();
+  // Ring buffer of log entries, logStart is the oldest one once it's full.
+  std::vector<LogEntry> log;
+  size_t logStart = 0;
+  // What the log's entries take, reported to Sonar's memory budget, which
+  // may ask to drop the oldest ones.
+  size_t logBytes = 0;
+  std::shared_ptr<facebook::sonar::SonarMemoryBudget::Account> logAccount;
   std::vector<std::string> insertOrder;
   std::map<std::string, facebook::sonar::State> stateMap;
+  std::map<std::string, facebook::sonar::StepTimings> timings;
+  // Only written under mutex, so a snapshot taken under it is consistent.
+  std::atomic<uint64_t> version{0};
+  // Published under snapshotMutex, so that readers of a current snapshot
+  // don't lock.
+  std::mutex snapshotMutex;
+  facebook::sonar::SonarPublished<Snapshot<std::string>> stateSnapshot;
+  facebook::sonar::SonarPublished<
+      Snapshot<std::vector<facebook::sonar::StateElement>>>
+      elementsSnapshot;
 };
@@ -9,22 +9,46 @@
 #include "SonarState.h"
 
 void SonarStep::complete() {
+  endTraceSection();
   isLogged = true;
-  state->success(name);
+  state->success(name, elapsed());
 }
 
 void SonarStep::fail(std::string message) {
+  endTraceSection();
   isLogged = true;
-  state->failed(name, message);
+  state->failed(name, message, elapsed());
 }
 
-SonarStep::SonarStep(std::string step, SonarState* s) {
+SonarStep::SonarStep(std::string step, SonarState* s)
+    : startTime(std::chrono::steady_clock::now()) {
   state = s;
   name = step;
+#if SONAR_TRACE_POINTS
+  traceSection =
+      facebook::sonar::detail::beginAsyncTraceSection("sonar: " + name);
+#endif
 }
 
 SonarStep::~SonarStep() {
+  endTraceSection();
   if (!isLogged) {
-    state->failed(name, "");
+    state->failed(name, "", elapsed());
   }
 }
+
+std::chrono::milliseconds SonarStep::elapsed() const {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - startTime);
+}
+
+void SonarStep::endTraceSection() {
+#if SONAR_TRACE_POINTS
+  // A step may be both completed and failed, the section only ends once.
+  if (traceSection != 0) {
+    facebook::sonar::detail::endAsyncTraceSection(
+        "sonar: " + name, traceSection);
+    traceSection = 0;
+  }
+#endif
+}
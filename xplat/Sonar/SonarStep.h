@@ -8,10 +8,17 @@
 
 #pragma once
 
+#include <Sonar/SonarTrace.h>
+#include <chrono>
+#include <cstdint>
 #include <string>
 
 class SonarState;
 
+/*
+ * With SONAR_TRACE_POINTS, a step is also an async trace section, from start
+ * to complete or fail, so connection setup shows up in systrace and
+ * Instruments. */
 class SonarStep {
  public:
   /* Mark this step as completed successfully
@@ -29,4 +36,11 @@ class SonarStep {
   std::string name;
   bool isLogged = false;
   SonarState* state;
+  std::chrono::steady_clock::time_point startTime;
+#if SONAR_TRACE_POINTS
+  uint64_t traceSection = 0;
+#endif
+
+  std::chrono::milliseconds elapsed() const;
+  void endTraceSection();
 };
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarResponder.h>
+#include <folly/json.h>
+#include <memory>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ * SonarStreamResponder responds to a request with a sequence of chunks
+ * instead of a single message, so that large results never have to be
+ * built in memory in one piece and the Sonar desktop app can start
+ * rendering them before the last chunk arrives.
+ *
+ * If the desktop doesn't understand chunked responses, the chunks are
+ * collected and delivered as {"chunks": [...]} on complete().
+ */
+class SonarStreamResponder {
+ public:
+  explicit SonarStreamResponder(std::unique_ptr<SonarResponder> responder)
+      : responder_(std::move(responder)), buffered_(folly::dynamic::array()) {}
+
+  /**
+   * Send the next chunk of the response.
+   */
+  void next(folly::dynamic&& chunk) {
+    if (!responder_) {
+      return;
+    }
+    chunks_++;
+    if (!responder_->sendChunk(std::move(chunk))) {
+      buffered_.push_back(std::move(chunk));
+    }
+  }
+
+  /**
+   * Finish the response. No chunks can be sent afterwards.
+   */
+  void complete() {
+    if (!responder_) {
+      return;
+    }
+    if (buffered_.empty()) {
+      responder_->success(folly::dynamic::object("chunks", chunks_));
+    } else {
+      responder_->success(folly::dynamic::object("chunks", std::move(buffered_)));
+    }
+    responder_ = nullptr;
+  }
+
+  /**
+   * Abort the response. Chunks already sent are discarded by the desktop.
+   */
+  void error(folly::dynamic&& response) {
+    if (!responder_) {
+      return;
+    }
+    responder_->error(std::move(response));
+    responder_ = nullptr;
+  }
+
+  bool isCancelled() const {
+    return !responder_ || responder_->isCancelled();
+  }
+
+ private:
+  std::unique_ptr<SonarResponder> responder_;
+  folly::dynamic buffered_;
+  int64_t chunks_ = 0;
+};
+
+} // namespace sonar
+} // namespace facebook
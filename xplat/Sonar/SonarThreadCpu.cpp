@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarThreadCpu.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <pthread.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <time.h>
+#endif
+
+namespace facebook {
+namespace sonar {
+
+namespace {
+
+#if defined(__APPLE__)
+using ThreadClock = mach_port_t;
+
+bool currentThreadClock(ThreadClock& clock) {
+  clock = pthread_mach_thread_np(pthread_self());
+  return true;
+}
+
+// False once the thread exited.
+bool readClock(ThreadClock clock, int64_t& nanos) {
+  thread_basic_info_data_t info;
+  mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+  if (thread_info(
+          clock,
+          THREAD_BASIC_INFO,
+          reinterpret_cast<thread_info_t>(&info),
+          &count) != KERN_SUCCESS) {
+    return false;
+  }
+  nanos = (info.user_time.seconds + info.system_time.seconds) * 1000000000LL +
+      (info.user_time.microseconds + info.system_time.microseconds) * 1000LL;
+  return true;
+}
+#elif defined(__linux__)
+using ThreadClock = clockid_t;
+
+bool currentThreadClock(ThreadClock& clock) {
+  return pthread_getcpuclockid(pthread_self(), &clock) == 0;
+}
+
+bool readClock(ThreadClock clock, int64_t& nanos) {
+  timespec time;
+  if (clock_gettime(clock, &time) != 0) {
+    return false;
+  }
+  nanos = time.tv_sec * 1000000000LL + time.tv_nsec;
+  return true;
+}
+#else
+using ThreadClock = int;
+
+bool currentThreadClock(ThreadClock&) {
+  return false;
+}
+
+bool readClock(ThreadClock, int64_t&) {
+  return false;
+}
+#endif
+
+std::mutex& registryMutex() {
+  static auto mutex = new std::mutex();
+  return *mutex;
+}
+
+// Guarded by registryMutex().
+std::vector<ThreadClock>& registeredClocks() {
+  static auto clocks = new std::vector<ThreadClock>();
+  return *clocks;
+}
+
+} // namespace
+
+void registerSonarThread() {
+  ThreadClock clock;
+  if (!currentThreadClock(clock)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(registryMutex());
+  auto& clocks = registeredClocks();
+  if (std::find(clocks.begin(), clocks.end(), clock) == clocks.end()) {
+    clocks.push_back(clock);
+  }
+}
+
+int64_t sonarThreadsCpuNanos() {
+  std::lock_guard<std::mutex> lock(registryMutex());
+  auto& clocks = registeredClocks();
+  int64_t total = 0;
+  // Threads that exited are forgotten, their time with them.
+  clocks.erase(
+      std::remove_if(
+          clocks.begin(),
+          clocks.end(),
+          [&total](ThreadClock clock) {
+            int64_t nanos = 0;
+            if (!readClock(clock, nanos)) {
+              return true;
+            }
+            total += nanos;
+            return false;
+          }),
+      clocks.end());
+  return total;
+}
+
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,31 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Marks the calling thread as one of Sonar's own, such as the threads of the
+ callback and connection event bases, so that its CPU time counts as what
+ Sonar costs the app. Registering a thread again does nothing.
+ */
+void registerSonarThread();
+
+/**
+ Nanoseconds of CPU time that the registered threads still alive have used
+ so far. Only meaningful as the difference between two calls. Always 0
+ where threads' CPU time can't be read.
+ */
+int64_t sonarThreadsCpuNanos();
+
+} // namespace sonar
+} // namespace facebook
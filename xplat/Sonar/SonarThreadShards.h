@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+/**
+ A unique id for an owner of thread shards. Unlike its address, it is never
+ reused by another owner once this one is gone.
+ */
+inline uint64_t nextSonarThreadShardsOwnerId() {
+  static std::atomic<uint64_t> nextId{1};
+  return nextId.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ The calling thread's shard of owner, which is state that only this thread
+ writes, so that it can record without taking a lock. The first call on a
+ thread asks owner.createShard() for it. When the thread exits, the shard
+ is handed to owner.retire(), if owner is still around.
+
+ Owner is held by a std::shared_ptr and enable_shared_from_this, and has:
+   const uint64_t id; // from nextSonarThreadShardsOwnerId()
+   Shard* createShard(); // owned by the owner
+   void retire(Shard* shard);
+ */
+template <typename Owner, typename Shard>
+Shard& sonarThreadShard(Owner& owner) {
+  struct Entry {
+    std::weak_ptr<Owner> owner;
+    uint64_t id;
+    Shard* shard;
+  };
+
+  // Almost always just the one.
+  struct Entries {
+    std::vector<Entry> list;
+
+    ~Entries() {
+      for (auto& entry : list) {
+        if (auto owner = entry.owner.lock()) {
+          owner->retire(entry.shard);
+        }
+      }
+    }
+  };
+
+  static thread_local Entries entries;
+  for (const auto& entry : entries.list) {
+    if (entry.id == owner.id) {
+      return *entry.shard;
+    }
+  }
+  // Entries of owners that are gone can't be told apart from live ones
+  // without locking them, which only happens here.
+  entries.list.erase(
+      std::remove_if(
+          entries.list.begin(),
+          entries.list.end(),
+          [](const Entry& entry) { return entry.owner.expired(); }),
+      entries.list.end());
+  Shard* shard = owner.createShard();
+  entries.list.push_back({owner.shared_from_this(), owner.id, shard});
+  return *shard;
+}
+
+} // namespace sonar
+} // namespace facebook
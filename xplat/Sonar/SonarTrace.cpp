@@ -0,0 +1,221 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarTrace.h"
+
+#if SONAR_TRACE_POINTS
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#if defined(__ANDROID__)
+#include <dlfcn.h>
+#endif
+
+namespace facebook {
+namespace sonar {
+
+namespace {
+
+constexpr uint32_t kMaxTracePoints = 256;
+
+/**
+ The names of all trace points in a trace plugin. Replaced, never changed,
+ except for names of points registered after it was published.
+ */
+struct Target {
+  std::array<SonarTraceName, kMaxTracePoints> names;
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::string> names;
+  std::shared_ptr<SonarTracePlugin> plugin;
+  // Targets replaced while a point may still be recording to them are kept
+  // until exit, there is one per call to setSonarTraceTarget.
+  std::vector<std::unique_ptr<Target>> targets;
+  std::atomic<Target*> current{nullptr};
+};
+
+Registry& registry() {
+  static auto registry = new Registry();
+  return *registry;
+}
+
+#if defined(__ANDROID__)
+
+// ATrace_* came with API 23, and the async sections with API 29, so they
+// are looked up rather than linked.
+struct ATraceFunctions {
+  bool (*isEnabled)() = nullptr;
+  void (*beginSection)(const char*) = nullptr;
+  void (*endSection)() = nullptr;
+  void (*beginAsyncSection)(const char*, int32_t) = nullptr;
+  void (*endAsyncSection)(const char*, int32_t) = nullptr;
+};
+
+const ATraceFunctions& atrace() {
+  static const ATraceFunctions functions = [] {
+    ATraceFunctions functions;
+    void* android = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+    if (!android) {
+      return functions;
+    }
+    auto isEnabled = reinterpret_cast<bool (*)()>(
+        dlsym(android, "ATrace_isEnabled"));
+    auto beginSection = reinterpret_cast<void (*)(const char*)>(
+        dlsym(android, "ATrace_beginSection"));
+    auto endSection =
+        reinterpret_cast<void (*)()>(dlsym(android, "ATrace_endSection"));
+    if (isEnabled && beginSection && endSection) {
+      functions.isEnabled = isEnabled;
+      functions.beginSection = beginSection;
+      functions.endSection = endSection;
+      functions.beginAsyncSection =
+          reinterpret_cast<void (*)(const char*, int32_t)>(
+              dlsym(android, "ATrace_beginAsyncSection"));
+      functions.endAsyncSection =
+          reinterpret_cast<void (*)(const char*, int32_t)>(
+              dlsym(android, "ATrace_endAsyncSection"));
+    }
+    return functions;
+  }();
+  return functions;
+}
+
+#endif
+
+} // namespace
+
+void setSonarTraceTarget(std::shared_ptr<SonarTracePlugin> plugin) {
+  auto& registry = ::facebook::sonar::registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  if (!plugin) {
+    registry.plugin = nullptr;
+    registry.current = nullptr;
+    return;
+  }
+  auto target = std::make_unique<Target>();
+  for (size_t i = 0; i < registry.names.size(); i++) {
+    target->names[i] = plugin->name(registry.names[i]);
+  }
+  registry.plugin = std::move(plugin);
+  registry.current = target.get();
+  registry.targets.push_back(std::move(target));
+}
+
+namespace detail {
+
+namespace {
+
+uint32_t registerPoint(const std::string& name) {
+  auto& registry = ::facebook::sonar::registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  if (registry.names.size() >= kMaxTracePoints) {
+    return kMaxTracePoints;
+  }
+  const auto index = static_cast<uint32_t>(registry.names.size());
+  registry.names.push_back(name);
+  // Written before the point is first used, and so before any thread can
+  // record it.
+  if (auto target = registry.current.load()) {
+    target->names[index] = registry.plugin->name(name);
+  }
+  return index;
+}
+
+} // namespace
+
+uint64_t beginAsyncTraceSection(const std::string& name) {
+#if defined(__ANDROID__)
+  // Cookies tell apart sections of the same name that are in flight at
+  // the same time.
+  static std::atomic<int32_t> nextCookie{1};
+  const auto& functions = atrace();
+  if (functions.beginAsyncSection && functions.isEnabled()) {
+    const int32_t cookie = nextCookie++;
+    functions.beginAsyncSection(name.c_str(), cookie);
+    return static_cast<uint32_t>(cookie);
+  }
+#elif defined(__APPLE__)
+  if (__builtin_available(iOS 12.0, macOS 10.14, *)) {
+    const auto signpost = os_signpost_id_generate(sonarTraceLog());
+    os_signpost_interval_begin(
+        sonarTraceLog(), signpost, "SonarStep", "%{public}s", name.c_str());
+    return signpost;
+  }
+#else
+  (void)name;
+#endif
+  return 0;
+}
+
+void endAsyncTraceSection(const std::string& name, uint64_t section) {
+  if (section == 0) {
+    return;
+  }
+#if defined(__ANDROID__)
+  atrace().endAsyncSection(name.c_str(), static_cast<int32_t>(section));
+#elif defined(__APPLE__)
+  if (__builtin_available(iOS 12.0, macOS 10.14, *)) {
+    os_signpost_interval_end(sonarTraceLog(), section, "SonarStep");
+  }
+#else
+  (void)name;
+#endif
+}
+
+SonarTracePoint::SonarTracePoint(const char* name)
+    : name_(std::string("sonar.") + name), index_(registerPoint(name_)) {}
+
+bool SonarTracePoint::begin() const {
+  if (index_ < kMaxTracePoints) {
+    if (auto target = registry().current.load(std::memory_order_acquire)) {
+      target->names[index_].begin();
+    }
+  }
+#if defined(__ANDROID__)
+  const auto& functions = atrace();
+  if (functions.isEnabled && functions.isEnabled()) {
+    functions.beginSection(name_.c_str());
+    return true;
+  }
+#endif
+  return false;
+}
+
+void SonarTracePoint::end(bool atrace) const {
+#if defined(__ANDROID__)
+  if (atrace) {
+    ::facebook::sonar::atrace().endSection();
+  }
+#else
+  (void)atrace;
+#endif
+  if (index_ < kMaxTracePoints) {
+    if (auto target = registry().current.load(std::memory_order_acquire)) {
+      target->names[index_].end();
+    }
+  }
+}
+
+#if defined(__APPLE__)
+os_log_t sonarTraceLog() {
+  static os_log_t log = os_log_create("com.facebook.sonar", "Sonar");
+  return log;
+}
+#endif
+
+} // namespace detail
+
+} // namespace sonar
+} // namespace facebook
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+/**
+ Trace points on Sonar's own hot paths, so that its cost shows up in
+ Perfetto and Instruments next to the app's. They are compiled out unless
+ Sonar is built with SONAR_TRACE_POINTS=1, and then record to ATrace on
+ Android, os_signpost on iOS and macOS, and the trace plugin passed to
+ setSonarTraceTarget.
+
+   void SonarClient::onMessageReceived(const std::string& message) {
+     SONAR_TRACE_SCOPE("onMessageReceived");
+     ...
+   }
+
+ name has to be a string literal. The scope ends at the end of the
+ enclosing block.
+ */
+
+#ifndef SONAR_TRACE_POINTS
+#define SONAR_TRACE_POINTS 0
+#endif
+
+#if SONAR_TRACE_POINTS
+
+#include <Sonar/SonarTracePlugin.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#if defined(__APPLE__)
+#include <os/signpost.h>
+#endif
+
+namespace facebook {
+namespace sonar {
+
+/**
+ Records Sonar's trace points to plugin as well, or stops recording them to
+ a plugin with null. Points are recorded under their names prefixed with
+ "sonar.".
+ */
+void setSonarTraceTarget(std::shared_ptr<SonarTracePlugin> plugin);
+
+namespace detail {
+
+#if defined(__APPLE__)
+os_log_t sonarTraceLog() API_AVAILABLE(ios(12.0), macos(10.14));
+#endif
+
+/**
+ Begins an async section, one that may end on another thread than it began
+ on, such as a connection step. Returns what to end it with.
+ */
+uint64_t beginAsyncTraceSection(const std::string& name);
+void endAsyncTraceSection(const std::string& name, uint64_t section);
+
+/**
+ One SONAR_TRACE_SCOPE site, registered the first time it is reached.
+ */
+class SonarTracePoint {
+ public:
+  explicit SonarTracePoint(const char* name);
+
+  // Returns whether ATrace was written to, which end then has to be told.
+  bool begin() const;
+  void end(bool atrace) const;
+
+  const char* name() const {
+    return name_.c_str();
+  }
+
+ private:
+  const std::string name_;
+  const uint32_t index_;
+};
+
+class SonarTracePointScope {
+ public:
+  explicit SonarTracePointScope(const SonarTracePoint& point)
+      : point_(point), atrace_(point.begin()) {
+#if defined(__APPLE__)
+    if (__builtin_available(iOS 12.0, macOS 10.14, *)) {
+      signpost_ = os_signpost_id_generate(sonarTraceLog());
+      os_signpost_interval_begin(
+          sonarTraceLog(), signpost_, "Sonar", "%{public}s", point_.name());
+    }
+#endif
+  }
+
+  ~SonarTracePointScope() {
+#if defined(__APPLE__)
+    if (__builtin_available(iOS 12.0, macOS 10.14, *)) {
+      os_signpost_interval_end(sonarTraceLog(), signpost_, "Sonar");
+    }
+#endif
+    point_.end(atrace_);
+  }
+
+  SonarTracePointScope(const SonarTracePointScope&) = delete;
+  SonarTracePointScope& operator=(const SonarTracePointScope&) = delete;
+
+ private:
+  const SonarTracePoint& point_;
+  const bool atrace_;
+#if defined(__APPLE__)
+  // The signposts are intervals named "Sonar", told apart by their message,
+  // since os_signpost only takes literal names.
+  os_signpost_id_t signpost_ = OS_SIGNPOST_ID_NULL;
+#endif
+};
+
+} // namespace detail
+
+} // namespace sonar
+} // namespace facebook
+
+#define SONAR_TRACE_CONCAT_(a, b) a##b
+#define SONAR_TRACE_CONCAT(a, b) SONAR_TRACE_CONCAT_(a, b)
+
+#define SONAR_TRACE_SCOPE(name)                                           \
+  static const ::facebook::sonar::detail::SonarTracePoint                 \
+      SONAR_TRACE_CONCAT(sonarTracePoint, __LINE__)(name);                \
+  const ::facebook::sonar::detail::SonarTracePointScope SONAR_TRACE_CONCAT( \
+      sonarTraceScope, __LINE__)(SONAR_TRACE_CONCAT(sonarTracePoint, __LINE__))
+
+#else
+
+#define SONAR_TRACE_SCOPE(name) static_cast<void>(0)
+
+#endif
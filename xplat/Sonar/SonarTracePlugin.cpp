@@ -0,0 +1,465 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include "SonarTracePlugin.h"
+#include "SonarThreadShards.h"
+
+#include <folly/io/IOBuf.h>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <pthread.h>
+#elif defined(__linux__)
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace facebook {
+namespace sonar {
+
+constexpr const char* SonarTracePlugin::kIdentifier;
+
+namespace detail {
+
+namespace {
+
+constexpr uint32_t kNoName = UINT32_MAX;
+// After this many, the rings of threads that exited are dropped, oldest
+// first, whether they were sent or not.
+constexpr size_t kMaxRetiredRings = 16;
+
+// An event's info word holds its name index, the low bits of its position
+// in the ring's sequence of events and its phase, which is never 0, so
+// that 0 can mark a slot that is being written.
+constexpr uint64_t kSequenceMask = (1 << 24) - 1;
+
+inline uint64_t infoWord(uint32_t name, uint64_t position, uint8_t phase) {
+  return static_cast<uint64_t>(name) << 32 |
+      (position & kSequenceMask) << 8 | phase;
+}
+
+struct Slot {
+  std::atomic<uint64_t> timestamp;
+  std::atomic<uint64_t> info;
+};
+
+struct Event {
+  uint64_t timestamp;
+  uint32_t name;
+  uint16_t thread;
+  uint8_t phase;
+};
+
+size_t roundUpToPowerOfTwo(size_t value) {
+  size_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+uint64_t currentThreadId() {
+#if defined(__APPLE__)
+  uint64_t tid = 0;
+  pthread_threadid_np(nullptr, &tid);
+  return tid;
+#elif defined(__linux__)
+  return static_cast<uint64_t>(syscall(SYS_gettid));
+#else
+  return std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+}
+
+std::string currentThreadName() {
+  char name[64] = {};
+#if defined(__APPLE__)
+  pthread_getname_np(pthread_self(), name, sizeof(name));
+#elif defined(__linux__)
+  // Unlike pthread_getname_np, available on every Android version.
+  prctl(PR_GET_NAME, name, 0, 0, 0);
+#endif
+  return name;
+}
+
+} // namespace
+
+/**
+ The events of one thread. Only that thread writes, flushes only read, and
+ check each slot they read for having been overwritten meanwhile.
+ */
+struct SonarTraceRing {
+  SonarTraceRing(size_t capacity, uint32_t index)
+      : mask(capacity - 1),
+        slots(new Slot[capacity]),
+        index(index),
+        threadId(currentThreadId()),
+        threadName(currentThreadName()) {
+    for (size_t i = 0; i < capacity; i++) {
+      slots[i].timestamp.store(0, std::memory_order_relaxed);
+      slots[i].info.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void write(uint64_t timestamp, uint32_t name, SonarTracePhase phase) {
+    const uint64_t position = head.load(std::memory_order_relaxed);
+    auto& slot = slots[position & mask];
+    // Marks the slot for readers that overlap with the stores below, like
+    // the sequence number of a seqlock.
+    slot.info.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.timestamp.store(timestamp, std::memory_order_relaxed);
+    slot.info.store(
+        infoWord(name, position, static_cast<uint8_t>(phase)),
+        std::memory_order_release);
+    head.store(position + 1, std::memory_order_release);
+  }
+
+  /**
+   Appends the events at positions [from, to) to events, and returns how
+   many of them had been overwritten by the time they were read.
+   */
+  uint64_t read(uint64_t from, uint64_t to, std::vector<Event>& events) const {
+    uint64_t overwritten = 0;
+    for (uint64_t position = from; position < to; position++) {
+      const auto& slot = slots[position & mask];
+      const uint64_t info = slot.info.load(std::memory_order_acquire);
+      const uint64_t timestamp = slot.timestamp.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (info == 0 || info != slot.info.load(std::memory_order_relaxed) ||
+          (info >> 8 & kSequenceMask) != (position & kSequenceMask)) {
+        overwritten++;
+        continue;
+      }
+      events.push_back({timestamp,
+                        static_cast<uint32_t>(info >> 32),
+                        static_cast<uint16_t>(index),
+                        static_cast<uint8_t>(info)});
+    }
+    return overwritten;
+  }
+
+  size_t capacity() const {
+    return mask + 1;
+  }
+
+  const size_t mask;
+  const std::unique_ptr<Slot[]> slots;
+  std::atomic<uint64_t> head{0};
+  const uint32_t index;
+  const uint64_t threadId;
+  const std::string threadName;
+
+  // Guarded by the core's mutex.
+  uint64_t tail = 0;
+  bool retired = false;
+};
+
+/**
+ What the plugin and its names share, so that names stay usable after the
+ plugin is gone.
+ */
+class SonarTraceCore : public std::enable_shared_from_this<SonarTraceCore> {
+ public:
+  explicit SonarTraceCore(size_t capacity)
+      : id(nextSonarThreadShardsOwnerId()),
+        capacity(roundUpToPowerOfTwo(std::max<size_t>(capacity, 2))),
+        start(std::chrono::steady_clock::now()) {}
+
+  SonarTraceRing& ring() {
+    return sonarThreadShard<SonarTraceCore, SonarTraceRing>(*this);
+  }
+
+  SonarTraceRing* createShard() {
+    std::lock_guard<std::mutex> lock(mutex);
+    rings.push_back(std::make_unique<SonarTraceRing>(capacity, nextThread++));
+    return rings.back().get();
+  }
+
+  void retire(SonarTraceRing* ring) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ring->retired = true;
+    size_t retired = std::count_if(
+        rings.begin(),
+        rings.end(),
+        [](const std::unique_ptr<SonarTraceRing>& ring) {
+          return ring->retired;
+        });
+    rings.erase(
+        std::remove_if(
+            rings.begin(),
+            rings.end(),
+            [&retired](const std::unique_ptr<SonarTraceRing>& ring) {
+              if (retired > kMaxRetiredRings && ring->retired) {
+                retired--;
+                return true;
+              }
+              return false;
+            }),
+        rings.end());
+  }
+
+  uint32_t registerName(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = indices.find(name);
+    if (it != indices.end()) {
+      return it->second;
+    }
+    if (names.size() == kSonarMaxTraceNames) {
+      return kNoName;
+    }
+    const uint32_t index = names.size();
+    names.push_back(name);
+    indices.emplace(name, index);
+    return index;
+  }
+
+  // Since the core was created, so that they stay exact as JavaScript
+  // numbers.
+  uint64_t now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+
+  const uint64_t id;
+  const size_t capacity;
+  const std::chrono::steady_clock::time_point start;
+
+  // Everything below is guarded by mutex.
+  std::mutex mutex;
+  std::vector<std::string> names;
+  std::unordered_map<std::string, uint32_t> indices;
+  // In the order their threads first recorded.
+  std::vector<std::unique_ptr<SonarTraceRing>> rings;
+  uint32_t nextThread = 0;
+};
+
+} // namespace detail
+
+using detail::SonarTraceCore;
+
+void SonarTraceName::record(SonarTracePhase phase) const {
+  if (core_) {
+    core_->ring().write(core_->now(), index_, phase);
+  }
+}
+
+SonarTracePlugin::SonarTracePlugin(
+    size_t eventsPerThread,
+    std::chrono::milliseconds flushInterval)
+    : flushInterval_(flushInterval),
+      core_(std::make_shared<SonarTraceCore>(eventsPerThread)) {}
+
+SonarTracePlugin::~SonarTracePlugin() {
+  stopFlushing();
+}
+
+SonarTraceName SonarTracePlugin::name(const std::string& name) {
+  const auto index = core_->registerName(name);
+  return index == detail::kNoName ? SonarTraceName()
+                                  : SonarTraceName(core_, index);
+}
+
+std::string SonarTracePlugin::identifier() const {
+  return kIdentifier;
+}
+
+void SonarTracePlugin::didConnect(std::shared_ptr<SonarConnection> conn) {
+  stopFlushing();
+  conn->receive(
+      "stream",
+      [this](const folly::dynamic& params, std::unique_ptr<SonarResponder> responder) {
+        const bool enabled = params.getDefault("enabled", false).asBool();
+        if (enabled && !streaming_) {
+          // The stream starts now, older events are only sent by a dump.
+          std::lock_guard<std::mutex> lock(core_->mutex);
+          for (auto& ring : core_->rings) {
+            ring->tail = ring->head.load(std::memory_order_acquire);
+          }
+        }
+        streaming_ = enabled;
+        responder->success(folly::dynamic::object());
+      });
+  conn->receive(
+      "dump",
+      [this](const folly::dynamic&, std::unique_ptr<SonarResponder> responder) {
+        dump();
+        responder->success(folly::dynamic::object());
+      });
+  {
+    std::lock_guard<std::mutex> lock(connectionMutex_);
+    connection_ = std::move(conn);
+    sentNames_ = 0;
+    sentThreads_ = 0;
+  }
+  streaming_ = false;
+  stopFlusher_ = false;
+  flusher_ = std::thread([this] {
+    std::unique_lock<std::mutex> lock(flusherMutex_);
+    while (!flusherWakeup_.wait_for(
+        lock, flushInterval_, [this] { return stopFlusher_; })) {
+      lock.unlock();
+      if (streaming_) {
+        flush();
+      }
+      lock.lock();
+    }
+  });
+}
+
+void SonarTracePlugin::didDisconnect() {
+  stopFlushing();
+  streaming_ = false;
+  std::lock_guard<std::mutex> lock(connectionMutex_);
+  connection_ = nullptr;
+}
+
+void SonarTracePlugin::stopFlushing() {
+  if (!flusher_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(flusherMutex_);
+    stopFlusher_ = true;
+  }
+  flusherWakeup_.notify_all();
+  flusher_.join();
+}
+
+void SonarTracePlugin::flush() {
+  sendChunk(false);
+}
+
+void SonarTracePlugin::dump() {
+  sendChunk(true);
+}
+
+namespace {
+
+void writeLittleEndian(uint8_t* out, uint64_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; i++) {
+    out[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+std::unique_ptr<folly::IOBuf> encodeEvents(
+    const std::vector<detail::Event>& events) {
+  const size_t size = events.size() * detail::kSonarTraceRecordSize;
+  auto data = folly::IOBuf::create(size);
+  uint8_t* out = data->writableData();
+  for (const auto& event : events) {
+    writeLittleEndian(out, event.timestamp, 8);
+    writeLittleEndian(out + 8, event.name, 4);
+    writeLittleEndian(out + 12, event.thread, 2);
+    out[14] = event.phase;
+    out[15] = 0;
+    out += detail::kSonarTraceRecordSize;
+  }
+  data->append(size);
+  return data;
+}
+
+} // namespace
+
+void SonarTracePlugin::sendChunk(bool dump) {
+  std::lock_guard<std::mutex> connectionLock(connectionMutex_);
+  if (!connection_ || !connection_->isActive()) {
+    return;
+  }
+
+  std::vector<detail::Event> events;
+  uint64_t dropped = 0;
+  folly::dynamic metadata = folly::dynamic::object;
+
+  auto& core = *core_;
+  {
+    std::lock_guard<std::mutex> lock(core.mutex);
+    for (auto& ring : core.rings) {
+      const uint64_t head = ring->head.load(std::memory_order_acquire);
+      const uint64_t oldest =
+          head > ring->capacity() ? head - ring->capacity() : 0;
+      if (dump) {
+        ring->read(oldest, head, events);
+        continue;
+      }
+      const uint64_t from = std::max(ring->tail, oldest);
+      dropped += from - ring->tail + ring->read(from, head, events);
+      ring->tail = head;
+    }
+    if (!dump) {
+      // Nothing is left to send of threads that exited, once the desktop
+      // knows about them.
+      core.rings.erase(
+          std::remove_if(
+              core.rings.begin(),
+              core.rings.end(),
+              [this](const std::unique_ptr<detail::SonarTraceRing>& ring) {
+                return ring->retired && ring->index < sentThreads_ &&
+                    ring->tail == ring->head.load();
+              }),
+          core.rings.end());
+    }
+    if (events.empty() && dropped == 0 && !dump) {
+      return;
+    }
+
+    // Names and threads go out once per connection, events refer to them
+    // by index.
+    if (sentNames_ < core.names.size()) {
+      auto names = folly::dynamic::array();
+      for (size_t i = sentNames_; i < core.names.size(); i++) {
+        names.push_back(core.names[i]);
+      }
+      metadata["names"] = folly::dynamic::object(
+          "offset", static_cast<int64_t>(sentNames_))("names", std::move(names));
+      sentNames_ = core.names.size();
+    }
+    auto threads = folly::dynamic::array();
+    for (const auto& ring : core.rings) {
+      if (ring->index >= sentThreads_) {
+        threads.push_back(folly::dynamic::array(
+            static_cast<uint16_t>(ring->index),
+            static_cast<int64_t>(ring->threadId),
+            ring->threadName));
+      }
+    }
+    if (!threads.empty()) {
+      metadata["threads"] = std::move(threads);
+    }
+    sentThreads_ = core.nextThread;
+  }
+
+  metadata["count"] = static_cast<int64_t>(events.size());
+  metadata["dropped"] = static_cast<int64_t>(dropped);
+  metadata["dump"] = dump;
+  if (connection_->supportsBinary()) {
+    connection_->sendBinary("traceChunk", metadata, encodeEvents(events));
+    return;
+  }
+  // The same records, as a flat list of their fields.
+  connection_->sendWith("traceChunk", [&](SonarMessageWriter& writer) {
+    for (const auto& item : metadata.items()) {
+      writer.putDynamic(item.first.asString(), item.second);
+    }
+    writer.beginArray("events");
+    for (const auto& event : events) {
+      writer.add(event.timestamp)
+          .add(event.name)
+          .add(static_cast<uint32_t>(event.thread))
+          .add(static_cast<uint32_t>(event.phase));
+    }
+    writer.endArray();
+  });
+}
+
+} // namespace sonar
+} // namespace facebook
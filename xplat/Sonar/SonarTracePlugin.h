@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarPlugin.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace facebook {
+namespace sonar {
+
+namespace detail {
+
+constexpr size_t kSonarMaxTraceNames = 1 << 16;
+// Bytes per event in a "traceChunk" binary payload: a uint64 timestamp in
+// nanoseconds, a uint32 name index, a uint16 thread index, a uint8 phase and
+// a zero byte, all little endian.
+constexpr size_t kSonarTraceRecordSize = 16;
+
+class SonarTraceCore;
+
+} // namespace detail
+
+/**
+ The phase of an event, with the values of the Chrome trace event format.
+ */
+enum class SonarTracePhase : uint8_t {
+  Begin = 'B',
+  End = 'E',
+  Instant = 'i',
+};
+
+/**
+ A name to record trace events with. Cheap to copy. Recording is lock free
+ and doesn't allocate other than the first time a thread records any event.
+ Ends are matched with the latest begin on the same thread, whatever their
+ name.
+ */
+class SonarTraceName {
+ public:
+  SonarTraceName() = default;
+
+  void begin() const {
+    record(SonarTracePhase::Begin);
+  }
+
+  void end() const {
+    record(SonarTracePhase::End);
+  }
+
+  void instant() const {
+    record(SonarTracePhase::Instant);
+  }
+
+  void record(SonarTracePhase phase) const;
+
+ private:
+  friend class SonarTracePlugin;
+  SonarTraceName(std::shared_ptr<detail::SonarTraceCore> core, uint32_t index)
+      : core_(std::move(core)), index_(index) {}
+
+  // Null once the plugin ran out of names; recording does nothing then.
+  std::shared_ptr<detail::SonarTraceCore> core_;
+  uint32_t index_ = 0;
+};
+
+/**
+ Begins name when constructed and ends it when destroyed.
+ */
+class SonarTraceScope {
+ public:
+  explicit SonarTraceScope(const SonarTraceName& name) : name_(name) {
+    name_.begin();
+  }
+
+  ~SonarTraceScope() {
+    name_.end();
+  }
+
+  SonarTraceScope(const SonarTraceScope&) = delete;
+  SonarTraceScope& operator=(const SonarTraceScope&) = delete;
+
+ private:
+  const SonarTraceName& name_;
+};
+
+/**
+ Records begin, end and instant events for the desktop's Trace plugin.
+ Each thread writes its events into a ring of its own, overwriting the
+ oldest once it is full, with plain atomic stores and without locking or
+ allocating.
+
+ While the desktop streams, what was recorded since the previous flush is
+ sent every flushInterval as a "traceChunk", as a binary payload where the
+ desktop supports it. Otherwise, or on a "dump" call, the rings can be sent
+ as they are. Events overwritten before they could be sent are counted as
+ dropped.
+
+ Names are looked up once, and the handle kept:
+
+   static auto decode = tracePlugin->name("decode");
+   SonarTraceScope scope(decode);
+
+ Past detail::kSonarMaxTraceNames names, the handles do nothing. Rings
+ take 16 bytes per event of capacity for each thread that records.
+ */
+class SonarTracePlugin : public SonarPlugin {
+ public:
+  static constexpr const char* kIdentifier = "Trace";
+
+  /**
+   eventsPerThread is rounded up to a power of two.
+   */
+  explicit SonarTracePlugin(
+      size_t eventsPerThread = 4096,
+      std::chrono::milliseconds flushInterval = std::chrono::milliseconds(250));
+
+  ~SonarTracePlugin();
+
+  SonarTraceName name(const std::string& name);
+
+  std::string identifier() const override;
+  void didConnect(std::shared_ptr<SonarConnection> conn) override;
+  void didDisconnect() override;
+
+  /**
+   Sends the events recorded since the last flush, unless there are none.
+   Called on the plugin's own thread while the desktop streams.
+   */
+  void flush();
+
+  /**
+   Sends everything the rings hold, whether it was streamed already or not.
+   */
+  void dump();
+
+ private:
+  void sendChunk(bool dump);
+  void stopFlushing();
+
+  const std::chrono::milliseconds flushInterval_;
+  const std::shared_ptr<detail::SonarTraceCore> core_;
+
+  std::mutex connectionMutex_;
+  std::shared_ptr<SonarConnection> connection_;
+  // How many names and threads the desktop has been sent on connection_.
+  size_t sentNames_ = 0;
+  size_t sentThreads_ = 0;
+
+  std::atomic<bool> streaming_{false};
+  std::thread flusher_;
+  std::mutex flusherMutex_;
+  std::condition_variable flusherWakeup_;
+  bool stopFlusher_ = false;
+};
+
+} // namespace sonar
+} // namespace facebook
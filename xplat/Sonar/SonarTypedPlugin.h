@@ -0,0 +1,241 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarConnection.h>
+#include <Sonar/SonarFields.h>
+#include <Sonar/SonarPlugin.h>
+#include <folly/dynamic.h>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+
+template <typename M>
+struct SonarReceiverEntry {
+  const char* name;
+  M method;
+};
+
+template <typename M>
+constexpr SonarReceiverEntry<M> sonarReceiver(const char* name, M method) {
+  return SonarReceiverEntry<M>{name, method};
+}
+
+namespace detail {
+
+template <typename Plugin, typename Base>
+void callSonarReceiver(
+    Plugin& plugin,
+    void (Base::*method)(
+        const folly::dynamic&,
+        std::unique_ptr<SonarResponder>),
+    const folly::dynamic& params,
+    std::unique_ptr<SonarResponder> responder) {
+  (plugin.*method)(params, std::move(responder));
+}
+
+template <typename Plugin, typename Base, typename Params>
+typename std::enable_if<HasSonarFields<Params>::value>::type
+callSonarReceiver(
+    Plugin& plugin,
+    void (Base::*method)(const Params&, std::unique_ptr<SonarResponder>),
+    const folly::dynamic& params,
+    std::unique_ptr<SonarResponder> responder) {
+  Params typed;
+  readSonarFields(params, typed);
+  (plugin.*method)(typed, std::move(responder));
+}
+
+inline uint32_t sonarMethodHash(const char* data, size_t size, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+  }
+  return hash;
+}
+
+} // namespace detail
+
+/**
+ Dispatches calls to the receivers in Plugin::sonarReceivers(), see
+ SonarTypedPlugin. Method names are looked up in a perfect hash table built
+ once, when the plugin connects, so a call costs one hash, one string
+ compare and a call through a plain function pointer.
+ */
+template <typename Plugin>
+class SonarTypedDispatcher : public SonarCallDispatcher {
+  using Receivers = decltype(Plugin::sonarReceivers());
+  using Thunk = void (*)(
+      Plugin&,
+      const folly::dynamic&,
+      std::unique_ptr<SonarResponder>);
+  static constexpr size_t kCount = std::tuple_size<Receivers>::value;
+
+ public:
+  explicit SonarTypedDispatcher(Plugin* plugin)
+      : plugin_(plugin),
+        thunks_(makeThunks(std::make_index_sequence<kCount>())) {
+    constexpr auto receivers = Plugin::sonarReceivers();
+    names_ = makeNames(receivers, std::make_index_sequence<kCount>());
+    buildTable();
+  }
+
+  int find(const std::string& method) const override {
+    if (slots_.empty()) {
+      return -1;
+    }
+    const int index = slots_
+        [detail::sonarMethodHash(method.data(), method.size(), seed_) &
+         (slots_.size() - 1)];
+    return index >= 0 && names_[index] == method ? index : -1;
+  }
+
+  void dispatch(
+      int index,
+      const folly::dynamic& params,
+      std::unique_ptr<SonarResponder> responder) override {
+    thunks_[index](*plugin_, params, std::move(responder));
+  }
+
+  std::vector<std::string> methods() const override {
+    return names_;
+  }
+
+ private:
+  template <size_t I>
+  static void invokeAt(
+      Plugin& plugin,
+      const folly::dynamic& params,
+      std::unique_ptr<SonarResponder> responder) {
+    constexpr auto receivers = Plugin::sonarReceivers();
+    detail::callSonarReceiver(
+        plugin, std::get<I>(receivers).method, params, std::move(responder));
+  }
+
+  template <size_t... I>
+  static std::array<Thunk, kCount> makeThunks(std::index_sequence<I...>) {
+    return {{&invokeAt<I>...}};
+  }
+
+  template <size_t... I>
+  static std::vector<std::string> makeNames(
+      const Receivers& receivers,
+      std::index_sequence<I...>) {
+    return {std::string(std::get<I>(receivers).name)...};
+  }
+
+  // Tries seeds until every name has a slot of its own; with at least twice
+  // as many slots as names that takes a few tries.
+  void buildTable() {
+    if (names_.empty()) {
+      return;
+    }
+    size_t size = 1;
+    while (size < 2 * names_.size()) {
+      size *= 2;
+    }
+    for (uint32_t attempt = 0;; attempt++) {
+      if (attempt > 0 && attempt % 64 == 0) {
+        size *= 2;
+      }
+      std::vector<int> slots(size, -1);
+      bool collided = false;
+      for (size_t i = 0; i < names_.size() && !collided; i++) {
+        auto& slot = slots
+            [detail::sonarMethodHash(
+                 names_[i].data(), names_[i].size(), attempt) &
+             (size - 1)];
+        if (slot >= 0 && names_[slot] == names_[i]) {
+          throw std::logic_error("Duplicate receiver " + names_[i]);
+        }
+        collided = slot >= 0;
+        slot = static_cast<int>(i);
+      }
+      if (!collided) {
+        slots_ = std::move(slots);
+        seed_ = attempt;
+        return;
+      }
+    }
+  }
+
+  Plugin* const plugin_;
+  const std::array<Thunk, kCount> thunks_;
+  std::vector<std::string> names_;
+  std::vector<int> slots_;
+  uint32_t seed_ = 0;
+};
+
+/**
+ Base for native plugins whose receivers are member functions, listed in a
+ static constexpr sonarReceivers():
+
+   class LayoutPlugin : public SonarTypedPlugin<LayoutPlugin> {
+    public:
+     std::string identifier() const override {
+       return "Layout";
+     }
+
+     void getRoot(const dynamic& params, std::unique_ptr<SonarResponder>);
+     void setHighlighted(const Highlight& params,
+                         std::unique_ptr<SonarResponder>);
+
+     static constexpr auto sonarReceivers() {
+       return std::make_tuple(
+           sonarReceiver("getRoot", &LayoutPlugin::getRoot),
+           sonarReceiver("setHighlighted", &LayoutPlugin::setHighlighted));
+     }
+   };
+
+ A receiver takes either the params as a folly::dynamic, or a type with
+ sonarFields() that they are read into, see SonarFields.h. Plugins can
+ hide onConnect and onDisconnect, which are called after connection() has
+ been set and before it is cleared.
+ */
+template <typename Derived>
+class SonarTypedPlugin : public SonarPlugin {
+ public:
+  void didConnect(std::shared_ptr<SonarConnection> conn) override {
+    conn->setDispatcher(std::make_shared<SonarTypedDispatcher<Derived>>(
+        static_cast<Derived*>(this)));
+    connection_ = std::move(conn);
+    static_cast<Derived*>(this)->onConnect();
+  }
+
+  void didDisconnect() override {
+    static_cast<Derived*>(this)->onDisconnect();
+    connection_ = nullptr;
+  }
+
+ protected:
+  void onConnect() {}
+
+  void onDisconnect() {}
+
+  /**
+   Null while disconnected.
+   */
+  const std::shared_ptr<SonarConnection>& connection() const {
+    return connection_;
+  }
+
+ private:
+  std::shared_ptr<SonarConnection> connection_;
+};
+
+} // namespace sonar
+} // namespace facebook
@@ -8,7 +8,12 @@
 
 #pragma once
 
+#include <Sonar/SonarMessageEncoding.h>
+#include <Sonar/SonarMetrics.h>
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
 #include <folly/json.h>
+#include <memory>
 
 namespace facebook {
 namespace sonar {
@@ -31,8 +36,17 @@ class SonarWebSocket {
   virtual void stop() = 0;
 
   /**
-   True if there's an open connection.
-   This method may block if the connection is busy.
+   While suspended, as when the app is in the background, messages are held
+   rather than sent and a dropped connection isn't reconnected, but the
+   connection and the plugins connected over it are kept, so that resuming
+   picks up where it left off. Sockets that can't suspend ignore it.
+   */
+  virtual void setSuspended(bool suspended) {}
+
+  /**
+   True if there's an open and trusted connection.
+   Lock-free, so it is cheap enough to call before doing any work that is
+   only useful while connected.
    */
   virtual bool isOpen() const = 0;
 
@@ -41,6 +55,120 @@ class SonarWebSocket {
    */
   virtual void sendMessage(const folly::dynamic& message) = 0;
 
+  /**
+   Send message to the ws server, taking ownership of it so that
+   implementations can avoid copying large messages.
+   */
+  virtual void sendMessage(folly::dynamic&& message) {
+    sendMessage(static_cast<const folly::dynamic&>(message));
+  }
+
+  /**
+   Send an "execute" message for the given plugin api and method. This is the
+   hot path for plugin traffic, so implementations may serialize the fixed
+   envelope once and only serialize params per message.
+   */
+  virtual void sendExecute(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      folly::dynamic&& params) {
+    sendMessage(folly::dynamic::object("method", "execute")(
+        "params",
+        folly::dynamic::object("api", api)("method", method)(
+            "params", std::move(params))));
+  }
+
+  /**
+   Same as sendExecute, but the message replaces any message for the same
+   api and key that has not been sent yet, so that a burst of updates where
+   only the newest value matters goes out as a single message.
+   */
+  virtual void sendExecuteLatest(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      folly::StringPiece key,
+      folly::dynamic&& params) {
+    sendExecute(api, method, std::move(params));
+  }
+
+  /**
+   Sends a message that is already serialized as JSON. Implementations that
+   speak JSON can pass it through without parsing it.
+   */
+  virtual void sendJson(std::string message) {
+    sendMessage(folly::parseJson(message));
+  }
+
+  /**
+   Same as sendExecute, for params that are already serialized as JSON.
+   */
+  virtual void sendExecuteJson(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      std::string params) {
+    sendExecute(api, method, folly::parseJson(params));
+  }
+
+  /**
+   Sends an "execute" message that was already serialized with
+   serializeExecute, so that a message going to several sockets is only
+   serialized once. Returns false without sending anything if the socket
+   doesn't currently speak the given encoding, in which case callers should
+   fall back to sendExecute.
+   */
+  virtual bool sendSerializedExecute(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      const std::string& payload,
+      SonarMessageEncoding encoding) {
+    return false;
+  }
+
+  /**
+   Encoding sendSerializedExecute currently accepts.
+   */
+  virtual SonarMessageEncoding getEncoding() const {
+    return SonarMessageEncoding::JSON;
+  }
+
+  /**
+   Sends an "execute" whose envelope and metadata travel as the frame
+   metadata and whose data is the given buffer, without copying or
+   transcoding it. Returns false without sending anything if the connection
+   can't carry binary frames, in which case callers should fall back to
+   sendExecute.
+   */
+  virtual bool sendBinary(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      const folly::dynamic& metadata,
+      std::unique_ptr<folly::IOBuf> data) {
+    return false;
+  }
+
+  virtual bool supportsBinary() const {
+    return false;
+  }
+
+  /**
+   Number of bytes accepted by sendMessage that have not been written to the
+   connection yet.
+   */
+  virtual size_t getBufferedBytes() const {
+    return 0;
+  }
+
+  /**
+   Request a single Callbacks::onOutboundQueueDrained() call once all
+   buffered bytes have been written.
+   */
+  virtual void notifyWhenDrained() {}
+
+  /**
+   Metrics to record per plugin traffic into. Must be set before start().
+   */
+  virtual void setMetrics(std::shared_ptr<SonarMetrics> metrics) {}
+
   /**
    Handler for connection and message receipt from the ws server.
    The callbacks should be set before a connection is established.
@@ -57,6 +185,21 @@ class SonarWebSocket::Callbacks {
   virtual void onDisconnected() = 0;
 
   virtual void onMessageReceived(const folly::dynamic& message) = 0;
+
+  /**
+   Whether execute calls for the given plugin would reach a receiver. Sockets
+   may skip parsing the params of calls that wouldn't, and only pass on
+   their id, plugin and method. Called on the socket's thread, for every
+   call, so it must not block.
+   */
+  virtual bool willDispatch(const std::string& api) {
+    return true;
+  }
+
+  /**
+   Called after notifyWhenDrained() once the outbound buffer is empty.
+   */
+  virtual void onOutboundQueueDrained() {}
 };
 
 } // namespace sonar
@@ -7,16 +7,25 @@
  */
 
 #include "SonarWebSocketImpl.h"
+#include "SonarCompression.h"
+#include "SonarMessageEncoding.h"
+#include "SonarRSocketStats.h"
 #include "SonarStep.h"
+#include "SonarTrace.h"
 #include "ConnectionContextStore.h"
 #include "Log.h"
+#include <folly/Random.h>
 #include <folly/String.h>
 #include <folly/futures/Future.h>
+#include <folly/io/async/AsyncSSLSocket.h>
 #include <folly/io/async/SSLContext.h>
 #include <folly/json.h>
 #include <rsocket/Payload.h>
 #include <rsocket/RSocket.h>
+#include <rsocket/internal/WarmResumeManager.h>
 #include <rsocket/transports/tcp/TcpConnectionFactory.h>
+#include <rsocket/transports/tcp/TcpDuplexConnection.h>
+#include <algorithm>
 #include <thread>
 #include <folly/io/async/AsyncSocketException.h>
 #include <stdexcept>
@@ -24,37 +33,90 @@
 #define WRONG_THREAD_EXIT_MSG \
   "ERROR: Aborting sonar initialization because it's not running in the sonar thread."
 
-static constexpr int reconnectIntervalSeconds = 2;
-static constexpr int connectionKeepaliveSeconds = 10;
 static constexpr int securePort = 8088;
 static constexpr int insecurePort = 8089;
+static constexpr size_t maxCachedEnvelopes = 1024;
+static constexpr int resumeRetryDelayMs = 500;
 
 namespace facebook {
 namespace sonar {
 
+static size_t messageBytes(const SonarOutboundMessage& message) {
+  return message.payload.size() +
+      (message.data ? message.data->computeChainDataLength() : 0);
+}
+
+static std::vector<std::string> withFallbackHosts(
+    const std::string& host,
+    const std::vector<std::string>& fallbackHosts) {
+  std::vector<std::string> hosts{host};
+  hosts.insert(hosts.end(), fallbackHosts.begin(), fallbackHosts.end());
+  return hosts;
+}
+
 class ConnectionEvents : public rsocket::RSocketConnectionEvents {
  private:
   SonarWebSocketImpl* websocket_;
+  const uint64_t attempt_;
+
+  // False for a client whose attempt timed out, it isn't the connection
+  // anymore.
+  bool isCurrent() const {
+    return attempt_ == websocket_->connectAttempt_;
+  }
 
  public:
-  ConnectionEvents(SonarWebSocketImpl* websocket) : websocket_(websocket) {}
+  ConnectionEvents(SonarWebSocketImpl* websocket)
+      : websocket_(websocket), attempt_(websocket->connectAttempt_) {}
 
   void onConnected() {
-    websocket_->isOpen_ = true;
-    if (websocket_->connectionIsTrusted_) {
+    if (!isCurrent()) {
+      return;
+    }
+    using State = SonarWebSocketImpl::ConnectionState;
+    const bool trusted = websocket_->connectingSecurely_;
+    auto expected = State::Connecting;
+    if (!websocket_->state_.compare_exchange_strong(
+            expected, trusted ? State::Trusted : State::Insecure)) {
+      // Stopped while connecting.
+      return;
+    }
+    if (trusted) {
       websocket_->callbacks_->onConnected();
     }
   }
 
   void onDisconnected(const folly::exception_wrapper&) {
-    if (!websocket_->isOpen_)
+    if (!isCurrent()) {
+      return;
+    }
+    using State = SonarWebSocketImpl::ConnectionState;
+    const bool resumable = websocket_->resumeBufferBytes_ > 0;
+    auto previous = websocket_->state_.load();
+    State next;
+    do {
+      if (previous != State::Insecure && previous != State::Trusted &&
+          previous != State::Closing) {
+        return;
+      }
+      if (previous == State::Closing) {
+        next = State::Closing;
+      } else if (previous == State::Trusted && resumable) {
+        next = State::Resuming;
+      } else {
+        next = State::Idle;
+      }
+    } while (!websocket_->state_.compare_exchange_weak(previous, next));
+    if (next == State::Resuming) {
+      websocket_->resume();
       return;
-    websocket_->isOpen_ = false;
-    if (websocket_->connectionIsTrusted_) {
-      websocket_->connectionIsTrusted_ = false;
+    }
+    if (previous != State::Insecure) {
       websocket_->callbacks_->onDisconnected();
     }
-    websocket_->reconnect();
+    if (previous != State::Closing) {
+      websocket_->reconnect();
+    }
   }
 
   void onClosed(const folly::exception_wrapper& e) {
@@ -62,6 +124,39 @@ class ConnectionEvents : public rsocket::RSocketConnectionEvents {
   }
 };
 
+// Does the client side TLS handshake on a socket that is already connected,
+// deleting itself once it is done.
+class TlsHandshake : public folly::AsyncSSLSocket::HandshakeCB {
+ public:
+  static folly::Future<folly::AsyncSocket::UniquePtr> start(
+      folly::AsyncSSLSocket::UniquePtr socket,
+      std::chrono::milliseconds timeout) {
+    auto handshake = new TlsHandshake(std::move(socket));
+    auto done = handshake->promise_.getFuture();
+    handshake->socket_->sslConn(handshake, timeout);
+    return done;
+  }
+
+  void handshakeSuc(folly::AsyncSSLSocket*) noexcept override {
+    promise_.setValue(std::move(socket_));
+    delete this;
+  }
+
+  void handshakeErr(
+      folly::AsyncSSLSocket*,
+      const folly::AsyncSocketException& error) noexcept override {
+    promise_.setException(error);
+    delete this;
+  }
+
+ private:
+  explicit TlsHandshake(folly::AsyncSSLSocket::UniquePtr socket)
+      : socket_(std::move(socket)) {}
+
+  folly::AsyncSSLSocket::UniquePtr socket_;
+  folly::Promise<folly::AsyncSocket::UniquePtr> promise_;
+};
+
 class Responder : public rsocket::RSocketResponder {
  private:
   SonarWebSocketImpl* websocket_;
@@ -72,22 +167,110 @@ class Responder : public rsocket::RSocketResponder {
   void handleFireAndForget(
       rsocket::Payload request,
       rsocket::StreamId streamId) {
-    const auto payload = request.moveDataToString();
-    websocket_->callbacks_->onMessageReceived(folly::parseJson(payload));
+    SONAR_TRACE_SCOPE("handleFireAndForget");
+    const auto start = std::chrono::steady_clock::now();
+    // Parse straight out of the frame's buffer, frames rarely arrive in
+    // more than one piece.
+    folly::StringPiece frame;
+    if (request.data) {
+      const auto bytes = request.data->coalesce();
+      frame = folly::StringPiece(
+          reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+    const auto size = frame.size();
+    std::string inflated;
+    if (isDeflatedFrame(frame)) {
+      inflated = inflateFrame(frame);
+      frame = inflated;
+    }
+    // The desktop only sends binary frames once it has seen our advertised
+    // encodings, so mirror whatever it last used for outgoing messages.
+    websocket_->encoding_ = detectEncoding(frame);
+
+    // Calls that won't be dispatched are answered with an error either way,
+    // so don't materialize their params.
+    folly::dynamic message = nullptr;
+    SonarExecuteRoute route;
+    if (peekExecuteRoute(frame, route) &&
+        !websocket_->callbacks_->willDispatch(route.api)) {
+      message = folly::dynamic::object("method", "execute")(
+          "params",
+          folly::dynamic::object("api", route.api)("method", route.method));
+      if (route.id) {
+        message["id"] = *route.id;
+      }
+    } else {
+      SONAR_TRACE_SCOPE("deserializeMessage");
+      message = deserializeMessage(frame);
+    }
+    if (message.getDefault("method") == "execute") {
+      const auto& params = message.getDefault("params");
+      const auto& api = params.getDefault("api");
+      const auto& method = params.getDefault("method");
+      if (api.isString() && method.isString()) {
+        if (auto metrics =
+                websocket_->metricsFor(api.getString(), method.getString())) {
+          metrics->messagesReceived++;
+          metrics->bytesReceived += size;
+          metrics->parseMicros += microsSince(start);
+        }
+      }
+    }
+    if (message.getDefault("binary", false) == true) {
+      websocket_->peerAcceptsBinary_ = true;
+    }
+    if (message.getDefault("compression") == kDeflateCompression) {
+      websocket_->peerAcceptsDeflate_ = true;
+    }
+    if (message.getDefault("fragments", false) == true) {
+      websocket_->peerAcceptsFragments_ = true;
+    }
+    if (message.getDefault("columnar", false) == true) {
+      websocket_->peerAcceptsColumnar_ = true;
+    }
+    websocket_->callbacks_->onMessageReceived(message);
   }
 };
 
 SonarWebSocketImpl::SonarWebSocketImpl(SonarInitConfig config, std::shared_ptr<SonarState> state, std::shared_ptr<ConnectionContextStore> contextStore)
-    : deviceData_(config.deviceData), sonarState_(state), sonarEventBase_(config.callbackWorker), connectionEventBase_(config.connectionWorker), contextStore_(contextStore) {
+    : deviceData_(config.deviceData), sonarState_(state), sonarEventBase_(config.callbackWorker), connectionEventBase_(config.connectionWorker),
+      compressionThreshold_(config.compressionThreshold),
+      keepaliveInterval_(std::max(config.keepaliveIntervalMs, 1000)),
+      connectTimeout_(config.connectTimeoutMs),
+      hostRace_(withFallbackHosts(config.deviceData.host, config.fallbackHosts)),
+      resumeBufferBytes_(config.resumeBufferBytes),
+      resumeWindow_(config.resumeWindowMs),
+      localSocketName_(config.localSocketName),
+      listenPort_(config.listenPort),
+      preopenSecureSocket_(config.preopenSecureSocket),
+      reconnectPolicy_(config.reconnectPolicy), contextStore_(contextStore),
+      lanes_(config.fragmentBytes),
+      outboundAccount_(SonarMemoryBudget::shared().open(
+          "Outbound queue",
+          [this](size_t bytes) {
+            sonarEventBase_->add([this, bytes]() { dropHeld(bytes); });
+          })),
+      suspendedBufferBytes_(config.suspendedBufferBytes),
+      batchWindowMs_(config.batchWindowMs), batchMaxBytes_(config.batchMaxBytes) {
       CHECK_THROW(config.callbackWorker, std::invalid_argument);
       CHECK_THROW(config.connectionWorker, std::invalid_argument);
     }
 
 SonarWebSocketImpl::~SonarWebSocketImpl() {
   stop();
+  if (csrThread_) {
+    // Waits for a CSR being generated, then for its continuation on the
+    // sonar thread, which finds the socket stopped. Destroyed on the sonar
+    // thread itself the continuation runs later, and finds alive_ expired.
+    csrThread_ = nullptr;
+    sonarEventBase_->runImmediatelyOrRunInEventBaseThreadAndWait([]() {});
+  }
+  alive_ = nullptr;
 }
 
 void SonarWebSocketImpl::start() {
+  auto closing = ConnectionState::Closing;
+  state_.compare_exchange_strong(closing, ConnectionState::Idle);
   auto step = sonarState_->start("Start connection thread");
   folly::makeFuture()
       .via(sonarEventBase_->getEventBase())
@@ -100,66 +283,119 @@ void SonarWebSocketImpl::startSync() {
     log(WRONG_THREAD_EXIT_MSG);
     return;
   }
-  if (isOpen()) {
+  const auto state = getConnectionState();
+  if (state == ConnectionState::Closing) {
+    log("Not connecting, the connection was stopped");
+    return;
+  }
+  if (state != ConnectionState::Idle) {
     log("Already connected");
     return;
   }
+  if (suspended_) {
+    reconnectWhenUnsuspended_ = true;
+    return;
+  }
+  secureConnectPending_ = false;
   auto connect = sonarState_->start("Connect to desktop");
-  try {
-    if (isCertificateExchangeNeeded()) {
-      doCertificateExchange();
-      return;
-    }
+  // Claimed before the context loads, so that nothing else starts
+  // connecting meanwhile.
+  beginConnecting();
+  // The certificates and config are read on the store's own thread, the
+  // sonar thread only decides how to connect once they are loaded.
+  contextStore_->load()
+      .via(sonarEventBase_->getEventBase())
+      .thenValue([this](auto&&) -> folly::Future<bool> {
+        if (getConnectionState() == ConnectionState::Closing) {
+          log("Not connecting, the connection was stopped");
+          return false;
+        }
+        const bool exchange = localSocketName_.empty() && listenPort_ == 0 &&
+            isCertificateExchangeNeeded();
+        // Not blocking the sonar thread on the connection attempt lets the
+        // connection run on the same EventBase.
+        return (exchange ? doCertificateExchange() : connectSecurely())
+            .thenValue([exchange](auto&&) { return !exchange; });
+      })
+      .via(sonarEventBase_->getEventBase())
+      .then([this, connect](folly::Try<bool> connectedSecurely) {
+        if (connectedSecurely.hasException()) {
+          connectAttemptFailed(connect, connectedSecurely.exception());
+          return;
+        }
+        if (connectedSecurely.value()) {
+          connect->complete();
+          reconnectAttempts_ = 0;
+        }
+      });
+}
 
-    connectSecurely();
-    connect->complete();
-  } catch (const folly::AsyncSocketException& e) {
-    if (e.getType() == folly::AsyncSocketException::NOT_OPEN) {
-      // The expected code path when flipper desktop is not running.
-      // Don't count as a failed attempt.
-      connect->fail("Port not open");
-    } else {
-      log(e.what());
-      failedConnectionAttempts_++;
-      connect->fail(e.what());
-    }
-    reconnect();
-  } catch (const std::exception& e) {
-    log(e.what());
-    connect->fail(e.what());
+void SonarWebSocketImpl::connectAttemptFailed(
+    std::shared_ptr<SonarStep> connect,
+    const folly::exception_wrapper& error) {
+  auto socketError = error.get_exception<folly::AsyncSocketException>();
+  const std::string message = error.what().toStdString();
+  if (socketError &&
+      socketError->getType() == folly::AsyncSocketException::NOT_OPEN) {
+    // The expected code path when flipper desktop is not running.
+    // Don't count as a failed attempt.
+    connect->fail("Port not open");
+  } else {
+    // Reconnect loops would otherwise log every few seconds.
+    SONAR_LOG_EVERY_MS(LogLevel::Warning, 60000, message);
     failedConnectionAttempts_++;
-    reconnect();
+    connect->fail(message);
   }
+  connectionEventBase_->getEventBase()->runInEventBaseThread(
+      [this]() { hostRace_.forget(); });
+  connectFailed();
+  reconnect();
 }
 
-void SonarWebSocketImpl::doCertificateExchange() {
+folly::Future<folly::SocketAddress> SonarWebSocketImpl::pickAddress(
+    uint16_t port) {
+  auto evb = connectionEventBase_->getEventBase();
+  return folly::via(
+      evb, [this, evb, port]() { return hostRace_.pick(evb, port); });
+}
 
+folly::Future<folly::Unit> SonarWebSocketImpl::doCertificateExchange() {
   rsocket::SetupParameters parameters;
-  folly::SocketAddress address;
 
   parameters.payload = rsocket::Payload(
       folly::toJson(folly::dynamic::object("os", deviceData_.os)(
           "device", deviceData_.device)("app", deviceData_.app)));
-  address.setFromHostPort(deviceData_.host, insecurePort);
 
   auto connectingInsecurely = sonarState_->start("Connect insecurely");
-  connectionIsTrusted_ = false;
-  client_ =
-      rsocket::RSocket::createConnectedClient(
-          std::make_unique<rsocket::TcpConnectionFactory>(
-              *connectionEventBase_->getEventBase(), std::move(address)),
-          std::move(parameters),
-          nullptr,
-          std::chrono::seconds(connectionKeepaliveSeconds), // keepaliveInterval
-          nullptr, // stats
-          std::make_shared<ConnectionEvents>(this))
-          .get();
-  connectingInsecurely->complete();
-
-  requestSignedCertFromSonar();
-}
-
-void SonarWebSocketImpl::connectSecurely() {
+  connectingSecurely_ = false;
+  beginConnecting();
+  return pickAddress(insecurePort)
+      .thenValue([this, parameters = std::move(parameters)](
+                     folly::SocketAddress address) mutable {
+        return withConnectTimeout(rsocket::RSocket::createConnectedClient(
+            std::make_unique<rsocket::TcpConnectionFactory>(
+                *connectionEventBase_->getEventBase(), std::move(address)),
+            std::move(parameters),
+            nullptr,
+            keepaliveInterval_,
+            stats_,
+            std::make_shared<ConnectionEvents>(this)));
+      })
+      .via(sonarEventBase_->getEventBase())
+      .thenValue([this, connectingInsecurely](
+                     std::unique_ptr<rsocket::RSocketClient> client) {
+        if (!adoptClient(std::move(client))) {
+          return;
+        }
+        connectingInsecurely->complete();
+        if (preopenSecureSocket_) {
+          preopenSecureSocket();
+        }
+        requestSignedCertFromSonar();
+      });
+}
+
+folly::Future<folly::Unit> SonarWebSocketImpl::connectSecurely() {
   rsocket::SetupParameters parameters;
   folly::SocketAddress address;
 
@@ -170,44 +406,364 @@ void SonarWebSocketImpl::connectSecurely() {
   }
   parameters.payload = rsocket::Payload(folly::toJson(folly::dynamic::object(
       "os", deviceData_.os)("device", deviceData_.device)(
-      "device_id", deviceId)("app", deviceData_.app)));
-  address.setFromHostPort(deviceData_.host, securePort);
-
-  std::shared_ptr<folly::SSLContext> sslContext = contextStore_->getSSLContext();
-  auto connectingSecurely = sonarState_->start("Connect securely");
-  connectionIsTrusted_ = true;
-  client_ =
-      rsocket::RSocket::createConnectedClient(
-          std::make_unique<rsocket::TcpConnectionFactory>(
-              *connectionEventBase_->getEventBase(),
-              std::move(address),
-              std::move(sslContext)),
-          std::move(parameters),
-          std::make_shared<Responder>(this),
-          std::chrono::seconds(connectionKeepaliveSeconds), // keepaliveInterval
-          nullptr, // stats
-          std::make_shared<ConnectionEvents>(this))
-          .get();
-  connectingSecurely->complete();
-  failedConnectionAttempts_ = 0;
+      "device_id", deviceId)("app", deviceData_.app)(
+      "encodings",
+      folly::dynamic::array(
+          encodingName(SonarMessageEncoding::MessagePack),
+          encodingName(SonarMessageEncoding::JSON)))(
+      "compression", folly::dynamic::array(kDeflateCompression))));
+  std::shared_ptr<folly::SSLContext> sslContext;
+  if (listenPort_ > 0) {
+    // Reached through listenPort_ instead.
+  } else if (localSocketName_.empty()) {
+    sslContext = contextStore_->getSSLContext();
+  } else {
+    // Leading NUL for the abstract namespace. Unlike TCP, nothing outside
+    // the device can connect to it, so plain text is as trusted as TLS.
+    address.setFromPath(std::string(1, '\0') + localSocketName_);
+  }
+
+  auto connectingSecurely = sonarState_->start(
+      listenPort_ > 0
+          ? "Wait for desktop to connect"
+          : localSocketName_.empty() ? "Connect securely" : "Connect locally");
+  connectingSecurely_ = true;
+  encoding_ = SonarMessageEncoding::JSON;
+  peerAcceptsBinary_ = false;
+  peerAcceptsDeflate_ = false;
+  peerAcceptsFragments_ = false;
+  peerAcceptsColumnar_ = false;
+  beginConnecting();
+  folly::Future<std::unique_ptr<rsocket::RSocketClient>> connected =
+      listenPort_ > 0 ? acceptClient(std::move(parameters))
+                      : !localSocketName_.empty()
+          ? connectClient(
+                std::move(address),
+                std::move(sslContext),
+                std::move(parameters))
+          : connectOverTcp(std::move(sslContext), std::move(parameters));
+  return std::move(connected)
+      .via(sonarEventBase_->getEventBase())
+      .thenValue([this, connectingSecurely](
+                     std::unique_ptr<rsocket::RSocketClient> client) {
+        if (!adoptClient(std::move(client))) {
+          return;
+        }
+        connectingSecurely->complete();
+        failedConnectionAttempts_ = 0;
+      });
+}
+
+folly::Future<std::unique_ptr<rsocket::RSocketClient>>
+SonarWebSocketImpl::connectClient(
+    folly::SocketAddress address,
+    std::shared_ptr<folly::SSLContext> sslContext,
+    rsocket::SetupParameters parameters) {
+  std::shared_ptr<rsocket::ResumeManager> resumeManager;
+  if (resumeBufferBytes_ > 0) {
+    parameters.resumable = true;
+    resumeManager = std::make_shared<rsocket::WarmResumeManager>(
+        stats_ ? stats_ : rsocket::RSocketStats::noop(), resumeBufferBytes_);
+  }
+  return withConnectTimeout(rsocket::RSocket::createConnectedClient(
+      std::make_unique<rsocket::TcpConnectionFactory>(
+          *connectionEventBase_->getEventBase(),
+          std::move(address),
+          std::move(sslContext)),
+      std::move(parameters),
+      std::make_shared<Responder>(this),
+      keepaliveInterval_,
+      stats_,
+      std::make_shared<ConnectionEvents>(this),
+      std::move(resumeManager)));
+}
+
+void SonarWebSocketImpl::preopenSecureSocket() {
+  auto evb = connectionEventBase_->getEventBase();
+  pickAddress(securePort)
+      .thenValue([this, evb](folly::SocketAddress address) {
+        // Connects in the background. TLS has to wait for the certificate.
+        preopenedSocket_.reset(new folly::AsyncSocket(
+            evb, address, static_cast<uint32_t>(connectTimeout_.count())));
+      })
+      .onError([](const folly::exception_wrapper& error) {
+        log(LogLevel::Warning, "Unable to preopen the secure connection: " +
+            error.what().toStdString());
+      });
+}
+
+folly::Future<std::unique_ptr<rsocket::RSocketClient>>
+SonarWebSocketImpl::connectOverTcp(
+    std::shared_ptr<folly::SSLContext> sslContext,
+    rsocket::SetupParameters parameters) {
+  auto evb = connectionEventBase_->getEventBase();
+  return folly::via(
+      evb,
+      [this, evb, sslContext, parameters = std::move(parameters)]() mutable
+      -> folly::Future<std::unique_ptr<rsocket::RSocketClient>> {
+        auto connectFresh = [this, sslContext](
+                                rsocket::SetupParameters parameters) {
+          return pickAddress(securePort)
+              .thenValue([this,
+                          sslContext,
+                          parameters = std::move(parameters)](
+                             folly::SocketAddress address) mutable {
+                return connectClient(
+                    std::move(address), sslContext, std::move(parameters));
+              });
+        };
+        auto socket = std::move(preopenedSocket_);
+        if (!socket || socket->connecting() || !socket->good()) {
+          return connectFresh(std::move(parameters));
+        }
+        // Only the TLS handshake is left, on the connection opened while
+        // the desktop signed the certificate. Such a connection can't be
+        // resumed, like accepted ones.
+        rsocket::SetupParameters fallback;
+        fallback.payload = parameters.payload.clone();
+        folly::AsyncSSLSocket::UniquePtr sslSocket(new folly::AsyncSSLSocket(
+            sslContext, evb, socket->detachFd(), false));
+        return TlsHandshake::start(std::move(sslSocket), connectTimeout_)
+            .thenValue([this, evb, parameters = std::move(parameters)](
+                           folly::AsyncSocket::UniquePtr secured) mutable {
+              return rsocket::RSocket::createClientFromConnection(
+                  std::make_unique<rsocket::TcpDuplexConnection>(
+                      std::move(secured)),
+                  *evb,
+                  std::move(parameters),
+                  nullptr,
+                  std::make_shared<Responder>(this),
+                  keepaliveInterval_,
+                  stats_,
+                  std::make_shared<ConnectionEvents>(this));
+            })
+            .onError([connectFresh, fallback = std::move(fallback)](
+                         const folly::exception_wrapper& error) mutable {
+              // The desktop may have dropped the idle connection meanwhile.
+              log(LogLevel::Warning, "Preopened connection failed, connecting again: " +
+                  error.what().toStdString());
+              return connectFresh(std::move(fallback));
+            });
+      });
+}
+
+folly::Future<std::unique_ptr<rsocket::RSocketClient>>
+SonarWebSocketImpl::withConnectTimeout(
+    folly::Future<std::unique_ptr<rsocket::RSocketClient>> connecting) {
+  if (connectTimeout_.count() <= 0) {
+    return connecting;
+  }
+  // The attempt itself can't be cancelled. If it still connects, the
+  // client is dropped and disconnects, with its events ignored.
+  return std::move(connecting)
+      .within(connectTimeout_)
+      .onError([this](const folly::FutureTimeout&)
+                   -> std::unique_ptr<rsocket::RSocketClient> {
+        connectAttempt_++;
+        // The client may have connected just as time ran out, it is
+        // dropped all the same. Back to Connecting, which the failure
+        // handling turns into Idle.
+        auto previous = state_.load();
+        if ((previous == ConnectionState::Trusted ||
+             previous == ConnectionState::Insecure) &&
+            state_.compare_exchange_strong(
+                previous, ConnectionState::Connecting) &&
+            previous == ConnectionState::Trusted) {
+          callbacks_->onDisconnected();
+        }
+        throw folly::AsyncSocketException(
+            folly::AsyncSocketException::TIMED_OUT,
+            "Timed out connecting to the desktop");
+      });
+}
+
+folly::Future<std::unique_ptr<rsocket::RSocketClient>>
+SonarWebSocketImpl::acceptClient(rsocket::SetupParameters parameters) {
+  auto evb = connectionEventBase_->getEventBase();
+  return folly::via(
+             evb,
+             [this, evb]() {
+               if (!serverTransport_) {
+                 serverTransport_ =
+                     std::make_unique<SonarServerTransport>(evb, listenPort_);
+               }
+               return serverTransport_->accept();
+             })
+      .thenValue([this, evb, parameters = std::move(parameters)](
+                     folly::AsyncSocket::UniquePtr socket) mutable {
+        // The desktop dialed in, but the device still plays the rsocket
+        // client, so that everything past the transport is the same as
+        // when connecting out.
+        return rsocket::RSocket::createClientFromConnection(
+            std::make_unique<rsocket::TcpDuplexConnection>(std::move(socket)),
+            *evb,
+            std::move(parameters),
+            nullptr,
+            std::make_shared<Responder>(this),
+            keepaliveInterval_,
+            stats_,
+            std::make_shared<ConnectionEvents>(this));
+      });
+}
+
+bool SonarWebSocketImpl::adoptClient(
+    std::unique_ptr<rsocket::RSocketClient> client) {
+  if (getConnectionState() == ConnectionState::Closing) {
+    // stop() was called while connecting.
+    client->disconnect();
+    return false;
+  }
+  client_ = std::move(client);
+  return true;
+}
+
+void SonarWebSocketImpl::beginConnecting() {
+  auto idle = ConnectionState::Idle;
+  state_.compare_exchange_strong(idle, ConnectionState::Connecting);
+}
+
+void SonarWebSocketImpl::connectFailed() {
+  auto connecting = ConnectionState::Connecting;
+  state_.compare_exchange_strong(connecting, ConnectionState::Idle);
+}
+
+void SonarWebSocketImpl::connectSecurelyAfterExchange() {
+  sonarEventBase_->add([this]() {
+    // Take over from the insecure connection's disconnect handling, which
+    // would only come back after the reconnect delay.
+    auto insecure = ConnectionState::Insecure;
+    state_.compare_exchange_strong(insecure, ConnectionState::Idle);
+    client_ = nullptr;
+    reconnectAttempts_ = 0;
+    startSync();
+  });
+}
+
+void SonarWebSocketImpl::resume() {
+  auto step = sonarState_->start("Resume connection");
+  const auto deadline = std::chrono::steady_clock::now() + resumeWindow_;
+  sonarEventBase_->add([this, step, deadline]() { tryResume(step, deadline); });
+}
+
+void SonarWebSocketImpl::tryResume(
+    std::shared_ptr<SonarStep> step,
+    std::chrono::steady_clock::time_point deadline) {
+  if (getConnectionState() != ConnectionState::Resuming || !client_) {
+    // Stopped while the connection was down.
+    return;
+  }
+  if (suspended_) {
+    // The window starts over once unsuspended, the desktop may well have
+    // kept the session that long.
+    resumeWhenUnsuspended_ = std::move(step);
+    return;
+  }
+  client_->resume()
+      .via(sonarEventBase_->getEventBase())
+      .then([this, step, deadline](folly::Try<folly::Unit> result) {
+        if (getConnectionState() != ConnectionState::Resuming) {
+          return;
+        }
+        if (result.hasValue()) {
+          auto resuming = ConnectionState::Resuming;
+          if (state_.compare_exchange_strong(
+                  resuming, ConnectionState::Trusted)) {
+            if (metrics_) {
+              metrics_->transport().resumptions++;
+            }
+            step->complete();
+          }
+          return;
+        }
+        if (std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(resumeRetryDelayMs) <
+            deadline) {
+          sonarEventBase_->runAfterDelay(
+              [this, step, deadline]() { tryResume(step, deadline); },
+              resumeRetryDelayMs);
+          return;
+        }
+        step->fail(result.exception().what().toStdString());
+        // Give up, and go through the usual disconnect and reconnect.
+        auto resuming = ConnectionState::Resuming;
+        if (state_.compare_exchange_strong(resuming, ConnectionState::Idle)) {
+          client_ = nullptr;
+          callbacks_->onDisconnected();
+          reconnect();
+        }
+      });
 }
 
 void SonarWebSocketImpl::reconnect() {
+  if (reconnectPolicy_.connectOnDemand && !secureConnectPending_) {
+    log("Not reconnecting until the client is started again");
+    return;
+  }
+  if (suspended_) {
+    // Picked up once unsuspended, without waiting out a delay.
+    reconnectWhenUnsuspended_ = true;
+    return;
+  }
   folly::makeFuture()
       .via(sonarEventBase_->getEventBase())
-      .delayed(std::chrono::seconds(reconnectIntervalSeconds))
+      .delayed(nextReconnectDelay())
       .thenValue([this](auto&&){ startSync(); });
 }
 
+std::chrono::milliseconds SonarWebSocketImpl::nextReconnectDelay() {
+  double delay = reconnectPolicy_.initialDelayMs;
+  for (int i = 0; i < reconnectAttempts_ && delay < reconnectPolicy_.maxDelayMs;
+       i++) {
+    delay *= reconnectPolicy_.multiplier;
+  }
+  delay = std::min(delay, static_cast<double>(reconnectPolicy_.maxDelayMs));
+  delay *= 1 + reconnectPolicy_.jitter * (2 * folly::Random::randDouble01() - 1);
+  reconnectAttempts_++;
+  return std::chrono::milliseconds(static_cast<int64_t>(std::max(delay, 0.0)));
+}
+
 void SonarWebSocketImpl::stop() {
+  state_ = ConnectionState::Closing;
   if (client_) {
     client_->disconnect();
   }
   client_ = nullptr;
+  if (serverTransport_ || preopenSecureSocket_) {
+    connectionEventBase_->runImmediatelyOrRunInEventBaseThreadAndWait(
+        [this]() {
+          serverTransport_ = nullptr;
+          preopenedSocket_ = nullptr;
+        });
+  }
+}
+
+void SonarWebSocketImpl::setSuspended(bool suspended) {
+  // On the sonar thread, so that messages drained before are sent and the
+  // ones drained after are held.
+  sonarEventBase_->add([this, suspended]() {
+    if (suspended_.exchange(suspended) == suspended) {
+      return;
+    }
+    sonarState_
+        ->start(suspended ? "Suspend connection" : "Unsuspend connection")
+        ->complete();
+    if (suspended) {
+      return;
+    }
+    reconnectAttempts_ = 0;
+    if (reconnectWhenUnsuspended_.exchange(false)) {
+      startSync();
+    }
+    if (auto step = std::move(resumeWhenUnsuspended_)) {
+      resumeWhenUnsuspended_ = nullptr;
+      tryResume(step, std::chrono::steady_clock::now() + resumeWindow_);
+    }
+    drainOutbound();
+  });
 }
 
 bool SonarWebSocketImpl::isOpen() const {
-  return isOpen_ && connectionIsTrusted_;
+  return getConnectionState() == ConnectionState::Trusted;
 }
 
 void SonarWebSocketImpl::setCallbacks(Callbacks* callbacks) {
@@ -215,13 +771,480 @@ void SonarWebSocketImpl::setCallbacks(Callbacks* callbacks) {
 }
 
 void SonarWebSocketImpl::sendMessage(const folly::dynamic& message) {
-  sonarEventBase_->add([this, message]() {
-    if (client_) {
-      client_->getRequester()
-          ->fireAndForget(rsocket::Payload(folly::toJson(message)))
-          ->subscribe([]() {});
+  SONAR_TRACE_SCOPE("sendMessage");
+  // Serialize on the calling thread so the sonar thread only has to hand
+  // ready payloads to rsocket, and producers never contend on a lock.
+  const SonarMessageEncoding encoding = encoding_;
+  enqueue(
+      encoding == SonarMessageEncoding::JSON && peerAcceptsColumnar_
+          ? toColumnarJson(message)
+          : serializeMessage(message, encoding),
+      encoding,
+      SonarMessagePriority::Interactive);
+}
+
+std::string SonarWebSocketImpl::envelopePrefix(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    SonarMessageEncoding encoding) {
+  std::lock_guard<std::mutex> lock(envelopeMutex_);
+  auto& prefixes = envelopePrefixes_[static_cast<size_t>(encoding)];
+  auto prefix = prefixes.find(std::make_pair(api, method));
+  if (prefix == prefixes.end()) {
+    if (prefixes.size() >= maxCachedEnvelopes) {
+      prefixes.clear();
     }
-  });
+    prefix = prefixes
+                 .emplace(
+                     std::make_pair(api.str(), method.str()),
+                     executeEnvelopePrefix(api, method, encoding))
+                 .first;
+  }
+  return prefix->second;
+}
+
+void SonarWebSocketImpl::sendExecute(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    folly::dynamic&& params) {
+  enqueueExecute(api, method, std::move(params), std::string());
+}
+
+void SonarWebSocketImpl::sendExecuteLatest(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    folly::StringPiece key,
+    folly::dynamic&& params) {
+  // Keys are only unique within a plugin.
+  std::string latestKey = api.str();
+  latestKey.push_back('\0');
+  latestKey.append(key);
+  enqueueExecute(api, method, std::move(params), std::move(latestKey));
+}
+
+void SonarWebSocketImpl::enqueueExecute(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    folly::dynamic&& params,
+    std::string latestKey) {
+  const auto start = std::chrono::steady_clock::now();
+  const SonarMessageEncoding encoding = encoding_;
+  auto payload = envelopePrefix(api, method, encoding);
+  {
+    SONAR_TRACE_SCOPE("serialize");
+    if (encoding == SonarMessageEncoding::MessagePack) {
+      msgpack::appendMessagePack(params, payload);
+    } else if (peerAcceptsColumnar_) {
+      appendColumnarJson(params, payload);
+    } else {
+      payload.append(folly::toJson(params));
+    }
+  }
+  payload.append(executeEnvelopeSuffix(encoding));
+  auto metrics = metricsFor(api, method);
+  if (metrics) {
+    metrics->messagesSent++;
+    metrics->bytesSent += payload.size();
+    metrics->serializationMicros += microsSince(start);
+  }
+  enqueue(
+      std::move(payload),
+      encoding,
+      SonarMessagePriority::Events,
+      std::move(metrics),
+      std::move(latestKey));
+}
+
+void SonarWebSocketImpl::sendJson(std::string message) {
+  if (encoding_ != SonarMessageEncoding::JSON) {
+    sendMessage(folly::parseJson(message));
+    return;
+  }
+  enqueue(
+      std::move(message),
+      SonarMessageEncoding::JSON,
+      SonarMessagePriority::Interactive);
+}
+
+void SonarWebSocketImpl::sendExecuteJson(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    std::string params) {
+  if (encoding_ != SonarMessageEncoding::JSON) {
+    sendExecute(api, method, folly::parseJson(params));
+    return;
+  }
+  auto payload = envelopePrefix(api, method, SonarMessageEncoding::JSON);
+  payload.append(params);
+  payload.append(executeEnvelopeSuffix(SonarMessageEncoding::JSON));
+  auto metrics = metricsFor(api, method);
+  if (metrics) {
+    metrics->messagesSent++;
+    metrics->bytesSent += payload.size();
+  }
+  enqueue(
+      std::move(payload),
+      SonarMessageEncoding::JSON,
+      SonarMessagePriority::Events,
+      std::move(metrics));
+}
+
+bool SonarWebSocketImpl::sendSerializedExecute(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    const std::string& payload,
+    SonarMessageEncoding encoding) {
+  if (encoding != encoding_) {
+    return false;
+  }
+  auto metrics = metricsFor(api, method);
+  if (metrics) {
+    metrics->messagesSent++;
+    metrics->bytesSent += payload.size();
+  }
+  enqueue(payload, encoding, SonarMessagePriority::Events, std::move(metrics));
+  return true;
+}
+
+SonarMessageEncoding SonarWebSocketImpl::getEncoding() const {
+  return encoding_;
+}
+
+bool SonarWebSocketImpl::sendBinary(
+    folly::StringPiece api,
+    folly::StringPiece method,
+    const folly::dynamic& metadata,
+    std::unique_ptr<folly::IOBuf> data) {
+  if (!peerAcceptsBinary_) {
+    return false;
+  }
+  // Metadata is always JSON, it is small and the desktop has to decode it
+  // separately from the data anyway.
+  auto envelope =
+      executeEnvelopePrefix(api, method, SonarMessageEncoding::JSON);
+  envelope.append(folly::toJson(metadata));
+  envelope.append(executeEnvelopeSuffix(SonarMessageEncoding::JSON));
+
+  const size_t size = envelope.size() + data->computeChainDataLength();
+  auto metrics = metricsFor(api, method);
+  if (metrics) {
+    metrics->messagesSent++;
+    metrics->bytesSent += size;
+  }
+  bufferedBytes_ += size;
+  if (outbound_.push({std::move(envelope),
+                      SonarMessageEncoding::JSON,
+                      std::move(data),
+                      std::move(metrics),
+                      std::chrono::steady_clock::now(),
+                      SonarMessagePriority::Bulk})) {
+    sonarEventBase_->add([this]() { drainOutbound(); });
+  }
+  return true;
+}
+
+bool SonarWebSocketImpl::supportsBinary() const {
+  return peerAcceptsBinary_;
+}
+
+void SonarWebSocketImpl::enqueue(
+    std::string payload,
+    SonarMessageEncoding encoding,
+    SonarMessagePriority priority,
+    std::shared_ptr<SonarMethodMetrics> metrics,
+    std::string latestKey) {
+  SONAR_TRACE_SCOPE("enqueue");
+  bufferedBytes_ += payload.size();
+  SonarOutboundMessage message{std::move(payload),
+                               encoding,
+                               nullptr,
+                               std::move(metrics),
+                               std::chrono::steady_clock::now(),
+                               priority};
+  if (!latestKey.empty()) {
+    message.generation = latest_.mark(latestKey);
+    message.latestKey = std::move(latestKey);
+  }
+  outboundAccount_->setBytes(bufferedBytes_);
+  if (outbound_.push(std::move(message))) {
+    sonarEventBase_->add([this]() { drainOutbound(); });
+  }
+}
+
+void SonarWebSocketImpl::setMetrics(std::shared_ptr<SonarMetrics> metrics) {
+  metrics_ = std::move(metrics);
+  stats_ = metrics_ ? std::make_shared<SonarRSocketStats>(metrics_) : nullptr;
+}
+
+std::shared_ptr<SonarMethodMetrics> SonarWebSocketImpl::metricsFor(
+    folly::StringPiece api,
+    folly::StringPiece method) {
+  return metrics_ ? metrics_->forMethod(api, method) : nullptr;
+}
+
+size_t SonarWebSocketImpl::getBufferedBytes() const {
+  return bufferedBytes_;
+}
+
+void SonarWebSocketImpl::notifyWhenDrained() {
+  drainNotificationRequested_ = true;
+  // The queue may have drained before the flag was set.
+  sonarEventBase_->add([this]() { maybeNotifyDrained(); });
+}
+
+void SonarWebSocketImpl::maybeNotifyDrained() {
+  outboundAccount_->setBytes(bufferedBytes_);
+  if (bufferedBytes_ == 0 && drainNotificationRequested_.exchange(false) &&
+      callbacks_) {
+    callbacks_->onOutboundQueueDrained();
+  }
+}
+
+size_t SonarWebSocketImpl::getOutboundQueueDepth() const {
+  return outbound_.depth();
+}
+
+void SonarWebSocketImpl::drainOutbound() {
+  SONAR_TRACE_SCOPE("drainOutbound");
+  auto messages = outbound_.drain();
+  if (suspended_) {
+    hold(std::move(messages));
+    return;
+  }
+  if (!held_.empty()) {
+    // Ahead of anything sent since.
+    messages.insert(
+        messages.begin(),
+        std::make_move_iterator(held_.begin()),
+        std::make_move_iterator(held_.end()));
+    held_.clear();
+    heldBytes_ = 0;
+  }
+  // Fragments are binary frames, so the desktop has to read both.
+  const bool fragment = peerAcceptsFragments_ && peerAcceptsBinary_;
+  for (auto& message : messages) {
+    if (message.metrics) {
+      message.metrics->queueWaitMicros += microsSince(message.enqueuedAt);
+    }
+    if (!message.latestKey.empty() &&
+        !latest_.isLatest(message.latestKey, message.generation)) {
+      bufferedBytes_ -= message.payload.size();
+      continue;
+    }
+    if (fragment && !message.data &&
+        lanes_.exceedsFragmentSize(message.payload.size()) &&
+        compressionThreshold_ > 0 && peerAcceptsDeflate_ &&
+        message.payload.size() >= compressionThreshold_) {
+      // Fragments are slices of the frame as it goes over the wire, so
+      // compress the whole message before it is split.
+      const size_t size = message.payload.size();
+      message.payload = deflateFrame(message.payload);
+      message.deflated = true;
+      bufferedBytes_ -= size - message.payload.size();
+    }
+    lanes_.push(std::move(message), fragment);
+  }
+  if (!pumpScheduled_) {
+    pumpLanes();
+  }
+}
+
+void SonarWebSocketImpl::hold(std::vector<SonarOutboundMessage> messages) {
+  for (auto& message : messages) {
+    if (!message.latestKey.empty() &&
+        !latest_.isLatest(message.latestKey, message.generation)) {
+      bufferedBytes_ -= messageBytes(message);
+      continue;
+    }
+    heldBytes_ += messageBytes(message);
+    held_.push_back(std::move(message));
+  }
+  if (heldBytes_ > suspendedBufferBytes_) {
+    dropHeld(heldBytes_ - suspendedBufferBytes_);
+  }
+  outboundAccount_->setBytes(bufferedBytes_);
+}
+
+void SonarWebSocketImpl::dropHeld(size_t bytes) {
+  size_t freed = 0;
+  for (auto message = held_.begin(); message != held_.end() && freed < bytes;) {
+    if (message->priority == SonarMessagePriority::Interactive) {
+      ++message;
+      continue;
+    }
+    if (!message->latestKey.empty()) {
+      latest_.take(message->latestKey, message->generation);
+    }
+    if (message->metrics) {
+      message->metrics->messagesDropped++;
+    }
+    freed += messageBytes(*message);
+    message = held_.erase(message);
+  }
+  heldBytes_ -= freed;
+  bufferedBytes_ -= freed;
+  outboundAccount_->setBytes(bufferedBytes_);
+}
+
+void SonarWebSocketImpl::pumpLanes() {
+  while (!lanes_.empty()) {
+    if (!client_) {
+      bufferedBytes_ -= lanes_.clear();
+      break;
+    }
+    if (suspended_) {
+      // The rest of a message being fragmented waits too.
+      return;
+    }
+    const bool sentFragment = lanes_.sendNext(
+        [this](SonarOutboundMessage message) { sendWhole(std::move(message)); },
+        [this](
+            const SonarOutboundFragment& fragment,
+            std::unique_ptr<folly::IOBuf> data) {
+          sendFragment(fragment, std::move(data));
+        });
+    if (sentFragment && !lanes_.empty()) {
+      // Give messages queued meanwhile, which may be in a higher lane, their
+      // turn before the next fragment.
+      pumpScheduled_ = true;
+      sonarEventBase_->runInLoop([this]() {
+        pumpScheduled_ = false;
+        drainOutbound();
+      });
+      return;
+    }
+  }
+  maybeNotifyDrained();
+}
+
+void SonarWebSocketImpl::sendWhole(SonarOutboundMessage message) {
+  size_t size = message.payload.size();
+  if (!message.latestKey.empty() &&
+      !latest_.take(message.latestKey, message.generation)) {
+    // Superseded while waiting in its lane.
+    bufferedBytes_ -= size;
+    return;
+  }
+  if (message.data) {
+    size += message.data->computeChainDataLength();
+    // Binary frames can't be batched, but must not overtake messages
+    // that are already waiting in the batch.
+    flushBatch();
+    sendBinaryFrame(std::move(message.payload), std::move(message.data));
+    bufferedBytes_ -= size;
+  } else if (message.deflated) {
+    flushBatch();
+    sendSerialized(std::move(message.payload), true);
+    bufferedBytes_ -= size;
+  } else if (batchWindowMs_ > 0) {
+    // Accounted for when the batch is flushed.
+    enqueueBatched(
+        std::move(message.payload),
+        message.encoding,
+        std::move(message.latestKey));
+  } else {
+    sendSerialized(std::move(message.payload));
+    bufferedBytes_ -= size;
+  }
+}
+
+void SonarWebSocketImpl::sendFragment(
+    const SonarOutboundFragment& fragment,
+    std::unique_ptr<folly::IOBuf> data) {
+  flushBatch();
+  auto metadata = folly::dynamic::object("method", "fragment")(
+      "id", static_cast<int64_t>(fragment.id))(
+      "index", static_cast<int64_t>(fragment.index))(
+      "count", static_cast<int64_t>(fragment.count));
+  size_t size = data->computeChainDataLength();
+  if (fragment.envelope) {
+    metadata["envelope"] = *fragment.envelope;
+    size += fragment.envelope->size();
+  }
+  sendBinaryFrame(folly::toJson(metadata), std::move(data));
+  bufferedBytes_ -= size;
+}
+
+void SonarWebSocketImpl::sendSerialized(std::string payload, bool deflated) {
+  // rsocket encrypts and writes on the connection thread, this covers
+  // handing the frame over to it.
+  SONAR_TRACE_SCOPE("write");
+  if (client_) {
+    if (!deflated && compressionThreshold_ > 0 && peerAcceptsDeflate_ &&
+        payload.size() >= compressionThreshold_) {
+      SONAR_TRACE_SCOPE("deflateFrame");
+      payload = deflateFrame(payload);
+    }
+    client_->getRequester()
+        ->fireAndForget(rsocket::Payload(std::move(payload)))
+        ->subscribe([]() {});
+  }
+}
+
+void SonarWebSocketImpl::sendBinaryFrame(
+    std::string metadata,
+    std::unique_ptr<folly::IOBuf> data) {
+  SONAR_TRACE_SCOPE("write");
+  if (client_) {
+    client_->getRequester()
+        ->fireAndForget(rsocket::Payload(
+            std::move(data), folly::IOBuf::copyBuffer(metadata)))
+        ->subscribe([]() {});
+  }
+}
+
+void SonarWebSocketImpl::enqueueBatched(
+    std::string payload,
+    SonarMessageEncoding encoding,
+    std::string latestKey) {
+  if (!pendingBatch_.empty() && encoding != pendingBatchEncoding_) {
+    flushBatch();
+  }
+  if (!latestKey.empty()) {
+    // An older message for the key may still be waiting in the batch, the
+    // newer one takes its place.
+    const auto older = std::find(
+        pendingBatchKeys_.begin(), pendingBatchKeys_.end(), latestKey);
+    if (older != pendingBatchKeys_.end()) {
+      auto& replaced = pendingBatch_[older - pendingBatchKeys_.begin()];
+      pendingBatchBytes_ -= replaced.size();
+      bufferedBytes_ -= replaced.size();
+      pendingBatchBytes_ += payload.size();
+      replaced = std::move(payload);
+      if (pendingBatchBytes_ >= batchMaxBytes_) {
+        flushBatch();
+      }
+      return;
+    }
+  }
+  const bool startsBatch = pendingBatch_.empty();
+  pendingBatchEncoding_ = encoding;
+  pendingBatchBytes_ += payload.size();
+  pendingBatch_.push_back(std::move(payload));
+  pendingBatchKeys_.push_back(std::move(latestKey));
+
+  if (pendingBatchBytes_ >= batchMaxBytes_) {
+    flushBatch();
+  } else if (startsBatch) {
+    sonarEventBase_->runAfterDelay(
+        [this]() { flushBatch(); }, batchWindowMs_);
+  }
+}
+
+void SonarWebSocketImpl::flushBatch() {
+  if (pendingBatch_.empty()) {
+    return;
+  }
+  if (pendingBatch_.size() == 1) {
+    sendSerialized(std::move(pendingBatch_.front()));
+  } else {
+    sendSerialized(serializeBatch(pendingBatch_, pendingBatchEncoding_));
+  }
+  bufferedBytes_ -= pendingBatchBytes_;
+  pendingBatch_.clear();
+  pendingBatchKeys_.clear();
+  pendingBatchBytes_ = 0;
+  maybeNotifyDrained();
 }
 
 bool SonarWebSocketImpl::isCertificateExchangeNeeded() {
@@ -240,14 +1263,62 @@ bool SonarWebSocketImpl::isCertificateExchangeNeeded() {
 
 void SonarWebSocketImpl::requestSignedCertFromSonar() {
   auto generatingCSR = sonarState_->start("Generate CSR");
-  std::string csr = contextStore_->createCertificateSigningRequest();
-  generatingCSR->complete();
+  // Key generation can take hundreds of milliseconds on older devices, so
+  // keep it off the sonar thread where it would block all plugin traffic.
+  if (!csrThread_) {
+    csrThread_ = std::make_unique<folly::ScopedEventBaseThread>("SonarCSR");
+  }
+  const uint64_t attempt = connectAttempt_;
+  const auto* const client = client_.get();
+  folly::via(
+      csrThread_->getEventBase(),
+      [contextStore = contextStore_]() -> std::string {
+        try {
+          return contextStore->createCertificateSigningRequest();
+        } catch (const std::exception& e) {
+          log(LogLevel::Error, e.what());
+          return "";
+        }
+      })
+      .via(sonarEventBase_->getEventBase())
+      .thenValue([this,
+                  alive = std::weak_ptr<bool>(alive_),
+                  attempt,
+                  client,
+                  generatingCSR](std::string csr) {
+        if (alive.expired()) {
+          return;
+        }
+        // The connection may have dropped, timed out or been stopped while
+        // the key was generated, in which case the next one asks again.
+        if (attempt != connectAttempt_ ||
+            getConnectionState() != ConnectionState::Insecure || !client_ ||
+            client_.get() != client) {
+          generatingCSR->fail("Connection closed while generating the CSR");
+          return;
+        }
+        if (csr.empty()) {
+          generatingCSR->fail("Unable to generate CSR");
+          // Dropping the insecure connection triggers a retry.
+          client_ = nullptr;
+          return;
+        }
+        generatingCSR->complete();
+        sendCertificateSigningRequest(csr);
+      });
+  failedConnectionAttempts_ = 0;
+}
 
+void SonarWebSocketImpl::sendCertificateSigningRequest(const std::string& csr) {
   folly::dynamic message = folly::dynamic::object("method", "signCertificate")(
       "csr", csr.c_str())("destination", contextStore_->getCertificateDirectoryPath().c_str());
   auto gettingCert = sonarState_->start("Getting cert from desktop");
 
   sonarEventBase_->add([this, message, gettingCert]() {
+    if (!client_) {
+      gettingCert->fail("Connection closed before sending the CSR");
+      return;
+    }
     client_->getRequester()
         ->requestResponse(rsocket::Payload(folly::toJson(message)))
         ->subscribe([this, gettingCert](rsocket::Payload p) {
@@ -258,10 +1329,8 @@ void SonarWebSocketImpl::requestSignedCertFromSonar() {
           }
           gettingCert->complete();
           log("Certificate exchange complete.");
-          // Disconnect after message sending is complete.
-          // This will trigger a reconnect which should use the secure channel.
-          // TODO: Connect immediately, without waiting for reconnect
-          client_ = nullptr;
+          secureConnectPending_ = true;
+          connectSecurelyAfterExchange();
         },
         [this, message](folly::exception_wrapper e) {
           e.handle(
@@ -269,18 +1338,20 @@ void SonarWebSocketImpl::requestSignedCertFromSonar() {
               std::string errorMessage = errorWithPayload.payload.moveDataToString();
 
              if (errorMessage.compare("not implemented")) {
-               log("Desktop failed to provide certificates. Error from sonar desktop:\n" + errorMessage);
+               log(LogLevel::Error, "Desktop failed to provide certificates. Error from sonar desktop:\n" + errorMessage);
+               if (contextStore_->fallBackToRSAKeys()) {
+                 log("Using an RSA key for the next certificate exchange.");
+               }
              } else {
               sendLegacyCertificateRequest(message);
              }
             },
             [e](...) {
-             log(("Error during certificate exchange:" + e.what()).c_str());
+             log(LogLevel::Error, ("Error during certificate exchange:" + e.what()).c_str());
             }
           );
         });
   });
-  failedConnectionAttempts_ = 0;
 }
 
 void SonarWebSocketImpl::sendLegacyCertificateRequest(folly::dynamic message) {
@@ -291,7 +1362,8 @@ void SonarWebSocketImpl::sendLegacyCertificateRequest(folly::dynamic message) {
    ->fireAndForget(rsocket::Payload(folly::toJson(message)))
    ->subscribe([this, sendingRequest]() {
      sendingRequest->complete();
-     client_ = nullptr;
+     secureConnectPending_ = true;
+     connectSecurelyAfterExchange();
    });
 }
 
@@ -8,13 +8,29 @@
 
 #pragma once
 
+#include <Sonar/SonarHostRace.h>
 #include <Sonar/SonarInitConfig.h>
+#include <Sonar/SonarMemoryBudget.h>
+#include <Sonar/SonarMessageEncoding.h>
+#include <Sonar/SonarOutboundQueue.h>
+#include <Sonar/SonarServerTransport.h>
 #include <Sonar/SonarWebSocket.h>
 #include <Sonar/SonarState.h>
+#include <Sonar/SonarStep.h>
 #include <folly/Executor.h>
+#include <folly/SocketAddress.h>
+#include <folly/futures/Future.h>
+#include <folly/io/async/AsyncSocket.h>
 #include <folly/io/async/EventBase.h>
+#include <folly/io/async/SSLContext.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
 #include <rsocket/RSocket.h>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
 #include <mutex>
+#include <vector>
 
 namespace facebook {
 namespace sonar {
@@ -28,6 +44,22 @@ class SonarWebSocketImpl : public SonarWebSocket {
   friend Responder;
 
  public:
+  enum class ConnectionState : uint8_t {
+    // Not connected, a connection attempt may be scheduled.
+    Idle,
+    // Waiting for the transport of a connection attempt to come up.
+    Connecting,
+    // Connected to the certificate exchange port.
+    Insecure,
+    // Connected securely, messages can be exchanged with the desktop.
+    Trusted,
+    // The secure connection dropped and is being resumed. Plugins stay
+    // connected meanwhile.
+    Resuming,
+    // stop() was called, no reconnects until start() is called again.
+    Closing,
+  };
+
   SonarWebSocketImpl(SonarInitConfig config, std::shared_ptr<SonarState> state, std::shared_ptr<ConnectionContextStore> contextStore);
 
   ~SonarWebSocketImpl();
@@ -36,16 +68,74 @@ class SonarWebSocketImpl : public SonarWebSocket {
 
   void stop() override;
 
+  void setSuspended(bool suspended) override;
+
   bool isOpen() const override;
 
   void setCallbacks(Callbacks* callbacks) override;
 
+  using SonarWebSocket::sendMessage;
   void sendMessage(const folly::dynamic& message) override;
 
+  void sendExecute(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      folly::dynamic&& params) override;
+
+  void sendExecuteLatest(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      folly::StringPiece key,
+      folly::dynamic&& params) override;
+
+  void sendJson(std::string message) override;
+
+  void sendExecuteJson(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      std::string params) override;
+
+  bool sendSerializedExecute(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      const std::string& payload,
+      SonarMessageEncoding encoding) override;
+
+  SonarMessageEncoding getEncoding() const override;
+
+  bool sendBinary(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      const folly::dynamic& metadata,
+      std::unique_ptr<folly::IOBuf> data) override;
+
+  bool supportsBinary() const override;
+
   void reconnect();
 
+  /**
+   Number of messages waiting to be handed to the connection.
+   */
+  size_t getOutboundQueueDepth() const;
+
+  ConnectionState getConnectionState() const {
+    return state_.load(std::memory_order_acquire);
+  }
+
+  size_t getBufferedBytes() const override;
+
+  void notifyWhenDrained() override;
+
+  void setMetrics(std::shared_ptr<SonarMetrics> metrics) override;
+
  private:
-  bool isOpen_ = false;
+  // Written on the sonar and connection threads, read from anywhere.
+  std::atomic<ConnectionState> state_{ConnectionState::Idle};
+  // Whether the connection attempt in progress is the secure one.
+  std::atomic<bool> connectingSecurely_{false};
+  // Bumped when an attempt times out, so that the events of its client,
+  // should it still connect, are ignored.
+  std::atomic<uint64_t> connectAttempt_{0};
   Callbacks* callbacks_;
   DeviceData deviceData_;
   std::shared_ptr<SonarState> sonarState_;
@@ -53,15 +143,170 @@ class SonarWebSocketImpl : public SonarWebSocket {
   folly::EventBase* sonarEventBase_;
   folly::EventBase* connectionEventBase_;
   std::unique_ptr<rsocket::RSocketClient> client_;
-  bool connectionIsTrusted_;
-  int failedConnectionAttempts_ = 0;
+  std::atomic<SonarMessageEncoding> encoding_{SonarMessageEncoding::JSON};
+  // Whether the desktop has told us it reads binary frames.
+  std::atomic<bool> peerAcceptsBinary_{false};
+  // Whether the desktop has told us it inflates compressed frames.
+  std::atomic<bool> peerAcceptsDeflate_{false};
+  // Whether the desktop has told us it reassembles fragmented messages.
+  std::atomic<bool> peerAcceptsFragments_{false};
+  // Whether the desktop has told us it expands columnar arrays.
+  std::atomic<bool> peerAcceptsColumnar_{false};
+  const size_t compressionThreshold_;
+  const std::chrono::milliseconds keepaliveInterval_;
+  const std::chrono::milliseconds connectTimeout_;
+  // Which of the desktop's hosts to connect to over TCP, only touched on
+  // connectionEventBase_.
+  SonarHostRace hostRace_;
+  const size_t resumeBufferBytes_;
+  const std::chrono::milliseconds resumeWindow_;
+  const std::string localSocketName_;
+  const uint16_t listenPort_;
+  // Created on the connection thread when first listening.
+  std::unique_ptr<SonarServerTransport> serverTransport_;
+  const bool preopenSecureSocket_;
+  // Connection to the secure port opened during a certificate exchange,
+  // only touched on connectionEventBase_.
+  folly::AsyncSocket::UniquePtr preopenedSocket_;
+  std::atomic<int> failedConnectionAttempts_{0};
+  const ReconnectPolicy reconnectPolicy_;
+  int reconnectAttempts_ = 0;
+  // Set once certificates were obtained, so the secure connection is
+  // attempted even in connect-on-demand mode.
+  std::atomic<bool> secureConnectPending_{false};
   std::shared_ptr<ConnectionContextStore> contextStore_;
+  // Generates CSRs off the sonar thread, see requestSignedCertFromSonar.
+  // Created on the sonar thread when first needed, joined by the destructor.
+  std::unique_ptr<folly::ScopedEventBaseThread> csrThread_;
+  // Expires with the socket, for a CSR continuation still queued on the
+  // sonar thread when the socket is destroyed on that thread.
+  std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
+
+  SonarOutboundQueue outbound_;
+  // Drained messages waiting for their turn, only touched on sonarEventBase_.
+  SonarOutboundLanes lanes_;
+  // Whether pumpLanes is scheduled to send the next fragment.
+  bool pumpScheduled_ = false;
+  // Bytes queued or batched that have not been handed to rsocket yet.
+  std::atomic<size_t> bufferedBytes_{0};
+  // Reports bufferedBytes_ to the memory budget. Queued messages can't be
+  // dropped, except for plugin messages held while suspended.
+  const std::shared_ptr<SonarMemoryBudget::Account> outboundAccount_;
+  // See setSuspended.
+  std::atomic<bool> suspended_{false};
+  // Set when a reconnect was put off until unsuspended.
+  std::atomic<bool> reconnectWhenUnsuspended_{false};
+  // Only touched on sonarEventBase_: messages drained while suspended,
+  // oldest first, a resumption put off until unsuspended, and the cap on
+  // what is held.
+  std::list<SonarOutboundMessage> held_;
+  size_t heldBytes_ = 0;
+  std::shared_ptr<SonarStep> resumeWhenUnsuspended_;
+  const size_t suspendedBufferBytes_;
+  std::atomic<bool> drainNotificationRequested_{false};
+  std::shared_ptr<SonarMetrics> metrics_;
+  // Shared by all connections, so that transport counters survive reconnects.
+  std::shared_ptr<rsocket::RSocketStats> stats_;
+
+  // Which messages sent with sendExecuteLatest are still the newest.
+  SonarLatestMessages latest_;
+
+  // Serialized "execute" envelope prefixes by encoding, keyed by api and
+  // method.
+  std::mutex envelopeMutex_;
+  std::map<std::pair<std::string, std::string>, std::string, SonarMethodKeyLess>
+      envelopePrefixes_[2];
+
+  // Outgoing batching state, only touched on sonarEventBase_.
+  const int batchWindowMs_;
+  const size_t batchMaxBytes_;
+  std::vector<std::string> pendingBatch_;
+  // The latestKey of each message in pendingBatch_, empty if it has none.
+  std::vector<std::string> pendingBatchKeys_;
+  size_t pendingBatchBytes_ = 0;
+  SonarMessageEncoding pendingBatchEncoding_ = SonarMessageEncoding::JSON;
 
   void startSync();
-  void doCertificateExchange();
-  void connectSecurely();
+  void beginConnecting();
+  void connectFailed();
+  void connectAttemptFailed(
+      std::shared_ptr<SonarStep> connect,
+      const folly::exception_wrapper& error);
+  // Takes over a newly connected client, unless stop() was called meanwhile.
+  bool adoptClient(std::unique_ptr<rsocket::RSocketClient> client);
+  // Fails connecting with a TIMED_OUT AsyncSocketException if it takes
+  // longer than connectTimeout_.
+  folly::Future<std::unique_ptr<rsocket::RSocketClient>> withConnectTimeout(
+      folly::Future<std::unique_ptr<rsocket::RSocketClient>> connecting);
+  // The address of the desktop's host that answers on port, completing on
+  // connectionEventBase_.
+  folly::Future<folly::SocketAddress> pickAddress(uint16_t port);
+  folly::Future<std::unique_ptr<rsocket::RSocketClient>> connectClient(
+      folly::SocketAddress address,
+      std::shared_ptr<folly::SSLContext> sslContext,
+      rsocket::SetupParameters parameters);
+  // Connects to the secure port, over preopenedSocket_ if it is connected.
+  folly::Future<std::unique_ptr<rsocket::RSocketClient>> connectOverTcp(
+      std::shared_ptr<folly::SSLContext> sslContext,
+      rsocket::SetupParameters parameters);
+  // Opens preopenedSocket_ while the desktop signs the certificate.
+  void preopenSecureSocket();
+  // Connects over the next connection the desktop makes to listenPort_.
+  folly::Future<std::unique_ptr<rsocket::RSocketClient>> acceptClient(
+      rsocket::SetupParameters parameters);
+  // Replaces the insecure connection with a secure one from the sonar
+  // thread, without waiting for the reconnect timer.
+  void connectSecurelyAfterExchange();
+  // Called on the connection thread once a resumable connection dropped.
+  void resume();
+  void tryResume(
+      std::shared_ptr<SonarStep> step,
+      std::chrono::steady_clock::time_point deadline);
+  std::chrono::milliseconds nextReconnectDelay();
+  void enqueue(
+      std::string payload,
+      SonarMessageEncoding encoding,
+      SonarMessagePriority priority,
+      std::shared_ptr<SonarMethodMetrics> metrics = nullptr,
+      std::string latestKey = std::string());
+  // Keeps messages drained while suspended, dropping the oldest plugin
+  // messages past suspendedBufferBytes_.
+  void hold(std::vector<SonarOutboundMessage> messages);
+  // Drops the oldest held plugin messages until bytes were freed. Responses
+  // are kept, the desktop is waiting for them.
+  void dropHeld(size_t bytes);
+  void enqueueExecute(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      folly::dynamic&& params,
+      std::string latestKey);
+  std::string envelopePrefix(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      SonarMessageEncoding encoding);
+  std::shared_ptr<SonarMethodMetrics> metricsFor(
+      folly::StringPiece api,
+      folly::StringPiece method);
+  void drainOutbound();
+  void pumpLanes();
+  void sendWhole(SonarOutboundMessage message);
+  void sendFragment(
+      const SonarOutboundFragment& fragment,
+      std::unique_ptr<folly::IOBuf> data);
+  void maybeNotifyDrained();
+  void sendSerialized(std::string payload, bool deflated = false);
+  void sendBinaryFrame(std::string metadata, std::unique_ptr<folly::IOBuf> data);
+  void enqueueBatched(
+      std::string payload,
+      SonarMessageEncoding encoding,
+      std::string latestKey);
+  void flushBatch();
+  // Both complete on the sonar thread once connected.
+  folly::Future<folly::Unit> doCertificateExchange();
+  folly::Future<folly::Unit> connectSecurely();
   bool isCertificateExchangeNeeded();
   void requestSignedCertFromSonar();
+  void sendCertificateSigningRequest(const std::string& csr);
   bool isRunningInOwnThread();
   void sendLegacyCertificateRequest(folly::dynamic message);
   std::string getDeviceId();
@@ -0,0 +1,521 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarClient.h>
+#include <Sonar/SonarConnectionImpl.h>
+#include <Sonar/SonarInspector.h>
+#include <Sonar/SonarMessageWriter.h>
+#include <Sonar/SonarResponderImpl.h>
+#include <Sonar/SonarState.h>
+#include <Sonar/SonarStep.h>
+#include <SonarTestLib/SonarInspectorAdapterMock.h>
+#include <SonarTestLib/SonarPluginMock.h>
+
+#include <folly/Benchmark.h>
+#include <folly/Optional.h>
+#include <folly/json.h>
+#include <folly/portability/GFlags.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <thread>
+
+DEFINE_bool(
+    allocations,
+    false,
+    "Also report heap allocations and bytes per iteration of each benchmark");
+
+namespace {
+
+// Only counted while a benchmark's measured loop runs, so that setup and
+// folly's own bookkeeping don't show up.
+std::atomic<bool> countingAllocations{false};
+std::atomic<uint64_t> allocationCount{0};
+std::atomic<uint64_t> allocatedBytes{0};
+
+} // namespace
+
+void* operator new(size_t size) {
+  if (countingAllocations.load(std::memory_order_relaxed)) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  }
+  if (void* pointer = std::malloc(size ? size : 1)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+  std::free(pointer);
+}
+
+namespace facebook {
+namespace sonar {
+namespace benchmarks {
+
+using folly::dynamic;
+
+struct AllocationTotals {
+  uint64_t iterations = 0;
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+};
+
+std::map<std::string, AllocationTotals>& allocationTotals() {
+  static auto totals = new std::map<std::string, AllocationTotals>();
+  return *totals;
+}
+
+/**
+ Counts what is allocated during its lifetime towards the named benchmark,
+ when run with --allocations. Declare it right before the measured loop,
+ after everything the loop uses, so that tearing those down isn't counted.
+ */
+class CountAllocations {
+ public:
+  CountAllocations(const char* name, size_t iterations)
+      : name_(name), iterations_(iterations) {
+    if (FLAGS_allocations) {
+      allocationCount = 0;
+      allocatedBytes = 0;
+      countingAllocations = true;
+    }
+  }
+
+  ~CountAllocations() {
+    if (!FLAGS_allocations) {
+      return;
+    }
+    countingAllocations = false;
+    auto& totals = allocationTotals()[name_];
+    totals.iterations += iterations_;
+    totals.allocations += allocationCount;
+    totals.bytes += allocatedBytes;
+  }
+
+ private:
+  const char* name_;
+  size_t iterations_;
+};
+
+void printAllocations() {
+  std::printf(
+      "%-32s %16s %16s\n", "Allocations per iteration", "allocs", "bytes");
+  for (const auto& entry : allocationTotals()) {
+    const auto& totals = entry.second;
+    std::printf(
+        "%-32s %16.1f %16.1f\n",
+        entry.first.c_str(),
+        static_cast<double>(totals.allocations) / totals.iterations,
+        static_cast<double>(totals.bytes) / totals.iterations);
+  }
+}
+
+/**
+ Drops everything it is sent, so that benchmarks measure building messages
+ rather than storing them.
+ */
+class NullWebSocket : public SonarWebSocket {
+ public:
+  void start() override {
+    open_ = true;
+    if (callbacks) {
+      callbacks->onConnected();
+    }
+  }
+
+  void stop() override {
+    open_ = false;
+  }
+
+  bool isOpen() const override {
+    return open_;
+  }
+
+  void sendMessage(const dynamic& message) override {
+    folly::doNotOptimizeAway(message);
+  }
+
+  void sendJson(std::string message) override {
+    folly::doNotOptimizeAway(message);
+  }
+
+  void sendExecuteJson(
+      folly::StringPiece api,
+      folly::StringPiece method,
+      std::string params) override {
+    folly::doNotOptimizeAway(params);
+  }
+
+  void setCallbacks(Callbacks* aCallbacks) override {
+    callbacks = aCallbacks;
+  }
+
+  Callbacks* callbacks = nullptr;
+
+ private:
+  bool open_ = false;
+};
+
+// A layout inspector node with a typical amount of attributes and data.
+dynamic inspectorNode(int index) {
+  dynamic children = dynamic::array();
+  for (int i = 0; i < 8; i++) {
+    children.push_back(folly::to<std::string>("0x7f8", index, i));
+  }
+  dynamic data = dynamic::object;
+  for (const auto& section : {"UIView", "CALayer", "Accessibility"}) {
+    dynamic values = dynamic::object;
+    for (int i = 0; i < 12; i++) {
+      values[folly::to<std::string>("property", i)] = dynamic::object(
+          "__type__", "number")("value", i * 1.5)("__mutable__", true);
+    }
+    data[section] = std::move(values);
+  }
+  return dynamic::object("id", folly::to<std::string>("0x7f8", index))(
+      "name", "UIView")("children", std::move(children))(
+      "attributes",
+      dynamic::array(dynamic::object("name", "tag")("value", "42")))(
+      "data", std::move(data))("decoration", "UIView");
+}
+
+// A getNodes reply, as sent when expanding a large view.
+dynamic inspectorPayload() {
+  dynamic elements = dynamic::array();
+  for (int i = 0; i < 50; i++) {
+    elements.push_back(inspectorNode(i));
+  }
+  return dynamic::object("elements", std::move(elements));
+}
+
+// Same as inspectorPayload, written with a SonarMessageWriter.
+void writeInspectorPayload(SonarMessageWriter& writer) {
+  writer.beginArray("elements");
+  for (int index = 0; index < 50; index++) {
+    writer.beginObject()
+        .put("id", folly::to<std::string>("0x7f8", index))
+        .put("name", "UIView")
+        .beginArray("children");
+    for (int i = 0; i < 8; i++) {
+      writer.add(folly::to<std::string>("0x7f8", index, i));
+    }
+    writer.end()
+        .beginArray("attributes")
+        .beginObject()
+        .put("name", "tag")
+        .put("value", "42")
+        .end()
+        .end()
+        .beginObject("data");
+    for (const auto& section : {"UIView", "CALayer", "Accessibility"}) {
+      writer.beginObject(section);
+      for (int i = 0; i < 12; i++) {
+        writer.beginObject(folly::to<std::string>("property", i))
+            .put("__type__", "number")
+            .put("value", i * 1.5)
+            .put("__mutable__", true)
+            .end();
+      }
+      writer.end();
+    }
+    writer.end().put("decoration", "UIView").end();
+  }
+  writer.end();
+}
+
+// A network plugin newResponse event with a 4KB base64 body.
+dynamic networkPayload() {
+  dynamic headers = dynamic::array();
+  for (int i = 0; i < 16; i++) {
+    headers.push_back(dynamic::object(
+        "key", folly::to<std::string>("X-Header-", i))(
+        "value", std::string(40, 'v')));
+  }
+  return dynamic::object("id", "4f2a3c")("timestamp", 1528808015000)(
+      "status", 200)("reason", "OK")("headers", std::move(headers))(
+      "data", std::string(4096, 'A'));
+}
+
+// A client with a "Test" plugin that answers "ping", inited by the desktop.
+void startPingClient(
+    folly::Optional<SonarClient>& client,
+    NullWebSocket* socket) {
+  client.emplace(
+      std::unique_ptr<SonarWebSocket>{socket}, std::make_shared<SonarState>());
+  client->start();
+  client->addPlugin(std::make_shared<test::SonarPluginMock>(
+      "Test", [](std::shared_ptr<SonarConnection> conn) {
+        conn->receive(
+            "ping",
+            [](const dynamic&, std::unique_ptr<SonarResponder> responder) {
+              responder->success(dynamic::object());
+            });
+      }));
+  socket->callbacks->onMessageReceived(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test")));
+}
+
+const dynamic& pingMessage() {
+  static const auto message = new dynamic(
+      dynamic::object("id", 1)("method", "execute")(
+          "params",
+          dynamic::object("api", "Test")("method", "ping")(
+              "params", dynamic::object())));
+  return *message;
+}
+
+BENCHMARK(onMessageReceivedExecute, iters) {
+  auto socket = new NullWebSocket;
+  folly::Optional<SonarClient> client;
+  BENCHMARK_SUSPEND {
+    startPingClient(client, socket);
+  }
+
+  const auto& message = pingMessage();
+  CountAllocations counter("onMessageReceivedExecute", iters);
+  for (size_t i = 0; i < iters; i++) {
+    socket->callbacks->onMessageReceived(message);
+  }
+}
+
+// Execute calls while another thread keeps taking the client lock, the way
+// plugins checking hasPlugin or getPlugin from other threads do.
+BENCHMARK(onMessageReceivedExecuteContended, iters) {
+  auto socket = new NullWebSocket;
+  folly::Optional<SonarClient> client;
+  std::atomic<bool> done{false};
+  std::thread contender;
+  BENCHMARK_SUSPEND {
+    startPingClient(client, socket);
+    contender = std::thread([&] {
+      while (!done) {
+        folly::doNotOptimizeAway(client->hasPlugin("Test"));
+      }
+    });
+  }
+
+  const auto& message = pingMessage();
+  for (size_t i = 0; i < iters; i++) {
+    socket->callbacks->onMessageReceived(message);
+  }
+
+  BENCHMARK_SUSPEND {
+    done = true;
+    contender.join();
+  }
+}
+
+BENCHMARK(connectionSendInspector, iters) {
+  NullWebSocket socket;
+  SonarConnectionImpl connection(&socket, "Inspector");
+  dynamic payload;
+  BENCHMARK_SUSPEND {
+    payload = inspectorPayload();
+  }
+  CountAllocations counter("connectionSendInspector", iters);
+  for (size_t i = 0; i < iters; i++) {
+    connection.send("update", payload);
+  }
+}
+
+// Includes writing the payload, unlike connectionSendInspector which builds
+// it up front.
+BENCHMARK(connectionSendWithInspector, iters) {
+  NullWebSocket socket;
+  SonarConnectionImpl connection(&socket, "Inspector");
+  CountAllocations counter("connectionSendWithInspector", iters);
+  for (size_t i = 0; i < iters; i++) {
+    connection.sendWith("update", writeInspectorPayload);
+  }
+}
+
+BENCHMARK(connectionSendNetwork, iters) {
+  NullWebSocket socket;
+  SonarConnectionImpl connection(&socket, "Network");
+  dynamic payload;
+  BENCHMARK_SUSPEND {
+    payload = networkPayload();
+  }
+  CountAllocations counter("connectionSendNetwork", iters);
+  for (size_t i = 0; i < iters; i++) {
+    connection.send("newResponse", payload);
+  }
+}
+
+BENCHMARK(responderSuccessInspector, iters) {
+  NullWebSocket socket;
+  dynamic payload;
+  BENCHMARK_SUSPEND {
+    payload = inspectorPayload();
+  }
+  CountAllocations counter("responderSuccessInspector", iters);
+  for (size_t i = 0; i < iters; i++) {
+    SonarResponderImpl responder(&socket, i);
+    responder.success(payload);
+  }
+}
+
+BENCHMARK(sonarStateStart, iters) {
+  SonarState state;
+  CountAllocations counter("sonarStateStart", iters);
+  for (size_t i = 0; i < iters; i++) {
+    state.start("Connect to desktop")->complete();
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+// The shared Inspector engine on a hierarchy of 4681 nodes, eight children
+// to a node and four levels deep.
+
+struct InspectorFixture {
+  test::SonarInspectorNodeMock root;
+  std::unique_ptr<SonarInspector> inspector;
+  dynamic ids = dynamic::array;
+
+  InspectorFixture() {
+    root.id = "root";
+    root.name = "Window";
+    test::buildInspectorTree(root, 4, 8);
+    inspector = std::make_unique<SonarInspector>(
+        std::make_unique<test::SonarInspectorAdapterMock>(&root));
+    // Indexing tracks every node, so that all of them can be asked for.
+    inspector->getSearchResults(dynamic::object("query", ""));
+    addIds(root);
+  }
+
+  void addIds(const test::SonarInspectorNodeMock& node) {
+    ids.push_back(node.id);
+    for (const auto& child : node.children) {
+      addIds(*child);
+    }
+  }
+
+  std::string getNodes(const dynamic& params) {
+    auto call = inspector->getNodes(params);
+    while (!call->run(std::chrono::milliseconds(4))) {
+    }
+    return call->takeResponse();
+  }
+};
+
+BENCHMARK(inspectorGetNodes, iters) {
+  folly::Optional<InspectorFixture> fixture;
+  dynamic params;
+  BENCHMARK_SUSPEND {
+    fixture.emplace();
+    params = dynamic::object("ids", fixture->ids);
+  }
+  CountAllocations counter("inspectorGetNodes", iters);
+  for (size_t i = 0; i < iters; i++) {
+    folly::doNotOptimizeAway(fixture->getNodes(params));
+  }
+}
+
+BENCHMARK(inspectorGetNodesUnchanged, iters) {
+  folly::Optional<InspectorFixture> fixture;
+  dynamic params;
+  BENCHMARK_SUSPEND {
+    fixture.emplace();
+    const auto response =
+        fixture->getNodes(dynamic::object("ids", fixture->ids));
+    const auto elements = folly::parseJson(response)["elements"];
+    auto hashes = dynamic::object();
+    for (const auto& element : elements) {
+      hashes[element["id"]] = element["hashes"];
+    }
+    params = dynamic::object("ids", fixture->ids)("hashes", std::move(hashes));
+  }
+  CountAllocations counter("inspectorGetNodesUnchanged", iters);
+  for (size_t i = 0; i < iters; i++) {
+    folly::doNotOptimizeAway(fixture->getNodes(params));
+  }
+}
+
+BENCHMARK(inspectorSearch, iters) {
+  folly::Optional<InspectorFixture> fixture;
+  BENCHMARK_SUSPEND {
+    fixture.emplace();
+  }
+  const auto params = dynamic::object("query", "textview")("limit", 100);
+  CountAllocations counter("inspectorSearch", iters);
+  for (size_t i = 0; i < iters; i++) {
+    folly::doNotOptimizeAway(fixture->inspector->getSearchResults(params));
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+// Android converts SonarObject and SonarArray values to folly::dynamic
+// through JSON, which is what these measure. The iOS conversion needs
+// Foundation, so it isn't covered here.
+
+BENCHMARK(toJsonInspector, iters) {
+  dynamic payload;
+  BENCHMARK_SUSPEND {
+    payload = inspectorPayload();
+  }
+  CountAllocations counter("toJsonInspector", iters);
+  for (size_t i = 0; i < iters; i++) {
+    folly::doNotOptimizeAway(folly::toJson(payload));
+  }
+}
+
+BENCHMARK(parseJsonInspector, iters) {
+  std::string json;
+  BENCHMARK_SUSPEND {
+    json = folly::toJson(inspectorPayload());
+  }
+  CountAllocations counter("parseJsonInspector", iters);
+  for (size_t i = 0; i < iters; i++) {
+    folly::doNotOptimizeAway(folly::parseJson(json));
+  }
+}
+
+BENCHMARK(toJsonNetwork, iters) {
+  dynamic payload;
+  BENCHMARK_SUSPEND {
+    payload = networkPayload();
+  }
+  CountAllocations counter("toJsonNetwork", iters);
+  for (size_t i = 0; i < iters; i++) {
+    folly::doNotOptimizeAway(folly::toJson(payload));
+  }
+}
+
+BENCHMARK(parseJsonNetwork, iters) {
+  std::string json;
+  BENCHMARK_SUSPEND {
+    json = folly::toJson(networkPayload());
+  }
+  CountAllocations counter("parseJsonNetwork", iters);
+  for (size_t i = 0; i < iters; i++) {
+    folly::doNotOptimizeAway(folly::parseJson(json));
+  }
+}
+
+} // namespace benchmarks
+} // namespace sonar
+} // namespace facebook
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  if (FLAGS_allocations) {
+    facebook::sonar::benchmarks::printAllocations();
+  }
+  return 0;
+}
@@ -0,0 +1,391 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+/*
+ Plays a desktop hammering the device. Desktop threads feed requests straight
+ into a SonarClient's socket callbacks, the way SonarWebSocketImpl does, and
+ the client answers through an in-memory socket, so this measures the
+ client's dispatch and its locking rather than the transport, which
+ SonarLoopbackHarness covers.
+
+ Requests either come from a recorded trace or from one of the built-in
+ scenarios:
+
+   execute     every thread calls "echo" on the plugins as fast as --rate
+   initDeinit  every thread inits and deinits the plugins over and over
+   getNodes    every thread asks for --ids nodes at once
+   mixed       threads take turns at the three above
+
+ A trace has one JSON object per line, {"at": ms, "message": {...}}, with
+ "at" counted from the start of the trace. Every thread replays the whole
+ trace, --scale times faster than it was recorded. Request ids are rewritten
+ so that responses can be matched to requests across threads. Executes that
+ race a deinit fail, and show up as errors and unanswered requests.
+
+   ./SonarLoadGenerator --scenario=mixed --threads=8 --rate=2000 --seconds=10
+   ./SonarLoadGenerator --trace=desktop.trace --threads=4 --scale=10
+*/
+
+#include <Sonar/SonarClient.h>
+#include <Sonar/SonarState.h>
+
+#include <folly/FileUtil.h>
+#include <folly/String.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/json.h>
+#include <folly/portability/GFlags.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+DEFINE_string(trace, "", "Desktop trace to replay instead of a scenario");
+DEFINE_string(scenario, "mixed", "execute, initDeinit, getNodes or mixed");
+DEFINE_int32(threads, 4, "Number of desktop threads sending requests");
+DEFINE_int32(plugins, 4, "Number of plugins registered with the client");
+DEFINE_int32(rate, 1000, "Requests per second sent by each thread");
+DEFINE_int32(seconds, 10, "How long each scenario thread sends for");
+DEFINE_double(scale, 1.0, "How much faster than recorded to replay a trace");
+DEFINE_int32(ids, 10000, "Node ids in each getNodes request");
+DEFINE_int32(
+    executor_threads,
+    0,
+    "Threads running the plugins' receivers, 0 to run them while dispatching");
+
+namespace facebook {
+namespace sonar {
+namespace load {
+
+using Clock = std::chrono::steady_clock;
+using folly::dynamic;
+
+struct TraceEntry {
+  // Offset from the start of the trace.
+  std::chrono::nanoseconds at;
+  dynamic message;
+};
+
+std::vector<TraceEntry> readTrace(const std::string& path) {
+  std::string contents;
+  if (!folly::readFile(path.c_str(), contents)) {
+    throw std::runtime_error("Couldn't read " + path);
+  }
+  std::vector<folly::StringPiece> lines;
+  folly::split('\n', contents, lines, true);
+
+  std::vector<TraceEntry> trace;
+  trace.reserve(lines.size());
+  for (const auto line : lines) {
+    auto entry = folly::parseJson(line);
+    trace.push_back(TraceEntry{
+        std::chrono::nanoseconds(
+            static_cast<int64_t>(entry["at"].asDouble() * 1e6 / FLAGS_scale)),
+        std::move(entry["message"])});
+  }
+  return trace;
+}
+
+dynamic init(const std::string& plugin) {
+  return dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", plugin));
+}
+
+dynamic deinit(const std::string& plugin) {
+  return dynamic::object("method", "deinit")(
+      "params", dynamic::object("plugin", plugin));
+}
+
+dynamic execute(
+    const std::string& plugin,
+    const std::string& method,
+    dynamic params) {
+  return dynamic::object("id", 0)("method", "execute")(
+      "params",
+      dynamic::object("api", plugin)("method", method)(
+          "params", std::move(params)));
+}
+
+std::string pluginName(int64_t i) {
+  return folly::to<std::string>("Plugin", i % FLAGS_plugins);
+}
+
+/**
+ Requests sent by one scenario thread, --rate a second for --seconds.
+ */
+std::vector<TraceEntry> scenarioTrace(const std::string& scenario, int thread) {
+  dynamic ids = dynamic::array();
+  if (scenario == "getNodes") {
+    for (int i = 0; i < FLAGS_ids; i++) {
+      ids.push_back(folly::to<std::string>(i));
+    }
+  }
+
+  const auto interval = std::chrono::nanoseconds(1000000000 / FLAGS_rate);
+  const auto count = static_cast<int64_t>(FLAGS_rate) * FLAGS_seconds;
+  std::vector<TraceEntry> trace;
+  trace.reserve(count);
+  for (int64_t i = 0; i < count; i++) {
+    const auto plugin = pluginName(thread + i);
+    dynamic message = nullptr;
+    if (scenario == "execute") {
+      message = execute(plugin, "echo", dynamic::object("value", i));
+    } else if (scenario == "initDeinit") {
+      message = i % 2 == 0 ? init(plugin) : deinit(plugin);
+    } else if (scenario == "getNodes") {
+      message = execute(plugin, "getNodes", dynamic::object("ids", ids));
+    } else {
+      throw std::invalid_argument("Unknown scenario " + scenario);
+    }
+    trace.push_back(TraceEntry{interval * i, std::move(message)});
+  }
+  return trace;
+}
+
+/**
+ Stands in for the connection to the desktop, matching responses to the
+ requests that were dispatched.
+ */
+class LoadSocket : public SonarWebSocket {
+ public:
+  void start() override {
+    open_ = true;
+    callbacks_->onConnected();
+  }
+
+  void stop() override {
+    open_ = false;
+    callbacks_->onDisconnected();
+  }
+
+  bool isOpen() const override {
+    return open_;
+  }
+
+  void setCallbacks(Callbacks* callbacks) override {
+    callbacks_ = callbacks;
+  }
+
+  /**
+   Hands a request to the client like a received frame, returning how long
+   the client took to dispatch it.
+   */
+  std::chrono::nanoseconds dispatch(dynamic& message) {
+    const auto start = Clock::now();
+    if (message.find("id") != message.items().end()) {
+      const auto id = nextId_++;
+      message["id"] = id;
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_[id] = start;
+    }
+    callbacks_->onMessageReceived(message);
+    return Clock::now() - start;
+  }
+
+  void sendMessage(const dynamic& message) override {
+    const auto now = Clock::now();
+    if (message.find("error") != message.items().end()) {
+      errors_++;
+    }
+    const auto id = message.find("id");
+    if (id == message.items().end()) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto request = pending_.find(id->second.asInt());
+    if (request != pending_.end()) {
+      responseLatencies_.push_back(now - request->second);
+      pending_.erase(request);
+    }
+  }
+
+  std::vector<std::chrono::nanoseconds> responseLatencies() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return responseLatencies_;
+  }
+
+  size_t unanswered() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+  }
+
+  uint64_t errors() const {
+    return errors_;
+  }
+
+ private:
+  std::atomic<bool> open_{false};
+  Callbacks* callbacks_ = nullptr;
+  std::atomic<int64_t> nextId_{1};
+  std::atomic<uint64_t> errors_{0};
+  std::mutex mutex_;
+  std::unordered_map<int64_t, Clock::time_point> pending_;
+  std::vector<std::chrono::nanoseconds> responseLatencies_;
+};
+
+/**
+ Answers "echo" with its params and "getNodes" with a node per id, about
+ what the inspector plugins do without the cost of walking a real tree.
+ */
+class LoadPlugin : public SonarPlugin {
+ public:
+  explicit LoadPlugin(std::string identifier)
+      : identifier_(std::move(identifier)) {}
+
+  std::string identifier() const override {
+    return identifier_;
+  }
+
+  void didConnect(std::shared_ptr<SonarConnection> conn) override {
+    conn->receive(
+        "echo",
+        [](const dynamic& params, std::unique_ptr<SonarResponder> responder) {
+          responder->success(params);
+        });
+    conn->receive(
+        "getNodes",
+        [](const dynamic& params, std::unique_ptr<SonarResponder> responder) {
+          dynamic elements = dynamic::array();
+          for (const auto& id : params["ids"]) {
+            elements.push_back(dynamic::object("id", id)("name", "View")(
+                "children", dynamic::array()));
+          }
+          responder->success(
+              dynamic::object("elements", std::move(elements)));
+        });
+  }
+
+  void didDisconnect() override {}
+
+ private:
+  std::string identifier_;
+};
+
+double percentileMicros(
+    std::vector<std::chrono::nanoseconds>& samples,
+    double p) {
+  if (samples.empty()) {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[std::min(
+                     samples.size() - 1,
+                     static_cast<size_t>(p * samples.size()))]
+             .count() /
+      1000.0;
+}
+
+int run() {
+  std::vector<std::vector<TraceEntry>> traces(FLAGS_threads);
+  if (!FLAGS_trace.empty()) {
+    const auto trace = readTrace(FLAGS_trace);
+    std::fill(traces.begin(), traces.end(), trace);
+  } else {
+    const std::vector<std::string> scenarios{"execute", "initDeinit",
+                                             "getNodes"};
+    for (int i = 0; i < FLAGS_threads; i++) {
+      traces[i] = scenarioTrace(
+          FLAGS_scenario == "mixed" ? scenarios[i % scenarios.size()]
+                                    : FLAGS_scenario,
+          i);
+    }
+  }
+
+  auto socket = new LoadSocket();
+  SonarClient client(
+      std::unique_ptr<SonarWebSocket>(socket),
+      std::make_shared<SonarState>());
+  std::shared_ptr<folly::Executor> executor;
+  if (FLAGS_executor_threads > 0) {
+    executor =
+        std::make_shared<folly::CPUThreadPoolExecutor>(FLAGS_executor_threads);
+  }
+  for (int i = 0; i < FLAGS_plugins; i++) {
+    client.addPlugin(std::make_shared<LoadPlugin>(pluginName(i)), executor);
+  }
+  client.start();
+  if (FLAGS_trace.empty()) {
+    for (int i = 0; i < FLAGS_plugins; i++) {
+      auto message = init(pluginName(i));
+      socket->dispatch(message);
+    }
+  }
+
+  std::mutex mutex;
+  std::vector<std::chrono::nanoseconds> dispatchLatencies;
+  std::atomic<int64_t> dispatched{0};
+  std::atomic<int64_t> late{0};
+
+  const auto start = Clock::now();
+  std::vector<std::thread> desktops;
+  for (int i = 0; i < FLAGS_threads; i++) {
+    desktops.emplace_back([&, i] {
+      std::vector<std::chrono::nanoseconds> latencies;
+      latencies.reserve(traces[i].size());
+      for (auto& entry : traces[i]) {
+        const auto due = start + entry.at;
+        if (Clock::now() > due) {
+          late++;
+        } else {
+          std::this_thread::sleep_until(due);
+        }
+        latencies.push_back(socket->dispatch(entry.message));
+      }
+      dispatched += latencies.size();
+      std::lock_guard<std::mutex> lock(mutex);
+      dispatchLatencies.insert(
+          dispatchLatencies.end(), latencies.begin(), latencies.end());
+    });
+  }
+  for (auto& desktop : desktops) {
+    desktop.join();
+  }
+  if (executor) {
+    // Let the receivers catch up before reading the responses.
+    std::static_pointer_cast<folly::CPUThreadPoolExecutor>(executor)->join();
+  }
+  const double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  auto responseLatencies = socket->responseLatencies();
+  const auto lock = client.getMetrics()["clientLock"];
+  client.stop();
+
+  std::cout << "dispatched:             " << dispatched << "\n"
+            << "requests/sec:           " << dispatched / elapsed << "\n"
+            << "behind schedule:        " << late << "\n"
+            << "p50 dispatch (us):      "
+            << percentileMicros(dispatchLatencies, 0.5) << "\n"
+            << "p99 dispatch (us):      "
+            << percentileMicros(dispatchLatencies, 0.99) << "\n"
+            << "responses:              " << responseLatencies.size() << "\n"
+            << "unanswered:             " << socket->unanswered() << "\n"
+            << "errors:                 " << socket->errors() << "\n"
+            << "p50 response (us):      "
+            << percentileMicros(responseLatencies, 0.5) << "\n"
+            << "p99 response (us):      "
+            << percentileMicros(responseLatencies, 0.99) << "\n"
+            << "lock acquisitions:      " << lock["acquisitions"] << "\n"
+            << "lock contended:         " << lock["contended"] << "\n"
+            << "lock wait (us):         " << lock["waitMicros"] << "\n"
+            << "max lock wait (us):     " << lock["maxWaitMicros"] << std::endl;
+  return 0;
+}
+
+} // namespace load
+} // namespace sonar
+} // namespace facebook
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return facebook::sonar::load::run();
+}
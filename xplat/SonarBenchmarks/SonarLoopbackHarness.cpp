@@ -0,0 +1,308 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+/*
+ End to end throughput and latency of the real transport. An in-process
+ rsocket server plays the desktop, and a SonarWebSocketImpl connects to it over
+ an abstract Unix socket, the way it does with localSocketName set, so no
+ certificates are needed. Plugin threads send execute messages at a fixed
+ rate, and the server measures how long each took to arrive. CPU time is that
+ of the whole process, so it includes the server's share.
+
+   ./SonarLoopbackHarness --plugins=4 --rate=500 --size=1024 --seconds=10
+
+ Compare against --single_event_base to see what the hop from the callback
+ thread to the connection thread costs, or add --latency_ms, --jitter_ms,
+ --bandwidth_bytes and --drop_rate to see how batching, compression and
+ backpressure hold up over a slow link, see SonarConditionedWebSocket.
+*/
+
+#include <Sonar/ConnectionContextStore.h>
+#include <Sonar/SonarConditionedWebSocket.h>
+#include <Sonar/SonarConnectionImpl.h>
+#include <Sonar/SonarState.h>
+#include <Sonar/SonarWebSocketImpl.h>
+
+#include <folly/Baton.h>
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <folly/json.h>
+#include <folly/portability/GFlags.h>
+#include <rsocket/RSocket.h>
+#include <rsocket/transports/tcp/TcpDuplexConnection.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+DEFINE_int32(plugins, 4, "Number of plugins sending messages");
+DEFINE_int32(rate, 500, "Messages per second sent by each plugin");
+DEFINE_int32(size, 1024, "Bytes of payload in each message");
+DEFINE_int32(seconds, 10, "How long to send for");
+DEFINE_int32(batch_window_ms, 0, "SonarInitConfig::batchWindowMs");
+DEFINE_bool(
+    single_event_base,
+    false,
+    "Run the connection on the callback EventBase instead of its own thread");
+DEFINE_string(socket, "sonar-loopback", "Name of the abstract Unix socket");
+DEFINE_int32(latency_ms, 0, "SonarLinkConditions::latencyMs");
+DEFINE_int32(jitter_ms, 0, "SonarLinkConditions::jitterMs");
+DEFINE_int64(
+    bandwidth_bytes,
+    0,
+    "SonarLinkConditions::bandwidthBytesPerSecond");
+DEFINE_double(drop_rate, 0, "SonarLinkConditions::dropRate");
+
+namespace facebook {
+namespace sonar {
+namespace loopback {
+
+using Clock = std::chrono::steady_clock;
+
+int64_t nowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ Accepts connections on an abstract Unix socket, which rsocket's own
+ TcpConnectionAcceptor can't listen on.
+ */
+class LocalConnectionAcceptor : public rsocket::ConnectionAcceptor,
+                                public folly::AsyncServerSocket::AcceptCallback {
+ public:
+  explicit LocalConnectionAcceptor(std::string name) : name_(std::move(name)) {}
+
+  ~LocalConnectionAcceptor() override {
+    stop();
+  }
+
+  void start(OnDuplexConnectionAccept onAccept) override {
+    onAccept_ = std::move(onAccept);
+    auto evb = thread_.getEventBase();
+    evb->runInEventBaseThreadAndWait([this, evb] {
+      folly::SocketAddress address;
+      address.setFromPath(std::string(1, '\0') + name_);
+      socket_ = folly::AsyncServerSocket::newSocket(evb);
+      socket_->bind(address);
+      socket_->addAcceptCallback(this, evb);
+      socket_->listen(128);
+      socket_->startAccepting();
+    });
+  }
+
+  void stop() override {
+    thread_.getEventBase()->runInEventBaseThreadAndWait([this] {
+      socket_.reset();
+    });
+  }
+
+  folly::Optional<uint16_t> listeningPort() const override {
+    return folly::none;
+  }
+
+  void connectionAccepted(
+      int fd,
+      const folly::SocketAddress&) noexcept override {
+    auto evb = thread_.getEventBase();
+    auto socket = folly::AsyncSocket::UniquePtr(new folly::AsyncSocket(evb, fd));
+    onAccept_(
+        std::make_unique<rsocket::TcpDuplexConnection>(std::move(socket)),
+        *evb);
+  }
+
+  void acceptError(const std::exception& e) noexcept override {
+    std::cerr << "accept failed: " << e.what() << std::endl;
+  }
+
+ private:
+  std::string name_;
+  folly::ScopedEventBaseThread thread_;
+  folly::AsyncServerSocket::UniquePtr socket_;
+  OnDuplexConnectionAccept onAccept_;
+};
+
+/**
+ Plays the desktop, recording the latency of every message it receives.
+ */
+class DesktopResponder : public rsocket::RSocketResponder {
+ public:
+  void handleFireAndForget(rsocket::Payload request, rsocket::StreamId)
+      override {
+    const auto receivedAt = nowNanos();
+    const auto message = folly::parseJson(request.moveDataToString());
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (message["method"] == "batch") {
+      for (const auto& batched : message["messages"]) {
+        record(batched, receivedAt);
+      }
+    } else {
+      record(message, receivedAt);
+    }
+  }
+
+  std::vector<int64_t> latencies() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return latencies_;
+  }
+
+ private:
+  void record(const folly::dynamic& message, int64_t receivedAt) {
+    if (message.getDefault("method") != "execute") {
+      return;
+    }
+    const auto sentAt = message["params"]["params"]["sentAt"].asInt();
+    latencies_.push_back(receivedAt - sentAt);
+  }
+
+  std::mutex mutex_;
+  std::vector<int64_t> latencies_;
+};
+
+class ConnectedCallbacks : public SonarWebSocket::Callbacks {
+ public:
+  void onConnected() override {
+    connected.post();
+  }
+  void onDisconnected() override {}
+  void onMessageReceived(const folly::dynamic&) override {}
+
+  folly::Baton<> connected;
+};
+
+double cpuSeconds() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+long peakRSSKilobytes() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+int run() {
+  auto responder = std::make_shared<DesktopResponder>();
+  auto server = rsocket::RSocket::createServer(
+      std::make_unique<LocalConnectionAcceptor>(FLAGS_socket));
+  server->start([responder](const rsocket::SetupParameters&) {
+    return responder;
+  });
+
+  folly::ScopedEventBaseThread sonarThread;
+  folly::ScopedEventBaseThread connectionThread;
+
+  SonarInitConfig config;
+  config.deviceData.host = "localhost";
+  config.deviceData.os = "Linux";
+  config.deviceData.device = "loopback";
+  config.deviceData.deviceId = "loopback";
+  config.deviceData.app = "SonarLoopbackHarness";
+  config.deviceData.privateAppDirectory = "/tmp";
+  config.callbackWorker = sonarThread.getEventBase();
+  config.connectionWorker = FLAGS_single_event_base
+      ? config.callbackWorker
+      : connectionThread.getEventBase();
+  config.localSocketName = FLAGS_socket;
+  config.batchWindowMs = FLAGS_batch_window_ms;
+  config.linkConditions.enabled = FLAGS_latency_ms > 0 || FLAGS_jitter_ms > 0 ||
+      FLAGS_bandwidth_bytes > 0 || FLAGS_drop_rate > 0;
+  config.linkConditions.latencyMs = FLAGS_latency_ms;
+  config.linkConditions.jitterMs = FLAGS_jitter_ms;
+  config.linkConditions.bandwidthBytesPerSecond = FLAGS_bandwidth_bytes;
+  config.linkConditions.dropRate = FLAGS_drop_rate;
+
+  auto state = std::make_shared<SonarState>();
+  std::unique_ptr<SonarWebSocket> socket =
+      std::make_unique<SonarWebSocketImpl>(
+          config,
+          state,
+          std::make_shared<ConnectionContextStore>(config.deviceData));
+  if (config.linkConditions.enabled) {
+    socket = std::make_unique<SonarConditionedWebSocket>(
+        std::move(socket), config.linkConditions, config.callbackWorker);
+  }
+  ConnectedCallbacks callbacks;
+  socket->setCallbacks(&callbacks);
+  socket->start();
+  if (!callbacks.connected.timed_wait(std::chrono::seconds(10))) {
+    std::cerr << "Couldn't connect to the loopback server" << std::endl;
+    return 1;
+  }
+
+  const std::string body(FLAGS_size, 'x');
+  const auto interval = std::chrono::nanoseconds(1000000000 / FLAGS_rate);
+  const auto end = Clock::now() + std::chrono::seconds(FLAGS_seconds);
+  std::atomic<int64_t> sent{0};
+
+  const auto cpuBefore = cpuSeconds();
+  const auto start = Clock::now();
+  std::vector<std::thread> plugins;
+  for (int i = 0; i < FLAGS_plugins; i++) {
+    plugins.emplace_back([&, i] {
+      SonarConnectionImpl connection(
+          socket.get(), folly::to<std::string>("Plugin", i));
+      for (auto next = Clock::now(); next < end; next += interval) {
+        std::this_thread::sleep_until(next);
+        connection.send(
+            "event",
+            folly::dynamic::object("sentAt", nowNanos())("body", body));
+        sent++;
+      }
+    });
+  }
+  for (auto& plugin : plugins) {
+    plugin.join();
+  }
+
+  // Give the last messages time to arrive.
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  const double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  const double cpu = cpuSeconds() - cpuBefore;
+  socket->stop();
+
+  auto latencies = responder->latencies();
+  if (latencies.empty()) {
+    std::cerr << "No messages arrived" << std::endl;
+    return 1;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  const auto percentile = [&](double p) {
+    return latencies[std::min(
+               latencies.size() - 1,
+               static_cast<size_t>(p * latencies.size()))] /
+        1000.0;
+  };
+
+  std::cout << "sent:              " << sent << "\n"
+            << "received:          " << latencies.size() << "\n"
+            << "messages/sec:      " << latencies.size() / elapsed << "\n"
+            << "p50 latency (us):  " << percentile(0.5) << "\n"
+            << "p99 latency (us):  " << percentile(0.99) << "\n"
+            << "CPU/msg (us):      " << cpu * 1e6 / latencies.size() << "\n"
+            << "peak RSS (KB):     " << peakRSSKilobytes() << std::endl;
+  return latencies.size() == static_cast<size_t>(sent) ? 0 : 1;
+}
+
+} // namespace loopback
+} // namespace sonar
+} // namespace facebook
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return facebook::sonar::loopback::run();
+}
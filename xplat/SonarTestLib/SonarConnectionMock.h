@@ -17,13 +17,15 @@ namespace sonar {
 
 class SonarConnectionMock : public SonarConnection {
  public:
-  void send(const std::string& method, const folly::dynamic& params) override {
-    sent_[method] = params;
+  void send(folly::StringPiece method, const folly::dynamic& params) override {
+    sent_[method.str()] = params;
   }
 
-  void receive(const std::string& method, const SonarReceiver& receiver)
+  using SonarConnection::receive;
+
+  void receive(folly::StringPiece method, const SonarReceiver& receiver)
       override {
-    receivers_[method] = receiver;
+    receivers_[method.str()] = receiver;
   }
 
   void error(const std::string& message, const std::string& stacktrace)
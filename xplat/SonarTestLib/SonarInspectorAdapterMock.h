@@ -0,0 +1,145 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <Sonar/SonarInspector.h>
+#include <folly/Conv.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+/**
+ A view in the hierarchy of SonarInspectorAdapterMock.
+ */
+struct SonarInspectorNodeMock {
+  std::string id;
+  std::string name;
+  SonarInspectorBounds bounds;
+  std::string text;
+  std::vector<std::unique_ptr<SonarInspectorNodeMock>> children;
+
+  SonarInspectorNodeMock* add(std::string childId, std::string childName) {
+    children.emplace_back(new SonarInspectorNodeMock);
+    auto child = children.back().get();
+    child->id = std::move(childId);
+    child->name = std::move(childName);
+    return child;
+  }
+};
+
+class SonarInspectorAdapterMock : public SonarInspectorAdapter {
+ public:
+  explicit SonarInspectorAdapterMock(SonarInspectorNodeMock* root)
+      : root_(root) {}
+
+  SonarInspectorNode root() override {
+    return root_;
+  }
+
+  std::string identifier(SonarInspectorNode node) override {
+    return get(node)->id;
+  }
+
+  std::string name(SonarInspectorNode node) override {
+    return get(node)->name;
+  }
+
+  void children(
+      SonarInspectorNode node,
+      std::vector<SonarInspectorNode>& children) override {
+    for (const auto& child : get(node)->children) {
+      children.push_back(child.get());
+    }
+  }
+
+  void attributes(
+      SonarInspectorNode node,
+      SonarInspectorAttributes& attributes) override {
+    attributes.add("text", get(node)->text);
+  }
+
+  void data(SonarInspectorNode node, SonarMessageWriter& writer) override {
+    const auto& bounds = get(node)->bounds;
+    writer.beginObject("Layout");
+    writer.put("width", bounds.width).put("height", bounds.height);
+    writer.endObject();
+  }
+
+  void extra(SonarInspectorNode node, SonarMessageWriter& writer) override {
+    writer.beginObject("extraInfo");
+    writer.put("hasText", !get(node)->text.empty()).endObject();
+  }
+
+  SonarInspectorBounds bounds(SonarInspectorNode node) override {
+    return get(node)->bounds;
+  }
+
+  SonarInspectorNode find(const std::string& id) override {
+    return find(root_, id);
+  }
+
+  void retain(SonarInspectorNode node) override {
+    retained++;
+  }
+
+  void release(SonarInspectorNode node) override {
+    retained--;
+  }
+
+  int retained = 0;
+
+ private:
+  static const SonarInspectorNodeMock* get(SonarInspectorNode node) {
+    return static_cast<const SonarInspectorNodeMock*>(node);
+  }
+
+  static const SonarInspectorNodeMock* find(
+      const SonarInspectorNodeMock* node,
+      const std::string& id) {
+    if (node->id == id) {
+      return node;
+    }
+    for (const auto& child : node->children) {
+      if (const auto found = find(child.get(), id)) {
+        return found;
+      }
+    }
+    return nullptr;
+  }
+
+  SonarInspectorNodeMock* root_;
+};
+
+/**
+ A root with width children, each with a subtree of the given depth and
+ width, for benchmarking a hierarchy the size of a real app's.
+ */
+inline void buildInspectorTree(
+    SonarInspectorNodeMock& parent,
+    int depth,
+    int width) {
+  if (depth == 0) {
+    return;
+  }
+  for (int i = 0; i < width; i++) {
+    auto child = parent.add(
+        folly::to<std::string>(parent.id, ".", i),
+        depth == 1 ? "TextView" : "LinearLayout");
+    child->text = folly::to<std::string>("Item ", i);
+    buildInspectorTree(*child, depth - 1, width);
+  }
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
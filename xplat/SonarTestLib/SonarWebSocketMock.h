@@ -32,6 +32,10 @@ class SonarWebSocketMock : public SonarWebSocket {
     }
   }
 
+  void setSuspended(bool aSuspended) override {
+    suspended = aSuspended;
+  }
+
   bool isOpen() const override {
     return open;
   }
@@ -40,14 +44,25 @@ class SonarWebSocketMock : public SonarWebSocket {
     messages.push_back(message);
   }
 
+  size_t getBufferedBytes() const override {
+    return bufferedBytes;
+  }
+
+  void notifyWhenDrained() override {
+    drainNotificationRequested = true;
+  }
+
   void setCallbacks(Callbacks* aCallbacks) override {
     callbacks = aCallbacks;
   }
 
  public:
   bool open = false;
+  bool suspended = false;
   Callbacks* callbacks;
   std::vector<folly::dynamic> messages;
+  size_t bufferedBytes = 0;
+  bool drainNotificationRequested = false;
 };
 
 } // namespace test
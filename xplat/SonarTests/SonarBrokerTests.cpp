@@ -0,0 +1,429 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarBroker.h>
+#include <Sonar/SonarClient.h>
+#include <SonarTestLib/SonarPluginMock.h>
+#include <SonarTestLib/SonarWebSocketMock.h>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <folly/json.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+namespace {
+
+// The broker and its satellites talk over a real socket, on threads of
+// their own.
+template <typename Condition>
+bool eventually(Condition condition) {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!condition()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return true;
+}
+
+std::string uniqueBrokerName() {
+  static std::atomic<int> count{0};
+  return "sonar-broker-tests-" + std::to_string(getpid()) + "-" +
+      std::to_string(count++);
+}
+
+/**
+ The plugins of one process. Counts how often each is connected, and has
+ them answer "whoami" with the name of the process.
+ */
+class ProcessPlugins {
+ public:
+  ProcessPlugins(
+      const std::string& process,
+      const std::vector<std::string>& identifiers) {
+    for (const auto& identifier : identifiers) {
+      connected_[identifier];
+    }
+    for (const auto& identifier : identifiers) {
+      plugins.push_back(std::make_shared<SonarPluginMock>(
+          identifier,
+          [this, identifier, process](std::shared_ptr<SonarConnection> conn) {
+            connected_.at(identifier)++;
+            conn->receive(
+                "whoami",
+                [process](
+                    const dynamic&, std::unique_ptr<SonarResponder> responder) {
+                  responder->success(dynamic::object("process", process));
+                });
+          },
+          [this, identifier]() { connected_.at(identifier)--; }));
+    }
+  }
+
+  int connected(const std::string& identifier) const {
+    return connected_.at(identifier);
+  }
+
+  std::vector<std::shared_ptr<SonarPlugin>> plugins;
+
+ private:
+  std::map<std::string, std::atomic<int>> connected_;
+};
+
+/**
+ A process that owns the desktop connection, which desktop stands in for,
+ and another process connected to it, each with a client of its own.
+ Everything on the broker's side happens on its thread.
+ */
+class BrokerSetup {
+ public:
+  ProcessPlugins brokerPlugins;
+  ProcessPlugins satellitePlugins;
+  // Whether the broker got the satellite's plugins.
+  bool registered = false;
+
+  BrokerSetup(
+      const std::vector<std::string>& brokerPlugins,
+      const std::vector<std::string>& satellitePlugins)
+      : brokerPlugins("broker", brokerPlugins),
+        satellitePlugins("satellite", satellitePlugins),
+        name_(uniqueBrokerName()),
+        desktop_(new SonarWebSocketMock) {
+    broker_ = std::make_unique<SonarClient>(
+        std::make_unique<SonarBrokerWebSocket>(
+            std::unique_ptr<SonarWebSocketMock>{desktop_},
+            name_,
+            brokerThread_.getEventBase()),
+        std::make_shared<SonarState>());
+    onBroker([this]() {
+      for (const auto& plugin : this->brokerPlugins.plugins) {
+        broker_->addPlugin(plugin);
+      }
+      broker_->start();
+    });
+    // Listening is queued behind start.
+    onBroker([]() {});
+
+    const auto refreshes = refreshesSent();
+    satellite_ = std::make_unique<SonarClient>(
+        std::make_unique<SonarBrokeredWebSocket>(
+            name_,
+            satelliteCallbacks_.getEventBase(),
+            satelliteConnection_.getEventBase()),
+        std::make_shared<SonarState>());
+    for (const auto& plugin : this->satellitePlugins.plugins) {
+      satellite_->addPlugin(plugin);
+    }
+    satellite_->start();
+    // The broker asks the desktop to refresh once it knows the satellite's
+    // plugins.
+    registered = eventually([&]() { return refreshesSent() > refreshes; });
+  }
+
+  ~BrokerSetup() {
+    stopSatellite();
+    onBroker([this]() { broker_ = nullptr; });
+  }
+
+  /**
+   Stops the satellite and waits until its threads are done with it.
+   */
+  void stopSatellite() {
+    if (!satellite_) {
+      return;
+    }
+    satellite_->stop();
+    satelliteConnection_.getEventBase()->runInEventBaseThreadAndWait([]() {});
+    satelliteCallbacks_.getEventBase()->runInEventBaseThreadAndWait([]() {});
+    satellite_ = nullptr;
+  }
+
+  void fromDesktop(const dynamic& message) {
+    onBroker([&]() { desktop_->callbacks->onMessageReceived(message); });
+  }
+
+  std::vector<dynamic> toDesktop() {
+    std::vector<dynamic> messages;
+    onBroker([&]() { messages = desktop_->messages; });
+    return messages;
+  }
+
+  /**
+   What the desktop was answered to the request with the given id, null
+   until then.
+   */
+  dynamic answer(int64_t id) {
+    for (const auto& message : toDesktop()) {
+      if (message.getDefault("id") == id) {
+        return message;
+      }
+    }
+    return nullptr;
+  }
+
+  dynamic waitForAnswer(int64_t id) {
+    dynamic found = nullptr;
+    eventually([&]() {
+      found = answer(id);
+      return !found.isNull();
+    });
+    return found;
+  }
+
+  size_t refreshesSent() {
+    size_t count = 0;
+    for (const auto& message : toDesktop()) {
+      count += message.getDefault("method") == "refreshPlugins";
+    }
+    return count;
+  }
+
+  bool isBrokerPluginActive(const std::string& identifier) {
+    bool active = false;
+    onBroker([&]() { active = broker_->isPluginActive(identifier); });
+    return active;
+  }
+
+  template <typename F>
+  void onBroker(F&& f) {
+    brokerThread_.getEventBase()->runInEventBaseThreadAndWait(
+        std::forward<F>(f));
+  }
+
+ private:
+  const std::string name_;
+  folly::ScopedEventBaseThread brokerThread_;
+  folly::ScopedEventBaseThread satelliteCallbacks_;
+  folly::ScopedEventBaseThread satelliteConnection_;
+  SonarWebSocketMock* const desktop_;
+  std::unique_ptr<SonarClient> broker_;
+  std::unique_ptr<SonarClient> satellite_;
+};
+
+} // namespace
+
+TEST(SonarBrokerTests, testFramesSplitAcrossReads) {
+  const auto stream =
+      encodeBrokerFrame(SonarBrokerFrameType::DesktopMessage, "{\"a\":1}") +
+      encodeBrokerFrame(SonarBrokerFrameType::Connected, "") +
+      encodeBrokerFrame(SonarBrokerFrameType::ForDesktop, "[2]");
+
+  SonarBrokerFrameReader reader;
+  std::vector<std::pair<SonarBrokerFrameType, std::string>> frames;
+  SonarBrokerFrameType type;
+  std::string payload;
+  // One byte at a time, the worst the socket can do.
+  for (const auto byte : stream) {
+    reader.append(&byte, 1);
+    while (reader.next(type, payload)) {
+      frames.emplace_back(type, payload);
+    }
+  }
+
+  ASSERT_EQ(frames.size(), 3);
+  EXPECT_EQ(frames[0].first, SonarBrokerFrameType::DesktopMessage);
+  EXPECT_EQ(frames[0].second, "{\"a\":1}");
+  EXPECT_EQ(frames[1].first, SonarBrokerFrameType::Connected);
+  EXPECT_EQ(frames[1].second, "");
+  EXPECT_EQ(frames[2].first, SonarBrokerFrameType::ForDesktop);
+  EXPECT_EQ(frames[2].second, "[2]");
+  EXPECT_FALSE(reader.failed());
+}
+
+TEST(SonarBrokerTests, testOversizedFrameFailsReader) {
+  const char header[] = {'\xff', '\xff', '\xff', '\xff', 'M'};
+  SonarBrokerFrameReader reader;
+  reader.append(header, sizeof(header));
+
+  SonarBrokerFrameType type;
+  std::string payload;
+  EXPECT_FALSE(reader.next(type, payload));
+  EXPECT_TRUE(reader.failed());
+}
+
+TEST(SonarBrokerTests, testOwnPluginsWithoutSatellites) {
+  // Not looping, so nothing ever connects to the broker.
+  folly::EventBase eventBase;
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(
+      std::make_unique<SonarBrokerWebSocket>(
+          std::unique_ptr<SonarWebSocketMock>{socket}, "test", &eventBase),
+      std::make_shared<SonarState>());
+  client.start();
+  auto plugin = std::make_shared<SonarPluginMock>("Cat");
+  client.addPlugin(plugin);
+
+  socket->callbacks->onMessageReceived(
+      dynamic::object("id", 1)("method", "getPlugins"));
+  EXPECT_EQ(
+      socket->messages.back(),
+      dynamic::object("id", 1)(
+          "success", dynamic::object("plugins", dynamic::array("Cat"))));
+
+  socket->callbacks->onMessageReceived(dynamic::object("id", 2)(
+      "method", "initMany")(
+      "params", dynamic::object("plugins", dynamic::array("Cat"))));
+  EXPECT_TRUE(client.isPluginActive("Cat"));
+  EXPECT_EQ(
+      socket->messages.back(),
+      dynamic::object("id", 2)("success", dynamic::object()));
+}
+
+TEST(SonarBrokerTests, testDesktopSeesSatellitePlugins) {
+  BrokerSetup setup({"Cat"}, {"Dog"});
+  ASSERT_TRUE(setup.registered);
+
+  // The second answer is the one the client keeps until plugins change.
+  for (int64_t id = 1; id <= 2; id++) {
+    setup.fromDesktop(dynamic::object("id", id)("method", "getPlugins"));
+    EXPECT_EQ(
+        setup.answer(id),
+        dynamic::object("id", id)(
+                "success",
+            dynamic::object("plugins", dynamic::array("Cat", "Dog"))));
+  }
+}
+
+TEST(SonarBrokerTests, testCallsAreRoutedToTheSatellite) {
+  BrokerSetup setup({"Cat"}, {"Dog"});
+  ASSERT_TRUE(setup.registered);
+  setup.fromDesktop(dynamic::object("id", 1)("method", "getPlugins"));
+
+  setup.fromDesktop(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Dog")));
+  EXPECT_TRUE(eventually(
+      [&]() { return setup.satellitePlugins.connected("Dog") == 1; }));
+  EXPECT_FALSE(setup.isBrokerPluginActive("Dog"));
+
+  setup.fromDesktop(dynamic::object("id", 2)("method", "execute")(
+      "params", dynamic::object("api", "Dog")("method", "whoami")));
+  EXPECT_EQ(
+      setup.waitForAnswer(2).getDefault("success"),
+      dynamic::object("process", "satellite"));
+  setup.fromDesktop(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Cat")));
+  setup.fromDesktop(dynamic::object("id", 3)("method", "execute")(
+      "params", dynamic::object("api", "Cat")("method", "whoami")));
+  EXPECT_EQ(
+      setup.waitForAnswer(3).getDefault("success"),
+      dynamic::object("process", "broker"));
+
+  // Only the process with the connection reports what it dropped.
+  setup.fromDesktop(dynamic::object("id", 4)("method", "__sendPolicy")(
+      "params",
+      dynamic::object("plugin", "Dog")("method", "whoami")("rate", 5)));
+  const auto policies =
+      setup.waitForAnswer(4).getDefault("success").getDefault("policies");
+  EXPECT_TRUE(policies.getDefault("whoami").count("dropped"));
+
+  setup.fromDesktop(dynamic::object("method", "deinit")(
+      "params", dynamic::object("plugin", "Dog")));
+  EXPECT_TRUE(eventually(
+      [&]() { return setup.satellitePlugins.connected("Dog") == 0; }));
+  EXPECT_EQ(setup.brokerPlugins.connected("Cat"), 1);
+}
+
+TEST(SonarBrokerTests, testInitManyIsSplitAcrossProcesses) {
+  BrokerSetup setup({"Cat"}, {"Dog", "Fox"});
+  ASSERT_TRUE(setup.registered);
+  setup.fromDesktop(dynamic::object("id", 1)("method", "getPlugins"));
+
+  setup.fromDesktop(dynamic::object("id", 2)("method", "initMany")(
+      "params", dynamic::object("plugins", dynamic::array("Cat", "Dog"))));
+  EXPECT_EQ(setup.brokerPlugins.connected("Cat"), 1);
+  EXPECT_TRUE(eventually(
+      [&]() { return setup.satellitePlugins.connected("Dog") == 1; }));
+  EXPECT_EQ(setup.satellitePlugins.connected("Fox"), 0);
+
+  // Only satellite plugins, which the broker answers for on its own.
+  setup.fromDesktop(dynamic::object("id", 3)("method", "initMany")(
+      "params", dynamic::object("plugins", dynamic::array("Fox"))));
+  EXPECT_EQ(
+      setup.answer(3),
+      dynamic::object("id", 3)("success", dynamic::object()));
+  EXPECT_TRUE(eventually(
+      [&]() { return setup.satellitePlugins.connected("Fox") == 1; }));
+
+  // The satellite is sent the plugins without the id, so the desktop is
+  // answered once.
+  size_t answers = 0;
+  for (const auto& message : setup.toDesktop()) {
+    answers += message.getDefault("id") == 2;
+  }
+  EXPECT_EQ(answers, 1);
+
+  setup.fromDesktop(dynamic::object("method", "deinitMany")(
+      "params",
+      dynamic::object("plugins", dynamic::array("Cat", "Dog", "Fox"))));
+  EXPECT_EQ(setup.brokerPlugins.connected("Cat"), 0);
+  EXPECT_TRUE(eventually([&]() {
+    return setup.satellitePlugins.connected("Dog") == 0 &&
+        setup.satellitePlugins.connected("Fox") == 0;
+  }));
+}
+
+TEST(SonarBrokerTests, testBrokerPluginWinsCollisions) {
+  BrokerSetup setup({"Cat"}, {"Cat", "Dog"});
+  ASSERT_TRUE(setup.registered);
+
+  setup.fromDesktop(dynamic::object("id", 1)("method", "getPlugins"));
+  EXPECT_EQ(
+      setup.answer(1).getDefault("success"),
+      dynamic::object("plugins", dynamic::array("Cat", "Dog")));
+
+  setup.fromDesktop(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Cat")));
+  setup.fromDesktop(dynamic::object("id", 2)("method", "execute")(
+      "params", dynamic::object("api", "Cat")("method", "whoami")));
+  EXPECT_EQ(
+      setup.answer(2).getDefault("success"),
+      dynamic::object("process", "broker"));
+
+  // Relayed after anything for Cat would have been, on the same channel.
+  setup.fromDesktop(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Dog")));
+  EXPECT_TRUE(eventually(
+      [&]() { return setup.satellitePlugins.connected("Dog") == 1; }));
+  EXPECT_EQ(setup.satellitePlugins.connected("Cat"), 0);
+}
+
+TEST(SonarBrokerTests, testSatelliteDisconnectRefreshesPlugins) {
+  BrokerSetup setup({"Cat"}, {"Dog"});
+  ASSERT_TRUE(setup.registered);
+  setup.fromDesktop(dynamic::object("id", 1)("method", "getPlugins"));
+  EXPECT_EQ(
+      setup.answer(1).getDefault("success"),
+      dynamic::object("plugins", dynamic::array("Cat", "Dog")));
+
+  const auto refreshes = setup.refreshesSent();
+  setup.stopSatellite();
+  EXPECT_TRUE(
+      eventually([&]() { return setup.refreshesSent() > refreshes; }));
+
+  setup.fromDesktop(dynamic::object("id", 2)("method", "getPlugins"));
+  EXPECT_EQ(
+      setup.answer(2).getDefault("success"),
+      dynamic::object("plugins", dynamic::array("Cat")));
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,134 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarCaptureWebSocket.h>
+#include <Sonar/SonarClient.h>
+#include <SonarTestLib/SonarPluginMock.h>
+
+#include <folly/json.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <cstdio>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+class CaptureCallbacks : public SonarWebSocket::Callbacks {
+ public:
+  void onConnected() override {}
+  void onDisconnected() override {}
+  void onMessageReceived(const dynamic& message) override {
+    received.push_back(message);
+  }
+
+  std::vector<dynamic> received;
+};
+
+std::string capturePath(const std::string& name) {
+  const auto path = "/tmp/SonarCaptureWebSocketTests." + name + "." +
+      std::to_string(getpid());
+  std::remove(path.c_str());
+  std::remove((path + ".1").c_str());
+  return path;
+}
+
+std::vector<dynamic> readAll(const std::string& path) {
+  std::vector<dynamic> messages;
+  SonarCaptureWebSocket::readCapture(
+      path, [&](folly::StringPiece message) {
+        messages.push_back(folly::parseJson(message));
+      });
+  return messages;
+}
+
+TEST(SonarCaptureWebSocketTests, testMessagesAreCaptured) {
+  const auto path = capturePath("captured");
+  folly::EventBase eventBase;
+  CaptureCallbacks callbacks;
+  {
+    SonarCaptureWebSocket socket(path, 4096, &eventBase);
+    socket.setCallbacks(&callbacks);
+    socket.start();
+    eventBase.loopOnce();
+    EXPECT_TRUE(socket.isOpen());
+    ASSERT_EQ(callbacks.received.size(), 1);
+    EXPECT_EQ(callbacks.received[0]["method"], "getPlugins");
+
+    socket.sendMessage(dynamic::object("id", callbacks.received[0]["id"])(
+        "success", dynamic::object("plugins", dynamic::array("Test"))));
+    socket.sendMessage(dynamic::object("method", "execute")("value", 1));
+    socket.sendMessage(dynamic::object("method", "execute")("value", 2));
+    eventBase.loop();
+    ASSERT_EQ(callbacks.received.size(), 2);
+    EXPECT_EQ(callbacks.received[1]["method"], "init");
+  }
+
+  const auto messages = readAll(path);
+  ASSERT_EQ(messages.size(), 2);
+  EXPECT_EQ(messages[0]["value"], 1);
+  EXPECT_EQ(messages[1]["value"], 2);
+}
+
+TEST(SonarCaptureWebSocketTests, testCaptureIsRotated) {
+  const auto path = capturePath("rotated");
+  folly::EventBase eventBase;
+  {
+    SonarCaptureWebSocket socket(path, 128, &eventBase);
+    socket.start();
+    eventBase.loopOnce();
+    for (int i = 0; i < 20; i++) {
+      socket.sendMessage(dynamic::object("value", i));
+    }
+    socket.sendMessage(dynamic::object("value", std::string(256, 'x')));
+    eventBase.loop();
+    EXPECT_EQ(socket.getDroppedMessages(), 1);
+  }
+
+  // Only the newest messages survive, still in order.
+  const auto messages = readAll(path);
+  ASSERT_FALSE(messages.empty());
+  EXPECT_LT(messages.size(), 20);
+  for (size_t i = 0; i < messages.size(); i++) {
+    const auto expected = static_cast<int64_t>(20 - messages.size() + i);
+    EXPECT_EQ(messages[i]["value"], expected);
+  }
+}
+
+TEST(SonarCaptureWebSocketTests, testClientPluginsAreInitialized) {
+  const auto path = capturePath("client");
+  folly::EventBase eventBase;
+  bool connected = false;
+  {
+    SonarClient client(
+        std::make_unique<SonarCaptureWebSocket>(path, 4096, &eventBase),
+        std::make_shared<SonarState>());
+    client.addPlugin(std::make_shared<SonarPluginMock>(
+        "Test", [&connected](std::shared_ptr<SonarConnection> conn) {
+          connected = true;
+          conn->send("hello", dynamic::object("value", 1));
+        }));
+    client.start();
+    // The answer to getPlugins, which is kept by the client, has to reach
+    // the socket as a message rather than as serialized JSON.
+    eventBase.loop();
+    EXPECT_TRUE(connected);
+    EXPECT_TRUE(client.isPluginActive("Test"));
+  }
+
+  const auto messages = readAll(path);
+  ASSERT_FALSE(messages.empty());
+  EXPECT_EQ(messages.back()["params"]["method"], "hello");
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -7,11 +7,15 @@
  */
 
 #include <Sonar/SonarClient.h>
+#include <Sonar/SonarDeferredWebSocket.h>
 #include <SonarTestLib/SonarPluginMock.h>
 #include <SonarTestLib/SonarWebSocketMock.h>
 
+#include <folly/executors/ManualExecutor.h>
+#include <folly/io/async/EventBase.h>
 #include <folly/json.h>
 #include <gtest/gtest.h>
+#include <thread>
 
 namespace facebook {
 namespace sonar {
@@ -159,6 +163,112 @@ TEST(SonarClientTests, testInitDeinit) {
   EXPECT_FALSE(pluginConnected);
 }
 
+TEST(SonarClientTests, testPluginFactoryIsCalledOnInit) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  int created = 0;
+  bool pluginConnected = false;
+  client.addPlugin(std::make_shared<SonarPluginMock>("Cat"));
+  client.addPluginFactory("Lazy", [&]() {
+    created++;
+    return std::make_shared<SonarPluginMock>(
+        "Lazy",
+        [&](std::shared_ptr<SonarConnection> conn) { pluginConnected = true; });
+  });
+  EXPECT_TRUE(client.hasPlugin("Lazy"));
+
+  dynamic messageGetPlugins = dynamic::object("id", 1)("method", "getPlugins");
+  socket->callbacks->onMessageReceived(messageGetPlugins);
+  EXPECT_EQ(
+      socket->messages.back(),
+      dynamic::object("id", 1)(
+          "success", dynamic::object("plugins", dynamic::array("Cat", "Lazy"))));
+  EXPECT_EQ(created, 0);
+
+  dynamic messageInit = dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Lazy"));
+  socket->callbacks->onMessageReceived(messageInit);
+  EXPECT_EQ(created, 1);
+  EXPECT_TRUE(pluginConnected);
+
+  dynamic messageDeinit = dynamic::object("method", "deinit")(
+      "params", dynamic::object("plugin", "Lazy"));
+  socket->callbacks->onMessageReceived(messageDeinit);
+  socket->callbacks->onMessageReceived(messageInit);
+  EXPECT_EQ(created, 1);
+  EXPECT_EQ(client.getPlugin("Lazy")->identifier(), "Lazy");
+}
+
+TEST(SonarClientTests, testInitMany) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  bool catConnected = false;
+  bool dogConnected = false;
+  auto executor = std::make_shared<folly::ManualExecutor>();
+  client.addPlugin(std::make_shared<SonarPluginMock>(
+      "Cat",
+      [&](std::shared_ptr<SonarConnection> conn) { catConnected = true; },
+      [&]() { catConnected = false; }));
+  client.addPlugin(
+      std::make_shared<SonarPluginMock>(
+          "Dog",
+          [&](std::shared_ptr<SonarConnection> conn) { dogConnected = true; },
+          [&]() { dogConnected = false; }),
+      executor);
+
+  dynamic messageInitMany = dynamic::object("id", 1)("method", "initMany")(
+      "params", dynamic::object("plugins", dynamic::array("Cat", "Dog", "Eel")));
+  socket->callbacks->onMessageReceived(messageInitMany);
+  EXPECT_TRUE(catConnected);
+  EXPECT_TRUE(client.isPluginActive("Dog"));
+  // Dog connects on its own executor.
+  EXPECT_FALSE(dogConnected);
+  EXPECT_EQ(
+      socket->messages.back(),
+      dynamic::object("id", 1)("success", dynamic::object()));
+  // The unknown plugin is reported without failing the others.
+  EXPECT_TRUE(socket->messages[socket->messages.size() - 2].count("error"));
+  executor->run();
+  EXPECT_TRUE(dogConnected);
+
+  dynamic messageDeinitMany = dynamic::object("method", "deinitMany")(
+      "params", dynamic::object("plugins", dynamic::array("Cat", "Dog")));
+  socket->callbacks->onMessageReceived(messageDeinitMany);
+  EXPECT_FALSE(catConnected);
+  EXPECT_FALSE(dogConnected);
+  EXPECT_FALSE(client.isPluginActive("Cat"));
+}
+
+TEST(SonarClientTests, testIsPluginActive) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  std::shared_ptr<SonarConnection> connection;
+  const auto connectionCallback = [&](std::shared_ptr<SonarConnection> conn) {
+    connection = conn;
+  };
+  auto plugin = std::make_shared<SonarPluginMock>("Test", connectionCallback);
+  client.addPlugin(plugin);
+  EXPECT_FALSE(client.isPluginActive("Test"));
+
+  dynamic messageInit = dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test"));
+  socket->callbacks->onMessageReceived(messageInit);
+  EXPECT_TRUE(client.isPluginActive("Test"));
+  EXPECT_TRUE(connection->isActive());
+
+  dynamic messageDeinit = dynamic::object("method", "deinit")(
+      "params", dynamic::object("plugin", "Test"));
+  socket->callbacks->onMessageReceived(messageDeinit);
+  EXPECT_FALSE(client.isPluginActive("Test"));
+  EXPECT_FALSE(connection->isActive());
+}
+
 TEST(SonarClientTests, testRemovePluginWhenConnected) {
   auto socket = new SonarWebSocketMock;
   SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
@@ -180,6 +290,25 @@ TEST(SonarClientTests, testRemovePluginWhenConnected) {
   EXPECT_EQ(socket->messages.back(), expected);
 }
 
+TEST(SonarClientTests, testRefreshPluginsIsCoalesced) {
+  folly::EventBase eventBase;
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(
+      std::unique_ptr<SonarWebSocketMock>{socket}, state, &eventBase);
+  client.start();
+
+  client.addPlugins({std::make_shared<SonarPluginMock>("Cat"),
+                     std::make_shared<SonarPluginMock>("Dog")});
+  client.addPlugin(std::make_shared<SonarPluginMock>("Fish"));
+  client.removePlugin(client.getPlugin("Dog"));
+  EXPECT_TRUE(socket->messages.empty());
+
+  eventBase.loopOnce();
+  dynamic expected = dynamic::object("method", "refreshPlugins");
+  ASSERT_EQ(socket->messages.size(), 1);
+  EXPECT_EQ(socket->messages.back(), expected);
+}
+
 TEST(SonarClientTests, testUnhandleableMethod) {
   auto socket = new SonarWebSocketMock;
   SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
@@ -230,6 +359,49 @@ TEST(SonarClientTests, testExecute) {
   EXPECT_EQ(socket->messages.back(), expected);
 }
 
+TEST(SonarClientTests, testReceiversCanBeAddedWhileCalling) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  const auto respond = [](const dynamic& params,
+                          std::unique_ptr<SonarResponder> responder) {
+    responder->success(dynamic::object());
+  };
+  std::shared_ptr<SonarConnection> connection;
+  client.addPlugin(std::make_shared<SonarPluginMock>(
+      "Test", [&](std::shared_ptr<SonarConnection> conn) {
+        connection = conn;
+        conn->receive("ping", respond);
+      }));
+  socket->callbacks->onMessageReceived(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test")));
+
+  // Like a plugin that registers the rest of its receivers from a thread
+  // of its own.
+  constexpr int kReceivers = 200;
+  std::thread registering([&] {
+    for (int i = 0; i < kReceivers; i++) {
+      connection->receive("method" + std::to_string(i), respond);
+    }
+  });
+  const dynamic ping = dynamic::object("id", 1)("method", "execute")(
+      "params", dynamic::object("api", "Test")("method", "ping"));
+  for (int i = 0; i < 1000; i++) {
+    socket->callbacks->onMessageReceived(ping);
+    EXPECT_EQ(socket->messages.back()["success"], dynamic::object());
+  }
+  registering.join();
+
+  socket->callbacks->onMessageReceived(
+      dynamic::object("id", 2)("method", "execute")(
+          "params",
+          dynamic::object("api", "Test")(
+              "method", "method" + std::to_string(kReceivers - 1))));
+  EXPECT_EQ(socket->messages.back()["id"], 2);
+  EXPECT_EQ(socket->messages.back()["success"], dynamic::object());
+}
+
 TEST(SonarClientTests, testExecuteWithParams) {
   auto socket = new SonarWebSocketMock;
   SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
@@ -263,6 +435,463 @@ TEST(SonarClientTests, testExecuteWithParams) {
   EXPECT_EQ(socket->messages.back(), expected);
 }
 
+TEST(SonarClientTests, testExecuteAsync) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  folly::Promise<dynamic> promise;
+  const auto connectionCallback = [&](std::shared_ptr<SonarConnection> conn) {
+    conn->receive(
+        "slow", [&](const dynamic &params) { return promise.getFuture(); });
+  };
+  auto plugin = std::make_shared<SonarPluginMock>("Test", connectionCallback);
+  client.addPlugin(plugin);
+
+  dynamic messageInit = dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test"));
+  socket->callbacks->onMessageReceived(messageInit);
+
+  dynamic messageExecute = dynamic::object("id", 1)("method", "execute")(
+      "params", dynamic::object("api", "Test")("method", "slow"));
+  socket->callbacks->onMessageReceived(messageExecute);
+  const auto sent = socket->messages.size();
+
+  promise.setValue(dynamic::object("done", true));
+
+  dynamic expected =
+      dynamic::object("id", 1)("success", dynamic::object("done", true));
+  EXPECT_EQ(socket->messages.size(), sent + 1);
+  EXPECT_EQ(socket->messages.back(), expected);
+}
+
+TEST(SonarClientTests, testCancelExecute) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  std::unique_ptr<SonarResponder> pending;
+  const auto connectionCallback = [&](std::shared_ptr<SonarConnection> conn) {
+    const auto receiver = [&](const dynamic &params,
+                              std::unique_ptr<SonarResponder> responder) {
+      pending = std::move(responder);
+    };
+    conn->receive("slow", receiver);
+  };
+  auto plugin = std::make_shared<SonarPluginMock>("Test", connectionCallback);
+  client.addPlugin(plugin);
+
+  dynamic messageInit = dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test"));
+  socket->callbacks->onMessageReceived(messageInit);
+
+  dynamic messageExecute = dynamic::object("id", 1)("method", "execute")(
+      "params", dynamic::object("api", "Test")("method", "slow"));
+  socket->callbacks->onMessageReceived(messageExecute);
+  EXPECT_FALSE(pending->isCancelled());
+
+  dynamic messageCancel = dynamic::object("method", "cancel")(
+      "params", dynamic::object("id", 1));
+  socket->callbacks->onMessageReceived(messageCancel);
+  EXPECT_TRUE(pending->isCancelled());
+
+  const auto sent = socket->messages.size();
+  pending->success(dynamic::object());
+  EXPECT_EQ(socket->messages.size(), sent);
+}
+
+TEST(SonarClientTests, testExecuteStream) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  const auto connectionCallback = [](std::shared_ptr<SonarConnection> conn) {
+    conn->receiveStream(
+        "tree",
+        [](const dynamic &params,
+           std::unique_ptr<SonarStreamResponder> responder) {
+          responder->next(dynamic::object("node", 1));
+          responder->next(dynamic::object("node", 2));
+          responder->complete();
+        });
+  };
+  auto plugin = std::make_shared<SonarPluginMock>("Test", connectionCallback);
+  client.addPlugin(plugin);
+
+  dynamic messageInit = dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test"));
+  socket->callbacks->onMessageReceived(messageInit);
+
+  const auto sent = socket->messages.size();
+  dynamic messageExecute =
+      dynamic::object("id", 1)("method", "execute")("chunked", true)(
+          "params", dynamic::object("api", "Test")("method", "tree"));
+  socket->callbacks->onMessageReceived(messageExecute);
+
+  ASSERT_EQ(socket->messages.size(), sent + 3);
+  EXPECT_EQ(
+      socket->messages[sent],
+      dynamic::object("id", 1)("seq", 0)("chunk", dynamic::object("node", 1)));
+  EXPECT_EQ(
+      socket->messages.back(),
+      dynamic::object("id", 1)("success", dynamic::object("chunks", 2)));
+
+  // Older desktops get the chunks in one response.
+  dynamic messageLegacy = dynamic::object("id", 2)("method", "execute")(
+      "params", dynamic::object("api", "Test")("method", "tree"));
+  socket->callbacks->onMessageReceived(messageLegacy);
+  EXPECT_EQ(
+      socket->messages.back(),
+      dynamic::object("id", 2)(
+          "success",
+          dynamic::object(
+              "chunks",
+              dynamic::array(
+                  dynamic::object("node", 1), dynamic::object("node", 2)))));
+}
+
+TEST(SonarClientTests, testExecutePaged) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  const auto connectionCallback = [](std::shared_ptr<SonarConnection> conn) {
+    conn->receivePaged("rows", [](const dynamic &params) {
+      auto next = std::make_shared<int>(0);
+      return [next](size_t pageSize, dynamic &items) {
+        for (size_t i = 0; i < pageSize && *next < 5; i++) {
+          items.push_back((*next)++);
+        }
+        return *next < 5;
+      };
+    });
+  };
+  auto plugin = std::make_shared<SonarPluginMock>("Test", connectionCallback);
+  client.addPlugin(plugin);
+
+  dynamic messageInit = dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test"));
+  socket->callbacks->onMessageReceived(messageInit);
+
+  dynamic messageExecute = dynamic::object("id", 1)("method", "execute")(
+      "params",
+      dynamic::object("api", "Test")("method", "rows")(
+          "params", dynamic::object("pageSize", 2)));
+  socket->callbacks->onMessageReceived(messageExecute);
+  const auto first = socket->messages.back()["success"];
+  EXPECT_EQ(first["items"], dynamic::array(0, 1));
+  EXPECT_TRUE(first["hasMore"].asBool());
+
+  const auto fetch = [&](int64_t id, const dynamic &cursor) {
+    socket->callbacks->onMessageReceived(
+        dynamic::object("id", id)("method", "execute")(
+            "params",
+            dynamic::object("api", "Test")("method", "fetchNextPage")(
+                "params", dynamic::object("cursor", cursor)("pageSize", 2))));
+    return socket->messages.back();
+  };
+  EXPECT_EQ(fetch(2, first["cursor"])["success"]["items"], dynamic::array(2, 3));
+  const auto last = fetch(3, first["cursor"])["success"];
+  EXPECT_EQ(last["items"], dynamic::array(4));
+  EXPECT_FALSE(last["hasMore"].asBool());
+
+  // The cursor is let go of once it is exhausted.
+  EXPECT_TRUE(fetch(4, first["cursor"]).count("error"));
+
+  // Without a pageSize, everything comes in one page.
+  dynamic messageAll = dynamic::object("id", 5)("method", "execute")(
+      "params", dynamic::object("api", "Test")("method", "rows"));
+  socket->callbacks->onMessageReceived(messageAll);
+  EXPECT_EQ(
+      socket->messages.back()["success"],
+      dynamic::object("cursor", 0)("items", dynamic::array(0, 1, 2, 3, 4))(
+          "hasMore", false));
+}
+
+TEST(SonarClientTests, testTrySendRespectsHighWatermark) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  std::shared_ptr<SonarConnection> connection;
+  bool writable = false;
+  const auto connectionCallback = [&](std::shared_ptr<SonarConnection> conn) {
+    connection = conn;
+    conn->setHighWatermark(100);
+    conn->onWritable([&]() { writable = true; });
+  };
+  auto plugin = std::make_shared<SonarPluginMock>("Test", connectionCallback);
+  client.addPlugin(plugin);
+
+  dynamic messageInit = dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test"));
+  socket->callbacks->onMessageReceived(messageInit);
+
+  EXPECT_TRUE(connection->trySend("first", dynamic::object()));
+  const auto sent = socket->messages.size();
+
+  socket->bufferedBytes = 200;
+  EXPECT_FALSE(connection->trySend("second", dynamic::object()));
+  EXPECT_EQ(socket->messages.size(), sent);
+  EXPECT_TRUE(socket->drainNotificationRequested);
+  EXPECT_FALSE(writable);
+
+  socket->bufferedBytes = 0;
+  socket->callbacks->onOutboundQueueDrained();
+  EXPECT_TRUE(writable);
+  EXPECT_TRUE(connection->trySend("third", dynamic::object()));
+}
+
+TEST(SonarClientTests, testSendJson) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  std::shared_ptr<SonarConnection> connection;
+  const auto connectionCallback = [&](std::shared_ptr<SonarConnection> conn) {
+    connection = conn;
+    conn->receive(
+        "get",
+        [](const dynamic& params, std::unique_ptr<SonarResponder> responder) {
+          responder->successJson("{\"value\":[1,2]}");
+        });
+  };
+  client.addPlugin(
+      std::make_shared<SonarPluginMock>("Test", connectionCallback));
+  socket->callbacks->onMessageReceived(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test")));
+
+  connection->sendJson("event", "{\"value\":1}");
+  EXPECT_EQ(
+      socket->messages.back(),
+      dynamic::object("method", "execute")(
+          "params",
+          dynamic::object("api", "Test")("method", "event")(
+              "params", dynamic::object("value", 1))));
+
+  socket->callbacks->onMessageReceived(
+      dynamic::object("id", 1)("method", "execute")(
+          "params", dynamic::object("api", "Test")("method", "get")));
+  EXPECT_EQ(
+      socket->messages.back(),
+      dynamic::object("id", 1)(
+          "success", dynamic::object("value", dynamic::array(1, 2))));
+}
+
+TEST(SonarClientTests, testMultipleDesktops) {
+  auto first = new SonarWebSocketMock;
+  auto second = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{first}, state);
+  client.addSocket(std::unique_ptr<SonarWebSocketMock>{second});
+
+  int connects = 0;
+  bool pluginConnected = false;
+  std::shared_ptr<SonarConnection> connection;
+  auto plugin = std::make_shared<SonarPluginMock>(
+      "Test",
+      [&](std::shared_ptr<SonarConnection> conn) {
+        connects++;
+        pluginConnected = true;
+        connection = conn;
+      },
+      [&]() { pluginConnected = false; });
+  client.addPlugin(plugin);
+  client.start();
+
+  const dynamic init = dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test"));
+  first->callbacks->onMessageReceived(init);
+  second->callbacks->onMessageReceived(init);
+  EXPECT_EQ(connects, 1);
+
+  connection->send("event", dynamic::object("value", 1));
+  const dynamic expected = dynamic::object("method", "execute")(
+      "params",
+      dynamic::object("api", "Test")("method", "event")(
+          "params", dynamic::object("value", 1)));
+  EXPECT_EQ(first->messages.back(), expected);
+  EXPECT_EQ(second->messages.back(), expected);
+
+  // The plugin stays connected as long as one desktop is looking at it.
+  first->callbacks->onMessageReceived(dynamic::object("method", "deinit")(
+      "params", dynamic::object("plugin", "Test")));
+  EXPECT_TRUE(pluginConnected);
+  EXPECT_TRUE(connection->isActive());
+
+  connection->send("event", dynamic::object("value", 2));
+  EXPECT_EQ(first->messages.back(), expected);
+  EXPECT_EQ(second->messages.back()["params"]["params"]["value"], 2);
+
+  second->stop();
+  EXPECT_FALSE(pluginConnected);
+}
+
+TEST(SonarClientTests, testSuspendKeepsPluginsConnected) {
+  SonarWebSocketMock* socket = nullptr;
+  auto deferred = std::make_unique<SonarDeferredWebSocket>([&socket]() {
+    auto created = std::make_unique<SonarWebSocketMock>();
+    socket = created.get();
+    return created;
+  });
+  SonarClient client(std::move(deferred), state);
+  bool pluginConnected = false;
+  client.addPlugin(std::make_shared<SonarPluginMock>(
+      "Test",
+      [&pluginConnected](std::shared_ptr<SonarConnection>) {
+        pluginConnected = true;
+      },
+      [&pluginConnected]() { pluginConnected = false; }));
+
+  // Suspended before the socket is even created.
+  client.suspend();
+  client.start();
+  ASSERT_NE(socket, nullptr);
+  EXPECT_TRUE(socket->suspended);
+  socket->callbacks->onMessageReceived(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test")));
+  EXPECT_TRUE(pluginConnected);
+
+  client.resume();
+  EXPECT_FALSE(socket->suspended);
+  client.suspend();
+  EXPECT_TRUE(socket->suspended);
+  EXPECT_TRUE(pluginConnected);
+  EXPECT_TRUE(client.isPluginActive("Test"));
+}
+
+TEST(SonarClientTests, testDeinitReleasesTheConnection) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  std::weak_ptr<SonarConnection> connection;
+  const auto connectionCallback =
+      [&connection](std::shared_ptr<SonarConnection> conn) {
+        connection = conn;
+        // Like the Android bindings, whose receivers own the connection.
+        conn->receive(
+            "ping",
+            [conn](const dynamic&, std::unique_ptr<SonarResponder> responder) {
+              responder->success(dynamic::object());
+            });
+      };
+  client.addPlugin(
+      std::make_shared<SonarPluginMock>("Test", connectionCallback));
+  socket->callbacks->onMessageReceived(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test")));
+  EXPECT_FALSE(connection.expired());
+
+  socket->callbacks->onMessageReceived(dynamic::object("method", "deinit")(
+      "params", dynamic::object("plugin", "Test")));
+  EXPECT_TRUE(connection.expired());
+}
+
+TEST(SonarClientTests, testMetrics) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  const auto connectionCallback = [](std::shared_ptr<SonarConnection> conn) {
+    conn->receive(
+        "ping",
+        [](const dynamic& params, std::unique_ptr<SonarResponder> responder) {
+          responder->success(dynamic::object());
+        });
+  };
+  client.addPlugin(
+      std::make_shared<SonarPluginMock>("Test", connectionCallback));
+  socket->callbacks->onMessageReceived(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test")));
+  socket->callbacks->onMessageReceived(
+      dynamic::object("id", 1)("method", "execute")(
+          "params", dynamic::object("api", "Test")("method", "ping")));
+
+  const auto metrics = client.getMetrics();
+  EXPECT_TRUE(metrics["plugins"]["Test"]["ping"]["receiverMicros"].isInt());
+  EXPECT_EQ(metrics["transport"]["keepaliveRttMicros"], -1);
+  EXPECT_GT(metrics["clientLock"]["acquisitions"].asInt(), 0);
+  EXPECT_EQ(metrics["clientLock"]["contended"], 0);
+
+  socket->callbacks->onMessageReceived(
+      dynamic::object("id", 2)("method", "__metrics"));
+  EXPECT_EQ(socket->messages.back()["id"], 2);
+  EXPECT_EQ(
+      socket->messages.back()["success"]["plugins"]["Test"]["ping"].size(),
+      metrics["plugins"]["Test"]["ping"].size());
+
+  // Sent rather than called, so there's nobody to answer.
+  const auto sent = socket->messages.size();
+  socket->callbacks->onMessageReceived(dynamic::object("method", "__metrics"));
+  EXPECT_EQ(socket->messages.size(), sent);
+}
+
+TEST(SonarClientTests, testSendPolicyDropsMessages) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  std::shared_ptr<SonarConnection> connection;
+  client.addPlugin(std::make_shared<SonarPluginMock>(
+      "Test",
+      [&connection](std::shared_ptr<SonarConnection> conn) {
+        connection = conn;
+      }));
+  // Set before the plugin is initialized, so it has to carry over.
+  socket->callbacks->onMessageReceived(
+      dynamic::object("id", 1)("method", "__sendPolicy")(
+          "params",
+          dynamic::object("plugin", "Test")("method", "event")(
+              "sampleEvery", 2)));
+  socket->callbacks->onMessageReceived(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test")));
+
+  const size_t before = socket->messages.size();
+  for (int i = 0; i < 4; i++) {
+    connection->send("event", dynamic::object("index", i));
+    connection->send("other", dynamic::object("index", i));
+  }
+  EXPECT_EQ(socket->messages.size() - before, 6);
+
+  socket->callbacks->onMessageReceived(
+      dynamic::object("id", 2)("method", "__sendPolicy")(
+          "params",
+          dynamic::object("plugin", "Test")("method", "other")("rate", 100)));
+  EXPECT_EQ(socket->messages.back()["id"], 2);
+  const auto& policies = socket->messages.back()["success"]["policies"];
+  EXPECT_EQ(policies["event"]["dropped"], 2);
+  EXPECT_EQ(policies["other"]["rate"], 100);
+  EXPECT_EQ(
+      client.getMetrics()["plugins"]["Test"]["event"]["messagesDropped"], 2);
+}
+
+TEST(SonarClientTests, testSendsWithBorrowedMethodNames) {
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+
+  std::shared_ptr<SonarConnection> connection;
+  client.addPlugin(std::make_shared<SonarPluginMock>(
+      "Test",
+      [&connection](std::shared_ptr<SonarConnection> conn) {
+        connection = conn;
+      }));
+  socket->callbacks->onMessageReceived(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Test")));
+
+  // Pieces of a larger string, so nothing may rely on them being
+  // null-terminated.
+  const folly::StringPiece names("TestEventsevent");
+  EXPECT_TRUE(client.isPluginActive(names.subpiece(0, 4)));
+  EXPECT_FALSE(client.isPluginActive(names.subpiece(0, 3)));
+  EXPECT_EQ(client.getPlugin(names.subpiece(0, 4))->identifier(), "Test");
+
+  connection->send(names.subpiece(4, 5), dynamic::object("value", 1));
+  EXPECT_EQ(socket->messages.back()["params"]["api"], "Test");
+  EXPECT_EQ(socket->messages.back()["params"]["method"], "Event");
+  connection->send(names.subpiece(10), dynamic::object("value", 2));
+  EXPECT_EQ(socket->messages.back()["params"]["method"], "event");
+}
+
 TEST(SonarClientTests, testExceptionUnknownPlugin) {
   auto socket = new SonarWebSocketMock;
   SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
@@ -289,6 +918,43 @@ TEST(SonarClientTests, testExceptionUnknownApi) {
             "connection Unknown not found for method execute");
 }
 
+TEST(SonarClientTests, testDeferredSocketIsCreatedOnStart) {
+  SonarWebSocketMock* socket = nullptr;
+  auto deferred = new SonarDeferredWebSocket([&socket]() {
+    socket = new SonarWebSocketMock;
+    return std::unique_ptr<SonarWebSocket>{socket};
+  });
+  SonarClient client(std::unique_ptr<SonarDeferredWebSocket>{deferred}, state);
+  client.addPlugin(std::make_shared<SonarPluginMock>("Test"));
+  EXPECT_FALSE(deferred->isCreated());
+  EXPECT_FALSE(deferred->isOpen());
+
+  client.start();
+  ASSERT_NE(socket, nullptr);
+  EXPECT_TRUE(deferred->isOpen());
+
+  // The client's callbacks reached the socket, so it was told about the
+  // connection and answers the desktop.
+  socket->callbacks->onMessageReceived(dynamic::object("id", 1)(
+      "method", "getPlugins"));
+  EXPECT_EQ(
+      socket->messages.back(),
+      dynamic::object("id", 1)(
+          "success", dynamic::object("plugins", dynamic::array("Test"))));
+}
+
+TEST(SonarClientTests, testResponderMemoryIsRecycled) {
+  SonarWebSocketMock socket;
+  std::unique_ptr<SonarResponder> first(new SonarResponderImpl(&socket, 1));
+  const void* address = first.get();
+  first.reset();
+
+  std::unique_ptr<SonarResponder> second(new SonarResponderImpl(&socket, 2));
+  EXPECT_EQ(second.get(), address);
+  second->success(dynamic::object());
+  EXPECT_EQ(socket.messages.back()["id"], 2);
+}
+
 } // namespace test
 } // namespace sonar
 } // namespace facebook
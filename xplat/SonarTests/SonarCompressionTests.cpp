@@ -0,0 +1,51 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarCompression.h>
+#include <Sonar/SonarMessageEncoding.h>
+
+#include <folly/json.h>
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+TEST(SonarCompressionTests, testRoundTrip) {
+  std::string frame = folly::toJson(dynamic::object("method", "execute")(
+      "params",
+      dynamic::object("api", "Network")("method", "newRequest")(
+          "params",
+          dynamic::object("id", "1")("url", "https://example.com")(
+              "headers", dynamic::array()))));
+
+  const auto deflated = deflateFrame(frame);
+  EXPECT_LT(deflated.size(), frame.size());
+  EXPECT_EQ(inflateFrame(deflated), frame);
+}
+
+TEST(SonarCompressionTests, testDetectDeflatedFrame) {
+  const dynamic message = dynamic::object("id", 1)("success", dynamic::object());
+
+  EXPECT_TRUE(isDeflatedFrame(deflateFrame(folly::toJson(message))));
+  EXPECT_FALSE(isDeflatedFrame(folly::toJson(message)));
+  EXPECT_FALSE(isDeflatedFrame(msgpack::toMessagePack(message)));
+}
+
+TEST(SonarCompressionTests, testTruncatedFrameIsRejected) {
+  const auto deflated = deflateFrame(std::string(1000, 'x'));
+  EXPECT_THROW(
+      inflateFrame(folly::StringPiece(deflated.data(), deflated.size() - 4)),
+      std::invalid_argument);
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarConditionedWebSocket.h>
+#include <SonarTestLib/SonarWebSocketMock.h>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/json.h>
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+class ConditionedCallbacks : public SonarWebSocket::Callbacks {
+ public:
+  void onConnected() override {}
+  void onDisconnected() override {}
+  void onMessageReceived(const dynamic& message) override {
+    received.push_back(message);
+  }
+
+  std::vector<dynamic> received;
+};
+
+void runFor(folly::EventBase& eventBase, uint32_t ms) {
+  eventBase.runAfterDelay(
+      [&eventBase]() { eventBase.terminateLoopSoon(); }, ms);
+  eventBase.loopForever();
+}
+
+TEST(SonarConditionedWebSocketTests, testLatencyHoldsMessagesBack) {
+  folly::EventBase eventBase;
+  auto mock = new SonarWebSocketMock;
+  SonarLinkConditions conditions;
+  conditions.enabled = true;
+  conditions.latencyMs = 50;
+  SonarConditionedWebSocket socket(
+      std::unique_ptr<SonarWebSocketMock>{mock}, conditions, &eventBase);
+  ConditionedCallbacks callbacks;
+  socket.setCallbacks(&callbacks);
+
+  socket.sendJson("{\"n\":1}");
+  mock->callbacks->onMessageReceived(dynamic::object("method", "getPlugins"));
+  EXPECT_TRUE(mock->messages.empty());
+  EXPECT_TRUE(callbacks.received.empty());
+  EXPECT_GT(socket.getBufferedBytes(), 0);
+
+  runFor(eventBase, 200);
+  ASSERT_EQ(mock->messages.size(), 1);
+  EXPECT_EQ(mock->messages[0], dynamic::object("n", 1));
+  EXPECT_EQ(callbacks.received.size(), 1);
+  EXPECT_EQ(socket.getBufferedBytes(), 0);
+}
+
+TEST(SonarConditionedWebSocketTests, testDropsOnlyPluginEvents) {
+  folly::EventBase eventBase;
+  auto mock = new SonarWebSocketMock;
+  SonarLinkConditions conditions;
+  conditions.enabled = true;
+  conditions.dropRate = 1;
+  SonarConditionedWebSocket socket(
+      std::unique_ptr<SonarWebSocketMock>{mock}, conditions, &eventBase);
+
+  socket.sendExecute("Plugin", "event", dynamic::object());
+  socket.sendMessage(dynamic::object("id", 1)("success", dynamic::object()));
+
+  ASSERT_EQ(mock->messages.size(), 1);
+  EXPECT_EQ(mock->messages[0]["id"], 1);
+  EXPECT_EQ(socket.getDroppedMessages(), 1);
+}
+
+TEST(SonarConditionedWebSocketTests, testDesktopChangesConditions) {
+  folly::EventBase eventBase;
+  auto mock = new SonarWebSocketMock;
+  SonarLinkConditions conditions;
+  conditions.enabled = true;
+  SonarConditionedWebSocket socket(
+      std::unique_ptr<SonarWebSocketMock>{mock}, conditions, &eventBase);
+
+  mock->callbacks->onMessageReceived(dynamic::object("id", 3)(
+      "method", "__linkConditions")(
+      "params", dynamic::object("jitterMs", 10)("dropRate", 0.5)));
+
+  EXPECT_EQ(socket.getConditions().jitterMs, 10);
+  EXPECT_EQ(socket.getConditions().dropRate, 0.5);
+  ASSERT_EQ(mock->messages.size(), 1);
+  EXPECT_EQ(
+      mock->messages[0],
+      dynamic::object("id", 3)(
+          "success",
+          dynamic::object("latencyMs", 0)("jitterMs", 10)(
+              "bandwidthBytesPerSecond", 0)("dropRate", 0.5)));
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
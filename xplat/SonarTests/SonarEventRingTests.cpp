@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarEventRing.h>
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using Events = std::vector<std::pair<std::string, std::string>>;
+
+Events drainAll(SonarEventRing& ring) {
+  Events events;
+  ring.drain([&events](folly::StringPiece method, folly::StringPiece params) {
+    events.emplace_back(method.str(), params.str());
+  });
+  return events;
+}
+
+TEST(SonarEventRingTests, testDropsOldestWhenFull) {
+  SonarEventRing ring(2, 1024);
+  ring.push("first", "{}");
+  ring.push("second", "{}");
+  ring.push("third", "{\"a\":1}");
+
+  EXPECT_EQ(ring.size(), 2);
+  EXPECT_EQ(
+      drainAll(ring), (Events{{"second", "{}"}, {"third", "{\"a\":1}"}}));
+  EXPECT_TRUE(ring.empty());
+}
+
+TEST(SonarEventRingTests, testDropNewestKeepsBufferedEvents) {
+  SonarEventRing ring(1, 1024, SonarEventRing::DropPolicy::DropNewest);
+  ring.push("first", "{}");
+  ring.push("second", "{}");
+  EXPECT_EQ(drainAll(ring), (Events{{"first", "{}"}}));
+}
+
+TEST(SonarEventRingTests, testWrapsAroundTheArena) {
+  // Room for three of these records, so the ring wraps every few pushes.
+  SonarEventRing ring(100, 3 * (8 + 10) + 4);
+  const std::string params(9, 'x');
+  for (int i = 0; i < 20; i++) {
+    ring.push("m", params);
+    EXPECT_LE(ring.size(), 3);
+  }
+  for (auto& event : drainAll(ring)) {
+    EXPECT_EQ(event, std::make_pair(std::string("m"), params));
+  }
+}
+
+TEST(SonarEventRingTests, testDrainStopsAtLimit) {
+  SonarEventRing ring(10, 1024);
+  for (int i = 0; i < 5; i++) {
+    ring.push("m", std::to_string(i));
+  }
+  EXPECT_EQ(
+      ring.drain([](folly::StringPiece, folly::StringPiece) {}, 3), 3);
+  EXPECT_EQ(drainAll(ring), (Events{{"m", "3"}, {"m", "4"}}));
+}
+
+TEST(SonarEventRingTests, testEvictDropsOldestUntilEnoughIsFreed) {
+  SonarEventRing ring(10, 1024);
+  for (int i = 0; i < 4; i++) {
+    ring.push("m", std::to_string(i));
+  }
+  // Each record is an 8 byte header, the method and the params.
+  EXPECT_EQ(ring.usedBytes(), 40);
+
+  EXPECT_EQ(ring.evict(15), 20);
+  EXPECT_EQ(ring.usedBytes(), 20);
+  EXPECT_EQ(drainAll(ring), (Events{{"m", "2"}, {"m", "3"}}));
+  EXPECT_EQ(ring.usedBytes(), 0);
+}
+
+TEST(SonarEventRingTests, testMappedRingSurvivesReopening) {
+  char path[] = "/tmp/SonarEventRingTestsXXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  auto ring = SonarEventRing::mapped(path, 10, 1024);
+  ASSERT_NE(ring, nullptr);
+  ring->push("first", "{}");
+  ring->push("second", "[1]");
+  ring.reset();
+
+  ring = SonarEventRing::mapped(path, 10, 1024);
+  EXPECT_EQ(drainAll(*ring), (Events{{"first", "{}"}, {"second", "[1]"}}));
+  unlink(path);
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarConnectionImpl.h>
+#include <Sonar/SonarFields.h>
+#include <SonarTestLib/SonarWebSocketMock.h>
+
+#include <folly/json.h>
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+enum class Alignment { Start, Center };
+
+struct Frame {
+  int x;
+  int y;
+  double scale;
+
+  static constexpr auto sonarFields() {
+    return std::make_tuple(
+        sonarField("x", &Frame::x),
+        sonarField("y", &Frame::y),
+        sonarField("scale", &Frame::scale));
+  }
+};
+
+struct Node {
+  std::string id;
+  bool visible;
+  Alignment alignment;
+  Frame frame;
+  std::vector<std::string> children;
+  std::map<std::string, int64_t> counts;
+  folly::Optional<std::string> parent;
+  dynamic extra;
+
+  static constexpr auto sonarFields() {
+    return std::make_tuple(
+        sonarField("id", &Node::id),
+        sonarField("visible", &Node::visible),
+        sonarField("alignment", &Node::alignment),
+        sonarField("frame", &Node::frame),
+        sonarField("children", &Node::children),
+        sonarField("counts", &Node::counts),
+        sonarField("parent", &Node::parent),
+        sonarField("extra", &Node::extra));
+  }
+};
+
+static_assert(HasSonarFields<Node>::value, "Node has fields");
+static_assert(!HasSonarFields<dynamic>::value, "dynamic has no fields");
+
+Node makeNode() {
+  return Node{"0x1",
+              true,
+              Alignment::Center,
+              Frame{1, 2, 0.5},
+              {"0x2", "0x3"},
+              {{"views", 2}},
+              folly::none,
+              dynamic::array(1, "two")};
+}
+
+dynamic expectedNode() {
+  return dynamic::object("id", "0x1")("visible", true)("alignment", 1)(
+      "frame", dynamic::object("x", 1)("y", 2)("scale", 0.5))(
+      "children", dynamic::array("0x2", "0x3"))(
+      "counts", dynamic::object("views", 2))("parent", nullptr)(
+      "extra", dynamic::array(1, "two"));
+}
+
+TEST(SonarFieldsTests, testWritesFields) {
+  std::string json;
+  SonarMessageWriter writer(json);
+  writeSonarFields(writer, makeNode());
+  writer.end();
+
+  EXPECT_TRUE(writer.isComplete());
+  EXPECT_EQ(folly::parseJson(json), expectedNode());
+}
+
+TEST(SonarFieldsTests, testReadsFields) {
+  Node node;
+  node.visible = false;
+  node.parent = std::string("0x0");
+  readSonarFields(expectedNode(), node);
+
+  std::string json;
+  SonarMessageWriter writer(json);
+  writeSonarFields(writer, node);
+  writer.end();
+  EXPECT_EQ(folly::parseJson(json), expectedNode());
+
+  // Missing fields keep their value, mistyped ones throw.
+  readSonarFields(dynamic::object("id", "0x9"), node);
+  EXPECT_EQ(node.id, "0x9");
+  EXPECT_TRUE(node.visible);
+  EXPECT_THROW(
+      readSonarFields(dynamic::object("children", 1), node), folly::TypeError);
+}
+
+TEST(SonarFieldsTests, testConnectionSendsTypedValue) {
+  SonarWebSocketMock socket;
+  SonarConnectionImpl connection(&socket, "Test");
+
+  connection.send("node", makeNode());
+  // Untyped sends still pick the folly::dynamic overloads.
+  connection.send("untyped", dynamic::object("value", 1));
+
+  ASSERT_EQ(socket.messages.size(), 2);
+  EXPECT_EQ(
+      socket.messages[0],
+      dynamic::object("method", "execute")(
+          "params",
+          dynamic::object("api", "Test")("method", "node")(
+              "params", expectedNode())));
+  EXPECT_EQ(
+      socket.messages[1]["params"]["params"], dynamic::object("value", 1));
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
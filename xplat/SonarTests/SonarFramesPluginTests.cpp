@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarFramesPlugin.h>
+#include <SonarTestLib/SonarConnectionMock.h>
+
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+// Summaries are only made by the tests.
+constexpr std::chrono::hours kNeverSummarize(1);
+constexpr int64_t kRefresh = 16666667;
+
+TEST(SonarFramesPluginTests, testSummarizesFrames) {
+  auto connection = std::make_shared<SonarConnectionMock>();
+  SonarFramesPlugin plugin(kNeverSummarize);
+  plugin.didConnect(connection);
+
+  int64_t time = 1000;
+  plugin.onFrame(time);
+  for (int i = 0; i < 3; i++) {
+    plugin.onFrame(time += kRefresh);
+  }
+  // Took three refreshes, missing two.
+  plugin.onFrame(time += 3 * kRefresh);
+  plugin.summarize();
+
+  const auto& summary = connection->sent_.at("frames");
+  EXPECT_EQ(summary["frames"], 4);
+  EXPECT_EQ(summary["missed"], 2);
+  EXPECT_EQ(summary["longestUs"], 3 * kRefresh / 1000);
+  EXPECT_EQ(summary["bucketsMs"].size() + 1, summary["buckets"].size());
+  // Up to 17ms, and just over 50ms.
+  EXPECT_EQ(summary["buckets"][2], 3);
+  EXPECT_EQ(summary["buckets"][6], 1);
+  plugin.didDisconnect();
+}
+
+TEST(SonarFramesPluginTests, testOnlySendsNewFrames) {
+  auto connection = std::make_shared<SonarConnectionMock>();
+  SonarFramesPlugin plugin(kNeverSummarize);
+  plugin.didConnect(connection);
+
+  plugin.onFrame(kRefresh);
+  plugin.onFrame(2 * kRefresh);
+  plugin.summarize();
+  connection->sent_.clear();
+  plugin.summarize();
+  EXPECT_EQ(connection->sent_.count("frames"), 0);
+
+  plugin.onFrame(3 * kRefresh);
+  plugin.summarize();
+  const auto& summary = connection->sent_.at("frames");
+  EXPECT_EQ(summary["frames"], 1);
+  EXPECT_EQ(summary["missed"], 0);
+  // Sent with the first summary only.
+  EXPECT_EQ(summary.count("bucketsMs"), 0);
+  plugin.didDisconnect();
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
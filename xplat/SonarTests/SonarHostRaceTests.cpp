@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarHostRace.h>
+
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+class AcceptAndDrop : public folly::AsyncServerSocket::AcceptCallback {
+ public:
+  void connectionAccepted(
+      int fd,
+      const folly::SocketAddress&) noexcept override {
+    close(fd);
+  }
+  void acceptError(const std::exception&) noexcept override {}
+};
+
+TEST(SonarHostRaceTests, testSingleHostIsPickedWithoutConnecting) {
+  folly::EventBase evb;
+  SonarHostRace race({"127.0.0.1"});
+
+  auto address = race.pick(&evb, 8088).getVia(&evb);
+
+  EXPECT_EQ(address.getAddressStr(), "127.0.0.1");
+  EXPECT_EQ(address.getPort(), 8088);
+}
+
+TEST(SonarHostRaceTests, testHostThatAcceptsWinsAndIsRemembered) {
+  folly::EventBase evb;
+  AcceptAndDrop callback;
+  auto server = folly::AsyncServerSocket::newSocket(&evb);
+  server->bind(folly::SocketAddress("127.0.0.1", 0));
+  server->addAcceptCallback(&callback, &evb);
+  server->listen(16);
+  server->startAccepting();
+  const auto port = server->getAddress().getPort();
+
+  // Nothing listens on 127.0.0.2's port, and the host that doesn't resolve
+  // isn't dialled.
+  SonarHostRace race(
+      {"127.0.0.2", "not a host", "127.0.0.1"}, std::chrono::milliseconds(10));
+
+  EXPECT_EQ(race.pick(&evb, port).getVia(&evb).getAddressStr(), "127.0.0.1");
+
+  server->stopAccepting();
+  // Remembered, so picked without connecting to it again.
+  EXPECT_EQ(race.pick(&evb, port).getVia(&evb).getAddressStr(), "127.0.0.1");
+}
+
+TEST(SonarHostRaceTests, testFailsWhenNoHostAccepts) {
+  folly::EventBase evb;
+  SonarHostRace race({"not a host", "neither is this"});
+
+  EXPECT_THROW(race.pick(&evb, 8088).getVia(&evb), std::runtime_error);
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,176 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarInspector.h>
+#include <SonarTestLib/SonarInspectorAdapterMock.h>
+
+#include <folly/json.h>
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+class SonarInspectorTests : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_.id = "root";
+    root_.name = "Window";
+    root_.bounds = SonarInspectorBounds{0, 0, 100, 100};
+    list_ = root_.add("list", "RecyclerView");
+    list_->bounds = SonarInspectorBounds{0, 50, 100, 50};
+    for (int i = 0; i < 3; i++) {
+      auto cell = list_->add(folly::to<std::string>("cell", i), "TextView");
+      cell->bounds = SonarInspectorBounds{0, 50.0 + 10 * i, 100, 10};
+    }
+    adapter_ = new SonarInspectorAdapterMock(&root_);
+    inspector_ = std::make_unique<SonarInspector>(
+        std::unique_ptr<SonarInspectorAdapterMock>{adapter_});
+  }
+
+  dynamic getNodes(dynamic params) {
+    auto call = inspector_->getNodes(params);
+    EXPECT_TRUE(call->run(std::chrono::seconds(1)));
+    return folly::parseJson(call->takeResponse());
+  }
+
+  SonarInspectorNodeMock root_;
+  SonarInspectorNodeMock* list_;
+  SonarInspectorAdapterMock* adapter_;
+  std::unique_ptr<SonarInspector> inspector_;
+};
+
+TEST_F(SonarInspectorTests, testGetRootTracksChildren) {
+  const auto root = folly::parseJson(inspector_->getRoot());
+
+  EXPECT_EQ(root["id"], "root");
+  EXPECT_EQ(root["name"], "Window");
+  EXPECT_EQ(root["children"], dynamic::array("list"));
+  EXPECT_EQ(root["childCount"], 1);
+  EXPECT_EQ(
+      root["attributes"],
+      dynamic::array(dynamic::object("name", "text")("value", "")));
+  EXPECT_EQ(root["data"]["Layout"]["width"].asDouble(), 100);
+  EXPECT_TRUE(root["hashes"]["data"].isString());
+  EXPECT_EQ(inspector_->trackedCount(), 2);
+  EXPECT_EQ(inspector_->lookUp("list"), list_);
+  EXPECT_EQ(adapter_->retained, 2);
+
+  inspector_->reset();
+  EXPECT_EQ(inspector_->lookUp("list"), nullptr);
+  EXPECT_EQ(adapter_->retained, 0);
+}
+
+TEST_F(SonarInspectorTests, testGetNodesLeavesOutKnownSections) {
+  inspector_->getRoot();
+  auto first = getNodes(dynamic::object("ids", dynamic::array("list")));
+  const auto hashes = first["elements"][0]["hashes"];
+
+  list_->children[1]->name = "EditText";
+  list_->text = "changed";
+  const auto second = getNodes(dynamic::object("ids", dynamic::array("list"))(
+      "hashes", dynamic::object("list", hashes)));
+
+  const auto& list = second["elements"][0];
+  EXPECT_EQ(list.count("children"), 0);
+  EXPECT_EQ(list.count("data"), 0);
+  EXPECT_EQ(
+      list["attributes"],
+      dynamic::array(dynamic::object("name", "text")("value", "changed")));
+  EXPECT_EQ(list["hashes"]["children"], hashes["children"]);
+  EXPECT_NE(list["hashes"]["attributes"], hashes["attributes"]);
+}
+
+TEST_F(SonarInspectorTests, testGetNodesPagesChildrenAndRunsInSlices) {
+  inspector_->getRoot();
+  auto call = inspector_->getNodes(dynamic::object(
+      "ids", dynamic::array("list", "root", "gone"))("structureOnly", true)(
+      "childrenRange", dynamic::object("offset", 1)("limit", 1)));
+
+  // Every slice captures at least one node, however small the budget.
+  int slices = 1;
+  while (!call->run(std::chrono::nanoseconds(0))) {
+    slices++;
+  }
+  EXPECT_EQ(slices, 3);
+
+  const auto elements = folly::parseJson(call->takeResponse())["elements"];
+  ASSERT_EQ(elements.size(), 2);
+  EXPECT_EQ(elements[0]["children"], dynamic::array("cell1"));
+  EXPECT_EQ(elements[0]["childCount"], 3);
+  EXPECT_EQ(elements[0].count("data"), 0);
+  EXPECT_EQ(inspector_->lookUp("cell0"), nullptr);
+  EXPECT_NE(inspector_->lookUp("cell1"), nullptr);
+}
+
+TEST_F(SonarInspectorTests, testGetNodesFindsIdsHandedOutElsewhere) {
+  list_->children[2]->text = "Item";
+  const auto elements =
+      getNodes(dynamic::object("ids", dynamic::array("cell2")))["elements"];
+
+  ASSERT_EQ(elements.size(), 1);
+  EXPECT_EQ(elements[0]["name"], "TextView");
+  EXPECT_EQ(elements[0]["extraInfo"]["hasText"], true);
+  EXPECT_EQ(inspector_->lookUp("cell2"), list_->children[2].get());
+  EXPECT_EQ(adapter_->retained, 1);
+}
+
+TEST_F(SonarInspectorTests, testSearchResultsIncludeAncestors) {
+  const auto results = folly::parseJson(inspector_->getSearchResults(
+      dynamic::object("query", "textview")("offset", 1)("limit", 1)));
+
+  EXPECT_EQ(results["total"], 3);
+  const auto& tree = results["results"];
+  EXPECT_EQ(tree["id"], "root");
+  EXPECT_FALSE(tree["isMatch"].asBool());
+  ASSERT_EQ(tree["children"].size(), 1);
+  const auto& list = tree["children"][0];
+  ASSERT_EQ(list["children"].size(), 1);
+  EXPECT_EQ(list["children"][0]["id"], "cell1");
+  EXPECT_TRUE(list["children"][0]["isMatch"].asBool());
+  EXPECT_EQ(list["children"][0]["children"], nullptr);
+
+  // Only the invalidated subtree is indexed again.
+  list_->children[2]->name = "Button";
+  inspector_->invalidate(list_);
+  const auto updated = folly::parseJson(
+      inspector_->getSearchResults(dynamic::object("query", "textview")));
+  EXPECT_EQ(updated["total"], 2);
+}
+
+TEST_F(SonarInspectorTests, testInvalidationsCoalesceUnderAncestor) {
+  inspector_->getRoot();
+  getNodes(dynamic::object("ids", dynamic::array("list")));
+  inspector_->invalidate(list_->children[0].get());
+  inspector_->invalidate(list_);
+
+  std::string json;
+  SonarMessageWriter writer(json);
+  EXPECT_TRUE(inspector_->flushInvalidated(writer));
+  writer.end();
+  EXPECT_EQ(
+      folly::parseJson(json),
+      dynamic::object("nodes", dynamic::array(dynamic::object("id", "list"))));
+
+  std::string empty;
+  SonarMessageWriter emptyWriter(empty);
+  EXPECT_FALSE(inspector_->flushInvalidated(emptyWriter));
+}
+
+TEST_F(SonarInspectorTests, testNodeAtFindsDeepestNode) {
+  EXPECT_EQ(inspector_->nodeAt(10, 75), "cell2");
+  EXPECT_EQ(inspector_->nodeAt(10, 10), "root");
+  EXPECT_EQ(inspector_->nodeAt(200, 10), "");
+  EXPECT_NE(inspector_->lookUp("cell2"), nullptr);
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,47 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/Log.h>
+
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using std::chrono::milliseconds;
+
+TEST(SonarLogTests, testRateLimiterCountsSuppressedMessages) {
+  LogRateLimiter limiter(milliseconds(100));
+  const auto start = std::chrono::steady_clock::now();
+  uint64_t suppressed = 42;
+
+  EXPECT_TRUE(limiter.allow(start, suppressed));
+  EXPECT_EQ(suppressed, 0);
+
+  EXPECT_FALSE(limiter.allow(start + milliseconds(10), suppressed));
+  EXPECT_FALSE(limiter.allow(start + milliseconds(99), suppressed));
+
+  EXPECT_TRUE(limiter.allow(start + milliseconds(100), suppressed));
+  EXPECT_EQ(suppressed, 2);
+
+  EXPECT_TRUE(limiter.allow(start + milliseconds(250), suppressed));
+  EXPECT_EQ(suppressed, 0);
+}
+
+TEST(SonarLogTests, testLogDoesNotBlockWhenQueueIsFull) {
+  for (int i = 0; i < 10000; i++) {
+    log(LogLevel::Info, "message " + std::to_string(i));
+  }
+  SONAR_LOG_EVERY_MS(LogLevel::Warning, 1000, "rate limited");
+  flushLog();
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarLoopWatchdog.h>
+
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <thread>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+TEST(SonarLoopWatchdogTests, testReportsTheReceiverThatStalledTheLoop) {
+  auto metrics = std::make_shared<SonarMetrics>();
+  folly::EventBase evb;
+  SonarLoopWatchdog watchdog(
+      metrics, std::chrono::milliseconds(1), std::chrono::milliseconds(1));
+  watchdog.watch("callback", &evb);
+  // Watched once, as the connection worker is usually the callback worker.
+  watchdog.watch("connection", &evb);
+
+  const auto receiver = metrics->forMethod("Test", "slow");
+  metrics->enterReceiver(receiver.get());
+  // The loop isn't running, so the probe waits.
+  watchdog.check();
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  watchdog.check();
+  watchdog.check();
+  metrics->exitReceiver(receiver.get());
+
+  auto loops = metrics->toDynamic()["loops"];
+  EXPECT_EQ(loops.size(), 1);
+  EXPECT_EQ(loops["callback"]["stalls"], 1);
+  EXPECT_EQ(loops["callback"]["probes"], 0);
+  EXPECT_EQ(loops["callback"]["lastStall"]["plugin"], "Test");
+  EXPECT_EQ(loops["callback"]["lastStall"]["method"], "slow");
+
+  evb.loopOnce();
+  loops = metrics->toDynamic()["loops"];
+  EXPECT_EQ(loops["callback"]["probes"], 1);
+  EXPECT_GE(loops["callback"]["maxLagMicros"].asInt(), 5000);
+  // The probe waited more than 5ms, so it landed past the 5ms bucket.
+  EXPECT_EQ(loops["callback"]["buckets"][2], 0);
+
+  // Receivers that started after the probe was posted aren't blamed.
+  watchdog.check();
+  metrics->enterReceiver(receiver.get());
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  watchdog.check();
+  metrics->exitReceiver(receiver.get());
+  loops = metrics->toDynamic()["loops"];
+  EXPECT_EQ(loops["callback"]["stalls"], 2);
+  EXPECT_EQ(loops["callback"]["lastStall"]["plugin"], "");
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarMemoryBudget.h>
+
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+TEST(SonarMemoryBudgetTests, testUsageIsSummedAcrossAccounts) {
+  SonarMemoryBudget budget;
+  auto events = budget.open("events");
+  auto queue = budget.open("queue");
+
+  events->setBytes(300);
+  queue->setBytes(500);
+  events->setBytes(200);
+
+  EXPECT_EQ(budget.usedBytes(), 700);
+  auto usage = budget.usage();
+  ASSERT_EQ(usage.size(), 2);
+  EXPECT_EQ(usage[0].name, "queue");
+  EXPECT_EQ(usage[0].bytes, 500);
+
+  queue = nullptr;
+  EXPECT_EQ(budget.usedBytes(), 200);
+  EXPECT_EQ(budget.usage().size(), 1);
+}
+
+TEST(SonarMemoryBudgetTests, testLargestBuffersEvictWhenOverCap) {
+  SonarMemoryBudget budget(1000);
+  std::vector<size_t> asked;
+  std::shared_ptr<SonarMemoryBudget::Account> large;
+  large = budget.open("large", [&](size_t bytes) {
+    asked.push_back(bytes);
+    large->setBytes(large->bytes() - bytes);
+  });
+  auto small = budget.open("small", [](size_t) { FAIL(); });
+  // Can't evict, but still counts.
+  auto fixed = budget.open("fixed");
+
+  fixed->setBytes(100);
+  small->setBytes(100);
+  large->setBytes(700);
+  EXPECT_TRUE(asked.empty());
+
+  // 1100 in total, down to 900.
+  large->setBytes(900);
+  EXPECT_EQ(asked, std::vector<size_t>{200});
+  EXPECT_EQ(budget.usedBytes(), 900);
+}
+
+TEST(SonarMemoryBudgetTests, testMemoryPressureShedsBuffersWhateverTheCap) {
+  SonarMemoryBudget budget;
+  size_t asked = 0;
+  auto events = budget.open("events", [&](size_t bytes) { asked = bytes; });
+  auto empty = budget.open("empty", [](size_t) { FAIL(); });
+
+  events->setBytes(301);
+  budget.onMemoryPressure(SonarMemoryPressure::Moderate);
+  EXPECT_EQ(asked, 151);
+  budget.onMemoryPressure(SonarMemoryPressure::Critical);
+  EXPECT_EQ(asked, 301);
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,58 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarMemoryPlugin.h>
+#include <SonarTestLib/SonarConnectionMock.h>
+#include <SonarTestLib/SonarResponderMock.h>
+
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+TEST(SonarMemoryPluginTests, testSendsDeltasInBatches) {
+  auto connection = std::make_shared<SonarConnectionMock>();
+  std::vector<int64_t> values = {100, 150, -1, 120};
+  size_t reads = 0;
+  // Not on an event base, so only the test samples.
+  auto plugin = std::make_shared<SonarMemoryPlugin>(
+      std::vector<SonarMemorySource>{{"fake", [&] { return values[reads++]; }}});
+  plugin->didConnect(connection);
+  connection->receivers_.at("configure")(
+      dynamic::object("batchSize", 3), std::make_unique<SonarResponderMock>());
+
+  const size_t width = plugin->fields().size() + 1;
+  plugin->sample();
+  plugin->sample();
+  EXPECT_EQ(connection->sent_.count("memory"), 0);
+  plugin->sample();
+
+  const auto& batch = connection->sent_.at("memory");
+  EXPECT_EQ(batch["fields"].size(), plugin->fields().size());
+  EXPECT_EQ(batch["fields"][width - 2], "fake");
+  const auto& samples = batch["samples"];
+  ASSERT_EQ(samples.size(), 3 * width);
+  // From 0, then the change, then none while the value isn't available.
+  EXPECT_EQ(samples[width - 1], 100);
+  EXPECT_EQ(samples[2 * width - 1], 50);
+  EXPECT_EQ(samples[3 * width - 1], 0);
+
+  plugin->sample();
+  plugin->sendBatch();
+  const auto& next = connection->sent_.at("memory");
+  EXPECT_EQ(next.count("fields"), 0);
+  EXPECT_EQ(next["samples"][width - 1], -30);
+  plugin->didDisconnect();
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,152 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarMessageEncoding.h>
+
+#include <folly/json.h>
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+TEST(SonarMessageEncodingTests, testMessagePackRoundTrip) {
+  dynamic message = dynamic::object("method", "execute")(
+      "params",
+      dynamic::object("api", "Test")("method", "update")(
+          "params",
+          dynamic::object("small", 7)("negative", -1000)(
+              "large", int64_t(1) << 40)("double", 1.5)("flag", true)(
+              "nothing", nullptr)("list", dynamic::array(1, "two", 3.0))(
+              "long", std::string(300, 'x'))));
+
+  const auto encoded = msgpack::toMessagePack(message);
+  EXPECT_EQ(msgpack::parseMessagePack(encoded), message);
+}
+
+TEST(SonarMessageEncodingTests, testDetectEncoding) {
+  dynamic message = dynamic::object("id", 1)("method", "getPlugins");
+
+  const auto json = serializeMessage(message, SonarMessageEncoding::JSON);
+  const auto binary =
+      serializeMessage(message, SonarMessageEncoding::MessagePack);
+
+  EXPECT_EQ(detectEncoding(json), SonarMessageEncoding::JSON);
+  EXPECT_EQ(detectEncoding(binary), SonarMessageEncoding::MessagePack);
+  EXPECT_EQ(deserializeMessage(json), message);
+  EXPECT_EQ(deserializeMessage(binary), message);
+}
+
+TEST(SonarMessageEncodingTests, testExecuteEnvelopeMatchesFullMessage) {
+  dynamic params = dynamic::object("id", 42)("name", "quoted \"name\"");
+  dynamic expected = dynamic::object("method", "execute")(
+      "params",
+      dynamic::object("api", "Network")("method", "newRequest")(
+          "params", params));
+
+  for (auto encoding :
+       {SonarMessageEncoding::JSON, SonarMessageEncoding::MessagePack}) {
+    auto payload = executeEnvelopePrefix("Network", "newRequest", encoding);
+    payload.append(
+        encoding == SonarMessageEncoding::JSON ? folly::toJson(params)
+                                               : msgpack::toMessagePack(params));
+    payload.append(executeEnvelopeSuffix(encoding));
+    EXPECT_EQ(deserializeMessage(payload), expected);
+  }
+}
+
+TEST(SonarMessageEncodingTests, testBatchContainsAllMessages) {
+  dynamic first = dynamic::object("method", "refreshPlugins");
+  dynamic second = dynamic::object("id", 3)("success", dynamic::object());
+
+  for (auto encoding :
+       {SonarMessageEncoding::JSON, SonarMessageEncoding::MessagePack}) {
+    const auto batch = serializeBatch(
+        {serializeMessage(first, encoding), serializeMessage(second, encoding)},
+        encoding);
+    EXPECT_EQ(
+        deserializeMessage(batch),
+        dynamic::object("method", "batch")(
+            "messages", dynamic::array(first, second)));
+  }
+}
+
+TEST(SonarMessageEncodingTests, testTruncatedInputIsRejected) {
+  const auto encoded = msgpack::toMessagePack(
+      dynamic::object("key", "a string that will get cut off"));
+  EXPECT_THROW(
+      msgpack::parseMessagePack(
+          folly::StringPiece(encoded.data(), encoded.size() - 4)),
+      std::invalid_argument);
+}
+
+TEST(SonarMessageEncodingTests, testPeekExecuteRoute) {
+  SonarExecuteRoute route;
+  EXPECT_TRUE(peekExecuteRoute(
+      " {\"id\": 12, \"method\": \"execute\", \"params\": {\"params\": "
+      "{\"ids\": [\"a\", {\"b\": \"}\\\"\"}]}, \"api\": \"Inspector\", "
+      "\"method\": \"getNodes\"}, \"timeout\": 500}",
+      route));
+  EXPECT_EQ(route.id.value(), 12);
+  EXPECT_EQ(route.api, "Inspector");
+  EXPECT_EQ(route.method, "getNodes");
+}
+
+TEST(SonarMessageEncodingTests, testPeekExecuteRouteFallsBack) {
+  SonarExecuteRoute route;
+  // Not an execute.
+  EXPECT_FALSE(peekExecuteRoute(
+      "{\"method\": \"init\", \"params\": {\"plugin\": \"Test\"}}", route));
+  // Escaped plugin name.
+  EXPECT_FALSE(peekExecuteRoute(
+      "{\"method\": \"execute\", \"params\": {\"api\": \"T\\u0065st\", "
+      "\"method\": \"ping\"}}",
+      route));
+  // Truncated.
+  EXPECT_FALSE(peekExecuteRoute(
+      "{\"method\": \"execute\", \"params\": {\"api\": \"Test\"", route));
+  EXPECT_FALSE(peekExecuteRoute(
+      msgpack::toMessagePack(dynamic::object("method", "execute")),
+      route));
+}
+
+TEST(SonarMessageEncodingTests, testColumnarJsonWritesKeysOnce) {
+  dynamic elements = dynamic::array;
+  for (int i = 0; i < 4; i++) {
+    elements.push_back(dynamic::object("id", i)("name", "View")(
+        "children", dynamic::array(i)));
+  }
+  const dynamic message = dynamic::object("id", 1)(
+      "success",
+      dynamic::object("elements", elements)(
+          "short", dynamic::array(dynamic::object("id", 0)))(
+          "mixed", dynamic::array(1, 2, 3, "four")));
+
+  const auto columnar = folly::parseJson(toColumnarJson(message));
+  const auto& packed = columnar["success"]["elements"];
+  ASSERT_TRUE(packed.isObject());
+  ASSERT_EQ(packed["__columns"].size(), 3);
+  for (size_t c = 0; c < 3; c++) {
+    const auto& key = packed["__columns"][c];
+    const auto& column = packed["__values"][c];
+    ASSERT_EQ(column.size(), 4);
+    for (size_t i = 0; i < 4; i++) {
+      EXPECT_EQ(column[i], elements[i][key]);
+    }
+  }
+  // Arrays that are too short or not all objects are left as they are.
+  EXPECT_EQ(columnar["success"]["short"], message["success"]["short"]);
+  EXPECT_EQ(columnar["success"]["mixed"], message["success"]["mixed"]);
+  EXPECT_EQ(columnar["id"], 1);
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarConnectionImpl.h>
+#include <Sonar/SonarMessageWriter.h>
+#include <SonarTestLib/SonarWebSocketMock.h>
+
+#include <folly/json.h>
+#include <gtest/gtest.h>
+#include <limits>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+TEST(SonarMessageWriterTests, testWritesSameJsonAsDynamic) {
+  std::string json;
+  SonarMessageWriter writer(json);
+  writer.put("id", "0x7f8")
+      .put("quoted", "a \"quoted\"\nname")
+      .put("count", 42)
+      .put("negative", int64_t(-1) << 40)
+      .put("ratio", 1.5)
+      .put("flag", true)
+      .putNull("nothing")
+      .beginArray("children")
+      .add("first")
+      .add(2)
+      .beginObject()
+      .put("nested", false)
+      .end()
+      .beginArray()
+      .end()
+      .end()
+      .beginObject("empty")
+      .end()
+      .putDynamic("existing", dynamic::array(1, "two"))
+      .end();
+
+  EXPECT_TRUE(writer.isComplete());
+  EXPECT_EQ(
+      folly::parseJson(json),
+      dynamic::object("id", "0x7f8")("quoted", "a \"quoted\"\nname")(
+          "count", 42)("negative", int64_t(-1) << 40)("ratio", 1.5)(
+          "flag", true)("nothing", nullptr)(
+          "children",
+          dynamic::array(
+              "first",
+              2,
+              dynamic::object("nested", false),
+              dynamic::array()))("empty", dynamic::object())(
+          "existing", dynamic::array(1, "two")));
+}
+
+TEST(SonarMessageWriterTests, testNonFiniteDoublesBecomeNull) {
+  std::string json;
+  SonarMessageWriter writer(json);
+  writer.put("nan", std::numeric_limits<double>::quiet_NaN()).end();
+  EXPECT_EQ(folly::parseJson(json), dynamic::object("nan", nullptr));
+}
+
+TEST(SonarMessageWriterTests, testKeyValueCalls) {
+  std::string json;
+  SonarMessageWriter writer(json);
+  writer.key("nodes").beginArray();
+  for (int i = 0; i < 3; i++) {
+    writer.beginObject().key("id").value(i).key("name").value("View");
+    writer.endObject();
+  }
+  writer.endArray().endObject();
+
+  EXPECT_EQ(
+      folly::parseJson(json),
+      dynamic::object(
+          "nodes",
+          dynamic::array(
+              dynamic::object("id", 0)("name", "View"),
+              dynamic::object("id", 1)("name", "View"),
+              dynamic::object("id", 2)("name", "View"))));
+}
+
+TEST(SonarMessageWriterTests, testWritingPastTheEndThrows) {
+  std::string json;
+  SonarMessageWriter writer(json);
+  writer.end();
+  EXPECT_THROW(writer.end(), std::logic_error);
+  EXPECT_THROW(writer.add(1), std::logic_error);
+  EXPECT_THROW(writer.key("key"), std::logic_error);
+}
+
+#ifndef NDEBUG
+TEST(SonarMessageWriterTests, testInvalidJsonThrowsInDebugBuilds) {
+  std::string json;
+  SonarMessageWriter writer(json);
+  EXPECT_THROW(writer.value(1), std::logic_error);
+  writer.beginArray("list");
+  EXPECT_THROW(writer.key("key"), std::logic_error);
+  EXPECT_THROW(writer.endObject(), std::logic_error);
+  writer.endArray().key("dangling");
+  EXPECT_THROW(writer.key("another"), std::logic_error);
+  EXPECT_THROW(writer.end(), std::logic_error);
+}
+#endif
+
+TEST(SonarMessageWriterTests, testConnectionSendWith) {
+  SonarWebSocketMock socket;
+  SonarConnectionImpl connection(&socket, "Test");
+
+  for (int i = 0; i < 2; i++) {
+    connection.sendWith("update", [i](SonarMessageWriter& writer) {
+      writer.put("index", i);
+    });
+  }
+
+  ASSERT_EQ(socket.messages.size(), 2);
+  EXPECT_EQ(
+      socket.messages[1],
+      dynamic::object("method", "execute")(
+          "params",
+          dynamic::object("api", "Test")("method", "update")(
+              "params", dynamic::object("index", 1))));
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
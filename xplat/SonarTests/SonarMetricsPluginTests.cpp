@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarMetricsPlugin.h>
+#include <SonarTestLib/SonarConnectionMock.h>
+
+#include <gtest/gtest.h>
+#include <thread>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+// Flushes are only made by the tests.
+constexpr std::chrono::hours kNeverFlush(1);
+
+TEST(SonarMetricsPluginTests, testAddsUpThreadsIntoOneMessage) {
+  auto connection = std::make_shared<SonarConnectionMock>();
+  SonarMetricsPlugin plugin(kNeverFlush);
+  auto hits = plugin.counter("hits");
+  auto latency = plugin.histogram("latency");
+  plugin.gauge("depth").set(3.5);
+  plugin.didConnect(connection);
+
+  // The thread exits before the flush, leaving its counts behind.
+  std::thread([&] {
+    for (int i = 1; i <= 4; i++) {
+      hits.add();
+      latency.record(i);
+    }
+  }).join();
+  hits.add(10);
+  plugin.flush();
+
+  const auto& message = connection->sent_.at("metrics");
+  EXPECT_EQ(
+      message["counterNames"],
+      dynamic::object("offset", 0)("names", dynamic::array("hits")));
+  EXPECT_EQ(message["counters"], dynamic::array(0, 14));
+  EXPECT_EQ(message["gauges"], dynamic::array(0, 3.5));
+  // Index, count, sum, min, max, then bucket and count pairs.
+  EXPECT_EQ(
+      message["histograms"],
+      dynamic::array(dynamic::array(
+          0, 4, 10, 1, 4, dynamic::array(1, 1, 2, 2, 3, 1))));
+  plugin.didDisconnect();
+}
+
+TEST(SonarMetricsPluginTests, testOnlySendsChanges) {
+  auto connection = std::make_shared<SonarConnectionMock>();
+  SonarMetricsPlugin plugin(kNeverFlush);
+  auto hits = plugin.counter("hits");
+  plugin.didConnect(connection);
+
+  hits.add(2);
+  plugin.flush();
+  connection->sent_.clear();
+  plugin.flush();
+  EXPECT_EQ(connection->sent_.count("metrics"), 0);
+
+  hits.add(3);
+  plugin.counter("misses").add();
+  plugin.flush();
+  const auto& message = connection->sent_.at("metrics");
+  EXPECT_EQ(message["counters"], dynamic::array(0, 3, 1, 1));
+  // Only the name the desktop hasn't seen yet.
+  EXPECT_EQ(
+      message["counterNames"],
+      dynamic::object("offset", 1)("names", dynamic::array("misses")));
+  plugin.didDisconnect();
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
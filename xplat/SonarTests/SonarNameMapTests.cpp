@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarNameMap.h>
+
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+TEST(SonarNameMapTests, testFindByPiece) {
+  SonarNameMap<int> map;
+  map["Inspector"] = 1;
+  map.emplace("Network", 2);
+
+  std::string name = "Network";
+  EXPECT_EQ(map.find(folly::StringPiece(name))->second, 2);
+  EXPECT_EQ(map.find("Inspector")->second, 1);
+  EXPECT_TRUE(map.find("Unknown") == map.end());
+  EXPECT_EQ(map.count("Network"), 1);
+}
+
+TEST(SonarNameMapTests, testEmplaceKeepsTheFirstValue) {
+  SonarNameMap<int> map;
+  EXPECT_TRUE(map.emplace("Network", 1).second);
+  EXPECT_FALSE(map.emplace("Network", 2).second);
+  EXPECT_EQ(map["Network"], 1);
+  EXPECT_EQ(map.size(), 1);
+}
+
+TEST(SonarNameMapTests, testKeysOwnTheirNames) {
+  SonarNameMap<int> map;
+  {
+    std::string name = "a name too long for the small string buffer";
+    map[name] = 1;
+    name.assign(name.size(), 'x');
+  }
+  const auto copy = map;
+  map.clear();
+
+  ASSERT_EQ(copy.size(), 1);
+  EXPECT_EQ(
+      copy.begin()->first.str(),
+      "a name too long for the small string buffer");
+  EXPECT_EQ(copy.count("a name too long for the small string buffer"), 1);
+}
+
+TEST(SonarNameMapTests, testErase) {
+  SonarNameMap<int> map;
+  map["Network"] = 1;
+  map["Inspector"] = 2;
+
+  EXPECT_EQ(map.erase("Network"), 1);
+  EXPECT_EQ(map.erase("Network"), 0);
+  map.erase(map.find("Inspector"));
+  EXPECT_TRUE(map.empty());
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,291 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarNetworkCapture.h>
+#include <SonarTestLib/SonarConnectionMock.h>
+#include <SonarTestLib/SonarResponderMock.h>
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+SonarNetworkRequest request(std::string id, std::string url) {
+  SonarNetworkRequest request;
+  request.id = std::move(id);
+  request.method = "GET";
+  request.url = std::move(url);
+  request.headers = {{"Accept", "*/*"}, {"User-Agent", "test"}};
+  return request;
+}
+
+TEST(SonarNetworkCaptureTests, testFilterMatchesHostPathAndMethod) {
+  const SonarNetworkCaptureFilter filter(dynamic::object("host", "Example.com")(
+      "pathPrefix", "/api")("methods", dynamic::array("post", "GET")));
+
+  EXPECT_TRUE(filter.acceptsRequest("GET", "https://example.com/api/feed"));
+  EXPECT_TRUE(
+      filter.acceptsRequest("POST", "https://u@cdn.example.com:8080/api?q"));
+  EXPECT_FALSE(filter.acceptsRequest("GET", "https://notexample.com/api"));
+  EXPECT_FALSE(filter.acceptsRequest("GET", "https://example.com/static"));
+  EXPECT_FALSE(filter.acceptsRequest("PUT", "https://example.com/api"));
+
+  const SonarNetworkCaptureFilter statuses(dynamic::object("minStatus", 400)(
+      "contentType", "application/json"));
+  EXPECT_TRUE(statuses.acceptsResponse(404, "Application/JSON; charset=utf8"));
+  EXPECT_FALSE(statuses.acceptsResponse(200, "application/json"));
+  EXPECT_FALSE(statuses.acceptsResponse(500, "text/html"));
+}
+
+TEST(SonarNetworkCaptureTests, testInternsHeaderNamesPerConnection) {
+  SonarNetworkCapture capture;
+  // Buffered before the desktop connects, with every name spelled out.
+  capture.reportRequest(request("1", "https://example.com/"));
+  auto connection = std::make_shared<SonarConnectionMock>();
+  capture.didConnect(connection);
+  EXPECT_EQ(
+      connection->sent_.at("newRequest")["compactHeaders"],
+      dynamic::array("Accept", "*/*", "User-Agent", "test"));
+
+  auto second = request("2", "https://example.com/");
+  capture.reportRequest(second);
+  const auto first = connection->sent_.at("newRequest");
+  EXPECT_EQ(first["compactHeaders"], dynamic::array(0, "*/*", 1, "test"));
+  EXPECT_EQ(first["newHeaderNames"], dynamic::array("Accept", "User-Agent"));
+  EXPECT_EQ(first["newHeaderNamesOffset"], 0);
+
+  second.id = "3";
+  second.headers.push_back({"Accept", "text/html"});
+  second.headers.push_back({"X-Trace", "1"});
+  capture.reportRequest(second);
+  const auto third = connection->sent_.at("newRequest");
+  EXPECT_EQ(
+      third["compactHeaders"],
+      dynamic::array(0, "*/*", 1, "test", 0, "text/html", 2, "1"));
+  EXPECT_EQ(third["newHeaderNames"], dynamic::array("X-Trace"));
+  EXPECT_EQ(third["newHeaderNamesOffset"], 2);
+}
+
+TEST(SonarNetworkCaptureTests, testKeepsTruncatedBodiesForTheDesktop) {
+  SonarNetworkCaptureConfig config;
+  config.inlineBodyBytes = 3;
+  SonarNetworkCapture capture(config);
+  auto connection = std::make_shared<SonarConnectionMock>();
+  capture.didConnect(connection);
+
+  SonarNetworkResponse response;
+  response.id = "1";
+  response.status = 200;
+  response.body = "hello";
+  capture.reportResponse(response);
+  const auto sent = connection->sent_.at("newResponse");
+  EXPECT_EQ(sent["data"], "aGVs");
+  EXPECT_EQ(sent["dataTruncated"], true);
+  EXPECT_EQ(sent["dataLength"], 5);
+
+  std::vector<dynamic> successes;
+  connection->receivers_.at("getResponseBody")(
+      dynamic::object("id", "1"),
+      std::make_unique<SonarResponderMock>(&successes));
+  ASSERT_EQ(successes.size(), 1);
+  EXPECT_EQ(successes[0]["data"], "aGVsbG8=");
+}
+
+TEST(SonarNetworkCaptureTests, testLeavesOutResponsesOfFilteredRequests) {
+  SonarNetworkCapture capture;
+  auto connection = std::make_shared<SonarConnectionMock>();
+  capture.didConnect(connection);
+  std::vector<dynamic> successes;
+  connection->receivers_.at("setFilter")(
+      dynamic::object("host", "example.com")("maxStatus", 299),
+      std::make_unique<SonarResponderMock>(&successes));
+  EXPECT_EQ(successes.size(), 1);
+
+  capture.reportRequest(request("1", "https://other.com/"));
+  SonarNetworkResponse response;
+  response.id = "1";
+  response.status = 200;
+  capture.reportResponse(response);
+  EXPECT_EQ(connection->sent_.count("newRequest"), 0);
+  EXPECT_EQ(connection->sent_.count("newResponse"), 0);
+
+  capture.reportRequest(request("2", "https://example.com/"));
+  response.id = "2";
+  response.status = 500;
+  capture.reportResponse(response);
+  EXPECT_EQ(connection->sent_.at("dropRequest"), dynamic::object("id", "2"));
+}
+
+TEST(SonarNetworkCaptureTests, testPathTemplatesCollapseIds) {
+  EXPECT_EQ(
+      SonarNetworkStats::pathTemplate("/users/42/posts"),
+      "/users/{id}/posts");
+  EXPECT_EQ(
+      SonarNetworkStats::pathTemplate("/blobs/0f3a9c2e-77b1-4d2a-9e0c"),
+      "/blobs/{id}");
+  EXPECT_EQ(SonarNetworkStats::pathTemplate("/v2/feed/"), "/v2/feed/");
+  EXPECT_EQ(SonarNetworkStats::pathTemplate(""), "/");
+}
+
+TEST(SonarNetworkCaptureTests, testAggregationSendsSummariesInstead) {
+  SonarNetworkCaptureConfig config;
+  config.aggregate = true;
+  config.summaryIntervalMs = 0;
+  SonarNetworkCapture capture(config);
+  auto connection = std::make_shared<SonarConnectionMock>();
+  capture.didConnect(connection);
+
+  const int statuses[] = {200, 500, 0};
+  const int latencies[] = {30, 60, 200};
+  for (int i = 0; i < 3; i++) {
+    const auto id = std::to_string(i);
+    auto sent = request(id, "https://Example.com/users/1" + id + "?q");
+    sent.timestamp = 1000;
+    sent.body = "ab";
+    capture.reportRequest(sent);
+    SonarNetworkResponse response;
+    response.id = id;
+    response.timestamp = 1000 + latencies[i];
+    response.status = statuses[i];
+    response.headers = {{"Content-Length", "100"}};
+    response.reusedConnection = i > 0;
+    capture.reportResponse(response);
+  }
+  SonarNetworkResponse unmatched;
+  unmatched.id = "unknown";
+  capture.reportResponse(unmatched);
+  EXPECT_EQ(connection->sent_.count("newRequest"), 0);
+  EXPECT_EQ(connection->sent_.count("newResponse"), 0);
+
+  std::vector<dynamic> successes;
+  connection->receivers_.at("getSummary")(
+      dynamic::object(), std::make_unique<SonarResponderMock>(&successes));
+  ASSERT_EQ(successes.size(), 1);
+  const auto& summary = successes[0];
+  EXPECT_EQ(summary["unmatched"], 1);
+  ASSERT_EQ(summary["endpoints"].size(), 1);
+  const auto& endpoint = summary["endpoints"][0];
+  EXPECT_EQ(endpoint["host"], "example.com");
+  EXPECT_EQ(endpoint["path"], "/users/{id}");
+  EXPECT_EQ(endpoint["requests"], 3);
+  EXPECT_EQ(endpoint["errors"], 1);
+  EXPECT_EQ(endpoint["failures"], 1);
+  EXPECT_EQ(endpoint["reusedConnections"], 2);
+  EXPECT_EQ(endpoint["bytesSent"], 6);
+  EXPECT_EQ(endpoint["bytesReceived"], 300);
+  // Percentiles are bucket bounds, but never past the slowest request.
+  EXPECT_EQ(endpoint["latencyMs"]["p50"], 100);
+  EXPECT_EQ(endpoint["latencyMs"]["p99"], 200);
+  EXPECT_EQ(endpoint["latencyMs"]["max"], 200);
+
+  // A summary starts over.
+  connection->receivers_.at("getSummary")(
+      dynamic::object(), std::make_unique<SonarResponderMock>(&successes));
+  EXPECT_EQ(successes.back()["endpoints"].size(), 0);
+
+  // Switching back sends requests again.
+  connection->receivers_.at("setAggregation")(
+      dynamic::object("enabled", false),
+      std::make_unique<SonarResponderMock>(&successes));
+  capture.reportRequest(request("4", "https://example.com/"));
+  EXPECT_EQ(connection->sent_.at("newRequest")["id"], "4");
+}
+
+TEST(SonarNetworkCaptureTests, testBufferFileOutlastsTheCapture) {
+  char path[] = "/tmp/SonarNetworkCaptureTestsXXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  SonarNetworkCaptureConfig config;
+  config.bufferedBytes = 4096;
+  config.bufferFile = path;
+  {
+    SonarNetworkCapture capture(config);
+    capture.reportRequest(request("1", "https://example.com/"));
+  }
+
+  // As after the app restarted.
+  SonarNetworkCapture capture(config);
+  auto connection = std::make_shared<SonarConnectionMock>();
+  capture.didConnect(connection);
+  EXPECT_EQ(connection->sent_.at("newRequest")["id"], "1");
+  EXPECT_EQ(unlink(path), 0);
+}
+
+TEST(SonarNetworkCaptureTests, testMarksFormattableResponses) {
+  SonarNetworkCapture capture;
+  auto connection = std::make_shared<SonarConnectionMock>();
+  capture.didConnect(connection);
+
+  SonarNetworkResponse response;
+  response.id = "1";
+  response.status = 200;
+  capture.reportResponse(response);
+  EXPECT_EQ(connection->sent_.at("newResponse").count("formattable"), 0);
+
+  response.id = "2";
+  response.formattable = true;
+  capture.reportResponse(response);
+  EXPECT_EQ(connection->sent_.at("newResponse")["formattable"], true);
+}
+
+TEST(SonarNetworkCaptureTests, testReportDroppedUnlessAggregating) {
+  SonarNetworkCapture capture;
+  auto connection = std::make_shared<SonarConnectionMock>();
+  capture.didConnect(connection);
+  capture.reportRequest(request("1", "https://example.com/"));
+  capture.reportDropped("1");
+  EXPECT_EQ(connection->sent_.at("dropRequest"), dynamic::object("id", "1"));
+
+  std::vector<dynamic> successes;
+  connection->receivers_.at("setAggregation")(
+      dynamic::object("enabled", true),
+      std::make_unique<SonarResponderMock>(&successes));
+  connection->sent_.erase("dropRequest");
+  capture.reportRequest(request("2", "https://example.com/"));
+  capture.reportDropped("2");
+  EXPECT_EQ(connection->sent_.count("dropRequest"), 0);
+}
+
+TEST(SonarNetworkCaptureTests, testBodyStoreSpillsOldestBodies) {
+  char directory[] = "/tmp/SonarNetworkCaptureTestsXXXXXX";
+  ASSERT_NE(mkdtemp(directory), nullptr);
+  {
+    SonarNetworkBodyStore store(8, directory, 8);
+    store.put("1", "aaaa");
+    store.put("2", "bbbb");
+    EXPECT_EQ(store.memoryBytes(), 8);
+    store.put("3", "cccc");
+    EXPECT_EQ(store.memoryBytes(), 8);
+    EXPECT_EQ(store.diskBytes(), 4);
+
+    std::string body;
+    ASSERT_TRUE(store.get("1", body));
+    EXPECT_EQ(body, "aaaa");
+
+    store.put("4", "dddd");
+    store.put("5", "eeee");
+    // Spilling 2 and 3 pushed 1 off the disk.
+    EXPECT_FALSE(store.get("1", body));
+    ASSERT_TRUE(store.get("2", body));
+    EXPECT_EQ(body, "bbbb");
+    store.put("6", "too large for either");
+    EXPECT_FALSE(store.get("6", body));
+  }
+  // Every spilled file was deleted, so the directory is empty again.
+  EXPECT_EQ(rmdir(directory), 0);
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
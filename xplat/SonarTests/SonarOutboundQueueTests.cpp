@@ -0,0 +1,167 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarOutboundQueue.h>
+
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <thread>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+TEST(SonarOutboundQueueTests, testDrainPreservesOrder) {
+  SonarOutboundQueue queue;
+  EXPECT_TRUE(queue.push({"first", SonarMessageEncoding::JSON}));
+  EXPECT_FALSE(queue.push({"second", SonarMessageEncoding::JSON}));
+  EXPECT_FALSE(queue.push({"third", SonarMessageEncoding::MessagePack}));
+  EXPECT_EQ(queue.depth(), 3);
+
+  auto messages = queue.drain();
+  ASSERT_EQ(messages.size(), 3);
+  EXPECT_EQ(messages[0].payload, "first");
+  EXPECT_EQ(messages[1].payload, "second");
+  EXPECT_EQ(messages[2].payload, "third");
+  EXPECT_EQ(messages[2].encoding, SonarMessageEncoding::MessagePack);
+  EXPECT_EQ(queue.depth(), 0);
+
+  EXPECT_TRUE(queue.push({"again", SonarMessageEncoding::JSON}));
+}
+
+TEST(SonarOutboundQueueTests, testConcurrentProducersKeepPerThreadOrder) {
+  constexpr int kThreads = 4;
+  constexpr int kMessages = 10000;
+  SonarOutboundQueue queue;
+
+  std::vector<std::thread> producers;
+  for (int t = 0; t < kThreads; t++) {
+    producers.emplace_back([&queue, t]() {
+      for (int i = 0; i < kMessages; i++) {
+        queue.push({std::to_string(t) + ":" + std::to_string(i),
+                    SonarMessageEncoding::JSON});
+      }
+    });
+  }
+
+  std::vector<int> last(kThreads, -1);
+  int received = 0;
+  while (received < kThreads * kMessages) {
+    for (const auto& message : queue.drain()) {
+      const int thread = message.payload[0] - '0';
+      const int index = std::stoi(message.payload.substr(2));
+      EXPECT_EQ(index, last[thread] + 1);
+      last[thread] = index;
+      received++;
+    }
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  EXPECT_EQ(queue.depth(), 0);
+}
+
+SonarOutboundMessage laneMessage(
+    std::string payload,
+    SonarMessagePriority priority) {
+  SonarOutboundMessage message{std::move(payload), SonarMessageEncoding::JSON};
+  message.priority = priority;
+  return message;
+}
+
+TEST(SonarOutboundQueueTests, testLanesServeHigherPriorityFirst) {
+  SonarOutboundLanes lanes(0);
+  lanes.push(laneMessage("bulk", SonarMessagePriority::Bulk), true);
+  lanes.push(laneMessage("event1", SonarMessagePriority::Events), true);
+  lanes.push(laneMessage("response", SonarMessagePriority::Interactive), true);
+  lanes.push(laneMessage("event2", SonarMessagePriority::Events), true);
+
+  std::vector<std::string> sent;
+  while (!lanes.empty()) {
+    EXPECT_FALSE(lanes.sendNext(
+        [&sent](SonarOutboundMessage message) {
+          sent.push_back(message.payload);
+        },
+        [](const SonarOutboundFragment&, std::unique_ptr<folly::IOBuf>) {
+          FAIL();
+        }));
+  }
+  EXPECT_EQ(
+      sent,
+      std::vector<std::string>({"response", "event1", "event2", "bulk"}));
+}
+
+TEST(SonarOutboundQueueTests, testLargeMessagesAreFragmented) {
+  SonarOutboundLanes lanes(4);
+  lanes.push(laneMessage("0123456789", SonarMessagePriority::Events), true);
+  lanes.push(laneMessage("unsplit", SonarMessagePriority::Events), false);
+
+  std::string reassembled;
+  std::vector<std::string> sent;
+  auto sendMessage = [&sent](SonarOutboundMessage message) {
+    sent.push_back(message.payload);
+  };
+  auto sendFragment = [&](const SonarOutboundFragment& fragment,
+                          std::unique_ptr<folly::IOBuf> data) {
+    EXPECT_EQ(fragment.count, 3);
+    EXPECT_EQ(fragment.envelope, nullptr);
+    reassembled.append(data->moveToFbString().toStdString());
+  };
+
+  EXPECT_TRUE(lanes.sendNext(sendMessage, sendFragment));
+  // A response overtakes the rest of the fragmented message.
+  lanes.push(laneMessage("response", SonarMessagePriority::Interactive), true);
+  EXPECT_FALSE(lanes.sendNext(sendMessage, sendFragment));
+  EXPECT_TRUE(lanes.sendNext(sendMessage, sendFragment));
+  EXPECT_TRUE(lanes.sendNext(sendMessage, sendFragment));
+  EXPECT_FALSE(lanes.sendNext(sendMessage, sendFragment));
+  EXPECT_TRUE(lanes.empty());
+
+  EXPECT_EQ(reassembled, "0123456789");
+  EXPECT_EQ(sent, std::vector<std::string>({"response", "unsplit"}));
+}
+
+TEST(SonarOutboundQueueTests, testBinaryFragmentsCarryEnvelope) {
+  SonarOutboundLanes lanes(3);
+  SonarOutboundMessage message{"{\"method\":\"execute\"}",
+                               SonarMessageEncoding::JSON,
+                               folly::IOBuf::copyBuffer("abcdefg")};
+  message.priority = SonarMessagePriority::Bulk;
+  lanes.push(std::move(message), true);
+
+  std::vector<std::string> envelopes;
+  auto sendFragment = [&envelopes](
+                          const SonarOutboundFragment& fragment,
+                          std::unique_ptr<folly::IOBuf>) {
+    envelopes.push_back(fragment.envelope ? *fragment.envelope : "");
+  };
+  EXPECT_TRUE(lanes.sendNext([](SonarOutboundMessage) {}, sendFragment));
+  EXPECT_EQ(lanes.clear(), 4);
+  EXPECT_TRUE(lanes.empty());
+  EXPECT_EQ(
+      envelopes, std::vector<std::string>({"{\"method\":\"execute\"}"}));
+}
+
+TEST(SonarOutboundQueueTests, testLatestMessagesSupersedeOlderOnes) {
+  SonarLatestMessages latest;
+  const auto first = latest.mark("Inspector\0highlight");
+  const auto second = latest.mark("Inspector\0highlight");
+  const auto other = latest.mark("Inspector\0other");
+
+  EXPECT_FALSE(latest.isLatest("Inspector\0highlight", first));
+  EXPECT_TRUE(latest.isLatest("Inspector\0highlight", second));
+  EXPECT_FALSE(latest.take("Inspector\0highlight", first));
+  EXPECT_TRUE(latest.take("Inspector\0highlight", second));
+  // Once the newest was sent, an older one can't take its place.
+  EXPECT_FALSE(latest.isLatest("Inspector\0highlight", first));
+  EXPECT_TRUE(latest.take("Inspector\0other", other));
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarPublished.h>
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+TEST(SonarPublishedTests, testReadSeesTheLatestValue) {
+  SonarPublished<std::string> published("first");
+  EXPECT_EQ(
+      published.read([](const std::string& value) { return value; }), "first");
+
+  published.publish(published.latest() + " second");
+  EXPECT_EQ(
+      published.read([](const std::string& value) { return value.size(); }),
+      12u);
+  EXPECT_EQ(published.latest(), "first second");
+}
+
+TEST(SonarPublishedTests, testPublishDeletesThePreviousValue) {
+  std::weak_ptr<int> previous;
+  {
+    SonarPublished<std::shared_ptr<int>> published(std::make_shared<int>(1));
+    previous = published.latest();
+    published.publish(std::make_shared<int>(2));
+    EXPECT_TRUE(previous.expired());
+    previous = published.latest();
+  }
+  EXPECT_TRUE(previous.expired());
+}
+
+TEST(SonarPublishedTests, testReadersNeverSeeDeletedValues) {
+  // Every value is deleted by overwriting its elements first, which a reader
+  // still holding it would notice.
+  struct Values {
+    std::vector<int> values = std::vector<int>(16, 7);
+    ~Values() {
+      std::fill(values.begin(), values.end(), -1);
+    }
+  };
+  SonarPublished<Values> published;
+  std::atomic<bool> done{false};
+  std::atomic<int> torn{0};
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; i++) {
+    readers.emplace_back([&] {
+      while (!done) {
+        published.read([&](const Values& current) {
+          for (const auto value : current.values) {
+            if (value != 7) {
+              torn++;
+            }
+          }
+        });
+      }
+    });
+  }
+  for (int i = 0; i < 1000; i++) {
+    published.publish(Values());
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(torn, 0);
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,148 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarConnectionImpl.h>
+#include <Sonar/SonarResponseCache.h>
+#include <SonarTestLib/SonarResponderMock.h>
+#include <SonarTestLib/SonarWebSocketMock.h>
+
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+TEST(SonarResponseCacheTests, testRepeatCallsSkipTheReceiver) {
+  SonarWebSocketMock socket;
+  auto connection = std::make_shared<SonarConnectionImpl>(&socket, "Test");
+  int calls = 0;
+  connection->receive(
+      "getRoot",
+      SonarConnection::SonarReceiver(
+          [&calls](
+              const dynamic& params, std::unique_ptr<SonarResponder> responder) {
+            calls++;
+            responder->success(dynamic::object("calls", calls));
+          }));
+  connection->cacheResponses("getRoot", "tree");
+
+  std::vector<dynamic> successes;
+  connection->call(
+      "getRoot",
+      dynamic::object("a", 1)("b", 2),
+      std::make_unique<SonarResponderMock>(&successes));
+  // The same params in another order.
+  connection->call(
+      "getRoot",
+      dynamic::object("b", 2)("a", 1),
+      std::make_unique<SonarResponderMock>(&successes));
+  EXPECT_EQ(calls, 1);
+  ASSERT_EQ(successes.size(), 2);
+  EXPECT_EQ(successes[1], dynamic::object("calls", 1));
+
+  connection->call(
+      "getRoot",
+      dynamic::object("a", 2),
+      std::make_unique<SonarResponderMock>(&successes));
+  EXPECT_EQ(calls, 2);
+
+  connection->invalidateResponses("tree");
+  connection->call(
+      "getRoot",
+      dynamic::object("a", 1)("b", 2),
+      std::make_unique<SonarResponderMock>(&successes));
+  EXPECT_EQ(calls, 3);
+  EXPECT_EQ(successes.back(), dynamic::object("calls", 3));
+
+  // Other counters leave the response alone.
+  connection->invalidateResponses("preferences");
+  connection->call(
+      "getRoot",
+      dynamic::object("a", 1)("b", 2),
+      std::make_unique<SonarResponderMock>(&successes));
+  EXPECT_EQ(calls, 3);
+}
+
+TEST(SonarResponseCacheTests, testKeepsNothingComputedBeforeABump) {
+  SonarWebSocketMock socket;
+  auto connection = std::make_shared<SonarConnectionImpl>(&socket, "Test");
+  int calls = 0;
+  std::unique_ptr<SonarResponder> pending;
+  connection->receive(
+      "getAll",
+      SonarConnection::SonarReceiver(
+          [&](const dynamic& params, std::unique_ptr<SonarResponder> responder) {
+            calls++;
+            if (params.getDefault("fail", false).asBool()) {
+              responder->error(dynamic::object("message", "failed"));
+              return;
+            }
+            pending = std::move(responder);
+          }));
+  connection->cacheResponses("getAll", "");
+
+  std::vector<dynamic> successes;
+  connection->call(
+      "getAll",
+      dynamic::object(),
+      std::make_unique<SonarResponderMock>(&successes));
+  // What the receiver read may have changed before it responded.
+  connection->invalidateResponses("");
+  pending->success(dynamic::object("stale", true));
+  connection->call(
+      "getAll",
+      dynamic::object(),
+      std::make_unique<SonarResponderMock>(&successes));
+  EXPECT_EQ(calls, 2);
+
+  std::vector<dynamic> errors;
+  for (int i = 0; i < 2; i++) {
+    connection->call(
+        "getAll",
+        dynamic::object("fail", true),
+        std::make_unique<SonarResponderMock>(&successes, &errors));
+  }
+  EXPECT_EQ(calls, 4);
+  EXPECT_EQ(errors.size(), 2);
+}
+
+TEST(SonarResponseCacheTests, testDropsLeastRecentlyServedResponses) {
+  auto cache = std::make_shared<SonarResponseCache>(16);
+  cache->cacheMethod("get", "");
+  std::vector<dynamic> successes;
+  const auto call = [&](int id, const std::string& response) {
+    std::unique_ptr<SonarResponder> responder =
+        std::make_unique<SonarResponderMock>(&successes);
+    if (!cache->respond("get", dynamic::object("id", id), responder)) {
+      responder->successJson(response);
+      return false;
+    }
+    return true;
+  };
+
+  EXPECT_FALSE(call(1, "\"aaaaa\""));
+  EXPECT_FALSE(call(2, "\"bbbbb\""));
+  EXPECT_EQ(cache->bytes(), 14);
+  EXPECT_TRUE(call(1, ""));
+  EXPECT_FALSE(call(3, "\"ccccc\""));
+  // 2 was served least recently.
+  EXPECT_EQ(cache->size(), 2);
+  EXPECT_TRUE(call(1, ""));
+  EXPECT_FALSE(call(2, "\"bbbbb\""));
+  EXPECT_EQ(successes.back(), "bbbbb");
+
+  EXPECT_FALSE(call(4, "\"far more than sixteen bytes\""));
+  EXPECT_FALSE(call(4, "\"small\""));
+  EXPECT_TRUE(call(4, ""));
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
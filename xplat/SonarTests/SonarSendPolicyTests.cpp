@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarSendPolicy.h>
+
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+TEST(SonarSendPolicyTests, testTokenBucketAllowsBurstThenRate) {
+  SonarSendPolicy policy;
+  policy.rate = 10;
+  policy.burst = 3;
+  SonarSendThrottle throttle(policy);
+
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_TRUE(throttle.admit(start));
+  EXPECT_TRUE(throttle.admit(start));
+  EXPECT_TRUE(throttle.admit(start));
+  EXPECT_FALSE(throttle.admit(start));
+  // One token every 100ms.
+  EXPECT_FALSE(throttle.admit(start + std::chrono::milliseconds(50)));
+  EXPECT_TRUE(throttle.admit(start + std::chrono::milliseconds(150)));
+  EXPECT_FALSE(throttle.admit(start + std::chrono::milliseconds(150)));
+  // Quiet periods don't accumulate more than the burst.
+  const auto later = start + std::chrono::seconds(60);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(throttle.admit(later));
+  }
+  EXPECT_FALSE(throttle.admit(later));
+  EXPECT_EQ(throttle.dropped(), 4);
+}
+
+TEST(SonarSendPolicyTests, testSamplingKeepsOneInN) {
+  SonarSendPolicy policy;
+  policy.sampleEvery = 4;
+  SonarSendThrottle throttle(policy);
+
+  int admitted = 0;
+  for (int i = 0; i < 20; i++) {
+    admitted += throttle.admit() ? 1 : 0;
+  }
+  EXPECT_EQ(admitted, 5);
+  EXPECT_EQ(throttle.dropped(), 15);
+}
+
+TEST(SonarSendPolicyTests, testFromDynamic) {
+  const auto policy = SonarSendPolicy::fromDynamic(
+      dynamic::object("rate", 5)("burst", 2.5)("sampleEvery", 3));
+  EXPECT_EQ(policy.rate, 5);
+  EXPECT_EQ(policy.burst, 2.5);
+  EXPECT_EQ(policy.sampleEvery, 3);
+  EXPECT_FALSE(policy.isUnlimited());
+
+  EXPECT_TRUE(SonarSendPolicy::fromDynamic(dynamic::object()).isUnlimited());
+  EXPECT_THROW(
+      SonarSendPolicy::fromDynamic(dynamic::object("rate", -1)),
+      std::invalid_argument);
+  EXPECT_THROW(
+      SonarSendPolicy::fromDynamic(dynamic::object("rate", "fast")),
+      std::invalid_argument);
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
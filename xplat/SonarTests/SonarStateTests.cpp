@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarState.h>
+#include <Sonar/SonarStep.h>
+
+#include <gtest/gtest.h>
+#include <algorithm>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+TEST(SonarStateTests, testLogIsBounded) {
+  SonarState state;
+  for (int i = 0; i < 1000; i++) {
+    auto step = state.start("Connect to desktop");
+    step->fail("Port not open");
+  }
+  state.start("Connect securely")->complete();
+
+  const auto log = state.getState();
+  EXPECT_LE(std::count(log->begin(), log->end(), '\n'), 256);
+  // The newest entry is always kept.
+  EXPECT_NE(log->find("[Success] Connect securely ("), std::string::npos);
+  EXPECT_EQ(state.getStateElements()->size(), 2);
+}
+
+TEST(SonarStateTests, testStepTimingsAreRecorded) {
+  SonarState state;
+  state.start("Generate CSR")->complete();
+  state.start("Generate CSR")->fail("");
+
+  const auto elements = state.getStateElements();
+  ASSERT_EQ(elements->size(), 1);
+  const auto& timings = (*elements)[0].timings_;
+  EXPECT_EQ(timings.count, 2);
+  uint32_t bucketed = 0;
+  for (auto bucket : timings.buckets) {
+    bucketed += bucket;
+  }
+  EXPECT_EQ(bucketed, 2);
+}
+
+TEST(SonarStateTests, testSnapshotsFollowNewSteps) {
+  SonarState state;
+  state.start("Connect to desktop")->complete();
+  const auto log = state.getState();
+  const auto elements = state.getStateElements();
+  // Unchanged polls get the same snapshot rather than a copy of it.
+  EXPECT_EQ(state.getState(), log);
+  EXPECT_EQ(state.getStateElements(), elements);
+  EXPECT_EQ(elements->size(), 1);
+
+  auto step = state.start("Connect securely");
+  EXPECT_EQ(state.getStateElements()->size(), 2);
+  EXPECT_EQ((*state.getStateElements())[1].state_, State::in_progress);
+  EXPECT_EQ(*state.getState(), *log);
+  EXPECT_EQ(elements->size(), 1);
+  step->complete();
+  EXPECT_EQ((*state.getStateElements())[1].state_, State::success);
+  EXPECT_NE(state.getState()->find("Connect securely"), std::string::npos);
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
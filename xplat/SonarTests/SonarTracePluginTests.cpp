@@ -0,0 +1,162 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarTracePlugin.h>
+#include <SonarTestLib/SonarConnectionMock.h>
+#include <SonarTestLib/SonarResponderMock.h>
+
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <thread>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+// Flushes are only made by the tests.
+constexpr std::chrono::hours kNeverFlush(1);
+
+constexpr int kBegin = 'B';
+constexpr int kEnd = 'E';
+constexpr int kInstant = 'i';
+
+void call(
+    SonarConnectionMock& connection,
+    folly::StringPiece method,
+    const dynamic& params) {
+  connection.receivers_.at(method)(
+      params, std::make_unique<SonarResponderMock>());
+}
+
+class SonarTracePluginTests : public ::testing::Test {
+ protected:
+  // Name, thread and phase of each event, leaving out the timestamps.
+  dynamic eventsWithoutTimestamps() {
+    const auto& events = connection_->sent_.at("traceChunk")["events"];
+    auto result = dynamic::array();
+    for (size_t i = 0; i < events.size(); i += 4) {
+      result.push_back(events[i + 1]);
+      result.push_back(events[i + 2]);
+      result.push_back(events[i + 3]);
+    }
+    return result;
+  }
+
+  std::shared_ptr<SonarConnectionMock> connection_ =
+      std::make_shared<SonarConnectionMock>();
+};
+
+TEST_F(SonarTracePluginTests, testStreamsEventsSinceStart) {
+  SonarTracePlugin plugin(16, kNeverFlush);
+  auto decode = plugin.name("decode");
+  auto frame = plugin.name("frame");
+  decode.instant();
+  plugin.didConnect(connection_);
+  call(*connection_, "stream", dynamic::object("enabled", true));
+
+  {
+    SonarTraceScope scope(decode);
+    frame.instant();
+  }
+  std::thread([&] { frame.instant(); }).join();
+  plugin.flush();
+
+  const auto& chunk = connection_->sent_.at("traceChunk");
+  EXPECT_EQ(
+      chunk["names"],
+      dynamic::object("offset", 0)("names", dynamic::array("decode", "frame")));
+  EXPECT_EQ(chunk["threads"].size(), 2);
+  EXPECT_EQ(chunk["count"], 4);
+  EXPECT_EQ(chunk["dropped"], 0);
+  EXPECT_EQ(
+      eventsWithoutTimestamps(),
+      dynamic::array(
+          0, 0, kBegin, 1, 0, kInstant, 0, 0, kEnd, 1, 1, kInstant));
+
+  // Nothing new.
+  connection_->sent_.clear();
+  plugin.flush();
+  EXPECT_EQ(connection_->sent_.count("traceChunk"), 0);
+  plugin.didDisconnect();
+}
+
+TEST_F(SonarTracePluginTests, testCountsOverwrittenEventsAsDropped) {
+  SonarTracePlugin plugin(4, kNeverFlush);
+  auto tick = plugin.name("tick");
+  plugin.didConnect(connection_);
+  call(*connection_, "stream", dynamic::object("enabled", true));
+
+  for (int i = 0; i < 10; i++) {
+    tick.instant();
+  }
+  plugin.flush();
+
+  const auto& chunk = connection_->sent_.at("traceChunk");
+  EXPECT_EQ(chunk["count"], 4);
+  EXPECT_EQ(chunk["dropped"], 6);
+  plugin.didDisconnect();
+}
+
+TEST_F(SonarTracePluginTests, testDumpSendsWhatTheRingsHold) {
+  SonarTracePlugin plugin(16, kNeverFlush);
+  auto tick = plugin.name("tick");
+  tick.instant();
+  tick.instant();
+  plugin.didConnect(connection_);
+
+  call(*connection_, "dump", dynamic::object);
+  EXPECT_EQ(connection_->sent_.at("traceChunk")["dump"], true);
+  EXPECT_EQ(
+      eventsWithoutTimestamps(), dynamic::array(0, 0, kInstant, 0, 0, kInstant));
+  plugin.didDisconnect();
+}
+
+class BinaryConnectionMock : public SonarConnectionMock {
+ public:
+  bool sendBinary(
+      folly::StringPiece method,
+      const folly::dynamic& metadata,
+      std::unique_ptr<folly::IOBuf> data) override {
+    sent_[method.str()] = metadata;
+    data_ = std::move(data);
+    return true;
+  }
+
+  bool supportsBinary() const override {
+    return true;
+  }
+
+  std::unique_ptr<folly::IOBuf> data_;
+};
+
+TEST_F(SonarTracePluginTests, testSendsBinaryRecords) {
+  auto connection = std::make_shared<BinaryConnectionMock>();
+  SonarTracePlugin plugin(16, kNeverFlush);
+  plugin.name("first");
+  auto second = plugin.name("second");
+  plugin.didConnect(connection);
+  call(*connection, "stream", dynamic::object("enabled", true));
+
+  second.begin();
+  plugin.flush();
+
+  EXPECT_EQ(connection->sent_.at("traceChunk")["count"], 1);
+  ASSERT_EQ(connection->data_->length(), 16);
+  const uint8_t* record = connection->data_->data();
+  // Name index, thread index, phase and padding after the timestamp.
+  EXPECT_EQ(
+      std::vector<uint8_t>(record + 8, record + 16),
+      std::vector<uint8_t>({1, 0, 0, 0, 0, 0, 'B', 0}));
+  plugin.didDisconnect();
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -0,0 +1,134 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *
+ *  This source code is licensed under the MIT license found in the LICENSE
+ *  file in the root directory of this source tree.
+ *
+ */
+
+#include <Sonar/SonarClient.h>
+#include <Sonar/SonarTypedPlugin.h>
+#include <SonarTestLib/SonarWebSocketMock.h>
+
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace sonar {
+namespace test {
+
+using folly::dynamic;
+
+struct Highlight {
+  std::string id;
+  bool isAlignmentMode = false;
+
+  static constexpr auto sonarFields() {
+    return std::make_tuple(
+        sonarField("id", &Highlight::id),
+        sonarField("isAlignmentMode", &Highlight::isAlignmentMode));
+  }
+};
+
+class TypedPlugin : public SonarTypedPlugin<TypedPlugin> {
+ public:
+  std::string identifier() const override {
+    return "Typed";
+  }
+
+  void onConnect() {
+    connected = true;
+  }
+
+  void onDisconnect() {
+    connected = false;
+  }
+
+  void ping(const dynamic& params, std::unique_ptr<SonarResponder> responder) {
+    responder->success(dynamic::object("pong", params["value"]));
+  }
+
+  void setHighlighted(
+      const Highlight& highlight,
+      std::unique_ptr<SonarResponder> responder) {
+    highlighted = highlight.id;
+    alignmentMode = highlight.isAlignmentMode;
+    responder->success(dynamic::object());
+  }
+
+  static constexpr auto sonarReceivers() {
+    return std::make_tuple(
+        sonarReceiver("ping", &TypedPlugin::ping),
+        sonarReceiver("setHighlighted", &TypedPlugin::setHighlighted));
+  }
+
+  bool connected = false;
+  std::string highlighted;
+  bool alignmentMode = false;
+};
+
+TEST(SonarTypedPluginTests, testDispatchesToMembers) {
+  auto state = std::make_shared<SonarState>();
+  auto socket = new SonarWebSocketMock;
+  SonarClient client(std::unique_ptr<SonarWebSocketMock>{socket}, state);
+  client.start();
+  auto plugin = std::make_shared<TypedPlugin>();
+  client.addPlugin(plugin);
+  socket->callbacks->onMessageReceived(dynamic::object("method", "init")(
+      "params", dynamic::object("plugin", "Typed")));
+  EXPECT_TRUE(plugin->connected);
+
+  socket->callbacks->onMessageReceived(
+      dynamic::object("id", 1)("method", "execute")(
+          "params",
+          dynamic::object("api", "Typed")("method", "ping")(
+              "params", dynamic::object("value", 3))));
+  EXPECT_EQ(
+      socket->messages.back(),
+      dynamic::object("id", 1)("success", dynamic::object("pong", 3)));
+
+  socket->callbacks->onMessageReceived(
+      dynamic::object("id", 2)("method", "execute")(
+          "params",
+          dynamic::object("api", "Typed")("method", "setHighlighted")(
+              "params",
+              dynamic::object("id", "0x1")("isAlignmentMode", true))));
+  EXPECT_EQ(plugin->highlighted, "0x1");
+  EXPECT_TRUE(plugin->alignmentMode);
+
+  socket->callbacks->onMessageReceived(dynamic::object("method", "deinit")(
+      "params", dynamic::object("plugin", "Typed")));
+  EXPECT_FALSE(plugin->connected);
+}
+
+class Many : public SonarTypedPlugin<Many> {
+ public:
+  std::string identifier() const override {
+    return "Many";
+  }
+  void receiver(const dynamic&, std::unique_ptr<SonarResponder>) {}
+  static constexpr auto sonarReceivers() {
+    return std::make_tuple(
+        sonarReceiver("getRoot", &Many::receiver),
+        sonarReceiver("getNodes", &Many::receiver),
+        sonarReceiver("setData", &Many::receiver),
+        sonarReceiver("setHighlighted", &Many::receiver),
+        sonarReceiver("setSearchActive", &Many::receiver),
+        sonarReceiver("isSearchActive", &Many::receiver),
+        sonarReceiver("getSearchResults", &Many::receiver));
+  }
+};
+
+TEST(SonarTypedPluginTests, testPerfectHashFindsEveryMethod) {
+  Many plugin;
+  SonarTypedDispatcher<Many> dispatcher(&plugin);
+  const auto methods = dispatcher.methods();
+  for (size_t i = 0; i < methods.size(); i++) {
+    EXPECT_EQ(dispatcher.find(methods[i]), static_cast<int>(i));
+  }
+  EXPECT_EQ(dispatcher.find("getRootX"), -1);
+  EXPECT_EQ(dispatcher.find(""), -1);
+}
+
+} // namespace test
+} // namespace sonar
+} // namespace facebook
@@ -94,6 +94,24 @@ TEST_F(SonarWebSocketImplTerminationTest, testStartedEventBaseDoesntHang) {
   connectionThread.join();
 }
 
+TEST_F(SonarWebSocketImplTerminationTest, testSharedEventBaseDoesntHang) {
+  auto eventBase = new EventBase();
+  auto thread = std::thread([eventBase](){
+    eventBase->loopForever();
+  });
+  auto config = SonarInitConfig {
+    DeviceData {},
+    eventBase,
+    eventBase
+  };
+  auto instance = std::make_shared<SonarWebSocketImpl>(config, state, contextStore);
+
+  instance->start();
+
+  eventBase->terminateLoopSoon();
+  thread.join();
+}
+
 } // namespace test
 } // namespace sonar
 } // namespace facebook